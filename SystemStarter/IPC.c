@@ -94,6 +94,10 @@ startupItemTerminated(CFMachPortRef aMachPort, void *anInfo)
 			 * if it was successful or it failed.
 			 */
 			RemoveItemFromWaitingList(aStartupContext, anItem);
+
+			/* Let whatever was waiting on it go ahead. */
+			if (aStartupContext->aGraph)
+				StartupGraphItemFinished(aStartupContext->aGraph, anItem);
 		}
 	}
 	if (aTerminationContext)
@@ -29,6 +29,8 @@
 #include <sys/sysctl.h>
 #include <sys/mman.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <limits.h>
@@ -545,295 +547,488 @@ CFMutableArrayRef StartupItemListCreateDependentsList(CFMutableArrayRef anItemLi
 	return aDependents;
 }
 
-/**
- * countUnmetRequirements counts the number of items in anItemList
- * which are pending in aStatusDict.
- **/
-static int countUnmetRequirements(CFDictionaryRef aStatusDict, CFArrayRef anItemList)
-{
-	int aCount = 0;
-	CFIndex anItemCount = CFArrayGetCount(anItemList);
-	CFIndex anItemIndex;
+/*
+ * The dependency graph behind StartupGraphGetNext(). Every edge is worked
+ * out once, up front, from the Requires, Uses and Provides lists; after that
+ * an item's exit only touches the items and services that were waiting on it.
+ */
 
-	for (anItemIndex = 0; anItemIndex < anItemCount; anItemIndex++) {
-		CFStringRef anItem = CFArrayGetValueAtIndex(anItemList, anItemIndex);
-		CFStringRef aStatus = CFDictionaryGetValue(aStatusDict, anItem);
+enum {
+	kNodeWaiting = 0,	/* dependencies outstanding, or parked */
+	kNodeQueued,		/* on the ready queue */
+	kNodeRunning,
+	kNodeDone,		/* ran, or was skipped as a duplicate */
+	kNodeAbandoned		/* can never run; stays on the waiting list */
+};
+
+typedef struct StartupNodeStorage {
+	CFMutableDictionaryRef anItem;
+	CFIndex aDomain;
+	CFIndex *aProvides;		/* services this item provides */
+	CFIndex aProvidesCount;
+	CFIndex *aWaiters;		/* items waiting for this one to finish */
+	CFIndex aWaitersCount;
+	int aHardPending;		/* required services not yet up */
+	int aSoftPending;		/* items that must finish first */
+	int aState;
+	CFIndex aReleasedBy;		/* whose exit made this item ready, or -1 */
+	CFAbsoluteTime aReadyTime;
+	CFAbsoluteTime aStartTime;
+	CFAbsoluteTime aFinishTime;
+} *StartupNode;
+
+typedef struct StartupServiceStorage {
+	CFStringRef aName;
+	CFIndex *aProviders;
+	CFIndex aProvidersCount;
+	CFIndex *aRequirers;		/* items which require it, when starting */
+	CFIndex aRequirersCount;
+	CFIndex *aParked;		/* items held back while a provider runs */
+	CFIndex aParkedCount;
+	CFIndex aUnfinished;		/* providers that have not finished */
+	CFIndex aRunning;		/* providers that are running */
+	Boolean anUp;			/* some provider succeeded */
+} *StartupService;
+
+struct StartupGraphStorage {
+	Action anAction;
+	CFIndex aConcurrency;
+	CFIndex aRunning;
+	CFMutableDictionaryRef aStatusDict;
+	CFMutableDictionaryRef aNodeIndex;	/* item -> node index + 1 */
+	CFIndex aNodeCount;
+	struct StartupNodeStorage *aNodes;
+	CFIndex aServiceCount;
+	struct StartupServiceStorage *aServices;
+	CFIndex *aQueue;			/* ring of ready node indexes */
+	CFIndex aQueueHead;
+	CFIndex aQueueCount;
+	CFAbsoluteTime aCreateTime;
+};
+
+/* Appends to an array that grows by doubling. Boot graphs are small; running
+ * out of memory here is not something SystemStarter recovers from.
+ */
+static void appendIndex(CFIndex **anArray, CFIndex *aCount, CFIndex anIndex)
+{
+	if ((*aCount & (*aCount - 1)) == 0) {
+		CFIndex *aNewArray = realloc(*anArray, (*aCount ? *aCount * 2 : 1) * sizeof(CFIndex));
 
-		if (!aStatus || !CFEqual(aStatus, kRunSuccess)) {
-			CF_syslog(LOG_DEBUG, CFSTR("\tFailed requirement/uses: %@"), anItem);
-			aCount++;
-		}
+		assert(aNewArray != NULL);
+		*anArray = aNewArray;
 	}
+	(*anArray)[(*aCount)++] = anIndex;
+}
+
+static CFIndex startupGraphNodeIndex(StartupGraph aGraph, CFDictionaryRef anItem)
+{
+	const void *aValue;
 
-	return aCount;
+	if (!CFDictionaryGetValueIfPresent(aGraph->aNodeIndex, anItem, &aValue))
+		return -1;
+	return (CFIndex) (intptr_t) aValue - 1;
 }
 
-/**
- * countDependantsPresent counts the number of items in aWaitingList
- * which depend on items in anItemList.
- **/
-static int countDependantsPresent(CFArrayRef aWaitingList, CFArrayRef anItemList, CFStringRef aKey)
+static CFIndex startupGraphServiceIndex(StartupGraph aGraph, CFMutableDictionaryRef aServiceIndex, CFStringRef aName, Boolean aCreate)
 {
-	int aCount = 0;
-	CFIndex anItemCount = CFArrayGetCount(anItemList);
-	CFIndex anItemIndex;
+	const void *aValue;
 
-	for (anItemIndex = 0; anItemIndex < anItemCount; anItemIndex++) {
-		CFStringRef anItem = CFArrayGetValueAtIndex(anItemList, anItemIndex);
-		CFArrayRef aMatchesList = startupItemListCopyMatches(aWaitingList, aKey, anItem);
+	if (CFDictionaryGetValueIfPresent(aServiceIndex, aName, &aValue))
+		return (CFIndex) (intptr_t) aValue - 1;
+	if (!aCreate)
+		return -1;
 
-		if (aMatchesList) {
-			aCount = aCount + CFArrayGetCount(aMatchesList);
-			CFRelease(aMatchesList);
-		}
+	if ((aGraph->aServiceCount & (aGraph->aServiceCount - 1)) == 0) {
+		CFIndex aCapacity = aGraph->aServiceCount ? aGraph->aServiceCount * 2 : 1;
+		StartupService aNewServices = realloc(aGraph->aServices, aCapacity * sizeof(struct StartupServiceStorage));
+
+		assert(aNewServices != NULL);
+		aGraph->aServices = aNewServices;
 	}
+	bzero(&aGraph->aServices[aGraph->aServiceCount], sizeof(struct StartupServiceStorage));
+	aGraph->aServices[aGraph->aServiceCount].aName = CFRetain(aName);
+	CFDictionarySetValue(aServiceIndex, aName, (const void *) (intptr_t) (aGraph->aServiceCount + 1));
 
-	return aCount;
+	return aGraph->aServiceCount++;
 }
 
-/**
- * pendingAntecedents returns TRUE if any antecedents of this item
- * are currently running, have not yet run, or none exist.
- **/
-static Boolean
-pendingAntecedents(CFArrayRef aWaitingList, CFDictionaryRef aStatusDict, CFArrayRef anAntecedentList, Action anAction)
+/* Makes aBefore finish before anAfter may start. */
+static void startupGraphAddEdge(StartupGraph aGraph, CFIndex aBefore, CFIndex anAfter)
+{
+	if (aBefore == anAfter)
+		return;
+	appendIndex(&aGraph->aNodes[aBefore].aWaiters, &aGraph->aNodes[aBefore].aWaitersCount, anAfter);
+	aGraph->aNodes[anAfter].aSoftPending++;
+}
+
+static void startupGraphEnqueue(StartupGraph aGraph, CFIndex aNodeIndex)
 {
-	int aPendingFlag = FALSE;
+	StartupNode aNode = &aGraph->aNodes[aNodeIndex];
 
-	CFIndex anAntecedentCount = CFArrayGetCount(anAntecedentList);
-	CFIndex anAntecedentIndex;
+	if (aNode->aState != kNodeWaiting)
+		return;
+	aNode->aState = kNodeQueued;
+	aGraph->aQueue[(aGraph->aQueueHead + aGraph->aQueueCount++) % aGraph->aNodeCount] = aNodeIndex;
+}
 
-	for (anAntecedentIndex = 0; anAntecedentIndex < anAntecedentCount; ++anAntecedentIndex) {
-		CFStringRef anAntecedent = CFArrayGetValueAtIndex(anAntecedentList, anAntecedentIndex);
-		CFStringRef aKey = (anAction == kActionStart) ? kProvidesKey : kUsesKey;
-		CFArrayRef aMatchesList = startupItemListCopyMatches(aWaitingList, aKey, anAntecedent);
+static void startupGraphCheckReady(StartupGraph aGraph, CFIndex aNodeIndex, CFIndex aReleasedBy)
+{
+	StartupNode aNode = &aGraph->aNodes[aNodeIndex];
 
-		if (aMatchesList) {
-			CFIndex aMatchesListCount = CFArrayGetCount(aMatchesList);
-			CFIndex aMatchesListIndex;
+	if (aNode->aState == kNodeWaiting && aNode->aHardPending == 0 && aNode->aSoftPending == 0) {
+		aNode->aReleasedBy = aReleasedBy;
+		aNode->aReadyTime = CFAbsoluteTimeGetCurrent();
+		startupGraphEnqueue(aGraph, aNodeIndex);
+	}
+}
 
-			for (aMatchesListIndex = 0; aMatchesListIndex < aMatchesListCount; ++aMatchesListIndex) {
-				CFDictionaryRef anItem = CFArrayGetValueAtIndex(aMatchesList, aMatchesListIndex);
+static void startupGraphFinish(StartupGraph aGraph, CFIndex aNodeIndex, int aState);
 
-				if (!anItem ||
-				    !CFDictionaryGetValue(anItem, kPIDKey) || !CFDictionaryGetValue(aStatusDict, anAntecedent)) {
-					aPendingFlag = TRUE;
-					break;
-				}
-			}
+/* An item whose required service will never come up. Whatever waited on it
+ * only for ordering may go ahead without it.
+ */
+static void startupGraphAbandon(StartupGraph aGraph, CFIndex aNodeIndex)
+{
+	StartupNode aNode = &aGraph->aNodes[aNodeIndex];
 
-			CFRelease(aMatchesList);
+	if (aNode->aState != kNodeWaiting && aNode->aState != kNodeQueued)
+		return;
 
-			if (aPendingFlag)
-				break;
-		}
-	}
-	return (aPendingFlag);
+	CF_syslog(LOG_DEBUG, CFSTR("%@ cannot run: a required service failed"), CFDictionaryGetValue(aNode->anItem, kDescriptionKey));
+	startupGraphFinish(aGraph, aNodeIndex, kNodeAbandoned);
 }
 
-/**
- * checkForDuplicates returns TRUE if an item provides the same service as a
- * pending item, or an item that already succeeded.
- **/
-static Boolean checkForDuplicates(CFArrayRef aWaitingList, CFDictionaryRef aStatusDict, CFDictionaryRef anItem)
+static void startupGraphFinish(StartupGraph aGraph, CFIndex aNodeIndex, int aState)
 {
-	int aDuplicateFlag = FALSE;
+	StartupNode aNode = &aGraph->aNodes[aNodeIndex];
+	CFIndex anIndex, anInner;
+
+	if (aNode->aState == kNodeRunning) {
+		aGraph->aRunning--;
+		for (anIndex = 0; anIndex < aNode->aProvidesCount; anIndex++)
+			aGraph->aServices[aNode->aProvides[anIndex]].aRunning--;
+	}
+	aNode->aState = aState;
+	aNode->aFinishTime = CFAbsoluteTimeGetCurrent();
+
+	for (anIndex = 0; anIndex < aNode->aProvidesCount; anIndex++) {
+		StartupService aService = &aGraph->aServices[aNode->aProvides[anIndex]];
+		CFStringRef aStatus = CFDictionaryGetValue(aGraph->aStatusDict, aService->aName);
 
-	CFArrayRef aProvidesList = CFDictionaryGetValue(anItem, kProvidesKey);
-	CFIndex aProvidesCount = aProvidesList ? CFArrayGetCount(aProvidesList) : 0;
-	CFIndex aProvidesIndex;
+		aService->aUnfinished--;
 
-	for (aProvidesIndex = 0; aProvidesIndex < aProvidesCount; ++aProvidesIndex) {
-		CFStringRef aProvides = CFArrayGetValueAtIndex(aProvidesList, aProvidesIndex);
+		/* Items that were held back while this one ran get another look. */
+		for (anInner = 0; anInner < aService->aParkedCount; anInner++)
+			startupGraphEnqueue(aGraph, aService->aParked[anInner]);
+		aService->aParkedCount = 0;
 
-		/* If the service succeeded, return true. */
-		CFStringRef aStatus = CFDictionaryGetValue(aStatusDict, aProvides);
+		if (aService->anUp)
+			continue;
 		if (aStatus && CFEqual(aStatus, kRunSuccess)) {
-			aDuplicateFlag = TRUE;
-			break;
-		}
-		/*
-		 * Otherwise test if any item is currently running which
-		 * might provide that service.
-		 */
-		else {
-			CFArrayRef aMatchesList = startupItemListCopyMatches(aWaitingList, kProvidesKey, aProvides);
-			if (aMatchesList) {
-				CFIndex aMatchesListCount = CFArrayGetCount(aMatchesList);
-				CFIndex aMatchesListIndex;
-
-				for (aMatchesListIndex = 0; aMatchesListIndex < aMatchesListCount; ++aMatchesListIndex) {
-					CFDictionaryRef anDupItem = CFArrayGetValueAtIndex(aMatchesList, aMatchesListIndex);
-					if (anDupItem && CFDictionaryGetValue(anDupItem, kPIDKey)) {
-						/*
-						 * Item is running, avoid
-						 * race condition.
-						 */
-						aDuplicateFlag = TRUE;
-						break;
-					} else {
-						CFNumberRef anItemDomain = CFDictionaryGetValue(anItem, kDomainKey);
-						CFNumberRef anotherItemDomain = CFDictionaryGetValue(anDupItem, kDomainKey);
-						/*
-						 * If anItem was found later
-						 * than aDupItem, stall
-						 * anItem until aDupItem
-						 * runs.
-						 */
-						if (anItemDomain &&
-						    anotherItemDomain &&
-						    CFNumberCompare(anItemDomain, anotherItemDomain,
-								    NULL) == kCFCompareGreaterThan) {
-							/*
-							 * Item not running,
-							 * but takes
-							 * precedence.
-							 */
-							aDuplicateFlag = TRUE;
-							break;
-						}
-					}
-				}
+			aService->anUp = TRUE;
+			for (anInner = 0; anInner < aService->aRequirersCount; anInner++) {
+				CFIndex aRequirer = aService->aRequirers[anInner];
 
-				CFRelease(aMatchesList);
-				if (aDuplicateFlag)
-					break;
+				aGraph->aNodes[aRequirer].aHardPending--;
+				startupGraphCheckReady(aGraph, aRequirer, aNodeIndex);
 			}
+		} else if (aService->aUnfinished == 0) {
+			for (anInner = 0; anInner < aService->aRequirersCount; anInner++)
+				startupGraphAbandon(aGraph, aService->aRequirers[anInner]);
 		}
 	}
-	return (aDuplicateFlag);
+
+	for (anIndex = 0; anIndex < aNode->aWaitersCount; anIndex++) {
+		CFIndex aWaiter = aNode->aWaiters[anIndex];
+
+		aGraph->aNodes[aWaiter].aSoftPending--;
+		startupGraphCheckReady(aGraph, aWaiter, aNodeIndex);
+	}
 }
 
-CFMutableDictionaryRef StartupItemListGetNext(CFArrayRef aWaitingList, CFDictionaryRef aStatusDict, Action anAction)
+/* Adds an edge from every provider of aName to aNodeIndex. */
+static void startupGraphAfterProviders(StartupGraph aGraph, CFMutableDictionaryRef aServiceIndex, CFStringRef aName, CFIndex aNodeIndex)
 {
-	CFMutableDictionaryRef aNextItem = NULL;
-	CFIndex aWaitingCount = CFArrayGetCount(aWaitingList);
-	int aMinFailedAntecedents = INT_MAX;
-	CFIndex aWaitingIndex;
+	CFIndex aServiceNumber = startupGraphServiceIndex(aGraph, aServiceIndex, aName, FALSE);
+	CFIndex anIndex;
 
-	switch (anAction) {
-	case kActionStart:
-		break;
-	case kActionStop:
-		break;
-	case kActionRestart:
-		break;
-	default:
+	if (aServiceNumber == -1)
+		return;
+	for (anIndex = 0; anIndex < aGraph->aServices[aServiceNumber].aProvidersCount; anIndex++)
+		startupGraphAddEdge(aGraph, aGraph->aServices[aServiceNumber].aProviders[anIndex], aNodeIndex);
+}
+
+StartupGraph StartupGraphCreate(CFArrayRef aWaitingList, CFMutableDictionaryRef aStatusDict, Action anAction, CFIndex aConcurrency)
+{
+	StartupGraph aGraph = calloc(1, sizeof(struct StartupGraphStorage));
+	CFMutableDictionaryRef aServiceIndex;
+	CFIndex aNodeIndex, anIndex, anInner;
+
+	if (!aGraph)
 		return NULL;
-	}
 
-	if (!aWaitingList || !aStatusDict || aWaitingCount <= 0)
+	aGraph->anAction = anAction;
+	aGraph->aConcurrency = aConcurrency;
+	aGraph->aStatusDict = (CFMutableDictionaryRef) CFRetain(aStatusDict);
+	aGraph->aCreateTime = CFAbsoluteTimeGetCurrent();
+	aGraph->aNodeCount = CFArrayGetCount(aWaitingList);
+	aGraph->aNodeIndex = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+	aGraph->aNodes = calloc(aGraph->aNodeCount ? aGraph->aNodeCount : 1, sizeof(struct StartupNodeStorage));
+	aGraph->aQueue = calloc(aGraph->aNodeCount ? aGraph->aNodeCount : 1, sizeof(CFIndex));
+	aServiceIndex = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+
+	if (!aGraph->aNodeIndex || !aGraph->aNodes || !aGraph->aQueue || !aServiceIndex) {
+		if (aServiceIndex)
+			CFRelease(aServiceIndex);
+		StartupGraphRelease(aGraph);
 		return NULL;
+	}
 
-	/**
-	 * Iterate through the items in aWaitingList and look for an optimally ready item.
-	 **/
-	for (aWaitingIndex = 0; aWaitingIndex < aWaitingCount; aWaitingIndex++) {
-		CFMutableDictionaryRef anItem = (CFMutableDictionaryRef) CFArrayGetValueAtIndex(aWaitingList, aWaitingIndex);
-		CFArrayRef anAntecedentList;
-		int aFailedAntecedentsCount = 0;	/* Number of unmet soft
-							 * depenancies */
-		Boolean aBestPick = FALSE;	/* Is this the best pick
-						 * so far?    */
-
-		/* Filter out running items. */
-		if (CFDictionaryGetValue(anItem, kPIDKey))
-			continue;
+	/* Who provides what. */
+	for (aNodeIndex = 0; aNodeIndex < aGraph->aNodeCount; aNodeIndex++) {
+		StartupNode aNode = &aGraph->aNodes[aNodeIndex];
+		CFArrayRef aProvidesList;
+		CFNumberRef aDomain;
 
-		/*
-		 * Filter out dupilicate services; if someone has
-		 * provided what we provide, we don't run.
-		 */
-		if (checkForDuplicates(aWaitingList, aStatusDict, anItem)) {
-			CF_syslog(LOG_DEBUG, CFSTR("Skipping %@ because of duplicate service."),
-				  CFDictionaryGetValue(anItem, kDescriptionKey));
-			continue;
+		aNode->anItem = (CFMutableDictionaryRef) CFArrayGetValueAtIndex(aWaitingList, aNodeIndex);
+		aNode->aReleasedBy = -1;
+		CFDictionarySetValue(aGraph->aNodeIndex, aNode->anItem, (const void *) (intptr_t) (aNodeIndex + 1));
+
+		if ((aDomain = CFDictionaryGetValue(aNode->anItem, kDomainKey)))
+			CFNumberGetValue(aDomain, kCFNumberCFIndexType, &aNode->aDomain);
+
+		aProvidesList = CFDictionaryGetValue(aNode->anItem, kProvidesKey);
+		for (anIndex = 0; aProvidesList && anIndex < CFArrayGetCount(aProvidesList); anIndex++) {
+			CFIndex aServiceNumber = startupGraphServiceIndex(aGraph, aServiceIndex, CFArrayGetValueAtIndex(aProvidesList, anIndex), TRUE);
+			StartupService aService = &aGraph->aServices[aServiceNumber];
+
+			appendIndex(&aNode->aProvides, &aNode->aProvidesCount, aServiceNumber);
+			appendIndex(&aService->aProviders, &aService->aProvidersCount, aNodeIndex);
+			aService->aUnfinished++;
 		}
+	}
+
+	for (aNodeIndex = 0; aNodeIndex < aGraph->aNodeCount; aNodeIndex++) {
+		StartupNode aNode = &aGraph->aNodes[aNodeIndex];
+		CFArrayRef aList;
+
 		/*
-		 * Dependencies don't matter when restarting an item;
-		 * stop here.
+		 * Of two items providing the same service, the one found in the
+		 * earlier domain goes first; the other only runs if it fails.
 		 */
-		if (anAction == kActionRestart) {
-			aNextItem = anItem;
+		for (anIndex = 0; anIndex < aNode->aProvidesCount; anIndex++) {
+			StartupService aService = &aGraph->aServices[aNode->aProvides[anIndex]];
+
+			for (anInner = 0; anInner < aService->aProvidersCount; anInner++) {
+				CFIndex anOther = aService->aProviders[anInner];
+
+				if (aGraph->aNodes[anOther].aDomain < aNode->aDomain)
+					startupGraphAddEdge(aGraph, anOther, aNodeIndex);
+			}
+		}
+
+		switch (anAction) {
+		case kActionStart:
+			/* Requires: wait until some provider has succeeded. */
+			aList = CFDictionaryGetValue(aNode->anItem, kRequiresKey);
+			for (anIndex = 0; aList && anIndex < CFArrayGetCount(aList); anIndex++) {
+				CFIndex aServiceNumber = startupGraphServiceIndex(aGraph, aServiceIndex, CFArrayGetValueAtIndex(aList, anIndex), TRUE);
+				StartupService aService = &aGraph->aServices[aServiceNumber];
+				CFStringRef aStatus = CFDictionaryGetValue(aStatusDict, aService->aName);
+
+				if (aStatus && CFEqual(aStatus, kRunSuccess))
+					continue;
+				appendIndex(&aService->aRequirers, &aService->aRequirersCount, aNodeIndex);
+				aNode->aHardPending++;
+			}
+			/* Uses: wait until every provider has finished, however it went. */
+			aList = CFDictionaryGetValue(aNode->anItem, kUsesKey);
+			for (anIndex = 0; aList && anIndex < CFArrayGetCount(aList); anIndex++)
+				startupGraphAfterProviders(aGraph, aServiceIndex, CFArrayGetValueAtIndex(aList, anIndex), aNodeIndex);
+			break;
+		case kActionStop:
+			/* Stopping runs the other way: providers go after their users. */
+			for (anInner = 0; anInner < 2; anInner++) {
+				aList = CFDictionaryGetValue(aNode->anItem, anInner ? kUsesKey : kRequiresKey);
+				for (anIndex = 0; aList && anIndex < CFArrayGetCount(aList); anIndex++) {
+					CFIndex aServiceNumber = startupGraphServiceIndex(aGraph, aServiceIndex, CFArrayGetValueAtIndex(aList, anIndex), FALSE);
+					CFIndex aProvider;
+
+					if (aServiceNumber == -1)
+						continue;
+					for (aProvider = 0; aProvider < aGraph->aServices[aServiceNumber].aProvidersCount; aProvider++)
+						startupGraphAddEdge(aGraph, aNodeIndex, aGraph->aServices[aServiceNumber].aProviders[aProvider]);
+				}
+			}
+			break;
+		default:
+			/* Dependencies don't matter when restarting an item. */
 			break;
 		}
-		anAntecedentList = CFDictionaryGetValue(anItem, ((anAction == kActionStart) ? kRequiresKey : kProvidesKey));
-
-		CF_syslog(LOG_DEBUG, CFSTR("Checking %@"), CFDictionaryGetValue(anItem, kDescriptionKey));
-
-		if (anAntecedentList)
-			CF_syslog(LOG_DEBUG, CFSTR("Antecedents: %@"), anAntecedentList);
-		else
-			syslog(LOG_DEBUG, "No antecedents");
-
-			/**
-			 * Filter out the items which have unsatisfied antecedents.
-			 **/
-		if (anAntecedentList &&
-		    ((anAction == kActionStart) ?
-		     countUnmetRequirements(aStatusDict, anAntecedentList) :
-		     countDependantsPresent(aWaitingList, anAntecedentList, kRequiresKey)))
-			continue;
+	}
 
-			/**
-			 * anItem has all hard dependancies met; check for soft dependancies.
-			 * We'll favor the item with the fewest unmet soft dependancies here.
-			 **/
-		anAntecedentList = CFDictionaryGetValue(anItem, ((anAction == kActionStart) ? kUsesKey : kProvidesKey));
-
-		if (anAntecedentList)
-			CF_syslog(LOG_DEBUG, CFSTR("Soft dependancies: %@"), anAntecedentList);
-		else
-			syslog(LOG_DEBUG, "No soft dependancies");
-
-		if (anAntecedentList) {
-			aFailedAntecedentsCount =
-			    ((anAction == kActionStart) ?
-			     countUnmetRequirements(aStatusDict, anAntecedentList) :
-			     countDependantsPresent(aWaitingList, anAntecedentList, kUsesKey));
-		} else {
-			if (aMinFailedAntecedents > 0)
-				aBestPick = TRUE;
+	CFRelease(aServiceIndex);
+
+	/* Nothing provides some required services at all. */
+	for (anIndex = 0; anIndex < aGraph->aServiceCount; anIndex++) {
+		StartupService aService = &aGraph->aServices[anIndex];
+
+		if (aService->aProvidersCount == 0) {
+			for (anInner = 0; anInner < aService->aRequirersCount; anInner++)
+				startupGraphAbandon(aGraph, aService->aRequirers[anInner]);
 		}
+	}
+
+	for (aNodeIndex = 0; aNodeIndex < aGraph->aNodeCount; aNodeIndex++)
+		startupGraphCheckReady(aGraph, aNodeIndex, -1);
+
+	return aGraph;
+}
+
+void StartupGraphRelease(StartupGraph aGraph)
+{
+	CFIndex anIndex;
+
+	if (!aGraph)
+		return;
+
+	for (anIndex = 0; aGraph->aNodes && anIndex < aGraph->aNodeCount; anIndex++) {
+		free(aGraph->aNodes[anIndex].aProvides);
+		free(aGraph->aNodes[anIndex].aWaiters);
+	}
+	for (anIndex = 0; anIndex < aGraph->aServiceCount; anIndex++) {
+		CFRelease(aGraph->aServices[anIndex].aName);
+		free(aGraph->aServices[anIndex].aProviders);
+		free(aGraph->aServices[anIndex].aRequirers);
+		free(aGraph->aServices[anIndex].aParked);
+	}
+	if (aGraph->aNodeIndex)
+		CFRelease(aGraph->aNodeIndex);
+	if (aGraph->aStatusDict)
+		CFRelease(aGraph->aStatusDict);
+	free(aGraph->aNodes);
+	free(aGraph->aServices);
+	free(aGraph->aQueue);
+	free(aGraph);
+}
+
+CFMutableDictionaryRef StartupGraphGetNext(StartupGraph aGraph, StartupContext aStartupContext)
+{
+	while (aGraph->aQueueCount > 0 && (aGraph->aConcurrency <= 0 || aGraph->aRunning < aGraph->aConcurrency)) {
+		CFIndex aNodeIndex = aGraph->aQueue[aGraph->aQueueHead];
+		StartupNode aNode = &aGraph->aNodes[aNodeIndex];
+		CFIndex anIndex;
+		Boolean aParked = FALSE;
+
+		aGraph->aQueueHead = (aGraph->aQueueHead + 1) % aGraph->aNodeCount;
+		aGraph->aQueueCount--;
+
+		/* Abandoned since it was queued. */
+		if (aNode->aState != kNodeQueued)
+			continue;
+		aNode->aState = kNodeWaiting;
 
 		/*
-		 * anItem has unmet dependencies that will
-		 * likely be met in the future, so delay it
+		 * Filter out duplicate services; if someone has provided what
+		 * we provide, we don't run. If someone is providing it right
+		 * now, wait and see how that goes.
 		 */
-		if (aFailedAntecedentsCount > 0 && pendingAntecedents(aWaitingList, aStatusDict, anAntecedentList, anAction)) {
+		for (anIndex = 0; anIndex < aNode->aProvidesCount; anIndex++) {
+			StartupService aService = &aGraph->aServices[aNode->aProvides[anIndex]];
+
+			if (aService->anUp)
+				break;
+			if (aService->aRunning > 0) {
+				appendIndex(&aService->aParked, &aService->aParkedCount, aNodeIndex);
+				aParked = TRUE;
+				break;
+			}
+		}
+		if (aParked)
+			continue;
+		if (anIndex < aNode->aProvidesCount) {
+			CF_syslog(LOG_DEBUG, CFSTR("Skipping %@ because of duplicate service."),
+				  CFDictionaryGetValue(aNode->anItem, kDescriptionKey));
+			RemoveItemFromWaitingList(aStartupContext, aNode->anItem);
+			startupGraphFinish(aGraph, aNodeIndex, kNodeDone);
 			continue;
 		}
-		if (aFailedAntecedentsCount > 0)
-			syslog(LOG_DEBUG, "Total: %d", aFailedAntecedentsCount);
 
-		if (aFailedAntecedentsCount > aMinFailedAntecedents)
-			continue;	/* Another item already won out */
+		return aNode->anItem;
+	}
+
+	return NULL;
+}
 
-		if (aFailedAntecedentsCount < aMinFailedAntecedents)
-			aBestPick = TRUE;
+void StartupGraphItemStarted(StartupGraph aGraph, CFMutableDictionaryRef anItem)
+{
+	CFIndex aNodeIndex = startupGraphNodeIndex(aGraph, anItem);
+	StartupNode aNode;
+	CFIndex anIndex;
 
-		if (!aBestPick)
-			continue;
+	if (aNodeIndex == -1)
+		return;
 
-		/*
-		 * anItem has less unmet
-		 * dependancies than any
-		 * other item so far, so it
-		 * wins.
-		 */
-		syslog(LOG_DEBUG, "Best pick so far, based on failed dependancies (%d->%d)",
-		       aMinFailedAntecedents, aFailedAntecedentsCount);
+	aNode = &aGraph->aNodes[aNodeIndex];
+	aNode->aState = kNodeRunning;
+	aNode->aStartTime = CFAbsoluteTimeGetCurrent();
+	aGraph->aRunning++;
+	for (anIndex = 0; anIndex < aNode->aProvidesCount; anIndex++)
+		aGraph->aServices[aNode->aProvides[anIndex]].aRunning++;
+}
 
-		/*
-		 * We have a winner!  Update success
-		 * parameters to match anItem.
-		 */
-		aMinFailedAntecedents = aFailedAntecedentsCount;
-		aNextItem = anItem;
+void StartupGraphItemFinished(StartupGraph aGraph, CFMutableDictionaryRef anItem)
+{
+	CFIndex aNodeIndex = startupGraphNodeIndex(aGraph, anItem);
+
+	if (aNodeIndex != -1 && aGraph->aNodes[aNodeIndex].aState != kNodeDone)
+		startupGraphFinish(aGraph, aNodeIndex, kNodeDone);
+}
+
+CFMutableDictionaryRef StartupGraphGetLongestRunning(StartupGraph aGraph)
+{
+	StartupNode aLongest = NULL;
+	CFIndex anIndex;
+
+	for (anIndex = 0; anIndex < aGraph->aNodeCount; anIndex++) {
+		StartupNode aNode = &aGraph->aNodes[anIndex];
+
+		if (aNode->aState == kNodeRunning && (!aLongest || aNode->aStartTime < aLongest->aStartTime))
+			aLongest = aNode;
+	}
+	return aLongest ? aLongest->anItem : NULL;
+}
+
+/*
+ * Walks back from the item that finished last through whichever item's exit
+ * let each one become ready. Time an item spent ready but not running is
+ * time lost to the concurrency limit.
+ */
+void StartupGraphLogCriticalPath(StartupGraph aGraph)
+{
+	CFIndex aLast = -1, anIndex;
+
+	for (anIndex = 0; anIndex < aGraph->aNodeCount; anIndex++) {
+		StartupNode aNode = &aGraph->aNodes[anIndex];
+
+		if (aNode->aState == kNodeDone && aNode->aStartTime != 0 &&
+		    (aLast == -1 || aNode->aFinishTime > aGraph->aNodes[aLast].aFinishTime))
+			aLast = anIndex;
+	}
+	if (aLast == -1)
+		return;
+
+	syslog(LOG_INFO, "Critical path: %.2f seconds", aGraph->aNodes[aLast].aFinishTime - aGraph->aCreateTime);
 
-	}			/* End of waiting list loop. */
+	for (anIndex = aLast; anIndex != -1; anIndex = aGraph->aNodes[anIndex].aReleasedBy) {
+		StartupNode aNode = &aGraph->aNodes[anIndex];
 
-	return aNextItem;
+		if (aNode->aStartTime == 0)
+			continue;
+		CF_syslog(LOG_INFO, CFSTR("  %@: ran %.2f seconds after waiting %.2f for a slot"),
+			  CFDictionaryGetValue(aNode->anItem, kDescriptionKey),
+			  aNode->aFinishTime - aNode->aStartTime, aNode->aStartTime - aNode->aReadyTime);
+	}
 }
 
 CFStringRef StartupItemCreateDescription(CFMutableDictionaryRef anItem)
@@ -67,16 +67,40 @@ CFMutableArrayRef StartupItemListCreateDependentsList (CFMutableArrayRef anItemL
 						       Action            anAction  );
 
 /*
- * Given aWaitingList of startup items, and aStatusDict describing the current
- * startup state, returns the next startup item to run, if any. Returns nil if
- * none is available.
- * Note that this is not necessarily deterministic; if more than one startup
- * item is ready to run, which item gets returned is not specified. An item is
- * not ready to run if the specified dependencies are not satisfied yet.
+ * Builds the dependency graph of aWaitingList for anAction, to run at most
+ * aConcurrency items at once (no limit if it is not positive). aStatusDict
+ * is where items' exits are recorded, as it is for StartupItemExit().
  */
-CFMutableDictionaryRef StartupItemListGetNext (CFArrayRef      aWaitingList,
-					       CFDictionaryRef aStatusDict ,
-					       Action          anAction    );
+StartupGraph StartupGraphCreate (CFArrayRef             aWaitingList,
+				 CFMutableDictionaryRef aStatusDict ,
+				 Action                 anAction    ,
+				 CFIndex                aConcurrency);
+void StartupGraphRelease (StartupGraph aGraph);
+
+/*
+ * Returns the next startup item to run, if any. Returns nil if none is ready
+ * or the concurrency limit has been reached. Items are ready once every item
+ * they wait for has finished and every service they require has succeeded.
+ * Items made redundant by a duplicate service are taken off the waiting list.
+ */
+CFMutableDictionaryRef StartupGraphGetNext (StartupGraph aGraph, StartupContext aStartupContext);
+
+/*
+ * Tell the graph that an item it returned started, and that an item finished,
+ * once its exit status is in aStatusDict.
+ */
+void StartupGraphItemStarted  (StartupGraph aGraph, CFMutableDictionaryRef anItem);
+void StartupGraphItemFinished (StartupGraph aGraph, CFMutableDictionaryRef anItem);
+
+/*
+ * Returns the item that has been running the longest, if any.
+ */
+CFMutableDictionaryRef StartupGraphGetLongestRunning (StartupGraph aGraph);
+
+/*
+ * Logs the chain of items that held up completion the longest.
+ */
+void StartupGraphLogCriticalPath (StartupGraph aGraph);
 
 CFMutableDictionaryRef StartupItemWithPID (CFArrayRef anItemList, pid_t aPID);
 pid_t StartupItemGetPID(CFDictionaryRef anItem);
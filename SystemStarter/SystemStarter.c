@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <crt_externs.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <syslog.h>
 #include <assert.h>
 #include <CoreFoundation/CoreFoundation.h>
@@ -44,6 +45,7 @@
 bool gDebugFlag = false;
 bool gVerboseFlag = false;
 bool gNoRunFlag = false;
+int gMaxRunning = 0;
 
 static void     usage(void) __attribute__((noreturn));
 static int      system_starter(Action anAction, const char *aService);
@@ -59,6 +61,8 @@ main(int argc, char *argv[])
 {
 	struct kevent	kev;
 	Action          anAction = kActionStart;
+	char           *anEnd;
+	long            aCount;
 	int             ch, r, kq = kqueue();
 
 	assert(kq  != -1);
@@ -68,7 +72,7 @@ main(int argc, char *argv[])
 	assert(r != -1);
 	signal(SIGTERM, dummy_sig);
 
-	while ((ch = getopt(argc, argv, "gvxirdDqn?")) != -1) {
+	while ((ch = getopt(argc, argv, "gvxirdDqnj:?")) != -1) {
 		switch (ch) {
 		case 'v':
 			gVerboseFlag = true;
@@ -85,6 +89,13 @@ main(int argc, char *argv[])
 		case 'n':
 			gNoRunFlag = true;
 			break;
+		case 'j':
+			aCount = strtol(optarg, &anEnd, 10);
+			if (anEnd == optarg || *anEnd != '\0' || aCount < 1 || aCount > INT_MAX) {
+				usage();
+			}
+			gMaxRunning = (int)aCount;
+			break;
 		case '?':
 		default:
 			usage();
@@ -175,40 +186,25 @@ main(int argc, char *argv[])
 
 
 /**
- * checkForActivity checks to see if any items have completed since the last invokation.
- * If not, a message is displayed showing what item(s) are being waited on.
+ * logWaiting names the item that has been running the longest while
+ * system_starter has nothing else it can start, once per item: the run loop
+ * wakes up for every IPC message, most of which change nothing.
  **/
 static void 
-checkForActivity(StartupContext aStartupContext)
+logWaiting(StartupContext aStartupContext, CFMutableDictionaryRef *aLastItem)
 {
-	static CFIndex  aLastStatusDictionaryCount = -1;
-	static CFStringRef aWaitingForString = NULL;
+	CFMutableDictionaryRef anItem = StartupGraphGetLongestRunning(aStartupContext->aGraph);
+	CFStringRef     anItemDescription;
 
-	if (aStartupContext && aStartupContext->aStatusDict) {
-		CFIndex         aCount = CFDictionaryGetCount(aStartupContext->aStatusDict);
+	if (anItem == *aLastItem)
+		return;
+	*aLastItem = anItem;
 
-		if (!aWaitingForString) {
-			aWaitingForString = CFSTR("Waiting for %@");
-		}
-		if (aLastStatusDictionaryCount == aCount) {
-			CFArrayRef aRunningList = StartupItemListCreateFromRunning(aStartupContext->aWaitingList);
-			if (aRunningList && CFArrayGetCount(aRunningList) > 0) {
-				CFMutableDictionaryRef anItem = (CFMutableDictionaryRef) CFArrayGetValueAtIndex(aRunningList, 0);
-				CFStringRef     anItemDescription = StartupItemCreateDescription(anItem);
-				CFStringRef     aString = aWaitingForString && anItemDescription ?
-				CFStringCreateWithFormat(NULL, NULL, aWaitingForString, anItemDescription) : NULL;
-
-				if (aString) {
-					CF_syslog(LOG_INFO, CFSTR("%@"), aString);
-					CFRelease(aString);
-				}
-				if (anItemDescription)
-					CFRelease(anItemDescription);
-			}
-			if (aRunningList)
-				CFRelease(aRunningList);
-		}
-		aLastStatusDictionaryCount = aCount;
+	anItemDescription = StartupItemCreateDescription(anItem);
+
+	if (anItemDescription) {
+		CF_syslog(LOG_INFO, CFSTR("Waiting for %@"), anItemDescription);
+		CFRelease(anItemDescription);
 	}
 }
 
@@ -262,6 +258,8 @@ system_starter(Action anAction, const char *aService_cstr)
 {
 	CFStringRef     aService = NULL;
 	NSSearchPathDomainMask aMask;
+	CFIndex         aConcurrency;
+	CFMutableDictionaryRef aWaitingFor = NULL;
 
 	if (aService_cstr)
 		aService = CFStringCreateWithCString(kCFAllocatorDefault, aService_cstr, kCFStringEncodingUTF8);
@@ -282,6 +280,7 @@ system_starter(Action anAction, const char *aService_cstr)
 
 	aStartupContext->aWaitingList = StartupItemListCreateWithMask(aMask);
 	aStartupContext->aFailedList = NULL;
+	aStartupContext->aGraph = NULL;
 	aStartupContext->aStatusDict = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks,
 					  &kCFTypeDictionaryValueCallBacks);
 	aStartupContext->aServicesCount = 0;
@@ -300,14 +299,31 @@ system_starter(Action anAction, const char *aService_cstr)
 	}
 	aStartupContext->aServicesCount = StartupItemListCountServices(aStartupContext->aWaitingList);
 
+	/**
+	 * Work out the dependencies once; from here on, only exits move things along.
+	 **/
+	if (gMaxRunning > 0) {
+		aConcurrency = gMaxRunning;
+	} else if ((aConcurrency = sysconf(_SC_NPROCESSORS_ONLN)) < 1) {
+		aConcurrency = 1;
+	}
+	aStartupContext->aGraph = StartupGraphCreate(aStartupContext->aWaitingList, aStartupContext->aStatusDict, anAction, aConcurrency);
+	if (!aStartupContext->aGraph) {
+		syslog(LOG_ERR, "Not enough memory to allocate startup graph");
+		return (1);
+	}
+
 	/**
 	 * Do the run loop
 	 **/
 	while (1) {
-		CFMutableDictionaryRef anItem = StartupItemListGetNext(aStartupContext->aWaitingList, aStartupContext->aStatusDict, anAction);
+		CFMutableDictionaryRef anItem = StartupGraphGetNext(aStartupContext->aGraph, aStartupContext);
 
 		if (anItem) {
-			int             err = StartupItemRun(aStartupContext->aStatusDict, anItem, anAction);
+			int             err;
+
+			StartupGraphItemStarted(aStartupContext->aGraph, anItem);
+			err = StartupItemRun(aStartupContext->aStatusDict, anItem, anAction);
 			if (!err) {
 				++aStartupContext->aRunningCount;
 				MonitorStartupItem(aStartupContext, anItem);
@@ -317,6 +333,8 @@ system_starter(Action anAction, const char *aService_cstr)
 
 				/* Remove the item from the waiting list. */
 				RemoveItemFromWaitingList(aStartupContext, anItem);
+
+				StartupGraphItemFinished(aStartupContext->aGraph, anItem);
 			}
 		} else {
 			/*
@@ -327,13 +345,15 @@ system_starter(Action anAction, const char *aService_cstr)
 				syslog(LOG_DEBUG, "none left");
 				break;
 			}
+			logWaiting(aStartupContext, &aWaitingFor);
+
 			/*
 			 * Process incoming IPC messages and item
-			 * terminations
+			 * terminations. Nothing changes until one of
+			 * those arrives, so there is nothing to time out.
 			 */
-			switch (CFRunLoopRunInMode(kCFRunLoopDefaultMode, 3.0, true)) {
+			switch (CFRunLoopRunInMode(kCFRunLoopDefaultMode, 1.0e10, true)) {
 			case kCFRunLoopRunTimedOut:
-				checkForActivity(aStartupContext);
 				break;
 			case kCFRunLoopRunFinished:
 				break;
@@ -352,8 +372,10 @@ system_starter(Action anAction, const char *aService_cstr)
 	 * Good-bye.
 	 **/
 	displayErrorMessages(aStartupContext, anAction);
+	StartupGraphLogCriticalPath(aStartupContext->aGraph);
 
 	/* clean up  */
+	StartupGraphRelease(aStartupContext->aGraph);
 	if (aStartupContext->aStatusDict)
 		CFRelease(aStartupContext->aStatusDict);
 	if (aStartupContext->aWaitingList)
@@ -385,7 +407,7 @@ CF_syslog(int level, CFStringRef message,...)
 static void 
 usage(void)
 {
-	fprintf(stderr, "usage: %s [-vdqn?] [ <action> [ <item> ] ]\n"
+	fprintf(stderr, "usage: %s [-vdqn?] [-j <count>] [ <action> [ <item> ] ]\n"
 	"\t<action>: action to take (start|stop|restart); default is start\n"
 		"\t<item>  : name of item to act on; default is all items\n"
 		"options:\n"
@@ -393,6 +415,7 @@ usage(void)
 		"\t-d: print debugging output\n"
 		"\t-q: be quiet (disable debugging output)\n"
 	     "\t-n: don't actually perform action on items (pretend mode)\n"
+		"\t-j: run at most <count> items at once; default is one per CPU\n"
 		"\t-?: show this help\n",
 		getprogname());
 	exit(EXIT_FAILURE);
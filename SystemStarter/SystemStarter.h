@@ -25,11 +25,15 @@
 #ifndef _SYSTEM_STARTER_H_
 #define _SYSTEM_STARTER_H_
 
+/* Dependency graph of the items being acted on; see StartupItems.h */
+typedef struct StartupGraphStorage *StartupGraph;
+
 /* Structure to pass common objects from system_starter to the IPC handlers */
 typedef struct StartupContextStorage {
     CFMutableArrayRef           aWaitingList;
     CFMutableArrayRef           aFailedList;
     CFMutableDictionaryRef      aStatusDict;
+    StartupGraph                aGraph;
     int                         aServicesCount;
     int                         aRunningCount;
 } *StartupContext;
@@ -47,5 +51,6 @@ typedef enum {
 
 void CF_syslog(int level, CFStringRef message, ...);
 extern bool gVerboseFlag;
+extern int gMaxRunning;
 
 #endif /* _SYSTEM_STARTER_H_ */
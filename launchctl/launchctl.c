@@ -41,6 +41,7 @@
 #include <sys/time.h>
 #include <sys/sysctl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/fcntl.h>
@@ -54,6 +55,7 @@
 #include <netinet/in_var.h>
 #include <netinet6/nd6.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <dirent.h>
 #include <libgen.h>
 #include <libinfo.h>
@@ -118,15 +120,12 @@ extern char **environ;
 struct load_unload_state {
 	launch_data_t pass1;
 	char *session_type;
-	bool editondisk:1, load:1, forceload:1;
+	bool editondisk:1, load:1, forceload:1, atomic:1;
 };
 
 static void launchctl_log(int level, const char *fmt, ...);
 static void launchctl_log_CFString(int level, CFStringRef string);
 static void myCFDictionaryApplyFunction(const void *key, const void *value, void *context);
-static CFTypeRef CFTypeCreateFromLaunchData(launch_data_t obj);
-static CFArrayRef CFArrayCreateFromLaunchArray(launch_data_t arr);
-static CFDictionaryRef CFDictionaryCreateFromLaunchDictionary(launch_data_t dict);
 static bool launch_data_array_append(launch_data_t a, launch_data_t o);
 static void insert_event(launch_data_t, const char *, const char *, launch_data_t);
 static void distill_jobs(launch_data_t);
@@ -136,6 +135,7 @@ static void sock_dict_cb(launch_data_t what, const char *key, void *context);
 static void sock_dict_edit_entry(launch_data_t tmp, const char *key, launch_data_t fdarray, launch_data_t thejob);
 static launch_data_t CF2launch_data(CFTypeRef);
 static launch_data_t read_plist_file(const char *file, bool editondisk, bool load);
+static launch_data_t read_plist_raw(const char *file);
 #if TARGET_OS_EMBEDDED
 static CFPropertyListRef GetPropertyListFromCache(void);
 static CFPropertyListRef CreateMyPropertyListFromCachedFile(const char *posixfile);
@@ -147,11 +147,16 @@ static void WriteMyPropertyListToFile(CFPropertyListRef, const char *);
 static bool path_goodness_check(const char *path, bool forceload);
 static void readpath(const char *, struct load_unload_state *);
 static void readfile(const char *, struct load_unload_state *);
+static void readfile2(const char *, launch_data_t, struct load_unload_state *);
+static void readfiles(char **paths, size_t cnt, struct load_unload_state *lus);
+static void plist_cache_open(const char *overrides_db_path);
+static void plist_cache_close(void);
 static int _fd(int);
 static int demux_cmd(int argc, char *const argv[]);
-static void submit_job_pass(launch_data_t jobs);
+static void submit_job_pass(launch_data_t jobs, bool atomic);
 static void do_mgroup_join(int fd, int family, int socktype, int protocol, const char *mgroup);
 static mach_port_t str2bsport(const char *s);
+static void print_job_status(long long pid, bool has_status, int wstatus, const char *label);
 static void print_jobs(launch_data_t j, const char *key, void *context);
 static void print_obj(launch_data_t obj, const char *key, void *context);
 static bool str2lim(const char *buf, rlim_t *res);
@@ -200,6 +205,7 @@ static int load_and_unload_cmd(int argc, char *const argv[]);
 //static int reload_cmd(int argc, char *const argv[]);
 static int start_stop_remove_cmd(int argc, char *const argv[]);
 static int submit_cmd(int argc, char *const argv[]);
+static int list_print_job(launch_data_t resp, bool plist_output, const char *cmd);
 static int list_cmd(int argc, char *const argv[]);
 
 static int setenv_cmd(int argc, char *const argv[]);
@@ -213,6 +219,8 @@ static int fyi_cmd(int argc, char *const argv[]);
 static int logupdate_cmd(int argc, char *const argv[]);
 static int umask_cmd(int argc, char *const argv[]);
 static int getrusage_cmd(int argc, char *const argv[]);
+static int hashstats_cmd(int argc, char *const argv[]);
+static int spawnstats_cmd(int argc, char *const argv[]);
 static int bsexec_cmd(int argc, char *const argv[]);
 static int _bslist_cmd(mach_port_t bport, unsigned int depth, bool show_job, bool local_only);
 static int bslist_cmd(int argc, char *const argv[]);
@@ -250,6 +258,8 @@ static const struct {
 	{ "shutdown",		fyi_cmd,				"Prepare for system shutdown" },
 	{ "singleuser",		fyi_cmd,				"Switch to single-user mode" },
 	{ "getrusage",		getrusage_cmd,			"Get resource usage statistics from launchd" },
+	{ "hashstats",		hashstats_cmd,			"Show the load of launchd's job and service indexes" },
+	{ "spawnstats",		spawnstats_cmd,			"View and adjust launchd's limits on jobs starting at once" },
 	{ "log",			logupdate_cmd,			"Adjust the logging level or mask of launchd" },
 	{ "umask",			umask_cmd,				"Change launchd's umask" },
 	{ "bsexec",			bsexec_cmd,				"Execute a process within a different Mach bootstrap subset" },
@@ -910,60 +920,126 @@ read_jetsam_defaults(void)
 
 #endif /* READ_JETSAM_DEFAULTS */
 
-launch_data_t
-read_plist_file(const char *file, bool editondisk, bool load)
+static CFPropertyListRef
+read_plist_cf(const char *file)
 {
-	CFPropertyListRef plist;
-	launch_data_t r = NULL;
 #if TARGET_OS_EMBEDDED
 	if (require_jobs_from_cache()) {
-		plist = CreateMyPropertyListFromCachedFile(file);
-	} else {
-		plist = CreateMyPropertyListFromFile(file);
+		return CreateMyPropertyListFromCachedFile(file);
 	}
-#else
-	plist = CreateMyPropertyListFromFile(file);
 #endif
+	return CreateMyPropertyListFromFile(file);
+}
 
-	if (NULL == plist) {
-		launchctl_log(LOG_ERR, "%s: no plist was returned for: %s", getprogname(), file);
+/* The job exactly as the file describes it, with no overrides applied. This
+ * touches no global state, so it is safe to call from the parsing threads.
+ */
+static launch_data_t
+read_plist_raw(const char *file)
+{
+	launch_data_t r, label;
+
+#if TARGET_OS_EMBEDDED
+	/* The xpcd cache hands back CF objects that are already parsed. */
+	if (require_jobs_from_cache()) {
+		CFPropertyListRef plist = read_plist_cf(file);
+
+		if (NULL == plist) {
+			return NULL;
+		}
+
+		r = NULL;
+		if (CFTypeCheck(plist, CFDictionary)) {
+			CFStringRef cflabel = CFDictionaryGetValue(plist, CFSTR(LAUNCH_JOBKEY_LABEL));
+			if (cflabel && CFTypeCheck(cflabel, CFString)) {
+				r = CF2launch_data(plist);
+			}
+		}
+		CFRelease(plist);
+
+		return r;
+	}
+#endif
+
+	if (NULL == (r = launch_data_plist_read_file(file))) {
+		if (errno != ENOENT) {
+			launchctl_log(LOG_ERR, "%s: could not parse %s: %s", getprogname(), file, strerror(errno));
+		}
+		return NULL;
+	}
+
+	if (launch_data_get_type(r) != LAUNCH_DATA_DICTIONARY
+		|| !(label = launch_data_dict_lookup(r, LAUNCH_JOBKEY_LABEL))
+		|| launch_data_get_type(label) != LAUNCH_DATA_STRING) {
+		launch_data_free(r);
 		return NULL;
 	}
 
+	return r;
+}
+
+static void
+edit_plist_on_disk(const char *file, bool load)
+{
+	CFPropertyListRef plist = read_plist_cf(file);
+
+	if (NULL == plist) {
+		return;
+	}
+
 	CFStringRef label = CFDictionaryGetValue(plist, CFSTR(LAUNCH_JOBKEY_LABEL));
 	if (!(label && CFTypeCheck(label, CFString))) {
-		return NULL;
+		CFRelease(plist);
+		return;
 	}
 
 	if (_launchctl_overrides_db) {
-		CFDictionaryRef overrides = CFDictionaryGetValue(_launchctl_overrides_db, label);
-		if (overrides && CFTypeCheck(overrides, CFDictionary)) {
-			CFBooleanRef disabled = CFDictionaryGetValue(overrides, CFSTR(LAUNCH_JOBKEY_DISABLED));
-			if (disabled && CFTypeCheck(disabled, CFBoolean)) {
-				CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_DISABLED), disabled);
-			}
+		CFMutableDictionaryRef job = (CFMutableDictionaryRef)CFDictionaryGetValue(_launchctl_overrides_db, label);
+		if (!job || !CFTypeCheck(job, CFDictionary)) {
+			job = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+			CFDictionarySetValue(_launchctl_overrides_db, label, job);
+			CFRelease(job);
+		}
+
+		CFDictionarySetValue(job, CFSTR(LAUNCH_JOBKEY_DISABLED), load ? kCFBooleanFalse : kCFBooleanTrue);
+		_launchctl_overrides_db_changed = true;
+	} else {
+		if (load) {
+			CFDictionaryRemoveValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_DISABLED));
+		} else {
+			CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_DISABLED), kCFBooleanTrue);
 		}
+		WriteMyPropertyListToFile(plist, file);
 	}
 
-	if (editondisk) {
-		if (_launchctl_overrides_db) {
-			CFMutableDictionaryRef job = (CFMutableDictionaryRef)CFDictionaryGetValue(_launchctl_overrides_db, label);
-			if (!job || !CFTypeCheck(job, CFDictionary)) {
-				job = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-				CFDictionarySetValue(_launchctl_overrides_db, label, job);
-				CFRelease(job);
-			}
+	CFRelease(plist);
+}
 
-			CFDictionarySetValue(job, CFSTR(LAUNCH_JOBKEY_DISABLED), load ? kCFBooleanFalse : kCFBooleanTrue);
-			CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_DISABLED), load ? kCFBooleanFalse : kCFBooleanTrue);
-			_launchctl_overrides_db_changed = true;
-		} else {
-			if (load) {
-				CFDictionaryRemoveValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_DISABLED));
-			} else {
-				CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_DISABLED), kCFBooleanTrue);
+/* Applies what launchctl layers on top of the file: the Disabled key from the
+ * overrides database and, on embedded, the jetsam defaults.
+ */
+static void
+apply_plist_overrides(launch_data_t thejob)
+{
+	launch_data_t tmp = launch_data_dict_lookup(thejob, LAUNCH_JOBKEY_LABEL);
+	CFStringRef label;
+
+	if (!tmp || launch_data_get_type(tmp) != LAUNCH_DATA_STRING) {
+		return;
+	}
+
+	label = CFStringCreateWithCString(kCFAllocatorDefault, launch_data_get_string(tmp), kCFStringEncodingUTF8);
+	if (!label) {
+		return;
+	}
+
+	if (_launchctl_overrides_db) {
+		CFDictionaryRef overrides = CFDictionaryGetValue(_launchctl_overrides_db, label);
+		if (overrides && CFTypeCheck(overrides, CFDictionary)) {
+			CFBooleanRef disabled = CFDictionaryGetValue(overrides, CFSTR(LAUNCH_JOBKEY_DISABLED));
+			if (disabled && CFTypeCheck(disabled, CFBoolean)) {
+				launch_data_dict_insert(thejob, launch_data_new_bool(CFBooleanGetValue(disabled)), LAUNCH_JOBKEY_DISABLED);
 			}
-			WriteMyPropertyListToFile(plist, file);
 		}
 	}
 
@@ -971,25 +1047,34 @@ read_plist_file(const char *file, bool editondisk, bool load)
 	if (_launchctl_jetsam_defaults) {
 		CFDictionaryRef job_defaults_dict = CFDictionaryGetValue(_launchctl_jetsam_defaults, label);
 		if (job_defaults_dict) {
-			CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_JETSAMPROPERTIES), job_defaults_dict);
+			launch_data_dict_insert(thejob, CF2launch_data(job_defaults_dict), LAUNCH_JOBKEY_JETSAMPROPERTIES);
 		}
 	} else {
 		/* The plist is missing. Set a default memory limit, since the device will be otherwise unusable */
-		long default_limit = 0;
-		CFMutableDictionaryRef job_defaults_dict = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-		CFNumberRef memory_limit = CFNumberCreate(kCFAllocatorDefault, kCFNumberLongType, &default_limit);
-		if (memory_limit) {
-			CFDictionaryAddValue(job_defaults_dict, CFSTR(LAUNCH_JOBKEY_JETSAMMEMORYLIMIT), memory_limit);
-			CFRelease(memory_limit);
-		}
-		CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_JETSAMPROPERTIES), job_defaults_dict);
-		CFRelease(job_defaults_dict);
+		launch_data_t job_defaults_dict = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+		launch_data_dict_insert(job_defaults_dict, launch_data_new_integer(0), LAUNCH_JOBKEY_JETSAMMEMORYLIMIT);
+		launch_data_dict_insert(thejob, job_defaults_dict, LAUNCH_JOBKEY_JETSAMPROPERTIES);
 	}
 #endif /* READ_JETSAM_DEFAULTS */
 
-	r = CF2launch_data(plist);
+	CFRelease(label);
+}
 
-	CFRelease(plist);
+launch_data_t
+read_plist_file(const char *file, bool editondisk, bool load)
+{
+	launch_data_t r;
+
+	if (editondisk) {
+		edit_plist_on_disk(file, load);
+	}
+
+	if (NULL == (r = read_plist_raw(file))) {
+		launchctl_log(LOG_ERR, "%s: no plist was returned for: %s", getprogname(), file);
+		return NULL;
+	}
+
+	apply_plist_overrides(r);
 
 	return r;
 }
@@ -1039,18 +1124,27 @@ limitloadtohardware_iterator(launch_data_t val, const char *key, void *ctx)
 void
 readfile(const char *what, struct load_unload_state *lus)
 {
-	char ourhostname[1024];
-	launch_data_t tmpd, tmps, thejob, tmpa;
-	bool job_disabled = false;
-	size_t i, c;
-
-	gethostname(ourhostname, sizeof(ourhostname));
+	launch_data_t thejob;
 
 	if (NULL == (thejob = read_plist_file(what, lus->editondisk, lus->load))) {
 		launchctl_log(LOG_ERR, "%s: no plist was returned for: %s", getprogname(), what);
 		return;
 	}
 
+	readfile2(what, thejob, lus);
+}
+
+void
+readfile2(const char *what, launch_data_t thejob, struct load_unload_state *lus)
+{
+	static char ourhostname[1024];
+	launch_data_t tmpd, tmps, tmpa;
+	bool job_disabled = false;
+	size_t i, c;
+
+	if (ourhostname[0] == '\0') {
+		gethostname(ourhostname, sizeof(ourhostname));
+	}
 
 	if (NULL == launch_data_dict_lookup(thejob, LAUNCH_JOBKEY_LABEL)) {
 		launchctl_log(LOG_ERR, "%s: missing the Label key: %s", getprogname(), what);
@@ -1267,37 +1361,555 @@ path_goodness_check(const char *path, bool forceload)
 		return false;
 	}
 
-	if (forceload) {
-		return true;
+	if (forceload) {
+		return true;
+	}
+
+	if (sb.st_mode & (S_IWOTH|S_IWGRP)) {
+		launchctl_log(LOG_ERR, "%s: Dubious permissions on file (skipping): %s", getprogname(), path);
+		return false;
+	}
+
+	if (sb.st_uid != 0 && sb.st_uid != getuid()) {
+		launchctl_log(LOG_ERR, "%s: Dubious ownership on file (skipping): %s", getprogname(), path);
+		return false;
+	}
+
+	if (!(S_ISREG(sb.st_mode) || S_ISDIR(sb.st_mode))) {
+		launchctl_log(LOG_ERR, "%s: Dubious path. Not a regular file or directory (skipping): %s", getprogname(), path);
+		return false;
+	}
+
+	if ((!S_ISDIR(sb.st_mode)) && (fnmatch("*.plist", path, FNM_CASEFOLD) == FNM_NOMATCH)) {
+		launchctl_log(LOG_ERR, "%s: Dubious file. Not of type .plist (skipping): %s", getprogname(), path);
+		return false;
+	}
+
+	return true;
+}
+
+#pragma mark Parsed Job Cache
+
+/* Parsing a plist through CoreFoundation and converting it to launch_data is
+ * most of the cost of loading a job, and the files rarely change between
+ * boots. So each domain keeps the converted jobs, packed as they would be on
+ * the wire, in a file next to its overrides database. An entry is used only
+ * while the file's device, inode, modification time and size are unchanged.
+ * Overrides are not part of the cached job; they are applied afterwards.
+ */
+#define PLIST_CACHE_FILE "launchctl.plistcache"
+#define PLIST_CACHE_MAGIC 0x6c706c63 /* 'lplc' */
+#define PLIST_CACHE_VERSION 1
+#define PLIST_CACHE_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+struct plist_cache_key {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t mtime_sec;
+	uint64_t mtime_nsec;
+	uint64_t size;
+};
+
+struct plist_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t count;
+};
+
+/* Followed by the path, NUL-terminated, then the packed job, each padded to
+ * 8 bytes.
+ */
+struct plist_cache_record {
+	struct plist_cache_key key;
+	uint32_t path_len;
+	uint32_t blob_len;
+};
+
+struct plist_cache_entry {
+	char *path;
+	struct plist_cache_key key;
+	void *blob;
+	size_t blob_len;
+	bool owned:1, used:1;
+};
+
+static struct {
+	char *path;
+	void *buf;
+	struct plist_cache_entry *entries;
+	size_t cnt, cap;
+	bool enabled:1, dirty:1, unsorted:1;
+} _launchctl_plist_cache;
+
+static void
+plist_cache_key_from_stat(struct plist_cache_key *key, const struct stat *sb)
+{
+	memset(key, 0, sizeof(*key));
+	key->dev = (uint64_t)sb->st_dev;
+	key->ino = (uint64_t)sb->st_ino;
+	key->mtime_sec = (uint64_t)sb->st_mtimespec.tv_sec;
+	key->mtime_nsec = (uint64_t)sb->st_mtimespec.tv_nsec;
+	key->size = (uint64_t)sb->st_size;
+}
+
+static int
+plist_cache_entry_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct plist_cache_entry *)a)->path, ((const struct plist_cache_entry *)b)->path);
+}
+
+static struct plist_cache_entry *
+plist_cache_find(const char *path)
+{
+	struct plist_cache_entry k = { .path = (char *)path };
+
+	if (_launchctl_plist_cache.cnt == 0) {
+		return NULL;
+	}
+	return bsearch(&k, _launchctl_plist_cache.entries, _launchctl_plist_cache.cnt, sizeof(k), plist_cache_entry_cmp);
+}
+
+static struct plist_cache_entry *
+plist_cache_append(char *path, bool owned)
+{
+	struct plist_cache_entry *e;
+
+	if (_launchctl_plist_cache.cnt == _launchctl_plist_cache.cap) {
+		size_t cap = _launchctl_plist_cache.cap ? _launchctl_plist_cache.cap * 2 : 64;
+		if (!(e = reallocf(_launchctl_plist_cache.entries, cap * sizeof(*e)))) {
+			_launchctl_plist_cache.cnt = _launchctl_plist_cache.cap = 0;
+			_launchctl_plist_cache.entries = NULL;
+			_launchctl_plist_cache.enabled = false;
+			return NULL;
+		}
+		_launchctl_plist_cache.entries = e;
+		_launchctl_plist_cache.cap = cap;
+	}
+
+	e = &_launchctl_plist_cache.entries[_launchctl_plist_cache.cnt++];
+	memset(e, 0, sizeof(*e));
+	e->path = path;
+	e->owned = owned;
+
+	return e;
+}
+
+static void
+plist_cache_open(const char *overrides_db_path)
+{
+	struct plist_cache_header *hdr;
+	struct stat sb;
+	char *dir, *p;
+	size_t off;
+	int fd;
+
+	memset(&_launchctl_plist_cache, 0, sizeof(_launchctl_plist_cache));
+
+	if (!overrides_db_path || !(p = strdup(overrides_db_path))) {
+		return;
+	}
+	dir = dirname(p);
+	asprintf(&_launchctl_plist_cache.path, "%s/%s", dir, PLIST_CACHE_FILE);
+	free(p);
+	if (!_launchctl_plist_cache.path) {
+		return;
+	}
+	_launchctl_plist_cache.enabled = true;
+
+	if ((fd = open(_launchctl_plist_cache.path, O_RDONLY)) == -1) {
+		return;
+	}
+
+	/* Whatever is in here gets loaded as a job, so it has to be as
+	 * trustworthy as the overrides database sitting next to it.
+	 */
+	if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode) || sb.st_uid != geteuid() || (sb.st_mode & (S_IWGRP|S_IWOTH))
+		|| sb.st_size < (off_t)sizeof(*hdr) || !(_launchctl_plist_cache.buf = malloc(sb.st_size))) {
+		(void)close(fd);
+		return;
+	}
+
+	if (read(fd, _launchctl_plist_cache.buf, sb.st_size) != sb.st_size) {
+		(void)close(fd);
+		goto out_bad;
+	}
+	(void)close(fd);
+
+	hdr = _launchctl_plist_cache.buf;
+	if (hdr->magic != PLIST_CACHE_MAGIC || hdr->version != PLIST_CACHE_VERSION) {
+		goto out_bad;
+	}
+
+	off = sizeof(*hdr);
+	while (off < (size_t)sb.st_size) {
+		struct plist_cache_record *rec = _launchctl_plist_cache.buf + off;
+		struct plist_cache_entry *e;
+		size_t plen, blen;
+
+		if ((size_t)sb.st_size - off < sizeof(*rec)) {
+			goto out_bad;
+		}
+		plen = PLIST_CACHE_ALIGN(rec->path_len);
+		blen = PLIST_CACHE_ALIGN(rec->blob_len);
+		off += sizeof(*rec);
+		if (rec->path_len == 0 || (size_t)sb.st_size - off < plen + blen) {
+			goto out_bad;
+		}
+
+		char *path = _launchctl_plist_cache.buf + off;
+		if (path[rec->path_len - 1] != '\0' || !(e = plist_cache_append(path, false))) {
+			goto out_bad;
+		}
+		e->key = rec->key;
+		e->blob = _launchctl_plist_cache.buf + off + plen;
+		e->blob_len = rec->blob_len;
+		off += plen + blen;
+	}
+
+	if (_launchctl_plist_cache.cnt != hdr->count) {
+		goto out_bad;
+	}
+	qsort(_launchctl_plist_cache.entries, _launchctl_plist_cache.cnt, sizeof(struct plist_cache_entry), plist_cache_entry_cmp);
+
+	return;
+out_bad:
+	/* A torn or foreign file. Start over; it gets rewritten on the way out. */
+	free(_launchctl_plist_cache.entries);
+	free(_launchctl_plist_cache.buf);
+	_launchctl_plist_cache.entries = NULL;
+	_launchctl_plist_cache.buf = NULL;
+	_launchctl_plist_cache.cnt = _launchctl_plist_cache.cap = 0;
+	_launchctl_plist_cache.dirty = true;
+}
+
+/* Only called from the parsing threads, while the cache is not changing. */
+static launch_data_t
+plist_cache_get(const char *path, const struct plist_cache_key *key)
+{
+	struct plist_cache_entry *e = plist_cache_find(path);
+	launch_data_t r = NULL, tmp;
+	size_t off = 0, fdoff = 0;
+	void *copy;
+
+	if (!e || memcmp(&e->key, key, sizeof(*key)) != 0) {
+		return NULL;
+	}
+
+	/* Unpacking rewrites the bytes in place; the file's bytes are kept
+	 * pristine so they can be written back out as they are.
+	 */
+	if (!(copy = malloc(e->blob_len))) {
+		return NULL;
+	}
+	memcpy(copy, e->blob, e->blob_len);
+	if ((tmp = launch_data_unpack(copy, e->blob_len, NULL, 0, &off, &fdoff)) && launch_data_get_type(tmp) == LAUNCH_DATA_DICTIONARY) {
+		r = launch_data_copy(tmp);
+	}
+	free(copy);
+
+	return r;
+}
+
+static void *
+plist_cache_pack(launch_data_t job, size_t *len)
+{
+	size_t sz = launch_data_packed_size(job, NULL);
+	void *blob = malloc(sz);
+
+	if (blob && launch_data_pack(job, blob, sz, NULL, NULL) != sz) {
+		free(blob);
+		blob = NULL;
+	}
+	*len = sz;
+
+	return blob;
+}
+
+static void
+plist_cache_put(const char *path, const struct plist_cache_key *key, void *blob, size_t blob_len, bool hit)
+{
+	struct plist_cache_entry *e = plist_cache_find(path);
+	char *p;
+
+	if (hit) {
+		if (e) {
+			e->used = true;
+		}
+		return;
+	}
+
+	if (!e) {
+		if (!(p = strdup(path)) || !(e = plist_cache_append(p, true))) {
+			free(p);
+			free(blob);
+			return;
+		}
+		_launchctl_plist_cache.unsorted = true;
+	} else if (e->owned) {
+		free(e->blob);
+	}
+
+	e->key = *key;
+	e->blob = blob;
+	e->blob_len = blob_len;
+	e->owned = true;
+	e->used = true;
+	_launchctl_plist_cache.dirty = true;
+}
+
+static bool
+plist_cache_write_record(int fd, struct plist_cache_entry *e)
+{
+	static const char zeroes[8];
+	struct plist_cache_record rec;
+	size_t plen = strlen(e->path) + 1;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.key = e->key;
+	rec.path_len = (uint32_t)plen;
+	rec.blob_len = (uint32_t)e->blob_len;
+
+	struct iovec iov[] = {
+		{ &rec, sizeof(rec) },
+		{ e->path, plen },
+		{ (void *)zeroes, PLIST_CACHE_ALIGN(plen) - plen },
+		{ e->blob, e->blob_len },
+		{ (void *)zeroes, PLIST_CACHE_ALIGN(e->blob_len) - e->blob_len },
+	};
+	ssize_t total = sizeof(rec) + PLIST_CACHE_ALIGN(plen) + PLIST_CACHE_ALIGN(e->blob_len);
+
+	return writev(fd, iov, sizeof(iov) / sizeof(iov[0])) == total;
+}
+
+static void
+plist_cache_close(void)
+{
+	struct plist_cache_header hdr;
+	struct stat sb;
+	struct plist_cache_key key;
+	char *tmppath = NULL;
+	size_t i, n = 0;
+	int fd = -1;
+
+	if (!_launchctl_plist_cache.enabled) {
+		goto out;
+	}
+
+	/* Entries for files not loaded this time stay if the file is unchanged,
+	 * so that loading one job does not throw away everybody else's.
+	 */
+	for (i = 0; i < _launchctl_plist_cache.cnt; i++) {
+		struct plist_cache_entry *e = &_launchctl_plist_cache.entries[i];
+
+		if (!e->used) {
+			if (stat(e->path, &sb) == -1 || (plist_cache_key_from_stat(&key, &sb), memcmp(&key, &e->key, sizeof(key)) != 0)) {
+				if (e->owned) {
+					free(e->blob);
+				}
+				e->blob = NULL;
+				_launchctl_plist_cache.dirty = true;
+				continue;
+			}
+		}
+		n += e->blob ? 1 : 0;
+	}
+
+	if (!_launchctl_plist_cache.dirty) {
+		goto out;
+	}
+
+	if (asprintf(&tmppath, "%s.XXXXXX", _launchctl_plist_cache.path) == -1 || (fd = mkstemp(tmppath)) == -1) {
+		goto out;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = PLIST_CACHE_MAGIC;
+	hdr.version = PLIST_CACHE_VERSION;
+	hdr.count = n;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		goto out_bad;
+	}
+
+	for (i = 0; i < _launchctl_plist_cache.cnt; i++) {
+		if (_launchctl_plist_cache.entries[i].blob && !plist_cache_write_record(fd, &_launchctl_plist_cache.entries[i])) {
+			goto out_bad;
+		}
+	}
+
+	if (close(fd) == -1 || rename(tmppath, _launchctl_plist_cache.path) == -1) {
+		fd = -1;
+		goto out_bad;
+	}
+	fd = -1;
+	goto out;
+
+out_bad:
+	if (_launchctl_verbose) {
+		launchctl_log(LOG_NOTICE, "Could not write the job cache: %s: %s", _launchctl_plist_cache.path, strerror(errno));
+	}
+	if (fd != -1) {
+		(void)close(fd);
+	}
+	(void)unlink(tmppath);
+out:
+	free(tmppath);
+	for (i = 0; i < _launchctl_plist_cache.cnt; i++) {
+		struct plist_cache_entry *e = &_launchctl_plist_cache.entries[i];
+		if (e->owned) {
+			free(e->path);
+			free(e->blob);
+		}
+	}
+	free(_launchctl_plist_cache.entries);
+	free(_launchctl_plist_cache.buf);
+	free(_launchctl_plist_cache.path);
+	memset(&_launchctl_plist_cache, 0, sizeof(_launchctl_plist_cache));
+}
+
+#pragma mark Parallel Job Parsing
+
+#define PLIST_PARSE_MAX_THREADS 8
+
+struct plist_parse_slot {
+	const char *path;
+	launch_data_t job;
+	struct plist_cache_key key;
+	void *blob;
+	size_t blob_len;
+	bool have_key:1, hit:1;
+};
+
+struct plist_parse_pool {
+	struct plist_parse_slot *slots;
+	size_t cnt;
+	size_t next;
+	bool use_cache;
+};
+
+static void
+plist_parse_slot(struct plist_parse_slot *ps, bool use_cache)
+{
+	struct stat sb;
+
+	if (use_cache && stat(ps->path, &sb) == 0) {
+		plist_cache_key_from_stat(&ps->key, &sb);
+		ps->have_key = true;
+		if ((ps->job = plist_cache_get(ps->path, &ps->key))) {
+			ps->hit = true;
+			return;
+		}
+	}
+
+	ps->job = read_plist_raw(ps->path);
+	if (ps->job && ps->have_key) {
+		ps->blob = plist_cache_pack(ps->job, &ps->blob_len);
+	}
+}
+
+static void *
+plist_parse_worker(void *context)
+{
+	struct plist_parse_pool *pool = context;
+	size_t i;
+
+	while ((i = __sync_fetch_and_add(&pool->next, 1)) < pool->cnt) {
+		plist_parse_slot(&pool->slots[i], pool->use_cache);
+	}
+
+	return NULL;
+}
+
+/* Parses the files on a few threads, then filters and queues the jobs one at
+ * a time in the order given, so the result does not depend on which thread
+ * finished first. Everything past parsing touches launchctl's globals and
+ * stays on this thread.
+ */
+static void
+readfiles(char **paths, size_t cnt, struct load_unload_state *lus)
+{
+	struct plist_parse_pool pool;
+	pthread_t threads[PLIST_PARSE_MAX_THREADS];
+	size_t i, nthreads = 0;
+	long ncpu;
+
+	if (cnt == 0) {
+		return;
+	}
+
+	/* Editing on disk rewrites files and the overrides database as it goes. */
+	if (lus->editondisk) {
+		for (i = 0; i < cnt; i++) {
+			readfile(paths[i], lus);
+		}
+		return;
+	}
+
+	memset(&pool, 0, sizeof(pool));
+	if (!(pool.slots = calloc(cnt, sizeof(*pool.slots)))) {
+		for (i = 0; i < cnt; i++) {
+			readfile(paths[i], lus);
+		}
+		return;
+	}
+	for (i = 0; i < cnt; i++) {
+		pool.slots[i].path = paths[i];
 	}
+	pool.cnt = cnt;
+	pool.use_cache = _launchctl_plist_cache.enabled;
 
-	if (sb.st_mode & (S_IWOTH|S_IWGRP)) {
-		launchctl_log(LOG_ERR, "%s: Dubious permissions on file (skipping): %s", getprogname(), path);
-		return false;
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#if TARGET_OS_EMBEDDED
+	/* The xpcd cache is already parsed, and is loaded lazily without a lock. */
+	if (require_jobs_from_cache()) {
+		ncpu = 1;
+		pool.use_cache = false;
+	}
+#endif
+	if (ncpu > 1 && cnt > 1) {
+		nthreads = MIN(MIN((size_t)ncpu, cnt), PLIST_PARSE_MAX_THREADS);
+		for (i = 0; i < nthreads; i++) {
+			if (pthread_create(&threads[i], NULL, plist_parse_worker, &pool) != 0) {
+				break;
+			}
+		}
+		nthreads = i;
 	}
 
-	if (sb.st_uid != 0 && sb.st_uid != getuid()) {
-		launchctl_log(LOG_ERR, "%s: Dubious ownership on file (skipping): %s", getprogname(), path);
-		return false;
+	/* This thread works too, and finishes on its own if no thread started. */
+	plist_parse_worker(&pool);
+	for (i = 0; i < nthreads; i++) {
+		(void)pthread_join(threads[i], NULL);
 	}
 
-	if (!(S_ISREG(sb.st_mode) || S_ISDIR(sb.st_mode))) {
-		launchctl_log(LOG_ERR, "%s: Dubious path. Not a regular file or directory (skipping): %s", getprogname(), path);
-		return false;
+	for (i = 0; i < cnt; i++) {
+		struct plist_parse_slot *ps = &pool.slots[i];
+
+		if (ps->have_key && (ps->hit || ps->blob)) {
+			plist_cache_put(ps->path, &ps->key, ps->blob, ps->blob_len, ps->hit);
+		}
+
+		if (NULL == ps->job) {
+			launchctl_log(LOG_ERR, "%s: no plist was returned for: %s", getprogname(), ps->path);
+			continue;
+		}
+
+		apply_plist_overrides(ps->job);
+		readfile2(ps->path, ps->job, lus);
 	}
 
-	if ((!S_ISDIR(sb.st_mode)) && (fnmatch("*.plist", path, FNM_CASEFOLD) == FNM_NOMATCH)) {
-		launchctl_log(LOG_ERR, "%s: Dubious file. Not of type .plist (skipping): %s", getprogname(), path);
-		return false;
+	if (_launchctl_plist_cache.unsorted) {
+		qsort(_launchctl_plist_cache.entries, _launchctl_plist_cache.cnt, sizeof(struct plist_cache_entry), plist_cache_entry_cmp);
+		_launchctl_plist_cache.unsorted = false;
 	}
 
-	return true;
+	free(pool.slots);
 }
 
 void
 readpath(const char *what, struct load_unload_state *lus)
 {
-	char buf[MAXPATHLEN];
+	char **paths = NULL;
+	size_t cnt = 0, cap = 0, i;
 	struct stat sb;
 	struct dirent *de;
 	DIR *d;
@@ -1311,7 +1923,8 @@ readpath(const char *what, struct load_unload_state *lus)
 	}
 
 	if (S_ISREG(sb.st_mode)) {
-		readfile(what, lus);
+		paths = (char **)&what;
+		readfiles(paths, 1, lus);
 	} else if (S_ISDIR(sb.st_mode)) {
 		if ((d = opendir(what)) == NULL) {
 			launchctl_log(LOG_ERR, "%s: opendir() failed to open the directory", getprogname());
@@ -1319,18 +1932,37 @@ readpath(const char *what, struct load_unload_state *lus)
 		}
 
 		while ((de = readdir(d))) {
+			char *buf;
+
 			if (de->d_name[0] == '.') {
 				continue;
 			}
-			snprintf(buf, sizeof(buf), "%s/%s", what, de->d_name);
+			if (asprintf(&buf, "%s/%s", what, de->d_name) == -1) {
+				continue;
+			}
 
 			if (!path_goodness_check(buf, lus->forceload)) {
+				free(buf);
 				continue;
 			}
 
-			readfile(buf, lus);
+			if (cnt == cap) {
+				char **tmp = realloc(paths, (cap = cap ? cap * 2 : 32) * sizeof(*paths));
+				if (!tmp) {
+					free(buf);
+					break;
+				}
+				paths = tmp;
+			}
+			paths[cnt++] = buf;
 		}
 		closedir(d);
+
+		readfiles(paths, cnt, lus);
+		for (i = 0; i < cnt; i++) {
+			free(paths[i]);
+		}
+		free(paths);
 	}
 }
 
@@ -1851,140 +2483,6 @@ WriteMyPropertyListToFile(CFPropertyListRef plist, const char *posixfile)
 	}
 }
 
-static inline Boolean
-_is_launch_data_t(launch_data_t obj)
-{
-	Boolean result = true;
-
-	switch (launch_data_get_type(obj)) {
-		case LAUNCH_DATA_STRING		: break;
-		case LAUNCH_DATA_INTEGER	: break;
-		case LAUNCH_DATA_REAL		: break;
-		case LAUNCH_DATA_BOOL		: break;
-		case LAUNCH_DATA_ARRAY		: break;
-		case LAUNCH_DATA_DICTIONARY	: break;
-		case LAUNCH_DATA_FD 		: break;
-		case LAUNCH_DATA_MACHPORT	: break;
-		default						: result = false;
-	}
-
-	return result;
-}
-
-static void
-_launch_data_iterate(launch_data_t obj, const char *key, CFMutableDictionaryRef dict)
-{
-	if (obj && _is_launch_data_t(obj)) {
-		CFStringRef cfKey = CFStringCreateWithCString(NULL, key, kCFStringEncodingUTF8);
-		CFTypeRef cfVal = CFTypeCreateFromLaunchData(obj);
-
-		if (cfVal) {
-			CFDictionarySetValue(dict, cfKey, cfVal);
-			CFRelease(cfVal);
-		}
-		CFRelease(cfKey);
-	}
-}
-
-static CFTypeRef
-CFTypeCreateFromLaunchData(launch_data_t obj)
-{
-	CFTypeRef cfObj = NULL;
-
-	switch (launch_data_get_type(obj)) {
-	case LAUNCH_DATA_STRING: {
-		const char *str = launch_data_get_string(obj);
-		cfObj = CFStringCreateWithCString(NULL, str, kCFStringEncodingUTF8);
-		break;
-	}
-	case LAUNCH_DATA_INTEGER: {
-		long long integer = launch_data_get_integer(obj);
-		cfObj = CFNumberCreate(NULL, kCFNumberLongLongType, &integer);
-		break;
-	}
-	case LAUNCH_DATA_REAL: {
-		double real = launch_data_get_real(obj);
-		cfObj = CFNumberCreate(NULL, kCFNumberDoubleType, &real);
-		break;
-	}
-	case LAUNCH_DATA_BOOL: {
-		bool yesno = launch_data_get_bool(obj);
-		cfObj = yesno ? kCFBooleanTrue : kCFBooleanFalse;
-		break;
-	}
-	case LAUNCH_DATA_ARRAY: {
-		cfObj = (CFTypeRef)CFArrayCreateFromLaunchArray(obj);
-		break;
-	}
-	case LAUNCH_DATA_DICTIONARY: {
-		cfObj = (CFTypeRef)CFDictionaryCreateFromLaunchDictionary(obj);
-		break;
-	}
-	case LAUNCH_DATA_FD: {
-		int fd = launch_data_get_fd(obj);
-		cfObj = CFNumberCreate(NULL, kCFNumberIntType, &fd);
-		break;
-	}
-	case LAUNCH_DATA_MACHPORT: {
-		mach_port_t port = launch_data_get_machport(obj);
-		cfObj = CFNumberCreate(NULL, kCFNumberIntType, &port);
-		break;
-	}
-	default:
-		break;
-	}
-
-	return cfObj;
-}
-
-#pragma mark CFArray
-static CFArrayRef
-CFArrayCreateFromLaunchArray(launch_data_t arr)
-{
-	CFArrayRef result = NULL;
-	CFMutableArrayRef mutResult = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
-
-	if (launch_data_get_type(arr) == LAUNCH_DATA_ARRAY) {
-		unsigned int count = launch_data_array_get_count(arr);
-		unsigned int i = 0;
-
-		for (i = 0; i < count; i++) {
-			launch_data_t launch_obj = launch_data_array_get_index(arr, i);
-			CFTypeRef obj = CFTypeCreateFromLaunchData(launch_obj);
-
-			if (obj) {
-				CFArrayAppendValue(mutResult, obj);
-				CFRelease(obj);
-			}
-		}
-
-		result = CFArrayCreateCopy(NULL, mutResult);
-	}
-
-	if (mutResult) {
-		CFRelease(mutResult);
-	}
-	return result;
-}
-
-#pragma mark CFDictionary / CFPropertyList
-static CFDictionaryRef
-CFDictionaryCreateFromLaunchDictionary(launch_data_t dict)
-{
-	CFDictionaryRef result = NULL;
-
-	if (launch_data_get_type(dict) == LAUNCH_DATA_DICTIONARY) {
-		CFMutableDictionaryRef mutResult = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-
-		launch_data_dict_iterate(dict, (void (*)(launch_data_t, const char *, void *))_launch_data_iterate, mutResult);
-
-		result = CFDictionaryCreateCopy(NULL, mutResult);
-		CFRelease(mutResult);
-	}
-
-	return result;
-}
-
 void
 myCFDictionaryApplyFunction(const void *key, const void *value, void *context)
 {
@@ -2644,11 +3142,14 @@ load_and_unload_cmd(int argc, char *const argv[])
 		lus.load = true;
 	}
 
-	while ((ch = getopt(argc, argv, "wFS:D:")) != -1) {
+	while ((ch = getopt(argc, argv, "wFAS:D:")) != -1) {
 		switch (ch) {
 		case 'w':
 			lus.editondisk = true;
 			break;
+		case 'A':
+			lus.atomic = true;
+			break;
 		case 'F':
 			lus.forceload = true;
 			break;
@@ -2688,7 +3189,7 @@ load_and_unload_cmd(int argc, char *const argv[])
 	}
 
 	if (badopts) {
-		launchctl_log(LOG_ERR, "usage: %s load [-wF] [-D <user|local|network|system|all>] paths...", getprogname());
+		launchctl_log(LOG_ERR, "usage: %s load [-wFA] [-D <user|local|network|system|all>] paths...", getprogname());
 		return 1;
 	}
 
@@ -2705,6 +3206,7 @@ load_and_unload_cmd(int argc, char *const argv[])
 			if (!_launchctl_overrides_db) {
 				_launchctl_overrides_db = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
 			}
+			plist_cache_open(_launchctl_job_overrides_db_path);
 		} else if (errno != EROFS) {
 			launchctl_log(LOG_ERR, "Could not open job overrides database at: %s: %d: %s", _launchctl_job_overrides_db_path, errno, strerror(errno));
 		}
@@ -2770,6 +3272,8 @@ load_and_unload_cmd(int argc, char *const argv[])
 		readpath(argv[i], &lus);
 	}
 
+	plist_cache_close();
+
 	if (launch_data_array_get_count(lus.pass1) == 0) {
 		if (!_launchctl_is_managed) {
 			launchctl_log(LOG_ERR, "nothing found to %s", lus.load ? "load" : "unload");
@@ -2780,7 +3284,7 @@ load_and_unload_cmd(int argc, char *const argv[])
 
 	if (lus.load) {
 		distill_jobs(lus.pass1);
-		submit_job_pass(lus.pass1);
+		submit_job_pass(lus.pass1, lus.atomic);
 	} else {
 		for (i = 0; i < launch_data_array_get_count(lus.pass1); i++) {
 			unloadjob(launch_data_array_get_index(lus.pass1, i));
@@ -2797,7 +3301,7 @@ load_and_unload_cmd(int argc, char *const argv[])
 }
 
 void
-submit_job_pass(launch_data_t jobs)
+submit_job_pass(launch_data_t jobs, bool atomic)
 {
 	launch_data_t msg, resp;
 	size_t i;
@@ -2808,7 +3312,7 @@ submit_job_pass(launch_data_t jobs)
 
 	msg = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
 
-	launch_data_dict_insert(msg, jobs, LAUNCH_KEY_SUBMITJOB);
+	launch_data_dict_insert(msg, jobs, atomic ? LAUNCH_KEY_SUBMITJOBSATOMICALLY : LAUNCH_KEY_SUBMITJOB);
 
 	resp = launch_msg(msg);
 
@@ -2832,6 +3336,9 @@ submit_job_pass(launch_data_t jobs)
 					case ESRCH:
 						launchctl_log(LOG_ERR, "%s: %s", lab4job, "Not loaded");
 						break;
+					case ECANCELED:
+						launchctl_log(LOG_ERR, "%s: %s", lab4job, "Not loaded because another job failed to load");
+						break;
 					case ENEEDAUTH:
 						launchctl_log(LOG_ERR, "%s: %s", lab4job, "Could not set security session");
 					default:
@@ -2896,19 +3403,11 @@ start_stop_remove_cmd(int argc, char *const argv[])
 }
 
 void
-print_jobs(launch_data_t j, const char *key __attribute__((unused)), void *context __attribute__((unused)))
+print_job_status(long long pid, bool has_status, int wstatus, const char *label)
 {
-	static size_t depth = 0;
-	launch_data_t lo = launch_data_dict_lookup(j, LAUNCH_JOBKEY_LABEL);
-	launch_data_t pido = launch_data_dict_lookup(j, LAUNCH_JOBKEY_PID);
-	launch_data_t stato = launch_data_dict_lookup(j, LAUNCH_JOBKEY_LASTEXITSTATUS);
-	const char *label = launch_data_get_string(lo);
-	size_t i;
-
-	if (pido) {
-		fprintf(stdout, "%lld\t-\t%s\n", launch_data_get_integer(pido), label);
-	} else if (stato) {
-		int wstatus = (int)launch_data_get_integer(stato);
+	if (pid) {
+		fprintf(stdout, "%lld\t-\t%s\n", pid, label);
+	} else if (has_status) {
 		if (WIFEXITED(wstatus)) {
 			fprintf(stdout, "-\t%d\t%s\n", WEXITSTATUS(wstatus), label);
 		} else if (WIFSIGNALED(wstatus)) {
@@ -2919,6 +3418,20 @@ print_jobs(launch_data_t j, const char *key __attribute__((unused)), void *conte
 	} else {
 		fprintf(stdout, "-\t-\t%s\n", label);
 	}
+}
+
+void
+print_jobs(launch_data_t j, const char *key __attribute__((unused)), void *context __attribute__((unused)))
+{
+	static size_t depth = 0;
+	launch_data_t lo = launch_data_dict_lookup(j, LAUNCH_JOBKEY_LABEL);
+	launch_data_t pido = launch_data_dict_lookup(j, LAUNCH_JOBKEY_PID);
+	launch_data_t stato = launch_data_dict_lookup(j, LAUNCH_JOBKEY_LASTEXITSTATUS);
+	const char *label = launch_data_get_string(lo);
+	size_t i;
+
+	print_job_status(pido ? launch_data_get_integer(pido) : 0, stato != NULL,
+			stato ? (int)launch_data_get_integer(stato) : 0, label);
 	for (i = 0; i < depth; i++) {
 		fprintf(stdout, "\t");
 	}
@@ -2986,6 +3499,31 @@ print_obj(launch_data_t obj, const char *key, void *context __attribute__((unuse
 	}
 }
 
+static int
+list_print_job(launch_data_t resp, bool plist_output, const char *cmd)
+{
+	int r = 1;
+
+	if (launch_data_get_type(resp) == LAUNCH_DATA_DICTIONARY) {
+		if (plist_output) {
+			char *xml = launch_data_plist_xml(resp, NULL);
+			if (xml) {
+				launchctl_log(LOG_NOTICE, "%s", xml);
+				free(xml);
+				r = 0;
+			}
+		} else {
+			print_obj(resp, NULL, NULL);
+			r = 0;
+		}
+	} else {
+		launchctl_log(LOG_ERR, "%s %s returned unknown response", getprogname(), cmd);
+	}
+	launch_data_free(resp);
+
+	return r;
+}
+
 int
 list_cmd(int argc, char *const argv[])
 {
@@ -2997,21 +3535,20 @@ list_cmd(int argc, char *const argv[])
 	}
 
 	launch_data_t resp, msg = NULL;
-	int r = 0;
+	struct launch_jobstat_slot *slots;
+	size_t nslots;
+	int i, r = 0;
 
 	bool plist_output = false;
-	char *label = NULL;
-	if (argc > 3) {
-		launchctl_log(LOG_ERR, "usage: %s list [-x] [label]", getprogname());
-		return 1;
-	} else if (argc >= 2) {
-		plist_output = (strncmp(argv[1], "-x", sizeof("-x")) == 0);
-		label = plist_output ? argv[2] : argv[1];
+	int first = 1;
+	if (argc >= 2 && strncmp(argv[1], "-x", sizeof("-x")) == 0) {
+		plist_output = true;
+		first = 2;
 	}
 
-	if (label) {
+	if (argc - first == 1) {
 		msg = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
-		launch_data_dict_insert(msg, launch_data_new_string(label), LAUNCH_KEY_GETJOB);
+		launch_data_dict_insert(msg, launch_data_new_string(argv[first]), LAUNCH_KEY_GETJOB);
 
 		resp = launch_msg(msg);
 		launch_data_free(msg);
@@ -3019,38 +3556,46 @@ list_cmd(int argc, char *const argv[])
 		if (resp == NULL) {
 			launchctl_log(LOG_ERR, "launch_msg(): %s", strerror(errno));
 			r = 1;
-		} else if (launch_data_get_type(resp) == LAUNCH_DATA_DICTIONARY) {
-			if (plist_output) {
-				CFDictionaryRef respDict = CFDictionaryCreateFromLaunchDictionary(resp);
-				CFStringRef plistStr = NULL;
-				if (respDict) {
-					CFDataRef plistData = CFPropertyListCreateXMLData(NULL, (CFPropertyListRef)respDict);
-					CFRelease(respDict);
-					if (plistData) {
-						plistStr = CFStringCreateWithBytes(NULL, CFDataGetBytePtr(plistData), CFDataGetLength(plistData), kCFStringEncodingUTF8, false);
-						CFRelease(plistData);
-					} else {
-						r = 1;
-					}
-				} else {
-					r = 1;
-				}
+		} else {
+			r = list_print_job(resp, plist_output, argv[0]);
+		}
+	} else if (argc - first > 1) {
+		/* Ask for all of them at once rather than one round trip each. */
+		size_t cnt = argc - first;
+		launch_data_t msgs[cnt], resps[cnt];
 
-				if (plistStr) {
-					launchctl_log_CFString(LOG_NOTICE, plistStr);
-					CFRelease(plistStr);
-					r = 0;
+		for (i = 0; i < (int)cnt; i++) {
+			msgs[i] = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+			launch_data_dict_insert(msgs[i], launch_data_new_string(argv[first + i]), LAUNCH_KEY_GETJOB);
+		}
+
+		if (launch_msg_pipeline(msgs, resps, cnt) == -1) {
+			launchctl_log(LOG_ERR, "launch_msg_pipeline(): %s", strerror(errno));
+			r = 1;
+		} else {
+			for (i = 0; i < (int)cnt; i++) {
+				if (launch_data_get_type(resps[i]) == LAUNCH_DATA_ERRNO) {
+					launchctl_log(LOG_ERR, "%s: %s", argv[first + i], strerror(launch_data_get_errno(resps[i])));
+					launch_data_free(resps[i]);
+					r = 1;
+				} else if (list_print_job(resps[i], plist_output, argv[0]) != 0) {
+					r = 1;
 				}
-			} else {
-				print_obj(resp, NULL, NULL);
-				r = 0;
 			}
-			launch_data_free(resp);
-		} else {
-			launchctl_log(LOG_ERR, "%s %s returned unknown response", getprogname(), argv[0]);
-			r = 1;
-			launch_data_free(resp);
 		}
+
+		for (i = 0; i < (int)cnt; i++) {
+			launch_data_free(msgs[i]);
+		}
+	} else if (launch_jobstat_copy(&slots, &nslots) == 0) {
+		/* launchd's status table has all we print, without asking it. */
+		fprintf(stdout, "PID\tStatus\tLabel\n");
+		for (i = 0; i < (int)nslots; i++) {
+			print_job_status(slots[i].ljs_pid, true, slots[i].ljs_status, slots[i].ljs_label);
+		}
+		free(slots);
+
+		r = 0;
 	} else if (vproc_swap_complex(NULL, VPROC_GSK_ALLJOBS, NULL, &resp) == NULL) {
 		fprintf(stdout, "PID\tStatus\tLabel\n");
 		launch_data_dict_iterate(resp, print_jobs, NULL);
@@ -3554,6 +4099,156 @@ getrusage_cmd(int argc, char *const argv[])
 	return r;
 }
 
+static long long
+hashstats_get(launch_data_t table, const char *key)
+{
+	launch_data_t tmp = launch_data_dict_lookup(table, key);
+
+	return (tmp && launch_data_get_type(tmp) == LAUNCH_DATA_INTEGER) ? launch_data_get_integer(tmp) : 0;
+}
+
+static void
+print_hashstats(launch_data_t table, const char *name, void *context __attribute__((unused)))
+{
+	long long count, buckets;
+	launch_data_t growing;
+
+	if (launch_data_get_type(table) != LAUNCH_DATA_DICTIONARY) {
+		return;
+	}
+
+	count = hashstats_get(table, LAUNCH_KEY_HASHSTATS_COUNT);
+	buckets = hashstats_get(table, LAUNCH_KEY_HASHSTATS_BUCKETS);
+	growing = launch_data_dict_lookup(table, LAUNCH_KEY_HASHSTATS_GROWING);
+
+	launchctl_log(LOG_NOTICE, "%-16s%8lld%10lld%8.2f%8lld%10lld%s", name, count, buckets,
+			buckets ? (double)count / (double)buckets : 0.0,
+			hashstats_get(table, LAUNCH_KEY_HASHSTATS_USEDBUCKETS),
+			hashstats_get(table, LAUNCH_KEY_HASHSTATS_LONGESTCHAIN),
+			(growing && launch_data_get_bool(growing)) ? "  (growing)" : "");
+}
+
+int
+hashstats_cmd(int argc, char *const argv[])
+{
+	launch_data_t resp, msg;
+	int r = 0;
+
+	if (argc != 1) {
+		launchctl_log(LOG_ERR, "usage: %s %s", getprogname(), argv[0]);
+		return 1;
+	}
+
+	msg = launch_data_new_string(LAUNCH_KEY_GETHASHSTATS);
+	resp = launch_msg(msg);
+	launch_data_free(msg);
+
+	if (resp == NULL) {
+		launchctl_log(LOG_ERR, "launch_msg(): %s", strerror(errno));
+		return 1;
+	} else if (launch_data_get_type(resp) == LAUNCH_DATA_ERRNO) {
+		launchctl_log(LOG_ERR, "%s %s error: %s", getprogname(), argv[0], strerror(launch_data_get_errno(resp)));
+		r = 1;
+	} else if (launch_data_get_type(resp) == LAUNCH_DATA_DICTIONARY) {
+		launchctl_log(LOG_NOTICE, "%-16s%8s%10s%8s%8s%10s", "Index", "Count", "Buckets", "Load", "Used", "Longest");
+		launch_data_dict_iterate(resp, print_hashstats, NULL);
+	} else {
+		launchctl_log(LOG_ERR, "%s %s returned unknown response", getprogname(), argv[0]);
+		r = 1;
+	}
+
+	launch_data_free(resp);
+
+	return r;
+}
+
+static bool
+spawnstats_limit(launch_data_t limits, const char *key, const char *arg)
+{
+	char *endptr;
+	long long v;
+
+	errno = 0;
+	v = strtoll(arg, &endptr, 10);
+	if (errno || *endptr != '\0' || endptr == arg || v < 0 || v > UINT32_MAX) {
+		return false;
+	}
+	launch_data_dict_insert(limits, launch_data_new_integer(v), key);
+	return true;
+}
+
+int
+spawnstats_cmd(int argc, char *const argv[])
+{
+	static const char *const buckets[] = { "< 1 ms", "< 10 ms", "< 100 ms", "< 1 s", "< 10 s", ">= 10 s" };
+	launch_data_t resp, msg, limits, hist;
+	long long admitted;
+	size_t i;
+	int r = 0;
+
+	if (argc > 3) {
+		launchctl_log(LOG_ERR, "usage: %s %s [limit [per-manager-limit]]", getprogname(), argv[0]);
+		return 1;
+	}
+
+	if (argc > 1) {
+		msg = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+		limits = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+		launch_data_dict_insert(msg, limits, LAUNCH_KEY_SETSPAWNLIMITS);
+		if (!spawnstats_limit(limits, LAUNCH_KEY_SPAWNSTATS_LIMIT, argv[1])
+				|| (argc > 2 && !spawnstats_limit(limits, LAUNCH_KEY_SPAWNSTATS_PERMANAGERLIMIT, argv[2]))) {
+			launchctl_log(LOG_ERR, "usage: %s %s [limit [per-manager-limit]]", getprogname(), argv[0]);
+			launch_data_free(msg);
+			return 1;
+		}
+	} else {
+		msg = launch_data_new_string(LAUNCH_KEY_GETSPAWNSTATS);
+	}
+
+	resp = launch_msg(msg);
+	launch_data_free(msg);
+
+	if (resp == NULL) {
+		launchctl_log(LOG_ERR, "launch_msg(): %s", strerror(errno));
+		return 1;
+	} else if (launch_data_get_type(resp) == LAUNCH_DATA_ERRNO) {
+		launchctl_log(LOG_ERR, "%s %s error: %s", getprogname(), argv[0], strerror(launch_data_get_errno(resp)));
+		r = 1;
+	} else if (launch_data_get_type(resp) == LAUNCH_DATA_DICTIONARY) {
+		admitted = hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_ADMITTED);
+
+		launchctl_log(LOG_NOTICE, "Limit:            %lld in flight, %lld per job manager (0 is unlimited)",
+				hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_LIMIT),
+				hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_PERMANAGERLIMIT));
+		launchctl_log(LOG_NOTICE, "Now:              %lld in flight, %lld queued",
+				hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_INFLIGHT),
+				hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_QUEUED));
+		launchctl_log(LOG_NOTICE, "Starts:           %lld admitted, %lld of them queued, %lld on demand, %lld timed out",
+				admitted,
+				hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_DELAYED),
+				hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_DEMANDED),
+				hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_TIMEDOUT));
+		launchctl_log(LOG_NOTICE, "Queueing delay:   %.3f ms mean, %.3f ms max",
+				admitted ? hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_TOTALDELAY) / 1000.0 / admitted : 0.0,
+				hashstats_get(resp, LAUNCH_KEY_SPAWNSTATS_MAXDELAY) / 1000.0);
+
+		hist = launch_data_dict_lookup(resp, LAUNCH_KEY_SPAWNSTATS_DELAYHISTOGRAM);
+		if (hist && launch_data_get_type(hist) == LAUNCH_DATA_ARRAY) {
+			for (i = 0; i < launch_data_array_get_count(hist) && i < sizeof(buckets) / sizeof(buckets[0]); i++) {
+				launchctl_log(LOG_NOTICE, "    %-10s%12lld", buckets[i],
+						launch_data_get_integer(launch_data_array_get_index(hist, i)));
+			}
+		}
+	} else {
+		launchctl_log(LOG_ERR, "%s %s returned unknown response", getprogname(), argv[0]);
+		r = 1;
+	}
+
+	launch_data_free(resp);
+
+	return r;
+}
+
 bool
 launch_data_array_append(launch_data_t a, launch_data_t o)
 {
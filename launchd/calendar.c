@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calendar.h"
+
+/* How far ahead calendar_next() looks before deciding a spec can never
+ * match. The Gregorian calendar repeats every 400 years.
+ */
+#define CALENDAR_MAX_YEARS 400
+
+static const struct {
+	int lo;
+	int hi;
+} calendar_bounds[CALENDAR_FIELD_COUNT] = {
+	[CALENDAR_MINUTE] = { 0, 59 },
+	[CALENDAR_HOUR] = { 0, 23 },
+	[CALENDAR_MDAY] = { 1, 31 },
+	[CALENDAR_MONTH] = { 1, 12 },
+	[CALENDAR_WDAY] = { 0, 7 },
+};
+
+#define CALENDAR_BOTH_DAYS ((1 << CALENDAR_MDAY) | (1 << CALENDAR_WDAY))
+
+void
+calendar_spec_init(struct calendar_spec *cs)
+{
+	cs->cs_min = (1ULL << 60) - 1;
+	cs->cs_hour = (1U << 24) - 1;
+	cs->cs_mday = ((1U << 31) - 1) << 1;
+	cs->cs_mon = (1U << 12) - 1;
+	cs->cs_wday = (1U << 7) - 1;
+	cs->cs_restricted = 0;
+}
+
+int
+calendar_spec_add(struct calendar_spec *cs, int field, int lo, int hi, int step)
+{
+	uint64_t bits = 0;
+	int i;
+
+	if (field < 0 || field >= CALENDAR_FIELD_COUNT || step < 1 || lo > hi
+			|| lo < calendar_bounds[field].lo || hi > calendar_bounds[field].hi) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = lo; i <= hi; i += step) {
+		bits |= 1ULL << i;
+	}
+
+	if (!(cs->cs_restricted & (1 << field))) {
+		cs->cs_restricted |= 1 << field;
+		switch (field) {
+		case CALENDAR_MINUTE:	cs->cs_min = 0;		break;
+		case CALENDAR_HOUR:	cs->cs_hour = 0;	break;
+		case CALENDAR_MDAY:	cs->cs_mday = 0;	break;
+		case CALENDAR_MONTH:	cs->cs_mon = 0;		break;
+		case CALENDAR_WDAY:	cs->cs_wday = 0;	break;
+		}
+	}
+
+	switch (field) {
+	case CALENDAR_MINUTE:
+		cs->cs_min |= bits;
+		break;
+	case CALENDAR_HOUR:
+		cs->cs_hour |= (uint32_t)bits;
+		break;
+	case CALENDAR_MDAY:
+		cs->cs_mday |= (uint32_t)bits;
+		break;
+	case CALENDAR_MONTH:
+		cs->cs_mon |= (uint16_t)(bits >> 1);
+		break;
+	case CALENDAR_WDAY:
+		/* 7 is Sunday, as in cron. */
+		cs->cs_wday |= (uint8_t)((bits | (bits >> 7)) & 0x7f);
+		break;
+	}
+
+	return 0;
+}
+
+int
+calendar_spec_parse(struct calendar_spec *cs, int field, const char *expr)
+{
+	const char *p = expr;
+
+	if (field < 0 || field >= CALENDAR_FIELD_COUNT || !*p) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (;;) {
+		long lo, hi, step = 1;
+		bool star = false;
+		char *end;
+
+		if (*p == '*') {
+			star = true;
+			lo = calendar_bounds[field].lo;
+			hi = calendar_bounds[field].hi;
+			p++;
+		} else {
+			lo = hi = strtol(p, &end, 10);
+			if (end == p) {
+				goto bad;
+			}
+			p = end;
+			if (*p == '-') {
+				p++;
+				hi = strtol(p, &end, 10);
+				if (end == p) {
+					goto bad;
+				}
+				p = end;
+			}
+		}
+
+		if (*p == '/') {
+			p++;
+			step = strtol(p, &end, 10);
+			if (end == p) {
+				goto bad;
+			}
+			p = end;
+			/* "5/15" means every 15 starting at 5. */
+			if (!star && lo == hi) {
+				hi = calendar_bounds[field].hi;
+			}
+		} else if (star) {
+			/* A bare "*" leaves the field a wildcard. */
+			if (*p == '\0' && p == expr + 1) {
+				return 0;
+			}
+		}
+
+		if (*p != '\0' && *p != ',') {
+			goto bad;
+		}
+		if (lo < 0 || hi > 63 || calendar_spec_add(cs, field, (int)lo, (int)hi, (int)step) == -1) {
+			goto bad;
+		}
+		if (*p == '\0') {
+			return 0;
+		}
+		p++;
+	}
+
+bad:
+	errno = EINVAL;
+	return -1;
+}
+
+static bool
+calendar_leap(int y)
+{
+	return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+static int
+calendar_days_in_month(int y, int mon)
+{
+	static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+	return days[mon] + (mon == 1 && calendar_leap(y));
+}
+
+/* Day of the week for a Gregorian date, 0 being Sunday. */
+static int
+calendar_weekday(int y, int mon, int mday)
+{
+	static const int t[12] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+
+	if (mon < 2) {
+		y--;
+	}
+	return (y + y / 4 - y / 100 + y / 400 + t[mon] + mday) % 7;
+}
+
+/* The lowest set bit of 'mask' in [from, limit), or -1. */
+static int
+calendar_next_bit(uint64_t mask, int from, int limit)
+{
+	if (from >= limit) {
+		return -1;
+	}
+	mask &= ~0ULL << from;
+	if (limit < 64) {
+		mask &= (1ULL << limit) - 1;
+	}
+	return mask ? __builtin_ctzll(mask) : -1;
+}
+
+static bool
+calendar_day_matches(const struct calendar_spec *cs, int y, int mon, int mday)
+{
+	bool md = cs->cs_mday & (1U << mday);
+	bool wd = cs->cs_wday & (1U << calendar_weekday(y, mon, mday));
+
+	if ((cs->cs_restricted & CALENDAR_BOTH_DAYS) == CALENDAR_BOTH_DAYS) {
+		return md || wd;
+	}
+	return md && wd;
+}
+
+static int64_t
+calendar_wall_key(int y, int mon, int mday, int hour, int min)
+{
+	return ((((int64_t)y * 12 + mon) * 31 + mday) * 24 + hour) * 60 + min;
+}
+
+static int64_t
+calendar_wall_key_at(time_t t)
+{
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	return calendar_wall_key(tm.tm_year + 1900, tm.tm_mon, tm.tm_mday, tm.tm_hour, tm.tm_min);
+}
+
+/* Days since 1970-01-01 for a Gregorian date. */
+static int64_t
+calendar_days_from_civil(int y, int mon, int mday)
+{
+	int64_t era, yoe, doy, doe;
+
+	mon++;
+	y -= mon <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+/* Turns a local wall time into the instant it should fire at, or -1 if it
+ * should be skipped because its only acceptable occurrence is not after
+ * 'after'. '*gmtoff' starts as a guess at the UTC offset in effect then and
+ * returns the actual one.
+ */
+static time_t
+calendar_resolve(const struct calendar_spec *cs, int y, int mon, int mday, int hour, int min, time_t after, long *gmtoffp)
+{
+	long gmtoff = *gmtoffp;
+	int64_t key = calendar_wall_key(y, mon, mday, hour, min);
+	time_t base = (time_t)(calendar_days_from_civil(y, mon, mday) * 86400 + hour * 3600 + min * 60);
+	time_t occ[2], lo, hi;
+	int i, n = 0;
+
+	/* Usually the offset is the same as now, or as whatever the first guess
+	 * lands on, and no transition is anywhere near; then a few localtime_r()
+	 * calls settle it and mktime() is not needed.
+	 */
+	for (i = 0; i < 2; i++) {
+		struct tm tm, near;
+		time_t r = base - gmtoff;
+
+		localtime_r(&r, &tm);
+		if (tm.tm_gmtoff != gmtoff) {
+			gmtoff = tm.tm_gmtoff;
+			continue;
+		}
+		if (calendar_wall_key(tm.tm_year + 1900, tm.tm_mon, tm.tm_mday, tm.tm_hour, tm.tm_min) != key) {
+			break;
+		}
+		lo = r - 7200;
+		hi = r + 7200;
+		if (localtime_r(&lo, &near)->tm_gmtoff != gmtoff || localtime_r(&hi, &near)->tm_gmtoff != gmtoff) {
+			break;
+		}
+		*gmtoffp = gmtoff;
+		return r > after ? r : -1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		struct tm tm;
+		time_t r;
+
+		memset(&tm, 0, sizeof(tm));
+		tm.tm_year = y - 1900;
+		tm.tm_mon = mon;
+		tm.tm_mday = mday;
+		tm.tm_hour = hour;
+		tm.tm_min = min;
+		tm.tm_isdst = i;
+
+		if ((r = mktime(&tm)) == -1 || calendar_wall_key_at(r) != key) {
+			continue;
+		}
+		if (n == 1 && occ[0] == r) {
+			continue;
+		}
+		occ[n++] = r;
+	}
+
+	if (n == 2 && occ[1] < occ[0]) {
+		time_t tmp = occ[0];
+		occ[0] = occ[1];
+		occ[1] = tmp;
+	}
+
+	if (n > 0) {
+		if (occ[0] > after) {
+			hi = occ[0];
+		} else if (n == 2 && occ[1] > after && !(cs->cs_restricted & (1 << CALENDAR_HOUR))) {
+			/* The second pass through a repeated hour only counts for jobs
+			 * that run every hour anyway.
+			 */
+			hi = occ[1];
+		} else {
+			return -1;
+		}
+	} else {
+		/* The wall time was skipped by a spring-forward transition. Fire at
+		 * the first instant after it, which is the end of the gap. UTC
+		 * offsets stay within 14 hours, which bounds the search.
+		 */
+		lo = base - 16 * 3600;
+		hi = base + 16 * 3600;
+		while (hi - lo > 1) {
+			time_t mid = lo + (hi - lo) / 2;
+			if (calendar_wall_key_at(mid) > key) {
+				hi = mid;
+			} else {
+				lo = mid;
+			}
+		}
+	}
+
+	{
+		struct tm tm;
+		*gmtoffp = localtime_r(&hi, &tm)->tm_gmtoff;
+	}
+
+	return hi;
+}
+
+/* Finds the first matching wall time at or after the one given, and resolves
+ * it to an instant after 'after'. '*gmtoff' receives the UTC offset in effect
+ * at that instant.
+ */
+static time_t
+calendar_search(const struct calendar_spec *cs, const struct tm *from, time_t after, long *gmtoff)
+{
+	int y, mon, mday, hour, min, n, last_year;
+	time_t r;
+
+	y = from->tm_year + 1900;
+	mon = from->tm_mon;
+	mday = from->tm_mday;
+	hour = from->tm_hour;
+	min = from->tm_min;
+	last_year = y + CALENDAR_MAX_YEARS;
+	*gmtoff = from->tm_gmtoff;
+
+	for (;;) {
+		if (min > 59) {
+			min = 0;
+			hour++;
+		}
+		if (hour > 23) {
+			hour = min = 0;
+			mday++;
+		}
+		if (mday > calendar_days_in_month(y, mon)) {
+			mday = 1;
+			hour = min = 0;
+			mon++;
+		}
+		if (mon > 11) {
+			mon = 0;
+			mday = 1;
+			hour = min = 0;
+			y++;
+		}
+		if (y > last_year) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		if ((n = calendar_next_bit(cs->cs_mon, mon, 12)) == -1) {
+			y++;
+			mon = 0;
+			mday = 1;
+			hour = min = 0;
+			continue;
+		}
+		if (n != mon) {
+			mon = n;
+			mday = 1;
+			hour = min = 0;
+		}
+
+		n = mday;
+		while (mday <= calendar_days_in_month(y, mon) && !calendar_day_matches(cs, y, mon, mday)) {
+			mday++;
+		}
+		if (mday > calendar_days_in_month(y, mon)) {
+			continue;
+		}
+		if (n != mday) {
+			hour = min = 0;
+		}
+
+		if ((n = calendar_next_bit(cs->cs_hour, hour, 24)) == -1) {
+			hour = 24;
+			continue;
+		}
+		if (n != hour) {
+			hour = n;
+			min = 0;
+		}
+
+		if ((n = calendar_next_bit(cs->cs_min, min, 60)) == -1) {
+			min = 60;
+			continue;
+		}
+		min = n;
+
+		if ((r = calendar_resolve(cs, y, mon, mday, hour, min, after, gmtoff)) != -1) {
+			return r;
+		}
+		min++;
+	}
+}
+
+time_t
+calendar_next(const struct calendar_spec *cs, time_t after)
+{
+	struct tm tm, rtm;
+	time_t r, lo, hi;
+	long gmtoff;
+
+	if (!localtime_r(&after, &tm)) {
+		return -1;
+	}
+
+	tm.tm_min++;
+	if ((r = calendar_search(cs, &tm, after, &gmtoff)) == -1) {
+		return -1;
+	}
+
+	/* If the clock falls back shortly after 'after', the wall times it
+	 * repeats come around again and may match before 'r'. Further out, the
+	 * search above already went through them on their first pass.
+	 */
+	hi = r;
+	if (r - after > 7200) {
+		hi = after + 7200;
+		gmtoff = localtime_r(&hi, &rtm)->tm_gmtoff;
+	}
+	if (gmtoff >= tm.tm_gmtoff) {
+		return r;
+	}
+
+	lo = after;
+	while (hi - lo > 1) {
+		time_t mid = lo + (hi - lo) / 2;
+		if (localtime_r(&mid, &rtm)->tm_gmtoff < tm.tm_gmtoff) {
+			hi = mid;
+		} else {
+			lo = mid;
+		}
+	}
+
+	localtime_r(&hi, &rtm);
+	if ((lo = calendar_search(cs, &rtm, after, &gmtoff)) != -1 && lo < r) {
+		r = lo;
+	}
+
+	return r;
+}
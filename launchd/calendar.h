@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAUNCHD_CALENDAR_H__
+#define __LAUNCHD_CALENDAR_H__
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * StartCalendarInterval schedules. Each field is a bitmask of the values it
+ * matches, so the next fire time is found by scanning bits rather than by
+ * stepping a struct tm through mktime(3).
+ *
+ * As in cron, when both the day of the month and the day of the week are
+ * restricted, a day matching either one fires.
+ */
+
+enum {
+	CALENDAR_MINUTE,	/* 0-59 */
+	CALENDAR_HOUR,		/* 0-23 */
+	CALENDAR_MDAY,		/* 1-31 */
+	CALENDAR_MONTH,		/* 1-12 */
+	CALENDAR_WDAY,		/* 0-7, where 7 is also Sunday */
+	CALENDAR_FIELD_COUNT,
+};
+
+struct calendar_spec {
+	uint64_t cs_min;
+	uint32_t cs_hour;
+	uint32_t cs_mday;	/* bit 0 unused */
+	uint16_t cs_mon;	/* bit 0 is January */
+	uint8_t cs_wday;	/* bit 0 is Sunday */
+	uint8_t cs_restricted;	/* 1 << field, for each field that is not "*" */
+};
+
+/* Matches every minute. */
+void calendar_spec_init(struct calendar_spec *cs);
+
+/* Restricts 'field' to lo..hi in steps of 'step'. The first call on a field
+ * replaces its wildcard; later calls add to it, which is how lists are built.
+ * Returns -1 with errno set to EINVAL if the range is out of bounds.
+ */
+int calendar_spec_add(struct calendar_spec *cs, int field, int lo, int hi, int step);
+
+/* Parses a cron-style field: "*", "5", "1-5", a stepped range such as
+ * "0-30/10" or "*" followed by "/15", or a comma-separated list of those.
+ */
+int calendar_spec_parse(struct calendar_spec *cs, int field, const char *expr);
+
+/* The first minute strictly after 'after', in local time, that the spec
+ * matches; -1 with errno set to EINVAL if it never matches (e.g. April 31).
+ *
+ * A time that falls in a daylight saving gap fires when the gap ends. A time
+ * repeated by a fall-back transition fires once, on its first occurrence,
+ * unless the hour is a wildcard, in which case both occurrences fire.
+ */
+time_t calendar_next(const struct calendar_spec *cs, time_t after);
+
+#endif /* __LAUNCHD_CALENDAR_H__ */
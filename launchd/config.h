@@ -40,4 +40,22 @@
 #define HAVE_SYSTEMSTATS 0
 #endif
 
+/*
+ * Jobs are started through a spawn plan (see spawn.h) wherever the child has
+ * no Mach setup to do before it execs. Darwin's children still check in with
+ * launchd through _vproc_post_fork_ping(), which a vfork()ed child cannot do
+ * while launchd waits on it.
+ */
+#ifdef __APPLE__
+#define HAVE_VFORK_SPAWN 0
+#else
+#define HAVE_VFORK_SPAWN 1
+#endif
+
+#ifdef __linux__
+#define HAVE_CLONE_VFORK 1
+#else
+#define HAVE_CLONE_VFORK 0
+#endif
+
 #endif /* __CONFIG_H__ */
@@ -38,7 +38,7 @@
 #endif
 #include <sys/types.h>
 #include <sys/queue.h>
-#include <sys/event.h>
+#include "evloop.h"
 #include <sys/stat.h>
 #include <sys/ucred.h>
 #include <sys/fcntl.h>
@@ -123,6 +123,11 @@ extern int gL1CacheEnabled;
 
 #include "launchd.h"
 #include "runtime.h"
+#include "calendar.h"
+#include "hashtab.h"
+#include "jobkeys.h"
+#include "jobgen.h"
+#include "jobstat.h"
 #include "ipc.h"
 #include "job.h"
 #include "jobServer.h"
@@ -146,6 +151,23 @@ extern int gL1CacheEnabled;
 #define LAUNCHD_SIGKILL_TIMER 4
 #define LAUNCHD_LOG_FAILED_EXEC_FREQ 10
 
+/* Job starts that nobody is waiting on go through admission control. A start
+ * is in flight from fork(2) until the job execs, or checks in if it has
+ * sockets or Mach services to check in for, or exits. The exec of a forked
+ * job is also seen as EOF on its fork_fd, since not every kevent backend has
+ * NOTE_EXEC. Past the global or the job manager's limit, starts wait in a
+ * FIFO per StartPriority and are admitted highest priority first as earlier
+ * ones land. A start that has not landed after LAUNCHD_ADMISSION_TIMEOUT
+ * seconds stops counting.
+ */
+#define LAUNCHD_ADMISSION_LIMIT 32
+#define LAUNCHD_ADMISSION_PERMGR_LIMIT 16
+#define LAUNCHD_ADMISSION_TIMEOUT 10
+#define LAUNCHD_START_PRIORITY_MIN (-10)
+#define LAUNCHD_START_PRIORITY_MAX 10
+#define LAUNCHD_START_PRIORITIES (LAUNCHD_START_PRIORITY_MAX - LAUNCHD_START_PRIORITY_MIN + 1)
+#define LAUNCHD_ADMISSION_DELAY_BUCKETS 6
+
 #define SHUTDOWN_LOG_DIR "/var/log/shutdown"
 
 #define TAKE_SUBSET_NAME "TakeSubsetName"
@@ -167,8 +189,8 @@ static void waiting4removal_delete(job_t j, struct waiting_for_removal *w4r);
 struct machservice {
 	SLIST_ENTRY(machservice) sle;
 	SLIST_ENTRY(machservice) special_port_sle;
-	LIST_ENTRY(machservice) name_hash_sle;
-	LIST_ENTRY(machservice) port_hash_sle;
+	struct hashtab_node name_hash_node;
+	struct hashtab_node port_hash_node;
 	struct machservice *alias;
 	job_t job;
 	unsigned int gen_num;
@@ -198,10 +220,10 @@ struct machservice {
 // HACK: This should be per jobmgr_t
 static SLIST_HEAD(, machservice) special_ports;
 
-#define PORT_HASH_SIZE 32
-#define HASH_PORT(x) (IS_POWER_OF_TWO(PORT_HASH_SIZE) ? (MACH_PORT_INDEX(x) & (PORT_HASH_SIZE - 1)) : (MACH_PORT_INDEX(x) % PORT_HASH_SIZE))
+#define ms_from_name_node(hn) hashtab_entry(hn, struct machservice, name_hash_node)
+#define ms_from_port_node(hn) hashtab_entry(hn, struct machservice, port_hash_node)
 
-static LIST_HEAD(, machservice) port_hash[PORT_HASH_SIZE];
+static struct hashtab port_hash;
 
 static void machservice_setup(launch_data_t obj, const char *key, void *context);
 static void machservice_setup_options(launch_data_t obj, const char *key, void *context);
@@ -240,21 +262,19 @@ static void socketgroup_setup(launch_data_t obj, const char *key, void *context)
 static void socketgroup_kevent_mod(job_t j, struct socketgroup *sg, bool do_add);
 
 struct calendarinterval {
-	LIST_ENTRY(calendarinterval) global_sle;
 	SLIST_ENTRY(calendarinterval) sle;
 	job_t job;
-	struct tm when;
+	struct calendar_spec when;
 	time_t when_next;
 };
 
-static LIST_HEAD(, calendarinterval) sorted_calendar_events;
 
-static bool calendarinterval_new(job_t j, struct tm *w);
+static bool calendarinterval_new(job_t j, struct calendar_spec *w);
 static bool calendarinterval_new_from_obj(job_t j, launch_data_t obj);
 static void calendarinterval_new_from_obj_dict_walk(launch_data_t obj, const char *key, void *context);
 static void calendarinterval_delete(job_t j, struct calendarinterval *ci);
 static void calendarinterval_setalarm(job_t j, struct calendarinterval *ci);
-static void calendarinterval_callback(void);
+static bool calendarinterval_callback(job_t j, void *ident);
 static void calendarinterval_sanity_check(void);
 
 struct envitem {
@@ -285,6 +305,16 @@ static void seatbelt_setup_flags(launch_data_t obj, const char *key, void *conte
 
 static void jetsam_property_setup(launch_data_t obj, const char *key, job_t j);
 
+/* A spawn plan and the storage it points into, for jobs started without
+ * fork(); see spawn.h.
+ */
+struct job_spawn {
+	struct spawn_plan js_plan;
+	struct spawn_rlimit *js_limits;
+	glob_t js_glob;
+	bool js_globbed;
+};
+
 typedef enum {
 	NETWORK_UP = 1,
 	NETWORK_DOWN,
@@ -373,12 +403,6 @@ static struct waiting4attach *waiting4attach_new(jobmgr_t jm, const char *name,
 static void waiting4attach_delete(jobmgr_t jm, struct waiting4attach *w4a);
 static struct waiting4attach *waiting4attach_find(jobmgr_t jm, job_t j);
 
-#define ACTIVE_JOB_HASH_SIZE 32
-#define ACTIVE_JOB_HASH(x) (IS_POWER_OF_TWO(ACTIVE_JOB_HASH_SIZE) ? (x & (ACTIVE_JOB_HASH_SIZE - 1)) : (x % ACTIVE_JOB_HASH_SIZE))
-
-#define MACHSERVICE_HASH_SIZE	37
-
-#define LABEL_HASH_SIZE 53
 struct jobmgr_s {
 	kq_callback kqjobmgr_callback;
 	LIST_ENTRY(jobmgr_s) xpc_le;
@@ -392,17 +416,19 @@ struct jobmgr_s {
 	 * its own label hash that is separate from the "global" one stored in the
 	 * root job manager.
 	 */
-	LIST_HEAD(, job_s) label_hash[LABEL_HASH_SIZE];
-	LIST_HEAD(, job_s) active_jobs[ACTIVE_JOB_HASH_SIZE];
-	LIST_HEAD(, machservice) ms_hash[MACHSERVICE_HASH_SIZE];
+	struct hashtab label_hash;
+	struct hashtab active_jobs;
+	struct hashtab ms_hash;
 	LIST_HEAD(, job_s) global_env_jobs;
 	mach_port_t jm_port;
+	struct hashtab_node jm_port_node;
 	mach_port_t req_port;
 	jobmgr_t parentmgr;
 	int reboot_flags;
 	time_t shutdown_time;
 	unsigned int global_on_demand_cnt;
 	unsigned int normal_active_cnt;
+	unsigned int starts_in_flight;
 	unsigned int 
 		shutting_down:1,
 		session_initialized:1, 
@@ -460,12 +486,19 @@ static job_t jobmgr_init_session(jobmgr_t jm, const char *session_type, bool sfl
 static job_t jobmgr_find_by_pid_deep(jobmgr_t jm, pid_t p, bool anon_okay);
 static job_t jobmgr_find_by_pid(jobmgr_t jm, pid_t p, bool create_anon);
 static job_t managed_job(pid_t p);
+static job_t job_find_by_pid(pid_t p, uint64_t uniqueid, bool anon_okay);
+static bool jobmgr_is_within(jobmgr_t jm, jobmgr_t ancestor);
 static jobmgr_t jobmgr_find_by_name(jobmgr_t jm, const char *where);
 static job_t job_mig_intran2(jobmgr_t jm, mach_port_t mport, pid_t upid);
 static job_t jobmgr_lookup_per_user_context_internal(job_t j, uid_t which_user, mach_port_t *mp);
 static void job_export_all2(jobmgr_t jm, launch_data_t where);
+static void job_publish_status(job_t j);
+static void jobmgr_publish_status_all(jobmgr_t jm);
+static void job_changed(job_t j);
+static void job_export_removed(const char *label, uint64_t gen, void *context);
 static void jobmgr_callback(void *obj, struct kevent *kev);
-static void jobmgr_setup_env_from_other_jobs(jobmgr_t jm);
+static bool jobmgr_exec_env_from_other_jobs(jobmgr_t jm, struct spawn_env *se);
+static uint64_t jobmgr_env_gen = 1;
 static void jobmgr_export_env_from_other_jobs(jobmgr_t jm, launch_data_t dict);
 static struct machservice *jobmgr_lookup_service(jobmgr_t jm, const char *name, bool check_parent, pid_t target_pid);
 static void jobmgr_logv(jobmgr_t jm, int pri, int err, const char *msg, va_list ap) __attribute__((format(printf, 4, 0)));
@@ -490,11 +523,12 @@ struct job_s {
 	LIST_ENTRY(job_s) subjob_sle;
 	LIST_ENTRY(job_s) needing_session_sle;
 	LIST_ENTRY(job_s) jetsam_sle;
-	LIST_ENTRY(job_s) pid_hash_sle;
-	LIST_ENTRY(job_s) global_pid_hash_sle;
-	LIST_ENTRY(job_s) label_hash_sle;
+	struct hashtab_node pid_hash_node;
+	struct hashtab_node global_pid_hash_node;
+	struct hashtab_node label_hash_node;
 	LIST_ENTRY(job_s) global_env_sle;
 	SLIST_ENTRY(job_s) curious_jobs_sle;
+	TAILQ_ENTRY(job_s) admission_sle;
 	LIST_HEAD(, suspended_peruser) suspended_perusers;
 	LIST_HEAD(, waiting_for_exit) exit_watchers;
 	LIST_HEAD(, job_s) subjobs;
@@ -503,6 +537,14 @@ struct job_s {
 	SLIST_HEAD(, calendarinterval) cal_intervals;
 	SLIST_HEAD(, envitem) global_env;
 	SLIST_HEAD(, envitem) env;
+	/* What the last start exec'd with; see job_exec_env(). */
+	struct spawn_env exec_env;
+	uint64_t exec_env_gen;
+	int exec_env_fd;
+	char *exec_env_login;
+	char *exec_env_home;
+	char *exec_env_shell;
+	const char **exec_argv;
 	SLIST_HEAD(, limititem) limits;
 	SLIST_HEAD(, machservice) machservices;
 	SLIST_HEAD(, semaphoreitem) semaphores;
@@ -513,6 +555,7 @@ struct job_s {
 	cpu_type_t *j_binpref;
 	size_t j_binpref_cnt;
 	mach_port_t j_port;
+	struct hashtab_node j_port_node;
 	mach_port_t exit_status_dest;
 	mach_port_t exit_status_port;
 	mach_port_t spawn_reply_port;
@@ -544,6 +587,11 @@ struct job_s {
 	pid_t p;
 	uint64_t uniqueid;
 	int last_exit_status;
+	// The job's slot in the shared status table, if it has one.
+	struct launch_jobstat_slot *jobstat;
+	// When the job last changed, for GetJobsSince; 0 until it is listed.
+	uint64_t generation;
+	TAILQ_ENTRY(job_s) generation_sle;
 	int stdin_fd;
 	int fork_fd;
 	int nice;
@@ -554,8 +602,12 @@ struct job_s {
 	int32_t main_thread_priority;
 	uint32_t timeout;
 	uint32_t exit_timeout;
+	uint32_t inetcompat_max_children;
+	uint32_t inetcompat_workers;
 	uint64_t sent_signal_time;
 	uint64_t start_time;
+	uint64_t admission_time;
+	int32_t start_priority;
 	uint32_t min_run_time;
 	bool unthrottle;
 	uint32_t start_interval;
@@ -598,6 +650,10 @@ struct job_s {
 		inetcompat:1,
 		// A twist on inetd compatibility
 		inetcompat_wait:1,
+		// launchproxy drains the accept queue on every wakeup
+		inetcompat_batch_accept:1,
+		// launchproxy does not log every connection
+		inetcompat_quiet:1,
 		/* An event fired and the job should start, but not necessarily right
 		 * away.
 		 */	
@@ -741,15 +797,38 @@ struct job_s {
 		system_app :1,
 		joins_gui_session :1,
 		low_priority_background_io :1,
-		legacy_timers :1;
+		legacy_timers :1,
+		// The job was imported by job_import_bulk() and not yet dispatched.
+		bulk_import :1,
+		// The job is waiting in an admission queue to be started.
+		admission_queued :1,
+		// The job was started and has not yet exec'd, checked in or exited.
+		start_in_flight :1,
+		// The start in flight lands at check-in rather than at exec.
+		start_awaits_checkin :1;
 
 	const char label[0];
 };
 
-static size_t hash_label(const char *label) __attribute__((pure));
-static size_t hash_ms(const char *msstr) __attribute__((pure));
+#define job_from_pid_node(hn) hashtab_entry(hn, struct job_s, pid_hash_node)
+#define job_from_global_pid_node(hn) hashtab_entry(hn, struct job_s, global_pid_hash_node)
+#define job_from_label_node(hn) hashtab_entry(hn, struct job_s, label_hash_node)
+#define job_from_port_node(hn) hashtab_entry(hn, struct job_s, j_port_node)
+#define jobmgr_from_port_node(hn) hashtab_entry(hn, struct jobmgr_s, jm_port_node)
+
+static uint32_t hash_label(const char *label) __attribute__((pure));
+static uint32_t hash_ms(const char *msstr) __attribute__((pure));
+static uint32_t hash_pid(pid_t p) __attribute__((const));
+static uint32_t hash_port(mach_port_t p) __attribute__((const));
 static SLIST_HEAD(, job_s) s_curious_jobs;
-static LIST_HEAD(, job_s) managed_actives[ACTIVE_JOB_HASH_SIZE];
+
+/* Every job with a live process, managed or anonymous, in any job manager,
+ * and every job and job manager bootstrap port. These let an inbound request
+ * be attributed to its sender without walking the job manager tree.
+ */
+static struct hashtab global_actives;
+static struct hashtab job_ports;
+static struct hashtab jobmgr_ports;
 
 #define job_assumes(j, e) os_assumes_ctx(job_log_bug, j, (e))
 #define job_assumes_zero(j, e) os_assumes_zero_ctx(job_log_bug, j, (e))
@@ -760,6 +839,7 @@ static void job_import_bool(job_t j, const char *key, bool value);
 static void job_import_string(job_t j, const char *key, const char *value);
 static void job_import_integer(job_t j, const char *key, long long value);
 static void job_import_dictionary(job_t j, const char *key, launch_data_t value);
+static void job_import_inetcompat_count(job_t j, launch_data_t inetcompat, const char *key, uint32_t *count);
 static void job_import_array(job_t j, const char *key, launch_data_t value);
 static void job_import_opaque(job_t j, const char *key, launch_data_t value);
 static bool job_set_global_on_demand(job_t j, bool val);
@@ -771,8 +851,23 @@ static bool job_useless(job_t j);
 static bool job_keepalive(job_t j);
 static void job_dispatch_curious_jobs(job_t j);
 static void job_start(job_t j);
+static void job_admit(job_t j, bool kickstart);
+static void job_admission_enqueue(job_t j);
+static void job_admission_dequeue(job_t j);
+static void job_admission_account(uint64_t delay);
+static void job_start_in_flight(job_t j, bool awaits_checkin);
+static void job_start_landed(job_t j);
+static bool jobmgr_admission_room(jobmgr_t jm);
+static void jobmgr_admission_kick(void);
+static void jobmgr_admission_drain(void);
 static void job_start_child(job_t j) __attribute__((noreturn));
 static void job_setup_attributes(job_t j);
+static bool job_spawn_setup(job_t j, struct job_spawn *js, int trusted_fd);
+static char **job_exec_env(job_t j, const struct passwd *pwe, int trusted_fd);
+static void job_exec_env_reset(job_t j);
+static const char **job_exec_argv(job_t j);
+static void job_spawn_teardown(struct job_spawn *js);
+static void job_spawn_log(job_t j, const struct spawn_result *sr);
 static bool job_setup_machport(job_t j);
 static kern_return_t job_setup_exit_port(job_t j);
 static void job_setup_fd(job_t j, int target_fd, const char *path, int flags);
@@ -782,6 +877,7 @@ static void job_log_pids_with_weird_uids(job_t j);
 static void job_setup_exception_port(job_t j, task_t target_task);
 static void job_callback(void *obj, struct kevent *kev);
 static void job_callback_proc(job_t j, struct kevent *kev);
+static void job_did_exec(job_t j);
 static void job_callback_timer(job_t j, void *ident);
 static void job_callback_read(job_t j, int ident);
 static void job_log_stray_pg(job_t j);
@@ -832,32 +928,9 @@ static struct priority_properties_t {
 	{ XPC_JETSAM_BAND_TELEPHONY, JETSAM_PRIORITY_TELEPHONY },
 };
 
-static const struct {
-	const char *key;
-	int val;
-} launchd_keys2limits[] = {
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_CORE, RLIMIT_CORE },
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_CPU, RLIMIT_CPU },
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_DATA, RLIMIT_DATA },
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_FSIZE, RLIMIT_FSIZE },
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_MEMLOCK, RLIMIT_MEMLOCK },
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_NOFILE, RLIMIT_NOFILE },
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_NPROC, RLIMIT_NPROC },
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_RSS, RLIMIT_RSS },
-	{ LAUNCH_JOBKEY_RESOURCELIMIT_STACK, RLIMIT_STACK },
-};
-
-static time_t cronemu(int mon, int mday, int hour, int min);
-static time_t cronemu_wday(int wday, int hour, int min);
-static bool cronemu_mon(struct tm *wtm, int mon, int mday, int hour, int min);
-static bool cronemu_mday(struct tm *wtm, int mday, int hour, int min);
-static bool cronemu_hour(struct tm *wtm, int hour, int min);
-static bool cronemu_min(struct tm *wtm, int min);
-
 // miscellaneous file local functions
 static size_t get_kern_max_proc(void);
 static char **mach_cmd2argv(const char *string);
-static size_t our_strhash(const char *s) __attribute__((pure));
 
 void eliminate_double_reboot(void);
 
@@ -883,6 +956,27 @@ static int xpc_process_set_jetsam_memory_limit(job_t j, xpc_object_t request, xp
 static job_t _launchd_embedded_god = NULL;
 static job_t _launchd_embedded_home = NULL;
 static size_t total_children;
+static TAILQ_HEAD(, job_s) s_admission_queues[LAUNCHD_START_PRIORITIES];
+// Every job but aliases, least recently changed first.
+static TAILQ_HEAD(jobs_by_generation, job_s) s_jobs_by_generation;
+static struct jobgen s_jobgen;
+static struct {
+	unsigned int limit;
+	unsigned int permgr_limit;
+	unsigned int in_flight;
+	unsigned int queued;
+	uint64_t admitted;
+	uint64_t delayed;
+	uint64_t demanded;
+	uint64_t timed_out;
+	uint64_t delay_total;
+	uint64_t delay_max;
+	uint64_t delay_hist[LAUNCHD_ADMISSION_DELAY_BUCKETS];
+	bool drain_pending;
+} s_admission = {
+	.limit = LAUNCHD_ADMISSION_LIMIT,
+	.permgr_limit = LAUNCHD_ADMISSION_PERMGR_LIMIT,
+};
 static size_t total_anon_children;
 static mach_port_t the_exception_server;
 static job_t workaround_5477111;
@@ -1107,6 +1201,18 @@ job_export(job_t j)
 		if ((tmp2 = launch_data_new_bool(j->inetcompat_wait))) {
 			launch_data_dict_insert(tmp, tmp2, LAUNCH_JOBINETDCOMPATIBILITY_WAIT);
 		}
+		if (j->inetcompat_batch_accept && (tmp2 = launch_data_new_bool(true))) {
+			launch_data_dict_insert(tmp, tmp2, LAUNCH_JOBINETDCOMPATIBILITY_BATCHACCEPT);
+		}
+		if (j->inetcompat_quiet && (tmp2 = launch_data_new_bool(false))) {
+			launch_data_dict_insert(tmp, tmp2, LAUNCH_JOBINETDCOMPATIBILITY_LOGCONNECTIONS);
+		}
+		if (j->inetcompat_max_children && (tmp2 = launch_data_new_integer(j->inetcompat_max_children))) {
+			launch_data_dict_insert(tmp, tmp2, LAUNCH_JOBINETDCOMPATIBILITY_MAXCHILDREN);
+		}
+		if (j->inetcompat_workers && (tmp2 = launch_data_new_integer(j->inetcompat_workers))) {
+			launch_data_dict_insert(tmp, tmp2, LAUNCH_JOBINETDCOMPATIBILITY_WORKERS);
+		}
 		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_INETDCOMPATIBILITY);
 	}
 
@@ -1294,6 +1400,9 @@ jobmgr_remove(jobmgr_t jm)
 	if (jm->jm_port) {
 		(void)jobmgr_assumes_zero(jm, launchd_mport_close_recv(jm->jm_port));
 	}
+	if (hashtab_node_linked(&jm->jm_port_node)) {
+		hashtab_remove(&jm->jm_port_node);
+	}
 
 	if (jm->req_bsport) {
 		(void)jobmgr_assumes_zero(jm, launchd_mport_deallocate(jm->req_bsport));
@@ -1357,6 +1466,9 @@ jobmgr_remove(jobmgr_t jm)
 		exit(EXIT_SUCCESS);
 	}
 
+	hashtab_destroy(&jm->label_hash);
+	hashtab_destroy(&jm->active_jobs);
+	hashtab_destroy(&jm->ms_hash);
 	free(jm);
 }
 
@@ -1381,7 +1493,7 @@ job_remove(job_t j)
 		}
 
 		LIST_REMOVE(j, sle);
-		LIST_REMOVE(j, label_hash_sle);
+		hashtab_remove(&j->label_hash_node);
 		free(j);
 		return;
 	}
@@ -1434,6 +1546,10 @@ job_remove(job_t j)
 		job_dispatch_curious_jobs(j);
 	}
 
+	if (j->admission_queued) {
+		job_admission_dequeue(j);
+	}
+
 	ipc_close_all_with_job(j);
 
 	if (j->forced_peers_to_demand_mode) {
@@ -1451,6 +1567,9 @@ job_remove(job_t j)
 	if (j->j_port) {
 		(void)job_assumes_zero(j, launchd_mport_close_recv(j->j_port));
 	}
+	if (hashtab_node_linked(&j->j_port_node)) {
+		hashtab_remove(&j->j_port_node);
+	}
 
 	while ((sg = SLIST_FIRST(&j->sockets))) {
 		socketgroup_delete(j, sg);
@@ -1495,6 +1614,8 @@ job_remove(job_t j)
 	if (j->argv) {
 		free(j->argv);
 	}
+	job_exec_env_reset(j);
+	free(j->exec_argv);
 	if (j->rootdir) {
 		free(j->rootdir);
 	}
@@ -1567,7 +1688,7 @@ job_remove(job_t j)
 	(void)kevent_mod((uintptr_t)j, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
 
 	LIST_REMOVE(j, sle);
-	LIST_REMOVE(j, label_hash_sle);
+	hashtab_remove(&j->label_hash_node);
 
 	job_t ji = NULL;
 	job_t jit = NULL;
@@ -1577,6 +1698,11 @@ job_remove(job_t j)
 
 	job_log(j, LOG_DEBUG, "Removed");
 
+	if (j->generation != 0) {
+		TAILQ_REMOVE(&s_jobs_by_generation, j, generation_sle);
+		(void)jobgen_bury(&s_jobgen, j->label);
+	}
+	jobstat_free(j->jobstat);
 	j->kqjob_callback = (kq_callback)0x8badf00d;
 	free(j);
 }
@@ -1648,6 +1774,8 @@ job_setup_machport(job_t j)
 		goto out_bad;
 	}
 
+	hashtab_insert(&job_ports, &j->j_port_node, hash_port(j->j_port));
+
 	return true;
 out_bad2:
 	(void)job_assumes_zero(j, launchd_mport_close_recv(j->j_port));
@@ -1803,9 +1931,16 @@ job_new_anonymous(jobmgr_t jm, pid_t anonpid)
 		total_anon_children++;
 		jr->anonymous = true;
 		jr->p = anonpid;
+		job_changed(jr);
+
+		struct proc_uniqidentifierinfo info;
+		if (proc_pidinfo(anonpid, PROC_PIDUNIQIDENTIFIERINFO, 0, &info, PROC_PIDUNIQIDENTIFIERINFO_SIZE) != 0) {
+			jr->uniqueid = info.p_uniqueid;
+		}
 
 		// Anonymous process reaping is messy.
-		LIST_INSERT_HEAD(&jm->active_jobs[ACTIVE_JOB_HASH(jr->p)], jr, pid_hash_sle);
+		hashtab_insert(&jm->active_jobs, &jr->pid_hash_node, hash_pid(jr->p));
+		hashtab_insert(&global_actives, &jr->global_pid_hash_node, hash_pid(jr->p));
 
 		if (unlikely(kevent_mod(jr->p, EVFILT_PROC, EV_ADD, proc_fflags, 0, root_jobmgr) == -1)) {
 			if (errno != ESRCH) {
@@ -2033,12 +2168,14 @@ job_new_subjob(job_t j, uuid_t identifier)
 		}
 
 		LIST_INSERT_HEAD(&nj->mgr->jobs, nj, sle);
+		nj->jobstat = jobstat_alloc(nj->label);
+		job_changed(nj);
 
 		jobmgr_t where2put = root_jobmgr;
 		if (j->mgr->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN) {
 			where2put = j->mgr;
 		}
-		LIST_INSERT_HEAD(&where2put->label_hash[hash_label(nj->label)], nj, label_hash_sle);
+		hashtab_insert(&where2put->label_hash, &nj->label_hash_node, hash_label(nj->label));
 		LIST_INSERT_HEAD(&j->subjobs, nj, subjob_sle);
 	} else {
 		(void)os_assumes_zero(errno);
@@ -2187,12 +2324,14 @@ job_new(jobmgr_t jm, const char *label, const char *prog, const char *const *arg
 	}
 
 	LIST_INSERT_HEAD(&jm->jobs, j, sle);
+	j->jobstat = jobstat_alloc(j->label);
+	job_changed(j);
 
 	jobmgr_t where2put_label = root_jobmgr;
 	if (j->mgr->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN) {
 		where2put_label = j->mgr;
 	}
-	LIST_INSERT_HEAD(&where2put_label->label_hash[hash_label(j->label)], j, label_hash_sle);
+	hashtab_insert(&where2put_label->label_hash, &j->label_hash_node, hash_label(j->label));
 	uuid_clear(j->expected_audit_uuid);
 
 	job_log(j, LOG_DEBUG, "Conceived");
@@ -2224,7 +2363,7 @@ job_new_alias(jobmgr_t jm, job_t src)
 
 	(void)strcpy((char *)j->label, src->label);
 	LIST_INSERT_HEAD(&jm->jobs, j, sle);
-	LIST_INSERT_HEAD(&jm->label_hash[hash_label(j->label)], j, label_hash_sle);
+	hashtab_insert(&jm->label_hash, &j->label_hash_node, hash_label(j->label));
 	/* Bad jump address. The kqueue callback for aliases should never be
 	 * invoked.
 	 */
@@ -2352,25 +2491,93 @@ job_apply_defaults(job_t j) {
 
 #endif
 
+/* The bulk equivalent of calling job_dispatch_curious_jobs() for each job in
+ * the batch: every job watching any of them is dispatched once, rather than
+ * once per job it watches. Jobs in the batch are left to the caller.
+ */
+static void
+job_dispatch_curious_jobs_bulk(void)
+{
+	job_t ji = NULL, jt = NULL, jw;
+	SLIST_FOREACH_SAFE(ji, &s_curious_jobs, curious_jobs_sle, jt) {
+		if (ji->bulk_import) {
+			continue;
+		}
+
+		struct semaphoreitem *si = NULL;
+		SLIST_FOREACH(si, &ji->semaphores, sle) {
+			if (!(si->why == OTHER_JOB_ENABLED || si->why == OTHER_JOB_DISABLED)) {
+				continue;
+			}
+
+			if ((jw = job_find(root_jobmgr, si->what)) && jw->bulk_import) {
+				job_log(ji, LOG_DEBUG, "Dispatching out of interest in \"%s\".", jw->label);
+
+				if (!ji->removing) {
+					job_dispatch(ji, false);
+				} else {
+					job_log(ji, LOG_NOTICE, "The following job is circularly dependent upon this one: %s", jw->label);
+				}
+
+				// As in job_dispatch_curious_jobs(), ji may be gone now.
+				break;
+			}
+		}
+	}
+}
+
 launch_data_t
-job_import_bulk(launch_data_t pload)
+job_import_bulk(launch_data_t pload, bool atomic)
 {
 	launch_data_t resp = launch_data_alloc(LAUNCH_DATA_ARRAY);
 	job_t *ja;
+	int *ea;
 	size_t i, c = launch_data_array_get_count(pload);
+	bool failed = false;
 
 	ja = alloca(c * sizeof(job_t));
+	ea = alloca(c * sizeof(int));
 
+	/* Import the whole batch before dispatching any of it, so that nothing is
+	 * spawned while the rest is still being parsed, and jobs watching the
+	 * batch through OtherJobEnabled are looked at once rather than per job.
+	 */
 	for (i = 0; i < c; i++) {
-		if ((likely(ja[i] = jobmgr_import2(root_jobmgr, launch_data_array_get_index(pload, i)))) && errno != ENEEDAUTH) {
-			errno = 0;
+		errno = 0;
+		if (likely(ja[i] = jobmgr_import2(root_jobmgr, launch_data_array_get_index(pload, i)))) {
+			ea[i] = (errno == ENEEDAUTH) ? ENEEDAUTH : 0;
+			// An existing XPC singleton is handed back with EEXIST; it is not ours.
+			ja[i]->bulk_import = (errno != EEXIST);
+		} else {
+			ea[i] = errno;
+			failed = true;
+		}
+	}
+
+	if (atomic && failed) {
+		for (i = 0; i < c; i++) {
+			if (ja[i] && ja[i]->bulk_import) {
+				job_log(ja[i], LOG_DEBUG, "Another job in an atomic submission failed to import. Removing.");
+				job_remove(ja[i]);
+				ea[i] = ECANCELED;
+			}
+			ja[i] = NULL;
 		}
-		launch_data_array_set_index(resp, launch_data_new_errno(errno), i);
 	}
 
+	for (i = 0; i < c; i++) {
+		launch_data_array_set_index(resp, launch_data_new_errno(ea[i]), i);
+	}
+
+	job_dispatch_curious_jobs_bulk();
+
+	for (i = 0; i < c; i++) {
+		if (likely(ja[i])) {
+			ja[i]->bulk_import = false;
+		}
+	}
 	for (i = 0; i < c; i++) {
 		if (likely(ja[i])) {
-			job_dispatch_curious_jobs(ja[i]);
 			job_dispatch(ja[i], false);
 		}
 	}
@@ -2381,212 +2588,154 @@ job_import_bulk(launch_data_t pload)
 void
 job_import_bool(job_t j, const char *key, bool value)
 {
-	bool found_key = false;
-
-	switch (key[0]) {
-	case 'a':
-	case 'A':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ABANDONPROCESSGROUP) == 0) {
-			j->abandon_pg = value;
-			found_key = true;
-		}
-		break;
-	case 'b':
-	case 'B':
-		if (strcasecmp(key, LAUNCH_JOBKEY_BEGINTRANSACTIONATSHUTDOWN) == 0) {
-			j->dirty_at_shutdown = value;
-			found_key = true;
-		}
-		break;
-	case 'j':
-	case 'J':
-		if (strcasecmp(key, LAUNCH_JOBKEY_JOINGUISESSION) == 0) {
-			j->joins_gui_session = value;
-			found_key = true;
-		}
-		break;
-	case 'k':
-	case 'K':
-		if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE) == 0) {
-			j->ondemand = !value;
-			found_key = true;
-		}
-		break;
-	case 'o':
-	case 'O':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ONDEMAND) == 0) {
-			j->ondemand = value;
-			found_key = true;
-		}
-		break;
-	case 'd':
-	case 'D':
-		if (strcasecmp(key, LAUNCH_JOBKEY_DEBUG) == 0) {
-			j->debug = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_DISABLED) == 0) {
-			(void)job_assumes(j, !value);
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_DISABLEASLR) == 0) {
-			j->disable_aslr = value;
-			found_key = true;
-		}
-		break;
-	case 'h':
-	case 'H':
-		if (strcasecmp(key, LAUNCH_JOBKEY_HOPEFULLYEXITSLAST) == 0) {
-			job_log(j, LOG_PERF, "%s has been deprecated. Please use the new %s key instead and add EnableTransactions to your launchd.plist.", LAUNCH_JOBKEY_HOPEFULLYEXITSLAST, LAUNCH_JOBKEY_BEGINTRANSACTIONATSHUTDOWN);
-			j->dirty_at_shutdown = value;
-			found_key = true;
-		}
-		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_SESSIONCREATE) == 0) {
-			j->session_create = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_STARTONMOUNT) == 0) {
-			j->start_on_mount = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SERVICEIPC) == 0) {
-			// this only does something on Mac OS X 10.4 "Tiger"
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SHUTDOWNMONITOR) == 0) {
-			if (_launchd_shutdown_monitor) {
-				job_log(j, LOG_ERR, "Only one job may monitor shutdown.");
-			} else {
-				j->shutdown_monitor = true;
-				_launchd_shutdown_monitor = j;
-			}
-			found_key = true;
-		}
-		break;
-	case 'l':
-	case 'L':
-		if (strcasecmp(key, LAUNCH_JOBKEY_LOWPRIORITYIO) == 0) {
-			j->low_pri_io = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LAUNCHONLYONCE) == 0) {
-			j->only_once = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LOWPRIORITYBACKGROUNDIO) == 0) {
-			j->low_priority_background_io = true;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LEGACYTIMERS) == 0) {
+	bool found_key = true;
+
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_ABANDONPROCESSGROUP:
+		j->abandon_pg = value;
+		break;
+	case JOBKEY_BEGINTRANSACTIONATSHUTDOWN:
+		j->dirty_at_shutdown = value;
+		break;
+	case JOBKEY_JOINGUISESSION:
+		j->joins_gui_session = value;
+		break;
+	case JOBKEY_KEEPALIVE:
+		j->ondemand = !value;
+		break;
+	case JOBKEY_ONDEMAND:
+		j->ondemand = value;
+		break;
+	case JOBKEY_DEBUG:
+		j->debug = value;
+		break;
+	case JOBKEY_DISABLED:
+		(void)job_assumes(j, !value);
+		break;
+	case JOBKEY_DISABLEASLR:
+		j->disable_aslr = value;
+		break;
+	case JOBKEY_HOPEFULLYEXITSLAST:
+		job_log(j, LOG_PERF, "%s has been deprecated. Please use the new %s key instead and add EnableTransactions to your launchd.plist.", LAUNCH_JOBKEY_HOPEFULLYEXITSLAST, LAUNCH_JOBKEY_BEGINTRANSACTIONATSHUTDOWN);
+		j->dirty_at_shutdown = value;
+		break;
+	case JOBKEY_SESSIONCREATE:
+		j->session_create = value;
+		break;
+	case JOBKEY_STARTONMOUNT:
+		j->start_on_mount = value;
+		break;
+	case JOBKEY_SERVICEIPC:
+		// this only does something on Mac OS X 10.4 "Tiger"
+		break;
+	case JOBKEY_SHUTDOWNMONITOR:
+		if (_launchd_shutdown_monitor) {
+			job_log(j, LOG_ERR, "Only one job may monitor shutdown.");
+		} else {
+			j->shutdown_monitor = true;
+			_launchd_shutdown_monitor = j;
+		}
+		break;
+	case JOBKEY_LOWPRIORITYIO:
+		j->low_pri_io = value;
+		break;
+	case JOBKEY_LAUNCHONLYONCE:
+		j->only_once = value;
+		break;
+	case JOBKEY_LOWPRIORITYBACKGROUNDIO:
+		j->low_priority_background_io = true;
+		break;
+	case JOBKEY_LEGACYTIMERS:
 #if !TARGET_OS_EMBEDDED
-			j->legacy_timers = value;
+		j->legacy_timers = value;
 #else // !TARGET_OS_EMBEDDED
-			job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
+		job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
 #endif // !TARGET_OS_EMBEDDED
-			found_key = true;
-		}
 		break;
-	case 'm':
-	case 'M':
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACHEXCEPTIONHANDLER) == 0) {
-			j->internal_exc_handler = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_MULTIPLEINSTANCES) == 0) {
-			j->multiple_instances = value;
-			found_key = true;
+	case JOBKEY_MACHEXCEPTIONHANDLER:
+		j->internal_exc_handler = value;
+		break;
+	case JOBKEY_MULTIPLEINSTANCES:
+		j->multiple_instances = value;
+		break;
+	case JOBKEY_INITGROUPS:
+		if (getuid() != 0) {
+			job_log(j, LOG_WARNING, "Ignored this key: %s", key);
+			return;
 		}
+		j->no_init_groups = !value;
 		break;
-	case 'i':
-	case 'I':
-		if (strcasecmp(key, LAUNCH_JOBKEY_INITGROUPS) == 0) {
-			if (getuid() != 0) {
-				job_log(j, LOG_WARNING, "Ignored this key: %s", key);
-				return;
-			}
-			j->no_init_groups = !value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_IGNOREPROCESSGROUPATSHUTDOWN) == 0) {
-			j->ignore_pg_at_shutdown = value;
-			found_key = true;
+	case JOBKEY_IGNOREPROCESSGROUPATSHUTDOWN:
+		j->ignore_pg_at_shutdown = value;
+		break;
+	case JOBKEY_RUNATLOAD:
+		if (value) {
+			// We don't want value == false to change j->start_pending
+			j->start_pending = true;
 		}
 		break;
-	case 'r':
-	case 'R':
-		if (strcasecmp(key, LAUNCH_JOBKEY_RUNATLOAD) == 0) {
-			if (value) {
-				// We don't want value == false to change j->start_pending
-				j->start_pending = true;
-			}
-			found_key = true;
-		}
-		break;
-	case 'e':
-	case 'E':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ENABLEGLOBBING) == 0) {
-			j->globargv = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_ENABLETRANSACTIONS) == 0) {
-			j->enable_transactions = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_ENTERKERNELDEBUGGERBEFOREKILL) == 0) {
-			j->debug_before_kill = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_EMBEDDEDPRIVILEGEDISPENSATION) == 0) {
+	case JOBKEY_ENABLEGLOBBING:
+		j->globargv = value;
+		break;
+	case JOBKEY_ENABLETRANSACTIONS:
+		j->enable_transactions = value;
+		break;
+	case JOBKEY_ENTERKERNELDEBUGGERBEFOREKILL:
+		j->debug_before_kill = value;
+		break;
+	case JOBKEY_EMBEDDEDPRIVILEGEDISPENSATION:
 #if TARGET_OS_EMBEDDED
-			if (!_launchd_embedded_god) {
-				if ((j->embedded_god = value)) {
-					_launchd_embedded_god = j;
-				}
-			} else {
-				job_log(j, LOG_ERR, "Job tried to claim %s after it has already been claimed.", key);
+		if (!_launchd_embedded_god) {
+			if ((j->embedded_god = value)) {
+				_launchd_embedded_god = j;
 			}
+		} else {
+			job_log(j, LOG_ERR, "Job tried to claim %s after it has already been claimed.", key);
+		}
 #else
-			job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
+		job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
 #endif
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_EMBEDDEDHOMESCREEN) == 0) {
+		break;
+	case JOBKEY_EMBEDDEDHOMESCREEN:
 #if TARGET_OS_EMBEDDED
-			if (!_launchd_embedded_home) {
-				if ((j->embedded_home = value)) {
-					_launchd_embedded_home = j;
-				}
-			} else {
-				job_log(j, LOG_ERR, "Job tried to claim %s after it has already been claimed.", key);
+		if (!_launchd_embedded_home) {
+			if ((j->embedded_home = value)) {
+				_launchd_embedded_home = j;
 			}
+		} else {
+			job_log(j, LOG_ERR, "Job tried to claim %s after it has already been claimed.", key);
+		}
 #else
-			job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
+		job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
 #endif
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_EVENTMONITOR) == 0) {
-			if (!_launchd_event_monitor) {
-				j->event_monitor = value;
-				if (value) {
-					_launchd_event_monitor = j;
-				}
-			} else {
-				job_log(j, LOG_NOTICE, "Job tried to steal event monitoring responsibility from: %s", _launchd_event_monitor->label);
+		break;
+	case JOBKEY_EVENTMONITOR:
+		if (!_launchd_event_monitor) {
+			j->event_monitor = value;
+			if (value) {
+				_launchd_event_monitor = j;
 			}
-			found_key = true;
+		} else {
+			job_log(j, LOG_NOTICE, "Job tried to steal event monitoring responsibility from: %s", _launchd_event_monitor->label);
 		}
 		break;
-	case 'w':
-	case 'W':
-		if (strcasecmp(key, LAUNCH_JOBKEY_WAITFORDEBUGGER) == 0) {
-			j->wait4debugger = value;
-			found_key = true;
-		}
+	case JOBKEY_WAITFORDEBUGGER:
+		j->wait4debugger = value;
 		break;
-	case 'x':
-	case 'X':
-		if (strcasecmp(key, LAUNCH_JOBKEY_XPCDOMAINBOOTSTRAPPER) == 0) {
-			if (pid1_magic) {
-				if (_launchd_xpc_bootstrapper) {
-					job_log(j, LOG_ERR, "This job tried to steal the XPC domain bootstrapper property from the following job: %s", _launchd_xpc_bootstrapper->label);
-				} else {
-					_launchd_xpc_bootstrapper = j;
-					j->xpc_bootstrapper = value;
-				}
+	case JOBKEY_XPCDOMAINBOOTSTRAPPER:
+		if (pid1_magic) {
+			if (_launchd_xpc_bootstrapper) {
+				job_log(j, LOG_ERR, "This job tried to steal the XPC domain bootstrapper property from the following job: %s", _launchd_xpc_bootstrapper->label);
 			} else {
-				job_log(j, LOG_ERR, "Non-daemon tried to claim XPC bootstrapper property.");
+				_launchd_xpc_bootstrapper = j;
+				j->xpc_bootstrapper = value;
 			}
+		} else {
+			job_log(j, LOG_ERR, "Non-daemon tried to claim XPC bootstrapper property.");
 		}
-		found_key = true;
 		break;
 	default:
+		found_key = false;
 		break;
 	}
 
@@ -2600,132 +2749,100 @@ job_import_string(job_t j, const char *key, const char *value)
 {
 	char **where2put = NULL;
 
-	switch (key[0]) {
-	case 'c':
-	case 'C':
-		if (strcasecmp(key, LAUNCH_JOBKEY_CFBUNDLEIDENTIFIER) == 0) {
-			where2put = &j->cfbundleidentifier;
-		}
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_CFBUNDLEIDENTIFIER:
+		where2put = &j->cfbundleidentifier;
 		break;
-	case 'm':
-	case 'M':
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACHEXCEPTIONHANDLER) == 0) {
-			where2put = &j->alt_exc_handler;
-		}
+	case JOBKEY_MACHEXCEPTIONHANDLER:
+		where2put = &j->alt_exc_handler;
 		break;
-	case 'p':
-	case 'P':
-		if (strcasecmp(key, LAUNCH_JOBKEY_PROGRAM) == 0) {
-			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_POSIXSPAWNTYPE) == 0
-				|| strcasecmp(key, LAUNCH_JOBKEY_PROCESSTYPE) == 0) {
-			if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_INTERACTIVE) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_INTERACTIVE;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_ADAPTIVE) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_ADAPTIVE;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_STANDARD) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_STANDARD;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_BACKGROUND) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_BACKGROUND;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_TALAPP) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_TAL;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_SYSTEMAPP) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_DEFAULT;
-				j->system_app = true;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_APP) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_DEFAULT;
-				j->app = true;
-			} else {
-				job_log(j, LOG_ERR, "Unknown value for key %s: %s", key, value);
-			}
+	case JOBKEY_PROGRAM:
+		return;
+	case JOBKEY_POSIXSPAWNTYPE:
+	case JOBKEY_PROCESSTYPE:
+		if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_INTERACTIVE) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_INTERACTIVE;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_ADAPTIVE) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_ADAPTIVE;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_STANDARD) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_STANDARD;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_BACKGROUND) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_BACKGROUND;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_TALAPP) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_TAL;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_SYSTEMAPP) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_DEFAULT;
+			j->system_app = true;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_APP) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_DEFAULT;
+			j->app = true;
+		} else {
+			job_log(j, LOG_ERR, "Unknown value for key %s: %s", key, value);
+		}
+		return;
+	case JOBKEY_LABEL:
+	case JOBKEY_LIMITLOADTOHOSTS:
+	case JOBKEY_LIMITLOADFROMHOSTS:
+	case JOBKEY_LIMITLOADTOSESSIONTYPE:
+		return;
+	case JOBKEY_ROOTDIRECTORY:
+		if (getuid() != 0) {
+			job_log(j, LOG_WARNING, "Ignored this key: %s", key);
 			return;
 		}
+		where2put = &j->rootdir;
+		break;
+	case JOBKEY_WORKINGDIRECTORY:
+		where2put = &j->workingdir;
 		break;
-	case 'l':
-	case 'L':
-		if (strcasecmp(key, LAUNCH_JOBKEY_LABEL) == 0) {
+	case JOBKEY_USERNAME:
+		if (getuid() != 0) {
+			job_log(j, LOG_WARNING, "Ignored this key: %s", key);
 			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOHOSTS) == 0) {
+		} else if (strcmp(value, "root") == 0) {
 			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADFROMHOSTS) == 0) {
+		}
+		where2put = &j->username;
+		break;
+	case JOBKEY_GROUPNAME:
+		if (getuid() != 0) {
+			job_log(j, LOG_WARNING, "Ignored this key: %s", key);
 			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE) == 0) {
+		} else if (strcmp(value, "wheel") == 0) {
 			return;
 		}
+		where2put = &j->groupname;
 		break;
-	case 'r':
-	case 'R':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ROOTDIRECTORY) == 0) {
-			if (getuid() != 0) {
-				job_log(j, LOG_WARNING, "Ignored this key: %s", key);
-				return;
-			}
-			where2put = &j->rootdir;
-		}
-		break;
-	case 'w':
-	case 'W':
-		if (strcasecmp(key, LAUNCH_JOBKEY_WORKINGDIRECTORY) == 0) {
-			where2put = &j->workingdir;
-		}
-		break;
-	case 'u':
-	case 'U':
-		if (strcasecmp(key, LAUNCH_JOBKEY_USERNAME) == 0) {
-			if (getuid() != 0) {
-				job_log(j, LOG_WARNING, "Ignored this key: %s", key);
-				return;
-			} else if (strcmp(value, "root") == 0) {
-				return;
-			}
-			where2put = &j->username;
-		}
-		break;
-	case 'g':
-	case 'G':
-		if (strcasecmp(key, LAUNCH_JOBKEY_GROUPNAME) == 0) {
-			if (getuid() != 0) {
-				job_log(j, LOG_WARNING, "Ignored this key: %s", key);
-				return;
-			} else if (strcmp(value, "wheel") == 0) {
-				return;
-			}
-			where2put = &j->groupname;
-		}
-		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_STANDARDOUTPATH) == 0) {
-			where2put = &j->stdoutpath;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_STANDARDERRORPATH) == 0) {
-			where2put = &j->stderrpath;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_STANDARDINPATH) == 0) {
-			where2put = &j->stdinpath;
-			j->stdin_fd = _fd(open(value, O_RDONLY|O_CREAT|O_NOCTTY|O_NONBLOCK, DEFFILEMODE));
-			if (job_assumes_zero_p(j, j->stdin_fd) != -1) {
-				// open() should not block, but regular IO by the job should
-				(void)job_assumes_zero_p(j, fcntl(j->stdin_fd, F_SETFL, 0));
-				// XXX -- EV_CLEAR should make named pipes happy?
-				(void)job_assumes_zero_p(j, kevent_mod(j->stdin_fd, EVFILT_READ, EV_ADD|EV_CLEAR, 0, 0, j));
-			} else {
-				j->stdin_fd = 0;
-			}
-#if HAVE_SANDBOX
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOXPROFILE) == 0) {
-			where2put = &j->seatbelt_profile;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOXCONTAINER) == 0) {
-			where2put = &j->container_identifier;
-#endif
-		}
+	case JOBKEY_STANDARDOUTPATH:
+		where2put = &j->stdoutpath;
 		break;
-	case 'X':
-	case 'x':
-		if (strcasecmp(key, LAUNCH_JOBKEY_XPCDOMAIN) == 0) {
-			return;
+	case JOBKEY_STANDARDERRORPATH:
+		where2put = &j->stderrpath;
+		break;
+	case JOBKEY_STANDARDINPATH:
+		where2put = &j->stdinpath;
+		j->stdin_fd = _fd(open(value, O_RDONLY|O_CREAT|O_NOCTTY|O_NONBLOCK, DEFFILEMODE));
+		if (job_assumes_zero_p(j, j->stdin_fd) != -1) {
+			// open() should not block, but regular IO by the job should
+			(void)job_assumes_zero_p(j, fcntl(j->stdin_fd, F_SETFL, 0));
+			// XXX -- EV_CLEAR should make named pipes happy?
+			(void)job_assumes_zero_p(j, kevent_mod(j->stdin_fd, EVFILT_READ, EV_ADD|EV_CLEAR, 0, 0, j));
+		} else {
+			j->stdin_fd = 0;
 		}
 		break;
+#if HAVE_SANDBOX
+	case JOBKEY_SANDBOXPROFILE:
+		where2put = &j->seatbelt_profile;
+		break;
+	case JOBKEY_SANDBOXCONTAINER:
+		where2put = &j->container_identifier;
+		break;
+#endif
+	case JOBKEY_XPCDOMAIN:
+		return;
 	default:
-		job_log(j, LOG_WARNING, "Unknown key for string: %s", key);
+		// Reported below.
 		break;
 	}
 
@@ -2747,103 +2864,96 @@ job_import_string(job_t j, const char *key, const char *value)
 void
 job_import_integer(job_t j, const char *key, long long value)
 {
-	switch (key[0]) {
-	case 'a':
-	case 'A':
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_ASID:
 #if TARGET_OS_EMBEDDED
-		if (strcasecmp(key, LAUNCH_JOBKEY_ASID) == 0) {
-			if (launchd_embedded_handofgod) {
-				if (audit_session_port((au_asid_t)value, &j->asport) == -1 && errno != ENOSYS) {
-					(void)job_assumes_zero(j, errno);
-				}
+		if (launchd_embedded_handofgod) {
+			if (audit_session_port((au_asid_t)value, &j->asport) == -1 && errno != ENOSYS) {
+				(void)job_assumes_zero(j, errno);
 			}
 		}
 #endif
-	case 'e':
-	case 'E':
-		if (strcasecmp(key, LAUNCH_JOBKEY_EXITTIMEOUT) == 0) {
-			if (unlikely(value < 0)) {
-				job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_EXITTIMEOUT);
-			} else if (unlikely(value > UINT32_MAX)) {
-				job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_EXITTIMEOUT);
-			} else {
-				j->exit_timeout = (typeof(j->exit_timeout)) value;
-			}
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_EMBEDDEDMAINTHREADPRIORITY) == 0) {
-			j->main_thread_priority = value;
+		break;
+	case JOBKEY_EXITTIMEOUT:
+		if (unlikely(value < 0)) {
+			job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_EXITTIMEOUT);
+		} else if (unlikely(value > UINT32_MAX)) {
+			job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_EXITTIMEOUT);
+		} else {
+			j->exit_timeout = (typeof(j->exit_timeout)) value;
 		}
 		break;
-	case 'j':
-	case 'J':
-		if (strcasecmp(key, LAUNCH_JOBKEY_JETSAMPRIORITY) == 0) {
-			job_log(j, LOG_WARNING | LOG_CONSOLE, "Please change the JetsamPriority key to be in a dictionary named JetsamProperties.");
+	case JOBKEY_EMBEDDEDMAINTHREADPRIORITY:
+		j->main_thread_priority = value;
+		break;
+	case JOBKEY_JETSAMPRIORITY: {
+		job_log(j, LOG_WARNING | LOG_CONSOLE, "Please change the JetsamPriority key to be in a dictionary named JetsamProperties.");
 
-			launch_data_t pri = launch_data_new_integer(value);
-			if (job_assumes(j, pri != NULL)) {
-				jetsam_property_setup(pri, LAUNCH_JOBKEY_JETSAMPRIORITY, j);
-				launch_data_free(pri);
-			}
+		launch_data_t pri = launch_data_new_integer(value);
+		if (job_assumes(j, pri != NULL)) {
+			jetsam_property_setup(pri, LAUNCH_JOBKEY_JETSAMPRIORITY, j);
+			launch_data_free(pri);
 		}
-	case 'n':
-	case 'N':
-		if (strcasecmp(key, LAUNCH_JOBKEY_NICE) == 0) {
-			if (unlikely(value < PRIO_MIN)) {
-				job_log(j, LOG_WARNING, "%s less than %d. Ignoring.", LAUNCH_JOBKEY_NICE, PRIO_MIN);
-			} else if (unlikely(value > PRIO_MAX)) {
-				job_log(j, LOG_WARNING, "%s is greater than %d. Ignoring.", LAUNCH_JOBKEY_NICE, PRIO_MAX);
-			} else {
-				j->nice = (typeof(j->nice)) value;
-				j->setnice = true;
-			}
+		break;
+	}
+	case JOBKEY_NICE:
+		if (unlikely(value < PRIO_MIN)) {
+			job_log(j, LOG_WARNING, "%s less than %d. Ignoring.", LAUNCH_JOBKEY_NICE, PRIO_MIN);
+		} else if (unlikely(value > PRIO_MAX)) {
+			job_log(j, LOG_WARNING, "%s is greater than %d. Ignoring.", LAUNCH_JOBKEY_NICE, PRIO_MAX);
+		} else {
+			j->nice = (typeof(j->nice)) value;
+			j->setnice = true;
 		}
 		break;
-	case 't':
-	case 'T':
-		if (strcasecmp(key, LAUNCH_JOBKEY_TIMEOUT) == 0) {
-			if (unlikely(value < 0)) {
-				job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_TIMEOUT);
-			} else if (unlikely(value > UINT32_MAX)) {
-				job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_TIMEOUT);
-			} else {
-				j->timeout = (typeof(j->timeout)) value;
-			}
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_THROTTLEINTERVAL) == 0) {
-			if (value < 0) {
-				job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_THROTTLEINTERVAL);
-			} else if (value > UINT32_MAX) {
-				job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_THROTTLEINTERVAL);
-			} else {
-				j->min_run_time = (typeof(j->min_run_time)) value;
-			}
+	case JOBKEY_STARTPRIORITY:
+		if (unlikely(value < LAUNCHD_START_PRIORITY_MIN)) {
+			job_log(j, LOG_WARNING, "%s less than %d. Ignoring.", LAUNCH_JOBKEY_STARTPRIORITY, LAUNCHD_START_PRIORITY_MIN);
+		} else if (unlikely(value > LAUNCHD_START_PRIORITY_MAX)) {
+			job_log(j, LOG_WARNING, "%s is greater than %d. Ignoring.", LAUNCH_JOBKEY_STARTPRIORITY, LAUNCHD_START_PRIORITY_MAX);
+		} else {
+			j->start_priority = (typeof(j->start_priority)) value;
 		}
 		break;
-	case 'u':
-	case 'U':
-		if (strcasecmp(key, LAUNCH_JOBKEY_UMASK) == 0) {
-			j->mask = value;
-			j->setmask = true;
+	case JOBKEY_TIMEOUT:
+		if (unlikely(value < 0)) {
+			job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_TIMEOUT);
+		} else if (unlikely(value > UINT32_MAX)) {
+			job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_TIMEOUT);
+		} else {
+			j->timeout = (typeof(j->timeout)) value;
 		}
 		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_STARTINTERVAL) == 0) {
-			if (unlikely(value <= 0)) {
-				job_log(j, LOG_WARNING, "%s is not greater than zero. Ignoring.", LAUNCH_JOBKEY_STARTINTERVAL);
-			} else if (unlikely(value > UINT32_MAX)) {
-				job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_STARTINTERVAL);
-			} else {
-				runtime_add_weak_ref();
-				j->start_interval = (typeof(j->start_interval)) value;
-
-				(void)job_assumes_zero_p(j, kevent_mod((uintptr_t)&j->start_interval, EVFILT_TIMER, EV_ADD, NOTE_SECONDS, j->start_interval, j));
-			}
-#if HAVE_SANDBOX
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOXFLAGS) == 0) {
-			j->seatbelt_flags = value;
-#endif
+	case JOBKEY_THROTTLEINTERVAL:
+		if (value < 0) {
+			job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_THROTTLEINTERVAL);
+		} else if (value > UINT32_MAX) {
+			job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_THROTTLEINTERVAL);
+		} else {
+			j->min_run_time = (typeof(j->min_run_time)) value;
 		}
+		break;
+	case JOBKEY_UMASK:
+		j->mask = value;
+		j->setmask = true;
+		break;
+	case JOBKEY_STARTINTERVAL:
+		if (unlikely(value <= 0)) {
+			job_log(j, LOG_WARNING, "%s is not greater than zero. Ignoring.", LAUNCH_JOBKEY_STARTINTERVAL);
+		} else if (unlikely(value > UINT32_MAX)) {
+			job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_STARTINTERVAL);
+		} else {
+			runtime_add_weak_ref();
+			j->start_interval = (typeof(j->start_interval)) value;
 
+			(void)job_assumes_zero_p(j, kevent_mod((uintptr_t)&j->start_interval, EVFILT_TIMER, EV_ADD, NOTE_SECONDS, j->start_interval, j));
+		}
 		break;
+#if HAVE_SANDBOX
+	case JOBKEY_SANDBOXFLAGS:
+		j->seatbelt_flags = value;
+		break;
+#endif
 	default:
 		job_log(j, LOG_WARNING, "Unknown key for integer: %s", key);
 		break;
@@ -2853,28 +2963,25 @@ job_import_integer(job_t j, const char *key, long long value)
 void
 job_import_opaque(job_t j __attribute__((unused)), const char *key, launch_data_t value __attribute__((unused)))
 {
-	switch (key[0]) {
-	case 'q':
-	case 'Q':
+	switch (jobkey_lookup(key)) {
 #if HAVE_QUARANTINE
-		if (strcasecmp(key, LAUNCH_JOBKEY_QUARANTINEDATA) == 0) {
-			size_t tmpsz = launch_data_get_opaque_size(value);
+	case JOBKEY_QUARANTINEDATA: {
+		size_t tmpsz = launch_data_get_opaque_size(value);
 
-			if (job_assumes(j, j->quarantine_data = malloc(tmpsz))) {
-				memcpy(j->quarantine_data, launch_data_get_opaque(value), tmpsz);
-				j->quarantine_data_sz = tmpsz;
-			}
+		if (job_assumes(j, j->quarantine_data = malloc(tmpsz))) {
+			memcpy(j->quarantine_data, launch_data_get_opaque(value), tmpsz);
+			j->quarantine_data_sz = tmpsz;
 		}
+		break;
+	}
 #endif
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_SECURITYSESSIONUUID) == 0) {
-			size_t tmpsz = launch_data_get_opaque_size(value);
-			if (job_assumes(j, tmpsz == sizeof(uuid_t))) {
-				memcpy(j->expected_audit_uuid, launch_data_get_opaque(value), sizeof(uuid_t));
-			}
+	case JOBKEY_SECURITYSESSIONUUID: {
+		size_t tmpsz = launch_data_get_opaque_size(value);
+		if (job_assumes(j, tmpsz == sizeof(uuid_t))) {
+			memcpy(j->expected_audit_uuid, launch_data_get_opaque(value), sizeof(uuid_t));
 		}
 		break;
+	}
 	default:
 		break;
 	}
@@ -2884,22 +2991,31 @@ static void
 policy_setup(launch_data_t obj, const char *key, void *context)
 {
 	job_t j = context;
-	bool found_key = false;
 
-	switch (key[0]) {
-	case 'd':
-	case 'D':
-		if (strcasecmp(key, LAUNCH_JOBPOLICY_DENYCREATINGOTHERJOBS) == 0) {
-			j->deny_job_creation = launch_data_get_bool(obj);
-			found_key = true;
-		}
+	switch (jobpolicy_lookup(key)) {
+	case JOBPOLICY_DENYCREATINGOTHERJOBS:
+		j->deny_job_creation = launch_data_get_bool(obj);
 		break;
 	default:
+		job_log(j, LOG_WARNING, "Unknown policy: %s", key);
 		break;
 	}
+}
 
-	if (unlikely(!found_key)) {
-		job_log(j, LOG_WARNING, "Unknown policy: %s", key);
+void
+job_import_inetcompat_count(job_t j, launch_data_t inetcompat, const char *key, uint32_t *count)
+{
+	launch_data_t tmp = launch_data_dict_lookup(inetcompat, key);
+
+	if (tmp == NULL) {
+		return;
+	}
+	if (launch_data_get_type(tmp) != LAUNCH_DATA_INTEGER) {
+		job_log(j, LOG_WARNING, "%s:%s is not an integer. Ignoring.", LAUNCH_JOBKEY_INETDCOMPATIBILITY, key);
+	} else if (launch_data_get_integer(tmp) < 0 || launch_data_get_integer(tmp) > UINT16_MAX) {
+		job_log(j, LOG_WARNING, "%s:%s is out of range. Ignoring.", LAUNCH_JOBKEY_INETDCOMPATIBILITY, key);
+	} else {
+		*count = (uint32_t)launch_data_get_integer(tmp);
 	}
 }
 
@@ -2908,89 +3024,67 @@ job_import_dictionary(job_t j, const char *key, launch_data_t value)
 {
 	launch_data_t tmp;
 
-	switch (key[0]) {
-	case 'p':
-	case 'P':
-		if (strcasecmp(key, LAUNCH_JOBKEY_POLICIES) == 0) {
-			launch_data_dict_iterate(value, policy_setup, j);
-		}
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_POLICIES:
+		launch_data_dict_iterate(value, policy_setup, j);
 		break;
-	case 'k':
-	case 'K':
-		if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE) == 0) {
-			launch_data_dict_iterate(value, semaphoreitem_setup, j);
-		}
+	case JOBKEY_KEEPALIVE:
+		launch_data_dict_iterate(value, semaphoreitem_setup, j);
 		break;
-	case 'i':
-	case 'I':
-		if (strcasecmp(key, LAUNCH_JOBKEY_INETDCOMPATIBILITY) == 0) {
-			j->inetcompat = true;
-			j->abandon_pg = true;
-			if ((tmp = launch_data_dict_lookup(value, LAUNCH_JOBINETDCOMPATIBILITY_WAIT))) {
-				j->inetcompat_wait = launch_data_get_bool(tmp);
-			}
+	case JOBKEY_INETDCOMPATIBILITY:
+		j->inetcompat = true;
+		j->abandon_pg = true;
+		if ((tmp = launch_data_dict_lookup(value, LAUNCH_JOBINETDCOMPATIBILITY_WAIT))) {
+			j->inetcompat_wait = launch_data_get_bool(tmp);
 		}
-		break;
-	case 'j':
-	case 'J':
-		if (strcasecmp(key, LAUNCH_JOBKEY_JETSAMPROPERTIES) == 0) {
-			launch_data_dict_iterate(value, (void (*)(launch_data_t, const char *, void *))jetsam_property_setup, j);
+		if ((tmp = launch_data_dict_lookup(value, LAUNCH_JOBINETDCOMPATIBILITY_BATCHACCEPT))) {
+			j->inetcompat_batch_accept = launch_data_get_bool(tmp);
 		}
-	case 'e':
-	case 'E':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ENVIRONMENTVARIABLES) == 0) {
-			launch_data_dict_iterate(value, envitem_setup, j);
-		}		
-		break;
-	case 'u':
-	case 'U':
-		if (strcasecmp(key, LAUNCH_JOBKEY_USERENVIRONMENTVARIABLES) == 0) {
-			j->importing_global_env = true;
-			launch_data_dict_iterate(value, envitem_setup, j);
-			j->importing_global_env = false;
+		if ((tmp = launch_data_dict_lookup(value, LAUNCH_JOBINETDCOMPATIBILITY_LOGCONNECTIONS))) {
+			j->inetcompat_quiet = !launch_data_get_bool(tmp);
 		}
+		job_import_inetcompat_count(j, value, LAUNCH_JOBINETDCOMPATIBILITY_MAXCHILDREN, &j->inetcompat_max_children);
+		job_import_inetcompat_count(j, value, LAUNCH_JOBINETDCOMPATIBILITY_WORKERS, &j->inetcompat_workers);
+		break;
+	case JOBKEY_JETSAMPROPERTIES:
+		launch_data_dict_iterate(value, (void (*)(launch_data_t, const char *, void *))jetsam_property_setup, j);
+		break;
+	case JOBKEY_ENVIRONMENTVARIABLES:
+		launch_data_dict_iterate(value, envitem_setup, j);
+		break;
+	case JOBKEY_USERENVIRONMENTVARIABLES:
+		j->importing_global_env = true;
+		launch_data_dict_iterate(value, envitem_setup, j);
+		j->importing_global_env = false;
+		break;
+	case JOBKEY_SOCKETS:
+		launch_data_dict_iterate(value, socketgroup_setup, j);
+		break;
+	case JOBKEY_STARTCALENDARINTERVAL:
+		calendarinterval_new_from_obj(j, value);
+		break;
+	case JOBKEY_SOFTRESOURCELIMITS:
+		launch_data_dict_iterate(value, limititem_setup, j);
 		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_SOCKETS) == 0) {
-			launch_data_dict_iterate(value, socketgroup_setup, j);
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_STARTCALENDARINTERVAL) == 0) {
-			calendarinterval_new_from_obj(j, value);
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SOFTRESOURCELIMITS) == 0) {
-			launch_data_dict_iterate(value, limititem_setup, j);
 #if HAVE_SANDBOX
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOXFLAGS) == 0) {
-			launch_data_dict_iterate(value, seatbelt_setup_flags, j);
-#endif
-		}
+	case JOBKEY_SANDBOXFLAGS:
+		launch_data_dict_iterate(value, seatbelt_setup_flags, j);
 		break;
-	case 'h':
-	case 'H':
-		if (strcasecmp(key, LAUNCH_JOBKEY_HARDRESOURCELIMITS) == 0) {
-			j->importing_hard_limits = true;
-			launch_data_dict_iterate(value, limititem_setup, j);
-			j->importing_hard_limits = false;
-		}
+#endif
+	case JOBKEY_HARDRESOURCELIMITS:
+		j->importing_hard_limits = true;
+		launch_data_dict_iterate(value, limititem_setup, j);
+		j->importing_hard_limits = false;
 		break;
-	case 'm':
-	case 'M':
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACHSERVICES) == 0) {
-			launch_data_dict_iterate(value, machservice_setup, j);
-		}
+	case JOBKEY_MACHSERVICES:
+		launch_data_dict_iterate(value, machservice_setup, j);
 		break;
-	case 'l':
-	case 'L':
-		if (strcasecmp(key, LAUNCH_JOBKEY_LAUNCHEVENTS) == 0) {
-			launch_data_dict_iterate(value, eventsystem_setup, j);
-		} else {
-			if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOHARDWARE) == 0) {
-				return;
-			}
-			if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADFROMHARDWARE) == 0) {
-				return;
-			}
-		}
+	case JOBKEY_LAUNCHEVENTS:
+		launch_data_dict_iterate(value, eventsystem_setup, j);
 		break;
+	case JOBKEY_LIMITLOADTOHARDWARE:
+	case JOBKEY_LIMITLOADFROMHARDWARE:
+		return;
 	default:
 		job_log(j, LOG_WARNING, "Unknown key for dictionary: %s", key);
 		break;
@@ -3002,41 +3096,25 @@ job_import_array(job_t j, const char *key, launch_data_t value)
 {
 	size_t i, value_cnt = launch_data_array_get_count(value);
 
-	switch (key[0]) {
-	case 'p':
-	case 'P':
-		if (strcasecmp(key, LAUNCH_JOBKEY_PROGRAMARGUMENTS) == 0) {
-			return;
-		}
-		break;
-	case 'l':
-	case 'L':
-		if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOHOSTS) == 0) {
-			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADFROMHOSTS) == 0) {
-			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE) == 0) {
-			job_log(j, LOG_NOTICE, "launchctl should have transformed the \"%s\" array to a string", LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE);
-			return;
-		}
-		break;
-	case 'b':
-	case 'B':
-		if (strcasecmp(key, LAUNCH_JOBKEY_BINARYORDERPREFERENCE) == 0) {
-			if (job_assumes(j, j->j_binpref = malloc(value_cnt * sizeof(*j->j_binpref)))) {
-				j->j_binpref_cnt = value_cnt;
-				for (i = 0; i < value_cnt; i++) {
-					j->j_binpref[i] = (cpu_type_t) launch_data_get_integer(launch_data_array_get_index(value, i));
-				}
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_PROGRAMARGUMENTS:
+	case JOBKEY_LIMITLOADTOHOSTS:
+	case JOBKEY_LIMITLOADFROMHOSTS:
+		return;
+	case JOBKEY_LIMITLOADTOSESSIONTYPE:
+		job_log(j, LOG_NOTICE, "launchctl should have transformed the \"%s\" array to a string", LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE);
+		return;
+	case JOBKEY_BINARYORDERPREFERENCE:
+		if (job_assumes(j, j->j_binpref = malloc(value_cnt * sizeof(*j->j_binpref)))) {
+			j->j_binpref_cnt = value_cnt;
+			for (i = 0; i < value_cnt; i++) {
+				j->j_binpref[i] = (cpu_type_t) launch_data_get_integer(launch_data_array_get_index(value, i));
 			}
 		}
 		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_STARTCALENDARINTERVAL) == 0) {
-			for (i = 0; i < value_cnt; i++) {
-				calendarinterval_new_from_obj(j, launch_data_array_get_index(value, i));
-			}
+	case JOBKEY_STARTCALENDARINTERVAL:
+		for (i = 0; i < value_cnt; i++) {
+			calendarinterval_new_from_obj(j, launch_data_array_get_index(value, i));
 		}
 		break;
 	default:
@@ -3309,13 +3387,16 @@ jobmgr_label_test(jobmgr_t jm, const char *str)
 job_t 
 job_find(jobmgr_t jm, const char *label)
 {
+	struct hashtab_node *hn;
+	uint32_t h = hash_label(label);
 	job_t ji;
 
 	if (!jm) {
 		jm = root_jobmgr;
 	}
 
-	LIST_FOREACH(ji, &jm->label_hash[hash_label(label)], label_hash_sle) {
+	for (hn = hashtab_lookup(&jm->label_hash, h); hn; hn = hashtab_next(hn)) {
+		ji = job_from_label_node(hn);
 		if (unlikely(ji->removal_pending || ji->mgr->shutting_down)) {
 			// 5351245 and 5488633 respectively
 			continue;
@@ -3330,75 +3411,94 @@ job_find(jobmgr_t jm, const char *label)
 	return NULL;
 }
 
-// Should try and consolidate with job_mig_intran2() and jobmgr_find_by_pid().
-job_t
-jobmgr_find_by_pid_deep(jobmgr_t jm, pid_t p, bool anon_okay)
+bool
+jobmgr_is_within(jobmgr_t jm, jobmgr_t ancestor)
 {
-	job_t ji = NULL;
-	LIST_FOREACH(ji, &jm->active_jobs[ACTIVE_JOB_HASH(p)], pid_hash_sle) {
-		if (ji->p == p && (!ji->anonymous || (ji->anonymous && anon_okay))) {
-			return ji;
-		}
-	}
-
-	jobmgr_t jmi = NULL;
-	SLIST_FOREACH(jmi, &jm->submgrs, sle) {
-		if ((ji = jobmgr_find_by_pid_deep(jmi, p, anon_okay))) {
-			break;
+	for (; jm; jm = jm->parentmgr) {
+		if (jm == ancestor) {
+			return true;
 		}
 	}
 
-	return ji;
+	return false;
 }
 
+/* A PID can belong to two jobs for as long as it takes to process the first
+ * one's exit after the PID has been reused. Unique IDs are never reused and
+ * only increase, so a nonzero 'uniqueid' picks the exact process, and without
+ * one the newest process wins.
+ */
 job_t
-jobmgr_find_by_pid(jobmgr_t jm, pid_t p, bool create_anon)
+job_find_by_pid(pid_t p, uint64_t uniqueid, bool anon_okay)
 {
-	job_t ji;
+	struct hashtab_node *hn;
+	job_t ji, jr = NULL;
 
-	LIST_FOREACH(ji, &jm->active_jobs[ACTIVE_JOB_HASH(p)], pid_hash_sle) {
-		if (ji->p == p) {
-			return ji;
+	for (hn = hashtab_lookup(&global_actives, hash_pid(p)); hn; hn = hashtab_next(hn)) {
+		ji = job_from_global_pid_node(hn);
+		if (ji->p != p || (ji->anonymous && !anon_okay)) {
+			continue;
+		}
+		if (uniqueid) {
+			if (ji->uniqueid == uniqueid) {
+				return ji;
+			}
+		} else if (!jr || ji->uniqueid > jr->uniqueid) {
+			jr = ji;
 		}
 	}
 
-	return create_anon ? job_new_anonymous(jm, p) : NULL;
+	return jr;
 }
 
 job_t
-managed_job(pid_t p)
+jobmgr_find_by_pid_deep(jobmgr_t jm, pid_t p, bool anon_okay)
 {
+	job_t ji = job_find_by_pid(p, 0, anon_okay);
+
+	return (ji && jobmgr_is_within(ji->mgr, jm)) ? ji : NULL;
+}
+
+job_t
+jobmgr_find_by_pid(jobmgr_t jm, pid_t p, bool create_anon)
+{
+	struct hashtab_node *hn;
 	job_t ji;
 
-	LIST_FOREACH(ji, &managed_actives[ACTIVE_JOB_HASH(p)], pid_hash_sle) {
+	for (hn = hashtab_lookup(&jm->active_jobs, hash_pid(p)); hn; hn = hashtab_next(hn)) {
+		ji = job_from_pid_node(hn);
 		if (ji->p == p) {
 			return ji;
 		}
 	}
 
-	return NULL;
+	return create_anon ? job_new_anonymous(jm, p) : NULL;
+}
+
+job_t
+managed_job(pid_t p)
+{
+	return job_find_by_pid(p, 0, false);
 }
 
 job_t 
 job_mig_intran2(jobmgr_t jm, mach_port_t mport, pid_t upid)
 {
+	struct hashtab_node *hn;
+	uint32_t h = hash_port(mport);
 	jobmgr_t jmi;
 	job_t ji;
 
-	if (jm->jm_port == mport) {
-		return jobmgr_find_by_pid(jm, upid, true);
-	}
-
-	SLIST_FOREACH(jmi, &jm->submgrs, sle) {
-		job_t jr;
-
-		if ((jr = job_mig_intran2(jmi, mport, upid))) {
-			return jr;
+	for (hn = hashtab_lookup(&jobmgr_ports, h); hn; hn = hashtab_next(hn)) {
+		jmi = jobmgr_from_port_node(hn);
+		if (jmi->jm_port == mport && jobmgr_is_within(jmi, jm)) {
+			return jobmgr_find_by_pid(jmi, upid, true);
 		}
 	}
 
-	LIST_FOREACH(ji, &jm->jobs, sle) {
-		if (ji->j_port == mport) {
+	for (hn = hashtab_lookup(&job_ports, h); hn; hn = hashtab_next(hn)) {
+		ji = job_from_port_node(hn);
+		if (ji->j_port == mport && jobmgr_is_within(ji->mgr, jm)) {
 			return ji;
 		}
 	}
@@ -3431,9 +3531,11 @@ job_mig_intran(mach_port_t p)
 job_t
 job_find_by_service_port(mach_port_t p)
 {
+	struct hashtab_node *hn;
 	struct machservice *ms;
 
-	LIST_FOREACH(ms, &port_hash[HASH_PORT(p)], port_hash_sle) {
+	for (hn = hashtab_lookup(&port_hash, hash_port(p)); hn; hn = hashtab_next(hn)) {
+		ms = ms_from_port_node(hn);
 		if (ms->recv && (ms->port == p)) {
 			return ms->job;
 		}
@@ -3478,6 +3580,131 @@ job_export_all2(jobmgr_t jm, launch_data_t where)
 	}
 }
 
+/* Brings the job's slot in the shared status table up to date. Everything in
+ * it is what job_export() reports, so that both views agree.
+ */
+void
+job_publish_status(job_t j)
+{
+	int status = j->fpfail ? LAUNCH_EXITSTATUS_FAIRPLAY_FAIL : j->last_exit_status;
+	int64_t started = 0;
+
+	if (j->start_time != 0) {
+		started = (int64_t)time(NULL) - (int64_t)(runtime_get_nanoseconds_since(j->start_time) / NSEC_PER_SEC);
+	}
+
+	jobstat_update(j->jobstat, j->p, status, j->nruns + (j->p != 0), started);
+}
+
+void
+jobmgr_publish_status_all(jobmgr_t jm)
+{
+	jobmgr_t jmi;
+	job_t ji;
+
+	SLIST_FOREACH(jmi, &jm->submgrs, sle) {
+		jobmgr_publish_status_all(jmi);
+	}
+
+	LIST_FOREACH(ji, &jm->jobs, sle) {
+		/* Aliases share their source's label, and the source has a slot. */
+		if (ji->alias) {
+			continue;
+		}
+		if (ji->jobstat == NULL) {
+			ji->jobstat = jobstat_alloc(ji->label);
+		}
+		job_publish_status(ji);
+	}
+}
+
+/* Called once the table exists, for the jobs loaded before it did. */
+void
+job_publish_status_all(void)
+{
+	jobmgr_publish_status_all(root_jobmgr);
+}
+
+/* Gives the job the next generation and publishes its status. Called for
+ * anything that changes what job_export() reports for it: creation, start,
+ * exit, its KeepAlive and idle timeout, and its Mach services and sockets.
+ */
+void
+job_changed(job_t j)
+{
+	// Aliases are listed through their source job.
+	if (j->alias) {
+		return;
+	}
+	if (j->generation != 0) {
+		TAILQ_REMOVE(&s_jobs_by_generation, j, generation_sle);
+	}
+	j->generation = jobgen_bump(&s_jobgen);
+	TAILQ_INSERT_TAIL(&s_jobs_by_generation, j, generation_sle);
+
+	job_publish_status(j);
+}
+
+void
+job_export_removed(const char *label, uint64_t gen __attribute__((unused)), void *context)
+{
+	launch_data_t tmp;
+
+	if ((tmp = launch_data_new_string(label)) != NULL) {
+		launch_data_array_set_index(context, tmp, launch_data_array_get_count(context));
+	}
+}
+
+/* Walks back from the most recently changed job, so the cost is in the number
+ * of changes since 'since' rather than the number of jobs.
+ */
+launch_data_t
+job_export_since(uint64_t since)
+{
+	launch_data_t resp, jobs, removed, tmp;
+	bool complete = !jobgen_covers(&s_jobgen, since);
+	job_t ji;
+
+	if ((resp = launch_data_alloc(LAUNCH_DATA_DICTIONARY)) == NULL) {
+		(void)os_assumes_zero(errno);
+		return NULL;
+	}
+	if ((jobs = launch_data_alloc(LAUNCH_DATA_DICTIONARY)) != NULL) {
+		launch_data_dict_insert(resp, jobs, LAUNCH_KEY_JOBSSINCE_JOBS);
+	}
+	if ((removed = launch_data_alloc(LAUNCH_DATA_ARRAY)) != NULL) {
+		launch_data_dict_insert(resp, removed, LAUNCH_KEY_JOBSSINCE_REMOVED);
+	}
+	if (jobs == NULL || removed == NULL) {
+		(void)os_assumes_zero(errno);
+		launch_data_free(resp);
+		return NULL;
+	}
+
+	if (complete) {
+		job_export_all2(root_jobmgr, jobs);
+	} else {
+		TAILQ_FOREACH_REVERSE(ji, &s_jobs_by_generation, jobs_by_generation, generation_sle) {
+			if (ji->generation <= since) {
+				break;
+			}
+			if (jobmgr_assumes(ji->mgr, (tmp = job_export(ji)) != NULL)) {
+				launch_data_dict_insert(jobs, tmp, ji->label);
+			}
+		}
+		jobgen_removed_since(&s_jobgen, since, job_export_removed, removed);
+	}
+
+	if ((tmp = launch_data_new_integer((long long)jobgen_current(&s_jobgen)))) {
+		launch_data_dict_insert(resp, tmp, LAUNCH_KEY_JOBSSINCE_GENERATION);
+	}
+	if ((tmp = launch_data_new_bool(complete))) {
+		launch_data_dict_insert(resp, tmp, LAUNCH_KEY_JOBSSINCE_COMPLETE);
+	}
+
+	return resp;
+}
+
 launch_data_t
 job_export_all(void)
 {
@@ -3492,6 +3719,49 @@ job_export_all(void)
 	return resp;
 }
 
+static void
+jobmgr_export_hashtab(launch_data_t where, const char *name, const struct hashtab *ht)
+{
+	struct hashtab_stats hs;
+	launch_data_t tmp;
+
+	if (!(tmp = launch_data_alloc(LAUNCH_DATA_DICTIONARY))) {
+		return;
+	}
+
+	hashtab_stats(ht, &hs);
+	launch_data_dict_insert(tmp, launch_data_new_integer(hs.hs_count), LAUNCH_KEY_HASHSTATS_COUNT);
+	launch_data_dict_insert(tmp, launch_data_new_integer(hs.hs_buckets), LAUNCH_KEY_HASHSTATS_BUCKETS);
+	launch_data_dict_insert(tmp, launch_data_new_integer(hs.hs_used), LAUNCH_KEY_HASHSTATS_USEDBUCKETS);
+	launch_data_dict_insert(tmp, launch_data_new_integer(hs.hs_max_chain), LAUNCH_KEY_HASHSTATS_LONGESTCHAIN);
+	launch_data_dict_insert(tmp, launch_data_new_bool(hs.hs_growing), LAUNCH_KEY_HASHSTATS_GROWING);
+	launch_data_dict_insert(where, tmp, name);
+}
+
+launch_data_t
+jobmgr_export_hash_stats(void)
+{
+	launch_data_t resp = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+
+	/* The per-manager indexes are the root job manager's. That is where every
+	 * label outside of XPC domains lives, and where the services of a flat
+	 * namespace are registered.
+	 */
+	if (resp != NULL) {
+		jobmgr_export_hashtab(resp, "Labels", &root_jobmgr->label_hash);
+		jobmgr_export_hashtab(resp, "ActiveJobs", &root_jobmgr->active_jobs);
+		jobmgr_export_hashtab(resp, "MachServices", &root_jobmgr->ms_hash);
+		jobmgr_export_hashtab(resp, "GlobalActives", &global_actives);
+		jobmgr_export_hashtab(resp, "Ports", &port_hash);
+		jobmgr_export_hashtab(resp, "JobPorts", &job_ports);
+		jobmgr_export_hashtab(resp, "JobManagerPorts", &jobmgr_ports);
+	} else {
+		(void)os_assumes_zero(errno);
+	}
+
+	return resp;
+}
+
 void
 job_log_stray_pg(job_t j)
 {
@@ -3575,6 +3845,8 @@ job_reap(job_t j)
 
 	job_log(j, LOG_DEBUG, "Reaping");
 
+	job_start_landed(j);
+
 	if (unlikely(j->weird_bootstrap)) {
 		int64_t junk = 0;
 		job_mig_swap_integer(j, VPROC_GSK_WEIRD_BOOTSTRAP, 0, 0, &junk);
@@ -3686,10 +3958,8 @@ job_reap(job_t j)
 		(void)kevent_mod((uintptr_t)&j->exit_timeout, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
 	}
 
-	LIST_REMOVE(j, pid_hash_sle);
-	if (!j->anonymous) {
-		LIST_REMOVE(j, global_pid_hash_sle);
-	}
+	hashtab_remove(&j->pid_hash_node);
+	hashtab_remove(&j->global_pid_hash_node);
 
 	if (j->sent_signal_time) {
 		uint64_t td_sec, td_usec, td = runtime_get_nanoseconds_since(j->sent_signal_time);
@@ -3881,6 +4151,7 @@ job_reap(job_t j)
 	j->event_monitor_ready2signal = false;
 	j->p = 0;
 	j->uniqueid = 0;
+	job_changed(j);
 }
 
 void
@@ -3935,6 +4206,231 @@ job_dispatch_curious_jobs(job_t j)
 	}
 }
 
+bool
+jobmgr_admission_room(jobmgr_t jm)
+{
+	if (s_admission.limit && s_admission.in_flight >= s_admission.limit) {
+		return false;
+	}
+	return !s_admission.permgr_limit || jm->starts_in_flight < s_admission.permgr_limit;
+}
+
+void
+job_admission_account(uint64_t delay)
+{
+	uint64_t bound = NSEC_PER_MSEC;
+	size_t i = 0;
+
+	while (i < LAUNCHD_ADMISSION_DELAY_BUCKETS - 1 && delay >= bound) {
+		bound *= 10;
+		i++;
+	}
+
+	s_admission.admitted++;
+	s_admission.delay_hist[i]++;
+	s_admission.delay_total += delay;
+	if (delay > s_admission.delay_max) {
+		s_admission.delay_max = delay;
+	}
+}
+
+void
+job_admission_enqueue(job_t j)
+{
+	TAILQ_INSERT_TAIL(&s_admission_queues[j->start_priority - LAUNCHD_START_PRIORITY_MIN], j, admission_sle);
+	j->admission_queued = true;
+	j->admission_time = runtime_get_opaque_time();
+	s_admission.queued++;
+	s_admission.delayed++;
+}
+
+void
+job_admission_dequeue(job_t j)
+{
+	TAILQ_REMOVE(&s_admission_queues[j->start_priority - LAUNCHD_START_PRIORITY_MIN], j, admission_sle);
+	j->admission_queued = false;
+	s_admission.queued--;
+}
+
+void
+job_admit(job_t j, bool kickstart)
+{
+	if (kickstart) {
+		// Somebody is waiting on this start. It counts, but it does not wait.
+		if (j->admission_queued) {
+			job_admission_dequeue(j);
+		}
+		s_admission.demanded++;
+		job_log(j, LOG_DEBUG, "Kickstarting job");
+		job_start(j);
+	} else if (j->admission_queued) {
+		job_log(j, LOG_DEBUG, "Job is already waiting to be started.");
+	} else if (s_admission.queued == 0 && jobmgr_admission_room(j->mgr)) {
+		job_admission_account(0);
+		job_log(j, LOG_DEBUG, "Starting job");
+		job_start(j);
+	} else {
+		job_admission_enqueue(j);
+		job_log(j, LOG_DEBUG, "Start queued at priority %d with %u starts in flight.", j->start_priority, s_admission.in_flight);
+		job_watch(j);
+		jobmgr_admission_kick();
+	}
+}
+
+void
+job_start_in_flight(job_t j, bool awaits_checkin)
+{
+	j->start_in_flight = true;
+	j->start_awaits_checkin = awaits_checkin;
+	j->mgr->starts_in_flight++;
+	s_admission.in_flight++;
+	(void)job_assumes_zero_p(j, kevent_mod((uintptr_t)&j->admission_time, EVFILT_TIMER, EV_ADD|EV_ONESHOT, NOTE_SECONDS, LAUNCHD_ADMISSION_TIMEOUT, j));
+}
+
+void
+job_start_landed(job_t j)
+{
+	if (!j->start_in_flight) {
+		return;
+	}
+
+	j->start_in_flight = false;
+	j->mgr->starts_in_flight--;
+	s_admission.in_flight--;
+	// Gone already if it is what fired.
+	(void)kevent_mod((uintptr_t)&j->admission_time, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+	jobmgr_admission_kick();
+}
+
+/* Queued starts are admitted from the event loop rather than from wherever a
+ * start landed: job_reap() and job_checkin() are in the middle of another
+ * job's bookkeeping.
+ */
+void
+jobmgr_admission_kick(void)
+{
+	if (s_admission.drain_pending || s_admission.queued == 0 || !root_jobmgr) {
+		return;
+	}
+
+	if (jobmgr_assumes_zero_p(root_jobmgr, kevent_mod((uintptr_t)&s_admission, EVFILT_TIMER, EV_ADD|EV_ONESHOT, NOTE_SECONDS, 0, root_jobmgr)) != -1) {
+		s_admission.drain_pending = true;
+	}
+}
+
+void
+jobmgr_admission_drain(void)
+{
+	uint64_t delay;
+	job_t ji = NULL;
+	int i;
+
+	s_admission.drain_pending = false;
+
+	/* Look again from the top after every start. Starting a job can queue,
+	 * dispatch or remove others.
+	 */
+	while (s_admission.queued && (!s_admission.limit || s_admission.in_flight < s_admission.limit)) {
+		for (i = LAUNCHD_START_PRIORITIES - 1; i >= 0; i--) {
+			TAILQ_FOREACH(ji, &s_admission_queues[i], admission_sle) {
+				if (jobmgr_admission_room(ji->mgr)) {
+					break;
+				}
+			}
+			if (ji) {
+				break;
+			}
+		}
+		if (!ji) {
+			// Everything left is in a job manager at its limit.
+			return;
+		}
+
+		job_admission_dequeue(ji);
+		delay = runtime_get_nanoseconds_since(ji->admission_time);
+		job_admission_account(delay);
+
+		if (job_active(ji) || !job_keepalive(ji)) {
+			job_log(ji, LOG_DEBUG, "No longer needs to be started.");
+			continue;
+		}
+
+		job_log(ji, LOG_DEBUG, "Starting job after waiting %llu ms.", delay / NSEC_PER_MSEC);
+		job_start(ji);
+	}
+}
+
+launch_data_t
+jobmgr_export_spawn_stats(void)
+{
+	launch_data_t resp = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	launch_data_t hist;
+	size_t i;
+
+	if (resp == NULL) {
+		(void)os_assumes_zero(errno);
+		return NULL;
+	}
+
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.limit), LAUNCH_KEY_SPAWNSTATS_LIMIT);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.permgr_limit), LAUNCH_KEY_SPAWNSTATS_PERMANAGERLIMIT);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.in_flight), LAUNCH_KEY_SPAWNSTATS_INFLIGHT);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.queued), LAUNCH_KEY_SPAWNSTATS_QUEUED);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.admitted), LAUNCH_KEY_SPAWNSTATS_ADMITTED);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.delayed), LAUNCH_KEY_SPAWNSTATS_DELAYED);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.demanded), LAUNCH_KEY_SPAWNSTATS_DEMANDED);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.timed_out), LAUNCH_KEY_SPAWNSTATS_TIMEDOUT);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.delay_total / NSEC_PER_USEC), LAUNCH_KEY_SPAWNSTATS_TOTALDELAY);
+	launch_data_dict_insert(resp, launch_data_new_integer(s_admission.delay_max / NSEC_PER_USEC), LAUNCH_KEY_SPAWNSTATS_MAXDELAY);
+
+	if ((hist = launch_data_alloc(LAUNCH_DATA_ARRAY))) {
+		for (i = 0; i < LAUNCHD_ADMISSION_DELAY_BUCKETS; i++) {
+			launch_data_array_set_index(hist, launch_data_new_integer(s_admission.delay_hist[i]), i);
+		}
+		launch_data_dict_insert(resp, hist, LAUNCH_KEY_SPAWNSTATS_DELAYHISTOGRAM);
+	}
+
+	return resp;
+}
+
+static int
+jobmgr_spawn_limit_get(launch_data_t limits, const char *key, unsigned int *limit)
+{
+	launch_data_t tmp = launch_data_dict_lookup(limits, key);
+
+	if (tmp == NULL) {
+		return 0;
+	}
+	if (launch_data_get_type(tmp) != LAUNCH_DATA_INTEGER
+			|| launch_data_get_integer(tmp) < 0 || launch_data_get_integer(tmp) > UINT32_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*limit = (unsigned int)launch_data_get_integer(tmp);
+	return 0;
+}
+
+launch_data_t
+jobmgr_set_spawn_limits(launch_data_t limits)
+{
+	unsigned int limit = s_admission.limit;
+	unsigned int permgr_limit = s_admission.permgr_limit;
+
+	if (launch_data_get_type(limits) != LAUNCH_DATA_DICTIONARY
+			|| jobmgr_spawn_limit_get(limits, LAUNCH_KEY_SPAWNSTATS_LIMIT, &limit) == -1
+			|| jobmgr_spawn_limit_get(limits, LAUNCH_KEY_SPAWNSTATS_PERMANAGERLIMIT, &permgr_limit) == -1) {
+		return launch_data_new_errno(EINVAL);
+	}
+
+	s_admission.limit = limit;
+	s_admission.permgr_limit = permgr_limit;
+	jobmgr_log(root_jobmgr, LOG_NOTICE, "Start limits set to %u in flight, %u per job manager.", limit, permgr_limit);
+	jobmgr_admission_kick();
+
+	return jobmgr_export_spawn_stats();
+}
+
 job_t
 job_dispatch(job_t j, bool kickstart)
 {
@@ -3990,8 +4486,7 @@ job_dispatch(job_t j, bool kickstart)
 		}
 
 		if (kickstart || job_keepalive(j)) {
-			job_log(j, LOG_DEBUG, "%starting job", kickstart ? "Kicks" : "S");
-			job_start(j);
+			job_admit(j, kickstart);
 		} else {
 			job_log(j, LOG_DEBUG, "Watching job.");
 			job_watch(j);
@@ -4075,6 +4570,34 @@ out:
 	free(pids);
 }
 
+void
+job_did_exec(job_t j)
+{
+	if (j->spawn_reply_port) {
+		errno = job_mig_spawn2_reply(j->spawn_reply_port, BOOTSTRAP_SUCCESS, j->p, j->exit_status_port);
+		if (errno) {
+			if (errno != MACH_SEND_INVALID_DEST) {
+				(void)job_assumes_zero(j, errno);
+			}
+			(void)job_assumes_zero(j, launchd_mport_close_recv(j->exit_status_port));
+		}
+
+		j->spawn_reply_port = MACH_PORT_NULL;
+		j->exit_status_port = MACH_PORT_NULL;
+	}
+
+	if (j->xpc_service && j->did_exec) {
+		j->xpcproxy_did_exec = true;
+	}
+
+	j->did_exec = true;
+	job_log(j, LOG_DEBUG, "Program changed");
+
+	if (!j->start_awaits_checkin) {
+		job_start_landed(j);
+	}
+}
+
 void
 job_callback_proc(job_t j, struct kevent *kev)
 {
@@ -4096,37 +4619,19 @@ job_callback_proc(job_t j, struct kevent *kev)
 
 				job_log(j, LOG_INFO, "Program changed. Updating the label to: %s", newlabel);
 
-				LIST_REMOVE(j, label_hash_sle);
+				hashtab_remove(&j->label_hash_node);
 				strcpy((char *)j->label, newlabel);
 
 				jobmgr_t where2put = root_jobmgr;
 				if (j->mgr->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN) {
 					where2put = j->mgr;
 				}
-				LIST_INSERT_HEAD(&where2put->label_hash[hash_label(j->label)], j, label_hash_sle);
+				hashtab_insert(&where2put->label_hash, &j->label_hash_node, hash_label(j->label));
 			} else if (errno != ESRCH) {
 				(void)job_assumes_zero(j, errno);
 			}
 		} else {
-			if (j->spawn_reply_port) {
-				errno = job_mig_spawn2_reply(j->spawn_reply_port, BOOTSTRAP_SUCCESS, j->p, j->exit_status_port);
-				if (errno) {
-					if (errno != MACH_SEND_INVALID_DEST) {
-						(void)job_assumes_zero(j, errno);
-					}
-					(void)job_assumes_zero(j, launchd_mport_close_recv(j->exit_status_port));
-				}
-
-				j->spawn_reply_port = MACH_PORT_NULL;
-				j->exit_status_port = MACH_PORT_NULL;
-			}
-
-			if (j->xpc_service && j->did_exec) {
-				j->xpcproxy_did_exec = true;
-			}
-
-			j->did_exec = true;
-			job_log(j, LOG_DEBUG, "Program changed");
+			job_did_exec(j);
 		}
 	}
 
@@ -4176,6 +4681,11 @@ job_callback_timer(job_t j, void *ident)
 		job_log(j, LOG_DEBUG, "&j->start_interval == ident (%p)", ident);
 		j->start_pending = true;
 		job_dispatch(j, false);
+	} else if (&j->admission_time == ident) {
+		job_log(j, LOG_NOTICE, "Job has not %s %d seconds after starting. No longer counting it against the start limits.",
+				j->start_awaits_checkin ? "checked in" : "exec(3)ed", LAUNCHD_ADMISSION_TIMEOUT);
+		s_admission.timed_out++;
+		job_start_landed(j);
 	} else if (&j->exit_timeout == ident) {
 		if (!job_assumes(j, j->p != 0)) {
 			return;
@@ -4226,7 +4736,7 @@ job_callback_timer(job_t j, void *ident)
 			job_log(j, LOG_WARNING | LOG_CONSOLE, "Exit timeout elapsed (%u seconds). Killing", j->exit_timeout);
 			job_kill(j);
 		}
-	} else {
+	} else if (!calendarinterval_callback(j, ident)) {
 		job_log(j, LOG_ERR, "Unrecognized job timer callback: %p", ident);
 	}
 }
@@ -4236,6 +4746,13 @@ job_callback_read(job_t j, int ident)
 {
 	if (ident == j->stdin_fd) {
 		job_dispatch(j, true);
+	} else if (j->fork_fd && ident == j->fork_fd) {
+		// Closing it also drops the kevent.
+		(void)job_assumes_zero_p(j, runtime_close(j->fork_fd));
+		j->fork_fd = 0;
+		if (!j->start_awaits_checkin) {
+			job_start_landed(j);
+		}
 	} else {
 		socketgroup_callback(j);
 	}
@@ -4279,7 +4796,7 @@ jobmgr_callback(void *obj, struct kevent *kev)
 			jobmgr_log(jm, LOG_DEBUG, "Got SIGTERM. Shutting down.");
 			return launchd_shutdown();
 		case SIGUSR1:
-			return calendarinterval_callback();
+			return runtime_expire_timers();
 		case SIGUSR2:
 			// Turn on all logging.
 			launchd_log_perf = true;
@@ -4309,13 +4826,13 @@ jobmgr_callback(void *obj, struct kevent *kev)
 		jobmgr_dispatch_all_semaphores(jm);
 		break;
 	case EVFILT_TIMER:
-		if (kev->ident == (uintptr_t)&sorted_calendar_events) {
-			calendarinterval_callback();
-		} else if (kev->ident == (uintptr_t)jm) {
+		if (kev->ident == (uintptr_t)jm) {
 			jobmgr_log(jm, LOG_DEBUG, "Shutdown timer firing.");
 			jobmgr_still_alive_with_check(jm);
 		} else if (kev->ident == (uintptr_t)&jm->reboot_flags) {
 			jobmgr_do_garbage_collection(jm);
+		} else if (kev->ident == (uintptr_t)&s_admission) {
+			jobmgr_admission_drain();
 		} else if (kev->ident == (uintptr_t)&launchd_runtime_busy_time) {
 			jobmgr_log(jm, LOG_DEBUG, "Idle exit timer fired. Shutting down.");
 			if (jobmgr_assumes_zero(jm, runtime_busy_cnt) == 0) {
@@ -4379,9 +4896,12 @@ job_start(job_t j)
 	uint64_t td;
 	int spair[2];
 	int execspair[2];
-	char nbuf[64];
 	pid_t c;
 	bool sipc = false;
+	bool spawned = false;
+	bool forked = false;
+	struct job_spawn js;
+	struct spawn_result sr;
 	u_int proc_fflags = NOTE_EXIT|NOTE_FORK|NOTE_EXEC|NOTE_EXIT_DETAIL|NOTE_EXITSTATUS;
 
 	if (!job_assumes(j, j->mgr != NULL)) {
@@ -4425,16 +4945,33 @@ job_start(job_t j)
 		(void)job_assumes_zero_p(j, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
 	}
 
-	(void)job_assumes_zero_p(j, socketpair(AF_UNIX, SOCK_STREAM, 0, execspair));
+	if (HAVE_VFORK_SPAWN && job_spawn_setup(j, &js, sipc ? spair[1] : -1)) {
+		/* The child execs before we get to attach a kevent to it, so there is
+		 * no fork() to uncork and no reason for it to see the other end.
+		 */
+		spawned = true;
+		if (sipc) {
+			(void)_fd(spair[0]);
+		}
+		c = runtime_spawn(j->weird_bootstrap ? j->j_port : j->mgr->jm_port, &js.js_plan, &sr);
+	} else if (job_exec_env(j, NULL, sipc ? spair[1] : -1) && job_exec_argv(j)) {
+		forked = true;
+		(void)job_assumes_zero_p(j, socketpair(AF_UNIX, SOCK_STREAM, 0, execspair));
+		c = runtime_fork(j->weird_bootstrap ? j->j_port : j->mgr->jm_port);
+	} else {
+		c = -1;
+	}
 
-	switch (c = runtime_fork(j->weird_bootstrap ? j->j_port : j->mgr->jm_port)) {
+	switch (c) {
 	case -1:
-		job_log_error(j, LOG_ERR, "fork() failed, will try again in one second");
+		job_log_error(j, LOG_ERR, "%s failed, will try again in one second", spawned ? "spawn" : "fork()");
 		(void)job_assumes_zero_p(j, kevent_mod((uintptr_t)j, EVFILT_TIMER, EV_ADD|EV_ONESHOT, NOTE_SECONDS, 1, j));
 		job_ignore(j);
 
-		(void)job_assumes_zero(j, runtime_close(execspair[0]));
-		(void)job_assumes_zero(j, runtime_close(execspair[1]));
+		if (forked) {
+			(void)job_assumes_zero(j, runtime_close(execspair[0]));
+			(void)job_assumes_zero(j, runtime_close(execspair[1]));
+		}
 		if (sipc) {
 			(void)job_assumes_zero(j, runtime_close(spair[0]));
 			(void)job_assumes_zero(j, runtime_close(spair[1]));
@@ -4450,9 +4987,8 @@ job_start(job_t j)
 		read(_fd(execspair[1]), &c, sizeof(c));
 
 		if (sipc) {
+			// LAUNCHD_TRUSTED_FD_ENV is already in the job's environment.
 			(void)job_assumes_zero(j, runtime_close(spair[0]));
-			snprintf(nbuf, sizeof(nbuf), "%d", spair[1]);
-			setenv(LAUNCHD_TRUSTED_FD_ENV, nbuf, 1);
 		}
 		job_start_child(j);
 		break;
@@ -4460,6 +4996,9 @@ job_start(job_t j)
 		j->start_time = runtime_get_opaque_time();
 
 		job_log(j, LOG_DEBUG, "Started as PID: %u", c);
+		if (spawned) {
+			job_spawn_log(j, &sr);
+		}
 
 		j->did_exec = false;
 		j->fpfail = false;
@@ -4488,9 +5027,10 @@ job_start(job_t j)
 		job_log(j, LOG_PERF, "Job started.");
 		runtime_add_ref();
 		total_children++;
-		LIST_INSERT_HEAD(&j->mgr->active_jobs[ACTIVE_JOB_HASH(c)], j, pid_hash_sle);
-		LIST_INSERT_HEAD(&managed_actives[ACTIVE_JOB_HASH(c)], j, global_pid_hash_sle);
+		hashtab_insert(&j->mgr->active_jobs, &j->pid_hash_node, hash_pid(c));
+		hashtab_insert(&global_actives, &j->global_pid_hash_node, hash_pid(c));
 		j->p = c;
+		job_changed(j);
 
 		struct proc_uniqidentifierinfo info;
 		if (proc_pidinfo(c, PROC_PIDUNIQIDENTIFIERINFO, 0, &info, PROC_PIDUNIQIDENTIFIERINFO_SIZE) != 0) {
@@ -4499,14 +5039,21 @@ job_start(job_t j)
 		}
 
 		j->mgr->normal_active_cnt++;
-		j->fork_fd = _fd(execspair[0]);
-		(void)job_assumes_zero(j, runtime_close(execspair[1]));
+		job_start_in_flight(j, sipc && !j->inetcompat);
+		if (!spawned) {
+			j->fork_fd = _fd(execspair[0]);
+			(void)job_assumes_zero(j, runtime_close(execspair[1]));
+		}
 		if (sipc) {
 			(void)job_assumes_zero(j, runtime_close(spair[1]));
 			ipc_open(_fd(spair[0]), j);
 		}
 		if (kevent_mod(c, EVFILT_PROC, EV_ADD, proc_fflags, 0, root_jobmgr ? root_jobmgr : j->mgr) != -1) {
 			job_ignore(j);
+			if (spawned && sr.sr_execed) {
+				// NOTE_EXEC came and went before the kevent was attached.
+				job_did_exec(j);
+			}
 		} else {
 			if (errno == ESRCH) {
 				job_log(j, LOG_ERR, "Child was killed before we could attach a kevent.");
@@ -4543,11 +5090,15 @@ job_start(job_t j)
 		}
 #endif
 		j->wait4debugger_oneshot = false;
-		if (likely(!j->stall_before_exec)) {
+		if (likely(!spawned && !j->stall_before_exec)) {
 			job_uncork_fork(j);
 		}
 		break;
 	}
+
+	if (spawned) {
+		job_spawn_teardown(&js);
+	}
 }
 
 void
@@ -4597,18 +5148,8 @@ job_start_child(job_t j)
 		}
 		g.gl_pathv[0] = (char *)file2exec;
 		argv = (const char **)g.gl_pathv;
-	} else if (likely(j->argv)) {
-		argv = alloca((j->argc + 2) * sizeof(char *));
-		argv[0] = file2exec;
-		for (i = 0; i < j->argc; i++) {
-			argv[i + 1] = j->argv[i];
-		}
-		argv[i + 1] = NULL;
 	} else {
-		argv = alloca(3 * sizeof(char *));
-		argv[0] = file2exec;
-		argv[1] = j->prog;
-		argv[2] = NULL;
+		argv = job_exec_argv(j);
 	}
 
 	if (likely(!(j->inetcompat || use_xpcproxy))) {
@@ -4758,6 +5299,184 @@ out_bad:
 	_exit(errno);
 }
 
+/*
+ * job_setup_attributes() and job_start_child() for the spawn path: all of the
+ * decisions are made here, in launchd, and the child only carries them out.
+ * Returns false, leaving nothing to tear down, for jobs that need the child
+ * to do more than that (or when the plan cannot be put together), which are
+ * then started with fork() as before.
+ */
+bool
+job_spawn_setup(job_t j, struct job_spawn *js, int trusted_fd)
+{
+	const char *file2exec = "/usr/libexec/launchproxy";
+	int gflags = GLOB_NOSORT|GLOB_NOCHECK|GLOB_TILDE|GLOB_DOOFFS;
+	struct spawn_plan *sp = &js->js_plan;
+	const char **argv;
+	struct limititem *li;
+	size_t i, n;
+
+	/* The debugger and VPROCFLAG_STALL_JOB_EXEC need the child stopped short
+	 * of exec, XPC services go through xpcproxy, and the rest are library
+	 * calls that only affect the calling process.
+	 *
+	 * Switching to another user or group means asking the user and group
+	 * databases. A directory service that hangs there must hold up only the
+	 * child, not the event loop, so those lookups stay in the forked child.
+	 * That also goes for the check a non-root launchd makes of its own
+	 * account, which is left to the jobs that are forked.
+	 */
+	if ((getuid() == 0 && (j->username || j->groupname || j->mach_uid))
+			|| j->stall_before_exec || j->wait4debugger || j->wait4debugger_oneshot
+			|| j->xpc_service || waiting4attach_find(j->mgr, j)
+			|| (j->session_create && !j->inetcompat)
+			|| j->low_pri_io || j->low_priority_background_io
+			|| j->jetsam_properties || j->j_binpref_cnt || j->disable_aslr) {
+		return false;
+	}
+#if HAVE_SANDBOX
+	if (j->seatbelt_profile || j->container_identifier) {
+		return false;
+	}
+#endif
+#if HAVE_QUARANTINE
+	if (j->quarantine_data) {
+		return false;
+	}
+#endif
+
+	memset(js, 0, sizeof(*js));
+	spawn_plan_init(sp);
+
+	if (unlikely(j->argv && j->globargv)) {
+		js->js_glob.gl_offs = 1;
+		js->js_globbed = true;
+		for (i = 0; i < j->argc; i++) {
+			if (i > 0) {
+				gflags |= GLOB_APPEND;
+			}
+			if (glob(j->argv[i], gflags, NULL, &js->js_glob) != 0) {
+				// Let the forked child fail the way it always has.
+				goto out_bad;
+			}
+		}
+		js->js_glob.gl_pathv[0] = (char *)file2exec;
+		argv = (const char **)js->js_glob.gl_pathv;
+	} else if ((argv = job_exec_argv(j)) == NULL) {
+		goto out_bad;
+	}
+
+	sp->sp_argv = (char *const *)argv;
+	sp->sp_path = file2exec;
+	if (likely(!j->inetcompat)) {
+		sp->sp_argv++;
+		sp->sp_path = j->prog ? j->prog : sp->sp_argv[0];
+		sp->sp_search = !j->prog;
+	}
+
+	if (unlikely(j->setnice)) {
+		sp->sp_setnice = true;
+		sp->sp_nice = j->nice;
+	}
+
+	n = 0;
+	SLIST_FOREACH(li, &j->limits, sle) {
+		n++;
+	}
+	if (n) {
+		if (!job_assumes(j, js->js_limits = calloc(n, sizeof(js->js_limits[0])))) {
+			goto out_bad;
+		}
+		n = 0;
+		SLIST_FOREACH(li, &j->limits, sle) {
+			js->js_limits[n].sr_which = li->which;
+			js->js_limits[n].sr_sethard = li->sethard;
+			js->js_limits[n].sr_setsoft = li->setsoft;
+			js->js_limits[n].sr_lim = li->lim;
+			n++;
+		}
+		sp->sp_limits = js->js_limits;
+		sp->sp_nlimits = n;
+	}
+
+	sp->sp_rootdir = j->rootdir;
+
+	if ((sp->sp_envp = job_exec_env(j, NULL, trusted_fd)) == NULL) {
+		goto out_bad;
+	}
+
+	sp->sp_workingdir = j->workingdir;
+	if (unlikely(j->setmask)) {
+		sp->sp_setmask = true;
+		sp->sp_mask = j->mask;
+	}
+
+	if (j->stdin_fd) {
+		sp->sp_stdio_fd[STDIN_FILENO] = j->stdin_fd;
+	} else {
+		sp->sp_stdio_path[STDIN_FILENO] = j->stdinpath;
+		sp->sp_stdio_flags[STDIN_FILENO] = O_RDONLY|O_CREAT;
+	}
+	sp->sp_stdio_path[STDOUT_FILENO] = j->stdoutpath;
+	sp->sp_stdio_flags[STDOUT_FILENO] = O_WRONLY|O_CREAT|O_APPEND;
+	sp->sp_stdio_path[STDERR_FILENO] = j->stderrpath;
+	sp->sp_stdio_flags[STDERR_FILENO] = O_WRONLY|O_CREAT|O_APPEND;
+
+	// The forked child asks whether its parent is PID 1; we are its parent.
+	sp->sp_setsid = (getpid() == 1);
+
+	return true;
+
+out_bad:
+	job_spawn_teardown(js);
+	return false;
+}
+
+void
+job_spawn_teardown(struct job_spawn *js)
+{
+	if (js->js_globbed) {
+		globfree(&js->js_glob);
+	}
+	free(js->js_limits);
+	memset(js, 0, sizeof(*js));
+}
+
+/* What the forked child would have logged for itself. */
+void
+job_spawn_log(job_t j, const struct spawn_result *sr)
+{
+	const struct spawn_report *r;
+	size_t i;
+
+	for (i = 0; i < sr->sr_nreports; i++) {
+		r = &sr->sr_reports[i];
+		errno = r->sr_errno;
+
+		switch (r->sr_step) {
+		case SPAWN_STEP_RLIMIT:
+			job_log_error(j, LOG_WARNING, "setrlimit()");
+			break;
+		case SPAWN_STEP_CHDIR:
+			if (errno == ENOENT || errno == ENOTDIR) {
+				job_log(j, LOG_ERR, "Job specified non-existent working directory: %s", j->workingdir);
+			} else {
+				(void)job_assumes_zero(j, errno);
+			}
+			break;
+		case SPAWN_STEP_OPEN:
+			job_log_error(j, LOG_WARNING, "open(\"%s\", ...)", r->sr_arg == STDIN_FILENO ? j->stdinpath : r->sr_arg == STDOUT_FILENO ? j->stdoutpath : j->stderrpath);
+			break;
+		case SPAWN_STEP_EXEC:
+			job_log_error(j, LOG_ERR, "Could not exec %s", j->prog ? j->prog : j->argv[0]);
+			break;
+		default:
+			job_log_error(j, LOG_ERR, "%s", spawn_step_name(r->sr_step));
+			break;
+		}
+	}
+}
+
 void
 jobmgr_export_env_from_other_jobs(jobmgr_t jm, launch_data_t dict)
 {
@@ -4765,44 +5484,187 @@ jobmgr_export_env_from_other_jobs(jobmgr_t jm, launch_data_t dict)
 	struct envitem *ei;
 	job_t ji;
 
-	if (jm->parentmgr) {
-		jobmgr_export_env_from_other_jobs(jm->parentmgr, dict);
-	} else {
-		char **tmpenviron = environ;
-		for (; *tmpenviron; tmpenviron++) {
-			char envkey[1024];
-			launch_data_t s = launch_data_alloc(LAUNCH_DATA_STRING);
-			launch_data_set_string(s, strchr(*tmpenviron, '=') + 1);
-			strncpy(envkey, *tmpenviron, sizeof(envkey));
-			*(strchr(envkey, '=')) = '\0';
-			launch_data_dict_insert(dict, s, envkey);
+	if (jm->parentmgr) {
+		jobmgr_export_env_from_other_jobs(jm->parentmgr, dict);
+	} else {
+		char **tmpenviron = environ;
+		for (; *tmpenviron; tmpenviron++) {
+			char envkey[1024];
+			launch_data_t s = launch_data_alloc(LAUNCH_DATA_STRING);
+			launch_data_set_string(s, strchr(*tmpenviron, '=') + 1);
+			strncpy(envkey, *tmpenviron, sizeof(envkey));
+			*(strchr(envkey, '=')) = '\0';
+			launch_data_dict_insert(dict, s, envkey);
+		}
+	}
+
+	LIST_FOREACH(ji, &jm->jobs, sle) {
+		SLIST_FOREACH(ei, &ji->global_env, sle) {
+			if ((tmp = launch_data_new_string(ei->value))) {
+				launch_data_dict_insert(dict, tmp, ei->key);
+			}
+		}
+	}
+}
+
+bool
+jobmgr_exec_env_from_other_jobs(jobmgr_t jm, struct spawn_env *se)
+{
+	struct envitem *ei;
+	job_t ji;
+
+	if (jm->parentmgr && !jobmgr_exec_env_from_other_jobs(jm->parentmgr, se)) {
+		return false;
+	}
+
+	LIST_FOREACH(ji, &jm->global_env_jobs, global_env_sle) {
+		SLIST_FOREACH(ei, &ji->global_env, sle) {
+			if (spawn_env_set(se, ei->key, ei->value, true) == -1) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void
+jobmgr_env_changed(void)
+{
+	jobmgr_env_gen++;
+}
+
+static bool
+job_exec_env_user_is(job_t j, const struct passwd *pwe)
+{
+	if (!pwe) {
+		return !j->exec_env_login;
+	}
+
+	return j->exec_env_login && strcmp(j->exec_env_login, pwe->pw_name) == 0
+		&& strcmp(j->exec_env_home, pwe->pw_dir) == 0
+		&& strcmp(j->exec_env_shell, pwe->pw_shell) == 0;
+}
+
+void
+job_exec_env_reset(job_t j)
+{
+	spawn_env_destroy(&j->exec_env);
+	free(j->exec_env_login);
+	free(j->exec_env_home);
+	free(j->exec_env_shell);
+	j->exec_env_login = j->exec_env_home = j->exec_env_shell = NULL;
+	j->exec_env_gen = 0;
+}
+
+/*
+ * The environment the job execs with: launchd's own, overridden by the global
+ * environment of every job up the job manager chain, then by the job's own.
+ * 'pwe' fills in SHELL, HOME, USER and LOGNAME where none of those did, and
+ * 'trusted_fd', unless -1, becomes LAUNCHD_TRUSTED_FD_ENV.
+ *
+ * It is kept from one start to the next and only rebuilt when jobmgr_env_gen
+ * has moved on, the job's own environment has changed (which zeroes
+ * exec_env_gen), or it is asked for with a different account.
+ */
+char **
+job_exec_env(job_t j, const struct passwd *pwe, int trusted_fd)
+{
+	struct spawn_env *se = &j->exec_env;
+	struct envitem *ei;
+	char nbuf[64];
+
+	if (likely(j->exec_env_gen == jobmgr_env_gen && job_exec_env_user_is(j, pwe))) {
+		if (j->exec_env_fd == trusted_fd) {
+			return se->se_envp;
+		}
+		// Socket pairs need not come back with the same number.
+		if (j->exec_env_fd != -1 && trusted_fd != -1) {
+			snprintf(nbuf, sizeof(nbuf), "%d", trusted_fd);
+			if (spawn_env_set(se, LAUNCHD_TRUSTED_FD_ENV, nbuf, true) == -1) {
+				goto out_bad;
+			}
+			j->exec_env_fd = trusted_fd;
+			return se->se_envp;
+		}
+	}
+
+	job_exec_env_reset(j);
+
+	if (spawn_env_copy(se, environ) == -1 || !jobmgr_exec_env_from_other_jobs(j->mgr, se)) {
+		goto out_bad;
+	}
+	SLIST_FOREACH(ei, &j->env, sle) {
+		if (spawn_env_set(se, ei->key, ei->value, true) == -1) {
+			goto out_bad;
+		}
+	}
+
+	if (pwe) {
+		if (spawn_env_set(se, "SHELL", pwe->pw_shell, false) == -1
+				|| spawn_env_set(se, "HOME", pwe->pw_dir, false) == -1
+				|| spawn_env_set(se, "USER", pwe->pw_name, false) == -1
+				|| spawn_env_set(se, "LOGNAME", pwe->pw_name, false) == -1) {
+			goto out_bad;
+		}
+		j->exec_env_login = strdup(pwe->pw_name);
+		j->exec_env_home = strdup(pwe->pw_dir);
+		j->exec_env_shell = strdup(pwe->pw_shell);
+		if (!j->exec_env_login || !j->exec_env_home || !j->exec_env_shell) {
+			goto out_bad;
 		}
 	}
 
-	LIST_FOREACH(ji, &jm->jobs, sle) {
-		SLIST_FOREACH(ei, &ji->global_env, sle) {
-			if ((tmp = launch_data_new_string(ei->value))) {
-				launch_data_dict_insert(dict, tmp, ei->key);
-			}
+	if (trusted_fd != -1) {
+		snprintf(nbuf, sizeof(nbuf), "%d", trusted_fd);
+		if (spawn_env_set(se, LAUNCHD_TRUSTED_FD_ENV, nbuf, true) == -1) {
+			goto out_bad;
 		}
 	}
+
+	j->exec_env_fd = trusted_fd;
+	j->exec_env_gen = jobmgr_env_gen;
+
+	return se->se_envp;
+
+out_bad:
+	(void)job_assumes_zero(j, errno);
+	job_exec_env_reset(j);
+	return NULL;
 }
 
-void
-jobmgr_setup_env_from_other_jobs(jobmgr_t jm)
+/* The argv job_start_child() always built, made once: the program, or
+ * launchproxy for inetd-compatible jobs, followed by ProgramArguments.
+ */
+const char **
+job_exec_argv(job_t j)
 {
-	struct envitem *ei;
-	job_t ji;
+	const char **argv;
+	size_t i;
 
-	if (jm->parentmgr) {
-		jobmgr_setup_env_from_other_jobs(jm->parentmgr);
+	if (likely(j->exec_argv)) {
+		return j->exec_argv;
 	}
 
-	LIST_FOREACH(ji, &jm->global_env_jobs, global_env_sle) {
-		SLIST_FOREACH(ei, &ji->global_env, sle) {
-			setenv(ei->key, ei->value, 1);
+	if (j->argv) {
+		argv = calloc(j->argc + 2, sizeof(char *));
+	} else {
+		argv = calloc(3, sizeof(char *));
+	}
+	if (!job_assumes(j, argv != NULL)) {
+		return NULL;
+	}
+
+	argv[0] = "/usr/libexec/launchproxy";
+	if (j->argv) {
+		for (i = 0; i < j->argc; i++) {
+			argv[i + 1] = j->argv[i];
 		}
+	} else {
+		argv[1] = j->prog;
 	}
+
+	return j->exec_argv = argv;
 }
 
 void
@@ -5137,7 +5999,11 @@ void
 job_setup_attributes(job_t j)
 {
 	struct limititem *li;
-	struct envitem *ei;
+
+	/* job_start() built the job's environment before forking. What the child
+	 * adds from here on, such as the account's variables, goes on top of it.
+	 */
+	environ = j->exec_env.se_envp;
 
 	if (unlikely(j->setnice)) {
 		(void)job_assumes_zero_p(j, setpriority(PRIO_PROCESS, 0, j->nice));
@@ -5201,12 +6067,6 @@ job_setup_attributes(job_t j)
 	job_setup_fd(j, STDOUT_FILENO, j->stdoutpath, O_WRONLY|O_CREAT|O_APPEND);
 	job_setup_fd(j, STDERR_FILENO, j->stderrpath, O_WRONLY|O_CREAT|O_APPEND);
 
-	jobmgr_setup_env_from_other_jobs(j->mgr);
-
-	SLIST_FOREACH(ei, &j->env, sle) {
-		setenv(ei->key, ei->value, 1);
-	}
-
 #if !TARGET_OS_EMBEDDED	
 	if (j->jetsam_properties) {
 		(void)job_assumes_zero(j, proc_setpcontrol(PROC_SETPC_TERMINATE));
@@ -5255,45 +6115,16 @@ job_setup_fd(job_t j, int target_fd, const char *path, int flags)
 void
 calendarinterval_setalarm(job_t j, struct calendarinterval *ci)
 {
-	struct calendarinterval *ci_iter, *ci_prev = NULL;
-	time_t later, head_later;
-
-	later = cronemu(ci->when.tm_mon, ci->when.tm_mday, ci->when.tm_hour, ci->when.tm_min);
+	time_t later = calendar_next(&ci->when, time(NULL));
 
-	if (ci->when.tm_wday != -1) {
-		time_t otherlater = cronemu_wday(ci->when.tm_wday, ci->when.tm_hour, ci->when.tm_min);
-
-		if (ci->when.tm_mday == -1) {
-			later = otherlater;
-		} else {
-			later = later < otherlater ? later : otherlater;
-		}
+	if (unlikely(later == -1)) {
+		job_log(j, LOG_WARNING, "Calendar interval never matches a real date.");
+		return;
 	}
 
 	ci->when_next = later;
 
-	LIST_FOREACH(ci_iter, &sorted_calendar_events, global_sle) {
-		if (ci->when_next < ci_iter->when_next) {
-			LIST_INSERT_BEFORE(ci_iter, ci, global_sle);
-			break;
-		}
-
-		ci_prev = ci_iter;
-	}
-
-	if (ci_iter == NULL) {
-		// ci must want to fire after every other timer, or there are no timers
-
-		if (LIST_EMPTY(&sorted_calendar_events)) {
-			LIST_INSERT_HEAD(&sorted_calendar_events, ci, global_sle);
-		} else {
-			LIST_INSERT_AFTER(ci_prev, ci, global_sle);
-		}
-	}
-
-	head_later = LIST_FIRST(&sorted_calendar_events)->when_next;
-
-	if (job_assumes_zero_p(j, kevent_mod((uintptr_t)&sorted_calendar_events, EVFILT_TIMER, EV_ADD, NOTE_ABSOLUTE|NOTE_SECONDS, head_later, root_jobmgr)) != -1) {
+	if (job_assumes_zero_p(j, kevent_mod((uintptr_t)ci, EVFILT_TIMER, EV_ADD|EV_ONESHOT, NOTE_ABSOLUTE|NOTE_SECONDS, later, j)) != -1) {
 		char time_string[100];
 		size_t time_string_len;
 
@@ -5505,6 +6336,10 @@ job_logv(job_t j, int pri, int err, const char *msg, va_list ap)
 		return _vproc_logv(pri, err, msg, ap);
 	}
 
+	if (!launchd_syslog_enabled(pri)) {
+		return;
+	}
+
 	newmsgsz = strlen(msg) + 200;
 	newmsg = alloca(newmsgsz);
 
@@ -5626,6 +6461,10 @@ jobmgr_logv(jobmgr_t jm, int pri, int err, const char *msg, va_list ap)
 		jm = root_jobmgr;
 	}
 
+	if (!launchd_syslog_enabled(pri)) {
+		return;
+	}
+
 	char *newmsg;
 	char *newname;
 	size_t i, o, jmname_len = strlen(jm->name), newmsgsz;
@@ -5668,63 +6507,60 @@ jobmgr_logv(jobmgr_t jm, int pri, int err, const char *msg, va_list ap)
 
 struct cal_dict_walk {
 	job_t j;
-	struct tm tmptm;
+	struct calendar_spec spec;
+	bool bad;
 };
 
 void
 calendarinterval_new_from_obj_dict_walk(launch_data_t obj, const char *key, void *context)
 {
 	struct cal_dict_walk *cdw = context;
-	struct tm *tmptm = &cdw->tmptm;
 	job_t j = cdw->j;
+	int field;
 	int64_t val;
 
-	if (unlikely(LAUNCH_DATA_INTEGER != launch_data_get_type(obj))) {
-		// hack to let caller know something went wrong
-		tmptm->tm_sec = -1;
+	switch (jobkey_cal_lookup(key)) {
+	case JOBKEY_CAL_MINUTE:
+		field = CALENDAR_MINUTE;
+		break;
+	case JOBKEY_CAL_HOUR:
+		field = CALENDAR_HOUR;
+		break;
+	case JOBKEY_CAL_DAY:
+		field = CALENDAR_MDAY;
+		break;
+	case JOBKEY_CAL_WEEKDAY:
+		field = CALENDAR_WDAY;
+		break;
+	case JOBKEY_CAL_MONTH:
+		field = CALENDAR_MONTH;
+		break;
+	default:
 		return;
 	}
 
-	val = launch_data_get_integer(obj);
-
-	if (val < 0) {
-		job_log(j, LOG_WARNING, "The interval for key \"%s\" is less than zero.", key);
-	} else if (strcasecmp(key, LAUNCH_JOBKEY_CAL_MINUTE) == 0) {
-		if (val > 59) {
-			job_log(j, LOG_WARNING, "The interval for key \"%s\" is not between 0 and 59 (inclusive).", key);
-			tmptm->tm_sec = -1;
-		} else {
-			tmptm->tm_min = (typeof(tmptm->tm_min)) val;
-		}
-	} else if (strcasecmp(key, LAUNCH_JOBKEY_CAL_HOUR) == 0) {
-		if (val > 23) {
-			job_log(j, LOG_WARNING, "The interval for key \"%s\" is not between 0 and 23 (inclusive).", key);
-			tmptm->tm_sec = -1;
-		} else {
-			tmptm->tm_hour = (typeof(tmptm->tm_hour)) val;
-		}
-	} else if (strcasecmp(key, LAUNCH_JOBKEY_CAL_DAY) == 0) {
-		if (val < 1 || val > 31) {
-			job_log(j, LOG_WARNING, "The interval for key \"%s\" is not between 1 and 31 (inclusive).", key);
-			tmptm->tm_sec = -1;
-		} else {
-			tmptm->tm_mday = (typeof(tmptm->tm_mday)) val;
+	switch (launch_data_get_type(obj)) {
+	case LAUNCH_DATA_INTEGER:
+		val = launch_data_get_integer(obj);
+		// Month 0 has always meant "every month".
+		if (field == CALENDAR_MONTH && val == 0) {
+			return;
 		}
-	} else if (strcasecmp(key, LAUNCH_JOBKEY_CAL_WEEKDAY) == 0) {
-		if (val > 7) {
-			job_log(j, LOG_WARNING, "The interval for key \"%s\" is not between 0 and 7 (inclusive).", key);
-			tmptm->tm_sec = -1;
-		} else {
-			tmptm->tm_wday = (typeof(tmptm->tm_wday)) val;
+		if (val < 0 || val > 63 || calendar_spec_add(&cdw->spec, field, (int)val, (int)val, 1) == -1) {
+			job_log(j, LOG_WARNING, "The interval for key \"%s\" is out of range: %lld", key, (long long)val);
+			cdw->bad = true;
 		}
-	} else if (strcasecmp(key, LAUNCH_JOBKEY_CAL_MONTH) == 0) {
-		if (val > 12) {
-			job_log(j, LOG_WARNING, "The interval for key \"%s\" is not between 0 and 12 (inclusive).", key);
-			tmptm->tm_sec = -1;
-		} else {
-			tmptm->tm_mon = (typeof(tmptm->tm_mon)) val;
-			tmptm->tm_mon -= 1; // 4798263 cron compatibility
+		break;
+	case LAUNCH_DATA_STRING:
+		// Cron syntax: lists, ranges and steps.
+		if (calendar_spec_parse(&cdw->spec, field, launch_data_get_string(obj)) == -1) {
+			job_log(j, LOG_WARNING, "The interval for key \"%s\" is not valid: %s", key, launch_data_get_string(obj));
+			cdw->bad = true;
 		}
+		break;
+	default:
+		cdw->bad = true;
+		break;
 	}
 }
 
@@ -5734,13 +6570,8 @@ calendarinterval_new_from_obj(job_t j, launch_data_t obj)
 	struct cal_dict_walk cdw;
 
 	cdw.j = j;
-	memset(&cdw.tmptm, 0, sizeof(0));
-
-	cdw.tmptm.tm_min = -1;
-	cdw.tmptm.tm_hour = -1;
-	cdw.tmptm.tm_mday = -1;
-	cdw.tmptm.tm_wday = -1;
-	cdw.tmptm.tm_mon = -1;
+	cdw.bad = false;
+	calendar_spec_init(&cdw.spec);
 
 	if (!job_assumes(j, obj != NULL)) {
 		return false;
@@ -5752,15 +6583,15 @@ calendarinterval_new_from_obj(job_t j, launch_data_t obj)
 
 	launch_data_dict_iterate(obj, calendarinterval_new_from_obj_dict_walk, &cdw);
 
-	if (unlikely(cdw.tmptm.tm_sec == -1)) {
+	if (unlikely(cdw.bad)) {
 		return false;
 	}
 
-	return calendarinterval_new(j, &cdw.tmptm);
+	return calendarinterval_new(j, &cdw.spec);
 }
 
 bool
-calendarinterval_new(job_t j, struct tm *w)
+calendarinterval_new(job_t j, struct calendar_spec *w)
 {
 	struct calendarinterval *ci = calloc(1, sizeof(struct calendarinterval));
 
@@ -5784,7 +6615,7 @@ void
 calendarinterval_delete(job_t j, struct calendarinterval *ci)
 {
 	SLIST_REMOVE(&j->cal_intervals, ci, calendarinterval, sle);
-	LIST_REMOVE(ci, global_sle);
+	(void)kevent_mod((uintptr_t)ci, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
 
 	free(ci);
 
@@ -5794,33 +6625,37 @@ calendarinterval_delete(job_t j, struct calendarinterval *ci)
 void
 calendarinterval_sanity_check(void)
 {
-	struct calendarinterval *ci = LIST_FIRST(&sorted_calendar_events);
-	time_t now = time(NULL);
-
-	if (unlikely(ci && (ci->when_next < now))) {
+	/* The kernel timer behind the timer queue is relative, so a wall clock
+	 * that was stepped forward leaves calendar deadlines overdue until we
+	 * look.
+	 */
+	if (unlikely(runtime_timers_overdue())) {
 		(void)jobmgr_assumes_zero_p(root_jobmgr, raise(SIGUSR1));
 	}
 }
 
-void
-calendarinterval_callback(void)
+bool
+calendarinterval_callback(job_t j, void *ident)
 {
-	struct calendarinterval *ci, *ci_next;
-	time_t now = time(NULL);
-
-	LIST_FOREACH_SAFE(ci, &sorted_calendar_events, global_sle, ci_next) {
-		job_t j = ci->job;
+	struct calendarinterval *ci;
 
-		if (ci->when_next > now) {
+	SLIST_FOREACH(ci, &j->cal_intervals, sle) {
+		if ((void *)ci == ident) {
 			break;
 		}
+	}
 
-		LIST_REMOVE(ci, global_sle);
-		calendarinterval_setalarm(j, ci);
-
-		j->start_pending = true;
-		job_dispatch(j, false);
+	if (!ci) {
+		return false;
 	}
+
+	job_log(j, LOG_DEBUG, "Calendar interval fired (%p)", ident);
+	calendarinterval_setalarm(j, ci);
+
+	j->start_pending = true;
+	job_dispatch(j, false);
+
+	return true;
 }
 
 bool
@@ -5844,6 +6679,7 @@ socketgroup_new(job_t j, const char *name, int *fds, size_t fd_cnt)
 	strcpy(sg->name_init, name);
 
 	SLIST_INSERT_HEAD(&j->sockets, sg, sle);
+	job_changed(j);
 
 	runtime_add_weak_ref();
 
@@ -5872,6 +6708,7 @@ socketgroup_delete(job_t j, struct socketgroup *sg)
 	}
 
 	SLIST_REMOVE(&j->sockets, sg, socketgroup, sle);
+	job_changed(j);
 
 	free(sg->fds);
 	free(sg);
@@ -5945,8 +6782,10 @@ envitem_new(job_t j, const char *k, const char *v, bool global)
 			LIST_INSERT_HEAD(&j->mgr->global_env_jobs, j, global_env_sle);
 		}
 		SLIST_INSERT_HEAD(&j->global_env, ei, sle);
+		jobmgr_env_changed();
 	} else {
 		SLIST_INSERT_HEAD(&j->env, ei, sle);
+		j->exec_env_gen = 0;
 	}
 
 	job_log(j, LOG_DEBUG, "Added environmental variable: %s=%s", k, v);
@@ -5962,8 +6801,10 @@ envitem_delete(job_t j, struct envitem *ei, bool global)
 		if (SLIST_EMPTY(&j->global_env)) {
 			LIST_REMOVE(j, global_env_sle);
 		}
+		jobmgr_env_changed();
 	} else {
 		SLIST_REMOVE(&j->env, ei, envitem, sle);
+		j->exec_env_gen = 0;
 	}
 
 	free(ei);
@@ -6042,7 +6883,7 @@ seatbelt_setup_flags(launch_data_t obj, const char *key, void *context)
 		return;
 	}
 
-	if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOX_NAMED) == 0) {
+	if (jobkey_sandbox_lookup(key) == JOBKEY_SANDBOX_NAMED) {
 		j->seatbelt_flags |= SANDBOX_NAMED;
 	}
 }
@@ -6052,7 +6893,7 @@ void
 limititem_setup(launch_data_t obj, const char *key, void *context)
 {
 	job_t j = context;
-	size_t i, limits_cnt = (sizeof(launchd_keys2limits) / sizeof(launchd_keys2limits[0]));
+	int resource;
 	rlim_t rl;
 
 	if (launch_data_get_type(obj) != LAUNCH_DATA_INTEGER) {
@@ -6061,17 +6902,39 @@ limititem_setup(launch_data_t obj, const char *key, void *context)
 
 	rl = launch_data_get_integer(obj);
 
-	for (i = 0; i < limits_cnt; i++) {
-		if (strcasecmp(launchd_keys2limits[i].key, key) == 0) {
-			break;
-		}
-	}
-
-	if (i == limits_cnt) {
+	switch (jobkey_resourcelimit_lookup(key)) {
+	case JOBKEY_RESOURCELIMIT_CORE:
+		resource = RLIMIT_CORE;
+		break;
+	case JOBKEY_RESOURCELIMIT_CPU:
+		resource = RLIMIT_CPU;
+		break;
+	case JOBKEY_RESOURCELIMIT_DATA:
+		resource = RLIMIT_DATA;
+		break;
+	case JOBKEY_RESOURCELIMIT_FSIZE:
+		resource = RLIMIT_FSIZE;
+		break;
+	case JOBKEY_RESOURCELIMIT_MEMLOCK:
+		resource = RLIMIT_MEMLOCK;
+		break;
+	case JOBKEY_RESOURCELIMIT_NOFILE:
+		resource = RLIMIT_NOFILE;
+		break;
+	case JOBKEY_RESOURCELIMIT_NPROC:
+		resource = RLIMIT_NPROC;
+		break;
+	case JOBKEY_RESOURCELIMIT_RSS:
+		resource = RLIMIT_RSS;
+		break;
+	case JOBKEY_RESOURCELIMIT_STACK:
+		resource = RLIMIT_STACK;
+		break;
+	default:
 		return;
 	}
 
-	limititem_update(j, launchd_keys2limits[i].val, rl);
+	limititem_update(j, resource, rl);
 }
 
 bool
@@ -6290,14 +7153,14 @@ machservice_ignore(job_t j, struct machservice *ms)
 void
 machservice_resetport(job_t j, struct machservice *ms)
 {
-	LIST_REMOVE(ms, port_hash_sle);
+	hashtab_remove(&ms->port_hash_node);
 	(void)job_assumes_zero(j, launchd_mport_close_recv(ms->port));
 	(void)job_assumes_zero(j, launchd_mport_deallocate(ms->port));
 
 	ms->gen_num++;
 	(void)job_assumes_zero(j, launchd_mport_create_recv(&ms->port));
 	(void)job_assumes_zero(j, launchd_mport_make_send(ms->port));
-	LIST_INSERT_HEAD(&port_hash[HASH_PORT(ms->port)], ms, port_hash_sle);
+	hashtab_insert(&port_hash, &ms->port_hash_node, hash_port(ms->port));
 }
 
 void
@@ -6378,15 +7241,16 @@ machservice_new(job_t j, const char *name, mach_port_t *serviceport, bool pid_lo
 	 * uniquify the names ourselves to avoid collisions. This is just easier.
 	 */
 	if (!j->dedicated_instance) {
-		LIST_INSERT_HEAD(&where2put->ms_hash[hash_ms(ms->name)], ms, name_hash_sle);	
+		hashtab_insert(&where2put->ms_hash, &ms->name_hash_node, hash_ms(ms->name));
 	}
-	LIST_INSERT_HEAD(&port_hash[HASH_PORT(ms->port)], ms, port_hash_sle);
+	hashtab_insert(&port_hash, &ms->port_hash_node, hash_port(ms->port));
 
 	if (ms->recv) {
 		machservice_stamp_port(j, ms);
 	}
 
 	job_log(j, LOG_DEBUG, "Mach service added%s: %s", (j->mgr->properties & BOOTSTRAP_PROPERTY_EXPLICITSUBSET) ? " to private namespace" : "", name);
+	job_changed(j);
 
 	return ms;
 out_bad2:
@@ -6405,7 +7269,7 @@ machservice_new_alias(job_t j, struct machservice *orig)
 		ms->alias = orig;
 		ms->job = j;
 
-		LIST_INSERT_HEAD(&j->mgr->ms_hash[hash_ms(ms->name)], ms, name_hash_sle);
+		hashtab_insert(&j->mgr->ms_hash, &ms->name_hash_node, hash_ms(ms->name));
 		SLIST_INSERT_HEAD(&j->machservices, ms, sle);
 		jobmgr_log(j->mgr, LOG_DEBUG, "Service aliased into job manager: %s", orig->name);
 	}
@@ -6488,6 +7352,7 @@ machservice_setup_options(launch_data_t obj, const char *key, void *context)
 {
 	struct machservice *ms = context;
 	mach_port_t mhp = mach_host_self();
+	jobkey_t mkey = jobkey_mach_lookup(key);
 	int which_port;
 	bool b;
 
@@ -6498,7 +7363,7 @@ machservice_setup_options(launch_data_t obj, const char *key, void *context)
 	switch (launch_data_get_type(obj)) {
 	case LAUNCH_DATA_INTEGER:
 		which_port = (int)launch_data_get_integer(obj); // XXX we should bound check this...
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACH_TASKSPECIALPORT) == 0) {
+		if (mkey == JOBKEY_MACH_TASKSPECIALPORT) {
 			switch (which_port) {
 			case TASK_KERNEL_PORT:
 			case TASK_HOST_PORT:
@@ -6515,30 +7380,39 @@ machservice_setup_options(launch_data_t obj, const char *key, void *context)
 				SLIST_INSERT_HEAD(&special_ports, ms, special_port_sle);
 				break;
 			}
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_MACH_HOSTSPECIALPORT) == 0 && pid1_magic) {
+		} else if (mkey == JOBKEY_MACH_HOSTSPECIALPORT && pid1_magic) {
 			if (which_port > HOST_MAX_SPECIAL_KERNEL_PORT) {
 				(void)job_assumes_zero(ms->job, (errno = host_set_special_port(mhp, which_port, ms->port)));
 			} else {
 				job_log(ms->job, LOG_WARNING, "Tried to set a reserved host special port: %d", which_port);
 			}
 		}
+		break;
 	case LAUNCH_DATA_BOOL:
 		b = launch_data_get_bool(obj);
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACH_ENTERKERNELDEBUGGERONCLOSE) == 0) {
+		switch (mkey) {
+		case JOBKEY_MACH_ENTERKERNELDEBUGGERONCLOSE:
 			ms->debug_on_close = b;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_MACH_RESETATCLOSE) == 0) {
+			break;
+		case JOBKEY_MACH_RESETATCLOSE:
 			ms->reset = b;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_MACH_HIDEUNTILCHECKIN) == 0) {
+			break;
+		case JOBKEY_MACH_HIDEUNTILCHECKIN:
 			ms->hide = b;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_MACH_EXCEPTIONSERVER) == 0) {
+			break;
+		case JOBKEY_MACH_EXCEPTIONSERVER:
 			job_set_exception_port(ms->job, ms->port);
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_MACH_KUNCSERVER) == 0) {
+			break;
+		case JOBKEY_MACH_KUNCSERVER:
 			ms->kUNCServer = b;
 			(void)job_assumes_zero(ms->job, host_set_UNDServer(mhp, ms->port));
+			break;
+		default:
+			break;
 		}
 		break;
 	case LAUNCH_DATA_STRING:
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACH_DRAINMESSAGESONCRASH) == 0) {
+		if (mkey == JOBKEY_MACH_DRAINMESSAGESONCRASH) {
 			const char *option = launch_data_get_string(obj);
 			if (strcasecmp(option, "One") == 0) {
 				ms->drain_one_on_crash = true;
@@ -6825,6 +7699,14 @@ job_uncork_fork(job_t j)
 	/* this unblocks the child and avoids a race
 	 * between the above fork() and the kevent_mod() */
 	(void)job_assumes(j, write(j->fork_fd, &c, sizeof(c)) == sizeof(c));
+
+	/* The child's end is close-on-exec, so EOF here is the exec. Where
+	 * there is no NOTE_EXEC to say so, that is what lands the start.
+	 */
+	if (j->start_in_flight && !j->start_awaits_checkin
+			&& kevent_mod((uintptr_t)j->fork_fd, EVFILT_READ, EV_ADD, 0, 0, j) != -1) {
+		return;
+	}
 	(void)job_assumes_zero_p(j, runtime_close(j->fork_fd));
 	j->fork_fd = 0;
 }
@@ -6900,6 +7782,8 @@ jobmgr_new(jobmgr_t jm, mach_port_t requestorport, mach_port_t transfer_port, bo
 		goto out_bad;
 	}
 
+	hashtab_insert(&jobmgr_ports, &jmr->jm_port_node, hash_port(jmr->jm_port));
+
 	if (!name) {
 		sprintf(jmr->name_init, "%u", MACH_PORT_INDEX(jmr->jm_port));
 	}
@@ -7082,7 +7966,8 @@ jobmgr_init_session(jobmgr_t jm, const char *session_type, bool sflag)
 jobmgr_t
 jobmgr_delete_anything_with_port(jobmgr_t jm, mach_port_t port)
 {
-	struct machservice *ms, *next_ms;
+	struct hashtab_node *hn, *next_hn;
+	struct machservice *ms;
 	jobmgr_t jmi, jmn;
 
 	/* Mach ports, unlike Unix descriptors, are reference counted. In other
@@ -7102,7 +7987,9 @@ jobmgr_delete_anything_with_port(jobmgr_t jm, mach_port_t port)
 			return jobmgr_shutdown(jm);
 		}
 
-		LIST_FOREACH_SAFE(ms, &port_hash[HASH_PORT(port)], port_hash_sle, next_ms) {
+		for (hn = hashtab_lookup(&port_hash, hash_port(port)); hn; hn = next_hn) {
+			next_hn = hashtab_next(hn);
+			ms = ms_from_port_node(hn);
 			if (ms->port == port && !ms->recv) {
 				machservice_delete(ms->job, ms, true);
 			}
@@ -7133,6 +8020,7 @@ jobmgr_delete_anything_with_port(jobmgr_t jm, mach_port_t port)
 struct machservice *
 jobmgr_lookup_service(jobmgr_t jm, const char *name, bool check_parent, pid_t target_pid)
 {
+	struct hashtab_node *hn;
 	struct machservice *ms;
 	job_t target_j;
 
@@ -7170,7 +8058,8 @@ jobmgr_lookup_service(jobmgr_t jm, const char *name, bool check_parent, pid_t ta
 		}
 	}
 
-	LIST_FOREACH(ms, &where2look->ms_hash[hash_ms(name)], name_hash_sle) {
+	for (hn = hashtab_lookup(&where2look->ms_hash, hash_ms(name)); hn; hn = hashtab_next(hn)) {
+		ms = ms_from_name_node(hn);
 		if (!ms->per_pid && strcmp(name, ms->name) == 0) {
 			return ms;
 		}
@@ -7268,7 +8157,7 @@ machservice_delete(job_t j, struct machservice *ms, bool port_died)
 		 * pretty simple affair since they can't and shouldn't have any complex
 		 * behaviors associated with them.
 		 */
-		LIST_REMOVE(ms, name_hash_sle);
+		hashtab_remove(&ms->name_hash_node);
 		SLIST_REMOVE(&j->machservices, ms, machservice, sle);
 		free(ms);
 		return;
@@ -7298,9 +8187,10 @@ machservice_delete(job_t j, struct machservice *ms, bool port_died)
 	SLIST_REMOVE(&j->machservices, ms, machservice, sle);
 
 	if (!(j->dedicated_instance || ms->event_channel)) {
-		LIST_REMOVE(ms, name_hash_sle);
+		hashtab_remove(&ms->name_hash_node);
 	}
-	LIST_REMOVE(ms, port_hash_sle);
+	hashtab_remove(&ms->port_hash_node);
+	job_changed(j);
 
 	free(ms);
 }
@@ -7378,6 +8268,7 @@ void
 job_checkin(job_t j)
 {
 	j->checkedin = true;
+	job_start_landed(j);
 }
 
 bool job_is_god(job_t j)
@@ -7388,13 +8279,16 @@ bool job_is_god(job_t j)
 bool
 job_ack_port_destruction(mach_port_t p)
 {
-	struct machservice *ms;
+	struct hashtab_node *hn;
+	struct machservice *ms = NULL;
 	job_t j;
 
-	LIST_FOREACH(ms, &port_hash[HASH_PORT(p)], port_hash_sle) {
+	for (hn = hashtab_lookup(&port_hash, hash_port(p)); hn; hn = hashtab_next(hn)) {
+		ms = ms_from_port_node(hn);
 		if (ms->recv && (ms->port == p)) {
 			break;
 		}
+		ms = NULL;
 	}
 
 	if (!ms) {
@@ -7463,6 +8357,7 @@ job_ack_no_senders(job_t j)
 	j->priv_port_has_senders = false;
 
 	(void)job_assumes_zero(j, launchd_mport_close_recv(j->j_port));
+	hashtab_remove(&j->j_port_node);
 	j->j_port = 0;
 
 	job_log(j, LOG_DEBUG, "No more senders on privileged Mach bootstrap port");
@@ -7566,33 +8461,42 @@ semaphoreitem_setup(launch_data_t obj, const char *key, void *context)
 
 	switch (launch_data_get_type(obj)) {
 	case LAUNCH_DATA_BOOL:
-		if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE_NETWORKSTATE) == 0) {
+		switch (jobkey_keepalive_lookup(key)) {
+		case JOBKEY_KEEPALIVE_NETWORKSTATE:
 			why = launch_data_get_bool(obj) ? NETWORK_UP : NETWORK_DOWN;
 			semaphoreitem_new(j, why, NULL);
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE_SUCCESSFULEXIT) == 0) {
+			break;
+		case JOBKEY_KEEPALIVE_SUCCESSFULEXIT:
 			why = launch_data_get_bool(obj) ? SUCCESSFUL_EXIT : FAILED_EXIT;
 			semaphoreitem_new(j, why, NULL);
 			j->start_pending = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE_AFTERINITIALDEMAND) == 0) {
+			break;
+		case JOBKEY_KEEPALIVE_AFTERINITIALDEMAND:
 			j->needs_kickoff = launch_data_get_bool(obj);
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE_CRASHED) == 0) {
+			break;
+		case JOBKEY_KEEPALIVE_CRASHED:
 			why = launch_data_get_bool(obj) ? CRASHED : DID_NOT_CRASH;
 			semaphoreitem_new(j, why, NULL);
 			j->start_pending = true;
-		} else {
+			break;
+		default:
 			job_log(j, LOG_ERR, "Unrecognized KeepAlive attribute: %s", key);
+			break;
 		}
 		break;
 	case LAUNCH_DATA_DICTIONARY:
-		if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE_OTHERJOBACTIVE) == 0) {
+		switch (jobkey_keepalive_lookup(key)) {
+		case JOBKEY_KEEPALIVE_OTHERJOBACTIVE:
 			sdic.why_true = OTHER_JOB_ACTIVE;
 			sdic.why_false = OTHER_JOB_INACTIVE;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE_OTHERJOBENABLED) == 0) {
+			break;
+		case JOBKEY_KEEPALIVE_OTHERJOBENABLED:
 			sdic.why_true = OTHER_JOB_ENABLED;
 			sdic.why_false = OTHER_JOB_DISABLED;
-		} else {
-			job_log(j, LOG_ERR, "Unrecognized KeepAlive attribute: %s", key);
 			break;
+		default:
+			job_log(j, LOG_ERR, "Unrecognized KeepAlive attribute: %s", key);
+			return;
 		}
 
 		launch_data_dict_iterate(obj, semaphoreitem_setup_dict_iter, &sdic);
@@ -7797,178 +8701,6 @@ jobmgr_dispatch_all_semaphores(jobmgr_t jm)
 	}
 }
 
-time_t
-cronemu(int mon, int mday, int hour, int min)
-{
-	struct tm workingtm;
-	time_t now;
-
-	now = time(NULL);
-	workingtm = *localtime(&now);
-
-	workingtm.tm_isdst = -1;
-	workingtm.tm_sec = 0;
-	workingtm.tm_min++;
-
-	while (!cronemu_mon(&workingtm, mon, mday, hour, min)) {
-		workingtm.tm_year++;
-		workingtm.tm_mon = 0;
-		workingtm.tm_mday = 1;
-		workingtm.tm_hour = 0;
-		workingtm.tm_min = 0;
-		mktime(&workingtm);
-	}
-
-	return mktime(&workingtm);
-}
-
-time_t
-cronemu_wday(int wday, int hour, int min)
-{
-	struct tm workingtm;
-	time_t now;
-
-	now = time(NULL);
-	workingtm = *localtime(&now);
-
-	workingtm.tm_isdst = -1;
-	workingtm.tm_sec = 0;
-	workingtm.tm_min++;
-
-	if (wday == 7) {
-		wday = 0;
-	}
-
-	while (!(workingtm.tm_wday == wday && cronemu_hour(&workingtm, hour, min))) {
-		workingtm.tm_mday++;
-		workingtm.tm_hour = 0;
-		workingtm.tm_min = 0;
-		mktime(&workingtm);
-	}
-
-	return mktime(&workingtm);
-}
-
-bool
-cronemu_mon(struct tm *wtm, int mon, int mday, int hour, int min)
-{
-	if (mon == -1) {
-		struct tm workingtm = *wtm;
-		int carrytest;
-
-		while (!cronemu_mday(&workingtm, mday, hour, min)) {
-			workingtm.tm_mon++;
-			workingtm.tm_mday = 1;
-			workingtm.tm_hour = 0;
-			workingtm.tm_min = 0;
-			carrytest = workingtm.tm_mon;
-			mktime(&workingtm);
-			if (carrytest != workingtm.tm_mon) {
-				return false;
-			}
-		}
-		*wtm = workingtm;
-		return true;
-	}
-
-	if (mon < wtm->tm_mon) {
-		return false;
-	}
-
-	if (mon > wtm->tm_mon) {
-		wtm->tm_mon = mon;
-		wtm->tm_mday = 1;
-		wtm->tm_hour = 0;
-		wtm->tm_min = 0;
-	}
-
-	return cronemu_mday(wtm, mday, hour, min);
-}
-
-bool
-cronemu_mday(struct tm *wtm, int mday, int hour, int min)
-{
-	if (mday == -1) {
-		struct tm workingtm = *wtm;
-		int carrytest;
-
-		while (!cronemu_hour(&workingtm, hour, min)) {
-			workingtm.tm_mday++;
-			workingtm.tm_hour = 0;
-			workingtm.tm_min = 0;
-			carrytest = workingtm.tm_mday;
-			mktime(&workingtm);
-			if (carrytest != workingtm.tm_mday) {
-				return false;
-			}
-		}
-		*wtm = workingtm;
-		return true;
-	}
-
-	if (mday < wtm->tm_mday) {
-		return false;
-	}
-
-	if (mday > wtm->tm_mday) {
-		wtm->tm_mday = mday;
-		wtm->tm_hour = 0;
-		wtm->tm_min = 0;
-	}
-
-	return cronemu_hour(wtm, hour, min);
-}
-
-bool
-cronemu_hour(struct tm *wtm, int hour, int min)
-{
-	if (hour == -1) {
-		struct tm workingtm = *wtm;
-		int carrytest;
-
-		while (!cronemu_min(&workingtm, min)) {
-			workingtm.tm_hour++;
-			workingtm.tm_min = 0;
-			carrytest = workingtm.tm_hour;
-			mktime(&workingtm);
-			if (carrytest != workingtm.tm_hour) {
-				return false;
-			}
-		}
-		*wtm = workingtm;
-		return true;
-	}
-
-	if (hour < wtm->tm_hour) {
-		return false;
-	}
-
-	if (hour > wtm->tm_hour) {
-		wtm->tm_hour = hour;
-		wtm->tm_min = 0;
-	}
-
-	return cronemu_min(wtm, min);
-}
-
-bool
-cronemu_min(struct tm *wtm, int min)
-{
-	if (min == -1) {
-		return true;
-	}
-
-	if (min < wtm->tm_min) {
-		return false;
-	}
-
-	if (min > wtm->tm_min) {
-		wtm->tm_min = min;
-	}
-
-	return true;
-}
-
 kern_return_t
 job_mig_create_server(job_t j, cmd_t server_cmd, uid_t server_uid, boolean_t on_demand, mach_port_t *server_portp)
 {
@@ -8341,6 +9073,7 @@ job_mig_swap_integer(job_t j, vproc_gsk_t inkey, vproc_gsk_t outkey, int64_t inv
 		break;
 	case VPROC_GSK_BASIC_KEEPALIVE:
 		j->ondemand = !inval;
+		job_changed(j);
 		break;
 	case VPROC_GSK_START_INTERVAL:
 		if (inval > UINT32_MAX || inval < 0) {
@@ -8364,6 +9097,7 @@ job_mig_swap_integer(job_t j, vproc_gsk_t inkey, vproc_gsk_t outkey, int64_t inv
 			kr = 1;
 		} else {
 			j->timeout = (typeof(j->timeout)) inval;
+			job_changed(j);
 		}
 		break;
 	case VPROC_GSK_EXIT_TIMEOUT:
@@ -9252,12 +9986,11 @@ job_mig_info(job_t j, name_array_t *servicenamesp,
 		jm = j->mgr;
 	}
 
-	unsigned int i = 0;
+	struct hashtab_node *hn = NULL;
 	struct machservice *msi = NULL;
-	for (i = 0; i < MACHSERVICE_HASH_SIZE; i++) {
-		LIST_FOREACH(msi, &jm->ms_hash[i], name_hash_sle) {
-			cnt += !msi->per_pid ? 1 : 0;
-		}
+	HASHTAB_FOREACH(hn, &jm->ms_hash) {
+		msi = ms_from_name_node(hn);
+		cnt += !msi->per_pid ? 1 : 0;
 	}
 
 	if (cnt == 0) {
@@ -9279,19 +10012,18 @@ job_mig_info(job_t j, name_array_t *servicenamesp,
 		goto out_bad;
 	}
 
-	for (i = 0; i < MACHSERVICE_HASH_SIZE; i++) {
-		LIST_FOREACH(msi, &jm->ms_hash[i], name_hash_sle) {
-			if (!msi->per_pid) {
-				strlcpy(service_names[cnt2], machservice_name(msi), sizeof(service_names[0]));
-				msi = msi->alias ? msi->alias : msi;
-				if (msi->job->mgr->shortdesc) {
-					strlcpy(service_jobs[cnt2], msi->job->mgr->shortdesc, sizeof(service_jobs[0]));
-				} else {
-					strlcpy(service_jobs[cnt2], msi->job->label, sizeof(service_jobs[0]));
-				}
-				service_actives[cnt2] = machservice_status(msi);
-				cnt2++;
+	HASHTAB_FOREACH(hn, &jm->ms_hash) {
+		msi = ms_from_name_node(hn);
+		if (!msi->per_pid) {
+			strlcpy(service_names[cnt2], machservice_name(msi), sizeof(service_names[0]));
+			msi = msi->alias ? msi->alias : msi;
+			if (msi->job->mgr->shortdesc) {
+				strlcpy(service_jobs[cnt2], msi->job->mgr->shortdesc, sizeof(service_jobs[0]));
+			} else {
+				strlcpy(service_jobs[cnt2], msi->job->label, sizeof(service_jobs[0]));
 			}
+			service_actives[cnt2] = machservice_status(msi);
+			cnt2++;
 		}
 	}
 
@@ -9653,11 +10385,11 @@ job_mig_move_subset(job_t j, mach_port_t target_subset, name_t session_type, mac
 		// This is so awful.
 		// Remove the job from its current job manager.
 		LIST_REMOVE(j, sle);
-		LIST_REMOVE(j, pid_hash_sle);
+		hashtab_remove(&j->pid_hash_node);
 
 		// Put the job into the target job manager.
 		LIST_INSERT_HEAD(&jmr->jobs, j, sle);
-		LIST_INSERT_HEAD(&jmr->active_jobs[ACTIVE_JOB_HASH(j->p)], j, pid_hash_sle);
+		hashtab_insert(&jmr->active_jobs, &j->pid_hash_node, hash_pid(j->p));
 
 		j->mgr = jmr;
 		job_set_global_on_demand(j, true);
@@ -9827,7 +10559,7 @@ job_mig_switch_to_session(job_t j, mach_port_t requestor_port, name_t session_na
 
 	// Remove the job from it's current job manager.
 	LIST_REMOVE(j, sle);
-	LIST_REMOVE(j, pid_hash_sle);
+	hashtab_remove(&j->pid_hash_node);
 
 	job_t ji = NULL, jit = NULL;
 	LIST_FOREACH_SAFE(ji, &j->mgr->global_env_jobs, global_env_sle, jit) {
@@ -9839,21 +10571,27 @@ job_mig_switch_to_session(job_t j, mach_port_t requestor_port, name_t session_na
 
 	// Put the job into the target job manager.
 	LIST_INSERT_HEAD(&target_jm->jobs, j, sle);
-	LIST_INSERT_HEAD(&target_jm->active_jobs[ACTIVE_JOB_HASH(j->p)], j, pid_hash_sle);
+	hashtab_insert(&target_jm->active_jobs, &j->pid_hash_node, hash_pid(j->p));
 
 	if (ji) {
 		LIST_INSERT_HEAD(&target_jm->global_env_jobs, j, global_env_sle);
+		jobmgr_env_changed();
 	}
 
 	// Move our Mach services over if we're not in a flat namespace.
 	if (!launchd_flat_mach_namespace && !SLIST_EMPTY(&j->machservices)) {
 		struct machservice *msi = NULL, *msit = NULL;
 		SLIST_FOREACH_SAFE(msi, &j->machservices, sle, msit) {
-			LIST_REMOVE(msi, name_hash_sle);
-			LIST_INSERT_HEAD(&target_jm->ms_hash[hash_ms(msi->name)], msi, name_hash_sle);
+			hashtab_remove(&msi->name_hash_node);
+			hashtab_insert(&target_jm->ms_hash, &msi->name_hash_node, hash_ms(msi->name));
 		}
 	}
 
+	if (j->start_in_flight) {
+		j->mgr->starts_in_flight--;
+		target_jm->starts_in_flight++;
+	}
+
 	j->mgr = target_jm;
 
 	if (!j->holds_ref) {
@@ -9991,6 +10729,7 @@ job_mig_take_subset(job_t j, mach_port_t *reqport, mach_port_t *rcvright,
 	*rcvright = jm->jm_port;
 
 	jm->req_port = 0;
+	hashtab_remove(&jm->jm_port_node);
 	jm->jm_port = 0;
 
 	workaround_5477111 = j;
@@ -10515,7 +11254,7 @@ xpc_event_find_channel(job_t j, const char *stream, struct machservice **ms)
 		 * bootstrap_look_up().
 		 */
 		if (!j->dedicated_instance) {
-			LIST_REMOVE(msi, name_hash_sle);
+			hashtab_remove(&msi->name_hash_node);
 		}
 		msi->event_channel = true;
 
@@ -11766,8 +12505,15 @@ void
 jobmgr_init(bool sflag)
 {
 	const char *root_session_type = pid1_magic ? VPROCMGR_SESSION_SYSTEM : VPROCMGR_SESSION_BACKGROUND;
+	size_t i;
+
 	SLIST_INIT(&s_curious_jobs);
 	LIST_INIT(&s_needing_sessions);
+	for (i = 0; i < LAUNCHD_START_PRIORITIES; i++) {
+		TAILQ_INIT(&s_admission_queues[i]);
+	}
+	TAILQ_INIT(&s_jobs_by_generation);
+	jobgen_init(&s_jobgen, (uint64_t)runtime_get_wall_time());
 
 	os_assert((root_jobmgr = jobmgr_new(NULL, MACH_PORT_NULL, MACH_PORT_NULL, sflag, root_session_type, false, MACH_PORT_NULL)) != NULL);
 	os_assert((_s_xpc_system_domain = jobmgr_new_xpc_singleton_domain(root_jobmgr, "com.apple.xpc.system")) != NULL);
@@ -11788,32 +12534,28 @@ jobmgr_init(bool sflag)
 	s_no_hang_fd = _fd(s_no_hang_fd);
 }
 
-size_t
-our_strhash(const char *s)
+uint32_t
+hash_label(const char *label)
 {
-	size_t c, r = 5381;
-
-	/* djb2
-	 * This algorithm was first reported by Dan Bernstein many years ago in comp.lang.c
-	 */
-
-	while ((c = *s++)) {
-		r = ((r << 5) + r) + c; // hash*33 + c
-	}
+	return hashtab_hash_string(label);
+}
 
-	return r;
+uint32_t
+hash_ms(const char *msstr)
+{
+	return hashtab_hash_string(msstr);
 }
 
-size_t
-hash_label(const char *label)
+uint32_t
+hash_pid(pid_t p)
 {
-	return our_strhash(label) % LABEL_HASH_SIZE;
+	return hashtab_hash_int((uint64_t)p);
 }
 
-size_t
-hash_ms(const char *msstr)
+uint32_t
+hash_port(mach_port_t p)
 {
-	return our_strhash(msstr) % MACHSERVICE_HASH_SIZE;
+	return hashtab_hash_int(MACH_PORT_INDEX(p));
 }
 
 bool
@@ -40,8 +40,14 @@ jobmgr_t jobmgr_shutdown(jobmgr_t jm);
 void jobmgr_dispatch_all_semaphores(jobmgr_t jm);
 void jobmgr_dispatch_all_interested(jobmgr_t jm, job_t j);
 jobmgr_t jobmgr_delete_anything_with_port(jobmgr_t jm, mach_port_t port);
+void jobmgr_env_changed(void); /* after launchd's own environment changes */
 
 launch_data_t job_export_all(void);
+launch_data_t job_export_since(uint64_t since); /* replies to GetJobsSince */
+void job_publish_status_all(void);
+launch_data_t jobmgr_export_hash_stats(void);
+launch_data_t jobmgr_export_spawn_stats(void);
+launch_data_t jobmgr_set_spawn_limits(launch_data_t limits); /* replies with the new stats */
 
 job_t job_dispatch(job_t j, bool kickstart); /* returns j on success, NULL on job removal */
 job_t job_find(jobmgr_t jm, const char *label);
@@ -54,7 +60,7 @@ void job_checkin(job_t j);
 void job_remove(job_t j);
 bool job_is_god(job_t j);
 job_t job_import(launch_data_t pload);
-launch_data_t job_import_bulk(launch_data_t pload);
+launch_data_t job_import_bulk(launch_data_t pload, bool atomic);
 job_t job_mig_intran(mach_port_t mp);
 void job_mig_destructor(job_t j);
 void job_ack_no_senders(job_t j);
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * launchd is written against kqueue(2). On systems that have it, this header
+ * simply pulls in <sys/event.h>. On Linux it declares the subset of the
+ * kqueue interface launchd relies on, implemented on top of epoll, signalfd,
+ * timerfd and pidfd in evloop_epoll.c.
+ *
+ * The udata convention is unchanged: every registered udata must point at a
+ * kq_callback, and x_handle_kqueue() calls through it.
+ */
+
+#ifndef __LAUNCHD_EVLOOP_H__
+#define __LAUNCHD_EVLOOP_H__
+
+#ifndef __linux__
+#include <sys/event.h>
+#else
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Filter and flag values follow Darwin's <sys/event.h>. */
+#define EVFILT_READ		(-1)
+#define EVFILT_WRITE		(-2)
+#define EVFILT_AIO		(-3)
+#define EVFILT_VNODE		(-4)
+#define EVFILT_PROC		(-5)
+#define EVFILT_SIGNAL		(-6)
+#define EVFILT_TIMER		(-7)
+#define EVFILT_MACHPORT		(-8)
+#define EVFILT_FS		(-9)
+
+#define EV_ADD		0x0001
+#define EV_DELETE	0x0002
+#define EV_ENABLE	0x0004
+#define EV_DISABLE	0x0008
+#define EV_ONESHOT	0x0010
+#define EV_CLEAR	0x0020
+#define EV_RECEIPT	0x0040
+#define EV_DISPATCH	0x0080
+#define EV_ERROR	0x4000
+#define EV_EOF		0x8000
+
+/* EVFILT_PROC */
+#define NOTE_EXIT	0x80000000
+#define NOTE_FORK	0x40000000
+#define NOTE_EXEC	0x20000000
+#define NOTE_REAP	0x10000000
+#define NOTE_SIGNAL	0x08000000
+#define NOTE_EXITSTATUS	0x04000000
+#define NOTE_TRACK	0x00000001
+#define NOTE_TRACKERR	0x00000002
+#define NOTE_CHILD	0x00000004
+
+/* EVFILT_TIMER; milliseconds if no unit is given */
+#define NOTE_SECONDS	0x00000001
+#define NOTE_USECONDS	0x00000002
+#define NOTE_NSECONDS	0x00000004
+#define NOTE_ABSOLUTE	0x00000008
+
+/* EVFILT_VNODE */
+#define NOTE_DELETE	0x00000001
+#define NOTE_WRITE	0x00000002
+#define NOTE_EXTEND	0x00000004
+#define NOTE_ATTRIB	0x00000008
+#define NOTE_LINK	0x00000010
+#define NOTE_RENAME	0x00000020
+#define NOTE_REVOKE	0x00000040
+
+/* EVFILT_FS, normally from <sys/mount.h> */
+#ifndef VQ_MOUNT
+#define VQ_NOTRESP	0x0001
+#define VQ_NEEDAUTH	0x0002
+#define VQ_LOWDISK	0x0004
+#define VQ_MOUNT	0x0008
+#define VQ_UNMOUNT	0x0010
+#define VQ_DEAD		0x0020
+#define VQ_ASSIST	0x0040
+#define VQ_NOTRESPLOCK	0x0080
+#define VQ_UPDATE	0x0100
+#endif
+
+struct kevent {
+	uintptr_t ident;
+	short filter;
+	unsigned short flags;
+	unsigned int fflags;
+	intptr_t data;
+	void *udata;
+};
+
+#define EV_SET(kevp, a, b, c, d, e, f) do {	\
+	struct kevent *__kevp__ = (kevp);	\
+	__kevp__->ident = (a);			\
+	__kevp__->filter = (b);			\
+	__kevp__->flags = (c);			\
+	__kevp__->fflags = (d);			\
+	__kevp__->data = (e);			\
+	__kevp__->udata = (f);			\
+} while (0)
+
+/* Only EVFILT_READ, EVFILT_WRITE, EVFILT_TIMER, EVFILT_PROC (NOTE_EXIT) and
+ * EVFILT_SIGNAL are supported; anything else is refused with ENOTSUP.
+ */
+int kqueue(void);
+int kevent(int kq, const struct kevent *changelist, int nchanges,
+	struct kevent *eventlist, int nevents, const struct timespec *timeout);
+
+#endif /* __linux__ */
+
+#endif /* __LAUNCHD_EVLOOP_H__ */
@@ -0,0 +1,603 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * kqueue(2)/kevent(2) for Linux, built on epoll.
+ *
+ * Every registration is a knote keyed by (ident, filter). Knotes are backed
+ * by an evl_source, which is what actually sits in the epoll set:
+ *
+ *   EVFILT_READ/WRITE	the descriptor itself, shared by its read and write
+ *			knotes so both interests live in one epoll entry
+ *   EVFILT_TIMER	a timerfd per timer
+ *   EVFILT_PROC	a pidfd per process; only NOTE_EXIT is reported
+ *   EVFILT_SIGNAL	one signalfd for every registered signal
+ *
+ * launchd only ever has one kqueue, so the state is global and a second
+ * kqueue() fails with EMFILE.
+ */
+
+#ifdef __linux__
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evloop.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+#ifndef W_EXITCODE
+#define W_EXITCODE(ret, sig) ((ret) << 8 | (sig))
+#endif
+#ifndef WCOREFLAG
+#define WCOREFLAG 0x80
+#endif
+
+#define EVL_HASH_SIZE 256
+#define EVL_EPOLL_MAX 64
+
+enum {
+	EVL_SOURCE_FD,
+	EVL_SOURCE_TIMER,
+	EVL_SOURCE_PROC,
+	EVL_SOURCE_SIGNAL,
+};
+
+struct knote;
+
+struct evl_source {
+	int type;
+	int fd;
+	uint32_t events;
+	struct knote *rd;
+	struct knote *wr;
+	struct knote *kn;
+};
+
+struct knote {
+	LIST_ENTRY(knote) kn_sle;
+	struct kevent kn_kev;
+	struct evl_source *kn_src;
+	uint64_t kn_sigcnt;
+	bool kn_disabled;
+};
+
+static int evl_epfd = -1;
+static LIST_HEAD(, knote) evl_hash[EVL_HASH_SIZE];
+static struct evl_source evl_sigsrc = { EVL_SOURCE_SIGNAL, -1, 0, NULL, NULL, NULL };
+static struct knote *evl_signals[_NSIG];
+static sigset_t evl_sigmask;
+static bool evl_sig_backlog;
+
+static inline size_t
+evl_hash_slot(uintptr_t ident, short filter)
+{
+	return (ident * 31 + (unsigned short)filter) & (EVL_HASH_SIZE - 1);
+}
+
+static struct knote *
+evl_knote_find(uintptr_t ident, short filter)
+{
+	struct knote *kn;
+
+	LIST_FOREACH(kn, &evl_hash[evl_hash_slot(ident, filter)], kn_sle) {
+		if (kn->kn_kev.ident == ident && kn->kn_kev.filter == filter) {
+			return kn;
+		}
+	}
+	return NULL;
+}
+
+static int
+evl_epoll_update(struct evl_source *src, uint32_t events)
+{
+	struct epoll_event eev;
+	int op;
+
+	if (src->events == events) {
+		return 0;
+	}
+
+	memset(&eev, 0, sizeof(eev));
+	eev.events = events;
+	eev.data.ptr = src;
+
+	if (events == 0) {
+		op = EPOLL_CTL_DEL;
+	} else if (src->events == 0) {
+		op = EPOLL_CTL_ADD;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+
+	if (epoll_ctl(evl_epfd, op, src->fd, &eev) == -1) {
+		/* A descriptor closed without EV_DELETE silently left the epoll set,
+		 * and its number may since have been reused.
+		 */
+		if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+			op = EPOLL_CTL_ADD;
+		} else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+			op = EPOLL_CTL_MOD;
+		} else if (op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF)) {
+			src->events = 0;
+			return 0;
+		} else {
+			return -1;
+		}
+		if (epoll_ctl(evl_epfd, op, src->fd, &eev) == -1) {
+			return -1;
+		}
+	}
+
+	src->events = events;
+	return 0;
+}
+
+static int
+evl_fd_interest(struct evl_source *src)
+{
+	uint32_t events = 0;
+
+	if (src->rd && !src->rd->kn_disabled) {
+		events |= EPOLLIN | EPOLLRDHUP;
+		if (src->rd->kn_kev.flags & EV_CLEAR) {
+			events |= EPOLLET;
+		}
+	}
+	if (src->wr && !src->wr->kn_disabled) {
+		events |= EPOLLOUT;
+		if (src->wr->kn_kev.flags & EV_CLEAR) {
+			events |= EPOLLET;
+		}
+	}
+
+	return evl_epoll_update(src, events);
+}
+
+static int
+evl_timer_arm(struct knote *kn)
+{
+	struct itimerspec its;
+	unsigned int fflags = kn->kn_kev.fflags;
+	int64_t v = kn->kn_kev.data;
+	int flags = 0;
+
+	memset(&its, 0, sizeof(its));
+
+	if (fflags & NOTE_SECONDS) {
+		its.it_value.tv_sec = v;
+	} else if (fflags & NOTE_USECONDS) {
+		its.it_value.tv_sec = v / 1000000;
+		its.it_value.tv_nsec = (v % 1000000) * 1000;
+	} else if (fflags & NOTE_NSECONDS) {
+		its.it_value.tv_sec = v / 1000000000;
+		its.it_value.tv_nsec = v % 1000000000;
+	} else {
+		its.it_value.tv_sec = v / 1000;
+		its.it_value.tv_nsec = (v % 1000) * 1000000;
+	}
+
+	if (fflags & NOTE_ABSOLUTE) {
+		flags = TFD_TIMER_ABSTIME;
+		/* A deadline already in the past must still fire. */
+		if (its.it_value.tv_sec <= 0 && its.it_value.tv_nsec <= 0) {
+			its.it_value.tv_nsec = 1;
+		}
+	} else {
+		if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+			its.it_value.tv_nsec = 1;
+		}
+		if (!(kn->kn_kev.flags & EV_ONESHOT)) {
+			its.it_interval = its.it_value;
+		}
+	}
+
+	return timerfd_settime(kn->kn_src->fd, flags, &its, NULL);
+}
+
+/* What kqueue reports in a NOTE_EXIT event's data: the status as wait(2)
+ * would return it, not the bare exit code or signal waitid() gives.
+ */
+static intptr_t
+evl_wait_status(const siginfo_t *si)
+{
+	switch (si->si_code) {
+	case CLD_EXITED:
+		return W_EXITCODE(si->si_status, 0);
+	case CLD_KILLED:
+		return si->si_status;
+	case CLD_DUMPED:
+		return si->si_status | WCOREFLAG;
+	default:
+		return 0;
+	}
+}
+
+static int
+evl_source_open(struct knote *kn)
+{
+	struct evl_source *src;
+	struct knote *other;
+	int fd = -1;
+
+	switch (kn->kn_kev.filter) {
+	case EVFILT_READ:
+	case EVFILT_WRITE:
+		other = evl_knote_find(kn->kn_kev.ident, kn->kn_kev.filter == EVFILT_READ ? EVFILT_WRITE : EVFILT_READ);
+		if (other) {
+			kn->kn_src = other->kn_src;
+			break;
+		}
+		if ((src = calloc(1, sizeof(*src))) == NULL) {
+			return ENOMEM;
+		}
+		src->type = EVL_SOURCE_FD;
+		src->fd = (int)kn->kn_kev.ident;
+		kn->kn_src = src;
+		break;
+	case EVFILT_TIMER:
+		fd = timerfd_create(kn->kn_kev.fflags & NOTE_ABSOLUTE ? CLOCK_REALTIME : CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		break;
+	case EVFILT_PROC:
+		fd = syscall(SYS_pidfd_open, (pid_t)kn->kn_kev.ident, 0);
+		break;
+	case EVFILT_SIGNAL:
+		if (kn->kn_kev.ident == 0 || kn->kn_kev.ident >= _NSIG) {
+			return EINVAL;
+		}
+		if (evl_sigsrc.fd == -1) {
+			sigemptyset(&evl_sigmask);
+		}
+		sigaddset(&evl_sigmask, (int)kn->kn_kev.ident);
+		/* signalfd only sees signals that stay pending, and a blocked
+		 * signal stays pending even if its disposition is SIG_IGN.
+		 */
+		if (sigprocmask(SIG_BLOCK, &evl_sigmask, NULL) == -1
+				|| (evl_sigsrc.fd = signalfd(evl_sigsrc.fd, &evl_sigmask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1
+				|| evl_epoll_update(&evl_sigsrc, EPOLLIN) == -1) {
+			return errno;
+		}
+		evl_signals[kn->kn_kev.ident] = kn;
+		kn->kn_src = &evl_sigsrc;
+		return 0;
+	default:
+		return ENOTSUP;
+	}
+
+	if (kn->kn_kev.filter == EVFILT_TIMER || kn->kn_kev.filter == EVFILT_PROC) {
+		if (fd == -1) {
+			return errno;
+		}
+		if ((src = calloc(1, sizeof(*src))) == NULL) {
+			(void)close(fd);
+			return ENOMEM;
+		}
+		src->type = kn->kn_kev.filter == EVFILT_TIMER ? EVL_SOURCE_TIMER : EVL_SOURCE_PROC;
+		src->fd = fd;
+		src->kn = kn;
+		kn->kn_src = src;
+		if (evl_epoll_update(src, EPOLLIN) == -1) {
+			int saved_errno = errno;
+			(void)close(fd);
+			free(src);
+			return saved_errno;
+		}
+	}
+
+	return 0;
+}
+
+static void
+evl_knote_delete(struct knote *kn)
+{
+	struct evl_source *src = kn->kn_src;
+
+	LIST_REMOVE(kn, kn_sle);
+
+	switch (src->type) {
+	case EVL_SOURCE_FD:
+		if (src->rd == kn) {
+			src->rd = NULL;
+		} else {
+			src->wr = NULL;
+		}
+		(void)evl_fd_interest(src);
+		if (!src->rd && !src->wr) {
+			free(src);
+		}
+		break;
+	case EVL_SOURCE_TIMER:
+	case EVL_SOURCE_PROC:
+		(void)evl_epoll_update(src, 0);
+		(void)close(src->fd);
+		free(src);
+		break;
+	case EVL_SOURCE_SIGNAL:
+		evl_signals[kn->kn_kev.ident] = NULL;
+		sigdelset(&evl_sigmask, (int)kn->kn_kev.ident);
+		(void)signalfd(evl_sigsrc.fd, &evl_sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+		/* The signal stays blocked; unblocking an ignored signal here
+		 * would only change what a later fork() inherits.
+		 */
+		break;
+	}
+
+	free(kn);
+}
+
+static int
+evl_apply(const struct kevent *kev)
+{
+	struct knote *kn = evl_knote_find(kev->ident, kev->filter);
+	int error;
+
+	if (kev->flags & EV_DELETE) {
+		if (!kn) {
+			return ENOENT;
+		}
+		evl_knote_delete(kn);
+		return 0;
+	}
+
+	if (kev->flags & EV_ADD) {
+		if (!kn) {
+			if ((kn = calloc(1, sizeof(*kn))) == NULL) {
+				return ENOMEM;
+			}
+			kn->kn_kev = *kev;
+			if ((error = evl_source_open(kn))) {
+				free(kn);
+				return error;
+			}
+			LIST_INSERT_HEAD(&evl_hash[evl_hash_slot(kev->ident, kev->filter)], kn, kn_sle);
+			if (kn->kn_src->type == EVL_SOURCE_FD) {
+				if (kev->filter == EVFILT_READ) {
+					kn->kn_src->rd = kn;
+				} else {
+					kn->kn_src->wr = kn;
+				}
+			}
+		} else {
+			kn->kn_kev.flags = kev->flags;
+			kn->kn_kev.fflags = kev->fflags;
+			kn->kn_kev.data = kev->data;
+			kn->kn_kev.udata = kev->udata;
+		}
+		kn->kn_disabled = false;
+	} else if (!kn) {
+		return ENOENT;
+	}
+
+	if (kev->flags & EV_DISABLE) {
+		kn->kn_disabled = true;
+	} else if (kev->flags & EV_ENABLE) {
+		kn->kn_disabled = false;
+	}
+
+	switch (kn->kn_src->type) {
+	case EVL_SOURCE_FD:
+		if (evl_fd_interest(kn->kn_src) == -1) {
+			error = errno;
+			evl_knote_delete(kn);
+			return error;
+		}
+		break;
+	case EVL_SOURCE_TIMER:
+		if ((kev->flags & EV_ADD) && evl_timer_arm(kn) == -1) {
+			error = errno;
+			evl_knote_delete(kn);
+			return error;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+int
+kqueue(void)
+{
+	if (evl_epfd != -1) {
+		errno = EMFILE;
+		return -1;
+	}
+
+	return (evl_epfd = epoll_create1(EPOLL_CLOEXEC));
+}
+
+/* Fills in 'out' from a knote that fired, and retires the knote if it was
+ * one-shot.
+ */
+static void
+evl_deliver(struct knote *kn, struct kevent *out, unsigned short flags, unsigned int fflags, intptr_t data)
+{
+	*out = kn->kn_kev;
+	out->flags = (kn->kn_kev.flags & (EV_ONESHOT | EV_CLEAR | EV_DISPATCH)) | flags;
+	out->fflags = fflags;
+	out->data = data;
+
+	if (kn->kn_kev.flags & EV_ONESHOT) {
+		evl_knote_delete(kn);
+	} else if (kn->kn_kev.flags & EV_DISPATCH) {
+		kn->kn_disabled = true;
+		if (kn->kn_src->type == EVL_SOURCE_FD) {
+			(void)evl_fd_interest(kn->kn_src);
+		}
+	}
+}
+
+static int
+evl_deliver_signals(struct kevent *eventlist, int nevents)
+{
+	int i, n = 0;
+
+	evl_sig_backlog = false;
+	for (i = 1; i < _NSIG; i++) {
+		struct knote *kn = evl_signals[i];
+		if (!kn || kn->kn_sigcnt == 0 || kn->kn_disabled) {
+			continue;
+		}
+		if (n == nevents) {
+			evl_sig_backlog = true;
+			break;
+		}
+		uint64_t cnt = kn->kn_sigcnt;
+		kn->kn_sigcnt = 0;
+		evl_deliver(kn, &eventlist[n++], 0, 0, (intptr_t)cnt);
+	}
+
+	return n;
+}
+
+int
+kevent(int kq, const struct kevent *changelist, int nchanges,
+	struct kevent *eventlist, int nevents, const struct timespec *timeout)
+{
+	struct epoll_event eev[EVL_EPOLL_MAX];
+	int i, r, n = 0, to = -1;
+	bool signalled = false;
+
+	if (kq != evl_epfd) {
+		errno = EBADF;
+		return -1;
+	}
+
+	for (i = 0; i < nchanges; i++) {
+		/* The change and event lists may be the same array. */
+		struct kevent change = changelist[i];
+		int error = evl_apply(&change);
+
+		if (error || (change.flags & EV_RECEIPT)) {
+			if (n == nevents) {
+				if (error) {
+					errno = error;
+					return -1;
+				}
+				continue;
+			}
+			eventlist[n] = change;
+			eventlist[n].flags = EV_ERROR;
+			eventlist[n].data = error;
+			n++;
+		}
+	}
+
+	if (n > 0 || nevents == 0) {
+		return n;
+	}
+
+	if (evl_sig_backlog) {
+		n = evl_deliver_signals(eventlist, nevents);
+		to = 0;
+	} else if (timeout) {
+		to = timeout->tv_sec * 1000 + (timeout->tv_nsec + 999999) / 1000000;
+	}
+
+	/* Each epoll event can turn into a read and a write kevent. */
+	r = (nevents - n) / 2;
+	if (r > EVL_EPOLL_MAX) {
+		r = EVL_EPOLL_MAX;
+	}
+	if (r == 0) {
+		return n;
+	}
+
+	if ((r = epoll_wait(evl_epfd, eev, r, to)) == -1) {
+		return n > 0 ? n : -1;
+	}
+
+	for (i = 0; i < r; i++) {
+		struct evl_source *src = eev[i].data.ptr;
+		uint32_t ev = eev[i].events;
+		unsigned short eof = (ev & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) ? EV_EOF : 0;
+		uint64_t expirations = 0;
+		siginfo_t si;
+
+		switch (src->type) {
+		case EVL_SOURCE_FD: {
+			/* epoll reports a hangup or an error whatever the interest, so
+			 * a disabled knote has to be skipped here. Delivering the
+			 * write side may free the source.
+			 */
+			struct knote *rd = (src->rd && !src->rd->kn_disabled) ? src->rd : NULL;
+			struct knote *wr = (src->wr && !src->wr->kn_disabled) ? src->wr : NULL;
+
+			if (wr && (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+				evl_deliver(wr, &eventlist[n++], eof, 0, 0);
+			}
+			if (rd && (ev & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))) {
+				evl_deliver(rd, &eventlist[n++], eof, 0, 0);
+			}
+			break;
+		}
+		case EVL_SOURCE_TIMER:
+			if (read(src->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+				break;
+			}
+			if (!src->kn->kn_disabled) {
+				evl_deliver(src->kn, &eventlist[n++], 0, 0, (intptr_t)expirations);
+			}
+			break;
+		case EVL_SOURCE_PROC:
+			/* Peek at the exit status without reaping; job_reap() still owns
+			 * that.
+			 */
+			memset(&si, 0, sizeof(si));
+			(void)waitid(P_PID, (id_t)src->kn->kn_kev.ident, &si, WEXITED | WNOHANG | WNOWAIT);
+			/* Like kqueue, a process knote goes away once it reports exit. */
+			src->kn->kn_kev.flags |= EV_ONESHOT;
+			evl_deliver(src->kn, &eventlist[n++], EV_EOF, NOTE_EXIT, evl_wait_status(&si));
+			break;
+		case EVL_SOURCE_SIGNAL: {
+			struct signalfd_siginfo ssi;
+
+			while (read(src->fd, &ssi, sizeof(ssi)) == sizeof(ssi)) {
+				if (ssi.ssi_signo < _NSIG && evl_signals[ssi.ssi_signo]) {
+					evl_signals[ssi.ssi_signo]->kn_sigcnt++;
+				}
+			}
+			signalled = true;
+			break;
+		}
+		}
+	}
+
+	/* Only now are the slots set aside for the other sources free to use;
+	 * what does not fit waits for the next call.
+	 */
+	if (signalled) {
+		n += evl_deliver_signals(eventlist + n, nevents - n);
+	}
+
+	return n;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashtab.h"
+
+/* Old buckets moved to the new array per insertion while growing. The table
+ * grows when the node count reaches the bucket count, and it takes that many
+ * insertions to reach the next threshold, so one per insertion would do; two
+ * leaves slack and shortens the window in which lookups consult both arrays.
+ */
+#define HASHTAB_MIGRATE_STEP	2
+
+static void
+hashtab_link(struct hashtab_node **head, struct hashtab_node *hn)
+{
+	if ((hn->hn_next = *head) != NULL) {
+		hn->hn_next->hn_prevp = &hn->hn_next;
+	}
+	*head = hn;
+	hn->hn_prevp = head;
+}
+
+static void
+hashtab_unlink(struct hashtab_node *hn)
+{
+	if (hn->hn_next) {
+		hn->hn_next->hn_prevp = hn->hn_prevp;
+	}
+	*hn->hn_prevp = hn->hn_next;
+}
+
+static void
+hashtab_free_buckets(struct hashtab *ht, struct hashtab_node **buckets)
+{
+	if (buckets != ht->ht_inline) {
+		free(buckets);
+	}
+}
+
+static void
+hashtab_migrate_bucket(struct hashtab *ht, size_t i)
+{
+	struct hashtab_node *hn, *next;
+
+	for (hn = ht->ht_old[i]; hn; hn = next) {
+		next = hn->hn_next;
+		hashtab_link(&ht->ht_buckets[hn->hn_hash & ht->ht_mask], hn);
+	}
+	ht->ht_old[i] = NULL;
+}
+
+static void
+hashtab_migrate_step(struct hashtab *ht, size_t n)
+{
+	while (n-- > 0 && ht->ht_migrated <= ht->ht_old_mask) {
+		hashtab_migrate_bucket(ht, ht->ht_migrated++);
+	}
+
+	if (ht->ht_migrated > ht->ht_old_mask) {
+		hashtab_free_buckets(ht, ht->ht_old);
+		ht->ht_old = NULL;
+		ht->ht_old_mask = 0;
+		ht->ht_migrated = 0;
+	}
+}
+
+static void
+hashtab_grow(struct hashtab *ht)
+{
+	size_t nbuckets = (ht->ht_mask + 1) * 2;
+	struct hashtab_node **buckets;
+
+	if (nbuckets > UINT32_MAX || !(buckets = calloc(nbuckets, sizeof(*buckets)))) {
+		return;
+	}
+
+	ht->ht_old = ht->ht_buckets;
+	ht->ht_old_mask = ht->ht_mask;
+	ht->ht_migrated = 0;
+	ht->ht_buckets = buckets;
+	ht->ht_mask = nbuckets - 1;
+}
+
+void
+hashtab_init(struct hashtab *ht)
+{
+	memset(ht, 0, sizeof(*ht));
+}
+
+void
+hashtab_destroy(struct hashtab *ht)
+{
+	if (ht->ht_old) {
+		hashtab_free_buckets(ht, ht->ht_old);
+	}
+	if (ht->ht_buckets) {
+		hashtab_free_buckets(ht, ht->ht_buckets);
+	}
+	hashtab_init(ht);
+}
+
+void
+hashtab_insert(struct hashtab *ht, struct hashtab_node *hn, uint32_t hash)
+{
+	if (!ht->ht_buckets) {
+		/* Job managers and services mostly come and go in small numbers, so
+		 * the first few buckets live in the table itself.
+		 */
+		ht->ht_buckets = ht->ht_inline;
+		ht->ht_mask = HASHTAB_INLINE_BUCKETS - 1;
+	}
+
+	if (ht->ht_old) {
+		hashtab_migrate_step(ht, HASHTAB_MIGRATE_STEP);
+	} else if (ht->ht_count >= ht->ht_mask + 1) {
+		hashtab_grow(ht);
+	}
+
+	hn->hn_hash = hash;
+	hn->hn_table = ht;
+	hashtab_link(&ht->ht_buckets[hash & ht->ht_mask], hn);
+	ht->ht_count++;
+}
+
+void
+hashtab_remove(struct hashtab_node *hn)
+{
+	hashtab_unlink(hn);
+	hn->hn_table->ht_count--;
+	hn->hn_next = NULL;
+	hn->hn_prevp = NULL;
+	hn->hn_table = NULL;
+}
+
+static struct hashtab_node *
+hashtab_match(struct hashtab_node *hn, uint32_t hash)
+{
+	while (hn && hn->hn_hash != hash) {
+		hn = hn->hn_next;
+	}
+	return hn;
+}
+
+struct hashtab_node *
+hashtab_lookup(struct hashtab *ht, uint32_t hash)
+{
+	if (!ht->ht_buckets) {
+		return NULL;
+	}
+
+	/* Every node with this hash must be in one chain for hashtab_next() to
+	 * find them all, so pull the old bucket across first.
+	 */
+	if (ht->ht_old && ht->ht_old[hash & ht->ht_old_mask]) {
+		hashtab_migrate_bucket(ht, hash & ht->ht_old_mask);
+	}
+
+	return hashtab_match(ht->ht_buckets[hash & ht->ht_mask], hash);
+}
+
+struct hashtab_node *
+hashtab_next(struct hashtab_node *hn)
+{
+	return hashtab_match(hn->hn_next, hn->hn_hash);
+}
+
+struct hashtab_node *
+hashtab_first(struct hashtab *ht)
+{
+	if (!ht->ht_buckets) {
+		return NULL;
+	}
+	if (ht->ht_old) {
+		hashtab_migrate_step(ht, ht->ht_old_mask + 1);
+	}
+
+	return hashtab_succ(ht, NULL);
+}
+
+struct hashtab_node *
+hashtab_succ(struct hashtab *ht, struct hashtab_node *hn)
+{
+	size_t i = 0;
+
+	if (hn) {
+		if (hn->hn_next) {
+			return hn->hn_next;
+		}
+		i = (hn->hn_hash & ht->ht_mask) + 1;
+	}
+
+	for (; i <= ht->ht_mask; i++) {
+		if (ht->ht_buckets[i]) {
+			return ht->ht_buckets[i];
+		}
+	}
+
+	return NULL;
+}
+
+size_t
+hashtab_count(const struct hashtab *ht)
+{
+	return ht->ht_count;
+}
+
+static void
+hashtab_stats_buckets(struct hashtab_node *const *buckets, size_t first, size_t last, struct hashtab_stats *hs)
+{
+	size_t i, len;
+	const struct hashtab_node *hn;
+
+	for (i = first; i <= last; i++) {
+		for (len = 0, hn = buckets[i]; hn; hn = hn->hn_next) {
+			len++;
+		}
+		if (len) {
+			hs->hs_used++;
+		}
+		if (len > hs->hs_max_chain) {
+			hs->hs_max_chain = len;
+		}
+	}
+}
+
+void
+hashtab_stats(const struct hashtab *ht, struct hashtab_stats *hs)
+{
+	memset(hs, 0, sizeof(*hs));
+	if (!ht->ht_buckets) {
+		return;
+	}
+
+	hs->hs_count = ht->ht_count;
+	hs->hs_buckets = ht->ht_mask + 1;
+	hs->hs_growing = ht->ht_old != NULL;
+
+	if (ht->ht_old) {
+		hashtab_stats_buckets(ht->ht_old, ht->ht_migrated, ht->ht_old_mask, hs);
+	}
+	hashtab_stats_buckets(ht->ht_buckets, 0, ht->ht_mask, hs);
+}
+
+uint32_t
+hashtab_hash_string(const char *s)
+{
+	uint32_t h = 2166136261u;
+	unsigned char c;
+
+	/* FNV-1a, then the MurmurHash3 finalizer. FNV alone leaves the low bits,
+	 * which are all a power-of-two table looks at, poorly mixed for keys that
+	 * differ only in their last character (com.apple.foo.1, .2, ...).
+	 */
+	while ((c = (unsigned char)*s++)) {
+		h ^= c;
+		h *= 16777619u;
+	}
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+
+	return h;
+}
+
+uint32_t
+hashtab_hash_int(uint64_t v)
+{
+	/* MurmurHash3's 64-bit finalizer. PIDs and port names are mostly
+	 * sequential; this spreads them over every bucket instead of just the
+	 * low ones.
+	 */
+	v ^= v >> 33;
+	v *= 0xff51afd7ed558ccdULL;
+	v ^= v >> 33;
+	v *= 0xc4ceb9fe1a85ec53ULL;
+	v ^= v >> 33;
+
+	return (uint32_t)v;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAUNCHD_HASHTAB_H__
+#define __LAUNCHD_HASHTAB_H__
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * An intrusive chained hash table with a power-of-two bucket count. When the
+ * load factor passes 1 the table doubles, but the entries are moved over a
+ * couple of buckets at a time on subsequent insertions rather than all at
+ * once, so no single insertion pays for the whole rehash.
+ *
+ * Like the <sys/queue.h> lists it replaces, the table never allocates
+ * entries; each object embeds one hashtab_node per table it can be in.
+ * Removal only needs the node, and removing the current node while walking a
+ * chain is safe. Insertion cannot fail: if the bucket array cannot grow, the
+ * chains just get longer.
+ *
+ * The table stores the caller's hash alongside each node and compares it
+ * before handing the node back, so callers only compare keys on a full hash
+ * match.
+ */
+
+#define HASHTAB_INLINE_BUCKETS	8
+
+struct hashtab;
+
+struct hashtab_node {
+	struct hashtab_node *hn_next;
+	struct hashtab_node **hn_prevp;
+	struct hashtab *hn_table;
+	uint32_t hn_hash;
+};
+
+struct hashtab {
+	struct hashtab_node **ht_buckets;
+	struct hashtab_node **ht_old;		/* non-NULL while growing */
+	size_t ht_mask;
+	size_t ht_old_mask;
+	size_t ht_migrated;			/* old buckets already emptied */
+	size_t ht_count;
+	struct hashtab_node *ht_inline[HASHTAB_INLINE_BUCKETS];
+};
+
+struct hashtab_stats {
+	size_t hs_count;
+	size_t hs_buckets;
+	size_t hs_used;				/* buckets with at least one node */
+	size_t hs_max_chain;
+	bool hs_growing;
+};
+
+#define hashtab_entry(n, type, field) \
+	((type *)(void *)((char *)(n) - offsetof(type, field)))
+
+/* A zeroed table is also a valid empty one. */
+void hashtab_init(struct hashtab *ht);
+/* Frees the bucket arrays. Nodes still in the table are simply forgotten. */
+void hashtab_destroy(struct hashtab *ht);
+
+void hashtab_insert(struct hashtab *ht, struct hashtab_node *hn, uint32_t hash);
+void hashtab_remove(struct hashtab_node *hn);
+
+static inline bool
+hashtab_node_linked(const struct hashtab_node *hn)
+{
+	return hn->hn_table != NULL;
+}
+
+/* The first node whose stored hash equals 'hash', or NULL; continue with
+ * hashtab_next(). Other nodes sharing the bucket are skipped.
+ */
+struct hashtab_node *hashtab_lookup(struct hashtab *ht, uint32_t hash);
+struct hashtab_node *hashtab_next(struct hashtab_node *hn);
+
+/* Walks every node: hashtab_first() finishes any pending growth so that the
+ * walk only has one bucket array to cover. Nothing may be inserted during a
+ * walk; use HASHTAB_FOREACH_SAFE to remove the current node.
+ */
+struct hashtab_node *hashtab_first(struct hashtab *ht);
+struct hashtab_node *hashtab_succ(struct hashtab *ht, struct hashtab_node *hn);
+
+#define HASHTAB_FOREACH(hn, ht) \
+	for ((hn) = hashtab_first(ht); (hn); (hn) = hashtab_succ((ht), (hn)))
+
+#define HASHTAB_FOREACH_SAFE(hn, ht, tmp) \
+	for ((hn) = hashtab_first(ht); (hn) && ((tmp) = hashtab_succ((ht), (hn)), 1); (hn) = (tmp))
+
+size_t hashtab_count(const struct hashtab *ht);
+void hashtab_stats(const struct hashtab *ht, struct hashtab_stats *hs);
+
+uint32_t hashtab_hash_string(const char *s) __attribute__((pure));
+uint32_t hashtab_hash_int(uint64_t v) __attribute__((const));
+
+#endif /* __LAUNCHD_HASHTAB_H__ */
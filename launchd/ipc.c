@@ -24,7 +24,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/queue.h>
-#include <sys/event.h>
+#include "evloop.h"
 #include <sys/stat.h>
 #include <sys/ucred.h>
 #include <sys/fcntl.h>
@@ -52,6 +52,7 @@
 #include "launchd.h"
 #include "runtime.h"
 #include "core.h"
+#include "jobstat.h"
 
 extern char **environ;
 
@@ -80,6 +81,7 @@ ipc_clean_up(void)
 		return;
 	}
 
+	jobstat_cleanup();
 	if (-1 == unlink(sockpath)) {
 		launchd_syslog(LOG_WARNING, "unlink(\"%s\"): %s", sockpath, strerror(errno));
 	} else if (-1 == rmdir(sockdir)) {
@@ -171,6 +173,13 @@ ipc_server_init(void)
 	ipc_self = getpid();
 	atexit(ipc_clean_up);
 
+	/* Clients that can find the socket can find the job status table. */
+	if (jobstat_init(ourdir) == -1) {
+		launchd_syslog(LOG_WARNING, "Could not create the job status table in \"%s\": %s", ourdir, strerror(errno));
+	} else {
+		job_publish_status_all();
+	}
+
 out_bad:
 	if (!ipc_inited && fd != -1) {
 		(void)runtime_close(fd);
@@ -225,6 +234,13 @@ ipc_listen_callback(void *obj __attribute__((unused)), struct kevent *kev)
 	ipc_open(cfd, NULL);
 }
 
+/* A client that pipelines requests without reading the replies would have
+ * launchd queue them without limit. Past the high-water mark, launchd stops
+ * reading its requests until the queue is down to the low-water mark.
+ */
+#define IPC_SEND_HIWAT (256 * 1024)
+#define IPC_SEND_LOWAT (64 * 1024)
+
 void
 ipc_callback(void *obj, struct kevent *kev)
 {
@@ -245,8 +261,14 @@ ipc_callback(void *obj, struct kevent *kev)
 				launchd_syslog(LOG_DEBUG, "%s(): send: %s", __func__, strerror(errno));
 				ipc_close(c);
 			}
-		} else if (r == 0) {
-			kevent_mod(launchd_getfd(c->conn), EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+		} else {
+			if (r == 0) {
+				kevent_mod(launchd_getfd(c->conn), EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+			}
+			if (c->read_paused && launchd_msg_send_pending(c->conn) <= IPC_SEND_LOWAT) {
+				c->read_paused = false;
+				kevent_mod(launchd_getfd(c->conn), EVFILT_READ, EV_ENABLE, 0, 0, &c->kqconn_callback);
+			}
 		}
 	} else {
 		launchd_syslog(LOG_DEBUG, "%s(): unknown filter type!", __func__);
@@ -330,6 +352,12 @@ void
 ipc_readmsg(launch_data_t msg, void *context)
 {
 	struct readmsg_context rmc = { context, NULL };
+	uint64_t reqid;
+	bool tagged;
+	int r;
+
+	/* A request in an envelope is answered in one with the same ID. */
+	tagged = launchd_msg_recv_id(rmc.c->conn, &reqid);
 
 	if (LAUNCH_DATA_DICTIONARY == launch_data_get_type(msg)) {
 		launch_data_dict_iterate(msg, ipc_readmsg2, &rmc);
@@ -345,9 +373,14 @@ ipc_readmsg(launch_data_t msg, void *context)
 
 	ipc_close_fds(msg);
 
-	if (launchd_msg_send(rmc.c->conn, rmc.resp) == -1) {
+	r = tagged ? launchd_msg_send_tagged(rmc.c->conn, rmc.resp, reqid) : launchd_msg_send(rmc.c->conn, rmc.resp);
+	if (r == -1) {
 		if (errno == EAGAIN) {
 			kevent_mod(launchd_getfd(rmc.c->conn), EVFILT_WRITE, EV_ADD, 0, 0, &rmc.c->kqconn_callback);
+			if (!rmc.c->read_paused && launchd_msg_send_pending(rmc.c->conn) > IPC_SEND_HIWAT) {
+				rmc.c->read_paused = true;
+				kevent_mod(launchd_getfd(rmc.c->conn), EVFILT_READ, EV_DISABLE, 0, 0, &rmc.c->kqconn_callback);
+			}
 		} else {
 			launchd_syslog(LOG_DEBUG, "launchd_msg_send() == -1: %s", strerror(errno));
 			ipc_close(rmc.c);
@@ -401,6 +434,10 @@ ipc_readmsg2(launch_data_t data, const char *cmd, void *context)
 				struct rusage rusage;
 				getrusage(RUSAGE_CHILDREN, &rusage);
 				resp = launch_data_new_opaque(&rusage, sizeof(rusage));
+			} else if (!strcmp(cmd, LAUNCH_KEY_GETHASHSTATS)) {
+				resp = jobmgr_export_hash_stats();
+			} else if (!strcmp(cmd, LAUNCH_KEY_GETSPAWNSTATS)) {
+				resp = jobmgr_export_spawn_stats();
 			}
 		} else {
 			if (!strcmp(cmd, LAUNCH_KEY_STARTJOB)) {
@@ -422,21 +459,37 @@ ipc_readmsg2(launch_data_t data, const char *cmd, void *context)
 				resp = launch_data_new_errno(errno);
 			} else if (!strcmp(cmd, LAUNCH_KEY_SUBMITJOB)) {
 				if (launch_data_get_type(data) == LAUNCH_DATA_ARRAY) {
-					resp = job_import_bulk(data);
+					resp = job_import_bulk(data, false);
 				} else {
 					if (job_import(data)) {
 						errno = 0;
 					}
 					resp = launch_data_new_errno(errno);
 				}
+			} else if (!strcmp(cmd, LAUNCH_KEY_SUBMITJOBSATOMICALLY)) {
+				if (launch_data_get_type(data) == LAUNCH_DATA_ARRAY) {
+					resp = job_import_bulk(data, true);
+				} else {
+					resp = launch_data_new_errno(EINVAL);
+				}
 			} else if (!strcmp(cmd, LAUNCH_KEY_UNSETUSERENVIRONMENT)) {
 				unsetenv(launch_data_get_string(data));
+				jobmgr_env_changed();
 				resp = launch_data_new_errno(0);
 			} else if (!strcmp(cmd, LAUNCH_KEY_SETUSERENVIRONMENT)) {
 				launch_data_dict_iterate(data, set_user_env, NULL);
+				jobmgr_env_changed();
 				resp = launch_data_new_errno(0);
 			} else if (!strcmp(cmd, LAUNCH_KEY_SETRESOURCELIMITS)) {
 				resp = adjust_rlimits(data);
+			} else if (!strcmp(cmd, LAUNCH_KEY_SETSPAWNLIMITS)) {
+				resp = jobmgr_set_spawn_limits(data);
+			} else if (!strcmp(cmd, LAUNCH_KEY_GETJOBSSINCE)) {
+				if (launch_data_get_type(data) != LAUNCH_DATA_INTEGER || launch_data_get_integer(data) < 0) {
+					resp = launch_data_new_errno(EINVAL);
+				} else if ((resp = job_export_since((uint64_t)launch_data_get_integer(data))) != NULL) {
+					ipc_revoke_fds(resp);
+				}
 			} else if (!strcmp(cmd, LAUNCH_KEY_GETJOB)) {
 				if ((j = job_find(NULL, launch_data_get_string(data))) == NULL) {
 					resp = launch_data_new_errno(errno);
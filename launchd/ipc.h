@@ -32,6 +32,8 @@ struct conncb {
 	LIST_ENTRY(conncb) sle;
 	launch_t conn;
 	job_t j;
+	/* Not reading requests until the replies already queued drain. */
+	bool read_paused;
 };
 
 extern char *sockpath;
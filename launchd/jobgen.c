@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobgen.h"
+
+void
+jobgen_init(struct jobgen *jg, uint64_t start)
+{
+	memset(jg, 0, sizeof(*jg));
+	jg->jg_current = start;
+	jg->jg_floor = start;
+}
+
+void
+jobgen_destroy(struct jobgen *jg)
+{
+	size_t i;
+
+	for (i = 0; i < jg->jg_cnt; i++) {
+		free(jg->jg_ring[(jg->jg_first + i) % JOBGEN_TOMBSTONES].jt_label);
+	}
+	jg->jg_first = 0;
+	jg->jg_cnt = 0;
+}
+
+uint64_t
+jobgen_bury(struct jobgen *jg, const char *label)
+{
+	struct jobgen_tombstone *jt;
+	uint64_t gen = jobgen_bump(jg);
+	char *copy;
+
+	/* Without the label, the removal cannot be reported; everything before
+	 * it is given up on instead.
+	 */
+	if ((copy = strdup(label)) == NULL) {
+		jg->jg_floor = gen;
+		return gen;
+	}
+
+	if (jg->jg_cnt == JOBGEN_TOMBSTONES) {
+		jt = &jg->jg_ring[jg->jg_first];
+		jg->jg_floor = jt->jt_gen;
+		free(jt->jt_label);
+		jg->jg_first = (jg->jg_first + 1) % JOBGEN_TOMBSTONES;
+		jg->jg_cnt--;
+	}
+
+	jt = &jg->jg_ring[(jg->jg_first + jg->jg_cnt) % JOBGEN_TOMBSTONES];
+	jt->jt_gen = gen;
+	jt->jt_label = copy;
+	jg->jg_cnt++;
+
+	return gen;
+}
+
+bool
+jobgen_covers(const struct jobgen *jg, uint64_t since)
+{
+	return since >= jg->jg_floor && since <= jg->jg_current;
+}
+
+void
+jobgen_removed_since(const struct jobgen *jg, uint64_t since,
+		void (*cb)(const char *label, uint64_t gen, void *context), void *context)
+{
+	const struct jobgen_tombstone *jt;
+	size_t i;
+
+	for (i = jg->jg_cnt; i > 0; i--) {
+		jt = &jg->jg_ring[(jg->jg_first + i - 1) % JOBGEN_TOMBSTONES];
+		if (jt->jt_gen <= since) {
+			break;
+		}
+		cb(jt->jt_label, jt->jt_gen, context);
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAUNCHD_JOBGEN_H__
+#define __LAUNCHD_JOBGEN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Generations for GetJobsSince. Every change to a job takes the next number
+ * from one counter, so a client that remembers the last number it was given
+ * can be told exactly what changed after it. Removed jobs leave a tombstone
+ * carrying their label and the generation of the removal.
+ *
+ * Tombstones are kept in a fixed ring, oldest first. Once one is overwritten,
+ * the generations before it no longer account for every removal, and clients
+ * asking from there are sent everything instead. The counter starts at the
+ * time launchd does, in microseconds, so a generation from an earlier launchd
+ * is also older than anything this one can answer for.
+ *
+ * Like the rest of the job state, none of this is locked.
+ */
+
+#define JOBGEN_TOMBSTONES 1024
+
+struct jobgen_tombstone {
+	uint64_t jt_gen;
+	char *jt_label;
+};
+
+struct jobgen {
+	uint64_t jg_current;
+	/* Removals at or before this may have been forgotten. */
+	uint64_t jg_floor;
+	size_t jg_first;
+	size_t jg_cnt;
+	struct jobgen_tombstone jg_ring[JOBGEN_TOMBSTONES];
+};
+
+void jobgen_init(struct jobgen *jg, uint64_t start);
+void jobgen_destroy(struct jobgen *jg);
+
+/* The generation for a change happening now. */
+static inline uint64_t
+jobgen_bump(struct jobgen *jg)
+{
+	return ++jg->jg_current;
+}
+
+static inline uint64_t
+jobgen_current(const struct jobgen *jg)
+{
+	return jg->jg_current;
+}
+
+/* Records the removal of the job 'label' and returns its generation. */
+uint64_t jobgen_bury(struct jobgen *jg, const char *label);
+
+/* Whether the jobs changed and removed after 'since' are all that a client
+ * holding 'since' is missing. False for 0, for generations this launchd did
+ * not hand out, and for ones older than the oldest tombstone kept.
+ */
+bool jobgen_covers(const struct jobgen *jg, uint64_t since);
+
+/* Calls 'cb' for each job removed after 'since', newest first. */
+void jobgen_removed_since(const struct jobgen *jg, uint64_t since,
+		void (*cb)(const char *label, uint64_t gen, void *context), void *context);
+
+#endif /* __LAUNCHD_JOBGEN_H__ */
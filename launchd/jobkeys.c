@@ -0,0 +1,474 @@
+/* Generated from launch.h and launch_priv.h by mkjobkeys.awk. Do not edit. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "jobkeys.h"
+
+struct jobkey_slot {
+	const char *js_name;
+	size_t js_len;
+	jobkey_t js_key;
+};
+
+struct jobkey_table {
+	const struct jobkey_slot *jt_slots;
+	const uint16_t *jt_disp;
+	const int8_t *jt_pos;		/* negative counts from the end */
+	uint32_t jt_mask;
+	uint32_t jt_dmask;
+	uint32_t jt_npos;
+};
+
+static inline uint32_t
+jobkey_mix(uint32_t h)
+{
+	h *= 0x85ebca6bu;
+	h += h >> 16;
+	h *= 0xc2b2ae35u;
+	return h + (h >> 16);
+}
+
+static inline jobkey_t
+jobkey_find(const struct jobkey_table *jt, const char *key)
+{
+	size_t i, p, len = strlen(key);
+	uint32_t h0 = 5381 + (uint32_t)len, h1 = (uint32_t)len, step, d;
+	const struct jobkey_slot *js;
+	unsigned char c;
+
+	for (i = 0; i < jt->jt_npos; i++) {
+		p = jt->jt_pos[i] < 0 ? len - (size_t)-jt->jt_pos[i] : (size_t)jt->jt_pos[i];
+		c = p < len ? (unsigned char)key[p] : 0;
+		if (c >= 'A' && c <= 'Z') {
+			c += 'a' - 'A';
+		}
+		h0 = h0 * 33 + c;
+		h1 = h1 * 65599 + c;
+	}
+
+	h0 = jobkey_mix(h0);
+	h1 = jobkey_mix(h1);
+	step = (h0 & jt->jt_mask) | 1;
+	d = jt->jt_disp[(h0 >> 16) & jt->jt_dmask];
+	js = &jt->jt_slots[(h1 + (d >> 8) * step + (d & 0xff)) & jt->jt_mask];
+
+	if (js->js_len != len || strcasecmp(js->js_name, key) != 0) {
+		return JOBKEY_UNKNOWN;
+	}
+	return js->js_key;
+}
+
+static const struct jobkey_slot jobkey_mach_slots[16] = {
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "kUNCServer", 10, JOBKEY_MACH_KUNCSERVER },
+	{ "HostSpecialPort", 15, JOBKEY_MACH_HOSTSPECIALPORT },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "HideUntilCheckIn", 16, JOBKEY_MACH_HIDEUNTILCHECKIN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "ExceptionServer", 15, JOBKEY_MACH_EXCEPTIONSERVER },
+	{ "TaskSpecialPort", 15, JOBKEY_MACH_TASKSPECIALPORT },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "ResetAtClose", 12, JOBKEY_MACH_RESETATCLOSE },
+	{ "EnterKernelDebuggerOnClose", 26, JOBKEY_MACH_ENTERKERNELDEBUGGERONCLOSE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "PingEventUpdates", 16, JOBKEY_MACH_PINGEVENTUPDATES },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "DrainMessagesOnCrash", 20, JOBKEY_MACH_DRAINMESSAGESONCRASH },
+	{ "", 0, JOBKEY_UNKNOWN },
+};
+
+static const uint16_t jobkey_mach_disp[4] = {
+	0, 0, 0, 0
+};
+
+static const int8_t jobkey_mach_pos[1] = { -14 };
+
+static const struct jobkey_table jobkey_mach_table = {
+	jobkey_mach_slots, jobkey_mach_disp, jobkey_mach_pos, 15, 3, 1
+};
+
+jobkey_t
+jobkey_mach_lookup(const char *key)
+{
+	return jobkey_find(&jobkey_mach_table, key);
+}
+
+static const struct jobkey_slot jobkey_keepalive_slots[16] = {
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "PathState", 9, JOBKEY_KEEPALIVE_PATHSTATE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Crashed", 7, JOBKEY_KEEPALIVE_CRASHED },
+	{ "AfterInitialDemand", 18, JOBKEY_KEEPALIVE_AFTERINITIALDEMAND },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "NetworkState", 12, JOBKEY_KEEPALIVE_NETWORKSTATE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "OtherJobActive", 14, JOBKEY_KEEPALIVE_OTHERJOBACTIVE },
+	{ "OtherJobEnabled", 15, JOBKEY_KEEPALIVE_OTHERJOBENABLED },
+	{ "SuccessfulExit", 14, JOBKEY_KEEPALIVE_SUCCESSFULEXIT },
+};
+
+static const uint16_t jobkey_keepalive_disp[2] = {
+	1, 0
+};
+
+static const int8_t jobkey_keepalive_pos[1] = { -14 };
+
+static const struct jobkey_table jobkey_keepalive_table = {
+	jobkey_keepalive_slots, jobkey_keepalive_disp, jobkey_keepalive_pos, 15, 1, 1
+};
+
+jobkey_t
+jobkey_keepalive_lookup(const char *key)
+{
+	return jobkey_find(&jobkey_keepalive_table, key);
+}
+
+static const struct jobkey_slot jobkey_cal_slots[16] = {
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Hour", 4, JOBKEY_CAL_HOUR },
+	{ "Month", 5, JOBKEY_CAL_MONTH },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Minute", 6, JOBKEY_CAL_MINUTE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Day", 3, JOBKEY_CAL_DAY },
+	{ "Weekday", 7, JOBKEY_CAL_WEEKDAY },
+	{ "", 0, JOBKEY_UNKNOWN },
+};
+
+static const uint16_t jobkey_cal_disp[2] = {
+	0, 0
+};
+
+static const int8_t jobkey_cal_pos[1] = { 0 };
+
+static const struct jobkey_table jobkey_cal_table = {
+	jobkey_cal_slots, jobkey_cal_disp, jobkey_cal_pos, 15, 1, 0
+};
+
+jobkey_t
+jobkey_cal_lookup(const char *key)
+{
+	return jobkey_find(&jobkey_cal_table, key);
+}
+
+static const struct jobkey_slot jobkey_resourcelimit_slots[16] = {
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "NumberOfFiles", 13, JOBKEY_RESOURCELIMIT_NOFILE },
+	{ "NumberOfProcesses", 17, JOBKEY_RESOURCELIMIT_NPROC },
+	{ "CPU", 3, JOBKEY_RESOURCELIMIT_CPU },
+	{ "Core", 4, JOBKEY_RESOURCELIMIT_CORE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Data", 4, JOBKEY_RESOURCELIMIT_DATA },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Stack", 5, JOBKEY_RESOURCELIMIT_STACK },
+	{ "MemoryLock", 10, JOBKEY_RESOURCELIMIT_MEMLOCK },
+	{ "ResidentSetSize", 15, JOBKEY_RESOURCELIMIT_RSS },
+	{ "FileSize", 8, JOBKEY_RESOURCELIMIT_FSIZE },
+	{ "", 0, JOBKEY_UNKNOWN },
+};
+
+static const uint16_t jobkey_resourcelimit_disp[4] = {
+	1, 0, 1, 0
+};
+
+static const int8_t jobkey_resourcelimit_pos[1] = { -4 };
+
+static const struct jobkey_table jobkey_resourcelimit_table = {
+	jobkey_resourcelimit_slots, jobkey_resourcelimit_disp, jobkey_resourcelimit_pos, 15, 3, 1
+};
+
+jobkey_t
+jobkey_resourcelimit_lookup(const char *key)
+{
+	return jobkey_find(&jobkey_resourcelimit_table, key);
+}
+
+static const struct jobkey_slot jobkey_disabled_slots[2] = {
+	{ "MachineType", 11, JOBKEY_DISABLED_MACHINETYPE },
+	{ "ModelName", 9, JOBKEY_DISABLED_MODELNAME },
+};
+
+static const uint16_t jobkey_disabled_disp[1] = {
+	0
+};
+
+static const int8_t jobkey_disabled_pos[1] = { 0 };
+
+static const struct jobkey_table jobkey_disabled_table = {
+	jobkey_disabled_slots, jobkey_disabled_disp, jobkey_disabled_pos, 1, 0, 0
+};
+
+jobkey_t
+jobkey_disabled_lookup(const char *key)
+{
+	return jobkey_find(&jobkey_disabled_table, key);
+}
+
+static const struct jobkey_slot jobkey_sandbox_slots[1] = {
+	{ "Named", 5, JOBKEY_SANDBOX_NAMED },
+};
+
+static const uint16_t jobkey_sandbox_disp[1] = {
+	0
+};
+
+static const int8_t jobkey_sandbox_pos[1] = { 0 };
+
+static const struct jobkey_table jobkey_sandbox_table = {
+	jobkey_sandbox_slots, jobkey_sandbox_disp, jobkey_sandbox_pos, 0, 0, 0
+};
+
+jobkey_t
+jobkey_sandbox_lookup(const char *key)
+{
+	return jobkey_find(&jobkey_sandbox_table, key);
+}
+
+static const struct jobkey_slot jobkey_slots[128] = {
+	{ "EmbeddedHomeScreen", 18, JOBKEY_EMBEDDEDHOMESCREEN },
+	{ "SecuritySessionUUID", 19, JOBKEY_SECURITYSESSIONUUID },
+	{ "EnableGlobbing", 14, JOBKEY_ENABLEGLOBBING },
+	{ "OnDemand", 8, JOBKEY_ONDEMAND },
+	{ "ShutdownMonitor", 15, JOBKEY_SHUTDOWNMONITOR },
+	{ "EventMonitor", 12, JOBKEY_EVENTMONITOR },
+	{ "XPCDomain", 9, JOBKEY_XPCDOMAIN },
+	{ "RootDirectory", 13, JOBKEY_ROOTDIRECTORY },
+	{ "StartOnMount", 12, JOBKEY_STARTONMOUNT },
+	{ "EnterKernelDebuggerBeforeKill", 29, JOBKEY_ENTERKERNELDEBUGGERBEFOREKILL },
+	{ "Policies", 8, JOBKEY_POLICIES },
+	{ "MachServices", 12, JOBKEY_MACHSERVICES },
+	{ "SessionCreate", 13, JOBKEY_SESSIONCREATE },
+	{ "SandboxProfile", 14, JOBKEY_SANDBOXPROFILE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "EmbeddedPrivilegeDispensation", 29, JOBKEY_EMBEDDEDPRIVILEGEDISPENSATION },
+	{ "ProcessType", 11, JOBKEY_PROCESSTYPE },
+	{ "UserEnvironmentVariables", 24, JOBKEY_USERENVIRONMENTVARIABLES },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "QuarantineData", 14, JOBKEY_QUARANTINEDATA },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "JoinGUISession", 14, JOBKEY_JOINGUISESSION },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "LimitLoadFromHosts", 18, JOBKEY_LIMITLOADFROMHOSTS },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "XPCDomainBootstrapper", 21, JOBKEY_XPCDOMAINBOOTSTRAPPER },
+	{ "MachServiceLookupPolicies", 25, JOBKEY_MACHSERVICELOOKUPPOLICIES },
+	{ "TimeOut", 7, JOBKEY_TIMEOUT },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "HardResourceLimits", 18, JOBKEY_HARDRESOURCELIMITS },
+	{ "MachExceptionHandler", 20, JOBKEY_MACHEXCEPTIONHANDLER },
+	{ "BinaryOrderPreference", 21, JOBKEY_BINARYORDERPREFERENCE },
+	{ "MultipleInstances", 17, JOBKEY_MULTIPLEINSTANCES },
+	{ "Nice", 4, JOBKEY_NICE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "HopefullyExitsFirst", 19, JOBKEY_HOPEFULLYEXITSFIRST },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Disabled", 8, JOBKEY_DISABLED },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Debug", 5, JOBKEY_DEBUG },
+	{ "JetsamMemoryLimitBackground", 27, JOBKEY_JETSAMMEMORYLIMITBACKGROUND },
+	{ "BonjourFDs", 10, JOBKEY_BONJOURFDS },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "TransactionCount", 16, JOBKEY_TRANSACTIONCOUNT },
+	{ "LegacyTimers", 12, JOBKEY_LEGACYTIMERS },
+	{ "ProgramArguments", 16, JOBKEY_PROGRAMARGUMENTS },
+	{ "HopefullyExitsLast", 18, JOBKEY_HOPEFULLYEXITSLAST },
+	{ "JetsamProperties", 16, JOBKEY_JETSAMPROPERTIES },
+	{ "StartCalendarInterval", 21, JOBKEY_STARTCALENDARINTERVAL },
+	{ "JetsamPriority", 14, JOBKEY_JETSAMPRIORITY },
+	{ "EnableTransactions", 18, JOBKEY_ENABLETRANSACTIONS },
+	{ "LaunchEvents", 12, JOBKEY_LAUNCHEVENTS },
+	{ "IgnoreProcessGroupAtShutdown", 28, JOBKEY_IGNOREPROCESSGROUPATSHUTDOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "POSIXSpawnType", 14, JOBKEY_POSIXSPAWNTYPE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "ServiceIPC", 10, JOBKEY_SERVICEIPC },
+	{ "StandardInPath", 14, JOBKEY_STANDARDINPATH },
+	{ "KeepAlive", 9, JOBKEY_KEEPALIVE },
+	{ "CFBundleIdentifier", 18, JOBKEY_CFBUNDLEIDENTIFIER },
+	{ "LimitLoadToSessionType", 22, JOBKEY_LIMITLOADTOSESSIONTYPE },
+	{ "StartInterval", 13, JOBKEY_STARTINTERVAL },
+	{ "Label", 5, JOBKEY_LABEL },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "UserName", 8, JOBKEY_USERNAME },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "QueueDirectories", 16, JOBKEY_QUEUEDIRECTORIES },
+	{ "WatchPaths", 10, JOBKEY_WATCHPATHS },
+	{ "SandboxFlags", 12, JOBKEY_SANDBOXFLAGS },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "InitGroups", 10, JOBKEY_INITGROUPS },
+	{ "PID", 3, JOBKEY_PID },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "EnvironmentVariables", 20, JOBKEY_ENVIRONMENTVARIABLES },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "StandardOutPath", 15, JOBKEY_STANDARDOUTPATH },
+	{ "LimitLoadFromHardware", 21, JOBKEY_LIMITLOADFROMHARDWARE },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "LastExitStatus", 14, JOBKEY_LASTEXITSTATUS },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "LaunchOnlyOnce", 14, JOBKEY_LAUNCHONLYONCE },
+	{ "ThrottleInterval", 16, JOBKEY_THROTTLEINTERVAL },
+	{ "LimitLoadToHardware", 19, JOBKEY_LIMITLOADTOHARDWARE },
+	{ "StartPriority", 13, JOBKEY_STARTPRIORITY },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "RunAtLoad", 9, JOBKEY_RUNATLOAD },
+	{ "LimitLoadToHosts", 16, JOBKEY_LIMITLOADTOHOSTS },
+	{ "JetsamMemoryLimit", 17, JOBKEY_JETSAMMEMORYLIMIT },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "__Defaults", 10, JOBKEY_DEFAULTS },
+	{ "DisableASLR", 11, JOBKEY_DISABLEASLR },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "SoftResourceLimits", 18, JOBKEY_SOFTRESOURCELIMITS },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "inetdCompatibility", 18, JOBKEY_INETDCOMPATIBILITY },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "ExitTimeOut", 11, JOBKEY_EXITTIMEOUT },
+	{ "LowPriorityBackgroundIO", 23, JOBKEY_LOWPRIORITYBACKGROUNDIO },
+	{ "Umask", 5, JOBKEY_UMASK },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "AbandonProcessGroup", 19, JOBKEY_ABANDONPROCESSGROUP },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Sockets", 7, JOBKEY_SOCKETS },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "SandboxContainer", 16, JOBKEY_SANDBOXCONTAINER },
+	{ "StandardErrorPath", 17, JOBKEY_STANDARDERRORPATH },
+	{ "PerJobMachServices", 18, JOBKEY_PERJOBMACHSERVICES },
+	{ "BeginTransactionAtShutdown", 26, JOBKEY_BEGINTRANSACTIONATSHUTDOWN },
+	{ "GroupName", 9, JOBKEY_GROUPNAME },
+	{ "LowPriorityIO", 13, JOBKEY_LOWPRIORITYIO },
+	{ "Program", 7, JOBKEY_PROGRAM },
+	{ "WaitForDebugger", 15, JOBKEY_WAITFORDEBUGGER },
+	{ "AuditSessionID", 14, JOBKEY_ASID },
+	{ "EmbeddedMainThreadPriority", 26, JOBKEY_EMBEDDEDMAINTHREADPRIORITY },
+	{ "WorkingDirectory", 16, JOBKEY_WORKINGDIRECTORY },
+};
+
+static const uint16_t jobkey_disp[32] = {
+	8, 11, 23, 6, 0, 1, 19, 1, 1, 5, 5, 0,
+	0, 6, 257, 7, 2, 1, 2, 1, 256, 2, 1, 1,
+	2, 0, 9, 0, 4, 0, 0, 17
+};
+
+static const int8_t jobkey_pos[2] = { -5, 0 };
+
+static const struct jobkey_table jobkey_table = {
+	jobkey_slots, jobkey_disp, jobkey_pos, 127, 31, 2
+};
+
+jobkey_t
+jobkey_lookup(const char *key)
+{
+	return jobkey_find(&jobkey_table, key);
+}
+
+static const struct jobkey_slot jobpolicy_slots[1] = {
+	{ "DenyCreatingOtherJobs", 21, JOBPOLICY_DENYCREATINGOTHERJOBS },
+};
+
+static const uint16_t jobpolicy_disp[1] = {
+	0
+};
+
+static const int8_t jobpolicy_pos[1] = { 0 };
+
+static const struct jobkey_table jobpolicy_table = {
+	jobpolicy_slots, jobpolicy_disp, jobpolicy_pos, 0, 0, 0
+};
+
+jobkey_t
+jobpolicy_lookup(const char *key)
+{
+	return jobkey_find(&jobpolicy_table, key);
+}
+
+static const struct jobkey_slot jobsocketkey_slots[16] = {
+	{ "SecureSocketWithKey", 19, JOBSOCKETKEY_SECUREWITHKEY },
+	{ "Bonjour", 7, JOBSOCKETKEY_BONJOUR },
+	{ "SockPathName", 12, JOBSOCKETKEY_PATHNAME },
+	{ "SockProtocol", 12, JOBSOCKETKEY_PROTOCOL },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "MulticastGroup", 14, JOBSOCKETKEY_MULTICASTGROUP },
+	{ "SockServiceName", 15, JOBSOCKETKEY_SERVICENAME },
+	{ "SockFamily", 10, JOBSOCKETKEY_FAMILY },
+	{ "SockPassive", 11, JOBSOCKETKEY_PASSIVE },
+	{ "SockType", 8, JOBSOCKETKEY_TYPE },
+	{ "SockNodeName", 12, JOBSOCKETKEY_NODENAME },
+	{ "SockPathMode", 12, JOBSOCKETKEY_PATHMODE },
+};
+
+static const uint16_t jobsocketkey_disp[4] = {
+	8, 256, 0, 5
+};
+
+static const int8_t jobsocketkey_pos[2] = { -7, -4 };
+
+static const struct jobkey_table jobsocketkey_table = {
+	jobsocketkey_slots, jobsocketkey_disp, jobsocketkey_pos, 15, 3, 2
+};
+
+jobkey_t
+jobsocketkey_lookup(const char *key)
+{
+	return jobkey_find(&jobsocketkey_table, key);
+}
+
+static const struct jobkey_slot jobinetdcompatibility_slots[8] = {
+	{ "BatchAccept", 11, JOBINETDCOMPATIBILITY_BATCHACCEPT },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "LogConnections", 14, JOBINETDCOMPATIBILITY_LOGCONNECTIONS },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "", 0, JOBKEY_UNKNOWN },
+	{ "Workers", 7, JOBINETDCOMPATIBILITY_WORKERS },
+	{ "Wait", 4, JOBINETDCOMPATIBILITY_WAIT },
+	{ "MaxChildren", 11, JOBINETDCOMPATIBILITY_MAXCHILDREN },
+};
+
+static const uint16_t jobinetdcompatibility_disp[2] = {
+	0, 256
+};
+
+static const int8_t jobinetdcompatibility_pos[1] = { -11 };
+
+static const struct jobkey_table jobinetdcompatibility_table = {
+	jobinetdcompatibility_slots, jobinetdcompatibility_disp, jobinetdcompatibility_pos, 7, 1, 1
+};
+
+jobkey_t
+jobinetdcompatibility_lookup(const char *key)
+{
+	return jobkey_find(&jobinetdcompatibility_table, key);
+}
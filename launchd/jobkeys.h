@@ -0,0 +1,170 @@
+/* Generated from launch.h and launch_priv.h by mkjobkeys.awk. Do not edit. */
+
+#ifndef __LAUNCHD_JOBKEYS_H__
+#define __LAUNCHD_JOBKEYS_H__
+
+typedef enum {
+	JOBKEY_UNKNOWN = 0,
+	/* MachServices options */
+	JOBKEY_MACH_RESETATCLOSE,
+	JOBKEY_MACH_HIDEUNTILCHECKIN,
+	JOBKEY_MACH_DRAINMESSAGESONCRASH,
+	JOBKEY_MACH_PINGEVENTUPDATES,
+	JOBKEY_MACH_KUNCSERVER,
+	JOBKEY_MACH_EXCEPTIONSERVER,
+	JOBKEY_MACH_TASKSPECIALPORT,
+	JOBKEY_MACH_HOSTSPECIALPORT,
+	JOBKEY_MACH_ENTERKERNELDEBUGGERONCLOSE,
+	/* KeepAlive conditions */
+	JOBKEY_KEEPALIVE_SUCCESSFULEXIT,
+	JOBKEY_KEEPALIVE_NETWORKSTATE,
+	JOBKEY_KEEPALIVE_PATHSTATE,
+	JOBKEY_KEEPALIVE_OTHERJOBACTIVE,
+	JOBKEY_KEEPALIVE_OTHERJOBENABLED,
+	JOBKEY_KEEPALIVE_AFTERINITIALDEMAND,
+	JOBKEY_KEEPALIVE_CRASHED,
+	/* StartCalendarInterval fields */
+	JOBKEY_CAL_MINUTE,
+	JOBKEY_CAL_HOUR,
+	JOBKEY_CAL_DAY,
+	JOBKEY_CAL_WEEKDAY,
+	JOBKEY_CAL_MONTH,
+	/* Soft/HardResourceLimits */
+	JOBKEY_RESOURCELIMIT_CORE,
+	JOBKEY_RESOURCELIMIT_CPU,
+	JOBKEY_RESOURCELIMIT_DATA,
+	JOBKEY_RESOURCELIMIT_FSIZE,
+	JOBKEY_RESOURCELIMIT_MEMLOCK,
+	JOBKEY_RESOURCELIMIT_NOFILE,
+	JOBKEY_RESOURCELIMIT_NPROC,
+	JOBKEY_RESOURCELIMIT_RSS,
+	JOBKEY_RESOURCELIMIT_STACK,
+	/* Disabled conditions */
+	JOBKEY_DISABLED_MACHINETYPE,
+	JOBKEY_DISABLED_MODELNAME,
+	/* SandboxFlags */
+	JOBKEY_SANDBOX_NAMED,
+	/* top-level job keys */
+	JOBKEY_DEFAULTS,
+	JOBKEY_LABEL,
+	JOBKEY_DISABLED,
+	JOBKEY_USERNAME,
+	JOBKEY_GROUPNAME,
+	JOBKEY_TIMEOUT,
+	JOBKEY_EXITTIMEOUT,
+	JOBKEY_INITGROUPS,
+	JOBKEY_SOCKETS,
+	JOBKEY_MACHSERVICES,
+	JOBKEY_MACHSERVICELOOKUPPOLICIES,
+	JOBKEY_INETDCOMPATIBILITY,
+	JOBKEY_ENABLEGLOBBING,
+	JOBKEY_PROGRAMARGUMENTS,
+	JOBKEY_PROGRAM,
+	JOBKEY_ONDEMAND,
+	JOBKEY_KEEPALIVE,
+	JOBKEY_LIMITLOADTOHOSTS,
+	JOBKEY_LIMITLOADFROMHOSTS,
+	JOBKEY_LIMITLOADTOSESSIONTYPE,
+	JOBKEY_LIMITLOADTOHARDWARE,
+	JOBKEY_LIMITLOADFROMHARDWARE,
+	JOBKEY_RUNATLOAD,
+	JOBKEY_ROOTDIRECTORY,
+	JOBKEY_WORKINGDIRECTORY,
+	JOBKEY_ENVIRONMENTVARIABLES,
+	JOBKEY_USERENVIRONMENTVARIABLES,
+	JOBKEY_UMASK,
+	JOBKEY_NICE,
+	JOBKEY_HOPEFULLYEXITSFIRST,
+	JOBKEY_HOPEFULLYEXITSLAST,
+	JOBKEY_LOWPRIORITYIO,
+	JOBKEY_SESSIONCREATE,
+	JOBKEY_STARTONMOUNT,
+	JOBKEY_SOFTRESOURCELIMITS,
+	JOBKEY_HARDRESOURCELIMITS,
+	JOBKEY_STANDARDINPATH,
+	JOBKEY_STANDARDOUTPATH,
+	JOBKEY_STANDARDERRORPATH,
+	JOBKEY_DEBUG,
+	JOBKEY_WAITFORDEBUGGER,
+	JOBKEY_QUEUEDIRECTORIES,
+	JOBKEY_WATCHPATHS,
+	JOBKEY_STARTINTERVAL,
+	JOBKEY_STARTCALENDARINTERVAL,
+	JOBKEY_BONJOURFDS,
+	JOBKEY_LASTEXITSTATUS,
+	JOBKEY_PID,
+	JOBKEY_THROTTLEINTERVAL,
+	JOBKEY_LAUNCHONLYONCE,
+	JOBKEY_ABANDONPROCESSGROUP,
+	JOBKEY_IGNOREPROCESSGROUPATSHUTDOWN,
+	JOBKEY_POLICIES,
+	JOBKEY_ENABLETRANSACTIONS,
+	JOBKEY_CFBUNDLEIDENTIFIER,
+	JOBKEY_PROCESSTYPE,
+	JOBKEY_LAUNCHEVENTS,
+	JOBKEY_TRANSACTIONCOUNT,
+	JOBKEY_QUARANTINEDATA,
+	JOBKEY_SANDBOXPROFILE,
+	JOBKEY_SANDBOXFLAGS,
+	JOBKEY_SANDBOXCONTAINER,
+	JOBKEY_JETSAMPROPERTIES,
+	JOBKEY_JETSAMPRIORITY,
+	JOBKEY_JETSAMMEMORYLIMIT,
+	JOBKEY_JETSAMMEMORYLIMITBACKGROUND,
+	JOBKEY_SECURITYSESSIONUUID,
+	JOBKEY_DISABLEASLR,
+	JOBKEY_XPCDOMAIN,
+	JOBKEY_POSIXSPAWNTYPE,
+	JOBKEY_EMBEDDEDPRIVILEGEDISPENSATION,
+	JOBKEY_EMBEDDEDHOMESCREEN,
+	JOBKEY_EMBEDDEDMAINTHREADPRIORITY,
+	JOBKEY_ENTERKERNELDEBUGGERBEFOREKILL,
+	JOBKEY_PERJOBMACHSERVICES,
+	JOBKEY_SERVICEIPC,
+	JOBKEY_BINARYORDERPREFERENCE,
+	JOBKEY_MACHEXCEPTIONHANDLER,
+	JOBKEY_MULTIPLEINSTANCES,
+	JOBKEY_EVENTMONITOR,
+	JOBKEY_SHUTDOWNMONITOR,
+	JOBKEY_BEGINTRANSACTIONATSHUTDOWN,
+	JOBKEY_XPCDOMAINBOOTSTRAPPER,
+	JOBKEY_ASID,
+	JOBKEY_JOINGUISESSION,
+	JOBKEY_LOWPRIORITYBACKGROUNDIO,
+	JOBKEY_LEGACYTIMERS,
+	JOBKEY_STARTPRIORITY,
+	/* Policies */
+	JOBPOLICY_DENYCREATINGOTHERJOBS,
+	/* Sockets entries */
+	JOBSOCKETKEY_TYPE,
+	JOBSOCKETKEY_PASSIVE,
+	JOBSOCKETKEY_BONJOUR,
+	JOBSOCKETKEY_SECUREWITHKEY,
+	JOBSOCKETKEY_PATHNAME,
+	JOBSOCKETKEY_PATHMODE,
+	JOBSOCKETKEY_NODENAME,
+	JOBSOCKETKEY_SERVICENAME,
+	JOBSOCKETKEY_FAMILY,
+	JOBSOCKETKEY_PROTOCOL,
+	JOBSOCKETKEY_MULTICASTGROUP,
+	/* inetdCompatibility */
+	JOBINETDCOMPATIBILITY_WAIT,
+	JOBINETDCOMPATIBILITY_BATCHACCEPT,
+	JOBINETDCOMPATIBILITY_LOGCONNECTIONS,
+	JOBINETDCOMPATIBILITY_MAXCHILDREN,
+	JOBINETDCOMPATIBILITY_WORKERS,
+} jobkey_t;
+
+/* Each returns JOBKEY_UNKNOWN for a key that is not in its namespace. */
+jobkey_t jobkey_mach_lookup(const char *key) __attribute__((pure));
+jobkey_t jobkey_keepalive_lookup(const char *key) __attribute__((pure));
+jobkey_t jobkey_cal_lookup(const char *key) __attribute__((pure));
+jobkey_t jobkey_resourcelimit_lookup(const char *key) __attribute__((pure));
+jobkey_t jobkey_disabled_lookup(const char *key) __attribute__((pure));
+jobkey_t jobkey_sandbox_lookup(const char *key) __attribute__((pure));
+jobkey_t jobkey_lookup(const char *key) __attribute__((pure));
+jobkey_t jobpolicy_lookup(const char *key) __attribute__((pure));
+jobkey_t jobsocketkey_lookup(const char *key) __attribute__((pure));
+jobkey_t jobinetdcompatibility_lookup(const char *key) __attribute__((pure));
+
+#endif /* __LAUNCHD_JOBKEYS_H__ */
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jobstat.h"
+
+static struct launch_jobstat_header *jobstat_hdr;
+static struct launch_jobstat_slot *jobstat_slots;
+static size_t jobstat_size;
+static char *jobstat_path;
+
+/* Slots given back, reused before any new one is handed out. */
+static uint32_t *jobstat_freelist;
+static size_t jobstat_nfree;
+
+/* Readers throw away anything they copied while the count was odd or that
+ * changed under them. The barriers keep the stores to the slot between the
+ * two increments.
+ */
+static void
+jobstat_write_begin(struct launch_jobstat_slot *slot)
+{
+	slot->ljs_seq++;
+	__sync_synchronize();
+}
+
+static void
+jobstat_write_end(struct launch_jobstat_slot *slot)
+{
+	__sync_synchronize();
+	slot->ljs_seq++;
+}
+
+int
+jobstat_init(const char *dir)
+{
+	size_t len = strlen(dir) + sizeof("/" LAUNCH_JOBSTAT_FILE);
+	void *map;
+	int fd, e;
+
+	if (jobstat_hdr != NULL) {
+		return 0;
+	}
+
+	if ((jobstat_path = malloc(len)) == NULL) {
+		return -1;
+	}
+	snprintf(jobstat_path, len, "%s/" LAUNCH_JOBSTAT_FILE, dir);
+
+	/* The file is sparse; only the pages slots have been handed out from
+	 * are ever backed. Like the socket, it is for our own user only.
+	 */
+	jobstat_size = sizeof(struct launch_jobstat_header) + JOBSTAT_SLOTS * sizeof(struct launch_jobstat_slot);
+	(void)unlink(jobstat_path);
+	if ((fd = open(jobstat_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)) == -1) {
+		goto out_bad;
+	}
+	if (ftruncate(fd, (off_t)jobstat_size) == -1
+			|| (map = mmap(NULL, jobstat_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		e = errno;
+		(void)close(fd);
+		(void)unlink(jobstat_path);
+		errno = e;
+		goto out_bad;
+	}
+	(void)close(fd);
+
+	if ((jobstat_freelist = calloc(JOBSTAT_SLOTS, sizeof(jobstat_freelist[0]))) == NULL) {
+		(void)munmap(map, jobstat_size);
+		(void)unlink(jobstat_path);
+		errno = ENOMEM;
+		goto out_bad;
+	}
+	jobstat_nfree = 0;
+
+	jobstat_hdr = map;
+	jobstat_slots = (struct launch_jobstat_slot *)(jobstat_hdr + 1);
+	jobstat_hdr->ljh_version = LAUNCH_JOBSTAT_VERSION;
+	jobstat_hdr->ljh_slotsize = sizeof(struct launch_jobstat_slot);
+	jobstat_hdr->ljh_nslots = JOBSTAT_SLOTS;
+	jobstat_hdr->ljh_pid = (uint32_t)getpid();
+	/* The magic goes last: a reader takes a table without it as not there. */
+	__sync_synchronize();
+	jobstat_hdr->ljh_magic = LAUNCH_JOBSTAT_MAGIC;
+
+	return 0;
+
+out_bad:
+	free(jobstat_path);
+	jobstat_path = NULL;
+	return -1;
+}
+
+void
+jobstat_cleanup(void)
+{
+	if (jobstat_hdr == NULL) {
+		return;
+	}
+
+	(void)unlink(jobstat_path);
+	(void)munmap(jobstat_hdr, jobstat_size);
+	free(jobstat_path);
+	free(jobstat_freelist);
+	jobstat_hdr = NULL;
+	jobstat_slots = NULL;
+	jobstat_path = NULL;
+	jobstat_freelist = NULL;
+	jobstat_nfree = 0;
+}
+
+struct launch_jobstat_slot *
+jobstat_alloc(const char *label)
+{
+	struct launch_jobstat_slot *slot;
+	size_t len;
+
+	if (jobstat_hdr == NULL) {
+		return NULL;
+	}
+
+	if (jobstat_nfree > 0) {
+		slot = &jobstat_slots[jobstat_freelist[--jobstat_nfree]];
+	} else if (jobstat_hdr->ljh_used < jobstat_hdr->ljh_nslots) {
+		slot = &jobstat_slots[jobstat_hdr->ljh_used];
+	} else {
+		jobstat_hdr->ljh_overflow++;
+		return NULL;
+	}
+
+	jobstat_write_begin(slot);
+	len = strlen(label);
+	slot->ljs_flags = 0;
+	if (len >= sizeof(slot->ljs_label)) {
+		len = sizeof(slot->ljs_label) - 1;
+		slot->ljs_flags |= LAUNCH_JOBSTAT_TRUNCATED;
+	}
+	memcpy(slot->ljs_label, label, len);
+	memset(slot->ljs_label + len, 0, sizeof(slot->ljs_label) - len);
+	slot->ljs_state = LAUNCH_JOBSTAT_LOADED;
+	slot->ljs_pid = 0;
+	slot->ljs_status = 0;
+	slot->ljs_starts = 0;
+	slot->ljs_start_time = 0;
+	jobstat_write_end(slot);
+
+	/* Only count a new slot once it holds a job. */
+	if (slot == &jobstat_slots[jobstat_hdr->ljh_used]) {
+		__sync_synchronize();
+		jobstat_hdr->ljh_used++;
+	}
+
+	return slot;
+}
+
+void
+jobstat_free(struct launch_jobstat_slot *slot)
+{
+	if (jobstat_hdr == NULL) {
+		return;
+	}
+	if (slot == NULL) {
+		if (jobstat_hdr->ljh_overflow > 0) {
+			jobstat_hdr->ljh_overflow--;
+		}
+		return;
+	}
+
+	jobstat_write_begin(slot);
+	slot->ljs_state = LAUNCH_JOBSTAT_FREE;
+	slot->ljs_pid = 0;
+	jobstat_write_end(slot);
+
+	jobstat_freelist[jobstat_nfree++] = (uint32_t)(slot - jobstat_slots);
+}
+
+void
+jobstat_update(struct launch_jobstat_slot *slot, pid_t pid, int status, uint64_t starts, int64_t start_time)
+{
+	if (slot == NULL) {
+		return;
+	}
+
+	jobstat_write_begin(slot);
+	if (pid != 0) {
+		slot->ljs_state = LAUNCH_JOBSTAT_RUNNING;
+	} else {
+		slot->ljs_state = starts > 0 ? LAUNCH_JOBSTAT_EXITED : LAUNCH_JOBSTAT_LOADED;
+	}
+	slot->ljs_pid = pid;
+	slot->ljs_status = status;
+	slot->ljs_starts = starts;
+	slot->ljs_start_time = start_time;
+	jobstat_write_end(slot);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAUNCHD_JOBSTAT_H__
+#define __LAUNCHD_JOBSTAT_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "launch_priv.h"
+
+/*
+ * The writing side of the shared job status table described in launch_priv.h.
+ * Only launchd's main thread writes it, so there is no locking here; the
+ * per-slot sequence counts are only for readers in other processes.
+ *
+ * The table has a fixed number of slots, sized for far more jobs than a host
+ * ever has. Jobs that do not get one are counted in the header so readers
+ * know to ask launchd instead.
+ */
+
+#define JOBSTAT_SLOTS 32768
+
+/* Creates the table in 'dir' and maps it. Returns 0, or -1 with errno set. */
+int jobstat_init(const char *dir);
+
+/* Unmaps the table and removes its file. */
+void jobstat_cleanup(void);
+
+/* A slot for the job 'label', starting out as LAUNCH_JOBSTAT_LOADED, or NULL
+ * if there is no table or it is full.
+ */
+struct launch_jobstat_slot *jobstat_alloc(const char *label);
+
+/* Gives back the slot of a job being removed; NULL for a job that did not
+ * get one.
+ */
+void jobstat_free(struct launch_jobstat_slot *slot);
+
+/* Publishes a job's state: running if 'pid' is set, otherwise exited with
+ * 'status' if it has ever been started. 'slot' may be NULL.
+ */
+void jobstat_update(struct launch_jobstat_slot *slot, pid_t pid, int status, uint64_t starts, int64_t start_time);
+
+#endif /* __LAUNCHD_JOBSTAT_H__ */
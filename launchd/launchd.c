@@ -23,7 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/queue.h>
-#include <sys/event.h>
+#include "evloop.h"
 #include <sys/stat.h>
 #include <sys/ucred.h>
 #include <sys/fcntl.h>
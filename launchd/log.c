@@ -6,6 +6,8 @@
 #include "launch_internal.h"
 #include "vproc_internal.h"
 #include "log.h"
+#include "logring.h"
+#include "logfmt.h"
 
 #define ROUND_TO_64BIT_WORD_SIZE(x)	((x + 7) & ~7)
 #define LAUNCHD_DEBUG_LOG "launchd-debug.%s.log"
@@ -13,6 +15,20 @@
 #define LAUNCHD_SHUTDOWN_LOG "launchd-shutdown.%s.log"
 #define LAUNCHD_LOWLEVEL_LOG "launchd-lowlevel.%s.log"
 
+/* Enough for a few thousand typical messages. Once full, the oldest messages
+ * are overwritten, so a job that crash-loops faster than syslogd drains us
+ * costs log history rather than memory.
+ */
+#define LAUNCHD_LOG_RING_SIZE (256 * 1024)
+/* Longest message text, and largest captured message; the latter is only a
+ * little more since it holds the format and arguments rather than the text.
+ */
+#define LAUNCHD_LOG_MSG_MAX 2048
+#define LAUNCHD_LOG_CAPTURE_MAX (LAUNCHD_LOG_MSG_MAX + 512)
+
+/* The message is a logfmt record that has not been rendered yet. */
+#define LOGMSG_DEFERRED 0x1
+
 os_redirect_assumes(_launchd_os_redirect);
 
 char *launchd_username = "unknown";
@@ -24,9 +40,12 @@ int64_t launchd_system_start;
 static FILE *_launchd_shutdown_log;
 static FILE *_launchd_debug_log;
 static FILE *_launchd_perf_log;
-static STAILQ_HEAD(, logmsg_s) _launchd_logq = STAILQ_HEAD_INITIALIZER(_launchd_logq);
-static size_t _launchd_logq_sz;
-static size_t _launchd_logq_cnt;
+static uint64_t _launchd_logq_buf[LAUNCHD_LOG_RING_SIZE / sizeof(uint64_t)];
+static struct logring _launchd_logq;
+static uint64_t _launchd_logq_dropped_reported;
+static size_t _launchd_logq_deferred;
+static char *_launchd_log_scratch;
+static size_t _launchd_log_scratch_sz;
 static int _launchd_log_up2 = LOG_UPTO(LOG_NOTICE);
 
 static int64_t _launchd_shutdown_start;
@@ -69,52 +88,81 @@ runtime_setlogmask(int maskpri)
 	return _launchd_log_up2;
 }
 
-static bool
-_logmsg_add(struct launchd_syslog_attr *attr, int err_num, const char *msg)
+static struct logring *
+_launchd_log_ring(void)
 {
-	size_t lm_sz = sizeof(struct logmsg_s) + strlen(msg) + strlen(attr->from_name) + strlen(attr->about_name) + strlen(attr->session_name) + 4;
-	char *data_off;
-	struct logmsg_s *lm;
+	if (unlikely(_launchd_logq.lr_buf == NULL)) {
+		logring_init(&_launchd_logq, _launchd_logq_buf, sizeof(_launchd_logq_buf), offsetof(struct logmsg_s, obj_sz));
+	}
+	return &_launchd_logq;
+}
+
+/* Messages are written straight into the ring in the form they are drained
+ * in, with the strings addressed by offset from the start of the message. A
+ * deferred message carries a logfmt record in place of its text until then.
+ */
+static size_t
+_logmsg_size(struct launchd_syslog_attr *attr, size_t msg_len)
+{
+	size_t lm_sz = sizeof(struct logmsg_s) + msg_len + strlen(attr->from_name) + 1 + strlen(attr->about_name) + 1 + strlen(attr->session_name) + 1;
 
 	/* Force the unpacking for the log_drain cause unalignment faults. */
-	lm_sz = ROUND_TO_64BIT_WORD_SIZE(lm_sz);
+	return ROUND_TO_64BIT_WORD_SIZE(lm_sz);
+}
 
-	if (unlikely((lm = calloc(1, lm_sz)) == NULL)) {
-		return false;
-	}
+static void
+_logmsg_fill(struct logmsg_s *lm, size_t lm_sz, struct launchd_syslog_attr *attr, int err_num, const void *msg, size_t msg_len, bool deferred)
+{
+	size_t from_len = strlen(attr->from_name) + 1;
+	size_t about_len = strlen(attr->about_name) + 1;
+	size_t session_len = strlen(attr->session_name) + 1;
+	char *data_off;
 
+	memset(lm, 0, sizeof(*lm));
 	data_off = lm->data;
 
+	lm->flags = deferred ? LOGMSG_DEFERRED : 0;
 	lm->when = runtime_get_wall_time();
 	lm->from_pid = attr->from_pid;
 	lm->about_pid = attr->about_pid;
 	lm->err_num = err_num;
 	lm->pri = attr->priority;
 	lm->obj_sz = lm_sz;
-	lm->msg = data_off;
-	data_off += sprintf(data_off, "%s", msg) + 1;
-	lm->from_name = data_off;
-	data_off += sprintf(data_off, "%s", attr->from_name) + 1;
-	lm->about_name = data_off;
-	data_off += sprintf(data_off, "%s", attr->about_name) + 1;
-	lm->session_name = data_off;
-	data_off += sprintf(data_off, "%s", attr->session_name) + 1;
-
-	STAILQ_INSERT_TAIL(&_launchd_logq, lm, sqe);
-	_launchd_logq_sz += lm_sz;
-	_launchd_logq_cnt++;
-
-	return true;
+	lm->msg_offset = data_off - (char *)lm;
+	memcpy(data_off, msg, msg_len);
+	data_off += msg_len;
+	lm->from_name_offset = data_off - (char *)lm;
+	memcpy(data_off, attr->from_name, from_len);
+	data_off += from_len;
+	lm->about_name_offset = data_off - (char *)lm;
+	memcpy(data_off, attr->about_name, about_len);
+	data_off += about_len;
+	lm->session_name_offset = data_off - (char *)lm;
+	memcpy(data_off, attr->session_name, session_len);
+	data_off += session_len;
+	/* The ring is reused; do not hand stale bytes to the drainer. */
+	memset(data_off, 0, (char *)lm + lm_sz - data_off);
 }
 
-static void
-_logmsg_remove(struct logmsg_s *lm)
+static bool
+_logmsg_add(struct launchd_syslog_attr *attr, int err_num, const void *msg, size_t msg_len, bool deferred)
 {
-	STAILQ_REMOVE(&_launchd_logq, lm, logmsg_s, sqe);
-	_launchd_logq_sz -= lm->obj_sz;
-	_launchd_logq_cnt--;
+	size_t lm_sz = _logmsg_size(attr, msg_len);
+	struct logring *ring = _launchd_log_ring();
+	struct logmsg_s *lm;
+
+	if (unlikely((lm = logring_reserve(ring, lm_sz)) == NULL)) {
+		return false;
+	}
 
-	free(lm);
+	_logmsg_fill(lm, lm_sz, attr, err_num, msg, msg_len, deferred);
+
+	logring_commit(ring, lm_sz);
+	if (deferred) {
+		_launchd_logq_deferred++;
+	}
+
+	return true;
 }
 
 bool
@@ -124,9 +172,37 @@ _launchd_os_redirect(const char *message)
 	return true;
 }
 
+bool
+launchd_syslog_enabled(int pri)
+{
+	if ((pri & LOG_CONSOLE) && launchd_console) {
+		return true;
+	}
+	pri &= ~LOG_CONSOLE;
+
+	if (pri == LOG_PERF) {
+		return launchd_var_available && launchd_log_perf;
+	}
+	if (launchd_var_available && ((launchd_shutting_down && launchd_log_shutdown) || launchd_log_debug)) {
+		return true;
+	}
+	if (pri == LOG_APPLEONLY) {
+		if (!launchd_apple_internal) {
+			return false;
+		}
+		pri = LOG_NOTICE;
+	}
+
+	return LOG_MASK(pri) & _launchd_log_up2;
+}
+
 void
 launchd_syslog(int pri, const char *message, ...)
 {
+	if (!launchd_syslog_enabled(pri)) {
+		return;
+	}
+
 	struct launchd_syslog_attr attr = {
 		.from_name = launchd_label,
 		.about_name = launchd_label,
@@ -148,13 +224,24 @@ void
 launchd_vsyslog(struct launchd_syslog_attr *attr, const char *fmt, va_list args)
 {
 	int saved_errno = errno;
-	char message[2048];
+	char message[LAUNCHD_LOG_MSG_MAX];
+	char capture[LAUNCHD_LOG_CAPTURE_MAX];
+	size_t capture_sz = 0;
+	bool enqueue;
+	va_list ap;
 
 	static dispatch_once_t perf_once = 0;
 	static dispatch_once_t shutdown_once = 0;
 	static dispatch_once_t shutdown_start_once = 0;
 	static dispatch_once_t debug_once = 0;
 
+	/* Nothing below is cheap, least of all formatting the message, and most
+	 * debug messages go nowhere.
+	 */
+	if (!launchd_syslog_enabled(attr->priority)) {
+		return;
+	}
+
 	bool echo2console = (attr->priority & LOG_CONSOLE);
 	attr->priority &= ~LOG_CONSOLE;
 	if (attr->priority == LOG_APPLEONLY && launchd_apple_internal) {
@@ -169,7 +256,7 @@ launchd_vsyslog(struct launchd_syslog_attr *attr, const char *fmt, va_list args)
 	 * we'll lose the first few relevant messages at boot for debug and
 	 * performance logging, but the loss isn't too bad. 
 	 */
-	if (launchd_var_available) {
+	if (launchd_var_available && (launchd_log_perf || launchd_log_debug || (launchd_shutting_down && launchd_log_shutdown))) {
 		/* This file is for logging low-level errors where we can't necessarily be
 		 * assured that we can write to the console or use syslog.
 		 */
@@ -218,7 +305,33 @@ launchd_vsyslog(struct launchd_syslog_attr *attr, const char *fmt, va_list args)
 
 	}
 
-	vsnprintf(message, sizeof(message), fmt, args);
+	/* Text is only produced here for the console and the log files. Queued
+	 * messages keep their arguments and are rendered when drained, if they
+	 * are not overwritten first.
+	 */
+	enqueue = attr->priority <= LOG_DEBUG && (LOG_MASK(attr->priority) & _launchd_log_up2);
+	if (enqueue) {
+		va_copy(ap, args);
+		capture_sz = logfmt_capture(capture, sizeof(capture), fmt, ap);
+		va_end(ap);
+	}
+
+	if (!(echo2console && launchd_console) && !log2here) {
+		if (capture_sz) {
+			_logmsg_add(attr, saved_errno, capture, capture_sz, true);
+			return;
+		}
+		if (!enqueue) {
+			return;
+		}
+	}
+
+	if (capture_sz) {
+		logfmt_render(message, sizeof(message), capture, capture_sz);
+	} else {
+		vsnprintf(message, sizeof(message), fmt, args);
+	}
+
 	if (echo2console && launchd_console) {
 		fprintf(launchd_console, "%-32s %-8u %-64s %-8u  %s\n", attr->from_name, attr->from_pid, attr->about_name, attr->about_pid, message);
 	}
@@ -234,39 +347,187 @@ launchd_vsyslog(struct launchd_syslog_attr *attr, const char *fmt, va_list args)
 		fprintf(log2here, "%-8lld %-32s %-8u %-24s %-8u  %s\n", delta, attr->from_name, attr->from_pid, attr->about_name, attr->about_pid, message);
 	}
 
-	if ((LOG_MASK(attr->priority) & _launchd_log_up2)) {
-		_logmsg_add(attr, saved_errno, message);
+	if (capture_sz) {
+		_logmsg_add(attr, saved_errno, capture, capture_sz, true);
+	} else if (enqueue) {
+		_logmsg_add(attr, saved_errno, message, strlen(message) + 1, false);
+	}
+}
+
+static bool
+_launchd_log_scratch_reserve(size_t sz)
+{
+	size_t nsz = _launchd_log_scratch_sz ? _launchd_log_scratch_sz : LAUNCHD_LOG_RING_SIZE;
+	char *n;
+
+	if (sz <= _launchd_log_scratch_sz) {
+		return true;
+	}
+	while (nsz < sz) {
+		nsz *= 2;
+	}
+	if (!(n = reallocf(_launchd_log_scratch, nsz))) {
+		_launchd_log_scratch = NULL;
+		_launchd_log_scratch_sz = 0;
+		return false;
+	}
+	_launchd_log_scratch = n;
+	_launchd_log_scratch_sz = nsz;
+
+	return true;
+}
+
+/* Copies one queued message to 'off' in the scratch buffer in wire form,
+ * rendering it first if it was deferred. Returns the bytes written.
+ */
+static size_t
+_launchd_log_unpack_one(const struct logmsg_s *lm, size_t off)
+{
+	const char *base = (const char *)lm;
+	char text[LAUNCHD_LOG_MSG_MAX];
+	size_t text_len, from_len, about_len, session_len, sz;
+	struct logmsg_s *out;
+	char *data_off;
+
+	if (!(lm->flags & LOGMSG_DEFERRED)) {
+		if (!_launchd_log_scratch_reserve(off + lm->obj_sz)) {
+			return 0;
+		}
+		memcpy(_launchd_log_scratch + off, lm, lm->obj_sz);
+		((struct logmsg_s *)(_launchd_log_scratch + off))->flags = 0;
+		return lm->obj_sz;
+	}
+
+	text_len = logfmt_render(text, sizeof(text), base + lm->msg_offset, lm->from_name_offset - lm->msg_offset);
+	text_len = (text_len < sizeof(text) ? text_len : sizeof(text) - 1) + 1;
+	from_len = lm->about_name_offset - lm->from_name_offset;
+	about_len = lm->session_name_offset - lm->about_name_offset;
+	session_len = strlen(base + lm->session_name_offset) + 1;
+
+	sz = ROUND_TO_64BIT_WORD_SIZE(sizeof(struct logmsg_s) + text_len + from_len + about_len + session_len);
+	if (!_launchd_log_scratch_reserve(off + sz)) {
+		return 0;
+	}
+
+	out = (struct logmsg_s *)(_launchd_log_scratch + off);
+	memcpy(out, lm, sizeof(*out));
+	out->flags = 0;
+	out->obj_sz = sz;
+	data_off = out->data;
+	out->msg_offset = data_off - (char *)out;
+	memcpy(data_off, text, text_len);
+	data_off += text_len;
+	out->from_name_offset = data_off - (char *)out;
+	memcpy(data_off, base + lm->from_name_offset, from_len);
+	data_off += from_len;
+	out->about_name_offset = data_off - (char *)out;
+	memcpy(data_off, base + lm->about_name_offset, about_len);
+	data_off += about_len;
+	out->session_name_offset = data_off - (char *)out;
+	memcpy(data_off, base + lm->session_name_offset, session_len);
+	data_off += session_len;
+	memset(data_off, 0, (char *)out + sz - data_off);
+
+	return sz;
+}
+
+/* Says how many messages were overwritten since the last drain. The notice
+ * is written to the start of the scratch buffer, not queued, so that it
+ * leads the drain instead of trailing it and evicts nothing further. Returns
+ * its size, or 0 if there is nothing to report. The drops count as reported
+ * once the drain has been handed out.
+ */
+static size_t
+_launchd_log_note_drops(void)
+{
+	struct launchd_syslog_attr attr = {
+		.from_name = launchd_label,
+		.about_name = launchd_label,
+		.session_name = pid1_magic ? "System" : "Background",
+		.priority = LOG_WARNING,
+		.from_uid = launchd_uid,
+		.from_pid = getpid(),
+		.about_pid = getpid(),
+	};
+
+	struct logring *ring = _launchd_log_ring();
+	uint64_t dropped = ring->lr_dropped - _launchd_logq_dropped_reported;
+	char message[128];
+	size_t msg_len, lm_sz;
+
+	if (likely(dropped == 0)) {
+		return 0;
+	}
+
+	(void)snprintf(message, sizeof(message), "Log queue full: %llu messages were dropped.", (unsigned long long)dropped);
+	msg_len = strlen(message) + 1;
+	lm_sz = _logmsg_size(&attr, msg_len);
+	if (unlikely(!_launchd_log_scratch_reserve(lm_sz))) {
+		/* Try again on the next drain. */
+		return 0;
 	}
+
+	_logmsg_fill((struct logmsg_s *)_launchd_log_scratch, lm_sz, &attr, 0, message, msg_len, false);
+
+	return lm_sz;
 }
 
 static kern_return_t
 _launchd_log_pack(vm_offset_t *outval, mach_msg_type_number_t *outvalCnt)
 {
-	struct logmsg_s *lm;
-	void *offset;
+	struct logring *ring = _launchd_log_ring();
+	struct iovec iov[2];
+	size_t off, done, sz;
+	int i, n;
 
-	*outvalCnt = _launchd_logq_sz;
+	/* Anything reported here goes ahead of the queued messages. */
+	off = _launchd_log_note_drops();
 
-	mig_allocate(outval, *outvalCnt);
+	if (_launchd_logq_deferred == 0) {
+		*outvalCnt = off + logring_used(ring);
 
-	if (unlikely(*outval == 0)) {
-		return 1;
+		mig_allocate(outval, *outvalCnt);
+
+		if (unlikely(*outval == 0)) {
+			return 1;
+		}
+
+		/* Already in wire form: at most two copies, however many messages. */
+		if (off) {
+			memcpy((void *)*outval, _launchd_log_scratch, off);
+		}
+		(void)logring_drain(ring, (char *)*outval + off);
+		_launchd_logq_dropped_reported = ring->lr_dropped;
+
+		return 0;
 	}
 
-	offset = (void *)*outval;
-	while ((lm = STAILQ_FIRST(&_launchd_logq))) {
-		lm->from_name_offset = lm->from_name - (char *)lm;
-		lm->about_name_offset = lm->about_name - (char *)lm;
-		lm->msg_offset = lm->msg - (char *)lm;
-		lm->session_name_offset = lm->session_name - (char *)lm;
+	/* Messages of our own are rendered now, so the final size is not known
+	 * until they all have been.
+	 */
+	n = logring_peek(ring, iov);
+	for (i = 0; i < n; i++) {
+		for (done = 0; done < iov[i].iov_len; done += ((struct logmsg_s *)(iov[i].iov_base + done))->obj_sz) {
+			if (unlikely((sz = _launchd_log_unpack_one(iov[i].iov_base + done, off)) == 0)) {
+				return 1;
+			}
+			off += sz;
+		}
+	}
 
-		memcpy(offset, lm, lm->obj_sz);
+	*outvalCnt = off;
 
-		offset += lm->obj_sz;
+	mig_allocate(outval, *outvalCnt);
 
-		_logmsg_remove(lm);
+	if (unlikely(*outval == 0)) {
+		return 1;
 	}
 
+	memcpy((void *)*outval, _launchd_log_scratch, off);
+	logring_clear(ring);
+	_launchd_logq_dropped_reported = ring->lr_dropped;
+	_launchd_logq_deferred = 0;
+
 	return 0;
 }
 
@@ -281,7 +542,7 @@ _launchd_log_uncork_pending_drain(void)
 		return;
 	}
 
-	if (_launchd_logq_cnt == 0) {
+	if (logring_count(_launchd_log_ring()) == 0) {
 		return;
 	}
 
@@ -319,7 +580,7 @@ launchd_log_push(void)
 			(void)fflush(_launchd_debug_log);
 		}
 
-		if (_launchd_logq_cnt && _launchd_log_pack(&outval, &outvalCnt) == 0) {
+		if (logring_count(_launchd_log_ring()) && _launchd_log_pack(&outval, &outvalCnt) == 0) {
 			(void)_vprocmgr_log_forward(inherited_bootstrap_port, (void *)outval, outvalCnt);
 			mig_deallocate(outval, outvalCnt);
 		}
@@ -331,6 +592,7 @@ launchd_log_push(void)
 kern_return_t
 launchd_log_forward(uid_t forward_uid, gid_t forward_gid, vm_offset_t inval, mach_msg_type_number_t invalCnt)
 {
+	struct logring *ring = _launchd_log_ring();
 	struct logmsg_s *lm, *lm_walk;
 	mach_msg_type_number_t data_left = invalCnt;
 
@@ -338,7 +600,7 @@ launchd_log_forward(uid_t forward_uid, gid_t forward_gid, vm_offset_t inval, mac
 		return 0;
 	}
 
-	for (lm_walk = (struct logmsg_s *)inval; (data_left > 0) && (lm_walk->obj_sz <= data_left); lm_walk = ((void *)lm_walk + lm_walk->obj_sz)) {
+	for (lm_walk = (struct logmsg_s *)inval; (data_left >= sizeof(struct logmsg_s)) && (lm_walk->obj_sz <= data_left); lm_walk = ((void *)lm_walk + lm_walk->obj_sz)) {
 		/* malloc(3) returns non-NULL when you ask for zero bytes. If our object
 		 * is zero bytes, something is wrong.
 		 */
@@ -347,23 +609,19 @@ launchd_log_forward(uid_t forward_uid, gid_t forward_gid, vm_offset_t inval, mac
 			break;
 		}
 
-		if (!(lm = malloc(lm_walk->obj_sz))) {
-			launchd_syslog(LOG_WARNING, "Failed to allocate %llu bytes for log message with %u bytes left in forwarded data. Ignoring remaining messages.", lm_walk->obj_sz, data_left);
+		/* The sender packed these from its own ring, so they are already in
+		 * the form we keep and drain them in; only the sender is filled in.
+		 */
+		if (!(lm = logring_reserve(ring, lm_walk->obj_sz))) {
+			launchd_syslog(LOG_WARNING, "Could not queue a forwarded log message of %llu bytes with %u bytes left in forwarded data. Ignoring remaining messages.", lm_walk->obj_sz, data_left);
 			break;
 		}
 
 		memcpy(lm, lm_walk, lm_walk->obj_sz);
+		lm->flags = 0;
 		lm->sender_uid = forward_uid;
 		lm->sender_gid = forward_gid;
-
-		lm->from_name += (size_t)lm;
-		lm->about_name += (size_t)lm;
-		lm->msg += (size_t)lm;
-		lm->session_name += (size_t)lm;
-
-		STAILQ_INSERT_TAIL(&_launchd_logq, lm, sqe);
-		_launchd_logq_sz += lm->obj_sz;
-		_launchd_logq_cnt++;
+		logring_commit(ring, lm->obj_sz);
 
 		data_left -= lm->obj_sz;
 	}
@@ -378,7 +636,7 @@ launchd_log_drain(mach_port_t srp, vm_offset_t *outval, mach_msg_type_number_t *
 {
 	(void)os_assumes_zero(launchd_drain_reply_port);
 
-	if ((_launchd_logq_cnt == 0) || launchd_shutting_down) {
+	if ((logring_count(_launchd_log_ring()) == 0) || launchd_shutting_down) {
 		launchd_drain_reply_port = srp;
 		(void)os_assumes_zero(launchd_mport_notify_req(launchd_drain_reply_port, MACH_NOTIFY_DEAD_NAME));
 
@@ -56,6 +56,12 @@ runtime_setlogmask(int maskpri);
 void
 launchd_closelog(void);
 
+/* Whether a message at 'pri' would be logged anywhere. Callers that do real
+ * work to build a message should check this first.
+ */
+bool
+launchd_syslog_enabled(int pri);
+
 __attribute__((format(printf, 2, 3)))
 void
 launchd_syslog(int pri, const char *message, ...);
@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logfmt.h"
+
+/* At render time each conversion is rebuilt for snprintf(3) with any '*'
+ * replaced by its captured value, so a specification has to fit in this
+ * even after that.
+ */
+#define LOGFMT_SPEC_MAX		64
+#define LOGFMT_INT_DIGITS	11
+
+enum {
+	LOGFMT_LEN_NONE,
+	LOGFMT_LEN_HH,
+	LOGFMT_LEN_H,
+	LOGFMT_LEN_L,
+	LOGFMT_LEN_LL,
+	LOGFMT_LEN_J,
+	LOGFMT_LEN_Z,
+	LOGFMT_LEN_T,
+};
+
+struct logfmt_spec {
+	const char *flags;
+	size_t flags_len;
+	const char *width;		/* "*", digits or empty */
+	size_t width_len;
+	const char *prec;		/* NULL without a '.'; else "*", digits or empty */
+	size_t prec_len;
+	int length;
+	char conv;
+};
+
+struct logfmt_buf {
+	char *p;
+	size_t sz;
+	size_t len;
+	bool overflow;
+};
+
+struct logfmt_out {
+	char *buf;
+	size_t sz;
+	size_t len;
+};
+
+static inline bool
+logfmt_is_star(const char *s, size_t len)
+{
+	return len == 1 && *s == '*';
+}
+
+/* Parses the specification following a '%'. Returns a pointer just past the
+ * conversion character, or NULL if it is one we do not capture.
+ */
+static const char *
+logfmt_parse(const char *p, struct logfmt_spec *sp)
+{
+	memset(sp, 0, sizeof(*sp));
+
+	sp->flags = p;
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'') {
+		p++;
+	}
+	sp->flags_len = p - sp->flags;
+
+	sp->width = p;
+	if (*p == '*') {
+		p++;
+	} else while (*p >= '0' && *p <= '9') {
+		p++;
+	}
+	sp->width_len = p - sp->width;
+
+	if (*p == '.') {
+		sp->prec = ++p;
+		if (*p == '*') {
+			p++;
+		} else while (*p >= '0' && *p <= '9') {
+			p++;
+		}
+		sp->prec_len = p - sp->prec;
+	}
+
+	switch (*p) {
+	case 'h':
+		if (*++p == 'h') {
+			p++;
+			sp->length = LOGFMT_LEN_HH;
+		} else {
+			sp->length = LOGFMT_LEN_H;
+		}
+		break;
+	case 'l':
+		if (*++p == 'l') {
+			p++;
+			sp->length = LOGFMT_LEN_LL;
+		} else {
+			sp->length = LOGFMT_LEN_L;
+		}
+		break;
+	case 'q':
+		p++;
+		sp->length = LOGFMT_LEN_LL;
+		break;
+	case 'j':
+		p++;
+		sp->length = LOGFMT_LEN_J;
+		break;
+	case 'z':
+		p++;
+		sp->length = LOGFMT_LEN_Z;
+		break;
+	case 't':
+		p++;
+		sp->length = LOGFMT_LEN_T;
+		break;
+	}
+
+	/* Positional arguments show up here as a '$' after the digits. */
+	switch ((sp->conv = *p)) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		break;
+	case 'c': case 's': case 'p':
+		if (sp->length != LOGFMT_LEN_NONE) {
+			return NULL;
+		}
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		if (sp->length != LOGFMT_LEN_NONE && sp->length != LOGFMT_LEN_L) {
+			return NULL;
+		}
+		break;
+	default:
+		return NULL;
+	}
+
+	if (sp->flags_len + sp->width_len + sp->prec_len + 2 * LOGFMT_INT_DIGITS + 6 > LOGFMT_SPEC_MAX) {
+		return NULL;
+	}
+
+	return p + 1;
+}
+
+static void
+logfmt_put(struct logfmt_buf *b, const void *v, size_t n)
+{
+	if (n > b->sz - b->len) {
+		b->overflow = true;
+		return;
+	}
+	memcpy(b->p + b->len, v, n);
+	b->len += n;
+}
+
+static void
+logfmt_put_u64(struct logfmt_buf *b, uint64_t v)
+{
+	logfmt_put(b, &v, sizeof(v));
+}
+
+/* Integers are kept as 64 bits, already truncated to the width the length
+ * modifier asked for, so rendering can treat them all as long long.
+ */
+static uint64_t
+logfmt_int_arg(va_list *ap, int length, bool is_signed)
+{
+	if (is_signed) {
+		switch (length) {
+		case LOGFMT_LEN_HH:
+			return (uint64_t)(int64_t)(signed char)va_arg(*ap, int);
+		case LOGFMT_LEN_H:
+			return (uint64_t)(int64_t)(short)va_arg(*ap, int);
+		case LOGFMT_LEN_L:
+			return (uint64_t)(int64_t)va_arg(*ap, long);
+		case LOGFMT_LEN_LL:
+			return (uint64_t)(int64_t)va_arg(*ap, long long);
+		case LOGFMT_LEN_J:
+			return (uint64_t)(int64_t)va_arg(*ap, intmax_t);
+		case LOGFMT_LEN_Z:
+			return (uint64_t)(int64_t)(ssize_t)va_arg(*ap, size_t);
+		case LOGFMT_LEN_T:
+			return (uint64_t)(int64_t)va_arg(*ap, ptrdiff_t);
+		default:
+			return (uint64_t)(int64_t)va_arg(*ap, int);
+		}
+	}
+
+	switch (length) {
+	case LOGFMT_LEN_HH:
+		return (unsigned char)va_arg(*ap, unsigned int);
+	case LOGFMT_LEN_H:
+		return (unsigned short)va_arg(*ap, unsigned int);
+	case LOGFMT_LEN_L:
+		return va_arg(*ap, unsigned long);
+	case LOGFMT_LEN_LL:
+		return va_arg(*ap, unsigned long long);
+	case LOGFMT_LEN_J:
+		return va_arg(*ap, uintmax_t);
+	case LOGFMT_LEN_Z:
+		return va_arg(*ap, size_t);
+	case LOGFMT_LEN_T:
+		return (uint64_t)va_arg(*ap, ptrdiff_t);
+	default:
+		return va_arg(*ap, unsigned int);
+	}
+}
+
+/* Record layout: a uint32_t length and the format string including its
+ * terminator, then each argument in order. '*' values and all scalars take
+ * 8 bytes; strings take a uint32_t length and the bytes, unterminated.
+ */
+size_t
+logfmt_capture(void *buf, size_t bufsz, const char *fmt, va_list ap)
+{
+	struct logfmt_buf b = { .p = buf, .sz = bufsz };
+	struct logfmt_spec sp;
+	size_t fmt_sz = strlen(fmt) + 1;
+	uint32_t fmt_len = (uint32_t)fmt_sz, slen;
+	const char *p, *end, *s;
+	long prec;
+	double d;
+	va_list aq;
+
+	if (fmt_sz > bufsz) {
+		return 0;
+	}
+
+	logfmt_put(&b, &fmt_len, sizeof(fmt_len));
+	logfmt_put(&b, fmt, fmt_sz);
+
+	va_copy(aq, ap);
+	for (p = fmt; *p && !b.overflow; p++) {
+		if (*p != '%') {
+			continue;
+		}
+		if (p[1] == '%') {
+			p++;
+			continue;
+		}
+		if (!(end = logfmt_parse(p + 1, &sp))) {
+			va_end(aq);
+			return 0;
+		}
+
+		if (logfmt_is_star(sp.width, sp.width_len)) {
+			logfmt_put_u64(&b, (uint64_t)(int64_t)va_arg(aq, int));
+		}
+		prec = -1;
+		if (sp.prec && logfmt_is_star(sp.prec, sp.prec_len)) {
+			prec = va_arg(aq, int);
+			logfmt_put_u64(&b, (uint64_t)(int64_t)prec);
+		} else if (sp.prec) {
+			prec = strtol(sp.prec, NULL, 10);
+		}
+
+		switch (sp.conv) {
+		case 'd':
+		case 'i':
+			logfmt_put_u64(&b, logfmt_int_arg(&aq, sp.length, true));
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			logfmt_put_u64(&b, logfmt_int_arg(&aq, sp.length, false));
+			break;
+		case 'c':
+			logfmt_put_u64(&b, (uint64_t)(int64_t)va_arg(aq, int));
+			break;
+		case 'p':
+			logfmt_put_u64(&b, (uintptr_t)va_arg(aq, void *));
+			break;
+		case 's':
+			if (!(s = va_arg(aq, const char *))) {
+				s = "(null)";
+			}
+			slen = (uint32_t)(prec >= 0 ? strnlen(s, (size_t)prec) : strlen(s));
+			logfmt_put(&b, &slen, sizeof(slen));
+			logfmt_put(&b, s, slen);
+			break;
+		default:
+			d = va_arg(aq, double);
+			logfmt_put(&b, &d, sizeof(d));
+			break;
+		}
+
+		p = end - 1;
+	}
+	va_end(aq);
+
+	return b.overflow ? 0 : b.len;
+}
+
+static bool
+logfmt_get(const char **p, size_t *left, void *v, size_t n)
+{
+	if (n > *left) {
+		return false;
+	}
+	memcpy(v, *p, n);
+	*p += n;
+	*left -= n;
+	return true;
+}
+
+static void
+logfmt_out_bytes(struct logfmt_out *o, const char *s, size_t n)
+{
+	size_t room = o->len < o->sz ? o->sz - o->len : 0;
+
+	if (room) {
+		memcpy(o->buf + o->len, s, n < room ? n : room);
+	}
+	o->len += n;
+}
+
+/* Where the next snprintf(3) should write, and how much it may. */
+static char *
+logfmt_out_room(struct logfmt_out *o, size_t *room)
+{
+	if (o->len < o->sz) {
+		*room = o->sz - o->len;
+		return o->buf + o->len;
+	}
+	*room = 0;
+	return NULL;
+}
+
+static void
+logfmt_out_advance(struct logfmt_out *o, int n)
+{
+	if (n > 0) {
+		o->len += (size_t)n;
+	}
+}
+
+/* Rebuilds the specification for snprintf(3). Strings always get a '*'
+ * precision, which the caller fills in with the captured length.
+ */
+static void
+logfmt_spec_string(char *spec, const struct logfmt_spec *sp, bool has_width, int64_t width, bool has_prec, int64_t prec)
+{
+	char *o = spec;
+
+	*o++ = '%';
+	memcpy(o, sp->flags, sp->flags_len);
+	o += sp->flags_len;
+
+	if (has_width) {
+		o += sprintf(o, "%d", (int)width);
+	} else {
+		memcpy(o, sp->width, sp->width_len);
+		o += sp->width_len;
+	}
+
+	if (sp->conv == 's') {
+		*o++ = '.';
+		*o++ = '*';
+	} else if (has_prec) {
+		/* A negative '*' precision means there is none. */
+		if (prec >= 0) {
+			o += sprintf(o, ".%d", (int)prec);
+		}
+	} else if (sp->prec) {
+		*o++ = '.';
+		memcpy(o, sp->prec, sp->prec_len);
+		o += sp->prec_len;
+	}
+
+	switch (sp->conv) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		*o++ = 'l';
+		*o++ = 'l';
+		break;
+	}
+	*o++ = sp->conv;
+	*o = '\0';
+}
+
+size_t
+logfmt_render(char *out, size_t outsz, const void *rec, size_t reclen)
+{
+	struct logfmt_out o = { .buf = out, .sz = outsz };
+	struct logfmt_spec sp;
+	const char *rp = rec, *fmt, *p, *lit, *end;
+	size_t left = reclen, room;
+	char spec[LOGFMT_SPEC_MAX], *dst;
+	bool has_width, has_prec;
+	int64_t width = 0, prec = 0;
+	uint32_t fmt_len, slen;
+	uint64_t v;
+	double d;
+
+	if (!logfmt_get(&rp, &left, &fmt_len, sizeof(fmt_len)) || fmt_len == 0 || fmt_len > left || rp[fmt_len - 1] != '\0') {
+		goto out;
+	}
+	fmt = rp;
+	rp += fmt_len;
+	left -= fmt_len;
+
+	for (lit = p = fmt; *p; p++) {
+		if (*p != '%') {
+			continue;
+		}
+		logfmt_out_bytes(&o, lit, p - lit);
+
+		if (p[1] == '%') {
+			logfmt_out_bytes(&o, "%", 1);
+			lit = ++p + 1;
+			continue;
+		}
+		if (!(end = logfmt_parse(p + 1, &sp))) {
+			/* Capture would have refused this format. */
+			goto out;
+		}
+
+		has_width = logfmt_is_star(sp.width, sp.width_len);
+		if (has_width) {
+			if (!logfmt_get(&rp, &left, &v, sizeof(v))) {
+				goto out;
+			}
+			width = (int64_t)v;
+		}
+		has_prec = sp.prec && logfmt_is_star(sp.prec, sp.prec_len);
+		if (has_prec) {
+			if (!logfmt_get(&rp, &left, &v, sizeof(v))) {
+				goto out;
+			}
+			prec = (int64_t)v;
+		}
+		logfmt_spec_string(spec, &sp, has_width, width, has_prec, prec);
+
+		dst = logfmt_out_room(&o, &room);
+		switch (sp.conv) {
+		case 's':
+			if (!logfmt_get(&rp, &left, &slen, sizeof(slen)) || slen > left) {
+				goto out;
+			}
+			logfmt_out_advance(&o, snprintf(dst, room, spec, (int)slen, rp));
+			rp += slen;
+			left -= slen;
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (!logfmt_get(&rp, &left, &d, sizeof(d))) {
+				goto out;
+			}
+			logfmt_out_advance(&o, snprintf(dst, room, spec, d));
+			break;
+		default:
+			if (!logfmt_get(&rp, &left, &v, sizeof(v))) {
+				goto out;
+			}
+			if (sp.conv == 'c') {
+				logfmt_out_advance(&o, snprintf(dst, room, spec, (int)v));
+			} else if (sp.conv == 'p') {
+				logfmt_out_advance(&o, snprintf(dst, room, spec, (void *)(uintptr_t)v));
+			} else if (sp.conv == 'd' || sp.conv == 'i') {
+				logfmt_out_advance(&o, snprintf(dst, room, spec, (long long)v));
+			} else {
+				logfmt_out_advance(&o, snprintf(dst, room, spec, (unsigned long long)v));
+			}
+			break;
+		}
+
+		lit = end;
+		p = end - 1;
+	}
+	logfmt_out_bytes(&o, lit, p - lit);
+
+out:
+	if (outsz) {
+		out[o.len < outsz ? o.len : outsz - 1] = '\0';
+	}
+	return o.len;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAUNCHD_LOGFMT_H__
+#define __LAUNCHD_LOGFMT_H__
+
+#include <sys/types.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+/*
+ * Deferred printf(3) formatting. logfmt_capture() stores a format string and
+ * the raw values of its arguments without converting any of them to text;
+ * logfmt_render() produces the text later, when someone actually reads it.
+ * Strings are copied at capture time, since whatever they point to may be
+ * gone by then.
+ *
+ * Only what launchd's own messages use is supported: the integer, floating
+ * point, character, string and pointer conversions with flags, widths and
+ * precisions, including '*'. Positional arguments, %n, long double and wide
+ * characters are not; capture fails for those and the caller formats the
+ * message immediately instead.
+ *
+ * A captured record contains no pointers and no alignment requirements, so it
+ * can be copied anywhere byte for byte.
+ */
+
+/* Returns the size of the record written to 'buf', or 0 if the format is not
+ * supported or the record does not fit in 'bufsz' bytes. Either way, 'ap' is
+ * consumed.
+ */
+size_t logfmt_capture(void *buf, size_t bufsz, const char *fmt, va_list ap);
+
+/* Renders a record like snprintf(3): 'out' is always terminated if 'outsz' is
+ * non-zero, and the return value is the length of the full text.
+ */
+size_t logfmt_render(char *out, size_t outsz, const void *rec, size_t reclen);
+
+#endif /* __LAUNCHD_LOGFMT_H__ */
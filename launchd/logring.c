@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "logring.h"
+
+void
+logring_init(struct logring *lr, void *buf, size_t size, size_t size_off)
+{
+	memset(lr, 0, sizeof(*lr));
+	lr->lr_buf = buf;
+	lr->lr_mask = size - 1;
+	lr->lr_size_off = size_off;
+}
+
+static uint64_t
+logring_record_size(const struct logring *lr, uint64_t pos)
+{
+	uint64_t sz;
+
+	memcpy(&sz, lr->lr_buf + (pos & lr->lr_mask) + lr->lr_size_off, sizeof(sz));
+	return sz;
+}
+
+/* Drops records from the tail until it is at or past 'pos'. */
+static void
+logring_evict(struct logring *lr, uint64_t pos)
+{
+	uint64_t sz;
+
+	while (lr->lr_tail < pos && lr->lr_tail < lr->lr_head) {
+		if (lr->lr_pad_len && lr->lr_tail == lr->lr_pad_start) {
+			lr->lr_tail += lr->lr_pad_len;
+			lr->lr_pad_len = 0;
+			continue;
+		}
+
+		sz = logring_record_size(lr, lr->lr_tail);
+		lr->lr_tail += sz;
+		lr->lr_cnt--;
+		lr->lr_dropped++;
+		lr->lr_dropped_bytes += sz;
+	}
+}
+
+void *
+logring_reserve(struct logring *lr, size_t sz)
+{
+	size_t cap = lr->lr_mask + 1;
+	size_t room = cap - (size_t)(lr->lr_head & lr->lr_mask);
+
+	if (sz == 0 || (sz & 7) || sz > cap) {
+		lr->lr_rejected++;
+		return NULL;
+	}
+
+	if (lr->lr_tail == lr->lr_head) {
+		/* Empty: start over at the beginning rather than wrap needlessly. */
+		lr->lr_head = lr->lr_tail = 0;
+		lr->lr_pad_len = 0;
+		room = cap;
+	}
+
+	if (room < sz) {
+		/* Anything older than one full buffer back, including the previous
+		 * wrap's padding, is overwritten by the time the head gets here.
+		 */
+		logring_evict(lr, lr->lr_head + room + sz - cap);
+		lr->lr_pad_start = lr->lr_head;
+		lr->lr_pad_len = room;
+		lr->lr_head += room;
+		if (lr->lr_tail == lr->lr_pad_start) {
+			lr->lr_tail = lr->lr_head;
+			lr->lr_pad_len = 0;
+		}
+	} else if (lr->lr_head + sz > cap) {
+		logring_evict(lr, lr->lr_head + sz - cap);
+	}
+
+	return lr->lr_buf + (lr->lr_head & lr->lr_mask);
+}
+
+void
+logring_commit(struct logring *lr, size_t sz)
+{
+	lr->lr_head += sz;
+	lr->lr_cnt++;
+}
+
+size_t
+logring_used(const struct logring *lr)
+{
+	return (size_t)(lr->lr_head - lr->lr_tail) - lr->lr_pad_len;
+}
+
+int
+logring_peek(const struct logring *lr, struct iovec iov[2])
+{
+	uint64_t first_end = lr->lr_pad_len ? lr->lr_pad_start : lr->lr_head;
+	uint64_t second = lr->lr_pad_len ? lr->lr_pad_start + lr->lr_pad_len : lr->lr_head;
+	int n = 0;
+
+	if (lr->lr_tail == lr->lr_head) {
+		return 0;
+	}
+
+	/* Without padding the live span can still cross the end of the buffer
+	 * if records happened to end exactly on it.
+	 */
+	if (!lr->lr_pad_len && (lr->lr_tail & ~(uint64_t)lr->lr_mask) != ((lr->lr_head - 1) & ~(uint64_t)lr->lr_mask)) {
+		first_end = (lr->lr_tail | lr->lr_mask) + 1;
+		second = first_end;
+	}
+
+	if (first_end > lr->lr_tail) {
+		iov[n].iov_base = lr->lr_buf + (lr->lr_tail & lr->lr_mask);
+		iov[n].iov_len = (size_t)(first_end - lr->lr_tail);
+		n++;
+	}
+	if (lr->lr_head > second) {
+		iov[n].iov_base = lr->lr_buf + (second & lr->lr_mask);
+		iov[n].iov_len = (size_t)(lr->lr_head - second);
+		n++;
+	}
+
+	return n;
+}
+
+size_t
+logring_drain(struct logring *lr, void *dst)
+{
+	struct iovec iov[2];
+	size_t off = 0;
+	int i, n = logring_peek(lr, iov);
+
+	for (i = 0; i < n; i++) {
+		memcpy((char *)dst + off, iov[i].iov_base, iov[i].iov_len);
+		off += iov[i].iov_len;
+	}
+	logring_clear(lr);
+
+	return off;
+}
+
+void
+logring_clear(struct logring *lr)
+{
+	lr->lr_head = lr->lr_tail = 0;
+	lr->lr_pad_len = 0;
+	lr->lr_cnt = 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAUNCHD_LOGRING_H__
+#define __LAUNCHD_LOGRING_H__
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A fixed-size byte ring of variable-length records, kept in exactly the form
+ * they are shipped in so that draining is a copy of at most two spans rather
+ * than a walk over the records. When a new record does not fit, the oldest
+ * ones are overwritten and counted as dropped; nothing is ever allocated.
+ *
+ * Records are 8-byte multiples and never straddle the end of the buffer: a
+ * record that would is placed at the start instead, and the unused end is
+ * skipped on drain. Each record carries its own length as a uint64_t at a
+ * fixed offset, which is how the ring finds the next one when evicting.
+ *
+ * There is no locking. Like the queue it replaces, the ring is only touched
+ * from launchd's main thread.
+ */
+
+struct logring {
+	char *lr_buf;
+	size_t lr_mask;			/* capacity - 1 */
+	size_t lr_size_off;		/* offset of each record's uint64_t length */
+	/* Monotonic byte positions; the live records are [lr_tail, lr_head). */
+	uint64_t lr_head;
+	uint64_t lr_tail;
+	/* Unused end of the buffer skipped by the last wrap, if still live. */
+	uint64_t lr_pad_start;
+	size_t lr_pad_len;
+	size_t lr_cnt;
+	uint64_t lr_dropped;		/* records overwritten before being drained */
+	uint64_t lr_dropped_bytes;
+	uint64_t lr_rejected;		/* records larger than the ring */
+};
+
+/* 'buf' must be 8-byte aligned and 'size' a power of two of at least 8. */
+void logring_init(struct logring *lr, void *buf, size_t size, size_t size_off);
+
+/* Room for a record of 'sz' bytes, evicting the oldest records as needed.
+ * Returns NULL, counting the record as rejected, if 'sz' is zero, not a
+ * multiple of 8 or larger than the ring. The record must be written,
+ * including its length, before logring_commit().
+ */
+void *logring_reserve(struct logring *lr, size_t sz);
+void logring_commit(struct logring *lr, size_t sz);
+
+/* Bytes of record data held, not counting any skipped end of the buffer. */
+size_t logring_used(const struct logring *lr);
+
+static inline size_t
+logring_count(const struct logring *lr)
+{
+	return lr->lr_cnt;
+}
+
+/* Points 'iov' at the live records, oldest first, in at most two spans, and
+ * returns how many spans there are. The ring is left as it is.
+ */
+int logring_peek(const struct logring *lr, struct iovec iov[2]);
+
+/* Copies the live records into 'dst', which must hold logring_used() bytes,
+ * and empties the ring.
+ */
+size_t logring_drain(struct logring *lr, void *dst);
+void logring_clear(struct logring *lr);
+
+#endif /* __LAUNCHD_LOGRING_H__ */
@@ -0,0 +1,474 @@
+#
+# Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Generates jobkeys.h (out=h) or jobkeys.c (out=c) from the job key
+# constants in launch.h and launch_priv.h:
+#
+#	awk -v out=h -f mkjobkeys.awk launch.h launch_priv.h > jobkeys.h
+#
+# Every LAUNCH_JOBKEY_FOO becomes JOBKEY_FOO in one enum. Keys are split into
+# tables by the namespace they are looked up in (top-level job keys, MachServices
+# options, KeepAlive conditions, ...), and each table gets a case-insensitive
+# minimal-probe perfect hash: one hash of the key, one displacement lookup and
+# one strcasecmp() to reject keys that are not in the table.
+#
+# The hash must stay in step with jobkey_hash() in the generated C. It is
+# computed here with plain arithmetic so that any POSIX awk will do.
+#
+
+BEGIN {
+	if (out != "h" && out != "c") {
+		print "mkjobkeys.awk: set out=h or out=c" > "/dev/stderr"
+		exit 1
+	}
+
+	for (i = 1; i < 128; i++) {
+		ord[sprintf("%c", i)] = i
+	}
+
+	# Sub-key namespaces, longest prefix first. Anything else under
+	# LAUNCH_JOBKEY_ is a top-level job key; MACHSERVICES and friends do
+	# not match LAUNCH_JOBKEY_MACH_ because of the trailing underscore.
+	ngroups = 0
+	group("LAUNCH_JOBKEY_MACH_", "jobkey_mach", "MachServices options")
+	group("LAUNCH_JOBKEY_KEEPALIVE_", "jobkey_keepalive", "KeepAlive conditions")
+	group("LAUNCH_JOBKEY_CAL_", "jobkey_cal", "StartCalendarInterval fields")
+	group("LAUNCH_JOBKEY_RESOURCELIMIT_", "jobkey_resourcelimit", "Soft/HardResourceLimits")
+	group("LAUNCH_JOBKEY_DISABLED_", "jobkey_disabled", "Disabled conditions")
+	group("LAUNCH_JOBKEY_SANDBOX_", "jobkey_sandbox", "SandboxFlags")
+	group("LAUNCH_JOBKEY_", "jobkey", "top-level job keys")
+	group("LAUNCH_JOBPOLICY_", "jobpolicy", "Policies")
+	group("LAUNCH_JOBSOCKETKEY_", "jobsocketkey", "Sockets entries")
+	group("LAUNCH_JOBINETDCOMPATIBILITY_", "jobinetdcompatibility", "inetdCompatibility")
+
+	nkeys = 0
+	MAXPOS = 16
+}
+
+function group(prefix, fn, desc) {
+	ngroups++
+	gprefix[ngroups] = prefix
+	gfn[ngroups] = fn
+	gdesc[ngroups] = desc
+	gcount[ngroups] = 0
+}
+
+function lower(s,    r, i, c) {
+	r = ""
+	for (i = 1; i <= length(s); i++) {
+		c = substr(s, i, 1)
+		if (c >= "A" && c <= "Z") {
+			c = sprintf("%c", ord[c] + 32)
+		}
+		r = r c
+	}
+	return r
+}
+
+# The character at position p, counting from the end if p is negative, or 0
+# past either end.
+function charat(s, p) {
+	if (p < 0) {
+		p += length(s)
+	}
+	if (p < 0 || p >= length(s)) {
+		return 0
+	}
+	return ord[substr(s, p + 1, 1)]
+}
+
+# a * m modulo 2^32, in halves so that no intermediate exceeds 2^53.
+function mul32(a, m,    hi, lo) {
+	hi = int(a / 65536)
+	lo = a % 65536
+	return ((hi * m) % 65536 * 65536 + lo * m) % 4294967296
+}
+
+# Without xor, a multiply-and-fold finalizer spreads the few characters that
+# were hashed over all 32 bits.
+function mix(h) {
+	h = mul32(h, 2246822507)
+	h = (h + int(h / 65536)) % 4294967296
+	h = mul32(h, 3266489909)
+	return (h + int(h / 65536)) % 4294967296
+}
+
+# djb2 and sdbm, both modulo 2^32, over the key's length and its lowercased
+# characters at the group's chosen positions.
+function hash(s, g,    i, c) {
+	s = lower(s)
+	h0 = 5381 + length(s)
+	h1 = length(s)
+	for (i = 1; i <= gnpos[g]; i++) {
+		c = charat(s, gpos[g, i])
+		h0 = (h0 * 33 + c) % 4294967296
+		h1 = (h1 * 65599 + c) % 4294967296
+	}
+	h0 = mix(h0)
+	h1 = mix(h1)
+}
+
+# Like gperf, only hash as many characters as it takes to tell the group's
+# keys apart: greedily add whichever of the first or last MAXPOS positions
+# splits the most keys until the length and those characters are unique.
+function positions(g,    n, i, k, p, best, bestn, cnt, sig, seen, distinct) {
+	n = gcount[g]
+	gnpos[g] = 0
+	distinct = 0
+	for (;;) {
+		split("", seen)
+		distinct = 0
+		for (i = 1; i <= n; i++) {
+			k = gmember[g, i]
+			sig = signature(g, lower(kstr[k]), "")
+			if (!(sig in seen)) {
+				seen[sig] = 1
+				distinct++
+			}
+		}
+		if (distinct == n) {
+			return
+		}
+
+		bestn = distinct
+		best = ""
+		for (p = -MAXPOS; p < MAXPOS; p++) {
+			split("", seen)
+			cnt = 0
+			for (i = 1; i <= n; i++) {
+				k = gmember[g, i]
+				sig = signature(g, lower(kstr[k]), p)
+				if (!(sig in seen)) {
+					seen[sig] = 1
+					cnt++
+				}
+			}
+			if (cnt > bestn) {
+				bestn = cnt
+				best = p
+			}
+		}
+		if (best == "") {
+			die("cannot tell the " gfn[g] " keys apart")
+		}
+		gpos[g, ++gnpos[g]] = best
+	}
+}
+
+function signature(g, s, extra,    i, sig) {
+	sig = length(s)
+	for (i = 1; i <= gnpos[g]; i++) {
+		sig = sig ":" charat(s, gpos[g, i])
+	}
+	if (extra != "") {
+		sig = sig ":" charat(s, extra)
+	}
+	return sig
+}
+
+function die(msg) {
+	print "mkjobkeys.awk: " msg > "/dev/stderr"
+	failed = 1
+	exit 1
+}
+
+/^#define[ \t]+LAUNCH_JOB(KEY|POLICY|SOCKETKEY|INETDCOMPATIBILITY)_[A-Z0-9_]+[ \t]+"/ {
+	name = $2
+	str = $3
+	if (str !~ /^"[^"]*"$/) {
+		die(FILENAME ":" FNR ": cannot parse " name)
+	}
+	str = substr(str, 2, length(str) - 2)
+	if (name in seen) {
+		next
+	}
+	seen[name] = 1
+
+	for (g = 1; g <= ngroups; g++) {
+		if (index(name, gprefix[g]) == 1) {
+			break
+		}
+	}
+
+	lc = lower(str)
+	if ((g SUBSEP lc) in gkey) {
+		die(name " and " gkey[g, lc] " are the same key")
+	}
+	gkey[g, lc] = name
+
+	nkeys++
+	kname[nkeys] = name
+	kstr[nkeys] = str
+	kgroup[nkeys] = g
+	gmember[g, ++gcount[g]] = nkeys
+}
+
+# Hash and displace: keys are bucketed by the top half of h0 and each bucket,
+# biggest first, gets the first displacement pair (d0, d1) for which every key
+# in it lands in a free slot (h1 + d0 * step + d1) mod size, step being h0 made
+# odd and so coprime to the size. The pair is stored as d0 << 8 | d1, which
+# caps tables at 256 slots.
+function build(g,    n, size, nb, b, i, k, d, ok, j, s, order, o, t, best) {
+	n = gcount[g]
+	size = 1
+	while (size < n) {
+		size *= 2
+	}
+	for (;;) {
+		nb = 1
+		while (nb * 2 <= n / 2) {
+			nb *= 2
+		}
+
+		for (i = 0; i < size; i++) {
+			slot[i] = 0
+		}
+		for (b = 0; b < nb; b++) {
+			bcount[b] = 0
+			disp[b] = 0
+		}
+		for (i = 1; i <= n; i++) {
+			k = gmember[g, i]
+			hash(kstr[k], g)
+			kh0[k] = h0
+			kh1[k] = h1
+			b = int(h0 / 65536) % nb
+			bmember[b, ++bcount[b]] = k
+		}
+
+		for (b = 0; b < nb; b++) {
+			order[b] = b
+		}
+		for (i = 0; i < nb; i++) {
+			best = i
+			for (j = i + 1; j < nb; j++) {
+				if (bcount[order[j]] > bcount[order[best]]) {
+					best = j
+				}
+			}
+			t = order[i]; order[i] = order[best]; order[best] = t
+		}
+
+		ok = 1
+		for (o = 0; o < nb && ok; o++) {
+			b = order[o]
+			if (bcount[b] == 0) {
+				break
+			}
+			for (d = 0; d < size * size; d++) {
+				ok = 1
+				for (j = 1; j <= bcount[b] && ok; j++) {
+					s = slotof(bmember[b, j], d, size)
+					if (slot[s]) {
+						ok = 0
+					}
+					for (i = 1; i < j && ok; i++) {
+						if (slotof(bmember[b, i], d, size) == s) {
+							ok = 0
+						}
+					}
+				}
+				if (ok) {
+					break
+				}
+			}
+			if (!ok) {
+				break
+			}
+			disp[b] = int(d / size) * 256 + d % size
+			for (j = 1; j <= bcount[b]; j++) {
+				slot[slotof(bmember[b, j], d, size)] = bmember[b, j]
+			}
+		}
+		if (ok) {
+			break
+		}
+		size *= 2
+		if (size > 256) {
+			die("no perfect hash for " gfn[g])
+		}
+	}
+
+	gsize[g] = size
+	gnb[g] = nb
+	for (i = 0; i < size; i++) {
+		gslot[g, i] = slot[i]
+	}
+	for (b = 0; b < nb; b++) {
+		gdisp[g, b] = disp[b]
+	}
+}
+
+function slotof(k, d, size,    step) {
+	step = kh0[k] % size
+	step = step - step % 2 + 1
+	return (kh1[k] % size + int(d / size) * step + d % size) % size
+}
+
+function enumname(name) {
+	return substr(name, 8)
+}
+
+function emit_h(    g, i) {
+	print "/* Generated from launch.h and launch_priv.h by mkjobkeys.awk. Do not edit. */"
+	print ""
+	print "#ifndef __LAUNCHD_JOBKEYS_H__"
+	print "#define __LAUNCHD_JOBKEYS_H__"
+	print ""
+	print "typedef enum {"
+	print "\tJOBKEY_UNKNOWN = 0,"
+	for (g = 1; g <= ngroups; g++) {
+		if (gcount[g] == 0) {
+			continue
+		}
+		print "\t/* " gdesc[g] " */"
+		for (i = 1; i <= gcount[g]; i++) {
+			print "\t" enumname(kname[gmember[g, i]]) ","
+		}
+	}
+	print "} jobkey_t;"
+	print ""
+	print "/* Each returns JOBKEY_UNKNOWN for a key that is not in its namespace. */"
+	for (g = 1; g <= ngroups; g++) {
+		if (gcount[g] == 0) {
+			continue
+		}
+		print "jobkey_t " gfn[g] "_lookup(const char *key) __attribute__((pure));"
+	}
+	print ""
+	print "#endif /* __LAUNCHD_JOBKEYS_H__ */"
+}
+
+function emit_c(    g, i, k) {
+	print "/* Generated from launch.h and launch_priv.h by mkjobkeys.awk. Do not edit. */"
+	print ""
+	print "#include <stddef.h>"
+	print "#include <stdint.h>"
+	print "#include <string.h>"
+	print "#include <strings.h>"
+	print ""
+	print "#include \"jobkeys.h\""
+	print ""
+	print "struct jobkey_slot {"
+	print "\tconst char *js_name;"
+	print "\tsize_t js_len;"
+	print "\tjobkey_t js_key;"
+	print "};"
+	print ""
+	print "struct jobkey_table {"
+	print "\tconst struct jobkey_slot *jt_slots;"
+	print "\tconst uint16_t *jt_disp;"
+	print "\tconst int8_t *jt_pos;\t\t/* negative counts from the end */"
+	print "\tuint32_t jt_mask;"
+	print "\tuint32_t jt_dmask;"
+	print "\tuint32_t jt_npos;"
+	print "};"
+	print ""
+	print "static inline uint32_t"
+	print "jobkey_mix(uint32_t h)"
+	print "{"
+	print "\th *= 0x85ebca6bu;"
+	print "\th += h >> 16;"
+	print "\th *= 0xc2b2ae35u;"
+	print "\treturn h + (h >> 16);"
+	print "}"
+	print ""
+	print "static inline jobkey_t"
+	print "jobkey_find(const struct jobkey_table *jt, const char *key)"
+	print "{"
+	print "\tsize_t i, p, len = strlen(key);"
+	print "\tuint32_t h0 = 5381 + (uint32_t)len, h1 = (uint32_t)len, step, d;"
+	print "\tconst struct jobkey_slot *js;"
+	print "\tunsigned char c;"
+	print ""
+	print "\tfor (i = 0; i < jt->jt_npos; i++) {"
+	print "\t\tp = jt->jt_pos[i] < 0 ? len - (size_t)-jt->jt_pos[i] : (size_t)jt->jt_pos[i];"
+	print "\t\tc = p < len ? (unsigned char)key[p] : 0;"
+	print "\t\tif (c >= 'A' && c <= 'Z') {"
+	print "\t\t\tc += 'a' - 'A';"
+	print "\t\t}"
+	print "\t\th0 = h0 * 33 + c;"
+	print "\t\th1 = h1 * 65599 + c;"
+	print "\t}"
+	print ""
+	print "\th0 = jobkey_mix(h0);"
+	print "\th1 = jobkey_mix(h1);"
+	print "\tstep = (h0 & jt->jt_mask) | 1;"
+	print "\td = jt->jt_disp[(h0 >> 16) & jt->jt_dmask];"
+	print "\tjs = &jt->jt_slots[(h1 + (d >> 8) * step + (d & 0xff)) & jt->jt_mask];"
+	print ""
+	print "\tif (js->js_len != len || strcasecmp(js->js_name, key) != 0) {"
+	print "\t\treturn JOBKEY_UNKNOWN;"
+	print "\t}"
+	print "\treturn js->js_key;"
+	print "}"
+
+	for (g = 1; g <= ngroups; g++) {
+		if (gcount[g] == 0) {
+			continue
+		}
+		print ""
+		print "static const struct jobkey_slot " gfn[g] "_slots[" gsize[g] "] = {"
+		for (i = 0; i < gsize[g]; i++) {
+			k = gslot[g, i]
+			if (k) {
+				print "\t{ \"" kstr[k] "\", " length(kstr[k]) ", " enumname(kname[k]) " },"
+			} else {
+				print "\t{ \"\", 0, JOBKEY_UNKNOWN },"
+			}
+		}
+		print "};"
+		print ""
+		printf "static const uint16_t %s_disp[%d] = {", gfn[g], gnb[g]
+		for (i = 0; i < gnb[g]; i++) {
+			printf "%s%d%s", (i % 12 == 0) ? "\n\t" : " ", gdisp[g, i], (i + 1 < gnb[g]) ? "," : ""
+		}
+		print ""
+		print "};"
+		print ""
+		printf "static const int8_t %s_pos[%d] = {", gfn[g], gnpos[g] ? gnpos[g] : 1
+		for (i = 1; i <= gnpos[g]; i++) {
+			printf " %d%s", gpos[g, i], (i < gnpos[g]) ? "," : ""
+		}
+		print gnpos[g] ? " };" : " 0 };"
+		print ""
+		print "static const struct jobkey_table " gfn[g] "_table = {"
+		print "\t" gfn[g] "_slots, " gfn[g] "_disp, " gfn[g] "_pos, " (gsize[g] - 1) ", " (gnb[g] - 1) ", " gnpos[g]
+		print "};"
+		print ""
+		print "jobkey_t"
+		print gfn[g] "_lookup(const char *key)"
+		print "{"
+		print "\treturn jobkey_find(&" gfn[g] "_table, key);"
+		print "}"
+	}
+}
+
+END {
+	if (failed) {
+		exit 1
+	}
+	for (g = 1; g <= ngroups; g++) {
+		if (gcount[g] > 0) {
+			positions(g)
+			build(g)
+		}
+	}
+	if (out == "h") {
+		emit_h()
+	} else {
+		emit_c()
+	}
+}
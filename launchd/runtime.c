@@ -40,7 +40,7 @@
 #include <sys/proc.h>
 #include <sys/proc_info.h>
 #include <libproc.h>
-#include <sys/event.h>
+#include "evloop.h"
 #include <sys/queue.h>
 #include <sys/socket.h>
 #include <sys/mount.h>
@@ -57,6 +57,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <syslog.h>
 #include <signal.h>
 #include <dlfcn.h>
@@ -76,6 +77,7 @@
 #include "vproc_internal.h"
 #include "jobServer.h"
 #include "job_reply.h"
+#include "timerq.h"
 
 #include <xpc/launchd.h>
 
@@ -89,19 +91,43 @@ static struct kevent *bulk_kev;
 static int bulk_kev_i;
 static int bulk_kev_cnt;
 
+#if HAS_MACH
 static pthread_t kqueue_demand_thread;
+static void *kqueue_demand_loop(void *arg);
+#endif
 
 static void mportset_callback(void);
 static kq_callback kqmportset_callback = (kq_callback)mportset_callback;
-static void *kqueue_demand_loop(void *arg);
+static void runtime_dispatch_kevents(int fd, const struct timespec *timeout);
+
+/* Every EVFILT_TIMER registered through kevent_mod() lives in runtime_timers
+ * instead of the kernel. The kernel only ever holds one timer, for whichever
+ * deadline comes first.
+ */
+struct runtime_timer {
+	LIST_ENTRY(runtime_timer) rt_sle;
+	struct timerq_entry rt_tqe;
+	uintptr_t rt_ident;
+	u_short rt_flags;
+	u_int rt_fflags;
+	void *rt_udata;
+};
+
+#define RUNTIME_TIMER_HASH_SIZE 256
+static LIST_HEAD(, runtime_timer) runtime_timer_hash[RUNTIME_TIMER_HASH_SIZE];
+static struct timerq runtime_timers;
+static uint64_t runtime_timers_armed = UINT64_MAX;
+static uint64_t runtime_timers_wall_armed = UINT64_MAX;
+
+static int runtime_timer_mod(uintptr_t ident, u_short flags, u_int fflags, intptr_t data, void *udata);
+static void runtime_timers_callback(void);
+static kq_callback kqtimers_callback = (kq_callback)runtime_timers_callback;
 
 boolean_t launchd_internal_demux(mach_msg_header_t *Request, mach_msg_header_t *Reply);
 static void launchd_runtime2(mach_msg_size_t msg_size);
 static mach_msg_size_t max_msg_size;
 static mig_callback *mig_cb_table;
 static size_t mig_cb_table_sz;
-static timeout_callback runtime_idle_callback;
-static mach_msg_timeout_t runtime_idle_timeout;
 static struct ldcred ldc;
 static audit_token_t ldc_token;
 static size_t runtime_standby_cnt;
@@ -199,8 +225,10 @@ launchd_runtime_init(void)
 	}
 
 	os_assert_zero(runtime_add_mport(launchd_internal_port, launchd_internal_demux));
+#if HAS_MACH
 	os_assert_zero(pthread_create(&kqueue_demand_thread, NULL, kqueue_demand_loop, NULL));
 	os_assert_zero(pthread_detach(kqueue_demand_thread));
+#endif
 
 	(void)posix_assumes_zero(sysctlbyname("vfs.generic.noremotehang", NULL, NULL, &p, sizeof(p)));
 }
@@ -315,7 +343,7 @@ log_kevent_struct(int level, struct kevent *kev_base, int indx)
 	unsigned short flags = kev->flags;
 	unsigned int fflags = kev->fflags;
 
-	if (likely(!(LOG_MASK(level & ~LOG_CONSOLE) & LOG_DEBUG))) {
+	if (likely(!launchd_syslog_enabled(level))) {
 		return;
 	}
 
@@ -514,6 +542,7 @@ mportset_callback(void)
 	(void)os_assumes_zero(vm_deallocate(mach_task_self(), (vm_address_t)members, (vm_size_t) membersCnt * sizeof(mach_port_name_t)));
 }
 
+#if HAS_MACH
 void *
 kqueue_demand_loop(void *arg __attribute__((unused)))
 {
@@ -540,17 +569,30 @@ kqueue_demand_loop(void *arg __attribute__((unused)))
 
 	return NULL;
 }
+#endif
 
 kern_return_t
 x_handle_kqueue(mach_port_t junk __attribute__((unused)), integer_t fd)
 {
 	struct timespec ts = { 0, 0 };
+
+	runtime_dispatch_kevents(fd, &ts);
+
+	return 0;
+}
+
+/* Drains one batch of kevents from 'fd' and calls through to each udata's
+ * kq_callback. With a NULL timeout, this blocks until something fires.
+ */
+static void
+runtime_dispatch_kevents(int fd, const struct timespec *timeout)
+{
 	struct kevent *kevi, kev[BULK_KEV_MAX];
 	int i;
 
 	bulk_kev = kev;
 
-	if ((bulk_kev_cnt = kevent(fd, NULL, 0, kev, BULK_KEV_MAX, &ts)) != -1) {
+	if ((bulk_kev_cnt = kevent(fd, NULL, 0, kev, BULK_KEV_MAX, timeout)) != -1) {
 #if 0	
 		for (i = 0; i < bulk_kev_cnt; i++) {
 			log_kevent_struct(LOG_DEBUG, &kev[0], i);
@@ -580,20 +622,28 @@ x_handle_kqueue(mach_port_t junk __attribute__((unused)), integer_t fd)
 				launchd_syslog(LOG_DEBUG, "Handled kevent.");
 			}
 		}
-	} else {
+	} else if (errno != EINTR) {
 		(void)os_assumes_zero(errno);
 	}
 
 	bulk_kev = NULL;
-
-	return 0;
 }
 
 void
 launchd_runtime(void)
 {
+#if HAS_MACH
 	launchd_runtime2(max_msg_size);
 	dispatch_main();
+#else
+	/* Without Mach there is no demand thread to bounce through; the main
+	 * thread owns the kqueue and blocks on it directly.
+	 */
+	for (;;) {
+		launchd_log_push();
+		runtime_dispatch_kevents(mainkq, NULL);
+	}
+#endif
 }
 
 kern_return_t
@@ -673,19 +723,33 @@ runtime_fork(mach_port_t bsport)
 	return r;
 }
 
-
-void
-runtime_set_timeout(timeout_callback to_cb, unsigned int sec)
+/* runtime_fork() for jobs whose setup fits in a spawn plan: the child comes
+ * back to us only once it has exec'd, with launchd's ignored signals reset.
+ */
+pid_t
+runtime_spawn(mach_port_t bsport, struct spawn_plan *sp, struct spawn_result *sr)
 {
-	if (sec == 0 || to_cb == NULL) {
-		runtime_idle_callback = NULL;
-		runtime_idle_timeout = 0;
-	}
+	int saved_errno;
+	pid_t r;
+
+	(void)os_assumes_zero(launchd_mport_make_send(bsport));
+	(void)os_assumes_zero(launchd_set_bport(bsport));
+	(void)os_assumes_zero(launchd_mport_deallocate(bsport));
+
+	sp->sp_sigdefault = sigign_set;
+	sigemptyset(&sp->sp_sigmask);
+
+	r = spawn_plan_exec(sp, sr);
+	saved_errno = errno;
 
-	runtime_idle_callback = to_cb;
-	runtime_idle_timeout = sec * 1000;
+	(void)os_assumes_zero(launchd_set_bport(MACH_PORT_NULL));
+
+	errno = saved_errno;
+
+	return r;
 }
 
+
 kern_return_t
 runtime_add_mport(mach_port_t name, mig_callback demux)
 {
@@ -782,11 +846,7 @@ kevent_mod(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t
 	case EVFILT_WRITE:
 		break;
 	case EVFILT_TIMER:
-		/* Workaround 5225889 */
-		if (flags & EV_ADD) {
-			(void)kevent_mod(ident, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
-		}
-		/* fall through */
+		return runtime_timer_mod(ident, flags, fflags, data, udata);
 	default:
 		flags |= EV_CLEAR;
 		break;
@@ -830,6 +890,180 @@ kevent_mod(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t
 	return r;
 }
 
+static uint64_t
+runtime_timers_now_mono(void)
+{
+	return runtime_opaque_time_to_nano(runtime_get_opaque_time());
+}
+
+static uint64_t
+runtime_timers_now_wall(void)
+{
+	return (uint64_t)runtime_get_wall_time() * NSEC_PER_USEC;
+}
+
+static struct runtime_timer *
+runtime_timer_find(uintptr_t ident)
+{
+	struct runtime_timer *rt;
+
+	LIST_FOREACH(rt, &runtime_timer_hash[(ident >> 4) % RUNTIME_TIMER_HASH_SIZE], rt_sle) {
+		if (rt->rt_ident == ident) {
+			return rt;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+runtime_timer_free(struct runtime_timer *rt)
+{
+	timerq_cancel(&runtime_timers, &rt->rt_tqe);
+	LIST_REMOVE(rt, rt_sle);
+	free(rt);
+}
+
+/* Points the kernel timers at the earliest deadlines in the queue. They are
+ * only moved earlier here; if one fires early, runtime_timers_callback() just
+ * finds nothing due and re-arms them.
+ *
+ * A relative timer counts down, so a step of the clock would leave it short
+ * of or past a wall-clock deadline. The earliest of those therefore also gets
+ * an absolute timer, which the kernel keeps on the wall clock even while
+ * launchd is idle. It is rounded up to a whole second so that it fits an
+ * intptr_t everywhere.
+ */
+static void
+runtime_timers_reprogram(void)
+{
+	uint64_t now = runtime_timers_now_mono();
+	uint64_t delta = timerq_next(&runtime_timers, now, runtime_timers_now_wall());
+	uint64_t wall = timerq_deadline(&runtime_timers, TIMERQ_CLOCK_WALL);
+	struct kevent kev;
+
+	if (wall < runtime_timers_wall_armed) {
+		EV_SET(&kev, (uintptr_t)&runtime_timers_wall_armed, EVFILT_TIMER, EV_ADD|EV_ONESHOT|EV_RECEIPT, NOTE_ABSOLUTE|NOTE_SECONDS, (wall + NSEC_PER_SEC - 1) / NSEC_PER_SEC, &kqtimers_callback);
+		if (posix_assumes_zero(kevent(mainkq, &kev, 1, &kev, 1, NULL)) != -1 && os_assumes_zero(kev.data) == 0) {
+			runtime_timers_wall_armed = wall;
+		}
+	}
+
+	if (delta == UINT64_MAX || now + delta >= runtime_timers_armed) {
+		return;
+	}
+
+	EV_SET(&kev, (uintptr_t)&runtime_timers, EVFILT_TIMER, EV_ADD|EV_ONESHOT|EV_RECEIPT, NOTE_NSECONDS, delta ? delta : 1, &kqtimers_callback);
+	if (posix_assumes_zero(kevent(mainkq, &kev, 1, &kev, 1, NULL)) != -1 && os_assumes_zero(kev.data) == 0) {
+		runtime_timers_armed = now + delta;
+	}
+}
+
+int
+runtime_timer_mod(uintptr_t ident, u_short flags, u_int fflags, intptr_t data, void *udata)
+{
+	struct runtime_timer *rt = runtime_timer_find(ident);
+	uint64_t ns, interval = 0;
+	int clock = TIMERQ_CLOCK_MONOTONIC;
+
+	if (flags & EV_DELETE) {
+		if (!rt) {
+			errno = ENOENT;
+			return -1;
+		}
+		runtime_timer_free(rt);
+		return 0;
+	}
+
+	if (!(flags & EV_ADD) || !udata || data < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (fflags & NOTE_SECONDS) {
+		ns = (uint64_t)data * NSEC_PER_SEC;
+	} else if (fflags & NOTE_USECONDS) {
+		ns = (uint64_t)data * NSEC_PER_USEC;
+	} else if (fflags & NOTE_NSECONDS) {
+		ns = (uint64_t)data;
+	} else {
+		ns = (uint64_t)data * NSEC_PER_MSEC;
+	}
+
+	/* Absolute timers are wall-clock deadlines and fire once. */
+	if (fflags & NOTE_ABSOLUTE) {
+		clock = TIMERQ_CLOCK_WALL;
+	} else {
+		if (!(flags & EV_ONESHOT)) {
+			interval = ns ? ns : 1;
+		}
+		ns += runtime_timers_now_mono();
+	}
+
+	if (!rt) {
+		if (!(rt = calloc(1, sizeof(*rt)))) {
+			errno = ENOMEM;
+			return -1;
+		}
+		timerq_entry_init(&rt->rt_tqe);
+		rt->rt_ident = ident;
+		LIST_INSERT_HEAD(&runtime_timer_hash[(ident >> 4) % RUNTIME_TIMER_HASH_SIZE], rt, rt_sle);
+	}
+
+	rt->rt_flags = flags & ~(EV_ADD|EV_RECEIPT);
+	rt->rt_fflags = fflags;
+	rt->rt_udata = udata;
+
+	if (timerq_arm(&runtime_timers, &rt->rt_tqe, clock, ns, interval) == -1) {
+		runtime_timer_free(rt);
+		return -1;
+	}
+
+	runtime_timers_reprogram();
+
+	return 0;
+}
+
+void
+runtime_timers_callback(void)
+{
+	runtime_timers_armed = UINT64_MAX;
+	runtime_timers_wall_armed = UINT64_MAX;
+	runtime_expire_timers();
+}
+
+void
+runtime_expire_timers(void)
+{
+	uint64_t now_mono = runtime_timers_now_mono();
+	uint64_t now_wall = runtime_timers_now_wall();
+	struct timerq_entry *te;
+	uint64_t n;
+
+	while ((te = timerq_pop_expired(&runtime_timers, now_mono, now_wall, &n))) {
+		struct runtime_timer *rt = (struct runtime_timer *)((char *)te - offsetof(struct runtime_timer, rt_tqe));
+		struct kevent kev;
+
+		EV_SET(&kev, rt->rt_ident, EVFILT_TIMER, rt->rt_flags, rt->rt_fflags, n, rt->rt_udata);
+		if (!timerq_entry_armed(te)) {
+			runtime_timer_free(rt);
+		}
+
+		launchd_syslog(LOG_DEBUG, "Dispatching timer: %lu", kev.ident);
+		runtime_ktrace(RTKT_LAUNCHD_BSD_KEVENT|DBG_FUNC_START, kev.ident, kev.filter, kev.fflags);
+		(*((kq_callback *)kev.udata))(kev.udata, &kev);
+		runtime_ktrace0(RTKT_LAUNCHD_BSD_KEVENT|DBG_FUNC_END);
+	}
+
+	runtime_timers_reprogram();
+}
+
+bool
+runtime_timers_overdue(void)
+{
+	return timerq_next(&runtime_timers, runtime_timers_now_mono(), runtime_timers_now_wall()) == 0;
+}
+
 boolean_t
 launchd_internal_demux(mach_msg_header_t *Request, mach_msg_header_t *Reply)
 {
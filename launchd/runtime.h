@@ -44,6 +44,7 @@
 #include "ktrace.h"
 #endif
 #include "log.h"
+#include "spawn.h"
 
 #define	likely(x)	__builtin_expect((bool)(x), true)
 #define	unlikely(x)	__builtin_expect((bool)(x), false)
@@ -60,7 +61,6 @@ struct ldcred {
 
 typedef void (*kq_callback)(void *, struct kevent *);
 typedef boolean_t (*mig_callback)(mach_msg_header_t *, mach_msg_header_t *);
-typedef void (*timeout_callback)(void);
 
 extern bool launchd_verbose_boot;
 /* Configuration knobs set in do_file_init(). */
@@ -105,7 +105,6 @@ int runtime_fsync(int fd);
 
 #define RUNTIME_ADVISABLE_IDLE_TIMEOUT 30
 
-void runtime_set_timeout(timeout_callback to_cb, unsigned int sec);
 kern_return_t runtime_add_mport(mach_port_t name, mig_callback demux);
 kern_return_t runtime_remove_mport(mach_port_t name);
 void runtime_record_caller_creds(audit_token_t *token);
@@ -117,9 +116,12 @@ const char *reboot_flags_to_C_names(unsigned int flags);
 
 int kevent_bulk_mod(struct kevent *kev, size_t kev_cnt);
 int kevent_mod(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t data, void *udata);
+void runtime_expire_timers(void);
+bool runtime_timers_overdue(void);
 void log_kevent_struct(int level, struct kevent *kev_base, int indx);
 
 pid_t runtime_fork(mach_port_t bsport);
+pid_t runtime_spawn(mach_port_t bsport, struct spawn_plan *sp, struct spawn_result *sr);
 
 mach_msg_return_t launchd_exc_runtime_once(mach_port_t port, mach_msg_size_t rcv_msg_size, mach_msg_size_t send_msg_size, mig_reply_error_t *bufRequest, mig_reply_error_t *bufReply, mach_msg_timeout_t to);
 
@@ -0,0 +1,562 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* For clone() and CLONE_*. */
+#define _GNU_SOURCE
+#endif
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#if HAVE_CLONE_VFORK
+#include <sys/syscall.h>
+#include <sched.h>
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <limits.h>
+#include <paths.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spawn.h"
+
+#ifndef DEFFILEMODE
+#define DEFFILEMODE (S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH)
+#endif
+
+#if HAVE_CLONE_VFORK
+/* The child runs on this much of the parent's stack; spawn_child_exec()'s
+ * path buffer is the bulk of it.
+ */
+#define SPAWN_STACK_SIZE (PATH_MAX + 16 * 1024)
+
+/* glibc's set*id() wrappers signal every thread in the process so that they
+ * all switch credentials, and they find those threads through memory the
+ * child shares with launchd. The child wants its own credentials only.
+ */
+#ifdef SYS_setuid32
+/* On 32-bit Linux the plain calls take 16-bit IDs. */
+#define spawn_setgid(g) syscall(SYS_setgid32, (g))
+#define spawn_setuid(u) syscall(SYS_setuid32, (u))
+#define spawn_setgroups(n, g) syscall(SYS_setgroups32, (n), (g))
+#else
+#define spawn_setgid(g) syscall(SYS_setgid, (g))
+#define spawn_setuid(u) syscall(SYS_setuid, (u))
+#define spawn_setgroups(n, g) syscall(SYS_setgroups, (n), (g))
+#endif
+#else
+#define spawn_setgid(g) setgid(g)
+#define spawn_setuid(u) setuid(u)
+#define spawn_setgroups(n, g) setgroups((n), (g))
+#endif
+
+void
+spawn_env_init(struct spawn_env *se)
+{
+	memset(se, 0, sizeof(*se));
+}
+
+void
+spawn_env_destroy(struct spawn_env *se)
+{
+	size_t i;
+
+	for (i = 0; i < se->se_envc; i++) {
+		free(se->se_envp[i]);
+	}
+	free(se->se_envp);
+	spawn_env_init(se);
+}
+
+/* Makes room for one more entry plus the terminating NULL. */
+static int
+spawn_env_grow(struct spawn_env *se)
+{
+	size_t cap;
+	char **envp;
+
+	if (se->se_envc + 2 <= se->se_envcap) {
+		return 0;
+	}
+
+	cap = se->se_envcap ? se->se_envcap * 2 : 32;
+	if ((envp = realloc(se->se_envp, cap * sizeof(envp[0]))) == NULL) {
+		return -1;
+	}
+
+	se->se_envp = envp;
+	se->se_envcap = cap;
+	return 0;
+}
+
+/* Also used by the child, so it must stay free of anything but reads. */
+static char *const *
+spawn_envp_find(char *const *envp, const char *key, size_t keylen)
+{
+	for (; envp && *envp; envp++) {
+		if (strncmp(*envp, key, keylen) == 0 && (*envp)[keylen] == '=') {
+			return envp;
+		}
+	}
+
+	return NULL;
+}
+
+int
+spawn_env_copy(struct spawn_env *se, char *const *envp)
+{
+	// Even an empty environment comes out as a valid, terminated array.
+	if (spawn_env_grow(se) == -1) {
+		return -1;
+	}
+	se->se_envp[se->se_envc] = NULL;
+
+	for (; envp && *envp; envp++) {
+		if (spawn_env_grow(se) == -1) {
+			return -1;
+		}
+		if ((se->se_envp[se->se_envc] = strdup(*envp)) == NULL) {
+			return -1;
+		}
+		se->se_envp[++se->se_envc] = NULL;
+	}
+
+	return 0;
+}
+
+int
+spawn_env_set(struct spawn_env *se, const char *key, const char *value, bool overwrite)
+{
+	size_t keylen = strlen(key), valuelen = strlen(value);
+	char **where;
+	char *kv;
+
+	if (keylen == 0 || strchr(key, '=')) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	where = (char **)spawn_envp_find(se->se_envp, key, keylen);
+	if (where && !overwrite) {
+		return 0;
+	}
+
+	if ((kv = malloc(keylen + valuelen + 2)) == NULL) {
+		return -1;
+	}
+	memcpy(kv, key, keylen);
+	kv[keylen] = '=';
+	memcpy(kv + keylen + 1, value, valuelen + 1);
+
+	if (where) {
+		free(*where);
+		*where = kv;
+		return 0;
+	}
+
+	if (spawn_env_grow(se) == -1) {
+		free(kv);
+		return -1;
+	}
+	se->se_envp[se->se_envc] = kv;
+	se->se_envp[++se->se_envc] = NULL;
+
+	return 0;
+}
+
+const char *
+spawn_env_get(const struct spawn_env *se, const char *key)
+{
+	size_t keylen = strlen(key);
+	char *const *where = spawn_envp_find(se->se_envp, key, keylen);
+
+	return where ? *where + keylen + 1 : NULL;
+}
+
+void
+spawn_plan_init(struct spawn_plan *sp)
+{
+	memset(sp, 0, sizeof(*sp));
+	sp->sp_ngroups = -1;
+	sp->sp_stdio_fd[0] = sp->sp_stdio_fd[1] = sp->sp_stdio_fd[2] = -1;
+	sigemptyset(&sp->sp_sigdefault);
+	sigemptyset(&sp->sp_sigmask);
+}
+
+const char *
+spawn_step_name(int step)
+{
+	switch (step) {
+	case SPAWN_STEP_NICE:		return "setpriority()";
+	case SPAWN_STEP_RLIMIT:		return "setrlimit()";
+	case SPAWN_STEP_CHROOT:		return "chroot()";
+	case SPAWN_STEP_SETLOGIN:	return "setlogin()";
+	case SPAWN_STEP_SETGID:		return "setgid()";
+	case SPAWN_STEP_SETGROUPS:	return "setgroups()";
+	case SPAWN_STEP_SETUID:		return "setuid()";
+	case SPAWN_STEP_CHDIR:		return "chdir()";
+	case SPAWN_STEP_OPEN:		return "open()";
+	case SPAWN_STEP_DUP2:		return "dup2()";
+	case SPAWN_STEP_SETPGID:	return "setpgid()";
+	case SPAWN_STEP_SETSID:		return "setsid()";
+	case SPAWN_STEP_EXEC:		return "execve()";
+	default:			return "unknown step";
+	}
+}
+
+static bool
+spawn_step_fatal(int step)
+{
+	switch (step) {
+	case SPAWN_STEP_SETLOGIN:
+	case SPAWN_STEP_SETGID:
+	case SPAWN_STEP_SETGROUPS:
+	case SPAWN_STEP_SETUID:
+	case SPAWN_STEP_EXEC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Everything below runs in the child, on memory it shares with launchd: only
+ * system calls and functions that do nothing but read and write the stack.
+ */
+
+static void
+spawn_child_report(int fd, int step, int error, int arg)
+{
+	struct spawn_report r = { step, error, arg };
+	ssize_t ignored __attribute__((unused));
+
+	ignored = write(fd, &r, sizeof(r));
+}
+
+static __attribute__((noreturn)) void
+spawn_child_fail(int fd, int step, int error)
+{
+	spawn_child_report(fd, step, error, 0);
+	_exit(error ? error : EXIT_FAILURE);
+}
+
+/* execvp(3) without the allocation, over the PATH the program will see. */
+static int
+spawn_child_exec(const struct spawn_plan *sp)
+{
+	char buf[PATH_MAX];
+	char *const *envp;
+	const char *p, *end;
+	size_t namelen, dirlen;
+	bool eacces = false;
+
+	if (!sp->sp_search || strchr(sp->sp_path, '/')) {
+		execve(sp->sp_path, sp->sp_argv, sp->sp_envp);
+		return errno;
+	}
+
+	if ((envp = spawn_envp_find(sp->sp_envp, "PATH", 4))) {
+		p = *envp + 5;
+	} else {
+		p = _PATH_DEFPATH;
+	}
+
+	namelen = strlen(sp->sp_path);
+	for (;; p = end + 1) {
+		if ((end = strchr(p, ':')) == NULL) {
+			end = p + strlen(p);
+		}
+
+		dirlen = (size_t)(end - p);
+		if (dirlen + namelen + 2 <= sizeof(buf)) {
+			/* An empty element means the current directory. */
+			memcpy(buf, p, dirlen);
+			buf[dirlen] = '/';
+			memcpy(buf + dirlen + 1, sp->sp_path, namelen + 1);
+
+			execve(dirlen ? buf : sp->sp_path, sp->sp_argv, sp->sp_envp);
+			switch (errno) {
+			case EACCES:
+				eacces = true;
+				break;
+			case ENOENT:
+			case ENOTDIR:
+			case ENAMETOOLONG:
+			case ELOOP:
+				break;
+			default:
+				return errno;
+			}
+		}
+
+		if (*end == '\0') {
+			break;
+		}
+	}
+
+	return eacces ? EACCES : ENOENT;
+}
+
+static void
+spawn_child_stdio(const struct spawn_plan *sp, int fd, int target)
+{
+	int newfd;
+
+	if (sp->sp_stdio_fd[target] == target) {
+		/* dup2() onto itself would leave close-on-exec set. */
+		if (fcntl(target, F_SETFD, 0) == -1) {
+			spawn_child_report(fd, SPAWN_STEP_DUP2, errno, target);
+		}
+		return;
+	} else if (sp->sp_stdio_fd[target] != -1) {
+		if (dup2(sp->sp_stdio_fd[target], target) == -1) {
+			spawn_child_report(fd, SPAWN_STEP_DUP2, errno, target);
+		}
+		return;
+	}
+
+	if (sp->sp_stdio_path[target] == NULL) {
+		return;
+	}
+
+	if ((newfd = open(sp->sp_stdio_path[target], sp->sp_stdio_flags[target]|O_NOCTTY, DEFFILEMODE)) == -1) {
+		spawn_child_report(fd, SPAWN_STEP_OPEN, errno, target);
+		return;
+	}
+
+	if (newfd != target) {
+		if (dup2(newfd, target) == -1) {
+			spawn_child_report(fd, SPAWN_STEP_DUP2, errno, target);
+		}
+		(void)close(newfd);
+	}
+}
+
+static __attribute__((noreturn)) void
+spawn_child(const struct spawn_plan *sp, int fd)
+{
+	struct sigaction sa;
+	struct rlimit rl;
+	size_t i;
+	int sig;
+
+	if (sp->sp_setnice && setpriority(PRIO_PROCESS, 0, sp->sp_nice) == -1) {
+		spawn_child_report(fd, SPAWN_STEP_NICE, errno, 0);
+	}
+
+	for (i = 0; i < sp->sp_nlimits; i++) {
+		const struct spawn_rlimit *sr = &sp->sp_limits[i];
+
+		if (getrlimit(sr->sr_which, &rl) == -1) {
+			spawn_child_report(fd, SPAWN_STEP_RLIMIT, errno, sr->sr_which);
+			continue;
+		}
+		if (sr->sr_sethard) {
+			rl.rlim_max = sr->sr_lim.rlim_max;
+		}
+		if (sr->sr_setsoft) {
+			rl.rlim_cur = sr->sr_lim.rlim_cur;
+		}
+		if (setrlimit(sr->sr_which, &rl) == -1) {
+			spawn_child_report(fd, SPAWN_STEP_RLIMIT, errno, sr->sr_which);
+		}
+	}
+
+	if (sp->sp_rootdir) {
+		if (chroot(sp->sp_rootdir) == -1 || chdir(".") == -1) {
+			spawn_child_report(fd, SPAWN_STEP_CHROOT, errno, 0);
+		}
+	}
+
+	if (sp->sp_setuser) {
+#if !defined(__linux__)
+		if (sp->sp_login && setlogin(sp->sp_login) == -1) {
+			spawn_child_fail(fd, SPAWN_STEP_SETLOGIN, errno);
+		}
+#endif
+		if (spawn_setgid(sp->sp_gid) == -1) {
+			spawn_child_fail(fd, SPAWN_STEP_SETGID, errno);
+		}
+		if (sp->sp_ngroups >= 0 && spawn_setgroups(sp->sp_ngroups, sp->sp_groups) == -1) {
+			spawn_child_fail(fd, SPAWN_STEP_SETGROUPS, errno);
+		}
+		if (spawn_setuid(sp->sp_uid) == -1) {
+			spawn_child_fail(fd, SPAWN_STEP_SETUID, errno);
+		}
+	}
+
+	if (sp->sp_workingdir && chdir(sp->sp_workingdir) == -1) {
+		spawn_child_report(fd, SPAWN_STEP_CHDIR, errno, 0);
+	}
+
+	if (sp->sp_setmask) {
+		umask(sp->sp_mask);
+	}
+
+	for (i = 0; i < 3; i++) {
+		spawn_child_stdio(sp, fd, (int)i);
+	}
+
+	if (sp->sp_setsid) {
+		if (setsid() == -1) {
+			spawn_child_report(fd, SPAWN_STEP_SETSID, errno, 0);
+		}
+	} else if (setpgid(0, 0) == -1) {
+		spawn_child_report(fd, SPAWN_STEP_SETPGID, errno, 0);
+	}
+
+	/* No handler of launchd's may run here, so every caught signal goes back
+	 * to its default before the mask the program starts with is installed.
+	 */
+	for (sig = 1; sig < NSIG; sig++) {
+		if (sigaction(sig, NULL, &sa) == -1) {
+			continue;
+		}
+		if (sigismember(&sp->sp_sigdefault, sig) || (sa.sa_handler != SIG_DFL && sa.sa_handler != SIG_IGN)) {
+			sa.sa_handler = SIG_DFL;
+			sa.sa_flags = 0;
+			sigemptyset(&sa.sa_mask);
+			(void)sigaction(sig, &sa, NULL);
+		}
+	}
+	(void)sigprocmask(SIG_SETMASK, &sp->sp_sigmask, NULL);
+
+	spawn_child_fail(fd, SPAWN_STEP_EXEC, spawn_child_exec(sp));
+}
+
+#if HAVE_CLONE_VFORK
+struct spawn_clone_args {
+	const struct spawn_plan *sca_sp;
+	int sca_fd;
+};
+
+static int
+spawn_clone_child(void *arg)
+{
+	struct spawn_clone_args *sca = arg;
+
+	spawn_child(sca->sca_sp, sca->sca_fd);
+}
+#endif
+
+/* Moves 'fd' above the standard descriptors, which the child is about to
+ * replace, and marks it close-on-exec. They are free for pipe() to hand out
+ * when launchd runs with its own stdio closed.
+ */
+static int
+spawn_fd_above_stdio(int fd)
+{
+	int newfd;
+
+	if (fd > STDERR_FILENO) {
+		(void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+		return fd;
+	}
+#ifdef F_DUPFD_CLOEXEC
+	newfd = fcntl(fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+#else
+	if ((newfd = fcntl(fd, F_DUPFD, STDERR_FILENO + 1)) != -1) {
+		(void)fcntl(newfd, F_SETFD, FD_CLOEXEC);
+	}
+#endif
+	(void)close(fd);
+	return newfd;
+}
+
+pid_t
+spawn_plan_exec(const struct spawn_plan *sp, struct spawn_result *sr)
+{
+	struct spawn_report r;
+	sigset_t all, oset;
+	int saved_errno;
+	int pfds[2];
+	ssize_t n;
+	pid_t p;
+
+	memset(sr, 0, sizeof(*sr));
+
+	if (pipe(pfds) == -1) {
+		return -1;
+	}
+	pfds[0] = spawn_fd_above_stdio(pfds[0]);
+	pfds[1] = spawn_fd_above_stdio(pfds[1]);
+	if (pfds[0] == -1 || pfds[1] == -1) {
+		saved_errno = errno;
+		if (pfds[0] != -1) {
+			(void)close(pfds[0]);
+		}
+		if (pfds[1] != -1) {
+			(void)close(pfds[1]);
+		}
+		errno = saved_errno;
+		return -1;
+	}
+
+	/* Nothing may interrupt the child while it runs on our memory. */
+	sigfillset(&all);
+	(void)sigprocmask(SIG_SETMASK, &all, &oset);
+
+#if HAVE_CLONE_VFORK
+	{
+		char stack[SPAWN_STACK_SIZE] __attribute__((aligned(16)));
+		struct spawn_clone_args sca = { sp, pfds[1] };
+
+		p = clone(spawn_clone_child, stack + sizeof(stack), CLONE_VM|CLONE_VFORK|SIGCHLD, &sca);
+	}
+#else
+	if ((p = vfork()) == 0) {
+		spawn_child(sp, pfds[1]);
+	}
+#endif
+	saved_errno = errno;
+
+	(void)sigprocmask(SIG_SETMASK, &oset, NULL);
+	(void)close(pfds[1]);
+
+	if (p == -1) {
+		(void)close(pfds[0]);
+		errno = saved_errno;
+		return -1;
+	}
+
+	/* By now the child has exec'd or exited, so this never waits. */
+	sr->sr_execed = true;
+	for (;;) {
+		if ((n = read(pfds[0], &r, sizeof(r))) == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n != sizeof(r)) {
+			break;
+		}
+		if (sr->sr_nreports < SPAWN_REPORTS_MAX) {
+			sr->sr_reports[sr->sr_nreports++] = r;
+		}
+		if (spawn_step_fatal(r.sr_step)) {
+			sr->sr_execed = false;
+		}
+	}
+	(void)close(pfds[0]);
+
+	return p;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAUNCHD_SPAWN_H__
+#define __LAUNCHD_SPAWN_H__
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Starting a job with fork(2) copies launchd's page tables and then has the
+ * child run job setup -- getpwnam(), setenv(), glob() -- on a copy-on-write
+ * image of launchd's heap. Both get more expensive as launchd grows.
+ *
+ * A spawn plan is everything that setup decides, worked out in the parent
+ * beforehand: argv, envp, credentials and supplementary groups, limits and
+ * the stdio paths. The child is then started with vfork(2), or clone(2) with
+ * CLONE_VM|CLONE_VFORK on Linux, and shares launchd's memory until it execs.
+ * It only reads the plan and makes system calls; it never allocates, never
+ * takes a lock and never returns into launchd's stack.
+ *
+ * Steps run in the order the fork path always ran them: nice, limits,
+ * chroot, credentials, working directory, umask, stdio, process group or
+ * session, signals, exec. Failures are reported back through a close-on-exec
+ * pipe, which also tells the parent whether the exec happened. Credential and
+ * exec failures end the child; the rest are reported and skipped, as before.
+ */
+
+enum {
+	SPAWN_STEP_NICE = 1,
+	SPAWN_STEP_RLIMIT,
+	SPAWN_STEP_CHROOT,
+	SPAWN_STEP_SETLOGIN,
+	SPAWN_STEP_SETGID,
+	SPAWN_STEP_SETGROUPS,
+	SPAWN_STEP_SETUID,
+	SPAWN_STEP_CHDIR,
+	SPAWN_STEP_OPEN,
+	SPAWN_STEP_DUP2,
+	SPAWN_STEP_SETPGID,
+	SPAWN_STEP_SETSID,
+	SPAWN_STEP_EXEC,
+};
+
+/* A NULL-terminated environment under construction, owning its strings. */
+struct spawn_env {
+	char **se_envp;
+	size_t se_envc;
+	size_t se_envcap;
+};
+
+struct spawn_rlimit {
+	int sr_which;
+	bool sr_sethard;
+	bool sr_setsoft;
+	struct rlimit sr_lim;
+};
+
+struct spawn_plan {
+	/* Executed as is if it contains a '/', otherwise looked up on the PATH of
+	 * sp_envp if sp_search is set.
+	 */
+	const char *sp_path;
+	bool sp_search;
+	char *const *sp_argv;
+
+	char *const *sp_envp;
+
+	bool sp_setnice;
+	int sp_nice;
+	const struct spawn_rlimit *sp_limits;
+	size_t sp_nlimits;
+	const char *sp_rootdir;
+
+	/* sp_login and sp_groups are only used when sp_setuser is set. A NULL
+	 * sp_login leaves the login name alone.
+	 */
+	bool sp_setuser;
+	uid_t sp_uid;
+	gid_t sp_gid;
+	const char *sp_login;
+	const gid_t *sp_groups;
+	int sp_ngroups;			/* -1 leaves the groups alone */
+
+	const char *sp_workingdir;
+	bool sp_setmask;
+	mode_t sp_mask;
+
+	/* For each of stdin, stdout and stderr: a descriptor to dup2() from, or
+	 * -1 and a path to open with the given flags, or neither.
+	 */
+	int sp_stdio_fd[3];
+	const char *sp_stdio_path[3];
+	int sp_stdio_flags[3];
+
+	bool sp_setsid;			/* otherwise setpgid(0, 0) */
+
+	/* Signals to reset to SIG_DFL, and the mask the program starts with. */
+	sigset_t sp_sigdefault;
+	sigset_t sp_sigmask;
+};
+
+#define SPAWN_REPORTS_MAX 16
+
+struct spawn_report {
+	int sr_step;
+	int sr_errno;
+	int sr_arg;			/* RLIMIT_* or target descriptor, if any */
+};
+
+struct spawn_result {
+	bool sr_execed;
+	size_t sr_nreports;
+	struct spawn_report sr_reports[SPAWN_REPORTS_MAX];
+};
+
+void spawn_env_init(struct spawn_env *se);
+void spawn_env_destroy(struct spawn_env *se);
+
+/* Appends copies of the NULL-terminated 'envp'. Returns -1 with errno set. */
+int spawn_env_copy(struct spawn_env *se, char *const *envp);
+
+/* Like setenv(3). Returns -1 with errno set. */
+int spawn_env_set(struct spawn_env *se, const char *key, const char *value, bool overwrite);
+const char *spawn_env_get(const struct spawn_env *se, const char *key);
+
+void spawn_plan_init(struct spawn_plan *sp);
+
+/* Starts the plan's program. Returns the child's PID, which has either
+ * exec'd or exited by the time this returns, or -1 with errno set if no child
+ * was created. What the child ran into is left in 'sr'.
+ */
+pid_t spawn_plan_exec(const struct spawn_plan *sp, struct spawn_result *sr);
+
+const char *spawn_step_name(int step);
+
+#endif /* __LAUNCHD_SPAWN_H__ */
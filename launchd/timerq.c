@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timerq.h"
+
+static void
+timerq_heap_place(struct timerq_heap *th, struct timerq_entry *te, size_t slot)
+{
+	th->th_entries[slot] = te;
+	te->te_slot = slot;
+}
+
+static void
+timerq_heap_up(struct timerq_heap *th, size_t slot)
+{
+	struct timerq_entry *te = th->th_entries[slot];
+
+	while (slot > 0) {
+		size_t parent = (slot - 1) / 2;
+		if (th->th_entries[parent]->te_deadline <= te->te_deadline) {
+			break;
+		}
+		timerq_heap_place(th, th->th_entries[parent], slot);
+		slot = parent;
+	}
+	timerq_heap_place(th, te, slot);
+}
+
+static void
+timerq_heap_down(struct timerq_heap *th, size_t slot)
+{
+	struct timerq_entry *te = th->th_entries[slot];
+
+	for (;;) {
+		size_t child = slot * 2 + 1;
+		if (child >= th->th_cnt) {
+			break;
+		}
+		if (child + 1 < th->th_cnt && th->th_entries[child + 1]->te_deadline < th->th_entries[child]->te_deadline) {
+			child++;
+		}
+		if (te->te_deadline <= th->th_entries[child]->te_deadline) {
+			break;
+		}
+		timerq_heap_place(th, th->th_entries[child], slot);
+		slot = child;
+	}
+	timerq_heap_place(th, te, slot);
+}
+
+static void
+timerq_heap_remove(struct timerq_heap *th, struct timerq_entry *te)
+{
+	size_t slot = te->te_slot;
+	struct timerq_entry *last = th->th_entries[--th->th_cnt];
+
+	te->te_slot = TIMERQ_IDLE;
+	if (last == te) {
+		return;
+	}
+
+	timerq_heap_place(th, last, slot);
+	if (slot > 0 && th->th_entries[(slot - 1) / 2]->te_deadline > last->te_deadline) {
+		timerq_heap_up(th, slot);
+	} else {
+		timerq_heap_down(th, slot);
+	}
+}
+
+void
+timerq_init(struct timerq *tq)
+{
+	memset(tq, 0, sizeof(*tq));
+}
+
+void
+timerq_destroy(struct timerq *tq)
+{
+	size_t i, j;
+
+	for (i = 0; i < TIMERQ_CLOCK_COUNT; i++) {
+		for (j = 0; j < tq->tq_heaps[i].th_cnt; j++) {
+			tq->tq_heaps[i].th_entries[j]->te_slot = TIMERQ_IDLE;
+		}
+		free(tq->tq_heaps[i].th_entries);
+	}
+	memset(tq, 0, sizeof(*tq));
+}
+
+void
+timerq_entry_init(struct timerq_entry *te)
+{
+	memset(te, 0, sizeof(*te));
+	te->te_slot = TIMERQ_IDLE;
+}
+
+int
+timerq_arm(struct timerq *tq, struct timerq_entry *te, int clock, uint64_t deadline, uint64_t interval)
+{
+	struct timerq_heap *th;
+
+	if (clock < 0 || clock >= TIMERQ_CLOCK_COUNT) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (timerq_entry_armed(te)) {
+		if (te->te_clock == clock) {
+			uint64_t old = te->te_deadline;
+
+			th = &tq->tq_heaps[clock];
+			te->te_deadline = deadline;
+			te->te_interval = interval;
+			if (deadline < old) {
+				timerq_heap_up(th, te->te_slot);
+			} else {
+				timerq_heap_down(th, te->te_slot);
+			}
+			return 0;
+		}
+		timerq_cancel(tq, te);
+	}
+
+	th = &tq->tq_heaps[clock];
+	if (th->th_cnt == th->th_cap) {
+		size_t cap = th->th_cap ? th->th_cap * 2 : 16;
+		struct timerq_entry **entries = realloc(th->th_entries, cap * sizeof(*entries));
+
+		if (!entries) {
+			errno = ENOMEM;
+			return -1;
+		}
+		th->th_entries = entries;
+		th->th_cap = cap;
+	}
+
+	te->te_deadline = deadline;
+	te->te_interval = interval;
+	te->te_clock = clock;
+	th->th_entries[th->th_cnt] = te;
+	te->te_slot = th->th_cnt++;
+	timerq_heap_up(th, te->te_slot);
+
+	return 0;
+}
+
+void
+timerq_cancel(struct timerq *tq, struct timerq_entry *te)
+{
+	if (timerq_entry_armed(te)) {
+		timerq_heap_remove(&tq->tq_heaps[te->te_clock], te);
+	}
+}
+
+uint64_t
+timerq_next(const struct timerq *tq, uint64_t now_mono, uint64_t now_wall)
+{
+	uint64_t now[TIMERQ_CLOCK_COUNT] = { now_mono, now_wall };
+	uint64_t r = UINT64_MAX;
+	size_t i;
+
+	for (i = 0; i < TIMERQ_CLOCK_COUNT; i++) {
+		const struct timerq_heap *th = &tq->tq_heaps[i];
+		uint64_t delta;
+
+		if (th->th_cnt == 0) {
+			continue;
+		}
+		delta = th->th_entries[0]->te_deadline > now[i] ? th->th_entries[0]->te_deadline - now[i] : 0;
+		if (delta < r) {
+			r = delta;
+		}
+	}
+
+	return r;
+}
+
+uint64_t
+timerq_deadline(const struct timerq *tq, int clock)
+{
+	const struct timerq_heap *th = &tq->tq_heaps[clock];
+
+	return th->th_cnt ? th->th_entries[0]->te_deadline : UINT64_MAX;
+}
+
+struct timerq_entry *
+timerq_pop_expired(struct timerq *tq, uint64_t now_mono, uint64_t now_wall, uint64_t *expirations)
+{
+	uint64_t now[TIMERQ_CLOCK_COUNT] = { now_mono, now_wall };
+	size_t i;
+
+	for (i = 0; i < TIMERQ_CLOCK_COUNT; i++) {
+		struct timerq_heap *th = &tq->tq_heaps[i];
+		struct timerq_entry *te;
+		uint64_t n = 1;
+
+		if (th->th_cnt == 0 || th->th_entries[0]->te_deadline > now[i]) {
+			continue;
+		}
+
+		te = th->th_entries[0];
+		if (te->te_interval) {
+			n += (now[i] - te->te_deadline) / te->te_interval;
+			te->te_deadline += n * te->te_interval;
+			timerq_heap_down(th, 0);
+		} else {
+			timerq_heap_remove(th, te);
+		}
+
+		if (expirations) {
+			*expirations = n;
+		}
+		return te;
+	}
+
+	return NULL;
+}
+
+size_t
+timerq_count(const struct timerq *tq)
+{
+	size_t i, r = 0;
+
+	for (i = 0; i < TIMERQ_CLOCK_COUNT; i++) {
+		r += tq->tq_heaps[i].th_cnt;
+	}
+
+	return r;
+}
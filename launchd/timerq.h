@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAUNCHD_TIMERQ_H__
+#define __LAUNCHD_TIMERQ_H__
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A deadline queue: one binary min-heap per clock, so that insertion,
+ * cancellation and expiry are all O(log n) no matter how many timers exist.
+ *
+ * Monotonic deadlines are immune to the wall clock being set. Wall deadlines
+ * (calendar events) are compared against the wall clock every time the queue
+ * is consulted, so stepping the clock forward makes them due immediately and
+ * stepping it back postpones them.
+ *
+ * The queue does not read any clock and does not call back into its users;
+ * the caller passes "now" in and pops expired entries one at a time.
+ */
+
+enum {
+	TIMERQ_CLOCK_MONOTONIC,
+	TIMERQ_CLOCK_WALL,
+	TIMERQ_CLOCK_COUNT,
+};
+
+#define TIMERQ_IDLE	((size_t)-1)
+
+struct timerq_entry {
+	uint64_t te_deadline;	/* nanoseconds, on te_clock */
+	uint64_t te_interval;	/* 0 for one-shot */
+	size_t te_slot;		/* heap index, or TIMERQ_IDLE */
+	int te_clock;
+};
+
+struct timerq_heap {
+	struct timerq_entry **th_entries;
+	size_t th_cnt;
+	size_t th_cap;
+};
+
+struct timerq {
+	struct timerq_heap tq_heaps[TIMERQ_CLOCK_COUNT];
+};
+
+void timerq_init(struct timerq *tq);
+void timerq_destroy(struct timerq *tq);
+
+void timerq_entry_init(struct timerq_entry *te);
+static inline bool
+timerq_entry_armed(const struct timerq_entry *te)
+{
+	return te->te_slot != TIMERQ_IDLE;
+}
+
+/* Queues 'te', or moves it if it is already queued. Returns -1 with errno set
+ * to ENOMEM if the heap could not grow.
+ */
+int timerq_arm(struct timerq *tq, struct timerq_entry *te, int clock, uint64_t deadline, uint64_t interval);
+void timerq_cancel(struct timerq *tq, struct timerq_entry *te);
+
+/* Nanoseconds until the earliest deadline on either clock: 0 if something is
+ * already due, UINT64_MAX if the queue is empty.
+ */
+uint64_t timerq_next(const struct timerq *tq, uint64_t now_mono, uint64_t now_wall);
+
+/* The earliest deadline on 'clock', or UINT64_MAX if it has none. */
+uint64_t timerq_deadline(const struct timerq *tq, int clock);
+
+/* Removes and returns one entry that is due, or NULL. Periodic entries are
+ * queued again for their next period before being returned; 'expirations'
+ * receives how many periods elapsed, counting any that were missed.
+ */
+struct timerq_entry *timerq_pop_expired(struct timerq *tq, uint64_t now_mono, uint64_t now_wall, uint64_t *expirations);
+
+size_t timerq_count(const struct timerq *tq);
+
+#endif /* __LAUNCHD_TIMERQ_H__ */
@@ -23,6 +23,8 @@
 #include <sys/event.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -50,6 +52,7 @@
 #endif // !TARGET_OS_EMBEDDED
 
 #include "launch.h"
+#include "launch_priv.h"
 
 #ifndef __APPLE__
 /*
@@ -61,13 +64,48 @@
 #define	LOG_LAUNCHD	(23<<3)
 #endif
 
+#define LAUNCHPROXY_KEVENTS 16
+
+/*
+ * A worker is a copy of the program started ahead of time, for programs that
+ * can serve more than one connection. Its standard input is a UNIX-domain
+ * sequenced-packet socket. Each connection arrives on it as a one-byte message
+ * carrying the connected socket (SCM_RIGHTS). When the worker has finished
+ * with the connection and closed it, it sends one byte back to ask for the
+ * next one. The worker should exit when its standard input reaches EOF.
+ * Unlike a datagram pair, the socket reads as EOF once the worker has died,
+ * which is how a worker lost in the middle of a connection is noticed.
+ */
+struct worker {
+	pid_t pid;
+	int fd;
+	bool idle;
+	bool served;
+};
+
 static int kq = 0;
+static int *listeners;
+static size_t nlisteners;
+static bool listening = true;
+
+static launch_data_t resp;
+static const char *prog;
+static char **prog_argv;
+static bool dupstdout = true, dupstderr = true;
+
+static bool batch_accept;
+static bool log_connections = true;
+static unsigned int max_children;
+static unsigned int nchildren;
+
+static struct worker *workers;
+static unsigned int nworkers, nidle, nalive;
 
 static void find_fds(launch_data_t o, const char *key __attribute__((unused)), void *context __attribute__((unused)))
 {
 	struct kevent kev;
 	size_t i;
-	int fd;
+	int fd, *tmp;
 
 	switch (launch_data_get_type(o)) {
 	case LAUNCH_DATA_FD:
@@ -76,8 +114,12 @@ static void find_fds(launch_data_t o, const char *key __attribute__((unused)), v
 			break;
 		fcntl(fd, F_SETFD, 1);
 		EV_SET(&kev, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
-		if (kevent(kq, &kev, 1, NULL, 0, NULL) == -1)
+		if (kevent(kq, &kev, 1, NULL, 0, NULL) == -1) {
 			syslog(LOG_DEBUG, "kevent(%d): %m", fd);
+		} else if ((tmp = realloc(listeners, (nlisteners + 1) * sizeof(listeners[0])))) {
+			listeners = tmp;
+			listeners[nlisteners++] = fd;
+		}
 		break;
 	case LAUNCH_DATA_ARRAY:
 		for (i = 0; i < launch_data_array_get_count(o); i++)
@@ -91,16 +133,313 @@ static void find_fds(launch_data_t o, const char *key __attribute__((unused)), v
 	}
 }
 
+/* Whether another connection can be taken on right now. */
+static bool have_capacity(void)
+{
+	if (nworkers)
+		return nidle > 0;
+	return max_children == 0 || nchildren < max_children;
+}
+
+/* Connections beyond our capacity wait in the kernel's accept queue. */
+static void set_listening(bool on)
+{
+	struct kevent kev;
+	size_t i;
+
+	if (on == listening)
+		return;
+	for (i = 0; i < nlisteners; i++) {
+		EV_SET(&kev, listeners[i], EVFILT_READ, on ? EV_ENABLE : EV_DISABLE, 0, 0, NULL);
+		if (kevent(kq, &kev, 1, NULL, 0, NULL) == -1)
+			syslog(LOG_DEBUG, "kevent(%d): %m", listeners[i]);
+	}
+	listening = on;
+}
+
+static void log_connection(const struct sockaddr_storage *ss, socklen_t slen)
+{
+	char fromhost[NI_MAXHOST];
+	char fromport[NI_MAXSERV];
+	int gni_r;
+
+	if (ss->ss_family == AF_INET || ss->ss_family == AF_INET6) {
+		gni_r = getnameinfo((const struct sockaddr *)ss, slen,
+				fromhost, (socklen_t) sizeof fromhost,
+				fromport, (socklen_t) sizeof fromport,
+				NI_NUMERICHOST | NI_NUMERICSERV);
+
+		if (gni_r) {
+			syslog(LOG_WARNING, "%s: getnameinfo(): %s", prog, gai_strerror(gni_r));
+		} else {
+			syslog(LOG_INFO, "%s: Connection from: %s on port: %s", prog, fromhost, fromport);
+		}
+	} else {
+		syslog(LOG_WARNING, "%s: getnameinfo() only supports IPv4/IPv6. Connection from address family: %u", prog, ss->ss_family);
+	}
+}
+
+/* What every child does before it becomes the program. */
+static void child_setup(void)
+{
+	launch_data_t tmp __attribute__((unused));
+
+	setpgid(0, 0);
+
+#if !TARGET_OS_EMBEDDED
+	if ((tmp = launch_data_dict_lookup(resp, LAUNCH_JOBKEY_SESSIONCREATE)) && launch_data_get_bool(tmp)) {
+		auditinfo_addr_t auinfo = {
+			.ai_termid = { .at_type = AU_IPv4 },
+			.ai_asid = AU_ASSIGN_ASID,
+			.ai_auid = getuid(),
+			.ai_flags = 0,
+		};
+		if (setaudit_addr(&auinfo, sizeof(auinfo)) == 0) {
+			char session[16]; 
+			snprintf(session, sizeof(session), "%x", auinfo.ai_asid);
+			setenv("SECURITYSESSIONID", session, 1);
+		} else {
+			syslog(LOG_NOTICE, "%s: Setting Audit Session ID failed: %d", prog, errno);
+		}
+	}
+#endif // !TARGET_OS_EMBEDDED
+	signal(SIGCHLD, SIG_DFL);
+}
+
+/* Runs the program on connection 'r'. Returns false if we should give up. */
+static bool exec_connection(int r, const struct sockaddr_storage *ss, socklen_t slen)
+{
+	switch (fork()) {
+	case -1:
+		syslog(LOG_WARNING, "fork(): %m");
+		close(r);
+		return errno != ENOMEM;
+	case 0:
+		break;
+	default:
+		close(r);
+		if (max_children)
+			nchildren++;
+		return true;
+	}
+
+	child_setup();
+	/* Done here rather than before the fork so that a slow syslogd never
+	 * holds up the accept loop.
+	 */
+	if (log_connections)
+		log_connection(ss, slen);
+	fcntl(r, F_SETFL, 0);
+	fcntl(r, F_SETFD, 1);
+	dup2(r, STDIN_FILENO);
+	if (dupstdout)
+		dup2(r, STDOUT_FILENO);
+	if (dupstderr)
+		dup2(r, STDERR_FILENO);
+	execv(prog, prog_argv);
+	syslog(LOG_ERR, "execv(): %m");
+	exit(EXIT_FAILURE);
+}
+
+static bool worker_spawn(struct worker *wk)
+{
+	struct kevent kev;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+		syslog(LOG_WARNING, "socketpair(): %m");
+		return false;
+	}
+	fcntl(sv[0], F_SETFD, 1);
+
+	switch ((wk->pid = fork())) {
+	case -1:
+		syslog(LOG_WARNING, "fork(): %m");
+		close(sv[0]);
+		close(sv[1]);
+		return false;
+	case 0:
+		child_setup();
+		dup2(sv[1], STDIN_FILENO);
+		if (sv[1] != STDIN_FILENO)
+			close(sv[1]);
+		execv(prog, prog_argv);
+		syslog(LOG_ERR, "execv(): %m");
+		_exit(EXIT_FAILURE);
+	default:
+		break;
+	}
+
+	close(sv[1]);
+	wk->fd = sv[0];
+	wk->idle = true;
+	wk->served = false;
+	nidle++;
+	nalive++;
+
+	EV_SET(&kev, wk->fd, EVFILT_READ, EV_ADD, 0, 0, wk);
+	if (kevent(kq, &kev, 1, NULL, 0, NULL) == -1)
+		syslog(LOG_WARNING, "kevent(%d): %m", wk->fd);
+	return true;
+}
+
+/* Worker 'wk' has gone away, or can no longer be reached: replaces it, unless
+ * it never took a connection, and gives up if none are left.
+ */
+static void worker_lost(struct worker *wk)
+{
+	close(wk->fd);
+	wk->fd = -1;
+	nalive--;
+	if (wk->idle)
+		nidle--;
+
+	/* A worker that never took a connection is not going to take the next
+	 * one either.
+	 */
+	if (!wk->served) {
+		syslog(LOG_ERR, "%s: worker %d exited without serving a connection", prog, wk->pid);
+	} else {
+		(void)worker_spawn(wk);
+	}
+
+	if (nalive == 0) {
+		syslog(LOG_ERR, "%s: no workers left", prog);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Hands connection 'r' to an idle worker, trying the next one if a worker
+ * cannot be reached. The caller closes its copy.
+ */
+static void worker_hand_off(int r)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	struct worker *wk;
+	char c = 0;
+	unsigned int i;
+	ssize_t n;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&cmsg, 0, sizeof(cmsg));
+	iov.iov_base = &c;
+	iov.iov_len = sizeof(c);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsg.buf;
+	msg.msg_controllen = sizeof(cmsg.buf);
+	cmsg.hdr.cmsg_len = CMSG_LEN(sizeof(int));
+	cmsg.hdr.cmsg_level = SOL_SOCKET;
+	cmsg.hdr.cmsg_type = SCM_RIGHTS;
+	memcpy(CMSG_DATA(&cmsg.hdr), &r, sizeof(int));
+
+	fcntl(r, F_SETFL, 0);
+
+	/* Each slot is tried at most once, so a replacement spawned into it
+	 * below waits for the next connection.
+	 */
+	for (i = 0; i < nworkers; i++) {
+		wk = &workers[i];
+		if (wk->fd == -1 || !wk->idle)
+			continue;
+
+		while ((n = sendmsg(wk->fd, &msg, 0)) == -1 && errno == EINTR)
+			;
+		if (n == -1) {
+			syslog(LOG_WARNING, "%s: sendmsg() to worker %d: %m", prog, wk->pid);
+			worker_lost(wk);
+			continue;
+		}
+		wk->idle = false;
+		wk->served = true;
+		nidle--;
+		return;
+	}
+}
+
+/* A worker asked for another connection, or went away. */
+static void worker_callback(struct worker *wk)
+{
+	char c;
+	ssize_t n;
+
+	while ((n = read(wk->fd, &c, sizeof(c))) == -1 && errno == EINTR)
+		;
+	if (n > 0) {
+		if (!wk->idle) {
+			wk->idle = true;
+			nidle++;
+		}
+		return;
+	}
+
+	worker_lost(wk);
+}
+
+static void reap_children(void)
+{
+	while (waitpid(-1, NULL, WNOHANG) > 0) {
+		if (nchildren)
+			nchildren--;
+	}
+}
+
+/* Takes connections off listening socket 'fd': one, or as many as are
+ * waiting and we have room for. Returns false if we should give up.
+ */
+static bool accept_connections(int fd)
+{
+	struct sockaddr_storage ss;
+	socklen_t slen;
+	int r;
+
+	do {
+		if (!have_capacity())
+			break;
+
+		slen = (socklen_t)sizeof ss;
+#ifdef SOCK_CLOEXEC
+		r = accept4(fd, (struct sockaddr *)&ss, &slen, SOCK_CLOEXEC);
+#else
+		if ((r = accept(fd, (struct sockaddr *)&ss, &slen)) != -1)
+			fcntl(r, F_SETFD, 1);
+#endif
+		if (r == -1) {
+			if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR || errno == ECONNABORTED)
+				break;
+			syslog(LOG_WARNING, "accept(): %m");
+			return false;
+		}
+
+		if (nworkers) {
+			if (log_connections)
+				log_connection(&ss, slen);
+			worker_hand_off(r);
+			close(r);
+		} else if (!exec_connection(r, &ss, slen)) {
+			return false;
+		}
+	} while (batch_accept);
+
+	return true;
+}
+
 int main(int argc __attribute__((unused)), char *argv[])
 {
 	struct timespec timeout = { 10, 0 };
-	struct sockaddr_storage ss;
-	socklen_t slen = (socklen_t)sizeof ss;
-	struct kevent kev;
-	int r, ec = EXIT_FAILURE;
-	launch_data_t tmp, resp, msg = launch_data_alloc(LAUNCH_DATA_STRING);
-	const char *prog = argv[1];
-	bool w = false, dupstdout = true, dupstderr = true;
+	struct kevent kev[LAUNCHPROXY_KEVENTS];
+	int i, r, ec = EXIT_FAILURE;
+	launch_data_t tmp, inetd, msg = launch_data_alloc(LAUNCH_DATA_STRING);
+	bool w = false;
+	size_t n;
+
+	prog = argv[1];
+	prog_argv = argv + 1;
 
 	launch_data_set_string(msg, LAUNCH_KEY_CHECKIN);
 
@@ -131,11 +470,18 @@ int main(int argc __attribute__((unused)), char *argv[])
 	if (tmp)
 		prog = launch_data_get_string(tmp);
 
-	tmp = launch_data_dict_lookup(resp, LAUNCH_JOBKEY_INETDCOMPATIBILITY);
-	if (tmp) {
-		tmp = launch_data_dict_lookup(tmp, LAUNCH_JOBINETDCOMPATIBILITY_WAIT);
-		if (tmp)
+	inetd = launch_data_dict_lookup(resp, LAUNCH_JOBKEY_INETDCOMPATIBILITY);
+	if (inetd) {
+		if ((tmp = launch_data_dict_lookup(inetd, LAUNCH_JOBINETDCOMPATIBILITY_WAIT)))
 			w = launch_data_get_bool(tmp);
+		if ((tmp = launch_data_dict_lookup(inetd, LAUNCH_JOBINETDCOMPATIBILITY_BATCHACCEPT)))
+			batch_accept = launch_data_get_bool(tmp);
+		if ((tmp = launch_data_dict_lookup(inetd, LAUNCH_JOBINETDCOMPATIBILITY_LOGCONNECTIONS)))
+			log_connections = launch_data_get_bool(tmp);
+		if ((tmp = launch_data_dict_lookup(inetd, LAUNCH_JOBINETDCOMPATIBILITY_MAXCHILDREN)))
+			max_children = (unsigned int)launch_data_get_integer(tmp);
+		if ((tmp = launch_data_dict_lookup(inetd, LAUNCH_JOBINETDCOMPATIBILITY_WORKERS)))
+			nworkers = (unsigned int)launch_data_get_integer(tmp);
 	}
 
 	if (launch_data_dict_lookup(resp, LAUNCH_JOBKEY_STANDARDOUTPATH))
@@ -144,99 +490,72 @@ int main(int argc __attribute__((unused)), char *argv[])
 	if (launch_data_dict_lookup(resp, LAUNCH_JOBKEY_STANDARDERRORPATH))
 		dupstderr = false;
 
-	if (!w)
+	if (!w && batch_accept) {
+		for (n = 0; n < nlisteners; n++)
+			fcntl(listeners[n], F_SETFL, fcntl(listeners[n], F_GETFL) | O_NONBLOCK);
+	}
+
+	if (!w && max_children && !nworkers) {
+		/* Children have to be reaped to be counted. */
+		EV_SET(&kev[0], SIGCHLD, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
+		if (kevent(kq, &kev[0], 1, NULL, 0, NULL) == -1) {
+			syslog(LOG_ERR, "kevent(SIGCHLD): %m");
+			goto out;
+		}
+	} else if (!w) {
 		signal(SIGCHLD, SIG_IGN);
+	}
+
+	if (!w && nworkers) {
+		if ((workers = calloc(nworkers, sizeof(workers[0]))) == NULL) {
+			syslog(LOG_ERR, "calloc(): %m");
+			goto out;
+		}
+		for (n = 0; n < nworkers; n++) {
+			workers[n].fd = -1;
+			(void)worker_spawn(&workers[n]);
+		}
+		if (nalive == 0)
+			goto out;
+	}
 
 	for (;;) {
-		if ((r = kevent(kq, NULL, 0, &kev, 1, &timeout)) == -1) {
+		if ((r = kevent(kq, NULL, 0, kev, w ? 1 : LAUNCHPROXY_KEVENTS, &timeout)) == -1) {
+			if (errno == EINTR)
+				continue;
 			syslog(LOG_DEBUG, "kevent(): %m");
 			goto out;
 		} else if (r == 0) {
-			ec = EXIT_SUCCESS;
-			goto out;
+			/* Idle, but not while a worker is still busy. */
+			if (nidle == nalive) {
+				ec = EXIT_SUCCESS;
+				goto out;
+			}
+			continue;
 		}
 
 		if (w) {
-			dup2((int)kev.ident, STDIN_FILENO);
+			dup2((int)kev[0].ident, STDIN_FILENO);
 			if (dupstdout)
-				dup2((int)kev.ident, STDOUT_FILENO);
+				dup2((int)kev[0].ident, STDOUT_FILENO);
 			if (dupstderr)
-				dup2((int)kev.ident, STDERR_FILENO);
-			execv(prog, argv + 1);
+				dup2((int)kev[0].ident, STDERR_FILENO);
+			execv(prog, prog_argv);
 			syslog(LOG_ERR, "execv(): %m");
 			exit(EXIT_FAILURE);
 		}
 
-		if ((r = accept((int)kev.ident, (struct sockaddr *)&ss, &slen)) == -1) {
-			if (errno == EWOULDBLOCK)
-				continue;
-			syslog(LOG_WARNING, "accept(): %m");
-			goto out;
-		} else {
-			if (ss.ss_family == AF_INET || ss.ss_family == AF_INET6) {
-				char fromhost[NI_MAXHOST];
-				char fromport[NI_MAXSERV];
-				int gni_r;
-
-				gni_r = getnameinfo((struct sockaddr *)&ss, slen,
-						fromhost, (socklen_t) sizeof fromhost,
-						fromport, (socklen_t) sizeof fromport,
-						NI_NUMERICHOST | NI_NUMERICSERV);
-
-				if (gni_r) {
-					syslog(LOG_WARNING, "%s: getnameinfo(): %s", prog, gai_strerror(gni_r));
-				} else {
-					syslog(LOG_INFO, "%s: Connection from: %s on port: %s", prog, fromhost, fromport);
-				}
-			} else {
-				syslog(LOG_WARNING, "%s: getnameinfo() only supports IPv4/IPv6. Connection from address family: %u", prog, ss.ss_family);
-			}
-
-			switch (fork()) {
-			case -1:
-				syslog(LOG_WARNING, "fork(): %m");
-				if (errno != ENOMEM) {
-					continue;
-				}
+		for (i = 0; i < r; i++) {
+			if (kev[i].filter == EVFILT_SIGNAL) {
+				reap_children();
+			} else if (kev[i].udata) {
+				worker_callback(kev[i].udata);
+			} else if (!accept_connections((int)kev[i].ident)) {
 				goto out;
-			case 0:
-				break;
-			default:
-				close(r);
-				continue;
-			}
-
-			setpgid(0, 0);
-
-#if !TARGET_OS_EMBEDDED
-			if ((tmp = launch_data_dict_lookup(resp, LAUNCH_JOBKEY_SESSIONCREATE)) && launch_data_get_bool(tmp)) {
-				auditinfo_addr_t auinfo = {
-					.ai_termid = { .at_type = AU_IPv4 },
-					.ai_asid = AU_ASSIGN_ASID,
-					.ai_auid = getuid(),
-					.ai_flags = 0,
-				};
-				if (setaudit_addr(&auinfo, sizeof(auinfo)) == 0) {
-					char session[16]; 
-					snprintf(session, sizeof(session), "%x", auinfo.ai_asid);
-					setenv("SECURITYSESSIONID", session, 1);
-				} else {
-					syslog(LOG_NOTICE, "%s: Setting Audit Session ID failed: %d", prog, errno);
-				}
 			}
-#endif // !TARGET_OS_EMBEDDED
-			fcntl(r, F_SETFL, 0);
-			fcntl(r, F_SETFD, 1);
-			dup2(r, STDIN_FILENO);
-			if (dupstdout)
-				dup2(r, STDOUT_FILENO);
-			if (dupstderr)
-				dup2(r, STDERR_FILENO);
-			signal(SIGCHLD, SIG_DFL);
-			execv(prog, argv + 1);
-			syslog(LOG_ERR, "execv(): %m");
-			exit(EXIT_FAILURE);
 		}
+
+		set_listening(have_capacity());
 	}
 
 out:
@@ -18,15 +18,46 @@
  * @APPLE_APACHE_LICENSE_HEADER_END@
  */
 #include "launch.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
 #include "byteswap.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 /* NOTE: defined temporarily in liblaunch.c */
 extern int _fd(int fd);
+extern void _launch_msg_release(launch_data_t root);
+
+/* Dictionaries are stored as an interleaved key/value _array, which is also
+ * their wire format. Once a heap-owned dictionary grows past
+ * LAUNCH_DATA_DICT_INDEX_THRESHOLD keys we move its _array into a
+ * _launch_dict_index block and mark the node with LAUNCH_DATA_INDEXED. The
+ * block carries an open-addressed table of (pair index + 1) keyed by a
+ * case-insensitive hash, so lookups stop scanning the array while iteration
+ * order and launch_data_pack() output stay exactly the same.
+ *
+ * Dictionaries unpacked in place from a receive buffer are never indexed
+ * since we do not own their storage.
+ */
+#define LAUNCH_DATA_DICT_INDEX_THRESHOLD 16
+
+struct _launch_dict_index {
+	uint32_t *buckets;
+	size_t mask;
+	launch_data_t entries[];
+};
+
+#define _dict_index(d) \
+	((struct _launch_dict_index *)((char *)(d)->_array - offsetof(struct _launch_dict_index, entries)))
+
+static bool _launch_data_dict_index_build(launch_data_t dict);
+static void _launch_data_dict_index_add(launch_data_t dict, size_t pair);
+static size_t _launch_data_dict_find(launch_data_t dict, const char *key);
 
 launch_data_t
 launch_data_alloc(launch_data_type_t t)
@@ -54,7 +85,25 @@ launch_data_alloc(launch_data_type_t t)
 launch_data_type_t
 launch_data_get_type(launch_data_t d)
 {
-	return d->type;
+	return d->type & LAUNCH_DATA_TYPE_MASK;
+}
+
+/* Whether 'd' owns its _array, string or opaque storage, as opposed to
+ * pointing into the buffer it was unpacked in.
+ */
+static bool
+_launch_data_owns(launch_data_t d)
+{
+	return !(d->type & LAUNCH_DATA_ARENA) || (d->type & LAUNCH_DATA_ARENA_OWNS);
+}
+
+/* Called once 'd' points at storage of its own. */
+static void
+_launch_data_set_owns(launch_data_t d)
+{
+	if (d->type & LAUNCH_DATA_ARENA) {
+		d->type |= LAUNCH_DATA_ARENA_OWNS;
+	}
 }
 
 void
@@ -62,7 +111,7 @@ launch_data_free(launch_data_t d)
 {
 	size_t i;
 
-	switch (d->type) {
+	switch (launch_data_get_type(d)) {
 	case LAUNCH_DATA_DICTIONARY:
 	case LAUNCH_DATA_ARRAY:
 		for (i = 0; i < d->_array_cnt; i++) {
@@ -70,19 +119,37 @@ launch_data_free(launch_data_t d)
 				launch_data_free(d->_array[i]);
 			}
 		}
-		free(d->_array);
+		if (!_launch_data_owns(d)) {
+			break;
+		}
+		if (d->type & LAUNCH_DATA_INDEXED) {
+			free(_dict_index(d)->buckets);
+			free(_dict_index(d));
+		} else {
+			free(d->_array);
+		}
 		break;
 	case LAUNCH_DATA_STRING:
-		if (d->string)
+		if (d->string && _launch_data_owns(d))
 			free(d->string);
 		break;
 	case LAUNCH_DATA_OPAQUE:
-		if (d->opaque)
+		if (d->opaque && _launch_data_owns(d))
 			free(d->opaque);
 		break;
 	default:
 		break;
 	}
+
+	if (d->type & LAUNCH_DATA_ARENA) {
+		/* The node itself lives in the message buffer; only the detached
+		 * root owns a reference to it.
+		 */
+		if (d->type & LAUNCH_DATA_ARENA_ROOT) {
+			_launch_msg_release(d);
+		}
+		return;
+	}
 	free(d);
 }
 
@@ -92,23 +159,123 @@ launch_data_dict_get_count(launch_data_t dict)
 	return dict->_array_cnt / 2;
 }
 
+static uint32_t
+_launch_data_key_hash(const char *key)
+{
+	/* FNV-1a over the lower-cased key, to agree with strcasecmp(). */
+	uint32_t h = 2166136261u;
+
+	for (; *key; key++) {
+		h ^= (uint32_t)tolower((unsigned char)*key);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static bool
+_launch_data_dict_index_build(launch_data_t dict)
+{
+	struct _launch_dict_index *idx;
+	size_t i, nbuckets = 32, npairs = dict->_array_cnt / 2;
+	uint32_t *buckets;
+
+	/* Keep the load factor at or below one half. */
+	while (nbuckets < npairs * 2) {
+		nbuckets <<= 1;
+	}
+
+	buckets = calloc(nbuckets, sizeof(uint32_t));
+	if (!buckets) {
+		return false;
+	}
+
+	if (dict->type & LAUNCH_DATA_INDEXED) {
+		idx = _dict_index(dict);
+		free(idx->buckets);
+	} else {
+		idx = malloc(sizeof(struct _launch_dict_index) + dict->_array_cnt * sizeof(launch_data_t));
+		if (!idx) {
+			free(buckets);
+			return false;
+		}
+		memcpy(idx->entries, dict->_array, dict->_array_cnt * sizeof(launch_data_t));
+		free(dict->_array);
+		dict->_array = idx->entries;
+		dict->type |= LAUNCH_DATA_INDEXED;
+	}
+
+	idx->buckets = buckets;
+	idx->mask = nbuckets - 1;
+
+	for (i = 0; i < npairs; i++) {
+		_launch_data_dict_index_add(dict, i);
+	}
+	return true;
+}
+
+static void
+_launch_data_dict_index_add(launch_data_t dict, size_t pair)
+{
+	struct _launch_dict_index *idx = _dict_index(dict);
+	size_t b = _launch_data_key_hash(dict->_array[pair * 2]->string) & idx->mask;
+
+	while (idx->buckets[b]) {
+		b = (b + 1) & idx->mask;
+	}
+	idx->buckets[b] = (uint32_t)(pair + 1);
+}
+
+/* Returns the _array offset of the key matching 'key', or _array_cnt. */
+static size_t
+_launch_data_dict_find(launch_data_t dict, const char *key)
+{
+	size_t i;
+
+	if (dict->type & LAUNCH_DATA_INDEXED) {
+		struct _launch_dict_index *idx = _dict_index(dict);
+		size_t b = _launch_data_key_hash(key) & idx->mask;
+
+		for (; idx->buckets[b]; b = (b + 1) & idx->mask) {
+			i = (idx->buckets[b] - 1) * 2;
+			if (!strcasecmp(key, dict->_array[i]->string)) {
+				return i;
+			}
+		}
+		return dict->_array_cnt;
+	}
+
+	for (i = 0; i < dict->_array_cnt; i += 2) {
+		if (!strcasecmp(key, dict->_array[i]->string))
+			break;
+	}
+	return i;
+}
+
 bool
 launch_data_dict_insert(launch_data_t dict, launch_data_t what, const char *key)
 {
 	size_t i;
+	bool appended;
 	launch_data_t thekey = launch_data_alloc(LAUNCH_DATA_STRING);
 
 	launch_data_set_string(thekey, key);
 
-	for (i = 0; i < dict->_array_cnt; i += 2) {
-		if (!strcasecmp(key, dict->_array[i]->string)) {
-			launch_data_array_set_index(dict, thekey, i);
-			launch_data_array_set_index(dict, what, i + 1);
-			return true;
-		}
-	}
+	i = _launch_data_dict_find(dict, key);
+	appended = (i == dict->_array_cnt);
 	launch_data_array_set_index(dict, thekey, i);
 	launch_data_array_set_index(dict, what, i + 1);
+
+	if (appended) {
+		if (!(dict->type & LAUNCH_DATA_INDEXED)) {
+			if (dict->_array_cnt / 2 > LAUNCH_DATA_DICT_INDEX_THRESHOLD) {
+				_launch_data_dict_index_build(dict);
+			}
+		} else if (dict->_array_cnt > _dict_index(dict)->mask + 1) {
+			_launch_data_dict_index_build(dict);
+		} else {
+			_launch_data_dict_index_add(dict, i / 2);
+		}
+	}
 	return true;
 }
 
@@ -117,15 +284,14 @@ launch_data_dict_lookup(launch_data_t dict, const char *key)
 {
 	size_t i;
 
-	if (LAUNCH_DATA_DICTIONARY != dict->type)
+	if (LAUNCH_DATA_DICTIONARY != launch_data_get_type(dict))
 		return NULL;
 
-	for (i = 0; i < dict->_array_cnt; i += 2) {
-		if (!strcasecmp(key, dict->_array[i]->string))
-			return dict->_array[i + 1];
-	}
+	i = _launch_data_dict_find(dict, key);
+	if (i == dict->_array_cnt)
+		return NULL;
 
-	return NULL;
+	return dict->_array[i + 1];
 }
 
 bool
@@ -133,16 +299,21 @@ launch_data_dict_remove(launch_data_t dict, const char *key)
 {
 	size_t i;
 
-	for (i = 0; i < dict->_array_cnt; i += 2) {
-		if (!strcasecmp(key, dict->_array[i]->string))
-			break;
-	}
+	i = _launch_data_dict_find(dict, key);
 	if (i == dict->_array_cnt)
 		return false;
 	launch_data_free(dict->_array[i]);
 	launch_data_free(dict->_array[i + 1]);
 	memmove(dict->_array + i, dict->_array + i + 2, (dict->_array_cnt - (i + 2)) * sizeof(launch_data_t));
 	dict->_array_cnt -= 2;
+
+	/* Every pair after the removed one moved down a slot; just rehash. */
+	if (dict->type & LAUNCH_DATA_INDEXED) {
+		memset(_dict_index(dict)->buckets, 0, (_dict_index(dict)->mask + 1) * sizeof(uint32_t));
+		for (i = 0; i < dict->_array_cnt / 2; i++) {
+			_launch_data_dict_index_add(dict, i);
+		}
+	}
 	return true;
 }
 
@@ -151,7 +322,7 @@ launch_data_dict_iterate(launch_data_t dict, void (*cb)(launch_data_t, const cha
 {
 	size_t i;
 
-	if (LAUNCH_DATA_DICTIONARY != dict->type) {
+	if (LAUNCH_DATA_DICTIONARY != launch_data_get_type(dict)) {
 		return;
 	}
 
@@ -163,8 +334,26 @@ launch_data_dict_iterate(launch_data_t dict, void (*cb)(launch_data_t, const cha
 bool
 launch_data_array_set_index(launch_data_t where, launch_data_t what, size_t ind)
 {
+	launch_data_t *a;
+
+	/* An unpacked container gets its own _array before it can be resized. */
+	if (!_launch_data_owns(where)) {
+		if ((a = malloc((where->_array_cnt + 1) * sizeof(launch_data_t))) == NULL) {
+			return false;
+		}
+		memcpy(a, where->_array, where->_array_cnt * sizeof(launch_data_t));
+		where->_array = a;
+		_launch_data_set_owns(where);
+	}
+
 	if ((ind + 1) >= where->_array_cnt) {
-		where->_array = reallocf(where->_array, (ind + 1) * sizeof(launch_data_t));
+		if (where->type & LAUNCH_DATA_INDEXED) {
+			struct _launch_dict_index *idx = _dict_index(where);
+			idx = reallocf(idx, sizeof(struct _launch_dict_index) + (ind + 1) * sizeof(launch_data_t));
+			where->_array = idx->entries;
+		} else {
+			where->_array = reallocf(where->_array, (ind + 1) * sizeof(launch_data_t));
+		}
 		memset(where->_array + where->_array_cnt, 0, (ind + 1 - where->_array_cnt) * sizeof(launch_data_t));
 		where->_array_cnt = ind + 1;
 	}
@@ -180,30 +369,17 @@ launch_data_array_set_index(launch_data_t where, launch_data_t what, size_t ind)
 launch_data_t
 launch_data_array_get_index(launch_data_t where, size_t ind)
 {
-	if (LAUNCH_DATA_ARRAY != where->type || ind >= where->_array_cnt) {
+	if (LAUNCH_DATA_ARRAY != launch_data_get_type(where) || ind >= where->_array_cnt) {
 		return NULL;
 	} else {
 		return where->_array[ind];
 	}
 }
 
-launch_data_t
-launch_data_array_pop_first(launch_data_t where)
-{
-	launch_data_t r = NULL;
-
-	if (where->_array_cnt > 0) {
-		r = where->_array[0];
-		memmove(where->_array, where->_array + 1, (where->_array_cnt - 1) * sizeof(launch_data_t));
-		where->_array_cnt--;
-	}
-	return r;
-}
-
 size_t
 launch_data_array_get_count(launch_data_t where)
 {
-	if (LAUNCH_DATA_ARRAY != where->type)
+	if (LAUNCH_DATA_ARRAY != launch_data_get_type(where))
 		return 0;
 	return where->_array_cnt;
 }
@@ -246,8 +422,9 @@ launch_data_set_real(launch_data_t d, double n)
 bool
 launch_data_set_string(launch_data_t d, const char *s)
 {
-	if (d->string)
+	if (d->string && _launch_data_owns(d))
 		free(d->string);
+	_launch_data_set_owns(d);
 	d->string = strdup(s);
 	if (d->string) {
 		d->string_len = strlen(d->string);
@@ -260,8 +437,9 @@ bool
 launch_data_set_opaque(launch_data_t d, const void *o, size_t os)
 {
 	d->opaque_size = os;
-	if (d->opaque)
+	if (d->opaque && _launch_data_owns(d))
 		free(d->opaque);
+	_launch_data_set_owns(d);
 	d->opaque = malloc(os);
 	if (d->opaque) {
 		memcpy(d->opaque, o, os);
@@ -294,10 +472,10 @@ launch_data_pack(launch_data_t d, void *where, size_t len, int *fd_where, size_t
 
 	where += node_data_len;
 
-	o_in_w->type = host2wire(d->type);
+	o_in_w->type = host2wire((uint64_t)launch_data_get_type(d));
 
 	size_t pad_len = 0;
-	switch (d->type) {
+	switch (launch_data_get_type(d)) {
 	case LAUNCH_DATA_INTEGER:
 		o_in_w->number = host2wire(d->number);
 		break;
@@ -370,6 +548,121 @@ launch_data_pack(launch_data_t d, void *where, size_t len, int *fd_where, size_t
 	return node_data_len;
 }
 
+size_t
+launch_data_packed_size(launch_data_t d, size_t *fd_cnt)
+{
+	size_t i, node_data_len = sizeof(struct _launch_data);
+
+	switch (launch_data_get_type(d)) {
+	case LAUNCH_DATA_FD:
+		if (fd_cnt && d->fd != -1) {
+			(*fd_cnt)++;
+		}
+		break;
+	case LAUNCH_DATA_STRING:
+		node_data_len += ROUND_TO_64BIT_WORD_SIZE(d->string_len + 1);
+		break;
+	case LAUNCH_DATA_OPAQUE:
+		node_data_len += ROUND_TO_64BIT_WORD_SIZE(d->opaque_size);
+		break;
+	case LAUNCH_DATA_DICTIONARY:
+	case LAUNCH_DATA_ARRAY:
+		node_data_len += d->_array_cnt * sizeof(uint64_t);
+		for (i = 0; i < d->_array_cnt; i++) {
+			node_data_len += launch_data_packed_size(d->_array[i], fd_cnt);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return node_data_len;
+}
+
+/* Produces the same byte stream as launch_data_pack(), but hands it to 'emit'
+ * piece by piece instead of requiring one buffer large enough for all of it.
+ * Unlike launch_data_pack(), the per-array pointer slots are zero-filled.
+ */
+size_t
+launch_data_pack_emit(launch_data_t d, launch_data_emit_t emit, void *ctx, size_t *fd_cnt)
+{
+	static const uint64_t zeros[8];
+	struct _launch_data w;
+	size_t i, n, pad_len, node_data_len = sizeof(struct _launch_data);
+
+	memset(&w, 0, sizeof(w));
+	w.type = host2wire((uint64_t)launch_data_get_type(d));
+
+	switch (launch_data_get_type(d)) {
+	case LAUNCH_DATA_INTEGER:
+		w.number = host2wire(d->number);
+		break;
+	case LAUNCH_DATA_REAL:
+		w.float_num = host2wire_f(d->float_num);
+		break;
+	case LAUNCH_DATA_BOOL:
+		w.boolean = host2wire(d->boolean);
+		break;
+	case LAUNCH_DATA_ERRNO:
+		w.err = host2wire(d->err);
+		break;
+	case LAUNCH_DATA_FD:
+		w.fd = host2wire(d->fd);
+		if (fd_cnt && d->fd != -1) {
+			(*fd_cnt)++;
+		}
+		break;
+	case LAUNCH_DATA_STRING:
+		w.string_len = host2wire(d->string_len);
+		break;
+	case LAUNCH_DATA_OPAQUE:
+		w.opaque_size = host2wire(d->opaque_size);
+		break;
+	case LAUNCH_DATA_DICTIONARY:
+	case LAUNCH_DATA_ARRAY:
+		w._array_cnt = host2wire(d->_array_cnt);
+		break;
+	default:
+		break;
+	}
+
+	emit(ctx, &w, sizeof(w));
+
+	switch (launch_data_get_type(d)) {
+	case LAUNCH_DATA_STRING:
+		emit(ctx, d->string, d->string_len + 1);
+		pad_len = ROUND_TO_64BIT_WORD_SIZE(d->string_len + 1) - (d->string_len + 1);
+		emit(ctx, zeros, pad_len);
+		node_data_len += d->string_len + 1 + pad_len;
+		break;
+	case LAUNCH_DATA_OPAQUE:
+		emit(ctx, d->opaque, d->opaque_size);
+		pad_len = ROUND_TO_64BIT_WORD_SIZE(d->opaque_size) - d->opaque_size;
+		emit(ctx, zeros, pad_len);
+		node_data_len += d->opaque_size + pad_len;
+		break;
+	case LAUNCH_DATA_DICTIONARY:
+	case LAUNCH_DATA_ARRAY:
+		for (i = 0; i < d->_array_cnt; i += n) {
+			n = d->_array_cnt - i;
+			if (n > sizeof(zeros) / sizeof(zeros[0])) {
+				n = sizeof(zeros) / sizeof(zeros[0]);
+			}
+			emit(ctx, zeros, n * sizeof(uint64_t));
+		}
+		node_data_len += d->_array_cnt * sizeof(uint64_t);
+
+		for (i = 0; i < d->_array_cnt; i++) {
+			node_data_len += launch_data_pack_emit(d->_array[i], emit, ctx, fd_cnt);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return node_data_len;
+}
+
 launch_data_t
 launch_data_unpack(void *data, size_t data_size, int *fds, size_t fd_cnt, size_t *data_offset, size_t *fdoffset)
 {
@@ -444,7 +737,7 @@ launch_data_unpack(void *data, size_t data_size, int *fds, size_t fd_cnt, size_t
 		break;
 	}
 
-	r->type = wire2host(r->type);
+	r->type = wire2host(r->type) | LAUNCH_DATA_ARENA;
 
 	return r;
 }
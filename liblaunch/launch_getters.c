@@ -60,7 +60,7 @@ launch_data_get_real(launch_data_t d)
 const char *
 launch_data_get_string(launch_data_t d)
 {
-	if (LAUNCH_DATA_STRING != d->type)
+	if (LAUNCH_DATA_STRING != launch_data_get_type(d))
 		return NULL;
 	return d->string;
 }
@@ -68,7 +68,7 @@ launch_data_get_string(launch_data_t d)
 void *
 launch_data_get_opaque(launch_data_t d)
 {
-	if (LAUNCH_DATA_OPAQUE != d->type)
+	if (LAUNCH_DATA_OPAQUE != launch_data_get_type(d))
 		return NULL;
 	return d->opaque;
 }
@@ -85,6 +85,12 @@ launchd_getfd(launch_t l)
 	return (l->which == LAUNCHD_USE_CHECKIN_FD) ? l->cifd : l->fd;
 }
 
+size_t
+launchd_msg_send_pending(launch_t l)
+{
+	return l->sendlen;
+}
+
 #if HAS_MACH
 mach_port_t
 launch_data_get_machport(launch_data_t d)
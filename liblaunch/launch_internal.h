@@ -34,10 +34,36 @@
 #endif
 #endif
 
+/* In-memory flags kept in the upper half of launch_data_t->type. They are
+ * masked off by launch_data_get_type() and never packed onto the wire.
+ *
+ * LAUNCH_DATA_INDEXED: the dictionary's _array lives in a hash index block.
+ * LAUNCH_DATA_ARENA: the node was unpacked in place inside a receive buffer
+ *   and does not own its storage; launch_data_free() only frees its children.
+ * LAUNCH_DATA_ARENA_ROOT: the node is a message root that was handed out by
+ *   launchd_msg_detach(); freeing it drops its reference on the buffer.
+ * LAUNCH_DATA_ARENA_OWNS: the unpacked node was modified since and its
+ *   _array, string or opaque storage is now on the heap.
+ */
+#define LAUNCH_DATA_INDEXED (1ull << 32)
+#define LAUNCH_DATA_ARENA (1ull << 33)
+#define LAUNCH_DATA_ARENA_ROOT (1ull << 34)
+#define LAUNCH_DATA_ARENA_OWNS (1ull << 35)
+#define LAUNCH_DATA_TYPE_MASK ((1ull << 32) - 1)
+
 enum {
 	LAUNCHD_USE_CHECKIN_FD,
 	LAUNCHD_USE_OTHER_FD,
 };
+
+/* A receive buffer that outlives its connection's use of it, because one or
+ * more messages unpacked inside it were detached.
+ */
+struct _launch_arena {
+	void	*buf;
+	long	refcnt;
+};
+
 struct _launch {
 	void	*sendbuf;
 	int	*sendfds;
@@ -46,7 +72,19 @@ struct _launch {
 	size_t	sendlen;
 	size_t	sendfdcnt;
 	size_t	recvlen;
+	size_t	recvcap;
 	size_t	recvfdcnt;
+	struct _launch_arena *recvarena;
+	/* Request IDs of the message being handed to a launchd_msg_recv()
+	 * callback, and the next one launch_msg_pipeline() will send.
+	 */
+	uint64_t recvid;
+	uint64_t nextid;
+	bool	recvtagged;
+	/* While set, launchd_msg_send() only queues the message in sendbuf. */
+	bool	holdsend;
+	/* Set while a launchd_msg_recv() callback runs, for launchd_close(). */
+	bool	*recvclosed;
 	int which;
 	int cifd;
 	int	fd;
@@ -54,14 +92,34 @@ struct _launch {
 
 typedef struct _launch *launch_t;
 
+/* A FIFO of messages in a ring that doubles when full. */
+struct launch_msg_deque {
+	launch_data_t *lmd_items;
+	size_t lmd_head;
+	size_t lmd_cnt;
+	size_t lmd_cap;
+};
+
+int launch_msg_deque_push(struct launch_msg_deque *q, launch_data_t d);
+launch_data_t launch_msg_deque_pop(struct launch_msg_deque *q);
+
+struct launch_async_conn;
+
 struct launch_globals_s {
 	// liblaunch.c
 	pthread_once_t lc_once;
 	pthread_mutex_t lc_mtx;
 	launch_t l;
-	launch_data_t async_resp;
+	struct launch_msg_deque async_resp;
 
-	launch_t in_flight_msg_recv_client;
+	// launch_msg_async()
+	pthread_once_t async_once;
+	pthread_mutex_t async_mtx;
+	bool async_inited;
+	size_t async_nconns;
+	struct launch_async_conn **async_pool;
+	pthread_key_t async_key;
+	unsigned long async_next;
 
 	int64_t s_am_embedded_god;
 
@@ -103,8 +161,13 @@ _launch_globals(void) {
 #define LAUNCHD_JOB_DEFAULTS "Defaults"
 #define LAUNCHD_JOB_DEFAULTS_CACHED "CachedDefaults"
 
+struct sockaddr_un;
+int launch_client_sockaddr(struct sockaddr_un *sunp);
+
 launch_t launchd_fdopen(int, int);
 int launchd_getfd(launch_t);
+/* Bytes queued by launchd_msg_send() that the peer has not taken yet. */
+size_t launchd_msg_send_pending(launch_t);
 void launchd_close(launch_t, __typeof__(close) closefunc);
 
 launch_data_t launch_data_new_errno(int);
@@ -113,9 +176,36 @@ bool launch_data_set_errno(launch_data_t, int);
 int launchd_msg_send(launch_t, launch_data_t);
 int launchd_msg_recv(launch_t, void (*)(launch_data_t, void *), void *);
 
+/* Sends 'd' in the envelope that carries a request ID; see liblaunch.c. */
+int launchd_msg_send_tagged(launch_t, launch_data_t, uint64_t reqid);
+
+/* Only valid in a launchd_msg_recv() callback. Returns true and the request
+ * ID if the message came in an envelope, in which case its reply must be
+ * sent back in one with the same ID.
+ */
+bool launchd_msg_recv_id(launch_t, uint64_t *reqid);
+
+/* Only valid on the message passed to a launchd_msg_recv() callback for 'lh'.
+ * Takes ownership of the message without copying it: the returned tree stays
+ * valid until launch_data_free() is called on it.
+ */
+launch_data_t launchd_msg_detach(launch_t lh, launch_data_t msg);
+
 size_t launch_data_pack(launch_data_t d, void *where, size_t len, int *fd_where, size_t *fdslotsleft);
+size_t launch_data_packed_size(launch_data_t d, size_t *fd_cnt);
+typedef void (*launch_data_emit_t)(void *ctx, const void *bytes, size_t len);
+size_t launch_data_pack_emit(launch_data_t d, launch_data_emit_t emit, void *ctx, size_t *fd_cnt);
 launch_data_t launch_data_unpack(void *data, size_t data_size, int *fds, size_t fd_cnt, size_t *data_offset, size_t *fdoffset);
 
+/* Property lists, XML or binary, to and from launch_data without going through
+ * CoreFoundation. The parsers return NULL with errno set to EINVAL on
+ * malformed input; the writer emits XML.
+ */
+launch_data_t launch_data_plist_parse(const void *buf, size_t len);
+launch_data_t launch_data_plist_read_file(const char *path);
+char *launch_data_plist_xml(launch_data_t d, size_t *len);
+int launch_data_plist_write_file(launch_data_t d, const char *path);
+
 #pragma GCC visibility pop
 
 #endif /*  __LAUNCH_INTERNAL_H__*/
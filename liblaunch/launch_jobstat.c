@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+#include "launch.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* How often a slot is copied again while launchd keeps writing it, before we
+ * take launchd to have died in the middle of a write.
+ */
+#define LAUNCH_JOBSTAT_RETRIES 100000
+
+/* Copies 'slot' into 'copy' once it is not being written. */
+static int
+launch_jobstat_read(const struct launch_jobstat_slot *slot, struct launch_jobstat_slot *copy)
+{
+	uint32_t seq;
+	size_t tries;
+
+	for (tries = 0; tries < LAUNCH_JOBSTAT_RETRIES; tries++) {
+		seq = *(const volatile uint32_t *)&slot->ljs_seq;
+		if ((seq & 1) == 0) {
+			__sync_synchronize();
+			memcpy(copy, slot, sizeof(*copy));
+			__sync_synchronize();
+			if (*(const volatile uint32_t *)&slot->ljs_seq == seq) {
+				copy->ljs_label[sizeof(copy->ljs_label) - 1] = '\0';
+				return 0;
+			}
+		}
+		if (tries % 64 == 63) {
+			sched_yield();
+		}
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+int
+launch_jobstat_copy(struct launch_jobstat_slot **slots, size_t *cnt)
+{
+	const struct launch_jobstat_header *hdr;
+	const struct launch_jobstat_slot *table;
+	struct launch_jobstat_slot *out = NULL;
+	struct sockaddr_un sun;
+	char path[sizeof(sun.sun_path) + sizeof(LAUNCH_JOBSTAT_FILE)], *slash;
+	size_t size = 0, used, n = 0, i;
+	struct stat sb;
+	void *map = MAP_FAILED;
+	int fd, e, r = -1;
+
+	/* The table is next to the socket. */
+	if (launch_client_sockaddr(&sun) == -1) {
+		return -1;
+	}
+	memcpy(path, sun.sun_path, sizeof(sun.sun_path));
+	path[sizeof(sun.sun_path)] = '\0';
+	if ((slash = strrchr(path, '/')) == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	strcpy(slash + 1, LAUNCH_JOBSTAT_FILE);
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		return -1;
+	}
+	if (fstat(fd, &sb) == -1) {
+		e = errno;
+		(void)close(fd);
+		errno = e;
+		return -1;
+	}
+	size = (size_t)sb.st_size;
+	if (size >= sizeof(*hdr)) {
+		map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	e = errno;
+	(void)close(fd);
+	if (map == MAP_FAILED) {
+		errno = size < sizeof(*hdr) ? ENOENT : e;
+		return -1;
+	}
+
+	hdr = map;
+	table = (const struct launch_jobstat_slot *)(hdr + 1);
+	if (*(const volatile uint64_t *)&hdr->ljh_magic != LAUNCH_JOBSTAT_MAGIC
+			|| hdr->ljh_version != LAUNCH_JOBSTAT_VERSION
+			|| hdr->ljh_slotsize != sizeof(*table)
+			|| hdr->ljh_nslots > (size - sizeof(*hdr)) / sizeof(*table)) {
+		errno = ENOENT;
+		goto out;
+	}
+	/* A launchd that died without cleaning up leaves its table behind. */
+	if (kill((pid_t)hdr->ljh_pid, 0) == -1 && errno == ESRCH) {
+		errno = ENOENT;
+		goto out;
+	}
+	if (*(const volatile uint32_t *)&hdr->ljh_overflow != 0) {
+		errno = EOVERFLOW;
+		goto out;
+	}
+
+	used = *(const volatile uint32_t *)&hdr->ljh_used;
+	__sync_synchronize();
+	if (used > hdr->ljh_nslots) {
+		errno = ENOENT;
+		goto out;
+	}
+	if ((out = malloc((used ? used : 1) * sizeof(*out))) == NULL) {
+		errno = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < used; i++) {
+		if (launch_jobstat_read(&table[i], &out[n]) == -1) {
+			goto out;
+		}
+		if (out[n].ljs_state == LAUNCH_JOBSTAT_FREE) {
+			continue;
+		}
+		if (out[n].ljs_flags & LAUNCH_JOBSTAT_TRUNCATED) {
+			errno = EOVERFLOW;
+			goto out;
+		}
+		n++;
+	}
+
+	*slots = out;
+	*cnt = n;
+	out = NULL;
+	r = 0;
+
+out:
+	e = errno;
+	free(out);
+	(void)munmap(map, size);
+	errno = e;
+
+	return r;
+}
@@ -0,0 +1,1569 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "launch.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Property lists straight to launch_data, without building a CoreFoundation
+ * tree first. Both parsers are single pass: the XML one is driven by a
+ * tokenizer that hands back one tag or run of text at a time, the binary one
+ * walks the object table from the top object down. Neither recurses on the C
+ * stack beyond PLIST_MAX_DEPTH, so hostile input fails with EINVAL instead of
+ * crashing. The binary one also decodes no more objects than the file has
+ * room for references, so that objects referenced from many places cannot
+ * multiply into a tree far larger than the file.
+ *
+ * Dates, UIDs and nulls have no launch_data counterpart. Like CF2launch_data()
+ * in launchctl, they are dropped along with their dictionary key.
+ */
+#define PLIST_MAX_DEPTH 128
+
+#define PLIST_XML_HEADER \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
+	"<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n" \
+	"<plist version=\"1.0\">\n"
+#define PLIST_XML_FOOTER "</plist>\n"
+
+#define PLIST_BINARY_MAGIC "bplist00"
+#define PLIST_BINARY_TRAILER 32
+
+#pragma mark Buffers
+
+struct plist_buf {
+	char *p;
+	size_t len;
+	size_t cap;
+	bool failed;
+};
+
+static bool
+plist_buf_reserve(struct plist_buf *b, size_t n)
+{
+	size_t cap;
+	char *p;
+
+	if (b->failed) {
+		return false;
+	}
+	if (b->cap - b->len > n) {
+		return true;
+	}
+
+	cap = b->cap ? b->cap : 256;
+	while (cap - b->len <= n) {
+		if (cap > SIZE_MAX / 2) {
+			b->failed = true;
+			return false;
+		}
+		cap *= 2;
+	}
+	if (!(p = realloc(b->p, cap))) {
+		b->failed = true;
+		return false;
+	}
+	b->p = p;
+	b->cap = cap;
+
+	return true;
+}
+
+static void
+plist_buf_append(struct plist_buf *b, const void *s, size_t n)
+{
+	if (plist_buf_reserve(b, n)) {
+		memcpy(b->p + b->len, s, n);
+		b->len += n;
+		b->p[b->len] = '\0';
+	}
+}
+
+static void
+plist_buf_puts(struct plist_buf *b, const char *s)
+{
+	plist_buf_append(b, s, strlen(s));
+}
+
+static void
+plist_buf_putc(struct plist_buf *b, char c)
+{
+	plist_buf_append(b, &c, 1);
+}
+
+static void
+plist_buf_indent(struct plist_buf *b, size_t depth)
+{
+	if (plist_buf_reserve(b, depth)) {
+		memset(b->p + b->len, '\t', depth);
+		b->len += depth;
+		b->p[b->len] = '\0';
+	}
+}
+
+static void
+plist_buf_utf8(struct plist_buf *b, uint32_t cp)
+{
+	char u[4];
+
+	if (cp < 0x80) {
+		u[0] = (char)cp;
+		plist_buf_append(b, u, 1);
+	} else if (cp < 0x800) {
+		u[0] = (char)(0xc0 | (cp >> 6));
+		u[1] = (char)(0x80 | (cp & 0x3f));
+		plist_buf_append(b, u, 2);
+	} else if (cp < 0x10000) {
+		u[0] = (char)(0xe0 | (cp >> 12));
+		u[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		u[2] = (char)(0x80 | (cp & 0x3f));
+		plist_buf_append(b, u, 3);
+	} else {
+		u[0] = (char)(0xf0 | (cp >> 18));
+		u[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+		u[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		u[3] = (char)(0x80 | (cp & 0x3f));
+		plist_buf_append(b, u, 4);
+	}
+}
+
+#pragma mark Nodes
+
+/* Strings and arrays are filled in directly rather than through the setters,
+ * which would copy them a second time.
+ */
+static launch_data_t
+plist_new_string(const char *s, size_t len)
+{
+	launch_data_t d;
+	char *str;
+
+	if (!(str = malloc(len + 1))) {
+		return NULL;
+	}
+	if (!(d = launch_data_alloc(LAUNCH_DATA_STRING))) {
+		free(str);
+		return NULL;
+	}
+	memcpy(str, s, len);
+	str[len] = '\0';
+	d->string = str;
+	/* An embedded NUL ends the string, as it does everywhere else. */
+	d->string_len = strlen(str);
+
+	return d;
+}
+
+static launch_data_t
+plist_new_opaque(const void *o, size_t len)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_OPAQUE);
+
+	if (d && !launch_data_set_opaque(d, o, len)) {
+		launch_data_free(d);
+		d = NULL;
+	}
+	return d;
+}
+
+static launch_data_t
+plist_new_array(launch_data_t *items, size_t cnt)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_ARRAY);
+	launch_data_t *a;
+
+	if (!d) {
+		return NULL;
+	}
+	if (!(a = malloc(cnt * sizeof(launch_data_t) + 1))) {
+		launch_data_free(d);
+		return NULL;
+	}
+	if (cnt) {
+		memcpy(a, items, cnt * sizeof(launch_data_t));
+	}
+	free(d->_array);
+	d->_array = a;
+	d->_array_cnt = cnt;
+
+	return d;
+}
+
+static bool
+plist_is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void
+plist_trim(const char **s, const char **e)
+{
+	while (*s < *e && plist_is_space(**s)) {
+		(*s)++;
+	}
+	while (*e > *s && plist_is_space((*e)[-1])) {
+		(*e)--;
+	}
+}
+
+#pragma mark Base64
+
+static const char plist_b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int
+plist_b64_value(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z') {
+		return c - 'A';
+	} else if (c >= 'a' && c <= 'z') {
+		return c - 'a' + 26;
+	} else if (c >= '0' && c <= '9') {
+		return c - '0' + 52;
+	} else if (c == '+') {
+		return 62;
+	} else if (c == '/') {
+		return 63;
+	}
+	return -1;
+}
+
+static launch_data_t
+plist_b64_decode(const char *s, size_t len)
+{
+	launch_data_t d = NULL;
+	uint32_t acc = 0;
+	size_t i, n = 0, bits = 0;
+	unsigned char *out;
+	int v;
+
+	if (!(out = malloc(len / 4 * 3 + 3))) {
+		return NULL;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (s[i] == '=') {
+			break;
+		}
+		if (plist_is_space(s[i])) {
+			continue;
+		}
+		if ((v = plist_b64_value((unsigned char)s[i])) == -1) {
+			errno = EINVAL;
+			goto out;
+		}
+		acc = (acc << 6) | (uint32_t)v;
+		if ((bits += 6) >= 8) {
+			bits -= 8;
+			out[n++] = (unsigned char)(acc >> bits);
+		}
+	}
+	for (; i < len; i++) {
+		if (s[i] != '=' && !plist_is_space(s[i])) {
+			errno = EINVAL;
+			goto out;
+		}
+	}
+
+	d = plist_new_opaque(out, n);
+out:
+	free(out);
+	return d;
+}
+
+static void
+plist_b64_encode(struct plist_buf *b, const unsigned char *p, size_t len)
+{
+	char q[4];
+	size_t i;
+
+	for (i = 0; i + 2 < len; i += 3) {
+		q[0] = plist_b64[p[i] >> 2];
+		q[1] = plist_b64[((p[i] & 3) << 4) | (p[i + 1] >> 4)];
+		q[2] = plist_b64[((p[i + 1] & 15) << 2) | (p[i + 2] >> 6)];
+		q[3] = plist_b64[p[i + 2] & 63];
+		plist_buf_append(b, q, 4);
+	}
+	if (i < len) {
+		q[0] = plist_b64[p[i] >> 2];
+		if (i + 1 < len) {
+			q[1] = plist_b64[((p[i] & 3) << 4) | (p[i + 1] >> 4)];
+			q[2] = plist_b64[(p[i + 1] & 15) << 2];
+		} else {
+			q[1] = plist_b64[(p[i] & 3) << 4];
+			q[2] = '=';
+		}
+		q[3] = '=';
+		plist_buf_append(b, q, 4);
+	}
+}
+
+#pragma mark XML Tokenizer
+
+enum {
+	PLIST_XML_ERROR = -1,
+	PLIST_XML_EOF,
+	PLIST_XML_START,	/* <name ...> */
+	PLIST_XML_EMPTY,	/* <name .../> */
+	PLIST_XML_END,		/* </name> */
+	PLIST_XML_TEXT,		/* decoded into 'text' */
+};
+
+struct plist_xml {
+	const char *p;
+	const char *end;
+	const char *name;
+	size_t name_len;
+	/* Character data since the builder last cleared it. */
+	struct plist_buf text;
+	bool text_significant;
+};
+
+static const char *
+plist_find(const char *p, const char *end, const char *s)
+{
+	size_t n = strlen(s);
+
+	while ((size_t)(end - p) >= n) {
+		const char *q = memchr(p, s[0], (size_t)(end - p) - n + 1);
+		if (!q) {
+			break;
+		}
+		if (memcmp(q, s, n) == 0) {
+			return q;
+		}
+		p = q + 1;
+	}
+	return NULL;
+}
+
+static bool
+plist_has_prefix(const char *p, const char *end, const char *s)
+{
+	size_t n = strlen(s);
+	return (size_t)(end - p) >= n && memcmp(p, s, n) == 0;
+}
+
+static void
+plist_xml_append_text(struct plist_xml *x, const char *s, size_t n)
+{
+	size_t i;
+
+	if (!x->text_significant) {
+		for (i = 0; i < n; i++) {
+			if (!plist_is_space(s[i])) {
+				x->text_significant = true;
+				break;
+			}
+		}
+	}
+	plist_buf_append(&x->text, s, n);
+}
+
+static int
+plist_xml_entity(struct plist_xml *x, const char *s, const char *e)
+{
+	uint32_t cp = 0;
+	size_t n = (size_t)(e - s);
+	const char *p;
+
+	if (n == 2 && memcmp(s, "lt", 2) == 0) {
+		cp = '<';
+	} else if (n == 2 && memcmp(s, "gt", 2) == 0) {
+		cp = '>';
+	} else if (n == 3 && memcmp(s, "amp", 3) == 0) {
+		cp = '&';
+	} else if (n == 4 && memcmp(s, "quot", 4) == 0) {
+		cp = '"';
+	} else if (n == 4 && memcmp(s, "apos", 4) == 0) {
+		cp = '\'';
+	} else if (n >= 2 && s[0] == '#') {
+		bool hex = (s[1] == 'x' || s[1] == 'X');
+
+		p = s + (hex ? 2 : 1);
+		if (p == e) {
+			return -1;
+		}
+		for (; p < e; p++) {
+			int v;
+
+			if (*p >= '0' && *p <= '9') {
+				v = *p - '0';
+			} else if (hex && *p >= 'a' && *p <= 'f') {
+				v = *p - 'a' + 10;
+			} else if (hex && *p >= 'A' && *p <= 'F') {
+				v = *p - 'A' + 10;
+			} else {
+				return -1;
+			}
+			cp = cp * (hex ? 16 : 10) + (uint32_t)v;
+			if (cp > 0x10ffff) {
+				return -1;
+			}
+		}
+		if (cp == 0 || (cp >= 0xd800 && cp <= 0xdfff)) {
+			return -1;
+		}
+	} else {
+		return -1;
+	}
+
+	x->text_significant = true;
+	plist_buf_utf8(&x->text, cp);
+
+	return 0;
+}
+
+static int
+plist_xml_text(struct plist_xml *x, const char *s, const char *e)
+{
+	const char *amp, *semi;
+
+	while (s < e) {
+		if (!(amp = memchr(s, '&', (size_t)(e - s)))) {
+			plist_xml_append_text(x, s, (size_t)(e - s));
+			break;
+		}
+		plist_xml_append_text(x, s, (size_t)(amp - s));
+		if (!(semi = memchr(amp, ';', (size_t)(e - amp))) || plist_xml_entity(x, amp + 1, semi) == -1) {
+			return -1;
+		}
+		s = semi + 1;
+	}
+
+	return x->text.failed ? -1 : 0;
+}
+
+static bool
+plist_xml_name_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.' || c == ':';
+}
+
+static int
+plist_xml_next(struct plist_xml *x)
+{
+	const char *p, *q, *e = x->end;
+
+	for (;;) {
+		p = x->p;
+		if (p >= e) {
+			return PLIST_XML_EOF;
+		}
+
+		if (*p != '<') {
+			if (!(q = memchr(p, '<', (size_t)(e - p)))) {
+				q = e;
+			}
+			x->p = q;
+			return plist_xml_text(x, p, q) == -1 ? PLIST_XML_ERROR : PLIST_XML_TEXT;
+		}
+
+		if (plist_has_prefix(p, e, "<?")) {
+			if (!(q = plist_find(p + 2, e, "?>"))) {
+				return PLIST_XML_ERROR;
+			}
+			x->p = q + 2;
+		} else if (plist_has_prefix(p, e, "<!--")) {
+			if (!(q = plist_find(p + 4, e, "-->"))) {
+				return PLIST_XML_ERROR;
+			}
+			x->p = q + 3;
+		} else if (plist_has_prefix(p, e, "<![CDATA[")) {
+			if (!(q = plist_find(p + 9, e, "]]>"))) {
+				return PLIST_XML_ERROR;
+			}
+			x->text_significant = true;
+			plist_buf_append(&x->text, p + 9, (size_t)(q - p - 9));
+			x->p = q + 3;
+			return x->text.failed ? PLIST_XML_ERROR : PLIST_XML_TEXT;
+		} else if (plist_has_prefix(p, e, "<!")) {
+			/* <!DOCTYPE ...>, possibly with an internal subset in brackets. */
+			int brackets = 0;
+
+			for (q = p + 2; q < e; q++) {
+				if (*q == '[') {
+					brackets++;
+				} else if (*q == ']') {
+					brackets--;
+				} else if (*q == '>' && brackets <= 0) {
+					break;
+				}
+			}
+			if (q == e) {
+				return PLIST_XML_ERROR;
+			}
+			x->p = q + 1;
+		} else {
+			int type = PLIST_XML_START;
+			char quote = 0;
+
+			q = p + 1;
+			if (q < e && *q == '/') {
+				type = PLIST_XML_END;
+				q++;
+			}
+			x->name = q;
+			while (q < e && plist_xml_name_char(*q)) {
+				q++;
+			}
+			x->name_len = (size_t)(q - x->name);
+			if (x->name_len == 0) {
+				return PLIST_XML_ERROR;
+			}
+
+			/* Attributes are of no interest; skip to the end of the tag. */
+			for (; q < e; q++) {
+				if (quote) {
+					if (*q == quote) {
+						quote = 0;
+					}
+				} else if (*q == '"' || *q == '\'') {
+					quote = *q;
+				} else if (*q == '>') {
+					break;
+				}
+			}
+			if (q == e) {
+				return PLIST_XML_ERROR;
+			}
+			if (q[-1] == '/' && q - 1 >= x->name + x->name_len) {
+				if (type == PLIST_XML_END) {
+					return PLIST_XML_ERROR;
+				}
+				type = PLIST_XML_EMPTY;
+			}
+			x->p = q + 1;
+			return type;
+		}
+	}
+}
+
+#pragma mark XML Parser
+
+enum {
+	PLIST_NONE,
+	PLIST_PLIST,
+	PLIST_DICT,
+	PLIST_ARRAY,
+	PLIST_KEY,
+	PLIST_STRING,
+	PLIST_INTEGER,
+	PLIST_REAL,
+	PLIST_TRUE,
+	PLIST_FALSE,
+	PLIST_DATA,
+	PLIST_DATE,
+};
+
+static const struct {
+	const char *name;
+	int kind;
+} plist_xml_elements[] = {
+	{ "plist", PLIST_PLIST },
+	{ "dict", PLIST_DICT },
+	{ "array", PLIST_ARRAY },
+	{ "key", PLIST_KEY },
+	{ "string", PLIST_STRING },
+	{ "integer", PLIST_INTEGER },
+	{ "real", PLIST_REAL },
+	{ "true", PLIST_TRUE },
+	{ "false", PLIST_FALSE },
+	{ "data", PLIST_DATA },
+	{ "date", PLIST_DATE },
+};
+
+static int
+plist_xml_kind(const struct plist_xml *x)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(plist_xml_elements) / sizeof(plist_xml_elements[0]); i++) {
+		if (strlen(plist_xml_elements[i].name) == x->name_len && memcmp(plist_xml_elements[i].name, x->name, x->name_len) == 0) {
+			return plist_xml_elements[i].kind;
+		}
+	}
+	return PLIST_NONE;
+}
+
+struct plist_frame {
+	launch_data_t dict;	/* NULL for an array */
+	size_t base;		/* an array's first item on the value stack */
+	char *key;		/* a dictionary's key awaiting its value */
+};
+
+struct plist_builder {
+	struct plist_frame frames[PLIST_MAX_DEPTH];
+	size_t depth;
+	launch_data_t *vals;
+	size_t nvals;
+	size_t capvals;
+	launch_data_t root;
+	bool have_root;
+};
+
+static int
+plist_builder_push_val(struct plist_builder *pb, launch_data_t v)
+{
+	launch_data_t *vals;
+	size_t cap;
+
+	if (pb->nvals == pb->capvals) {
+		cap = pb->capvals ? pb->capvals * 2 : 32;
+		if (!(vals = realloc(pb->vals, cap * sizeof(*vals)))) {
+			launch_data_free(v);
+			return -1;
+		}
+		pb->vals = vals;
+		pb->capvals = cap;
+	}
+	pb->vals[pb->nvals++] = v;
+
+	return 0;
+}
+
+/* Hands a finished value to the enclosing container. A NULL value is one the
+ * property list had but launch_data cannot hold.
+ */
+static int
+plist_builder_value(struct plist_builder *pb, launch_data_t v)
+{
+	struct plist_frame *f;
+
+	if (pb->depth == 0) {
+		if (pb->have_root) {
+			goto out_bad;
+		}
+		pb->root = v;
+		pb->have_root = true;
+		return 0;
+	}
+
+	f = &pb->frames[pb->depth - 1];
+	if (f->dict) {
+		if (!f->key) {
+			goto out_bad;
+		}
+		if (v) {
+			launch_data_dict_insert(f->dict, v, f->key);
+		}
+		free(f->key);
+		f->key = NULL;
+		return 0;
+	}
+
+	return v ? plist_builder_push_val(pb, v) : 0;
+out_bad:
+	if (v) {
+		launch_data_free(v);
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+static int
+plist_builder_open(struct plist_builder *pb, bool dict)
+{
+	struct plist_frame *f;
+
+	if (pb->depth == PLIST_MAX_DEPTH) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	f = &pb->frames[pb->depth];
+	memset(f, 0, sizeof(*f));
+	if (dict && !(f->dict = launch_data_alloc(LAUNCH_DATA_DICTIONARY))) {
+		return -1;
+	}
+	f->base = pb->nvals;
+	pb->depth++;
+
+	return 0;
+}
+
+static int
+plist_builder_close(struct plist_builder *pb, bool dict)
+{
+	struct plist_frame *f = &pb->frames[pb->depth - 1];
+	launch_data_t v;
+
+	if (dict != (f->dict != NULL) || f->key) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (dict) {
+		v = f->dict;
+		f->dict = NULL;
+	} else if (!(v = plist_new_array(pb->vals + f->base, pb->nvals - f->base))) {
+		return -1;
+	} else {
+		pb->nvals = f->base;
+	}
+	pb->depth--;
+
+	return plist_builder_value(pb, v);
+}
+
+static void
+plist_builder_free(struct plist_builder *pb)
+{
+	size_t i;
+
+	while (pb->depth > 0) {
+		struct plist_frame *f = &pb->frames[--pb->depth];
+		if (f->dict) {
+			launch_data_free(f->dict);
+		}
+		free(f->key);
+	}
+	for (i = 0; i < pb->nvals; i++) {
+		launch_data_free(pb->vals[i]);
+	}
+	free(pb->vals);
+	if (pb->root) {
+		launch_data_free(pb->root);
+	}
+}
+
+static int
+plist_xml_leaf(struct plist_builder *pb, int kind, struct plist_buf *text)
+{
+	const char *s = text->p ? text->p : "", *e = s + text->len;
+	launch_data_t v = NULL;
+	char *end;
+
+	switch (kind) {
+	case PLIST_KEY:
+		if (pb->depth == 0 || !pb->frames[pb->depth - 1].dict || pb->frames[pb->depth - 1].key) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (!(pb->frames[pb->depth - 1].key = malloc(text->len + 1))) {
+			return -1;
+		}
+		memcpy(pb->frames[pb->depth - 1].key, s, text->len);
+		pb->frames[pb->depth - 1].key[text->len] = '\0';
+		return 0;
+	case PLIST_STRING:
+		if (!(v = plist_new_string(s, text->len))) {
+			return -1;
+		}
+		break;
+	case PLIST_INTEGER: {
+		char num[64];
+		bool neg = false;
+		unsigned long long n;
+
+		plist_trim(&s, &e);
+		if (s == e || (size_t)(e - s) >= sizeof(num)) {
+			goto out_bad;
+		}
+		if (*s == '-' || *s == '+') {
+			neg = (*s++ == '-');
+		}
+		if (s == e || *s == '-' || *s == '+' || plist_is_space(*s)) {
+			goto out_bad;
+		}
+		memcpy(num, s, (size_t)(e - s));
+		num[e - s] = '\0';
+		errno = 0;
+		n = strtoull(num, &end, (num[0] == '0' && (num[1] == 'x' || num[1] == 'X')) ? 16 : 10);
+		if (errno || *end != '\0' || end == num) {
+			goto out_bad;
+		}
+		if (neg && n > (unsigned long long)INT64_MAX + 1) {
+			goto out_bad;
+		}
+		if (!(v = launch_data_alloc(LAUNCH_DATA_INTEGER))) {
+			return -1;
+		}
+		/* Values past INT64_MAX wrap, as CFNumber's unsigned 64-bit ones do
+		 * when read back as long long.
+		 */
+		launch_data_set_integer(v, neg ? (long long)(0 - n) : (long long)n);
+		break;
+	}
+	case PLIST_REAL: {
+		char num[128];
+		double d;
+
+		plist_trim(&s, &e);
+		if (s == e || (size_t)(e - s) >= sizeof(num)) {
+			goto out_bad;
+		}
+		memcpy(num, s, (size_t)(e - s));
+		num[e - s] = '\0';
+		d = strtod(num, &end);
+		if (*end != '\0' || end == num) {
+			goto out_bad;
+		}
+		if (!(v = launch_data_alloc(LAUNCH_DATA_REAL))) {
+			return -1;
+		}
+		launch_data_set_real(v, d);
+		break;
+	}
+	case PLIST_TRUE:
+	case PLIST_FALSE:
+		plist_trim(&s, &e);
+		if (s != e) {
+			goto out_bad;
+		}
+		if (!(v = launch_data_alloc(LAUNCH_DATA_BOOL))) {
+			return -1;
+		}
+		launch_data_set_bool(v, kind == PLIST_TRUE);
+		break;
+	case PLIST_DATA:
+		if (!(v = plist_b64_decode(s, text->len))) {
+			return -1;
+		}
+		break;
+	case PLIST_DATE:
+		break;
+	default:
+		goto out_bad;
+	}
+
+	return plist_builder_value(pb, v);
+out_bad:
+	errno = EINVAL;
+	return -1;
+}
+
+static launch_data_t
+plist_parse_xml(const char *buf, size_t len)
+{
+	struct plist_xml x;
+	struct plist_builder *pb;
+	launch_data_t r = NULL;
+	int tok, leaf = PLIST_NONE;
+	bool in_plist = false, done_plist = false;
+
+	if (!(pb = calloc(1, sizeof(*pb)))) {
+		return NULL;
+	}
+	memset(&x, 0, sizeof(x));
+	x.p = buf;
+	x.end = buf + len;
+
+	/* A UTF-8 byte order mark. */
+	if (plist_has_prefix(x.p, x.end, "\xef\xbb\xbf")) {
+		x.p += 3;
+	}
+
+	while ((tok = plist_xml_next(&x)) != PLIST_XML_EOF) {
+		int kind;
+
+		if (tok == PLIST_XML_ERROR) {
+			goto out_bad;
+		}
+		if (tok == PLIST_XML_TEXT) {
+			continue;
+		}
+
+		kind = plist_xml_kind(&x);
+
+		if (leaf != PLIST_NONE) {
+			/* Nothing but text may appear inside a scalar. */
+			if (tok != PLIST_XML_END || kind != leaf) {
+				goto out_bad;
+			}
+			if (plist_xml_leaf(pb, leaf, &x.text) == -1) {
+				goto out;
+			}
+			leaf = PLIST_NONE;
+			goto next;
+		}
+
+		/* Between elements, only whitespace. */
+		if (x.text_significant || done_plist) {
+			goto out_bad;
+		}
+
+		switch (kind) {
+		case PLIST_PLIST:
+			if (tok == PLIST_XML_START) {
+				if (in_plist || pb->depth || pb->have_root) {
+					goto out_bad;
+				}
+				in_plist = true;
+			} else if (tok == PLIST_XML_END) {
+				if (!in_plist || pb->depth) {
+					goto out_bad;
+				}
+				in_plist = false;
+				done_plist = true;
+			} else {
+				goto out_bad;
+			}
+			break;
+		case PLIST_DICT:
+		case PLIST_ARRAY:
+			if (tok == PLIST_XML_START) {
+				if (plist_builder_open(pb, kind == PLIST_DICT) == -1) {
+					goto out;
+				}
+			} else if (tok == PLIST_XML_END) {
+				if (pb->depth == 0 || plist_builder_close(pb, kind == PLIST_DICT) == -1) {
+					goto out_bad;
+				}
+			} else if (plist_builder_open(pb, kind == PLIST_DICT) == -1 || plist_builder_close(pb, kind == PLIST_DICT) == -1) {
+				goto out;
+			}
+			break;
+		case PLIST_NONE:
+			goto out_bad;
+		default:
+			if (tok == PLIST_XML_START) {
+				leaf = kind;
+			} else if (tok == PLIST_XML_EMPTY) {
+				x.text.len = 0;
+				if (plist_xml_leaf(pb, kind, &x.text) == -1) {
+					goto out;
+				}
+			} else {
+				goto out_bad;
+			}
+			break;
+		}
+next:
+		x.text.len = 0;
+		x.text_significant = false;
+	}
+
+	if (leaf != PLIST_NONE || in_plist || pb->depth || x.text_significant || !pb->root) {
+		goto out_bad;
+	}
+
+	r = pb->root;
+	pb->root = NULL;
+	goto out;
+out_bad:
+	errno = EINVAL;
+out:
+	if (x.text.failed && !r) {
+		errno = ENOMEM;
+	}
+	plist_builder_free(pb);
+	free(pb);
+	free(x.text.p);
+	return r;
+}
+
+#pragma mark Binary Parser
+
+struct plist_bin {
+	const uint8_t *buf;
+	size_t objects_end;	/* objects live in [8, objects_end) */
+	const uint8_t *offsets;
+	uint64_t nobjects;
+	uint8_t offset_size;
+	uint8_t ref_size;
+	uint8_t *visiting;
+	uint64_t budget;	/* objects still allowed to be decoded */
+};
+
+static uint64_t
+plist_be(const uint8_t *p, size_t n)
+{
+	uint64_t v = 0;
+
+	while (n-- > 0) {
+		v = (v << 8) | *p++;
+	}
+	return v;
+}
+
+static int
+plist_bin_int(const struct plist_bin *b, size_t *off, uint64_t *v)
+{
+	size_t n;
+
+	if (*off >= b->objects_end || (b->buf[*off] & 0xf0) != 0x10 || (b->buf[*off] & 0x0f) > 4) {
+		return -1;
+	}
+	n = (size_t)1 << (b->buf[*off] & 0x0f);
+	if (b->objects_end - *off - 1 < n) {
+		return -1;
+	}
+	/* 16-byte integers are only written for values that need the top bit of
+	 * 64; the low eight bytes are the value.
+	 */
+	*v = n == 16 ? plist_be(b->buf + *off + 9, 8) : plist_be(b->buf + *off + 1, n);
+	*off += 1 + n;
+
+	return 0;
+}
+
+/* The element count of a data, string, array or dictionary object; past 14 it
+ * follows the marker as an integer object.
+ */
+static int
+plist_bin_count(const struct plist_bin *b, size_t *off, uint64_t *cnt)
+{
+	uint8_t info = b->buf[*off] & 0x0f;
+
+	(*off)++;
+	if (info != 0x0f) {
+		*cnt = info;
+		return 0;
+	}
+	return plist_bin_int(b, off, cnt);
+}
+
+static int plist_bin_object(struct plist_bin *b, uint64_t ref, size_t depth, launch_data_t *out);
+
+static int
+plist_bin_ref(struct plist_bin *b, size_t off, uint64_t i, size_t depth, launch_data_t *out)
+{
+	return plist_bin_object(b, plist_be(b->buf + off + i * b->ref_size, b->ref_size), depth, out);
+}
+
+static launch_data_t
+plist_bin_utf16(const uint8_t *p, uint64_t units)
+{
+	struct plist_buf s;
+	launch_data_t d;
+	uint64_t i;
+
+	memset(&s, 0, sizeof(s));
+	plist_buf_reserve(&s, (size_t)units * 3);
+	for (i = 0; i < units; i++) {
+		uint32_t cp = (uint32_t)plist_be(p + i * 2, 2);
+
+		if (cp >= 0xd800 && cp <= 0xdbff && i + 1 < units) {
+			uint32_t lo = (uint32_t)plist_be(p + i * 2 + 2, 2);
+			if (lo >= 0xdc00 && lo <= 0xdfff) {
+				cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+				i++;
+			}
+		}
+		if (cp >= 0xd800 && cp <= 0xdfff) {
+			cp = 0xfffd;
+		}
+		plist_buf_utf8(&s, cp);
+	}
+
+	d = s.failed ? NULL : plist_new_string(s.p ? s.p : "", s.len);
+	free(s.p);
+
+	return d;
+}
+
+static int
+plist_bin_object(struct plist_bin *b, uint64_t ref, size_t depth, launch_data_t *out)
+{
+	launch_data_t v = NULL, *items = NULL;
+	uint64_t cnt, i, n;
+	size_t off, avail;
+	uint8_t marker;
+	int r = -1;
+
+	*out = NULL;
+	if (ref >= b->nobjects || depth >= PLIST_MAX_DEPTH || b->visiting[ref] || b->budget == 0) {
+		goto out_bad;
+	}
+	b->budget--;
+	off = (size_t)plist_be(b->offsets + ref * b->offset_size, b->offset_size);
+	if (off < sizeof(PLIST_BINARY_MAGIC) - 1 || off >= b->objects_end) {
+		goto out_bad;
+	}
+
+	marker = b->buf[off];
+	switch (marker >> 4) {
+	case 0x0:
+		if (marker == 0x08 || marker == 0x09) {
+			if (!(v = launch_data_alloc(LAUNCH_DATA_BOOL))) {
+				return -1;
+			}
+			launch_data_set_bool(v, marker == 0x09);
+		} else if (marker != 0x00 && marker != 0x0f) {
+			goto out_bad;
+		}
+		break;
+	case 0x1:
+		if (plist_bin_int(b, &off, &n) == -1) {
+			goto out_bad;
+		}
+		if (!(v = launch_data_alloc(LAUNCH_DATA_INTEGER))) {
+			return -1;
+		}
+		launch_data_set_integer(v, (long long)n);
+		break;
+	case 0x2: {
+		double d;
+
+		if ((marker & 0x0f) != 2 && (marker & 0x0f) != 3) {
+			goto out_bad;
+		}
+		n = (uint64_t)1 << (marker & 0x0f);
+		if (b->objects_end - off - 1 < n) {
+			goto out_bad;
+		}
+		if (n == 4) {
+			uint32_t u = (uint32_t)plist_be(b->buf + off + 1, 4);
+			float f;
+			memcpy(&f, &u, sizeof(f));
+			d = f;
+		} else {
+			uint64_t u = plist_be(b->buf + off + 1, 8);
+			memcpy(&d, &u, sizeof(d));
+		}
+		if (!(v = launch_data_alloc(LAUNCH_DATA_REAL))) {
+			return -1;
+		}
+		launch_data_set_real(v, d);
+		break;
+	}
+	case 0x3:
+		if (marker != 0x33 || b->objects_end - off - 1 < 8) {
+			goto out_bad;
+		}
+		break;
+	case 0x4:
+	case 0x5:
+	case 0x6:
+		if (plist_bin_count(b, &off, &cnt) == -1) {
+			goto out_bad;
+		}
+		avail = b->objects_end - off;
+		if ((marker >> 4) == 0x6 ? cnt > avail / 2 : cnt > avail) {
+			goto out_bad;
+		}
+		if ((marker >> 4) == 0x4) {
+			v = plist_new_opaque(b->buf + off, (size_t)cnt);
+		} else if ((marker >> 4) == 0x5) {
+			v = plist_new_string((const char *)b->buf + off, (size_t)cnt);
+		} else {
+			v = plist_bin_utf16(b->buf + off, cnt);
+		}
+		if (!v) {
+			return -1;
+		}
+		break;
+	case 0x8:
+		if (b->objects_end - off - 1 < (size_t)(marker & 0x0f) + 1) {
+			goto out_bad;
+		}
+		break;
+	case 0xa:
+	case 0xd:
+		if (plist_bin_count(b, &off, &cnt) == -1) {
+			goto out_bad;
+		}
+		n = (marker >> 4) == 0xd ? 2 : 1;
+		if (cnt > (b->objects_end - off) / b->ref_size / n) {
+			goto out_bad;
+		}
+
+		b->visiting[ref] = 1;
+		if ((marker >> 4) == 0xa) {
+			if (!(items = malloc((size_t)cnt * sizeof(launch_data_t) + 1))) {
+				goto out_unmark;
+			}
+			for (i = 0, n = 0; i < cnt; i++) {
+				if (plist_bin_ref(b, off, i, depth + 1, &items[n]) == -1) {
+					goto out_unmark;
+				}
+				if (items[n]) {
+					n++;
+				}
+			}
+			v = plist_new_array(items, (size_t)n);
+			if (!v) {
+				goto out_unmark;
+			}
+			cnt = 0;
+		} else {
+			if (!(v = launch_data_alloc(LAUNCH_DATA_DICTIONARY))) {
+				goto out_unmark;
+			}
+			for (i = 0; i < cnt; i++) {
+				launch_data_t key, val;
+
+				if (plist_bin_ref(b, off, i, depth + 1, &key) == -1) {
+					goto out_unmark;
+				}
+				if (!key || launch_data_get_type(key) != LAUNCH_DATA_STRING) {
+					if (key) {
+						launch_data_free(key);
+					}
+					errno = EINVAL;
+					goto out_unmark;
+				}
+				if (plist_bin_ref(b, off, cnt + i, depth + 1, &val) == -1) {
+					launch_data_free(key);
+					goto out_unmark;
+				}
+				if (val) {
+					launch_data_dict_insert(v, val, launch_data_get_string(key));
+				}
+				launch_data_free(key);
+			}
+		}
+		b->visiting[ref] = 0;
+		free(items);
+		break;
+	default:
+		goto out_bad;
+	}
+
+	*out = v;
+	return 0;
+out_unmark:
+	b->visiting[ref] = 0;
+	if (items) {
+		/* Only the first n slots were filled. */
+		for (i = 0; i < n && (marker >> 4) == 0xa; i++) {
+			launch_data_free(items[i]);
+		}
+		free(items);
+	}
+	if (v) {
+		launch_data_free(v);
+	}
+	return r;
+out_bad:
+	errno = EINVAL;
+	return -1;
+}
+
+static launch_data_t
+plist_parse_binary(const uint8_t *buf, size_t len)
+{
+	const uint8_t *t = buf + len - PLIST_BINARY_TRAILER;
+	struct plist_bin b;
+	launch_data_t r = NULL;
+	uint64_t top, table;
+
+	memset(&b, 0, sizeof(b));
+	b.buf = buf;
+	b.offset_size = t[6];
+	b.ref_size = t[7];
+	b.nobjects = plist_be(t + 8, 8);
+	top = plist_be(t + 16, 8);
+	table = plist_be(t + 24, 8);
+
+	if (b.offset_size < 1 || b.offset_size > 8 || b.ref_size < 1 || b.ref_size > 8
+		|| table < sizeof(PLIST_BINARY_MAGIC) - 1 || table > len - PLIST_BINARY_TRAILER
+		|| b.nobjects == 0 || top >= b.nobjects
+		|| b.nobjects > (len - PLIST_BINARY_TRAILER - table) / b.offset_size) {
+		errno = EINVAL;
+		return NULL;
+	}
+	b.objects_end = (size_t)table;
+	b.offsets = buf + table;
+	/* A tree gets one object per reference, plus the top. Sharing a
+	 * container between parents is what would take more, and that is how
+	 * a few hundred bytes would otherwise expand without bound.
+	 */
+	b.budget = (table - (sizeof(PLIST_BINARY_MAGIC) - 1)) / b.ref_size + 1;
+
+	if (!(b.visiting = calloc((size_t)b.nobjects, 1))) {
+		return NULL;
+	}
+
+	if (plist_bin_object(&b, top, 0, &r) == 0 && !r) {
+		errno = EINVAL;
+	}
+	free(b.visiting);
+
+	return r;
+}
+
+#pragma mark Entry Points
+
+launch_data_t
+launch_data_plist_parse(const void *buf, size_t len)
+{
+	if (len >= sizeof(PLIST_BINARY_MAGIC) - 1 && memcmp(buf, PLIST_BINARY_MAGIC, sizeof(PLIST_BINARY_MAGIC) - 1) == 0) {
+		if (len < sizeof(PLIST_BINARY_MAGIC) - 1 + PLIST_BINARY_TRAILER) {
+			errno = EINVAL;
+			return NULL;
+		}
+		return plist_parse_binary(buf, len);
+	}
+
+	return plist_parse_xml(buf, len);
+}
+
+launch_data_t
+launch_data_plist_read_file(const char *path)
+{
+	launch_data_t r = NULL;
+	struct stat sb;
+	size_t off = 0;
+	ssize_t n;
+	char *buf;
+	int fd, saved_errno;
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return NULL;
+	}
+	if (fstat(fd, &sb) == -1) {
+		goto out;
+	}
+	if (!S_ISREG(sb.st_mode)) {
+		errno = EINVAL;
+		goto out;
+	}
+	if (!(buf = malloc((size_t)sb.st_size + 1))) {
+		goto out;
+	}
+	while (off < (size_t)sb.st_size) {
+		if ((n = read(fd, buf + off, (size_t)sb.st_size - off)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		} else if (n == 0) {
+			break;
+		}
+		off += (size_t)n;
+	}
+	if (off == (size_t)sb.st_size) {
+		r = launch_data_plist_parse(buf, off);
+	} else if (n == 0) {
+		errno = EINVAL;
+	}
+	free(buf);
+out:
+	saved_errno = errno;
+	(void)close(fd);
+	errno = saved_errno;
+	return r;
+}
+
+#pragma mark XML Serializer
+
+static void
+plist_xml_escape(struct plist_buf *b, const char *s)
+{
+	const char *p;
+
+	for (p = s; *p; p++) {
+		const char *ent = NULL;
+
+		switch (*p) {
+		case '<':
+			ent = "&lt;";
+			break;
+		case '>':
+			ent = "&gt;";
+			break;
+		case '&':
+			ent = "&amp;";
+			break;
+		default:
+			continue;
+		}
+		plist_buf_append(b, s, (size_t)(p - s));
+		plist_buf_puts(b, ent);
+		s = p + 1;
+	}
+	plist_buf_append(b, s, (size_t)(p - s));
+}
+
+static void
+plist_xml_scalar(struct plist_buf *b, const char *tag, const char *text)
+{
+	plist_buf_putc(b, '<');
+	plist_buf_puts(b, tag);
+	plist_buf_putc(b, '>');
+	plist_buf_puts(b, text);
+	plist_buf_puts(b, "</");
+	plist_buf_puts(b, tag);
+	plist_buf_puts(b, ">\n");
+}
+
+static bool
+plist_xml_representable(launch_data_t d)
+{
+	return d && launch_data_get_type(d) != LAUNCH_DATA_ERRNO;
+}
+
+static int
+plist_xml_emit(struct plist_buf *b, launch_data_t d, size_t depth)
+{
+	char num[64];
+	size_t i;
+
+	if (depth >= PLIST_MAX_DEPTH) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	switch (launch_data_get_type(d)) {
+	case LAUNCH_DATA_DICTIONARY:
+		if (launch_data_dict_get_count(d) == 0) {
+			plist_buf_puts(b, "<dict/>\n");
+			break;
+		}
+		plist_buf_puts(b, "<dict>\n");
+		for (i = 0; i < d->_array_cnt; i += 2) {
+			if (!plist_xml_representable(d->_array[i + 1])) {
+				continue;
+			}
+			plist_buf_indent(b, depth + 1);
+			plist_buf_puts(b, "<key>");
+			plist_xml_escape(b, d->_array[i]->string);
+			plist_buf_puts(b, "</key>\n");
+			plist_buf_indent(b, depth + 1);
+			if (plist_xml_emit(b, d->_array[i + 1], depth + 1) == -1) {
+				return -1;
+			}
+		}
+		plist_buf_indent(b, depth);
+		plist_buf_puts(b, "</dict>\n");
+		break;
+	case LAUNCH_DATA_ARRAY:
+		if (d->_array_cnt == 0) {
+			plist_buf_puts(b, "<array/>\n");
+			break;
+		}
+		plist_buf_puts(b, "<array>\n");
+		for (i = 0; i < d->_array_cnt; i++) {
+			if (!plist_xml_representable(d->_array[i])) {
+				continue;
+			}
+			plist_buf_indent(b, depth + 1);
+			if (plist_xml_emit(b, d->_array[i], depth + 1) == -1) {
+				return -1;
+			}
+		}
+		plist_buf_indent(b, depth);
+		plist_buf_puts(b, "</array>\n");
+		break;
+	case LAUNCH_DATA_STRING:
+		plist_buf_puts(b, "<string>");
+		plist_xml_escape(b, d->string);
+		plist_buf_puts(b, "</string>\n");
+		break;
+	case LAUNCH_DATA_INTEGER:
+		snprintf(num, sizeof(num), "%lld", (long long)d->number);
+		plist_xml_scalar(b, "integer", num);
+		break;
+	/* Descriptors and ports go out as the numbers they are, as launchctl's
+	 * conversion to CF always did.
+	 */
+	case LAUNCH_DATA_FD:
+		snprintf(num, sizeof(num), "%d", (int)d->fd);
+		plist_xml_scalar(b, "integer", num);
+		break;
+#if HAS_MACH
+	case LAUNCH_DATA_MACHPORT:
+		snprintf(num, sizeof(num), "%u", (unsigned int)d->mp);
+		plist_xml_scalar(b, "integer", num);
+		break;
+#endif
+	case LAUNCH_DATA_REAL:
+		if (isnan(d->float_num)) {
+			snprintf(num, sizeof(num), "nan");
+		} else if (isinf(d->float_num)) {
+			snprintf(num, sizeof(num), "%sinfinity", d->float_num < 0 ? "-" : "+");
+		} else {
+			snprintf(num, sizeof(num), "%.17g", d->float_num);
+		}
+		plist_xml_scalar(b, "real", num);
+		break;
+	case LAUNCH_DATA_BOOL:
+		plist_buf_puts(b, d->boolean ? "<true/>\n" : "<false/>\n");
+		break;
+	case LAUNCH_DATA_OPAQUE:
+		plist_buf_puts(b, "<data>");
+		plist_b64_encode(b, d->opaque, (size_t)d->opaque_size);
+		plist_buf_puts(b, "</data>\n");
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+char *
+launch_data_plist_xml(launch_data_t d, size_t *len)
+{
+	struct plist_buf b;
+
+	memset(&b, 0, sizeof(b));
+	plist_buf_puts(&b, PLIST_XML_HEADER);
+	if (plist_xml_emit(&b, d, 0) == -1) {
+		free(b.p);
+		return NULL;
+	}
+	plist_buf_puts(&b, PLIST_XML_FOOTER);
+
+	if (b.failed) {
+		free(b.p);
+		errno = ENOMEM;
+		return NULL;
+	}
+	if (len) {
+		*len = b.len;
+	}
+	return b.p;
+}
+
+int
+launch_data_plist_write_file(launch_data_t d, const char *path)
+{
+	size_t len, off = 0;
+	ssize_t n;
+	char *xml;
+	int fd, saved_errno, r = -1;
+
+	if (!(xml = launch_data_plist_xml(d, &len))) {
+		return -1;
+	}
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+		free(xml);
+		return -1;
+	}
+
+	while (off < len) {
+		if ((n = write(fd, xml + off, len - off)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			goto out;
+		}
+		off += (size_t)n;
+	}
+	r = 0;
+out:
+	saved_errno = errno;
+	if (close(fd) == -1 && r == 0) {
+		saved_errno = errno;
+		r = -1;
+	}
+	free(xml);
+	errno = saved_errno;
+	return r;
+}
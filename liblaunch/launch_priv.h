@@ -45,6 +45,49 @@ __BEGIN_DECLS
 #define LAUNCH_KEY_SETRESOURCELIMITS "SetResourceLimits"
 #define LAUNCH_KEY_GETRUSAGESELF "GetResourceUsageSelf"
 #define LAUNCH_KEY_GETRUSAGECHILDREN "GetResourceUsageChildren"
+#define LAUNCH_KEY_GETHASHSTATS "GetHashStats"
+#define LAUNCH_KEY_GETSPAWNSTATS "GetSpawnStats"
+#define LAUNCH_KEY_SETSPAWNLIMITS "SetSpawnLimits"
+/* Like SubmitJob with an array, but if any job fails to import, none are
+ * loaded; the others report ECANCELED.
+ */
+#define LAUNCH_KEY_SUBMITJOBSATOMICALLY "SubmitJobsAtomically"
+/* Takes the Generation from an earlier reply, or 0, and replies with the jobs
+ * changed since, keyed by label as for GetJobs, and the labels of the jobs
+ * removed since. Apply Removed before Jobs: a job removed and loaded again is
+ * in both. If launchd cannot tell what changed, because the generation is 0,
+ * from another launchd, or older than the removals it remembers, Complete is
+ * true and Jobs has every job; forget any not in it.
+ */
+#define LAUNCH_KEY_GETJOBSSINCE "GetJobsSince"
+
+#define LAUNCH_KEY_HASHSTATS_COUNT "Count"
+#define LAUNCH_KEY_HASHSTATS_BUCKETS "Buckets"
+#define LAUNCH_KEY_HASHSTATS_USEDBUCKETS "UsedBuckets"
+#define LAUNCH_KEY_HASHSTATS_LONGESTCHAIN "LongestChain"
+#define LAUNCH_KEY_HASHSTATS_GROWING "Growing"
+
+#define LAUNCH_KEY_JOBSSINCE_GENERATION "Generation"
+#define LAUNCH_KEY_JOBSSINCE_COMPLETE "Complete"
+#define LAUNCH_KEY_JOBSSINCE_JOBS "Jobs"
+#define LAUNCH_KEY_JOBSSINCE_REMOVED "Removed"
+
+/* GetSpawnStats replies, and SetSpawnLimits takes, the limits on job starts
+ * in flight. A limit of zero means no limit. Delays are in microseconds; the
+ * histogram counts admitted starts that waited less than 1 ms, 10 ms, 100 ms,
+ * 1 s, 10 s, and longer.
+ */
+#define LAUNCH_KEY_SPAWNSTATS_LIMIT "Limit"
+#define LAUNCH_KEY_SPAWNSTATS_PERMANAGERLIMIT "PerManagerLimit"
+#define LAUNCH_KEY_SPAWNSTATS_INFLIGHT "InFlight"
+#define LAUNCH_KEY_SPAWNSTATS_QUEUED "Queued"
+#define LAUNCH_KEY_SPAWNSTATS_ADMITTED "Admitted"
+#define LAUNCH_KEY_SPAWNSTATS_DELAYED "Delayed"
+#define LAUNCH_KEY_SPAWNSTATS_DEMANDED "Demanded"
+#define LAUNCH_KEY_SPAWNSTATS_TIMEDOUT "TimedOut"
+#define LAUNCH_KEY_SPAWNSTATS_TOTALDELAY "TotalDelay"
+#define LAUNCH_KEY_SPAWNSTATS_MAXDELAY "MaxDelay"
+#define LAUNCH_KEY_SPAWNSTATS_DELAYHISTOGRAM "DelayHistogram"
 
 #define LAUNCHD_SOCKET_ENV "LAUNCHD_SOCKET"
 #define LAUNCHD_SOCK_PREFIX _PATH_VARTMP "launchd"
@@ -106,6 +149,12 @@ __BEGIN_DECLS
 #define LAUNCH_JOBKEY_MACH_ENTERKERNELDEBUGGERONCLOSE "EnterKernelDebuggerOnClose"
 #define LAUNCH_JOBKEY_LOWPRIORITYBACKGROUNDIO "LowPriorityBackgroundIO"
 #define LAUNCH_JOBKEY_LEGACYTIMERS "LegacyTimers"
+#define LAUNCH_JOBKEY_STARTPRIORITY "StartPriority"
+
+#define LAUNCH_JOBINETDCOMPATIBILITY_BATCHACCEPT "BatchAccept"
+#define LAUNCH_JOBINETDCOMPATIBILITY_LOGCONNECTIONS "LogConnections"
+#define LAUNCH_JOBINETDCOMPATIBILITY_MAXCHILDREN "MaxChildren"
+#define LAUNCH_JOBINETDCOMPATIBILITY_WORKERS "Workers"
 
 #define LAUNCH_ENV_INSTANCEID "LaunchInstanceID"
 
@@ -178,6 +227,104 @@ mpm_uncork_fork(mach_port_t ajob);
 launch_data_t
 launch_socket_service_check_in(void);
 
+/* Sends all 'cnt' requests on the one connection without waiting in between
+ * and fills 'resps' with their replies, in the same order, as they come back.
+ * Each reply must be freed with launch_data_free(). Returns 0, or -1 with
+ * errno set and no replies at all.
+ *
+ * Meant for queries such as GetJob. Requests that launch_msg() treats
+ * specially, CheckIn and SubmitJob, should still go through launch_msg().
+ * launchd only understands the pipelined framing as of this version; an older
+ * one drops the connection.
+ */
+int
+launch_msg_pipeline(launch_data_t *reqs, launch_data_t *resps, size_t cnt);
+
+/* Called once per launch_msg_async() request, on a thread owned by liblaunch,
+ * with either the reply or, when 'resp' is NULL, the errno the request failed
+ * with. The reply belongs to the handler, which must free it with
+ * launch_data_free().
+ */
+typedef void (*launch_msg_handler_t)(launch_data_t resp, int err, void *ctx);
+
+/* Sends 'msg' and returns without waiting for the reply, which is handed to
+ * 'handler' instead. Unlike launch_msg(), callers on different threads never
+ * wait on each other's round trips: a request only holds its connection for
+ * as long as it takes to queue it, and replies are matched to requests by ID.
+ * Returns 0 once the request is queued, or -1 with errno set, in which case
+ * the handler is never called. Handlers for requests on the same connection
+ * run one at a time, in the order the replies arrive.
+ *
+ * The same restrictions as for launch_msg_pipeline() apply.
+ */
+int
+launch_msg_async(launch_data_t msg, launch_msg_handler_t handler, void *ctx);
+
+/* How many connections launch_msg_async() spreads requests over, handing
+ * them out in turn; LAUNCH_MSG_CONN_PER_THREAD gives every calling thread one
+ * of its own instead, whose requests still in flight fail with ECANCELED when
+ * the thread exits. The default is a single connection. Must be called before
+ * the first launch_msg_async(), or fails with EBUSY.
+ */
+#define LAUNCH_MSG_CONN_PER_THREAD 0
+
+int
+launch_msg_async_set_connections(size_t n);
+
+/* launchd publishes the PID, last exit status and start count of every job it
+ * has loaded in a table of fixed-size slots, in a file next to its socket
+ * that it keeps mapped and updates as jobs start and exit. Reading it takes no
+ * IPC at all, but like the socket it is only open to launchd's own user. Each
+ * slot is guarded by its own sequence count, which launchd makes odd while it
+ * writes the slot; a reader copies the slot and keeps it only if the count was
+ * even and unchanged around the copy.
+ */
+#define LAUNCH_JOBSTAT_FILE "jobstat"
+#define LAUNCH_JOBSTAT_MAGIC 0x3154415453424f4aull /* "JOBSTAT1" */
+#define LAUNCH_JOBSTAT_VERSION 1
+#define LAUNCH_JOBSTAT_LABEL_MAX 224
+
+#define LAUNCH_JOBSTAT_FREE 0
+#define LAUNCH_JOBSTAT_LOADED 1		/* never started */
+#define LAUNCH_JOBSTAT_RUNNING 2
+#define LAUNCH_JOBSTAT_EXITED 3
+
+/* ljs_flags */
+#define LAUNCH_JOBSTAT_TRUNCATED 0x1	/* the label did not fit */
+
+struct launch_jobstat_header {
+	uint64_t ljh_magic;
+	uint32_t ljh_version;
+	uint32_t ljh_slotsize;
+	uint32_t ljh_nslots;
+	/* Slots [0, ljh_used) have been handed out at some point. */
+	uint32_t ljh_used;
+	/* Jobs loaded right now that did not get a slot. */
+	uint32_t ljh_overflow;
+	uint32_t ljh_pid;
+	uint8_t ljh_reserved[32];
+};
+
+struct launch_jobstat_slot {
+	uint32_t ljs_seq;
+	uint16_t ljs_state;
+	uint16_t ljs_flags;
+	int32_t ljs_pid;
+	int32_t ljs_status;		/* as from wait(2) */
+	uint64_t ljs_starts;
+	int64_t ljs_start_time;		/* seconds since the Epoch */
+	char ljs_label[LAUNCH_JOBSTAT_LABEL_MAX];
+};
+
+/* Copies the slots of all loaded jobs out of the table of the launchd that
+ * launch_msg() would talk to. On success '*slots' is an array of '*cnt' slots
+ * to be released with free(). Fails with ENOENT if there is no table, and
+ * with EOVERFLOW if it does not have every job or every label in full; the
+ * caller should then ask launchd with VPROC_GSK_ALLJOBS instead.
+ */
+int
+launch_jobstat_copy(struct launch_jobstat_slot **slots, size_t *cnt);
+
 __END_DECLS
 
 #pragma GCC visibility pop
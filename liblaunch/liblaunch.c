@@ -48,6 +48,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pwd.h>
+#include <poll.h>
+#include <signal.h>
 #include <assert.h>
 #include <uuid/uuid.h>
 #include <sys/syscall.h>
@@ -85,12 +87,24 @@ struct launch_msg_header {
 	uint64_t len;
 };
 
+/* The envelope: a header with its own magic that also carries a request ID.
+ * A client that sends one gets its reply back in one with the same ID, so it
+ * can have any number of requests in flight on one connection. Clients that
+ * never send one see the old framing only.
+ */
+struct launch_msg_header_tagged {
+	uint64_t magic;
+	uint64_t len;
+	uint64_t reqid;
+};
+
 #define LAUNCH_MSG_HEADER_MAGIC 0xD2FEA02366B39A41ull
+#define LAUNCH_MSG_HEADER_MAGIC_TAGGED 0xD2FEA02366B39A42ull
 
-/* launch_data_array_pop_first is located in launch_data.c */
-launch_data_t launch_data_array_pop_first(launch_data_t where);
 /* _fd is used in both liblaunch.c and inside of launch_data.c */
 int _fd(int fd);
+/* _launch_msg_release is used by launch_data_free() in launch_data.c */
+void _launch_msg_release(launch_data_t root);
 void launch_client_init(void);
 void launch_msg_getmsgs(launch_data_t m, void *context);
 launch_data_t launch_msg_internal(launch_data_t d);
@@ -105,6 +119,9 @@ _launch_init_globals(launch_globals_t globals)
 	globals->lc_once = once;
     /* XXX: Not checking return value of pthread_mutex_init */
 	pthread_mutex_init(&globals->lc_mtx, NULL);
+	globals->async_once = once;
+	pthread_mutex_init(&globals->async_mtx, NULL);
+	globals->async_nconns = 1;
 }
 
 #if !_LIBLAUNCH_HAS_ALLOC_ONCE
@@ -126,6 +143,29 @@ _launch_globals_impl(void)
 }
 #endif
 
+/* Drop one reference on a receive buffer shared with detached messages. */
+static void
+_launch_arena_release(struct _launch_arena *arena)
+{
+	if (__sync_sub_and_fetch(&arena->refcnt, 1) == 0) {
+		free(arena->buf);
+		free(arena);
+	}
+}
+
+/* Called by launch_data_free() on a detached message root. The message header
+ * in front of the root was consumed by launchd_msg_recv(), so the first of the
+ * two words just before the root, whichever header it was, is reused to point
+ * back at the owning arena.
+ */
+void
+_launch_msg_release(launch_data_t root)
+{
+	struct launch_msg_header *lmhp = (struct launch_msg_header *)root - 1;
+
+	_launch_arena_release((struct _launch_arena *)(uintptr_t)lmhp->magic);
+}
+
 /* Set the file descriptor to FD_CLOEXEC, in effect, the descriptor will close
  * if execve(2) is called (we transform into a new process)
  */
@@ -139,33 +179,21 @@ int _fd(int fd)
 	return fd;
 }
 
-#ifndef UNIT_TEST
-void
-launch_client_init(void)
+/* Where launchd is listening for the calling process. Returns -1, with
+ * errno set to ENOENT, where there is no way to tell on this platform.
+ */
+int
+launch_client_sockaddr(struct sockaddr_un *sunp)
 {
-	struct sockaddr_un sun;
 	char *where = getenv(LAUNCHD_SOCKET_ENV);
-	char *_launchd_fd = getenv(LAUNCHD_TRUSTED_FD_ENV);
-	int dfd, lfd = -1, cifd = -1;
 #ifdef __APPLE__
     name_t spath;
 #else
 #pragma message "PORT: Figure out how to handle spath from bootstrap"
 #endif
 
-	if (_launchd_fd) {
-		cifd = strtol(_launchd_fd, NULL, 10);
-		if ((dfd = dup(cifd)) >= 0) {
-			close(dfd);
-			_fd(cifd);
-		} else {
-			cifd = -1;
-		}
-		unsetenv(LAUNCHD_TRUSTED_FD_ENV);
-	}
-
-	memset(&sun, 0, sizeof(sun));
-	sun.sun_family = AF_UNIX;
+	memset(sunp, 0, sizeof(*sunp));
+	sunp->sun_family = AF_UNIX;
 
 	/* The rules are as follows.
 	 * - All users (including root) talk to their per-user launchd's by default.
@@ -174,26 +202,53 @@ launch_client_init(void)
 	 *   talk to the system launchd.
 	 */
 	if (where && where[0] != '\0') {
-		strncpy(sun.sun_path, where, sizeof(sun.sun_path));
+		strncpy(sunp->sun_path, where, sizeof(sunp->sun_path));
 	} else {
 #ifdef __APPLE__
 		if (_vprocmgr_getsocket(spath) == 0) {
 			if ((getenv("SUDO_COMMAND") || getenv("__USE_SYSTEM_LAUNCHD")) && geteuid() == 0) {
 				/* Talk to the system launchd. */
-				strncpy(sun.sun_path, LAUNCHD_SOCK_PREFIX "/sock", sizeof(sun.sun_path));
+				strncpy(sunp->sun_path, LAUNCHD_SOCK_PREFIX "/sock", sizeof(sunp->sun_path));
 			} else {
 				/* Talk to our per-user launchd. */
 				size_t min_len;
 
-				min_len = sizeof(sun.sun_path) < sizeof(spath) ? sizeof(sun.sun_path) : sizeof(spath);
+				min_len = sizeof(sunp->sun_path) < sizeof(spath) ? sizeof(sunp->sun_path) : sizeof(spath);
 
-				strncpy(sun.sun_path, spath, min_len);
+				strncpy(sunp->sun_path, spath, min_len);
 			}
 		}
 #else
+		errno = ENOENT;
+		return -1;
+#endif
+	}
+
+	return 0;
+}
+
+#ifndef UNIT_TEST
+void
+launch_client_init(void)
+{
+	struct sockaddr_un sun;
+	char *_launchd_fd = getenv(LAUNCHD_TRUSTED_FD_ENV);
+	int dfd, lfd = -1, cifd = -1;
+
+	if (_launchd_fd) {
+		cifd = strtol(_launchd_fd, NULL, 10);
+		if ((dfd = dup(cifd)) >= 0) {
+			close(dfd);
+			_fd(cifd);
+		} else {
+			cifd = -1;
+		}
+		unsetenv(LAUNCHD_TRUSTED_FD_ENV);
+	}
+
+	if (launch_client_sockaddr(&sun) == -1) {
 		fprintf(stderr, "Reaching dead branch for this platform in liblaunch.c\n");
 		abort();
-#endif
 	}
 
 	launch_globals_t globals = _launch_globals();
@@ -222,10 +277,6 @@ launch_client_init(void)
 		goto out_bad;
 	}
 
-	if (!(globals->async_resp = launch_data_alloc(LAUNCH_DATA_ARRAY))) {
-		goto out_bad;
-	}
-
 	return;
 out_bad:
 	if (globals->l) {
@@ -239,6 +290,8 @@ out_bad:
 	}
 }
 
+#endif /* UNIT_TEST */
+
 launch_t
 launchd_fdopen(int fd, int cifd)
 {
@@ -287,18 +340,19 @@ out_bad:
 void
 launchd_close(launch_t lh, typeof(close) closefunc)
 {
-	launch_globals_t globals = _launch_globals();
-
-	if (globals->in_flight_msg_recv_client == lh) {
-		globals->in_flight_msg_recv_client = NULL;
+	if (lh->recvclosed) {
+		*lh->recvclosed = true;
 	}
 
 	if (lh->sendbuf)
 		free(lh->sendbuf);
 	if (lh->sendfds)
 		free(lh->sendfds);
-	if (lh->recvbuf)
+	if (lh->recvarena) {
+		_launch_arena_release(lh->recvarena);
+	} else if (lh->recvbuf) {
 		free(lh->recvbuf);
+	}
 	if (lh->recvfds)
 		free(lh->recvfds);
 	closefunc(lh->fd);
@@ -306,13 +360,127 @@ launchd_close(launch_t lh, typeof(close) closefunc)
 	free(lh);
 }
 
-int
-launchd_msg_send(launch_t lh, launch_data_t d)
+/* Messages bigger than this are never packed into one buffer. They are
+ * encoded into a LAUNCH_MSG_STREAM_CHUNK scratch buffer that is written to the
+ * socket each time it fills up. Whatever the socket will not take right away
+ * is kept in sendbuf, exactly sized, for launchd_msg_send(lh, NULL) to finish.
+ */
+#define LAUNCH_MSG_STREAM_THRESHOLD (256 * 1024)
+#define LAUNCH_MSG_STREAM_CHUNK (64 * 1024)
+
+struct launch_msg_stream {
+	launch_t lh;
+	int fd;
+	int err;
+	char *chunk;
+	size_t used;
+	size_t left;
+};
+
+static void
+launchd_msg_stream_flush(struct launch_msg_stream *s)
 {
-	struct launch_msg_header lmh;
+	launch_t lh = s->lh;
+	ssize_t r;
+
+	if (s->err || s->used == 0 || lh->sendlen > 0) {
+		return;
+	}
+
+	if ((r = send(s->fd, s->chunk, s->used, 0)) == -1) {
+		if (errno != EAGAIN) {
+			s->err = errno;
+			return;
+		}
+		r = 0;
+	}
+	s->left -= r;
+
+	if ((size_t)r < s->used) {
+		free(lh->sendbuf);
+		if ((lh->sendbuf = malloc(s->left)) == NULL) {
+			s->err = ENOMEM;
+			return;
+		}
+		memcpy(lh->sendbuf, s->chunk + r, s->used - r);
+		lh->sendlen = s->used - r;
+	}
+	s->used = 0;
+}
+
+static void
+launchd_msg_stream_emit(void *ctx, const void *bytes, size_t len)
+{
+	struct launch_msg_stream *s = ctx;
+	launch_t lh = s->lh;
+	size_t n;
+
+	while (len > 0 && !s->err) {
+		if (lh->sendlen > 0) {
+			memcpy(lh->sendbuf + lh->sendlen, bytes, len);
+			lh->sendlen += len;
+			return;
+		}
+
+		n = LAUNCH_MSG_STREAM_CHUNK - s->used;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(s->chunk + s->used, bytes, n);
+		s->used += n;
+		bytes += n;
+		len -= n;
+
+		if (s->used == LAUNCH_MSG_STREAM_CHUNK) {
+			launchd_msg_stream_flush(s);
+		}
+	}
+}
+
+static int
+launchd_msg_send_stream(launch_t lh, launch_data_t d, int fd2use, const void *hdr, size_t hdrlen, uint64_t msglen)
+{
+	struct launch_msg_stream s;
+
+	memset(&s, 0, sizeof(s));
+	s.lh = lh;
+	s.fd = fd2use;
+	s.left = msglen;
+	if ((s.chunk = malloc(LAUNCH_MSG_STREAM_CHUNK)) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	launchd_msg_stream_emit(&s, hdr, hdrlen);
+	launch_data_pack_emit(d, launchd_msg_stream_emit, &s, NULL);
+	launchd_msg_stream_flush(&s);
+	free(s.chunk);
+
+	lh->sendfdcnt = 0;
+
+	if (s.err) {
+		errno = s.err;
+		return -1;
+	} else if (lh->sendlen > 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Messages are queued behind whatever has not been written yet, so a reply
+ * can be sent while an earlier one is still pending. With holdsend set they
+ * are only queued; the next send without it writes them all with one
+ * sendmsg(), descriptors and all.
+ */
+static int
+launchd_msg_send_internal(launch_t lh, launch_data_t d, bool tagged, uint64_t reqid)
+{
+	struct launch_msg_header_tagged lmh;
 	struct cmsghdr *cm = NULL;
 	struct msghdr mh;
-	struct iovec iov[2];
+	struct iovec iov;
 	size_t sentctrllen = 0;
 	int r;
 
@@ -324,56 +492,55 @@ launchd_msg_send(launch_t lh, launch_data_t d)
 
 	memset(&mh, 0, sizeof(mh));
 
-	/* confirm that the next hack works */
-	assert((d && lh->sendlen == 0) || (!d && lh->sendlen));
-
 	if (d) {
-		size_t fd_slots_used = 0;
-		size_t good_enough_size = 10 * 1024 * 1024;
-		uint64_t msglen;
+		size_t hdrlen = tagged ? sizeof(struct launch_msg_header_tagged) : sizeof(struct launch_msg_header);
+		size_t fd_slots_used = lh->sendfdcnt, fd_cnt = 0;
+		size_t packed_size = launch_data_packed_size(d, &fd_cnt);
+		uint64_t msglen = packed_size + hdrlen; /* type promotion to make the host2wire() macro work right */
+		void *newbuf;
 
-		/* hack, see the above assert to verify "correctness" */
-		free(lh->sendbuf);
-		lh->sendbuf = malloc(good_enough_size);
-		if (!lh->sendbuf) {
-			errno = ENOMEM;
-			return -1;
+		lmh.magic = host2wire(tagged ? LAUNCH_MSG_HEADER_MAGIC_TAGGED : LAUNCH_MSG_HEADER_MAGIC);
+		lmh.len = host2wire(msglen);
+		lmh.reqid = host2wire(reqid);
+
+		if (packed_size > LAUNCH_MSG_STREAM_THRESHOLD && fd_cnt == 0 && lh->sendlen == 0 && !lh->holdsend) {
+			return launchd_msg_send_stream(lh, d, fd2use, &lmh, hdrlen, msglen);
 		}
 
-		free(lh->sendfds);
-		lh->sendfds = malloc(4 * 1024);
-		if (!lh->sendfds) {
-			free(lh->sendbuf);
-			lh->sendbuf = NULL;
+		if ((newbuf = realloc(lh->sendbuf, lh->sendlen + msglen)) == NULL) {
 			errno = ENOMEM;
 			return -1;
 		}
+		lh->sendbuf = newbuf;
 
-		lh->sendlen = launch_data_pack(d, lh->sendbuf, good_enough_size, lh->sendfds, &fd_slots_used);
+		if (fd_cnt > 0) {
+			if ((newbuf = realloc(lh->sendfds, (lh->sendfdcnt + fd_cnt) * sizeof(int))) == NULL) {
+				errno = ENOMEM;
+				return -1;
+			}
+			lh->sendfds = newbuf;
+		}
 
-		if (lh->sendlen == 0) {
+		memcpy(lh->sendbuf + lh->sendlen, &lmh, hdrlen);
+		if (launch_data_pack(d, lh->sendbuf + lh->sendlen + hdrlen, packed_size, lh->sendfds, &fd_slots_used) == 0) {
 			errno = ENOMEM;
 			return -1;
 		}
 
+		lh->sendlen += msglen;
 		lh->sendfdcnt = fd_slots_used;
 
-		msglen = lh->sendlen + sizeof(struct launch_msg_header); /* type promotion to make the host2wire() macro work right */
-		lmh.len = host2wire(msglen);
-		lmh.magic = host2wire(LAUNCH_MSG_HEADER_MAGIC);
-
-		iov[0].iov_base = &lmh;
-		iov[0].iov_len = sizeof(lmh);
-		mh.msg_iov = iov;
-		mh.msg_iovlen = 2;
-	} else {
-		mh.msg_iov = iov + 1;
-		mh.msg_iovlen = 1;
+		if (lh->holdsend) {
+			return 0;
+		}
+	} else if (lh->sendlen == 0) {
+		return 0;
 	}
 
-	iov[1].iov_base = lh->sendbuf;
-	iov[1].iov_len = lh->sendlen;
-
+	iov.iov_base = lh->sendbuf;
+	iov.iov_len = lh->sendlen;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
 
 	if (lh->sendfdcnt > 0) {
 		sentctrllen = mh.msg_controllen = CMSG_SPACE(lh->sendfdcnt * sizeof(int));
@@ -399,10 +566,6 @@ launchd_msg_send(launch_t lh, launch_data_t d)
 		return -1;
 	}
 
-	if (d) {
-		r -= sizeof(struct launch_msg_header);
-	}
-
 	lh->sendlen -= r;
 	if (lh->sendlen > 0) {
 		memmove(lh->sendbuf, lh->sendbuf + r, lh->sendlen);
@@ -411,6 +574,7 @@ launchd_msg_send(launch_t lh, launch_data_t d)
 		lh->sendbuf = malloc(0);
 	}
 
+	/* The descriptors went out with the first byte. */
 	lh->sendfdcnt = 0;
 	free(lh->sendfds);
 	lh->sendfds = malloc(0);
@@ -423,6 +587,416 @@ launchd_msg_send(launch_t lh, launch_data_t d)
 	return 0;
 }
 
+int
+launchd_msg_send(launch_t lh, launch_data_t d)
+{
+	return launchd_msg_send_internal(lh, d, false, 0);
+}
+
+int
+launchd_msg_send_tagged(launch_t lh, launch_data_t d, uint64_t reqid)
+{
+	return launchd_msg_send_internal(lh, d, true, reqid);
+}
+
+int
+launch_msg_deque_push(struct launch_msg_deque *q, launch_data_t d)
+{
+	launch_data_t *items;
+	size_t cap, i;
+
+	if (q->lmd_cnt == q->lmd_cap) {
+		cap = q->lmd_cap ? q->lmd_cap * 2 : 8;
+		if ((items = malloc(cap * sizeof(items[0]))) == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		/* Unwrap the ring into the front of the new one. */
+		for (i = 0; i < q->lmd_cnt; i++) {
+			items[i] = q->lmd_items[(q->lmd_head + i) % q->lmd_cap];
+		}
+		free(q->lmd_items);
+		q->lmd_items = items;
+		q->lmd_head = 0;
+		q->lmd_cap = cap;
+	}
+
+	q->lmd_items[(q->lmd_head + q->lmd_cnt++) % q->lmd_cap] = d;
+	return 0;
+}
+
+launch_data_t
+launch_msg_deque_pop(struct launch_msg_deque *q)
+{
+	launch_data_t d;
+
+	if (q->lmd_cnt == 0) {
+		return NULL;
+	}
+
+	d = q->lmd_items[q->lmd_head];
+	q->lmd_head = (q->lmd_head + 1) % q->lmd_cap;
+	q->lmd_cnt--;
+	return d;
+}
+
+struct launch_async_req {
+	struct launch_async_req *lar_next;
+	uint64_t lar_reqid;
+	launch_msg_handler_t lar_handler;
+	void *lar_ctx;
+	launch_data_t lar_resp;
+};
+
+/* One of launch_msg_async()'s connections. A request is written by the thread
+ * that makes it and added to the pending list, both under lac_mtx, which is
+ * never held for longer than that. A reader thread per connection does all of
+ * the reading, finishes writing what the socket would not take at once, and
+ * runs the handlers with the lock dropped. When the connection fails, the
+ * reader fails everything pending, closes it and exits; the next request on it
+ * opens it again.
+ */
+struct launch_async_conn {
+	pthread_mutex_t lac_mtx;
+	launch_t lac_lh;
+	/* Written to when the reader has to look at lac_lh again. */
+	int lac_wake[2];
+	/* The thread that owned the connection is gone; the reader frees it. */
+	bool lac_closing;
+	struct launch_async_req *lac_head;
+	struct launch_async_req **lac_tailp;
+};
+
+/* Requests answered or failed in one pass of the reader. */
+struct launch_async_done {
+	struct launch_async_conn *lad_conn;
+	struct launch_async_req *lad_head;
+	struct launch_async_req **lad_tailp;
+};
+
+static void
+launch_async_conn_free(struct launch_async_conn *ac)
+{
+	close(ac->lac_wake[0]);
+	close(ac->lac_wake[1]);
+	pthread_mutex_destroy(&ac->lac_mtx);
+	free(ac);
+}
+
+static struct launch_async_conn *
+launch_async_conn_new(void)
+{
+	struct launch_async_conn *ac;
+
+	if ((ac = calloc(1, sizeof(*ac))) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if (pipe(ac->lac_wake) == -1) {
+		free(ac);
+		return NULL;
+	}
+	fcntl(_fd(ac->lac_wake[0]), F_SETFL, O_NONBLOCK);
+	fcntl(_fd(ac->lac_wake[1]), F_SETFL, O_NONBLOCK);
+	pthread_mutex_init(&ac->lac_mtx, NULL);
+	ac->lac_tailp = &ac->lac_head;
+
+	return ac;
+}
+
+static void
+launch_async_getmsgs(launch_data_t m, void *context)
+{
+	struct launch_async_done *done = context;
+	struct launch_async_conn *ac = done->lad_conn;
+	struct launch_async_req *req, **reqp;
+	uint64_t reqid;
+
+	if (!launchd_msg_recv_id(ac->lac_lh, &reqid)) {
+		/* Nothing on this connection asked for it. */
+		return;
+	}
+
+	/* Replies come back in order unless launchd defers one, so this almost
+	 * always stops at the first request.
+	 */
+	for (reqp = &ac->lac_head; (req = *reqp) != NULL; reqp = &req->lar_next) {
+		if (req->lar_reqid == reqid) {
+			if ((*reqp = req->lar_next) == NULL) {
+				ac->lac_tailp = reqp;
+			}
+			req->lar_next = NULL;
+			req->lar_resp = launchd_msg_detach(ac->lac_lh, m);
+			*done->lad_tailp = req;
+			done->lad_tailp = &req->lar_next;
+			return;
+		}
+	}
+}
+
+static void
+launch_async_complete(struct launch_async_req *req, int err)
+{
+	struct launch_async_req *next;
+
+	for (; req != NULL; req = next) {
+		next = req->lar_next;
+		req->lar_handler(req->lar_resp, req->lar_resp ? 0 : err, req->lar_ctx);
+		free(req);
+	}
+}
+
+static void *
+launch_async_reader(void *arg)
+{
+	struct launch_async_conn *ac = arg;
+	struct launch_async_done done;
+	struct pollfd pfd[2];
+	bool closing = false;
+	char buf[64];
+	int err = 0;
+
+	pfd[1].fd = ac->lac_wake[0];
+	pfd[1].events = POLLIN;
+
+	while (err == 0) {
+		pthread_mutex_lock(&ac->lac_mtx);
+		pfd[0].fd = launchd_getfd(ac->lac_lh);
+		pfd[0].events = POLLIN | (ac->lac_lh->sendlen > 0 ? POLLOUT : 0);
+		pthread_mutex_unlock(&ac->lac_mtx);
+
+		if (poll(pfd, 2, -1) == -1 && errno != EINTR) {
+			err = errno;
+		}
+		while (read(ac->lac_wake[0], buf, sizeof(buf)) > 0) {
+		}
+
+		done.lad_conn = ac;
+		done.lad_head = NULL;
+		done.lad_tailp = &done.lad_head;
+
+		pthread_mutex_lock(&ac->lac_mtx);
+		if (ac->lac_closing) {
+			err = ECANCELED;
+		} else if (err == 0 && launchd_msg_send(ac->lac_lh, NULL) == -1 && errno != EAGAIN) {
+			err = errno;
+		} else if (err == 0 && launchd_msg_recv(ac->lac_lh, launch_async_getmsgs, &done) == -1 && errno != EAGAIN) {
+			err = errno;
+		}
+		if (err != 0) {
+			if (ac->lac_head != NULL) {
+				*done.lad_tailp = ac->lac_head;
+				done.lad_tailp = ac->lac_tailp;
+			}
+			ac->lac_head = NULL;
+			ac->lac_tailp = &ac->lac_head;
+			launchd_close(ac->lac_lh, close);
+			ac->lac_lh = NULL;
+			closing = ac->lac_closing;
+		}
+		pthread_mutex_unlock(&ac->lac_mtx);
+
+		/* Once lac_lh is NULL, 'ac' may be reopened, or freed by its owner,
+		 * so it is not touched again unless it is ours to free.
+		 */
+		launch_async_complete(done.lad_head, err);
+	}
+
+	if (closing) {
+		launch_async_conn_free(ac);
+	}
+	return NULL;
+}
+
+/* Called with lac_mtx held and no connection open. */
+static int
+launch_async_conn_open(struct launch_async_conn *ac)
+{
+	struct sockaddr_un sun;
+	sigset_t all, old;
+	pthread_attr_t attr;
+	pthread_t reader;
+	int fd, r;
+
+	if (launch_client_sockaddr(&sun) == -1
+			|| (fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		return -1;
+	}
+	_fd(fd);
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1
+			|| (ac->lac_lh = launchd_fdopen(fd, -1)) == NULL) {
+		r = errno;
+		close(fd);
+		errno = r;
+		return -1;
+	}
+
+	/* Signals are for the application's threads, not ours. */
+	sigfillset(&all);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	r = pthread_create(&reader, &attr, launch_async_reader, ac);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+
+	if (r != 0) {
+		launchd_close(ac->lac_lh, close);
+		ac->lac_lh = NULL;
+		errno = r;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The destructor of a per-thread connection. */
+static void
+launch_async_conn_release(void *arg)
+{
+	struct launch_async_conn *ac = arg;
+	bool open;
+
+	pthread_mutex_lock(&ac->lac_mtx);
+	ac->lac_closing = true;
+	if ((open = ac->lac_lh != NULL)) {
+		(void)write(ac->lac_wake[1], "", 1);
+	}
+	pthread_mutex_unlock(&ac->lac_mtx);
+
+	if (!open) {
+		launch_async_conn_free(ac);
+	}
+}
+
+static void
+launch_async_init(void)
+{
+	launch_globals_t globals = _launch_globals();
+	size_t i;
+
+	pthread_mutex_lock(&globals->async_mtx);
+
+	if (globals->async_nconns == LAUNCH_MSG_CONN_PER_THREAD
+			&& pthread_key_create(&globals->async_key, launch_async_conn_release) != 0) {
+		globals->async_nconns = 1;
+	}
+
+	if (globals->async_nconns != LAUNCH_MSG_CONN_PER_THREAD
+			&& (globals->async_pool = calloc(globals->async_nconns, sizeof(globals->async_pool[0]))) != NULL) {
+		for (i = 0; i < globals->async_nconns; i++) {
+			if ((globals->async_pool[i] = launch_async_conn_new()) == NULL) {
+				while (i-- > 0) {
+					launch_async_conn_free(globals->async_pool[i]);
+				}
+				free(globals->async_pool);
+				globals->async_pool = NULL;
+				break;
+			}
+		}
+	}
+
+	globals->async_inited = true;
+	pthread_mutex_unlock(&globals->async_mtx);
+}
+
+static struct launch_async_conn *
+launch_async_conn_get(void)
+{
+	launch_globals_t globals = _launch_globals();
+	struct launch_async_conn *ac;
+
+	pthread_once(&globals->async_once, launch_async_init);
+
+	if (globals->async_nconns == LAUNCH_MSG_CONN_PER_THREAD) {
+		if ((ac = pthread_getspecific(globals->async_key)) == NULL) {
+			if ((ac = launch_async_conn_new()) == NULL) {
+				return NULL;
+			}
+			if (pthread_setspecific(globals->async_key, ac) != 0) {
+				launch_async_conn_free(ac);
+				errno = ENOMEM;
+				return NULL;
+			}
+		}
+		return ac;
+	}
+
+	if (globals->async_pool == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return globals->async_pool[__sync_fetch_and_add(&globals->async_next, 1) % globals->async_nconns];
+}
+
+int
+launch_msg_async_set_connections(size_t n)
+{
+	launch_globals_t globals = _launch_globals();
+	int r = 0;
+
+	pthread_mutex_lock(&globals->async_mtx);
+	if (globals->async_inited) {
+		errno = EBUSY;
+		r = -1;
+	} else {
+		globals->async_nconns = n;
+	}
+	pthread_mutex_unlock(&globals->async_mtx);
+
+	return r;
+}
+
+int
+launch_msg_async(launch_data_t msg, launch_msg_handler_t handler, void *ctx)
+{
+	struct launch_async_conn *ac;
+	struct launch_async_req *req;
+	int r = -1;
+
+	if (msg == NULL || handler == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((ac = launch_async_conn_get()) == NULL) {
+		return -1;
+	}
+	if ((req = calloc(1, sizeof(*req))) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	req->lar_handler = handler;
+	req->lar_ctx = ctx;
+
+	pthread_mutex_lock(&ac->lac_mtx);
+
+	if (ac->lac_lh == NULL && launch_async_conn_open(ac) == -1) {
+		goto out;
+	}
+
+	req->lar_reqid = ac->lac_lh->nextid++;
+	if (launchd_msg_send_tagged(ac->lac_lh, msg, req->lar_reqid) == -1) {
+		if (errno != EAGAIN) {
+			goto out;
+		}
+		/* The reader writes the rest once the socket takes it. */
+		(void)write(ac->lac_wake[1], "", 1);
+	}
+
+	*ac->lac_tailp = req;
+	ac->lac_tailp = &req->lar_next;
+	req = NULL;
+	r = 0;
+
+out:
+	pthread_mutex_unlock(&ac->lac_mtx);
+	free(req);
+
+	return r;
+}
+
+#ifndef UNIT_TEST
 int
 launch_get_fd(void)
 {
@@ -437,17 +1011,40 @@ launch_get_fd(void)
 	return globals->l->fd;
 }
 
+/* Queues what launchd sent without being asked for launch_msg(NULL) to pick
+ * up. Returns false if 'm' is not such a message.
+ */
+static bool
+launch_msg_queue_async(launch_globals_t globals, launch_data_t m)
+{
+	launch_data_t async_resp;
+
+	if ((LAUNCH_DATA_DICTIONARY != launch_data_get_type(m)) || !(async_resp = launch_data_dict_lookup(m, LAUNCHD_ASYNC_MSG_KEY))) {
+		return false;
+	}
+
+	async_resp = launch_data_copy(async_resp);
+	if (launch_msg_deque_push(&globals->async_resp, async_resp) == -1) {
+		launch_data_free(async_resp);
+	}
+	return true;
+}
+
 void
 launch_msg_getmsgs(launch_data_t m, void *context)
 {
-	launch_data_t async_resp, *sync_resp = context;
+	launch_data_t *sync_resp = context;
+	uint64_t reqid;
 
 	launch_globals_t globals = _launch_globals();
 
-	if ((LAUNCH_DATA_DICTIONARY == launch_data_get_type(m)) && (async_resp = launch_data_dict_lookup(m, LAUNCHD_ASYNC_MSG_KEY))) {
-		launch_data_array_set_index(globals->async_resp, launch_data_copy(async_resp), launch_data_array_get_count(globals->async_resp));
-	} else {
-		*sync_resp = launch_data_copy(m);
+	if (launchd_msg_recv_id(globals->l, &reqid)) {
+		/* Left over from a launch_msg_pipeline() that gave up. */
+		return;
+	}
+
+	if (!launch_msg_queue_async(globals, m)) {
+		*sync_resp = launchd_msg_detach(globals->l, m);
 	}
 }
 
@@ -594,8 +1191,7 @@ launch_msg_internal(launch_data_t d)
 	}
 
 	while (resp == NULL) {
-		if (d == NULL && launch_data_array_get_count(globals->async_resp) > 0) {
-			resp = launch_data_array_pop_first(globals->async_resp);
+		if (d == NULL && (resp = launch_msg_deque_pop(&globals->async_resp)) != NULL) {
 			goto out;
 		}
 		if (launchd_msg_recv(globals->l, launch_msg_getmsgs, &resp) == -1) {
@@ -660,12 +1256,165 @@ out:
 	return resp;
 }
 
+struct launch_msg_pipeline_ctx {
+	launch_data_t *resps;
+	size_t cnt;
+	size_t outstanding;
+	uint64_t firstid;
+};
+
+static void
+launch_msg_pipeline_getmsgs(launch_data_t m, void *context)
+{
+	struct launch_msg_pipeline_ctx *ctx = context;
+	uint64_t reqid;
+
+	launch_globals_t globals = _launch_globals();
+
+	if (!launchd_msg_recv_id(globals->l, &reqid)) {
+		(void)launch_msg_queue_async(globals, m);
+		return;
+	}
+
+	reqid -= ctx->firstid;
+	if (reqid < ctx->cnt && ctx->resps[reqid] == NULL) {
+		ctx->resps[reqid] = launchd_msg_detach(globals->l, m);
+		ctx->outstanding--;
+	}
+}
+
+int
+launch_msg_pipeline(launch_data_t *reqs, launch_data_t *resps, size_t cnt)
+{
+	struct launch_msg_pipeline_ctx ctx = { resps, cnt, cnt, 0 };
+	fd_set rfds, wfds;
+	size_t i;
+	int fd2use, r = -1;
+
+	for (i = 0; i < cnt; i++) {
+		resps[i] = NULL;
+		if (reqs[i] == NULL) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	launch_globals_t globals = _launch_globals();
+	pthread_once(&globals->lc_once, launch_client_init);
+	if (!globals->l) {
+		errno = ENOTCONN;
+		return -1;
+	}
+
+	pthread_mutex_lock(&globals->lc_mtx);
+
+	globals->l->which = globals->s_am_embedded_god ? LAUNCHD_USE_CHECKIN_FD : LAUNCHD_USE_OTHER_FD;
+	if ((fd2use = launchd_getfd(globals->l)) == -1) {
+		errno = EPERM;
+		goto out;
+	}
+
+	/* Queue everything, then write it out in one go. */
+	ctx.firstid = globals->l->nextid;
+	globals->l->nextid += cnt;
+	globals->l->holdsend = true;
+	for (i = 0; i < cnt; i++) {
+		if (launchd_msg_send_tagged(globals->l, reqs[i], ctx.firstid + i) == -1) {
+			globals->l->holdsend = false;
+			goto out;
+		}
+	}
+	globals->l->holdsend = false;
+
+	/* Replies are read while the requests are still being written, or a batch
+	 * bigger than the socket buffers would leave both sides waiting to write.
+	 */
+	while (ctx.outstanding > 0) {
+		if (launchd_msg_send(globals->l, NULL) == -1 && errno != EAGAIN) {
+			goto out;
+		}
+		if (launchd_msg_recv(globals->l, launch_msg_pipeline_getmsgs, &ctx) == -1) {
+			if (errno != EAGAIN) {
+				goto out;
+			} else if (ctx.outstanding > 0) {
+				FD_ZERO(&rfds);
+				FD_ZERO(&wfds);
+				FD_SET(fd2use, &rfds);
+				if (globals->l->sendlen > 0) {
+					FD_SET(fd2use, &wfds);
+				}
+
+				select(fd2use + 1, &rfds, &wfds, NULL, NULL);
+			}
+		}
+	}
+	r = 0;
+
+out:
+	pthread_mutex_unlock(&globals->lc_mtx);
+
+	if (r == -1) {
+		for (i = 0; i < cnt; i++) {
+			if (resps[i]) {
+				launch_data_free(resps[i]);
+				resps[i] = NULL;
+			}
+		}
+	}
+
+	return r;
+}
+
+#endif /* UNIT_TEST */
+
+/* Discard the first 'consumed' bytes and 'fds_consumed' descriptors of the
+ * receive buffer, keeping any partial message that follows. If detached
+ * messages still point into the buffer, the tail moves to a fresh one instead.
+ */
+static int
+launchd_recvbuf_consume(launch_t lh, size_t consumed, size_t fds_consumed)
+{
+	size_t remaining = lh->recvlen - consumed;
+
+	if (lh->recvarena) {
+		void *newbuf = malloc(remaining + 8*1024);
+		if (!newbuf) {
+			return -1;
+		}
+		memcpy(newbuf, lh->recvbuf + consumed, remaining);
+		_launch_arena_release(lh->recvarena);
+		lh->recvarena = NULL;
+		lh->recvbuf = newbuf;
+		lh->recvcap = remaining + 8*1024;
+	} else if (consumed > 0 && remaining > 0) {
+		memmove(lh->recvbuf, lh->recvbuf + consumed, remaining);
+	}
+	lh->recvlen = remaining;
+
+	lh->recvfdcnt -= fds_consumed;
+	if (fds_consumed > 0 && lh->recvfdcnt > 0) {
+		memmove(lh->recvfds, lh->recvfds + fds_consumed, lh->recvfdcnt * sizeof(int));
+	}
+
+	return 0;
+}
+
+/* Whether a whole message starts at 'offset' in the receive buffer. */
+static bool
+launchd_recvbuf_has_msg(launch_t lh, size_t offset)
+{
+	struct launch_msg_header *lmhp = lh->recvbuf + offset;
+
+	return lh->recvlen - offset >= sizeof(struct launch_msg_header) && lh->recvlen - offset >= wire2host(lmhp->len);
+}
+
 int
 launchd_msg_recv(launch_t lh, void (*cb)(launch_data_t, void *), void *context)
 {
 	struct cmsghdr *cm = alloca(4096);
 	launch_data_t rmsg = NULL;
-	size_t data_offset, fd_offset;
+	size_t data_offset, fd_offset, hdrlen, consumed = 0, fds_consumed = 0;
+	bool holdsend = lh->holdsend, closed = false;
 	struct msghdr mh;
 	struct iovec iov;
 	int r;
@@ -680,7 +1429,21 @@ launchd_msg_recv(launch_t lh, void (*cb)(launch_data_t, void *), void *context)
 	mh.msg_iov = &iov;
 	mh.msg_iovlen = 1;
 
-	lh->recvbuf = reallocf(lh->recvbuf, lh->recvlen + 8*1024);
+	if (lh->recvarena) {
+		/* Growing the buffer in place would move detached messages. */
+		if (launchd_recvbuf_consume(lh, 0, 0) == -1) {
+			errno = ENOMEM;
+			return -1;
+		}
+	} else if (lh->recvcap < lh->recvlen + 8*1024) {
+		lh->recvbuf = reallocf(lh->recvbuf, lh->recvlen + 8*1024);
+		if (!lh->recvbuf) {
+			lh->recvlen = lh->recvcap = 0;
+			errno = ENOMEM;
+			return -1;
+		}
+		lh->recvcap = lh->recvlen + 8*1024;
+	}
 
 	iov.iov_base = lh->recvbuf + lh->recvlen;
 	iov.iov_len = 8*1024;
@@ -706,79 +1469,139 @@ launchd_msg_recv(launch_t lh, void (*cb)(launch_data_t, void *), void *context)
 
 	r = 0;
 
-	while (lh->recvlen > 0) {
-		struct launch_msg_header *lmhp = lh->recvbuf;
+	/* Every complete message in the buffer is unpacked in place and handed to
+	 * the callback; the buffer itself is only compacted once at the end.
+	 * Replies sent from the callback are held back while more complete
+	 * messages follow, so that a pipelined batch is answered with one write.
+	 */
+	while (lh->recvlen > consumed) {
+		struct launch_msg_header *lmhp = lh->recvbuf + consumed;
 		uint64_t tmplen;
-		data_offset = sizeof(struct launch_msg_header);
-		fd_offset = 0;
+		fd_offset = fds_consumed;
 
-		if (lh->recvlen < sizeof(struct launch_msg_header))
+		if (lh->recvlen - consumed < sizeof(struct launch_msg_header))
 			goto need_more_data;
 
 		tmplen = wire2host(lmhp->len);
 
-		if (wire2host(lmhp->magic) != LAUNCH_MSG_HEADER_MAGIC || tmplen <= sizeof(struct launch_msg_header)) {
+		switch (wire2host(lmhp->magic)) {
+		case LAUNCH_MSG_HEADER_MAGIC:
+			hdrlen = sizeof(struct launch_msg_header);
+			lh->recvtagged = false;
+			lh->recvid = 0;
+			break;
+		case LAUNCH_MSG_HEADER_MAGIC_TAGGED:
+			hdrlen = sizeof(struct launch_msg_header_tagged);
+			lh->recvtagged = true;
+			break;
+		default:
 			errno = EBADRPC;
 			goto out_bad;
 		}
 
-		if (lh->recvlen < tmplen) {
+		if (tmplen <= hdrlen) {
+			errno = EBADRPC;
+			goto out_bad;
+		}
+		data_offset = consumed + hdrlen;
+
+		if (lh->recvlen - consumed < tmplen) {
 			goto need_more_data;
 		}
 
-		if ((rmsg = launch_data_unpack(lh->recvbuf, lh->recvlen, lh->recvfds, lh->recvfdcnt, &data_offset, &fd_offset)) == NULL) {
+		if ((rmsg = launch_data_unpack(lh->recvbuf, consumed + tmplen, lh->recvfds, lh->recvfdcnt, &data_offset, &fd_offset)) == NULL) {
 			errno = EBADRPC;
 			goto out_bad;
 		}
 
-		launch_globals_t globals = _launch_globals();
+		if (lh->recvtagged) {
+			lh->recvid = wire2host(((struct launch_msg_header_tagged *)lmhp)->reqid);
+		}
 
-		globals->in_flight_msg_recv_client = lh;
+		lh->recvclosed = &closed;
+		lh->holdsend = holdsend || launchd_recvbuf_has_msg(lh, data_offset);
 
 		cb(rmsg, context);
 
 		/* launchd and only launchd can call launchd_close() as a part of the callback */
-		if (globals->in_flight_msg_recv_client == NULL) {
-			r = 0;
-			break;
+		if (closed) {
+			return 0;
 		}
 
-		lh->recvlen -= data_offset;
-		if (lh->recvlen > 0) {
-			memmove(lh->recvbuf, lh->recvbuf + data_offset, lh->recvlen);
-		} else {
-			free(lh->recvbuf);
-			lh->recvbuf = malloc(0);
-		}
+		lh->recvclosed = NULL;
+		lh->holdsend = holdsend;
+		consumed = data_offset;
+		fds_consumed = fd_offset;
+	}
 
-		lh->recvfdcnt -= fd_offset;
-		if (lh->recvfdcnt > 0) {
-			memmove(lh->recvfds, lh->recvfds + fd_offset, lh->recvfdcnt * sizeof(int));
-		} else {
-			free(lh->recvfds);
-			lh->recvfds = malloc(0);
-		}
+	if (launchd_recvbuf_consume(lh, consumed, fds_consumed) == -1) {
+		errno = ENOMEM;
+		return -1;
 	}
 
 	return r;
 
 need_more_data:
+	if (launchd_recvbuf_consume(lh, consumed, fds_consumed) == -1) {
+		errno = ENOMEM;
+		return -1;
+	}
 	errno = EAGAIN;
 out_bad:
 	return -1;
 }
 
+bool
+launchd_msg_recv_id(launch_t lh, uint64_t *reqid)
+{
+	if (lh->recvtagged) {
+		*reqid = lh->recvid;
+	}
+	return lh->recvtagged;
+}
+
+launch_data_t
+launchd_msg_detach(launch_t lh, launch_data_t msg)
+{
+	struct launch_msg_header *lmhp = (struct launch_msg_header *)msg - 1;
+
+	assert(lh->recvclosed != NULL);
+
+	if (!lh->recvarena) {
+		if ((lh->recvarena = malloc(sizeof(struct _launch_arena))) == NULL) {
+			return launch_data_copy(msg);
+		}
+		/* The connection holds one reference until it moves on to a new buffer. */
+		lh->recvarena->buf = lh->recvbuf;
+		lh->recvarena->refcnt = 1;
+	}
+
+	__sync_add_and_fetch(&lh->recvarena->refcnt, 1);
+	lmhp->magic = (uintptr_t)lh->recvarena;
+	msg->type |= LAUNCH_DATA_ARENA_ROOT;
+
+	return msg;
+}
+
 launch_data_t
 launch_data_copy(launch_data_t o)
 {
-	launch_data_t r = launch_data_alloc(o->type);
+	launch_data_t r = launch_data_alloc(launch_data_get_type(o));
 	size_t i;
 
+	if (launch_data_get_type(o) == LAUNCH_DATA_DICTIONARY) {
+		/* Re-insert so that large copies get their own lookup index. */
+		for (i = 0; i < o->_array_cnt; i += 2) {
+			launch_data_dict_insert(r, launch_data_copy(o->_array[i + 1]), o->_array[i]->string);
+		}
+		return r;
+	}
+
 	free(r->_array);
 	memcpy(r, o, sizeof(struct _launch_data));
+	r->type = launch_data_get_type(o);
 
-	switch (o->type) {
-	case LAUNCH_DATA_DICTIONARY:
+	switch (r->type) {
 	case LAUNCH_DATA_ARRAY:
 		r->_array = calloc(1, o->_array_cnt * sizeof(launch_data_t));
 		for (i = 0; i < o->_array_cnt; i++) {
@@ -800,6 +1623,7 @@ launch_data_copy(launch_data_t o)
 	return r;
 }
 
+#ifndef UNIT_TEST
 launch_data_t
 launch_data_new_errno(int e)
 {
@@ -59,6 +59,7 @@
 #include "launch.h"
 #include "launch_priv.h"
 #include "launch_internal.h"
+#include "vproc_transaction.h"
 #ifdef __APPLE__
 /* NOTE: ktrace.h appears to enable Apple OS specific kernel tracing. Until
  * this functionality can be verified further, there's no sense pulling it into
@@ -163,7 +164,7 @@ _vproc_transactions_enable_internal(void *arg __unused)
 		globals->_vproc_transaction_enabled = 1;
 	}
 
-	if (globals->_vproc_transaction_cnt > 0) {
+	if (*(volatile int64_t *)&globals->_vproc_transaction_cnt > 0) {
 		(void)os_assumes_zero(proc_set_dirty(getpid(), true));
 	}
 }
@@ -182,7 +183,7 @@ _vproc_transaction_begin_internal(void *ctx __unused)
 {
 	launch_globals_t globals = _launch_globals();
 
-	int64_t new = ++globals->_vproc_transaction_cnt;
+	int64_t new = __sync_add_and_fetch(&globals->_vproc_transaction_cnt, 1);
 	if (!globals->_vproc_transaction_enabled || new > 1) {
 		return;
 	}
@@ -200,6 +201,11 @@ _vproc_transaction_begin(void)
 {
 	launch_globals_t globals = _launch_globals();
 
+	/* A count of one or more means the queue already exists. */
+	if (_vproc_transaction_fast_begin(&globals->_vproc_transaction_cnt)) {
+		return;
+	}
+
 	dispatch_once_f(&globals->_vproc_transaction_once, NULL, _vproc_transaction_init_once);
 	dispatch_sync_f(globals->_vproc_transaction_queue, NULL, _vproc_transaction_begin_internal);
 }
@@ -231,7 +237,7 @@ _vproc_transaction_end_internal(void *arg)
 {
 	launch_globals_t globals = _launch_globals();
 
-	int64_t new = --globals->_vproc_transaction_cnt;
+	int64_t new = __sync_sub_and_fetch(&globals->_vproc_transaction_cnt, 1);
 	if (!globals->_vproc_transaction_enabled || new > 0) {
 		return;
 	}
@@ -242,7 +248,8 @@ _vproc_transaction_end_internal(void *arg)
 	}
 
 	if (globals->_vproc_gone2zero_callout && !arg) {
-		globals->_vproc_transaction_cnt = 1;
+		/* Nothing else moves the count off zero outside of this queue. */
+		__sync_add_and_fetch(&globals->_vproc_transaction_cnt, 1);
 		dispatch_async_f(globals->_vproc_gone2zero_queue, globals->_vproc_gone2zero_ctx, _vproc_transaction_end_internal2);
 	} else {
 		(void)os_assumes_zero(proc_set_dirty(getpid(), false));
@@ -268,6 +275,10 @@ _vproc_transaction_end(void)
 {
 	launch_globals_t globals = _launch_globals();
 
+	if (_vproc_transaction_fast_end(&globals->_vproc_transaction_cnt)) {
+		return;
+	}
+
 	dispatch_once_f(&globals->_vproc_transaction_once, NULL, _vproc_transaction_init_once);
 	dispatch_sync_f(globals->_vproc_transaction_queue, NULL, _vproc_transaction_end_internal);
 }
@@ -283,7 +294,7 @@ _vproc_transaction_count(void)
 {
 	launch_globals_t globals = _launch_globals();
 
-	return globals->_vproc_transaction_cnt;
+	return *(volatile int64_t *)&globals->_vproc_transaction_cnt;
 }
 
 size_t
@@ -346,7 +357,7 @@ _vproc_transaction_try_exit(int status)
 {
 #if !TARGET_OS_EMBEDDED
 	launch_globals_t globals = _launch_globals();
-	if (globals->_vproc_transaction_cnt == 0) {
+	if (*(volatile int64_t *)&globals->_vproc_transaction_cnt == 0) {
 		_exit(status);
 	}
 #else
@@ -0,0 +1,516 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "liblaunch_test.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
+
+#define ASYNC_TEST_THREADS 8
+#define ASYNC_TEST_REQS 200
+#define ASYNC_BENCH_REQS 20000
+#define ASYNC_MAX_THREADS 32
+#define ASYNC_MAX_CONNS 64
+
+#define ASYNC_DROP "drop"
+
+/* Failures in the children below must not unwind into the test runner. */
+#define ASYNC_CHECK(e) do { \
+	if (!(e)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #e); \
+		_exit(1); \
+	} \
+} while (0)
+
+/* launch_data_new_*() are left out of the test build. */
+static launch_data_t
+async_tests_integer(long long n)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_INTEGER);
+
+	launch_data_set_integer(d, n);
+	return d;
+}
+
+static launch_data_t
+async_tests_string(const char *s)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_STRING);
+
+	launch_data_set_string(d, s);
+	return d;
+}
+
+struct async_tests_echo_ctx {
+	launch_t conn;
+	bool drop;
+};
+
+static void
+async_tests_echo(launch_data_t msg, void *context)
+{
+	struct async_tests_echo_ctx *ctx = context;
+	uint64_t reqid;
+
+	if (launch_data_get_type(msg) == LAUNCH_DATA_STRING
+			&& strcmp(launch_data_get_string(msg), ASYNC_DROP) == 0) {
+		ctx->drop = true;
+	} else if (launchd_msg_recv_id(ctx->conn, &reqid)) {
+		(void)launchd_msg_send_tagged(ctx->conn, msg, reqid);
+	} else {
+		(void)launchd_msg_send(ctx->conn, msg);
+	}
+}
+
+/* Stands in for launchd on 'path': answers every message on every connection
+ * with itself, in the framing it came in, and hangs up on ASYNC_DROP.
+ */
+static pid_t
+async_tests_server(const char *path)
+{
+	struct async_tests_echo_ctx ctx;
+	struct pollfd pfd[1 + ASYNC_MAX_CONNS];
+	launch_t conns[ASYNC_MAX_CONNS];
+	struct sockaddr_un sun;
+	size_t n = 0, i;
+	int lfd, fd;
+	pid_t p;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+	unlink(path);
+	assert_true((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1);
+	assert_int_equal(0, bind(lfd, (struct sockaddr *)&sun, sizeof(sun)));
+	assert_int_equal(0, listen(lfd, ASYNC_MAX_CONNS));
+
+	if ((p = fork()) != 0) {
+		close(lfd);
+		return p;
+	}
+
+	for (;;) {
+		pfd[0].fd = lfd;
+		pfd[0].events = n < ASYNC_MAX_CONNS ? POLLIN : 0;
+		for (i = 0; i < n; i++) {
+			pfd[i + 1].fd = launchd_getfd(conns[i]);
+			pfd[i + 1].events = POLLIN | (conns[i]->sendlen > 0 ? POLLOUT : 0);
+		}
+		if (poll(pfd, n + 1, -1) == -1) {
+			continue;
+		}
+
+		for (i = n; i-- > 0;) {
+			if (pfd[i + 1].revents == 0) {
+				continue;
+			}
+			ctx.conn = conns[i];
+			ctx.drop = false;
+			if ((launchd_msg_send(conns[i], NULL) == -1 && errno != EAGAIN)
+					|| (launchd_msg_recv(conns[i], async_tests_echo, &ctx) == -1 && errno != EAGAIN)
+					|| ctx.drop) {
+				launchd_close(conns[i], close);
+				conns[i] = conns[--n];
+			}
+		}
+
+		if ((pfd[0].revents & POLLIN) && (fd = accept(lfd, NULL, NULL)) != -1) {
+			conns[n++] = launchd_fdopen(fd, -1);
+		}
+	}
+}
+
+struct async_tests_call {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	size_t outstanding;
+	/* Replies and errors, one per request, by the index passed as 'ctx'. */
+	long long *values;
+	int *errs;
+};
+
+struct async_tests_req {
+	struct async_tests_call *call;
+	size_t i;
+};
+
+static void
+async_tests_handler(launch_data_t resp, int err, void *context)
+{
+	struct async_tests_req *req = context;
+	struct async_tests_call *call = req->call;
+
+	pthread_mutex_lock(&call->mtx);
+	call->errs[req->i] = err;
+	if (resp != NULL) {
+		call->values[req->i] = launch_data_get_type(resp) == LAUNCH_DATA_INTEGER ? launch_data_get_integer(resp) : -1;
+		launch_data_free(resp);
+	}
+	if (--call->outstanding == 0) {
+		pthread_cond_signal(&call->cv);
+	}
+	pthread_mutex_unlock(&call->mtx);
+}
+
+/* Sends 'cnt' integers from 'base' up, all at once, and waits for them. */
+static void
+async_tests_calls(long long base, size_t cnt, long long *values, int *errs)
+{
+	struct async_tests_req reqs[ASYNC_TEST_REQS];
+	struct async_tests_call call;
+	launch_data_t d;
+	size_t i;
+
+	pthread_mutex_init(&call.mtx, NULL);
+	pthread_cond_init(&call.cv, NULL);
+	call.outstanding = cnt;
+	call.values = values;
+	call.errs = errs;
+
+	for (i = 0; i < cnt; i++) {
+		reqs[i].call = &call;
+		reqs[i].i = i;
+		values[i] = -1;
+		d = async_tests_integer(base + i);
+		ASYNC_CHECK(launch_msg_async(d, async_tests_handler, &reqs[i]) == 0);
+		launch_data_free(d);
+	}
+
+	pthread_mutex_lock(&call.mtx);
+	while (call.outstanding > 0) {
+		pthread_cond_wait(&call.cv, &call.mtx);
+	}
+	pthread_mutex_unlock(&call.mtx);
+}
+
+static void *
+async_tests_thread(void *arg)
+{
+	long long values[ASYNC_TEST_REQS], base = (long long)(uintptr_t)arg * ASYNC_TEST_REQS;
+	int errs[ASYNC_TEST_REQS];
+	size_t i;
+
+	async_tests_calls(base, ASYNC_TEST_REQS, values, errs);
+	for (i = 0; i < ASYNC_TEST_REQS; i++) {
+		ASYNC_CHECK(errs[i] == 0);
+		ASYNC_CHECK(values[i] == base + (long long)i);
+	}
+	return NULL;
+}
+
+/* launch_msg_async() sets up its connections once per process, so every
+ * configuration gets a child of its own, talking to a server of its own.
+ */
+static void
+async_tests_in_child(void (*fn)(size_t), size_t nconns)
+{
+	char dir[] = "/tmp/liblaunch_test.XXXXXX", path[64];
+	int status;
+	pid_t p, server;
+
+	assert_true(mkdtemp(dir) != NULL);
+	snprintf(path, sizeof(path), "%s/sock", dir);
+	server = async_tests_server(path);
+
+	fflush(stdout);
+	if ((p = fork()) == 0) {
+		signal(SIGPIPE, SIG_IGN);
+		setenv(LAUNCHD_SOCKET_ENV, path, 1);
+		ASYNC_CHECK(launch_msg_async_set_connections(nconns) == 0);
+		fn(nconns);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	assert_true(p > 0);
+	assert_int_equal(p, waitpid(p, &status, 0));
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+	unlink(path);
+	rmdir(dir);
+
+	assert_true(WIFEXITED(status));
+	assert_int_equal(0, WEXITSTATUS(status));
+}
+
+static void
+async_tests_correctness(size_t nconns)
+{
+	struct async_tests_req req;
+	struct async_tests_call call;
+	pthread_t threads[ASYNC_TEST_THREADS];
+	long long values[2];
+	launch_data_t d;
+	int errs[2];
+	size_t i;
+
+	errno = 0;
+	ASYNC_CHECK(launch_msg_async(NULL, async_tests_handler, NULL) == -1 && errno == EINVAL);
+
+	/* Every thread gets its own replies back, whichever connection they
+	 * shared and in whatever order they were interleaved.
+	 */
+	for (i = 0; i < ASYNC_TEST_THREADS; i++) {
+		ASYNC_CHECK(pthread_create(&threads[i], NULL, async_tests_thread, (void *)(uintptr_t)i) == 0);
+	}
+	for (i = 0; i < ASYNC_TEST_THREADS; i++) {
+		ASYNC_CHECK(pthread_join(threads[i], NULL) == 0);
+	}
+
+	errno = 0;
+	ASYNC_CHECK(launch_msg_async_set_connections(4) == -1 && errno == EBUSY);
+
+	if (nconns == LAUNCH_MSG_CONN_PER_THREAD) {
+		return;
+	}
+
+	/* A request that never gets a reply fails once the connection does... */
+	pthread_mutex_init(&call.mtx, NULL);
+	pthread_cond_init(&call.cv, NULL);
+	call.outstanding = 1;
+	call.values = values;
+	call.errs = errs;
+	req.call = &call;
+	req.i = 0;
+	values[0] = -1;
+	d = async_tests_string(ASYNC_DROP);
+	ASYNC_CHECK(launch_msg_async(d, async_tests_handler, &req) == 0);
+	launch_data_free(d);
+	pthread_mutex_lock(&call.mtx);
+	while (call.outstanding > 0) {
+		pthread_cond_wait(&call.cv, &call.mtx);
+	}
+	pthread_mutex_unlock(&call.mtx);
+	ASYNC_CHECK(errs[0] != 0);
+	ASYNC_CHECK(values[0] == -1);
+
+	/* ...and the next one on it connects again. */
+	for (i = 0; i < nconns; i++) {
+		async_tests_calls(1000, 2, values, errs);
+		ASYNC_CHECK(errs[0] == 0 && values[0] == 1000);
+		ASYNC_CHECK(errs[1] == 0 && values[1] == 1001);
+	}
+}
+
+void test_launch_msg_deque(void **s) {
+	struct launch_msg_deque q = { NULL, 0, 0, 0 };
+	launch_data_t d;
+	long long next = 0, popped = 0;
+	int round;
+
+	assert_true(launch_msg_deque_pop(&q) == NULL);
+
+	/* Keep it half full so the ring wraps before every time it grows. */
+	for (round = 0; round < 6; round++) {
+		while (next < popped * 2 + 5) {
+			assert_int_equal(0, launch_msg_deque_push(&q, async_tests_integer(next++)));
+		}
+		while (popped < next / 2 + 1) {
+			assert_true((d = launch_msg_deque_pop(&q)) != NULL);
+			assert_int_equal(popped++, launch_data_get_integer(d));
+			launch_data_free(d);
+		}
+	}
+	while ((d = launch_msg_deque_pop(&q)) != NULL) {
+		assert_int_equal(popped++, launch_data_get_integer(d));
+		launch_data_free(d);
+	}
+	assert_int_equal(next, popped);
+	assert_int_equal(0, q.lmd_cnt);
+	free(q.lmd_items);
+}
+
+void test_launch_msg_async(void **s) {
+	async_tests_in_child(async_tests_correctness, 2);
+	async_tests_in_child(async_tests_correctness, LAUNCH_MSG_CONN_PER_THREAD);
+}
+
+/* What launch_msg() does: one connection, held by one caller at a time from
+ * its request until its reply.
+ */
+struct async_bench_conn {
+	pthread_mutex_t mtx;
+	launch_t conn;
+};
+
+static void
+async_bench_getmsgs(launch_data_t m, void *context)
+{
+	launch_data_t *resp = context;
+
+	*resp = launch_data_copy(m);
+}
+
+struct async_bench_wait {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	launch_data_t resp;
+	int err;
+	bool done;
+};
+
+static void
+async_bench_handler(launch_data_t resp, int err, void *context)
+{
+	struct async_bench_wait *w = context;
+
+	pthread_mutex_lock(&w->mtx);
+	w->resp = resp;
+	w->err = err;
+	w->done = true;
+	pthread_cond_signal(&w->cv);
+	pthread_mutex_unlock(&w->mtx);
+}
+
+struct async_bench_thread {
+	struct async_bench_conn *shared;
+	size_t reqs;
+};
+
+static void *
+async_bench_thread(void *arg)
+{
+	struct async_bench_thread *t = arg;
+	struct async_bench_wait w;
+	launch_data_t msg, resp;
+	struct pollfd pfd;
+	size_t i;
+
+	pthread_mutex_init(&w.mtx, NULL);
+	pthread_cond_init(&w.cv, NULL);
+	msg = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	launch_data_dict_insert(msg, async_tests_string("com.example.monitored"), LAUNCH_KEY_GETJOB);
+
+	for (i = 0; i < t->reqs; i++) {
+		resp = NULL;
+		if (t->shared != NULL) {
+			pthread_mutex_lock(&t->shared->mtx);
+			pfd.fd = launchd_getfd(t->shared->conn);
+			pfd.events = POLLIN;
+			ASYNC_CHECK(launchd_msg_send(t->shared->conn, msg) == 0);
+			while (resp == NULL) {
+				if (launchd_msg_recv(t->shared->conn, async_bench_getmsgs, &resp) == -1) {
+					ASYNC_CHECK(errno == EAGAIN);
+					poll(&pfd, 1, -1);
+				}
+			}
+			pthread_mutex_unlock(&t->shared->mtx);
+		} else {
+			w.done = false;
+			ASYNC_CHECK(launch_msg_async(msg, async_bench_handler, &w) == 0);
+			pthread_mutex_lock(&w.mtx);
+			while (!w.done) {
+				pthread_cond_wait(&w.cv, &w.mtx);
+			}
+			pthread_mutex_unlock(&w.mtx);
+			ASYNC_CHECK(w.err == 0);
+			resp = w.resp;
+		}
+		ASYNC_CHECK(launch_data_get_type(resp) == LAUNCH_DATA_DICTIONARY);
+		launch_data_free(resp);
+	}
+
+	launch_data_free(msg);
+	return NULL;
+}
+
+/* Requests per second over all threads, each making blocking calls. */
+static void
+async_bench_run(size_t nconns)
+{
+	struct async_bench_thread args[ASYNC_MAX_THREADS];
+	pthread_t threads[ASYNC_MAX_THREADS];
+	struct async_bench_conn shared, *sharedp = NULL;
+	struct timespec start, end;
+	struct sockaddr_un sun;
+	size_t nthreads, i;
+	char name[48];
+	int fd;
+
+	if (nconns == (size_t)-1) {
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strncpy(sun.sun_path, getenv(LAUNCHD_SOCKET_ENV), sizeof(sun.sun_path) - 1);
+		ASYNC_CHECK((fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1);
+		ASYNC_CHECK(connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == 0);
+		pthread_mutex_init(&shared.mtx, NULL);
+		shared.conn = launchd_fdopen(fd, -1);
+		sharedp = &shared;
+		snprintf(name, sizeof(name), "launch_msg");
+	} else if (nconns == LAUNCH_MSG_CONN_PER_THREAD) {
+		snprintf(name, sizeof(name), "async, per thread");
+	} else {
+		snprintf(name, sizeof(name), "async, %zu conn%s", nconns, nconns == 1 ? "" : "s");
+	}
+
+	printf("%-18s", name);
+	for (nthreads = 1; nthreads <= ASYNC_MAX_THREADS; nthreads *= 2) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < nthreads; i++) {
+			args[i].shared = sharedp;
+			args[i].reqs = ASYNC_BENCH_REQS / nthreads;
+			ASYNC_CHECK(pthread_create(&threads[i], NULL, async_bench_thread, &args[i]) == 0);
+		}
+		for (i = 0; i < nthreads; i++) {
+			ASYNC_CHECK(pthread_join(threads[i], NULL) == 0);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		printf(" %8.0f", ASYNC_BENCH_REQS / ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9));
+	}
+	printf("\n");
+
+	if (sharedp != NULL) {
+		launchd_close(shared.conn, close);
+	}
+}
+
+/* Shares the launch_msg_async_set_connections() call in the child with the
+ * other configurations; the launch_msg() stand-in ignores it.
+ */
+static void
+async_bench_launch_msg(size_t nconns)
+{
+	async_bench_run((size_t)-1);
+}
+
+void bench_launch_msg_async(void **s) {
+	size_t nthreads;
+
+	printf("%-18s", "requests/s");
+	for (nthreads = 1; nthreads <= ASYNC_MAX_THREADS; nthreads *= 2) {
+		printf(" %8zu", nthreads);
+	}
+	printf("\n");
+	fflush(stdout);
+
+	async_tests_in_child(async_bench_launch_msg, 1);
+	async_tests_in_child(async_bench_run, 1);
+	async_tests_in_child(async_bench_run, 4);
+	async_tests_in_child(async_bench_run, LAUNCH_MSG_CONN_PER_THREAD);
+}
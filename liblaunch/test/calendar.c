@@ -0,0 +1 @@
+../../launchd/calendar.c
\ No newline at end of file
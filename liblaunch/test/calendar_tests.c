@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "liblaunch_test.h"
+#include "calendar.h"
+
+/* 2014-01-01 00:00:00 UTC, a Wednesday. */
+#define JAN_1_2014 1388534400
+
+static void
+set_tz(const char *tz)
+{
+	setenv("TZ", tz, 1);
+	tzset();
+}
+
+static time_t
+utc(int y, int mon, int mday, int hour, int min)
+{
+	struct tm tm;
+
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = y - 1900;
+	tm.tm_mon = mon - 1;
+	tm.tm_mday = mday;
+	tm.tm_hour = hour;
+	tm.tm_min = min;
+	return timegm(&tm);
+}
+
+/* Minute-by-minute reference, for checking calendar_next() on dense specs. */
+static bool
+spec_matches(const struct calendar_spec *cs, time_t t)
+{
+	struct tm tm;
+	bool md, wd;
+
+	gmtime_r(&t, &tm);
+	md = cs->cs_mday & (1U << tm.tm_mday);
+	wd = cs->cs_wday & (1U << tm.tm_wday);
+	if ((cs->cs_restricted & (1 << CALENDAR_MDAY)) && (cs->cs_restricted & (1 << CALENDAR_WDAY))) {
+		if (!md && !wd) {
+			return false;
+		}
+	} else if (!md || !wd) {
+		return false;
+	}
+	return (cs->cs_min & (1ULL << tm.tm_min)) && (cs->cs_hour & (1U << tm.tm_hour))
+		&& (cs->cs_mon & (1U << tm.tm_mon));
+}
+
+void test_calendar_spec_parse(void **s) {
+	struct calendar_spec cs;
+
+	calendar_spec_init(&cs);
+	assert_int_equal(0, calendar_spec_parse(&cs, CALENDAR_MINUTE, "*/15"));
+	assert_true(cs.cs_min == ((1ULL << 0) | (1ULL << 15) | (1ULL << 30) | (1ULL << 45)));
+
+	assert_int_equal(0, calendar_spec_parse(&cs, CALENDAR_HOUR, "1-3,10,20-23/2"));
+	assert_true(cs.cs_hour == ((1U << 1) | (1U << 2) | (1U << 3) | (1U << 10) | (1U << 20) | (1U << 22)));
+
+	assert_int_equal(0, calendar_spec_parse(&cs, CALENDAR_WDAY, "7"));
+	assert_int_equal(1, cs.cs_wday);
+
+	assert_int_equal(0, calendar_spec_parse(&cs, CALENDAR_MONTH, "2"));
+	assert_int_equal(1 << 1, cs.cs_mon);
+
+	/* A bare wildcard leaves the field unrestricted. */
+	assert_int_equal(0, calendar_spec_parse(&cs, CALENDAR_MDAY, "*"));
+	assert_false(cs.cs_restricted & (1 << CALENDAR_MDAY));
+
+	assert_int_equal(-1, calendar_spec_parse(&cs, CALENDAR_MINUTE, "60"));
+	assert_int_equal(EINVAL, errno);
+	assert_int_equal(-1, calendar_spec_parse(&cs, CALENDAR_MDAY, "0"));
+	assert_int_equal(-1, calendar_spec_parse(&cs, CALENDAR_HOUR, "1-"));
+	assert_int_equal(-1, calendar_spec_parse(&cs, CALENDAR_HOUR, "x"));
+	assert_int_equal(-1, calendar_spec_parse(&cs, CALENDAR_HOUR, "1,,2"));
+}
+
+void test_calendar_next_basic(void **s) {
+	struct calendar_spec cs;
+	time_t t;
+
+	set_tz("UTC");
+
+	calendar_spec_init(&cs);
+	assert_true(calendar_next(&cs, JAN_1_2014) == JAN_1_2014 + 60);
+	/* Seconds past the minute still round up to the next minute. */
+	assert_true(calendar_next(&cs, JAN_1_2014 + 59) == JAN_1_2014 + 60);
+
+	calendar_spec_add(&cs, CALENDAR_HOUR, 2, 2, 1);
+	calendar_spec_add(&cs, CALENDAR_MINUTE, 30, 30, 1);
+	t = calendar_next(&cs, JAN_1_2014);
+	assert_true(t == utc(2014, 1, 1, 2, 30));
+	/* Strictly after: the same minute is not returned again. */
+	assert_true(calendar_next(&cs, t) == utc(2014, 1, 2, 2, 30));
+
+	/* Fridays at 09:00 (January 3rd). */
+	calendar_spec_init(&cs);
+	calendar_spec_add(&cs, CALENDAR_WDAY, 5, 5, 1);
+	calendar_spec_add(&cs, CALENDAR_HOUR, 9, 9, 1);
+	calendar_spec_add(&cs, CALENDAR_MINUTE, 0, 0, 1);
+	assert_true(calendar_next(&cs, JAN_1_2014) == utc(2014, 1, 3, 9, 0));
+
+	/* The 2nd or a Friday, whichever comes first. */
+	calendar_spec_add(&cs, CALENDAR_MDAY, 2, 2, 1);
+	assert_true(calendar_next(&cs, JAN_1_2014) == utc(2014, 1, 2, 9, 0));
+	assert_true(calendar_next(&cs, utc(2014, 1, 2, 9, 0)) == utc(2014, 1, 3, 9, 0));
+
+	/* Last minute of the year rolls into the next. */
+	calendar_spec_init(&cs);
+	calendar_spec_add(&cs, CALENDAR_MONTH, 1, 1, 1);
+	calendar_spec_add(&cs, CALENDAR_MDAY, 1, 1, 1);
+	calendar_spec_add(&cs, CALENDAR_HOUR, 0, 0, 1);
+	calendar_spec_add(&cs, CALENDAR_MINUTE, 0, 0, 1);
+	assert_true(calendar_next(&cs, utc(2014, 12, 31, 23, 59)) == utc(2015, 1, 1, 0, 0));
+}
+
+void test_calendar_next_leap_day(void **s) {
+	struct calendar_spec cs;
+
+	set_tz("UTC");
+
+	calendar_spec_init(&cs);
+	calendar_spec_add(&cs, CALENDAR_MONTH, 2, 2, 1);
+	calendar_spec_add(&cs, CALENDAR_MDAY, 29, 29, 1);
+	calendar_spec_add(&cs, CALENDAR_HOUR, 12, 12, 1);
+	calendar_spec_add(&cs, CALENDAR_MINUTE, 0, 0, 1);
+	assert_true(calendar_next(&cs, JAN_1_2014) == utc(2016, 2, 29, 12, 0));
+	/* 2100 is not a leap year. */
+	assert_true(calendar_next(&cs, utc(2096, 3, 1, 0, 0)) == utc(2104, 2, 29, 12, 0));
+
+	/* April 31st never happens. */
+	calendar_spec_init(&cs);
+	calendar_spec_add(&cs, CALENDAR_MONTH, 4, 4, 1);
+	calendar_spec_add(&cs, CALENDAR_MDAY, 31, 31, 1);
+	errno = 0;
+	assert_true(calendar_next(&cs, JAN_1_2014) == -1);
+	assert_int_equal(EINVAL, errno);
+}
+
+void test_calendar_next_dst(void **s) {
+	struct calendar_spec cs;
+	time_t t;
+
+	set_tz("America/New_York");
+
+	/* 02:30 does not exist on 2014-03-09; it fires at 03:00 EDT instead. */
+	calendar_spec_init(&cs);
+	calendar_spec_add(&cs, CALENDAR_HOUR, 2, 2, 1);
+	calendar_spec_add(&cs, CALENDAR_MINUTE, 30, 30, 1);
+	t = calendar_next(&cs, utc(2014, 3, 9, 5, 0));
+	assert_true(t == utc(2014, 3, 9, 7, 0));
+	assert_true(calendar_next(&cs, t) == utc(2014, 3, 10, 6, 30));
+
+	/* 01:30 happens twice on 2014-11-02 and a job pinned to it fires once. */
+	calendar_spec_init(&cs);
+	calendar_spec_add(&cs, CALENDAR_HOUR, 1, 1, 1);
+	calendar_spec_add(&cs, CALENDAR_MINUTE, 30, 30, 1);
+	t = calendar_next(&cs, utc(2014, 11, 2, 4, 0));
+	assert_true(t == utc(2014, 11, 2, 5, 30));
+	assert_true(calendar_next(&cs, t) == utc(2014, 11, 3, 6, 30));
+
+	/* An hourly job runs in both passes through the repeated hour. */
+	calendar_spec_init(&cs);
+	calendar_spec_add(&cs, CALENDAR_MINUTE, 30, 30, 1);
+	t = calendar_next(&cs, utc(2014, 11, 2, 5, 0));
+	assert_true(t == utc(2014, 11, 2, 5, 30));
+	assert_true(calendar_next(&cs, t) == utc(2014, 11, 2, 6, 30));
+
+	set_tz("UTC");
+}
+
+void test_calendar_next_matches_reference(void **s) {
+	struct calendar_spec cs;
+	time_t after, expected, t;
+	int i;
+
+	set_tz("UTC");
+	srandom(4242);
+
+	for (i = 0; i < 200; i++) {
+		calendar_spec_init(&cs);
+		calendar_spec_add(&cs, CALENDAR_MINUTE, random() % 60, 59, 1 + random() % 30);
+		if (random() % 2) {
+			calendar_spec_add(&cs, CALENDAR_HOUR, random() % 24, 23, 1 + random() % 12);
+		}
+		if (random() % 3 == 0) {
+			calendar_spec_add(&cs, CALENDAR_MDAY, 1 + random() % 28, 28, 1 + random() % 7);
+		}
+		if (random() % 3 == 0) {
+			calendar_spec_add(&cs, CALENDAR_WDAY, random() % 7, 6, 1 + random() % 3);
+		}
+
+		after = JAN_1_2014 + random() % (365 * 86400);
+		for (expected = after - after % 60 + 60; !spec_matches(&cs, expected); expected += 60);
+
+		t = calendar_next(&cs, after);
+		assert_true(t == expected);
+	}
+}
+
+/* The mktime() stepping calendarinterval_setalarm() used before, kept here
+ * as a baseline.
+ */
+static bool legacy_hour(struct tm *wtm, int hour, int min);
+
+static bool
+legacy_min(struct tm *wtm, int min)
+{
+	if (min == -1) {
+		return true;
+	}
+	if (min < wtm->tm_min) {
+		return false;
+	}
+	if (min > wtm->tm_min) {
+		wtm->tm_min = min;
+	}
+	return true;
+}
+
+static bool
+legacy_hour(struct tm *wtm, int hour, int min)
+{
+	if (hour == -1) {
+		struct tm workingtm = *wtm;
+		int carrytest;
+
+		while (!legacy_min(&workingtm, min)) {
+			workingtm.tm_hour++;
+			workingtm.tm_min = 0;
+			carrytest = workingtm.tm_hour;
+			mktime(&workingtm);
+			if (carrytest != workingtm.tm_hour) {
+				return false;
+			}
+		}
+		*wtm = workingtm;
+		return true;
+	}
+	if (hour < wtm->tm_hour) {
+		return false;
+	}
+	if (hour > wtm->tm_hour) {
+		wtm->tm_hour = hour;
+		wtm->tm_min = 0;
+	}
+	return legacy_min(wtm, min);
+}
+
+static bool
+legacy_mday(struct tm *wtm, int mday, int hour, int min)
+{
+	if (mday == -1) {
+		struct tm workingtm = *wtm;
+		int carrytest;
+
+		while (!legacy_hour(&workingtm, hour, min)) {
+			workingtm.tm_mday++;
+			workingtm.tm_hour = 0;
+			workingtm.tm_min = 0;
+			carrytest = workingtm.tm_mday;
+			mktime(&workingtm);
+			if (carrytest != workingtm.tm_mday) {
+				return false;
+			}
+		}
+		*wtm = workingtm;
+		return true;
+	}
+	if (mday < wtm->tm_mday) {
+		return false;
+	}
+	if (mday > wtm->tm_mday) {
+		wtm->tm_mday = mday;
+		wtm->tm_hour = 0;
+		wtm->tm_min = 0;
+	}
+	return legacy_hour(wtm, hour, min);
+}
+
+static bool
+legacy_mon(struct tm *wtm, int mon, int mday, int hour, int min)
+{
+	if (mon == -1) {
+		struct tm workingtm = *wtm;
+		int carrytest;
+
+		while (!legacy_mday(&workingtm, mday, hour, min)) {
+			workingtm.tm_mon++;
+			workingtm.tm_mday = 1;
+			workingtm.tm_hour = 0;
+			workingtm.tm_min = 0;
+			carrytest = workingtm.tm_mon;
+			mktime(&workingtm);
+			if (carrytest != workingtm.tm_mon) {
+				return false;
+			}
+		}
+		*wtm = workingtm;
+		return true;
+	}
+	if (mon < wtm->tm_mon) {
+		return false;
+	}
+	if (mon > wtm->tm_mon) {
+		wtm->tm_mon = mon;
+		wtm->tm_mday = 1;
+		wtm->tm_hour = 0;
+		wtm->tm_min = 0;
+	}
+	return legacy_mday(wtm, mday, hour, min);
+}
+
+static time_t
+legacy_cronemu(time_t now, int mon, int mday, int hour, int min)
+{
+	struct tm workingtm;
+
+	localtime_r(&now, &workingtm);
+	workingtm.tm_isdst = -1;
+	workingtm.tm_sec = 0;
+	workingtm.tm_min++;
+
+	while (!legacy_mon(&workingtm, mon, mday, hour, min)) {
+		workingtm.tm_year++;
+		workingtm.tm_mon = 0;
+		workingtm.tm_mday = 1;
+		workingtm.tm_hour = 0;
+		workingtm.tm_min = 0;
+		mktime(&workingtm);
+	}
+
+	return mktime(&workingtm);
+}
+
+#define BENCH_CALENDAR_CNT 100000
+
+static double
+elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+/* Random intervals in launchd's plist form; -1 is a wildcard. With 'sparse',
+ * the month and day are pinned to ones that only come around rarely.
+ */
+static void
+bench_interval(bool sparse, int *mon, int *mday, int *hour, int *min)
+{
+	static const int rare[][2] = { { 1, 29 }, { 0, 31 }, { 11, 31 }, { 4, 31 } };
+
+	if (sparse) {
+		int k = (int)(random() % 4);
+		*mon = rare[k][0];
+		*mday = rare[k][1];
+	} else {
+		*mon = random() % 4 ? -1 : (int)(random() % 12);
+		*mday = random() % 2 ? -1 : (int)(1 + random() % 28);
+	}
+	*hour = random() % 2 ? -1 : (int)(random() % 24);
+	*min = (int)(random() % 60);
+}
+
+static void
+bench_calendar(bool sparse)
+{
+	struct calendar_spec cs;
+	struct timespec start;
+	double legacy, closed;
+	int i, mon, mday, hour, min, legacy_cnt = BENCH_CALENDAR_CNT / 100;
+
+	srandom(1);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < legacy_cnt; i++) {
+		bench_interval(sparse, &mon, &mday, &hour, &min);
+		(void)legacy_cronemu(JAN_1_2014 + i * 600, mon, mday, hour, min);
+	}
+	legacy = elapsed_ns(&start) / legacy_cnt;
+
+	srandom(1);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BENCH_CALENDAR_CNT; i++) {
+		bench_interval(sparse, &mon, &mday, &hour, &min);
+
+		calendar_spec_init(&cs);
+		if (mon != -1) {
+			calendar_spec_add(&cs, CALENDAR_MONTH, mon + 1, mon + 1, 1);
+		}
+		if (mday != -1) {
+			calendar_spec_add(&cs, CALENDAR_MDAY, mday, mday, 1);
+		}
+		if (hour != -1) {
+			calendar_spec_add(&cs, CALENDAR_HOUR, hour, hour, 1);
+		}
+		calendar_spec_add(&cs, CALENDAR_MINUTE, min, min, 1);
+		assert_true(calendar_next(&cs, JAN_1_2014 + i * 600) != -1);
+	}
+	closed = elapsed_ns(&start) / BENCH_CALENDAR_CNT;
+
+	printf("calendar %d %s intervals: mktime stepping %10.1f ns/op, bitmask %8.1f ns/op\n",
+		BENCH_CALENDAR_CNT, sparse ? "sparse" : "random", legacy, closed);
+}
+
+void bench_calendar_next(void **s) {
+	set_tz("America/New_York");
+	bench_calendar(false);
+	bench_calendar(true);
+	set_tz("UTC");
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "liblaunch_test.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
+
+static launch_data_t
+new_integer(long long n)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_INTEGER);
+	launch_data_set_integer(d, n);
+	return d;
+}
+
+static launch_data_t
+build_dict(size_t cnt)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	char key[32];
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		snprintf(key, sizeof(key), "Key%zu", i);
+		launch_data_dict_insert(d, new_integer(i), key);
+	}
+	return d;
+}
+
+/*
+ * TEST: launch_data_dict_{insert,lookup,remove}
+ *****************************************************/
+void test_launch_data_dict_lookup_small(void **s) {
+	launch_data_t d = build_dict(4);
+	assert_int_equal(4, launch_data_dict_get_count(d));
+	assert_int_equal(2, launch_data_get_integer(launch_data_dict_lookup(d, "KEY2")));
+	assert_true(NULL == launch_data_dict_lookup(d, "Key4"));
+	launch_data_free(d);
+};
+
+void test_launch_data_dict_lookup_indexed(void **s) {
+	launch_data_t d = build_dict(1000);
+	char key[32];
+	size_t i;
+
+	assert_int_equal(LAUNCH_DATA_DICTIONARY, launch_data_get_type(d));
+	assert_int_equal(1000, launch_data_dict_get_count(d));
+	for (i = 0; i < 1000; i++) {
+		snprintf(key, sizeof(key), "kEY%zu", i);
+		assert_int_equal(i, launch_data_get_integer(launch_data_dict_lookup(d, key)));
+	}
+	assert_true(NULL == launch_data_dict_lookup(d, "Key1000"));
+	launch_data_free(d);
+};
+
+void test_launch_data_dict_insert_replaces(void **s) {
+	launch_data_t d = build_dict(100);
+	launch_data_dict_insert(d, new_integer(-1), "KEY99");
+	launch_data_dict_insert(d, new_integer(-2), "key0");
+	assert_int_equal(100, launch_data_dict_get_count(d));
+	assert_int_equal(-1, launch_data_get_integer(launch_data_dict_lookup(d, "Key99")));
+	assert_int_equal(-2, launch_data_get_integer(launch_data_dict_lookup(d, "Key0")));
+	launch_data_free(d);
+};
+
+static void
+check_order(launch_data_t v, const char *key, void *ctx) {
+	long long *expected = ctx;
+	assert_int_equal(*expected, launch_data_get_integer(v));
+	*expected += 2;
+}
+
+void test_launch_data_dict_remove_keeps_order(void **s) {
+	launch_data_t d = build_dict(100);
+	long long expected = 0;
+	char key[32];
+	size_t i;
+
+	for (i = 1; i < 100; i += 2) {
+		snprintf(key, sizeof(key), "key%zu", i);
+		assert_true(launch_data_dict_remove(d, key));
+	}
+	assert_false(launch_data_dict_remove(d, "key1"));
+	assert_int_equal(50, launch_data_dict_get_count(d));
+	assert_int_equal(98, launch_data_get_integer(launch_data_dict_lookup(d, "key98")));
+
+	launch_data_dict_iterate(d, check_order, &expected);
+	assert_int_equal(100, expected);
+	launch_data_free(d);
+};
+
+void test_launch_data_dict_pack_indexed(void **s) {
+	launch_data_t d = build_dict(100), u;
+	size_t len, data_offset = 0, fd_offset = 0;
+	void *buf = malloc(64 * 1024);
+
+	len = launch_data_pack(d, buf, 64 * 1024, NULL, NULL);
+	assert_true(len > 0);
+	/* The in-memory index flag must never reach the wire. */
+	assert_int_equal(LAUNCH_DATA_DICTIONARY, wire2host(((launch_data_t)buf)->type));
+
+	u = launch_data_unpack(buf, len, NULL, 0, &data_offset, &fd_offset);
+	assert_false(NULL == u);
+	assert_int_equal(len, data_offset);
+	assert_int_equal(100, launch_data_dict_get_count(u));
+	assert_int_equal(42, launch_data_get_integer(launch_data_dict_lookup(u, "KEY42")));
+
+	free(buf);
+	launch_data_free(d);
+};
+
+void test_launch_data_unpack_in_place(void **s) {
+	launch_data_t d = build_dict(4), u, v, c;
+	size_t len, data_offset = 0, fd_offset = 0;
+	void *buf = malloc(4096), *buf2 = malloc(4096);
+
+	v = launch_data_alloc(LAUNCH_DATA_STRING);
+	launch_data_set_string(v, "value");
+	launch_data_dict_insert(d, v, "String");
+	len = launch_data_pack(d, buf, 4096, NULL, NULL);
+	u = launch_data_unpack(buf, len, NULL, 0, &data_offset, &fd_offset);
+	assert_false(NULL == u);
+
+	/* Nodes living in the receive buffer still report their plain type. */
+	v = launch_data_dict_lookup(u, "string");
+	assert_int_equal(LAUNCH_DATA_STRING, launch_data_get_type(v));
+	assert_string_equal("value", launch_data_get_string(v));
+
+	/* launch_data_free() leaves the buffer alone. */
+	launch_data_free(u);
+	assert_int_equal(3, launch_data_get_integer(launch_data_dict_lookup(u, "key3")));
+
+	/* The tree can be modified where it is, as launch_msg() replies are. */
+	len = launch_data_pack(d, buf2, 4096, NULL, NULL);
+	data_offset = fd_offset = 0;
+	c = launch_data_unpack(buf2, len, NULL, 0, &data_offset, &fd_offset);
+	assert_false(NULL == c);
+	v = launch_data_dict_lookup(c, "string");
+	launch_data_set_string(v, "changed");
+	launch_data_dict_insert(c, launch_data_alloc(LAUNCH_DATA_ARRAY), "array");
+	launch_data_array_set_index(launch_data_dict_lookup(c, "array"), new_integer(7), 0);
+	launch_data_dict_remove(c, "key0");
+	assert_string_equal("changed", launch_data_get_string(v));
+	assert_int_equal(LAUNCH_DATA_ARRAY, launch_data_get_type(launch_data_dict_lookup(c, "array")));
+	assert_true(NULL == launch_data_dict_lookup(c, "key0"));
+	assert_int_equal(3, launch_data_get_integer(launch_data_dict_lookup(c, "key3")));
+	assert_int_equal(5, launch_data_dict_get_count(c));
+	launch_data_free(c);
+
+	free(buf);
+	free(buf2);
+	launch_data_free(d);
+};
+/*****************************************************/
+
+/*
+ * BENCHMARK: linear scan vs. indexed dictionary
+ *****************************************************/
+static double
+elapsed_ns(struct timespec *start)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/* The pre-index behaviour: a strcasecmp() walk of the interleaved array. */
+static launch_data_t
+linear_lookup(launch_data_t dict, const char *key)
+{
+	size_t i;
+
+	for (i = 0; i < dict->_array_cnt; i += 2) {
+		if (!strcasecmp(key, dict->_array[i]->string))
+			return dict->_array[i + 1];
+	}
+	return NULL;
+}
+
+static void
+linear_insert(launch_data_t dict, launch_data_t what, const char *key)
+{
+	size_t i;
+
+	for (i = 0; i < dict->_array_cnt; i += 2) {
+		if (!strcasecmp(key, dict->_array[i]->string))
+			break;
+	}
+	launch_data_t thekey = launch_data_alloc(LAUNCH_DATA_STRING);
+	launch_data_set_string(thekey, key);
+	launch_data_array_set_index(dict, thekey, i);
+	launch_data_array_set_index(dict, what, i + 1);
+}
+
+static void
+bench_dict(size_t cnt)
+{
+	launch_data_t linear = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	launch_data_t indexed = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	double lin_ins, idx_ins, lin_look, idx_look;
+	struct timespec start;
+	char key[32];
+	size_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		snprintf(key, sizeof(key), "Key%zu", i);
+		linear_insert(linear, new_integer(i), key);
+	}
+	lin_ins = elapsed_ns(&start) / cnt;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		snprintf(key, sizeof(key), "Key%zu", i);
+		launch_data_dict_insert(indexed, new_integer(i), key);
+	}
+	idx_ins = elapsed_ns(&start) / cnt;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		snprintf(key, sizeof(key), "KEY%zu", i);
+		assert_false(NULL == linear_lookup(linear, key));
+	}
+	lin_look = elapsed_ns(&start) / cnt;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		snprintf(key, sizeof(key), "KEY%zu", i);
+		assert_false(NULL == launch_data_dict_lookup(indexed, key));
+	}
+	idx_look = elapsed_ns(&start) / cnt;
+
+	printf("dict %6zu keys: insert %10.1f -> %8.1f ns/op, lookup %10.1f -> %8.1f ns/op\n",
+		cnt, lin_ins, idx_ins, lin_look, idx_look);
+
+	launch_data_free(linear);
+	launch_data_free(indexed);
+}
+
+void bench_launch_data_dict(void **s) {
+	bench_dict(10);
+	bench_dict(100);
+	bench_dict(10000);
+};
+/*****************************************************/
@@ -0,0 +1 @@
+../../launchd/evloop_epoll.c
\ No newline at end of file
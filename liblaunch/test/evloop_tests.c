@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liblaunch_test.h"
+#include "evloop.h"
+
+#define EVLOOP_TEST_PAIRS 4
+#define EVLOOP_TEST_SLOTS 4
+
+static const int evloop_test_signals[] = { SIGUSR1, SIGUSR2, SIGWINCH, SIGURG };
+#define EVLOOP_TEST_NSIGS (sizeof(evloop_test_signals) / sizeof(evloop_test_signals[0]))
+
+/* The epoll emulation allows only one kqueue per process. */
+static int
+evloop_test_kq(void)
+{
+	static int kq = -1;
+
+	if (kq == -1) {
+		kq = kqueue();
+	}
+	assert_true(kq != -1);
+	return kq;
+}
+
+static void
+evloop_test_change(int kq, uintptr_t ident, short filter, unsigned short flags)
+{
+	struct kevent kev;
+
+	EV_SET(&kev, ident, filter, flags, 0, 0, NULL);
+	assert_int_equal(0, kevent(kq, &kev, 1, NULL, 0, NULL));
+}
+
+/* Signals that arrive together with descriptor events must not take the
+ * slots kept for the descriptors, or kevent() returns more events than the
+ * caller has room for.
+ */
+void
+test_evloop_signals_and_fds(void **state __attribute__((unused)))
+{
+	struct kevent kev[EVLOOP_TEST_SLOTS + 8];
+	struct timespec zero = { 0, 0 };
+	int sv[EVLOOP_TEST_PAIRS][2];
+	unsigned int sigs = 0, reads = 0, writes = 0;
+	void (*saved_handlers[EVLOOP_TEST_NSIGS])(int);
+	sigset_t saved;
+	size_t i;
+	char c;
+	int kq = evloop_test_kq(), n, rounds;
+
+	assert_int_equal(0, sigprocmask(SIG_SETMASK, NULL, &saved));
+
+	/* Pending signals first, so that they come out of the wait ahead of
+	 * the descriptors.
+	 */
+	for (i = 0; i < EVLOOP_TEST_NSIGS; i++) {
+		/* kqueue counts a signal whatever its disposition. */
+		saved_handlers[i] = signal(evloop_test_signals[i], SIG_IGN);
+		evloop_test_change(kq, evloop_test_signals[i], EVFILT_SIGNAL, EV_ADD);
+		assert_int_equal(0, raise(evloop_test_signals[i]));
+	}
+	for (i = 0; i < EVLOOP_TEST_PAIRS; i++) {
+		assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv[i]));
+		assert_int_equal(1, write(sv[i][1], "x", 1));
+		evloop_test_change(kq, sv[i][0], EVFILT_READ, EV_ADD);
+		evloop_test_change(kq, sv[i][0], EVFILT_WRITE, EV_ADD | EV_ONESHOT);
+	}
+
+	for (rounds = 0; rounds < 16 && (sigs < EVLOOP_TEST_NSIGS || reads < EVLOOP_TEST_PAIRS || writes < EVLOOP_TEST_PAIRS); rounds++) {
+		memset(kev, 0xa5, sizeof(kev));
+		n = kevent(kq, NULL, 0, kev, EVLOOP_TEST_SLOTS, &zero);
+		assert_true(n >= 0 && n <= EVLOOP_TEST_SLOTS);
+		for (i = EVLOOP_TEST_SLOTS; i < sizeof(kev) / sizeof(kev[0]); i++) {
+			assert_int_equal(0xa5a5, (unsigned short)kev[i].flags);
+		}
+
+		for (i = 0; i < (size_t)n; i++) {
+			switch (kev[i].filter) {
+			case EVFILT_SIGNAL:
+				sigs++;
+				break;
+			case EVFILT_READ:
+				/* Consume it, so that it is reported only once. */
+				assert_int_equal(1, read((int)kev[i].ident, &c, 1));
+				reads++;
+				evloop_test_change(kq, kev[i].ident, EVFILT_READ, EV_DELETE);
+				break;
+			default:
+				assert_int_equal(EVFILT_WRITE, kev[i].filter);
+				writes++;
+				break;
+			}
+		}
+	}
+	assert_int_equal(EVLOOP_TEST_NSIGS, sigs);
+	assert_int_equal(EVLOOP_TEST_PAIRS, reads);
+	assert_int_equal(EVLOOP_TEST_PAIRS, writes);
+
+	for (i = 0; i < EVLOOP_TEST_NSIGS; i++) {
+		evloop_test_change(kq, evloop_test_signals[i], EVFILT_SIGNAL, EV_DELETE);
+		(void)signal(evloop_test_signals[i], saved_handlers[i]);
+	}
+	for (i = 0; i < EVLOOP_TEST_PAIRS; i++) {
+		close(sv[i][0]);
+		close(sv[i][1]);
+	}
+	assert_int_equal(0, sigprocmask(SIG_SETMASK, &saved, NULL));
+}
+
+/* A hangup is reported only to the knotes that are enabled. */
+void
+test_evloop_hangup_disabled(void **state __attribute__((unused)))
+{
+	struct kevent kev[4];
+	struct timespec zero = { 0, 0 };
+	int kq = evloop_test_kq(), sv[2];
+
+	assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	evloop_test_change(kq, sv[0], EVFILT_READ, EV_ADD | EV_DISABLE);
+	evloop_test_change(kq, sv[0], EVFILT_WRITE, EV_ADD | EV_ONESHOT);
+	close(sv[1]);
+
+	assert_int_equal(1, kevent(kq, NULL, 0, kev, 4, &zero));
+	assert_int_equal(EVFILT_WRITE, kev[0].filter);
+	assert_true(kev[0].flags & EV_EOF);
+	assert_int_equal(0, kevent(kq, NULL, 0, kev, 4, &zero));
+
+	evloop_test_change(kq, sv[0], EVFILT_READ, EV_ENABLE);
+	assert_int_equal(1, kevent(kq, NULL, 0, kev, 4, &zero));
+	assert_int_equal(EVFILT_READ, kev[0].filter);
+	assert_true(kev[0].flags & EV_EOF);
+
+	evloop_test_change(kq, sv[0], EVFILT_READ, EV_DELETE);
+	close(sv[0]);
+}
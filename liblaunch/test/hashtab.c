@@ -0,0 +1 @@
+../../launchd/hashtab.c
\ No newline at end of file
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "liblaunch_test.h"
+#include "hashtab.h"
+
+#define HASHTAB_TEST_CNT 5000
+
+struct hashtab_test_item {
+	struct hashtab_node node;
+	int key;
+	bool seen;
+};
+
+static struct hashtab_test_item *
+hashtab_test_find(struct hashtab *ht, int key)
+{
+	struct hashtab_node *hn;
+
+	for (hn = hashtab_lookup(ht, hashtab_hash_int(key)); hn; hn = hashtab_next(hn)) {
+		struct hashtab_test_item *it = hashtab_entry(hn, struct hashtab_test_item, node);
+		if (it->key == key) {
+			return it;
+		}
+	}
+
+	return NULL;
+}
+
+/* Every key stays reachable while the table doubles underneath it, including
+ * in the middle of a migration.
+ */
+void test_hashtab_grow(void **s) {
+	struct hashtab ht;
+	struct hashtab_test_item *items = calloc(HASHTAB_TEST_CNT, sizeof(*items));
+	struct hashtab_stats hs;
+	bool saw_growing = false;
+	int i, j;
+
+	hashtab_init(&ht);
+	assert_true(hashtab_test_find(&ht, 0) == NULL);
+
+	for (i = 0; i < HASHTAB_TEST_CNT; i++) {
+		items[i].key = i;
+		hashtab_insert(&ht, &items[i].node, hashtab_hash_int(i));
+		hashtab_stats(&ht, &hs);
+		saw_growing |= hs.hs_growing;
+		if (hs.hs_growing && (i % 97) == 0) {
+			for (j = 0; j <= i; j++) {
+				assert_true(hashtab_test_find(&ht, j) == &items[j]);
+			}
+		}
+	}
+	assert_true(saw_growing);
+	assert_int_equal(HASHTAB_TEST_CNT, hashtab_count(&ht));
+
+	hashtab_stats(&ht, &hs);
+	assert_int_equal(HASHTAB_TEST_CNT, hs.hs_count);
+	assert_true(hs.hs_buckets >= HASHTAB_TEST_CNT / 2);
+	assert_true((hs.hs_buckets & (hs.hs_buckets - 1)) == 0);
+	assert_true(hs.hs_max_chain <= 8);
+
+	for (i = 0; i < HASHTAB_TEST_CNT; i++) {
+		assert_true(hashtab_test_find(&ht, i) == &items[i]);
+	}
+	assert_true(hashtab_test_find(&ht, HASHTAB_TEST_CNT) == NULL);
+
+	hashtab_destroy(&ht);
+	free(items);
+}
+
+/* Nodes sharing a hash are all returned by lookup; removing one leaves the
+ * others, and removed nodes are unlinked.
+ */
+void test_hashtab_collisions(void **s) {
+	struct hashtab ht;
+	struct hashtab_test_item items[4];
+	struct hashtab_node *hn;
+	int i, n;
+
+	hashtab_init(&ht);
+	memset(items, 0, sizeof(items));
+	for (i = 0; i < 4; i++) {
+		items[i].key = i;
+		/* Same bucket for all four, same hash for the first three. */
+		hashtab_insert(&ht, &items[i].node, i < 3 ? 42 : 42 + 1024);
+	}
+
+	for (n = 0, hn = hashtab_lookup(&ht, 42); hn; hn = hashtab_next(hn)) {
+		assert_true(hashtab_entry(hn, struct hashtab_test_item, node)->key < 3);
+		n++;
+	}
+	assert_int_equal(3, n);
+
+	hashtab_remove(&items[1].node);
+	assert_false(hashtab_node_linked(&items[1].node));
+	assert_true(hashtab_node_linked(&items[0].node));
+	for (n = 0, hn = hashtab_lookup(&ht, 42); hn; hn = hashtab_next(hn)) {
+		assert_true(hn != &items[1].node);
+		n++;
+	}
+	assert_int_equal(2, n);
+	assert_int_equal(3, hashtab_count(&ht));
+
+	hashtab_destroy(&ht);
+}
+
+/* A walk visits every node exactly once, and the safe form tolerates removing
+ * the node being visited.
+ */
+void test_hashtab_foreach(void **s) {
+	struct hashtab ht;
+	struct hashtab_test_item *it, *items = calloc(HASHTAB_TEST_CNT, sizeof(*items));
+	struct hashtab_node *hn, *tmp;
+	int i, n = 0;
+
+	hashtab_init(&ht);
+	HASHTAB_FOREACH(hn, &ht) {
+		n++;
+	}
+	assert_int_equal(0, n);
+
+	/* Stop partway through a growth so the walk has to settle it first. */
+	for (i = 0; i < 1030; i++) {
+		items[i].key = i;
+		hashtab_insert(&ht, &items[i].node, hashtab_hash_int(i));
+	}
+
+	HASHTAB_FOREACH(hn, &ht) {
+		it = hashtab_entry(hn, struct hashtab_test_item, node);
+		assert_false(it->seen);
+		it->seen = true;
+		n++;
+	}
+	assert_int_equal(1030, n);
+
+	HASHTAB_FOREACH_SAFE(hn, &ht, tmp) {
+		it = hashtab_entry(hn, struct hashtab_test_item, node);
+		if (it->key % 2) {
+			hashtab_remove(hn);
+		}
+	}
+	assert_int_equal(515, hashtab_count(&ht));
+	for (i = 0; i < 1030; i++) {
+		assert_true((hashtab_test_find(&ht, i) != NULL) == !(i % 2));
+	}
+
+	hashtab_destroy(&ht);
+	free(items);
+}
+
+/* Labels that differ only in a trailing digit, and sequential PIDs, used to
+ * pile into a handful of djb2 or pid & 31 buckets. They should now cover a
+ * power-of-two table about as evenly as random keys would.
+ */
+void test_hashtab_hash_spread(void **s) {
+	uint32_t mask = 255;
+	unsigned int strs[256], ints[256];
+	char label[64];
+	int i, empty_strs = 0, empty_ints = 0;
+
+	memset(strs, 0, sizeof(strs));
+	memset(ints, 0, sizeof(ints));
+	for (i = 0; i < 1024; i++) {
+		snprintf(label, sizeof(label), "com.apple.example.agent.%d", i);
+		strs[hashtab_hash_string(label) & mask]++;
+		ints[hashtab_hash_int(100 + i) & mask]++;
+	}
+	for (i = 0; i <= (int)mask; i++) {
+		empty_strs += strs[i] == 0;
+		empty_ints += ints[i] == 0;
+		assert_true(strs[i] <= 16);
+		assert_true(ints[i] <= 16);
+	}
+	/* 256 * e^-4 is about 5 empty buckets for a uniform hash. */
+	assert_true(empty_strs <= 16);
+	assert_true(empty_ints <= 16);
+
+	assert_int_equal(hashtab_hash_string("com.apple.launchd"), hashtab_hash_string("com.apple.launchd"));
+	assert_true(hashtab_hash_string("com.apple.launchd") != hashtab_hash_string("com.apple.launche"));
+}
@@ -0,0 +1 @@
+../../launchd/jobgen.c
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "liblaunch_test.h"
+#include "jobgen.h"
+
+#define JOBGEN_TEST_START 1000000
+
+struct jobgen_test_removed {
+	char labels[8][32];
+	uint64_t gens[8];
+	size_t cnt;
+};
+
+static void
+jobgen_test_collect(const char *label, uint64_t gen, void *context)
+{
+	struct jobgen_test_removed *r = context;
+
+	assert_true(r->cnt < 8);
+	snprintf(r->labels[r->cnt], sizeof(r->labels[0]), "%s", label);
+	r->gens[r->cnt++] = gen;
+}
+
+void test_jobgen_since(void **s) {
+	struct jobgen jg;
+	struct jobgen_test_removed r;
+	uint64_t g1, g2, g3;
+
+	jobgen_init(&jg, JOBGEN_TEST_START);
+	assert_int_equal(JOBGEN_TEST_START, jobgen_current(&jg));
+
+	/* 0 and generations this launchd never handed out mean everything. */
+	assert_false(jobgen_covers(&jg, 0));
+	assert_false(jobgen_covers(&jg, JOBGEN_TEST_START - 1));
+	assert_false(jobgen_covers(&jg, JOBGEN_TEST_START + 1));
+	assert_true(jobgen_covers(&jg, JOBGEN_TEST_START));
+
+	g1 = jobgen_bump(&jg);
+	g2 = jobgen_bury(&jg, "com.example.a");
+	g3 = jobgen_bury(&jg, "com.example.b");
+	assert_true(g1 < g2 && g2 < g3);
+	assert_int_equal(g3, jobgen_current(&jg));
+	assert_true(jobgen_covers(&jg, JOBGEN_TEST_START));
+	assert_true(jobgen_covers(&jg, g3));
+
+	memset(&r, 0, sizeof(r));
+	jobgen_removed_since(&jg, JOBGEN_TEST_START, jobgen_test_collect, &r);
+	assert_int_equal(2, r.cnt);
+	assert_string_equal("com.example.b", r.labels[0]);
+	assert_int_equal(g3, r.gens[0]);
+	assert_string_equal("com.example.a", r.labels[1]);
+	assert_int_equal(g2, r.gens[1]);
+
+	memset(&r, 0, sizeof(r));
+	jobgen_removed_since(&jg, g2, jobgen_test_collect, &r);
+	assert_int_equal(1, r.cnt);
+	assert_string_equal("com.example.b", r.labels[0]);
+
+	memset(&r, 0, sizeof(r));
+	jobgen_removed_since(&jg, g3, jobgen_test_collect, &r);
+	assert_int_equal(0, r.cnt);
+
+	jobgen_destroy(&jg);
+}
+
+/* Once a tombstone is overwritten, only generations from its removal on can
+ * still be answered with changes.
+ */
+void test_jobgen_forget(void **s) {
+	struct jobgen jg;
+	struct jobgen_test_removed r;
+	uint64_t first, second, last = 0;
+	char label[32];
+	size_t i;
+
+	jobgen_init(&jg, JOBGEN_TEST_START);
+	first = jobgen_bury(&jg, "com.example.first");
+	second = jobgen_bury(&jg, "com.example.second");
+	for (i = 2; i < JOBGEN_TOMBSTONES; i++) {
+		snprintf(label, sizeof(label), "com.example.%zu", i);
+		last = jobgen_bury(&jg, label);
+	}
+	assert_true(jobgen_covers(&jg, JOBGEN_TEST_START));
+
+	last = jobgen_bury(&jg, "com.example.last");
+	assert_false(jobgen_covers(&jg, JOBGEN_TEST_START));
+	assert_false(jobgen_covers(&jg, first - 1));
+	assert_true(jobgen_covers(&jg, first));
+	assert_true(jobgen_covers(&jg, last));
+
+	memset(&r, 0, sizeof(r));
+	jobgen_removed_since(&jg, last - 1, jobgen_test_collect, &r);
+	assert_int_equal(1, r.cnt);
+	assert_string_equal("com.example.last", r.labels[0]);
+
+	(void)jobgen_bury(&jg, "com.example.after");
+	assert_false(jobgen_covers(&jg, first));
+	assert_true(jobgen_covers(&jg, second));
+
+	jobgen_destroy(&jg);
+}
@@ -0,0 +1 @@
+../../launchd/jobkeys.c
\ No newline at end of file
@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "liblaunch_test.h"
+#include "launch_priv.h"
+#include "jobkeys.h"
+
+#define JOBKEYS_BENCH_KEYS 100
+#define JOBKEYS_BENCH_IMPORTS 20000
+
+struct jobkey_test {
+	jobkey_t (*jt_lookup)(const char *);
+	const char *jt_name;
+	jobkey_t jt_key;
+};
+
+#define JOBKEY_TEST(ns, k) { ns##_lookup, LAUNCH_##k, k }
+
+static const struct jobkey_test jobkey_tests[] = {
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_RESETATCLOSE),
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_HIDEUNTILCHECKIN),
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_DRAINMESSAGESONCRASH),
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_PINGEVENTUPDATES),
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_KUNCSERVER),
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_EXCEPTIONSERVER),
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_TASKSPECIALPORT),
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_HOSTSPECIALPORT),
+	JOBKEY_TEST(jobkey_mach, JOBKEY_MACH_ENTERKERNELDEBUGGERONCLOSE),
+	JOBKEY_TEST(jobkey_keepalive, JOBKEY_KEEPALIVE_SUCCESSFULEXIT),
+	JOBKEY_TEST(jobkey_keepalive, JOBKEY_KEEPALIVE_NETWORKSTATE),
+	JOBKEY_TEST(jobkey_keepalive, JOBKEY_KEEPALIVE_PATHSTATE),
+	JOBKEY_TEST(jobkey_keepalive, JOBKEY_KEEPALIVE_OTHERJOBACTIVE),
+	JOBKEY_TEST(jobkey_keepalive, JOBKEY_KEEPALIVE_OTHERJOBENABLED),
+	JOBKEY_TEST(jobkey_keepalive, JOBKEY_KEEPALIVE_AFTERINITIALDEMAND),
+	JOBKEY_TEST(jobkey_keepalive, JOBKEY_KEEPALIVE_CRASHED),
+	JOBKEY_TEST(jobkey_cal, JOBKEY_CAL_MINUTE),
+	JOBKEY_TEST(jobkey_cal, JOBKEY_CAL_HOUR),
+	JOBKEY_TEST(jobkey_cal, JOBKEY_CAL_DAY),
+	JOBKEY_TEST(jobkey_cal, JOBKEY_CAL_WEEKDAY),
+	JOBKEY_TEST(jobkey_cal, JOBKEY_CAL_MONTH),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_CORE),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_CPU),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_DATA),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_FSIZE),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_MEMLOCK),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_NOFILE),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_NPROC),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_RSS),
+	JOBKEY_TEST(jobkey_resourcelimit, JOBKEY_RESOURCELIMIT_STACK),
+	JOBKEY_TEST(jobkey_disabled, JOBKEY_DISABLED_MACHINETYPE),
+	JOBKEY_TEST(jobkey_disabled, JOBKEY_DISABLED_MODELNAME),
+	JOBKEY_TEST(jobkey_sandbox, JOBKEY_SANDBOX_NAMED),
+	JOBKEY_TEST(jobkey, JOBKEY_DEFAULTS),
+	JOBKEY_TEST(jobkey, JOBKEY_LABEL),
+	JOBKEY_TEST(jobkey, JOBKEY_DISABLED),
+	JOBKEY_TEST(jobkey, JOBKEY_USERNAME),
+	JOBKEY_TEST(jobkey, JOBKEY_GROUPNAME),
+	JOBKEY_TEST(jobkey, JOBKEY_TIMEOUT),
+	JOBKEY_TEST(jobkey, JOBKEY_EXITTIMEOUT),
+	JOBKEY_TEST(jobkey, JOBKEY_INITGROUPS),
+	JOBKEY_TEST(jobkey, JOBKEY_SOCKETS),
+	JOBKEY_TEST(jobkey, JOBKEY_MACHSERVICES),
+	JOBKEY_TEST(jobkey, JOBKEY_MACHSERVICELOOKUPPOLICIES),
+	JOBKEY_TEST(jobkey, JOBKEY_INETDCOMPATIBILITY),
+	JOBKEY_TEST(jobkey, JOBKEY_ENABLEGLOBBING),
+	JOBKEY_TEST(jobkey, JOBKEY_PROGRAMARGUMENTS),
+	JOBKEY_TEST(jobkey, JOBKEY_PROGRAM),
+	JOBKEY_TEST(jobkey, JOBKEY_ONDEMAND),
+	JOBKEY_TEST(jobkey, JOBKEY_KEEPALIVE),
+	JOBKEY_TEST(jobkey, JOBKEY_LIMITLOADTOHOSTS),
+	JOBKEY_TEST(jobkey, JOBKEY_LIMITLOADFROMHOSTS),
+	JOBKEY_TEST(jobkey, JOBKEY_LIMITLOADTOSESSIONTYPE),
+	JOBKEY_TEST(jobkey, JOBKEY_LIMITLOADTOHARDWARE),
+	JOBKEY_TEST(jobkey, JOBKEY_LIMITLOADFROMHARDWARE),
+	JOBKEY_TEST(jobkey, JOBKEY_RUNATLOAD),
+	JOBKEY_TEST(jobkey, JOBKEY_ROOTDIRECTORY),
+	JOBKEY_TEST(jobkey, JOBKEY_WORKINGDIRECTORY),
+	JOBKEY_TEST(jobkey, JOBKEY_ENVIRONMENTVARIABLES),
+	JOBKEY_TEST(jobkey, JOBKEY_USERENVIRONMENTVARIABLES),
+	JOBKEY_TEST(jobkey, JOBKEY_UMASK),
+	JOBKEY_TEST(jobkey, JOBKEY_NICE),
+	JOBKEY_TEST(jobkey, JOBKEY_HOPEFULLYEXITSFIRST),
+	JOBKEY_TEST(jobkey, JOBKEY_HOPEFULLYEXITSLAST),
+	JOBKEY_TEST(jobkey, JOBKEY_LOWPRIORITYIO),
+	JOBKEY_TEST(jobkey, JOBKEY_SESSIONCREATE),
+	JOBKEY_TEST(jobkey, JOBKEY_STARTONMOUNT),
+	JOBKEY_TEST(jobkey, JOBKEY_SOFTRESOURCELIMITS),
+	JOBKEY_TEST(jobkey, JOBKEY_HARDRESOURCELIMITS),
+	JOBKEY_TEST(jobkey, JOBKEY_STANDARDINPATH),
+	JOBKEY_TEST(jobkey, JOBKEY_STANDARDOUTPATH),
+	JOBKEY_TEST(jobkey, JOBKEY_STANDARDERRORPATH),
+	JOBKEY_TEST(jobkey, JOBKEY_DEBUG),
+	JOBKEY_TEST(jobkey, JOBKEY_WAITFORDEBUGGER),
+	JOBKEY_TEST(jobkey, JOBKEY_QUEUEDIRECTORIES),
+	JOBKEY_TEST(jobkey, JOBKEY_WATCHPATHS),
+	JOBKEY_TEST(jobkey, JOBKEY_STARTINTERVAL),
+	JOBKEY_TEST(jobkey, JOBKEY_STARTCALENDARINTERVAL),
+	JOBKEY_TEST(jobkey, JOBKEY_BONJOURFDS),
+	JOBKEY_TEST(jobkey, JOBKEY_LASTEXITSTATUS),
+	JOBKEY_TEST(jobkey, JOBKEY_PID),
+	JOBKEY_TEST(jobkey, JOBKEY_THROTTLEINTERVAL),
+	JOBKEY_TEST(jobkey, JOBKEY_LAUNCHONLYONCE),
+	JOBKEY_TEST(jobkey, JOBKEY_ABANDONPROCESSGROUP),
+	JOBKEY_TEST(jobkey, JOBKEY_IGNOREPROCESSGROUPATSHUTDOWN),
+	JOBKEY_TEST(jobkey, JOBKEY_POLICIES),
+	JOBKEY_TEST(jobkey, JOBKEY_ENABLETRANSACTIONS),
+	JOBKEY_TEST(jobkey, JOBKEY_CFBUNDLEIDENTIFIER),
+	JOBKEY_TEST(jobkey, JOBKEY_PROCESSTYPE),
+	JOBKEY_TEST(jobkey, JOBKEY_LAUNCHEVENTS),
+	JOBKEY_TEST(jobkey, JOBKEY_TRANSACTIONCOUNT),
+	JOBKEY_TEST(jobkey, JOBKEY_QUARANTINEDATA),
+	JOBKEY_TEST(jobkey, JOBKEY_SANDBOXPROFILE),
+	JOBKEY_TEST(jobkey, JOBKEY_SANDBOXFLAGS),
+	JOBKEY_TEST(jobkey, JOBKEY_SANDBOXCONTAINER),
+	JOBKEY_TEST(jobkey, JOBKEY_JETSAMPROPERTIES),
+	JOBKEY_TEST(jobkey, JOBKEY_JETSAMPRIORITY),
+	JOBKEY_TEST(jobkey, JOBKEY_JETSAMMEMORYLIMIT),
+	JOBKEY_TEST(jobkey, JOBKEY_JETSAMMEMORYLIMITBACKGROUND),
+	JOBKEY_TEST(jobkey, JOBKEY_SECURITYSESSIONUUID),
+	JOBKEY_TEST(jobkey, JOBKEY_DISABLEASLR),
+	JOBKEY_TEST(jobkey, JOBKEY_XPCDOMAIN),
+	JOBKEY_TEST(jobkey, JOBKEY_POSIXSPAWNTYPE),
+	JOBKEY_TEST(jobkey, JOBKEY_EMBEDDEDPRIVILEGEDISPENSATION),
+	JOBKEY_TEST(jobkey, JOBKEY_EMBEDDEDHOMESCREEN),
+	JOBKEY_TEST(jobkey, JOBKEY_EMBEDDEDMAINTHREADPRIORITY),
+	JOBKEY_TEST(jobkey, JOBKEY_ENTERKERNELDEBUGGERBEFOREKILL),
+	JOBKEY_TEST(jobkey, JOBKEY_PERJOBMACHSERVICES),
+	JOBKEY_TEST(jobkey, JOBKEY_SERVICEIPC),
+	JOBKEY_TEST(jobkey, JOBKEY_BINARYORDERPREFERENCE),
+	JOBKEY_TEST(jobkey, JOBKEY_MACHEXCEPTIONHANDLER),
+	JOBKEY_TEST(jobkey, JOBKEY_MULTIPLEINSTANCES),
+	JOBKEY_TEST(jobkey, JOBKEY_EVENTMONITOR),
+	JOBKEY_TEST(jobkey, JOBKEY_SHUTDOWNMONITOR),
+	JOBKEY_TEST(jobkey, JOBKEY_BEGINTRANSACTIONATSHUTDOWN),
+	JOBKEY_TEST(jobkey, JOBKEY_XPCDOMAINBOOTSTRAPPER),
+	JOBKEY_TEST(jobkey, JOBKEY_ASID),
+	JOBKEY_TEST(jobkey, JOBKEY_JOINGUISESSION),
+	JOBKEY_TEST(jobkey, JOBKEY_LOWPRIORITYBACKGROUNDIO),
+	JOBKEY_TEST(jobkey, JOBKEY_LEGACYTIMERS),
+	JOBKEY_TEST(jobkey, JOBKEY_STARTPRIORITY),
+	JOBKEY_TEST(jobpolicy, JOBPOLICY_DENYCREATINGOTHERJOBS),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_TYPE),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_PASSIVE),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_BONJOUR),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_SECUREWITHKEY),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_PATHNAME),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_PATHMODE),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_NODENAME),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_SERVICENAME),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_FAMILY),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_PROTOCOL),
+	JOBKEY_TEST(jobsocketkey, JOBSOCKETKEY_MULTICASTGROUP),
+	JOBKEY_TEST(jobinetdcompatibility, JOBINETDCOMPATIBILITY_WAIT),
+	JOBKEY_TEST(jobinetdcompatibility, JOBINETDCOMPATIBILITY_BATCHACCEPT),
+	JOBKEY_TEST(jobinetdcompatibility, JOBINETDCOMPATIBILITY_LOGCONNECTIONS),
+	JOBKEY_TEST(jobinetdcompatibility, JOBINETDCOMPATIBILITY_MAXCHILDREN),
+	JOBKEY_TEST(jobinetdcompatibility, JOBINETDCOMPATIBILITY_WORKERS),
+};
+
+#define JOBKEY_TESTS (sizeof(jobkey_tests) / sizeof(jobkey_tests[0]))
+
+static void
+jobkeys_test_case(char *s, int upper)
+{
+	for (; *s; s++) {
+		*s = upper ? toupper((unsigned char)*s) : tolower((unsigned char)*s);
+	}
+}
+
+static jobkey_t
+jobkeys_test_linear(jobkey_t (*lookup)(const char *), const char *key)
+{
+	size_t i;
+
+	for (i = 0; i < JOBKEY_TESTS; i++) {
+		if (jobkey_tests[i].jt_lookup == lookup && strcasecmp(jobkey_tests[i].jt_name, key) == 0) {
+			return jobkey_tests[i].jt_key;
+		}
+	}
+	return JOBKEY_UNKNOWN;
+}
+
+void test_jobkeys_lookup(void **s) {
+	char buf[64];
+	size_t i;
+
+	for (i = 0; i < JOBKEY_TESTS; i++) {
+		const struct jobkey_test *jt = &jobkey_tests[i];
+
+		assert_int_equal(jt->jt_key, jt->jt_lookup(jt->jt_name));
+
+		snprintf(buf, sizeof(buf), "%s", jt->jt_name);
+		jobkeys_test_case(buf, 1);
+		assert_int_equal(jt->jt_key, jt->jt_lookup(buf));
+		jobkeys_test_case(buf, 0);
+		assert_int_equal(jt->jt_key, jt->jt_lookup(buf));
+	}
+}
+
+void test_jobkeys_unknown(void **s) {
+	char buf[64];
+	size_t i, len;
+
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_lookup(""));
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_lookup("NoSuchKey"));
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_lookup("Label "));
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_lookup("Labe"));
+
+	/* Sub-keys only resolve in their own namespace. */
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_lookup(LAUNCH_JOBKEY_MACH_RESETATCLOSE));
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_lookup(LAUNCH_JOBKEY_CAL_HOUR));
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_mach_lookup(LAUNCH_JOBKEY_MACHSERVICES));
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_keepalive_lookup(LAUNCH_JOBKEY_KEEPALIVE));
+	assert_int_equal(JOBKEY_UNKNOWN, jobkey_resourcelimit_lookup(LAUNCH_JOBKEY_CAL_DAY));
+
+	/* Every proper prefix and one-character extension of a key misses,
+	 * unless it happens to be another key (Program, ProgramArguments).
+	 */
+	for (i = 0; i < JOBKEY_TESTS; i++) {
+		const struct jobkey_test *jt = &jobkey_tests[i];
+
+		len = strlen(jt->jt_name);
+		snprintf(buf, sizeof(buf), "%s", jt->jt_name);
+		while (len-- > 0) {
+			buf[len] = '\0';
+			assert_int_equal(jobkeys_test_linear(jt->jt_lookup, buf), jt->jt_lookup(buf));
+		}
+		snprintf(buf, sizeof(buf), "%sx", jt->jt_name);
+		assert_int_equal(jobkeys_test_linear(jt->jt_lookup, buf), jt->jt_lookup(buf));
+	}
+}
+
+/* How the job_import_*() functions found a key before the tables: a switch
+ * on the first letter, then strcasecmp() down that letter's keys. Here every
+ * value type shares one chain per letter, where core.c had one per type.
+ */
+static const char *jobkeys_bench_chain[26][24];
+
+static void
+jobkeys_bench_chain_init(void)
+{
+	size_t i, n[26] = { 0 };
+	int c;
+
+	for (i = 0; i < JOBKEY_TESTS; i++) {
+		if (jobkey_tests[i].jt_lookup != jobkey_lookup) {
+			continue;
+		}
+		c = tolower((unsigned char)jobkey_tests[i].jt_name[0]) - 'a';
+		if (c >= 0 && c < 26 && n[c] < 23) {
+			jobkeys_bench_chain[c][n[c]++] = jobkey_tests[i].jt_name;
+		}
+	}
+}
+
+static void
+jobkeys_bench_chain_walk(launch_data_t obj, const char *key, void *context)
+{
+	const char **k;
+	int c = tolower((unsigned char)key[0]) - 'a';
+
+	if (c < 0 || c >= 26) {
+		return;
+	}
+	for (k = jobkeys_bench_chain[c]; *k; k++) {
+		if (strcasecmp(key, *k) == 0) {
+			(*(size_t *)context)++;
+			return;
+		}
+	}
+}
+
+static void
+jobkeys_bench_hash_walk(launch_data_t obj, const char *key, void *context)
+{
+	if (jobkey_lookup(key) != JOBKEY_UNKNOWN) {
+		(*(size_t *)context)++;
+	}
+}
+
+static void
+jobkeys_bench_run(const char *name, launch_data_t job, void (*walk)(launch_data_t, const char *, void *))
+{
+	struct timespec start, end;
+	size_t i, found = 0;
+	double secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < JOBKEYS_BENCH_IMPORTS; i++) {
+		launch_data_dict_iterate(job, walk, &found);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%-24s %zu keys, %zu known, %8.2f us/import\n", name, launch_data_dict_get_count(job),
+		found / JOBKEYS_BENCH_IMPORTS, secs * 1e6 / JOBKEYS_BENCH_IMPORTS);
+}
+
+static launch_data_t
+jobkeys_bench_value(void)
+{
+	launch_data_t v = launch_data_alloc(LAUNCH_DATA_BOOL);
+
+	launch_data_set_bool(v, true);
+	return v;
+}
+
+void bench_jobkeys_import(void **s) {
+	launch_data_t job = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	char buf[64];
+	size_t i, n = 0;
+
+	/* Every top-level key once, topped up to 100 with keys launchd does not
+	 * know, which have to fall all the way through either way.
+	 */
+	for (i = 0; i < JOBKEY_TESTS && n < JOBKEYS_BENCH_KEYS; i++) {
+		if (jobkey_tests[i].jt_lookup == jobkey_lookup) {
+			launch_data_dict_insert(job, jobkeys_bench_value(), jobkey_tests[i].jt_name);
+			n++;
+		}
+	}
+	for (i = 0; n < JOBKEYS_BENCH_KEYS; i++, n++) {
+		snprintf(buf, sizeof(buf), "%sUnknownKey%zu", (i & 1) ? "Sock" : "Pro", i);
+		launch_data_dict_insert(job, jobkeys_bench_value(), buf);
+	}
+	assert_int_equal(JOBKEYS_BENCH_KEYS, launch_data_dict_get_count(job));
+
+	jobkeys_bench_chain_init();
+	jobkeys_bench_run("key[0] + strcasecmp", job, jobkeys_bench_chain_walk);
+	jobkeys_bench_run("perfect hash", job, jobkeys_bench_hash_walk);
+
+	launch_data_free(job);
+}
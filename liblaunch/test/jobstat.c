@@ -0,0 +1 @@
+../../launchd/jobstat.c
\ No newline at end of file
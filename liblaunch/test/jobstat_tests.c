@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "liblaunch_test.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
+#include "jobstat.h"
+
+#define JOBSTAT_TEST_SLOTS 4
+#define JOBSTAT_TEST_READS 20000
+#define JOBSTAT_BENCH_JOBS 2000
+#define JOBSTAT_BENCH_RUNS 50
+
+/* Points launch_jobstat_copy() at a table in a directory of our own. */
+static void
+jobstat_tests_dir(char *dir)
+{
+	char path[64];
+
+	strcpy(dir, "/tmp/liblaunch_test.XXXXXX");
+	assert_true(mkdtemp(dir) != NULL);
+	snprintf(path, sizeof(path), "%s/sock", dir);
+	setenv(LAUNCHD_SOCKET_ENV, path, 1);
+}
+
+static void
+jobstat_tests_copy(struct launch_jobstat_slot **slots, size_t *cnt)
+{
+	*slots = NULL;
+	*cnt = 0;
+	assert_int_equal(0, launch_jobstat_copy(slots, cnt));
+}
+
+void test_jobstat_table(void **s) {
+	struct launch_jobstat_slot *a, *b, *c, *slots;
+	char dir[32], path[64], label[LAUNCH_JOBSTAT_LABEL_MAX + 32];
+	size_t cnt, filled = 0;
+	struct stat sb;
+
+	jobstat_tests_dir(dir);
+	assert_int_equal(-1, launch_jobstat_copy(&slots, &cnt));
+	assert_int_equal(ENOENT, errno);
+	assert_true(jobstat_alloc("com.example.early") == NULL);
+
+	assert_int_equal(0, jobstat_init(dir));
+	snprintf(path, sizeof(path), "%s/" LAUNCH_JOBSTAT_FILE, dir);
+	assert_int_equal(0, stat(path, &sb));
+	assert_int_equal(0600, sb.st_mode & 07777);
+	jobstat_tests_copy(&slots, &cnt);
+	assert_int_equal(0, cnt);
+	free(slots);
+
+	assert_true((a = jobstat_alloc("com.example.a")) != NULL);
+	assert_true((b = jobstat_alloc("com.example.b")) != NULL);
+	jobstat_update(a, 123, 0, 1, 1000);
+	jobstat_update(b, 0, W_EXITCODE(3, 0), 2, 2000);
+	jobstat_tests_copy(&slots, &cnt);
+	assert_int_equal(2, cnt);
+	assert_string_equal("com.example.a", slots[0].ljs_label);
+	assert_int_equal(LAUNCH_JOBSTAT_RUNNING, slots[0].ljs_state);
+	assert_int_equal(123, slots[0].ljs_pid);
+	assert_int_equal(1, slots[0].ljs_starts);
+	assert_int_equal(1000, slots[0].ljs_start_time);
+	assert_string_equal("com.example.b", slots[1].ljs_label);
+	assert_int_equal(LAUNCH_JOBSTAT_EXITED, slots[1].ljs_state);
+	assert_int_equal(0, slots[1].ljs_pid);
+	assert_int_equal(3, WEXITSTATUS(slots[1].ljs_status));
+	free(slots);
+
+	/* A removed job's slot is skipped, and the next job gets it. */
+	jobstat_free(a);
+	jobstat_tests_copy(&slots, &cnt);
+	assert_int_equal(1, cnt);
+	assert_string_equal("com.example.b", slots[0].ljs_label);
+	free(slots);
+	assert_true((c = jobstat_alloc("com.example.c")) == a);
+	jobstat_tests_copy(&slots, &cnt);
+	assert_int_equal(2, cnt);
+	assert_string_equal("com.example.c", slots[0].ljs_label);
+	assert_int_equal(LAUNCH_JOBSTAT_LOADED, slots[0].ljs_state);
+	assert_int_equal(0, slots[0].ljs_starts);
+	free(slots);
+
+	/* A table that cannot show every job in full is not used at all. */
+	memset(label, 'x', sizeof(label) - 1);
+	label[sizeof(label) - 1] = '\0';
+	assert_true((a = jobstat_alloc(label)) != NULL);
+	assert_int_equal(-1, launch_jobstat_copy(&slots, &cnt));
+	assert_int_equal(EOVERFLOW, errno);
+	jobstat_free(a);
+
+	while (jobstat_alloc("com.example.filler") != NULL) {
+		filled++;
+	}
+	assert_int_equal(JOBSTAT_SLOTS - 2, filled);
+	assert_int_equal(-1, launch_jobstat_copy(&slots, &cnt));
+	assert_int_equal(EOVERFLOW, errno);
+	jobstat_free(NULL);
+	jobstat_tests_copy(&slots, &cnt);
+	assert_int_equal(JOBSTAT_SLOTS, cnt);
+	free(slots);
+
+	jobstat_cleanup();
+	assert_int_equal(-1, launch_jobstat_copy(&slots, &cnt));
+	assert_int_equal(ENOENT, errno);
+	assert_int_equal(0, rmdir(dir));
+}
+
+/* A table whose launchd is gone is not reported, even though its file is. */
+void test_jobstat_stale(void **s) {
+	struct launch_jobstat_slot *slots;
+	char dir[32], path[64];
+	uint32_t dead;
+	size_t cnt;
+	pid_t p;
+	int fd;
+
+	jobstat_tests_dir(dir);
+	assert_int_equal(0, jobstat_init(dir));
+	assert_true(jobstat_alloc("com.example.a") != NULL);
+	jobstat_tests_copy(&slots, &cnt);
+	assert_int_equal(1, cnt);
+	free(slots);
+
+	fflush(stdout);
+	assert_true((p = fork()) != -1);
+	if (p == 0) {
+		_exit(0);
+	}
+	assert_int_equal(p, waitpid(p, NULL, 0));
+	dead = (uint32_t)p;
+
+	snprintf(path, sizeof(path), "%s/" LAUNCH_JOBSTAT_FILE, dir);
+	assert_true((fd = open(path, O_RDWR)) != -1);
+	assert_int_equal(sizeof(dead), pwrite(fd, &dead, sizeof(dead),
+			offsetof(struct launch_jobstat_header, ljh_pid)));
+	assert_int_equal(0, close(fd));
+	assert_int_equal(-1, launch_jobstat_copy(&slots, &cnt));
+	assert_int_equal(ENOENT, errno);
+
+	jobstat_cleanup();
+	assert_int_equal(0, rmdir(dir));
+}
+
+struct jobstat_tests_writer {
+	struct launch_jobstat_slot *slots[JOBSTAT_TEST_SLOTS];
+	volatile bool stop;
+	uint64_t writes;
+};
+
+/* Keeps every field of a slot equal to the same counter, and keeps replacing
+ * the job in the last one with one whose label carries the counter too.
+ */
+static void *
+jobstat_tests_write(void *arg)
+{
+	struct jobstat_tests_writer *w = arg;
+	char label[48];
+	uint64_t i;
+	size_t n;
+
+	for (i = 1; !w->stop; i++) {
+		n = i % JOBSTAT_TEST_SLOTS;
+		if (n == JOBSTAT_TEST_SLOTS - 1) {
+			jobstat_free(w->slots[n]);
+			snprintf(label, sizeof(label), "com.example.%llu", (unsigned long long)i);
+			w->slots[n] = jobstat_alloc(label);
+		}
+		jobstat_update(w->slots[n], (pid_t)i, (int)i, i, (int64_t)i);
+	}
+	w->writes = i;
+	return NULL;
+}
+
+void test_jobstat_concurrent(void **s) {
+	struct jobstat_tests_writer w;
+	struct launch_jobstat_slot *slots;
+	pthread_t writer;
+	char dir[32], label[48];
+	size_t cnt, i, run;
+
+	jobstat_tests_dir(dir);
+	assert_int_equal(0, jobstat_init(dir));
+	for (i = 0; i < JOBSTAT_TEST_SLOTS; i++) {
+		assert_true((w.slots[i] = jobstat_alloc("com.example.start")) != NULL);
+	}
+	w.stop = false;
+	assert_int_equal(0, pthread_create(&writer, NULL, jobstat_tests_write, &w));
+
+	/* No copy ever mixes two writes. */
+	for (run = 0; run < JOBSTAT_TEST_READS; run++) {
+		jobstat_tests_copy(&slots, &cnt);
+		assert_true(cnt == JOBSTAT_TEST_SLOTS || cnt == JOBSTAT_TEST_SLOTS - 1);
+		for (i = 0; i < cnt; i++) {
+			if (slots[i].ljs_starts == 0) {
+				continue;
+			}
+			assert_int_equal(slots[i].ljs_starts, slots[i].ljs_pid);
+			assert_int_equal(slots[i].ljs_starts, slots[i].ljs_status);
+			assert_int_equal(slots[i].ljs_starts, slots[i].ljs_start_time);
+			if (slots[i].ljs_starts % JOBSTAT_TEST_SLOTS == JOBSTAT_TEST_SLOTS - 1) {
+				snprintf(label, sizeof(label), "com.example.%llu", (unsigned long long)slots[i].ljs_starts);
+				assert_string_equal(label, slots[i].ljs_label);
+			}
+		}
+		free(slots);
+	}
+
+	w.stop = true;
+	assert_int_equal(0, pthread_join(writer, NULL));
+	assert_true(w.writes > 1);
+
+	jobstat_cleanup();
+	assert_int_equal(0, rmdir(dir));
+}
+
+/* Roughly what job_export() puts in for each job. */
+static launch_data_t
+jobstat_bench_job(const char *label, size_t i)
+{
+	launch_data_t j = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	launch_data_t args = launch_data_alloc(LAUNCH_DATA_ARRAY);
+	launch_data_t tmp;
+	size_t n;
+
+	tmp = launch_data_alloc(LAUNCH_DATA_STRING);
+	launch_data_set_string(tmp, label);
+	launch_data_dict_insert(j, tmp, LAUNCH_JOBKEY_LABEL);
+	tmp = launch_data_alloc(LAUNCH_DATA_STRING);
+	launch_data_set_string(tmp, "System");
+	launch_data_dict_insert(j, tmp, LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE);
+	tmp = launch_data_alloc(LAUNCH_DATA_BOOL);
+	launch_data_set_bool(tmp, true);
+	launch_data_dict_insert(j, tmp, LAUNCH_JOBKEY_ONDEMAND);
+	tmp = launch_data_alloc(LAUNCH_DATA_INTEGER);
+	launch_data_set_integer(tmp, 0);
+	launch_data_dict_insert(j, tmp, LAUNCH_JOBKEY_LASTEXITSTATUS);
+	if (i % 2) {
+		tmp = launch_data_alloc(LAUNCH_DATA_INTEGER);
+		launch_data_set_integer(tmp, 1000 + i);
+		launch_data_dict_insert(j, tmp, LAUNCH_JOBKEY_PID);
+	}
+	tmp = launch_data_alloc(LAUNCH_DATA_INTEGER);
+	launch_data_set_integer(tmp, 30);
+	launch_data_dict_insert(j, tmp, LAUNCH_JOBKEY_TIMEOUT);
+	tmp = launch_data_alloc(LAUNCH_DATA_STRING);
+	launch_data_set_string(tmp, "/usr/libexec/monitored");
+	launch_data_dict_insert(j, tmp, LAUNCH_JOBKEY_PROGRAM);
+	for (n = 0; n < 3; n++) {
+		tmp = launch_data_alloc(LAUNCH_DATA_STRING);
+		launch_data_set_string(tmp, n == 0 ? "/usr/libexec/monitored" : "--flag");
+		launch_data_array_set_index(args, tmp, n);
+	}
+	launch_data_dict_insert(j, args, LAUNCH_JOBKEY_PROGRAMARGUMENTS);
+
+	return j;
+}
+
+static void
+jobstat_bench_print(launch_data_t j, const char *key, void *context)
+{
+	long long *sum = context;
+	launch_data_t pido = launch_data_dict_lookup(j, LAUNCH_JOBKEY_PID);
+	launch_data_t stato = launch_data_dict_lookup(j, LAUNCH_JOBKEY_LASTEXITSTATUS);
+
+	*sum += (pido ? launch_data_get_integer(pido) : 0) + launch_data_get_integer(stato)
+		+ (long long)strlen(launch_data_get_string(launch_data_dict_lookup(j, LAUNCH_JOBKEY_LABEL)));
+}
+
+void bench_jobstat_list(void **s) {
+	struct launch_jobstat_slot *jslots[JOBSTAT_BENCH_JOBS], *slots;
+	struct timespec start, end;
+	char dir[32], label[64];
+	double export_us, table_us;
+	long long export_sum = 0, table_sum = 0;
+	size_t i, run, cnt, len, data_offset, fd_offset;
+	launch_data_t all, u;
+	void *buf;
+
+	jobstat_tests_dir(dir);
+	assert_int_equal(0, jobstat_init(dir));
+	for (i = 0; i < JOBSTAT_BENCH_JOBS; i++) {
+		snprintf(label, sizeof(label), "com.example.monitored.%zu", i);
+		assert_true((jslots[i] = jobstat_alloc(label)) != NULL);
+		jobstat_update(jslots[i], i % 2 ? (pid_t)(1000 + i) : 0, 0, 1, 1);
+	}
+
+	/* What VPROC_GSK_ALLJOBS costs short of the round trip itself: launchd
+	 * builds the tree and packs it, and the client unpacks and walks it.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (run = 0; run < JOBSTAT_BENCH_RUNS; run++) {
+		all = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+		for (i = 0; i < JOBSTAT_BENCH_JOBS; i++) {
+			snprintf(label, sizeof(label), "com.example.monitored.%zu", i);
+			launch_data_dict_insert(all, jobstat_bench_job(label, i), label);
+		}
+		len = launch_data_packed_size(all, NULL);
+		buf = malloc(len);
+		assert_int_equal(len, launch_data_pack(all, buf, len, NULL, NULL));
+		launch_data_free(all);
+
+		data_offset = fd_offset = 0;
+		assert_true((u = launch_data_unpack(buf, len, NULL, 0, &data_offset, &fd_offset)) != NULL);
+		launch_data_dict_iterate(u, jobstat_bench_print, &export_sum);
+		free(buf);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	export_us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / JOBSTAT_BENCH_RUNS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (run = 0; run < JOBSTAT_BENCH_RUNS; run++) {
+		jobstat_tests_copy(&slots, &cnt);
+		assert_int_equal(JOBSTAT_BENCH_JOBS, cnt);
+		for (i = 0; i < cnt; i++) {
+			table_sum += slots[i].ljs_pid + slots[i].ljs_status + (long long)strlen(slots[i].ljs_label);
+		}
+		free(slots);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	table_us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / JOBSTAT_BENCH_RUNS;
+
+	assert_true(export_sum == table_sum);
+	printf("list of %d jobs: exported tree %9.1f us, status table %9.1f us\n",
+		JOBSTAT_BENCH_JOBS, export_us, table_us);
+
+	jobstat_cleanup();
+	assert_int_equal(0, rmdir(dir));
+}
@@ -0,0 +1 @@
+../launch_jobstat.c
\ No newline at end of file
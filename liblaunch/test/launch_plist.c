@@ -0,0 +1 @@
+../launch_plist.c
\ No newline at end of file
@@ -71,6 +71,73 @@ int main(void) {
 	unit_test(test_launch_init_globals),
 	unit_test_setup_teardown(test_launch_data_alloc, setup_empty, teardown_launch_data),
 	unit_test_setup_teardown(test_launch_data_alloc_array, setup_empty, teardown_launch_data),
+	unit_test(test_launch_data_dict_lookup_small),
+	unit_test(test_launch_data_dict_lookup_indexed),
+	unit_test(test_launch_data_dict_insert_replaces),
+	unit_test(test_launch_data_dict_remove_keeps_order),
+	unit_test(test_launch_data_dict_pack_indexed),
+	unit_test(test_launch_data_unpack_in_place),
+	unit_test(bench_launch_data_dict),
+	unit_test(test_launch_data_packed_size),
+	unit_test(test_launch_data_pack_emit),
+	unit_test(bench_launch_data_pack),
+	unit_test(test_launchd_msg_envelope),
+	unit_test(bench_launchd_msg_pipeline),
+	unit_test(test_launch_msg_deque),
+	unit_test(test_launch_msg_async),
+	unit_test(bench_launch_msg_async),
+	unit_test(test_jobstat_table),
+	unit_test(test_jobstat_stale),
+	unit_test(test_jobstat_concurrent),
+	unit_test(bench_jobstat_list),
+	unit_test(test_jobgen_since),
+	unit_test(test_jobgen_forget),
+	unit_test(test_evloop_signals_and_fds),
+	unit_test(test_evloop_hangup_disabled),
+	unit_test(test_timerq_ordering),
+	unit_test(test_timerq_cancel),
+	unit_test(test_timerq_periodic),
+	unit_test(test_timerq_wall_clock_jump),
+	unit_test(test_calendar_spec_parse),
+	unit_test(test_calendar_next_basic),
+	unit_test(test_calendar_next_leap_day),
+	unit_test(test_calendar_next_dst),
+	unit_test(test_calendar_next_matches_reference),
+	unit_test(bench_calendar_next),
+	unit_test(test_hashtab_grow),
+	unit_test(test_hashtab_collisions),
+	unit_test(test_hashtab_foreach),
+	unit_test(test_hashtab_hash_spread),
+	unit_test(test_plist_parse_xml),
+	unit_test(test_plist_parse_xml_duplicates),
+	unit_test(test_plist_parse_malformed),
+	unit_test(test_plist_parse_deep),
+	unit_test(test_plist_parse_binary),
+	unit_test(test_plist_parse_binary_malformed),
+	unit_test(test_plist_corpus_roundtrip),
+	unit_test(test_plist_fuzz_corpus),
+	unit_test(test_plist_write_file),
+	unit_test(bench_plist_parse),
+	unit_test(test_logring_fifo),
+	unit_test(test_logring_wrap),
+	unit_test(test_logring_overwrite),
+	unit_test(test_logring_reject),
+	unit_test(test_logfmt_conversions),
+	unit_test(test_logfmt_copies_strings),
+	unit_test(test_logfmt_truncation),
+	unit_test(test_logfmt_unsupported),
+	unit_test(bench_logfmt_kevent),
+	unit_test(test_jobkeys_lookup),
+	unit_test(test_jobkeys_unknown),
+	unit_test(bench_jobkeys_import),
+	unit_test(test_spawn_env),
+	unit_test(test_spawn_plan_exec),
+	unit_test(test_spawn_plan_search),
+	unit_test(test_spawn_plan_failures),
+	unit_test(bench_spawn_rss),
+	unit_test(test_vproc_transaction_fast_path),
+	unit_test(test_vproc_transaction_threads),
+	unit_test(bench_vproc_transactions),
 	};
 
 	return run_tests(tests);
@@ -53,4 +53,101 @@ void test_launch_init_globals(void**);
 void test_launch_data_alloc(void**);
 void test_launch_data_alloc_array(void**);
 
+/* launch_data.c */
+void test_launch_data_dict_lookup_small(void**);
+void test_launch_data_dict_lookup_indexed(void**);
+void test_launch_data_dict_insert_replaces(void**);
+void test_launch_data_dict_remove_keeps_order(void**);
+void test_launch_data_dict_pack_indexed(void**);
+void test_launch_data_unpack_in_place(void**);
+void bench_launch_data_dict(void**);
+void test_launch_data_packed_size(void**);
+void test_launch_data_pack_emit(void**);
+void bench_launch_data_pack(void**);
+
+/* liblaunch.c framing */
+void test_launchd_msg_envelope(void**);
+void bench_launchd_msg_pipeline(void**);
+
+/* liblaunch.c launch_msg_async */
+void test_launch_msg_deque(void**);
+void test_launch_msg_async(void**);
+void bench_launch_msg_async(void**);
+
+/* launch_jobstat.c, jobstat.c */
+void test_jobstat_table(void**);
+void test_jobstat_stale(void**);
+void test_jobstat_concurrent(void**);
+void bench_jobstat_list(void**);
+
+/* jobgen.c */
+void test_jobgen_since(void**);
+void test_jobgen_forget(void**);
+
+/* evloop_epoll.c */
+void test_evloop_signals_and_fds(void**);
+void test_evloop_hangup_disabled(void**);
+
+/* timerq.c */
+void test_timerq_ordering(void**);
+void test_timerq_cancel(void**);
+void test_timerq_periodic(void**);
+void test_timerq_wall_clock_jump(void**);
+
+/* calendar.c */
+void test_calendar_spec_parse(void**);
+void test_calendar_next_basic(void**);
+void test_calendar_next_leap_day(void**);
+void test_calendar_next_dst(void**);
+void test_calendar_next_matches_reference(void**);
+void bench_calendar_next(void**);
+
+/* hashtab.c */
+void test_hashtab_grow(void**);
+void test_hashtab_collisions(void**);
+void test_hashtab_foreach(void**);
+void test_hashtab_hash_spread(void**);
+
+/* launch_plist.c */
+void test_plist_parse_xml(void**);
+void test_plist_parse_xml_duplicates(void**);
+void test_plist_parse_malformed(void**);
+void test_plist_parse_deep(void**);
+void test_plist_parse_binary(void**);
+void test_plist_parse_binary_malformed(void**);
+void test_plist_corpus_roundtrip(void**);
+void test_plist_fuzz_corpus(void**);
+void test_plist_write_file(void**);
+void bench_plist_parse(void**);
+
+/* logring.c */
+void test_logring_fifo(void**);
+void test_logring_wrap(void**);
+void test_logring_overwrite(void**);
+void test_logring_reject(void**);
+
+/* logfmt.c */
+void test_logfmt_conversions(void**);
+void test_logfmt_copies_strings(void**);
+void test_logfmt_truncation(void**);
+void test_logfmt_unsupported(void**);
+void bench_logfmt_kevent(void**);
+
+/* jobkeys.c */
+void test_jobkeys_lookup(void**);
+void test_jobkeys_unknown(void**);
+void bench_jobkeys_import(void**);
+
+/* spawn.c */
+void test_spawn_env(void**);
+void test_spawn_plan_exec(void**);
+void test_spawn_plan_search(void**);
+void test_spawn_plan_failures(void**);
+void bench_spawn_rss(void**);
+
+/* vproc_transaction.h */
+void test_vproc_transaction_fast_path(void**);
+void test_vproc_transaction_threads(void**);
+void bench_vproc_transactions(void**);
+
 #endif
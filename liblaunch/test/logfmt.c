@@ -0,0 +1 @@
+../../launchd/logfmt.c
\ No newline at end of file
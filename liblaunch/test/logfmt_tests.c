@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "liblaunch_test.h"
+#include "logfmt.h"
+
+#define LOGFMT_TEST_BUF 2048
+#define LOGFMT_BENCH_EVENTS 1000000
+
+static size_t
+logfmt_test_capture(void *rec, size_t recsz, const char *fmt, ...)
+{
+	va_list ap;
+	size_t sz;
+
+	va_start(ap, fmt);
+	sz = logfmt_capture(rec, recsz, fmt, ap);
+	va_end(ap);
+
+	return sz;
+}
+
+/* Captures and renders, and checks the result against vsnprintf(3). */
+static void
+logfmt_test_same(const char *fmt, ...)
+{
+	char rec[LOGFMT_TEST_BUF], want[LOGFMT_TEST_BUF], got[LOGFMT_TEST_BUF];
+	va_list ap, aq;
+	size_t sz;
+	int want_len;
+
+	va_start(ap, fmt);
+	va_copy(aq, ap);
+	want_len = vsnprintf(want, sizeof(want), fmt, ap);
+	sz = logfmt_capture(rec, sizeof(rec), fmt, aq);
+	va_end(aq);
+	va_end(ap);
+
+	assert_true(sz > 0);
+	assert_int_equal(want_len, logfmt_render(got, sizeof(got), rec, sz));
+	assert_string_equal(want, got);
+}
+
+/* Rendering later gives exactly what formatting right away would have. */
+void test_logfmt_conversions(void **s) {
+	logfmt_test_same("no conversions at all");
+	logfmt_test_same("100%% literal, %d%%", 42);
+	logfmt_test_same("%d %i %u %o %x %X", -7, 7, 4000000000u, 8, 0xbeef, 0xbeef);
+	logfmt_test_same("%hhd %hhu %hd %hu", 200, 511, 70000, 70000);
+	logfmt_test_same("%ld %lu %lld %llx %qd", -5L, 5UL, -(1LL << 40), 1ULL << 63, 9LL);
+	logfmt_test_same("%jd %zu %zd %td", (intmax_t)-3, (size_t)SIZE_MAX, (ssize_t)-1, (ptrdiff_t)-2);
+	logfmt_test_same("[%5d] [%-5d] [%05d] [%+d] [% d] [%#x] [%.3d]", 1, 2, 3, 4, 5, 6, 7);
+	logfmt_test_same("[%*d] [%-*d] [%*d] [%.*d] [%.*d]", 6, 1, 6, 2, -6, 3, 4, 4, -1, 5);
+	logfmt_test_same("%c%c%c", 'a', 'b', 'c');
+	logfmt_test_same("%s/%s, %10s|%-10s|%.3s|%.*s|%.0s.", "one", "", "right", "left", "truncated", 2, "star", "gone");
+	logfmt_test_same("%f %.2f %e %g %G %a %lf", 3.25, -1.005, 1e100, 0.0001, 1e-10, 1.0, 2.5);
+	logfmt_test_same("%p %p", (void *)0, (void *)logfmt_test_same);
+	logfmt_test_same("KEVENT[%d]: udata = %p data = 0x%lx ident = %s filter = %s flags = %s fflags = %s",
+			3, (void *)&s, 0x10L, "42", "EVFILT_PROC", "EV_ADD|EV_ONESHOT", "NOTE_EXIT");
+}
+
+/* Strings are copied when captured, not when rendered. */
+void test_logfmt_copies_strings(void **s) {
+	char rec[LOGFMT_TEST_BUF], out[64], label[] = "com.example.job";
+	size_t sz;
+
+	sz = logfmt_test_capture(rec, sizeof(rec), "%s exited: %d", label, 1);
+	assert_true(sz > 0);
+	memset(label, 'X', sizeof(label) - 1);
+
+	logfmt_render(out, sizeof(out), rec, sz);
+	assert_string_equal("com.example.job exited: 1", out);
+
+	sz = logfmt_test_capture(rec, sizeof(rec), "%s", NULL);
+	logfmt_render(out, sizeof(out), rec, sz);
+	assert_string_equal("(null)", out);
+}
+
+/* Output is truncated like snprintf(3), and a short record renders what it can
+ * rather than reading past its end.
+ */
+void test_logfmt_truncation(void **s) {
+	char rec[LOGFMT_TEST_BUF], out[8];
+	size_t sz;
+
+	sz = logfmt_test_capture(rec, sizeof(rec), "%s and %d", "abcdef", 12345);
+	assert_int_equal(strlen("abcdef and 12345"), logfmt_render(out, sizeof(out), rec, sz));
+	assert_string_equal("abcdef ", out);
+	assert_int_equal(strlen("abcdef and 12345"), logfmt_render(NULL, 0, rec, sz));
+
+	assert_int_equal(strlen("abcdef and "), logfmt_render(out, sizeof(out), rec, sz - 1));
+	assert_int_equal(0, logfmt_render(out, sizeof(out), rec, 2));
+	assert_string_equal("", out);
+
+	/* Too small a record buffer is a failed capture, not a partial one. */
+	assert_int_equal(0, logfmt_test_capture(rec, 12, "%s", "longer than twelve bytes"));
+}
+
+/* What we do not capture is refused, so the caller can format it directly. */
+void test_logfmt_unsupported(void **s) {
+	char rec[LOGFMT_TEST_BUF];
+	int n;
+
+	assert_int_equal(0, logfmt_test_capture(rec, sizeof(rec), "%1$d", 1));
+	assert_int_equal(0, logfmt_test_capture(rec, sizeof(rec), "%n", &n));
+	assert_int_equal(0, logfmt_test_capture(rec, sizeof(rec), "%Lf", (long double)1));
+	assert_int_equal(0, logfmt_test_capture(rec, sizeof(rec), "%ls", L"wide"));
+	assert_int_equal(0, logfmt_test_capture(rec, sizeof(rec), "trailing %"));
+	assert_int_equal(0, logfmt_test_capture(rec, sizeof(rec), "%0000000000000000000000000000000000000000000000000000000001d", 1));
+}
+
+static uint64_t
+logfmt_bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int logfmt_bench_debug;
+
+/* The two messages runtime_dispatch_kevents() logs per kevent, the way each
+ * logging mode handles them.
+ */
+enum {
+	LOGFMT_BENCH_EAGER,		/* format first, check the mask after */
+	LOGFMT_BENCH_GATED,		/* check the mask first, capture if enabled */
+};
+
+static void
+logfmt_bench_log(int mode, const char *fmt, ...)
+{
+	char buf[LOGFMT_TEST_BUF];
+	va_list ap;
+
+	if (mode == LOGFMT_BENCH_GATED && !logfmt_bench_debug) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	if (mode == LOGFMT_BENCH_EAGER) {
+		vsnprintf(buf, sizeof(buf), fmt, ap);
+	} else {
+		(void)logfmt_capture(buf, sizeof(buf), fmt, ap);
+	}
+	va_end(ap);
+}
+
+static double
+logfmt_bench_run(int mode)
+{
+	uint64_t start = logfmt_bench_now(), elapsed;
+	unsigned long i;
+
+	for (i = 0; i < LOGFMT_BENCH_EVENTS; i++) {
+		logfmt_bench_log(mode, "Dispatching kevent (ident/filter): %lu/%hd", i, (short)-5);
+		logfmt_bench_log(mode, "KEVENT[%d]: udata = %p data = 0x%lx ident = %s filter = %s flags = %s fflags = %s",
+				0, (void *)&i, (long)i, "1234", "EVFILT_PROC", "EV_ADD|EV_ONESHOT", "NOTE_EXIT|NOTE_EXEC");
+		logfmt_bench_log(mode, "Handled kevent.");
+	}
+	elapsed = logfmt_bench_now() - start;
+
+	return LOGFMT_BENCH_EVENTS / (elapsed / 1e9);
+}
+
+/* Stands in for x_handle_kqueue(), which cannot run outside launchd: the
+ * logging it does per event, with debug logging off and on.
+ */
+void bench_logfmt_kevent(void **s) {
+	logfmt_bench_debug = 0;
+	printf("kevent logging, debug off: eager %.0f events/sec, gated %.0f events/sec\n",
+			logfmt_bench_run(LOGFMT_BENCH_EAGER), logfmt_bench_run(LOGFMT_BENCH_GATED));
+	logfmt_bench_debug = 1;
+	printf("kevent logging, debug on: eager %.0f events/sec, deferred %.0f events/sec\n",
+			logfmt_bench_run(LOGFMT_BENCH_EAGER), logfmt_bench_run(LOGFMT_BENCH_GATED));
+}
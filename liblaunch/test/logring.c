@@ -0,0 +1 @@
+../../launchd/logring.c
\ No newline at end of file
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "liblaunch_test.h"
+#include "logring.h"
+
+#define LOGRING_TEST_SIZE 256
+
+/* Same shape as a log message: a length, then a payload. */
+struct logring_test_rec {
+	uint64_t sz;
+	uint64_t seq;
+};
+
+static void
+logring_test_put(struct logring *lr, size_t sz, uint64_t seq)
+{
+	struct logring_test_rec *r = logring_reserve(lr, sz);
+
+	assert_true(r != NULL);
+	memset(r, 0xa5, sz);
+	r->sz = sz;
+	r->seq = seq;
+	logring_commit(lr, sz);
+}
+
+/* Walks drained records, checking they are contiguous and in order. Returns
+ * the sequence number of the first one.
+ */
+static uint64_t
+logring_test_check(const char *buf, size_t len, size_t cnt)
+{
+	const struct logring_test_rec *r;
+	uint64_t first = 0, last = 0;
+	size_t off = 0, n = 0;
+
+	while (off < len) {
+		r = (const struct logring_test_rec *)(buf + off);
+		assert_true(r->sz >= sizeof(*r) && r->sz <= len - off);
+		if (n++ == 0) {
+			first = r->seq;
+		} else {
+			assert_int_equal(last + 1, r->seq);
+		}
+		last = r->seq;
+		off += r->sz;
+	}
+	assert_int_equal(len, off);
+	assert_int_equal(cnt, n);
+
+	return first;
+}
+
+/* Records come back out in order, as one span until the ring wraps. */
+void test_logring_fifo(void **s) {
+	uint64_t mem[LOGRING_TEST_SIZE / 8];
+	char out[LOGRING_TEST_SIZE];
+	struct logring lr;
+	struct iovec iov[2];
+	uint64_t i;
+
+	logring_init(&lr, mem, sizeof(mem), offsetof(struct logring_test_rec, sz));
+	assert_int_equal(0, logring_peek(&lr, iov));
+
+	for (i = 0; i < 4; i++) {
+		logring_test_put(&lr, 16 + i * 8, i);
+	}
+	assert_int_equal(4, logring_count(&lr));
+	assert_int_equal(16 + 24 + 32 + 40, logring_used(&lr));
+	assert_int_equal(1, logring_peek(&lr, iov));
+	assert_int_equal(logring_used(&lr), iov[0].iov_len);
+
+	assert_int_equal(112, logring_drain(&lr, out));
+	assert_int_equal(0, logring_test_check(out, 112, 4));
+	assert_int_equal(0, logring_count(&lr));
+	assert_int_equal(0, logring_used(&lr));
+	assert_int_equal(0, lr.lr_dropped);
+}
+
+/* A record that does not fit at the end goes to the start, and the skipped
+ * end is not drained.
+ */
+void test_logring_wrap(void **s) {
+	uint64_t mem[LOGRING_TEST_SIZE / 8];
+	char out[LOGRING_TEST_SIZE];
+	struct logring lr;
+	struct iovec iov[2];
+	uint64_t seq;
+
+	logring_init(&lr, mem, sizeof(mem), offsetof(struct logring_test_rec, sz));
+
+	/* 5 * 48 = 240 leaves 16 bytes at the end. */
+	for (seq = 0; seq < 5; seq++) {
+		logring_test_put(&lr, 48, seq);
+	}
+	logring_test_put(&lr, 48, seq++);
+	assert_int_equal(1, lr.lr_dropped);
+	assert_int_equal(5, logring_count(&lr));
+	assert_int_equal(5 * 48, logring_used(&lr));
+	assert_int_equal(2, logring_peek(&lr, iov));
+	assert_int_equal(4 * 48, iov[0].iov_len);
+	assert_int_equal(48, iov[1].iov_len);
+	assert_true(iov[1].iov_base == (void *)mem);
+
+	assert_int_equal(5 * 48, logring_drain(&lr, out));
+	assert_int_equal(1, logring_test_check(out, 5 * 48, 5));
+
+	/* Records ending exactly on the end of the buffer need no padding but
+	 * still leave the live span split in two.
+	 */
+	for (seq = 0; seq < 4; seq++) {
+		logring_test_put(&lr, 64, seq);
+	}
+	logring_test_put(&lr, 64, seq++);
+	assert_int_equal(0, lr.lr_pad_len);
+	assert_int_equal(2, logring_peek(&lr, iov));
+	assert_int_equal(3 * 64, iov[0].iov_len);
+	assert_int_equal(64, iov[1].iov_len);
+	assert_int_equal(4 * 64, logring_drain(&lr, out));
+	assert_int_equal(1, logring_test_check(out, 4 * 64, 4));
+}
+
+/* Filling the ring over and over keeps the newest records and counts the
+ * rest, whatever mix of sizes arrives.
+ */
+void test_logring_overwrite(void **s) {
+	uint64_t mem[LOGRING_TEST_SIZE / 8];
+	char out[LOGRING_TEST_SIZE];
+	struct logring lr;
+	uint64_t seq, first, put_bytes = 0;
+	size_t sz;
+
+	logring_init(&lr, mem, sizeof(mem), offsetof(struct logring_test_rec, sz));
+
+	for (seq = 0; seq < 10000; seq++) {
+		sz = 16 + ((seq * 7919) % 13) * 8;
+		logring_test_put(&lr, sz, seq);
+		put_bytes += sz;
+		assert_true(logring_used(&lr) <= LOGRING_TEST_SIZE);
+		assert_true(logring_used(&lr) + lr.lr_dropped_bytes == put_bytes);
+	}
+
+	sz = logring_used(&lr);
+	assert_int_equal(sz, logring_drain(&lr, out));
+	first = logring_test_check(out, sz, 10000 - lr.lr_dropped);
+	assert_int_equal(lr.lr_dropped, first);
+
+	/* A full-size record evicts everything, padding included. */
+	logring_test_put(&lr, 24, 0);
+	logring_test_put(&lr, LOGRING_TEST_SIZE, 1);
+	assert_int_equal(1, logring_count(&lr));
+	assert_int_equal(LOGRING_TEST_SIZE, logring_used(&lr));
+	logring_clear(&lr);
+	assert_int_equal(0, logring_count(&lr));
+}
+
+/* Sizes the ring cannot hold are refused without disturbing it. */
+void test_logring_reject(void **s) {
+	uint64_t mem[LOGRING_TEST_SIZE / 8];
+	struct logring lr;
+
+	logring_init(&lr, mem, sizeof(mem), offsetof(struct logring_test_rec, sz));
+	logring_test_put(&lr, 32, 0);
+
+	assert_true(logring_reserve(&lr, 0) == NULL);
+	assert_true(logring_reserve(&lr, 20) == NULL);
+	assert_true(logring_reserve(&lr, LOGRING_TEST_SIZE + 8) == NULL);
+	assert_int_equal(3, lr.lr_rejected);
+	assert_int_equal(0, lr.lr_dropped);
+	assert_int_equal(1, logring_count(&lr));
+	assert_int_equal(32, logring_used(&lr));
+}
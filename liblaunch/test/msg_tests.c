@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "liblaunch_test.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
+
+#define MSG_BENCH_LABELS 200
+#define MSG_BENCH_RUNS 20
+
+struct msg_tests_seen {
+	size_t cnt;
+	bool tagged[MSG_BENCH_LABELS];
+	uint64_t reqid[MSG_BENCH_LABELS];
+	long long value[MSG_BENCH_LABELS];
+	/* What the connection still had to write after each reply. */
+	size_t pending[MSG_BENCH_LABELS];
+	launch_t conn;
+	bool echo;
+};
+
+static int
+msg_tests_send_integer(launch_t conn, long long n, bool tagged, uint64_t reqid)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_INTEGER);
+	int r;
+
+	launch_data_set_integer(d, n);
+	r = tagged ? launchd_msg_send_tagged(conn, d, reqid) : launchd_msg_send(conn, d);
+	launch_data_free(d);
+	return r;
+}
+
+/* A GetJob request, or what launchd would send back for one. */
+static launch_data_t
+msg_tests_getjob(const char *label)
+{
+	launch_data_t msg = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	launch_data_t s = launch_data_alloc(LAUNCH_DATA_STRING);
+
+	launch_data_set_string(s, label);
+	launch_data_dict_insert(msg, s, LAUNCH_KEY_GETJOB);
+	return msg;
+}
+
+static void
+msg_tests_reset(struct msg_tests_seen *seen, launch_t conn, bool echo)
+{
+	memset(seen, 0, sizeof(*seen));
+	seen->conn = conn;
+	seen->echo = echo;
+}
+
+static void
+msg_tests_record(launch_data_t msg, void *context)
+{
+	struct msg_tests_seen *seen = context;
+	launch_t conn = seen->conn;
+	size_t i = seen->cnt++;
+
+	seen->tagged[i] = launchd_msg_recv_id(conn, &seen->reqid[i]);
+	if (launch_data_get_type(msg) == LAUNCH_DATA_INTEGER) {
+		seen->value[i] = launch_data_get_integer(msg);
+	}
+
+	if (seen->echo) {
+		if (seen->tagged[i]) {
+			assert_int_equal(0, launchd_msg_send_tagged(conn, msg, seen->reqid[i]));
+		} else {
+			assert_int_equal(0, launchd_msg_send(conn, msg));
+		}
+		seen->pending[i] = conn->sendlen;
+	}
+}
+
+static void
+msg_tests_drain(launch_data_t msg, void *context)
+{
+}
+
+void test_launchd_msg_envelope(void **s) {
+	struct msg_tests_seen seen;
+	static const uint64_t bad[] = { 0x1234, 64 };
+	launch_t a, b;
+	int sv[2];
+	size_t i;
+
+	assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	assert_true((a = launchd_fdopen(sv[0], -1)) != NULL);
+	assert_true((b = launchd_fdopen(sv[1], -1)) != NULL);
+
+	/* Both framings can share a connection. */
+	assert_int_equal(0, msg_tests_send_integer(a, 1, false, 0));
+	assert_int_equal(0, msg_tests_send_integer(a, 2, true, 7));
+	msg_tests_reset(&seen, b, false);
+	assert_int_equal(0, launchd_msg_recv(b, msg_tests_record, &seen));
+	assert_int_equal(2, seen.cnt);
+	assert_false(seen.tagged[0]);
+	assert_int_equal(1, seen.value[0]);
+	assert_true(seen.tagged[1]);
+	assert_int_equal(7, seen.reqid[1]);
+	assert_int_equal(2, seen.value[1]);
+
+	/* Held messages are only written by the next send that is not. */
+	a->holdsend = true;
+	for (i = 0; i < 3; i++) {
+		assert_int_equal(0, msg_tests_send_integer(a, 10 + i, true, 100 + i));
+	}
+	a->holdsend = false;
+	msg_tests_reset(&seen, b, false);
+	assert_int_equal(-1, launchd_msg_recv(b, msg_tests_record, &seen));
+	assert_int_equal(EAGAIN, errno);
+	assert_int_equal(0, launchd_msg_send(a, NULL));
+
+	/* The receiving side answers the batch with one write, after the last. */
+	seen.echo = true;
+	assert_int_equal(0, launchd_msg_recv(b, msg_tests_record, &seen));
+	assert_int_equal(3, seen.cnt);
+	assert_true(seen.pending[0] > 0);
+	assert_true(seen.pending[1] > seen.pending[0]);
+	assert_int_equal(0, seen.pending[2]);
+
+	msg_tests_reset(&seen, a, false);
+	assert_int_equal(0, launchd_msg_recv(a, msg_tests_record, &seen));
+	assert_int_equal(3, seen.cnt);
+	for (i = 0; i < 3; i++) {
+		assert_true(seen.tagged[i]);
+		assert_int_equal(100 + i, seen.reqid[i]);
+		assert_int_equal(10 + i, seen.value[i]);
+	}
+
+	/* Nothing to write is not an error. */
+	assert_int_equal(0, launchd_msg_send(a, NULL));
+
+	/* What a peer that stops reading leaves queued is what launchd throttles
+	 * its requests by.
+	 */
+	assert_int_equal(0, launchd_msg_send_pending(a));
+	assert_int_equal(0, fcntl(sv[0], F_SETFL, O_NONBLOCK));
+	assert_int_equal(0, fcntl(sv[1], F_SETFL, O_NONBLOCK));
+	for (i = 0; launchd_msg_send_pending(a) == 0; i++) {
+		if (msg_tests_send_integer(a, i, true, i) == -1) {
+			assert_int_equal(EAGAIN, errno);
+		}
+	}
+	while (launchd_msg_send(a, NULL) == -1) {
+		assert_int_equal(EAGAIN, errno);
+		while (launchd_msg_recv(b, msg_tests_drain, NULL) == 0) {
+		}
+		assert_int_equal(EAGAIN, errno);
+	}
+	assert_int_equal(0, launchd_msg_send_pending(a));
+	while (launchd_msg_recv(b, msg_tests_drain, NULL) == 0) {
+	}
+
+	/* Anything else is still refused. */
+	assert_int_equal(sizeof(bad), write(sv[0], bad, sizeof(bad)));
+	assert_int_equal(-1, launchd_msg_recv(b, msg_tests_record, &seen));
+	assert_int_equal(EBADRPC, errno);
+
+	launchd_close(a, close);
+	launchd_close(b, close);
+}
+
+/* Answers every message with itself, in the framing it came in, like
+ * ipc_readmsg() does, until the other end goes away.
+ */
+static pid_t
+msg_tests_echo_server(int fd, int other)
+{
+	struct msg_tests_seen seen;
+	struct pollfd pfd;
+	launch_t conn;
+	pid_t p;
+
+	if ((p = fork()) != 0) {
+		return p;
+	}
+
+	close(other);
+	conn = launchd_fdopen(fd, -1);
+	pfd.fd = fd;
+	for (;;) {
+		pfd.events = POLLIN | (conn->sendlen > 0 ? POLLOUT : 0);
+		poll(&pfd, 1, -1);
+		if ((pfd.revents & POLLOUT) && launchd_msg_send(conn, NULL) == -1 && errno != EAGAIN) {
+			_exit(0);
+		}
+		msg_tests_reset(&seen, conn, true);
+		if (launchd_msg_recv(conn, msg_tests_record, &seen) == -1 && errno != EAGAIN) {
+			_exit(0);
+		}
+	}
+}
+
+/* Reads until 'want' messages have been seen. */
+static void
+msg_tests_wait(launch_t conn, struct msg_tests_seen *seen, size_t want)
+{
+	struct pollfd pfd = { launchd_getfd(conn), POLLIN, 0 };
+
+	while (seen->cnt < want) {
+		if (launchd_msg_recv(conn, msg_tests_record, seen) == -1) {
+			assert_int_equal(EAGAIN, errno);
+			poll(&pfd, 1, -1);
+		}
+	}
+}
+
+void bench_launchd_msg_pipeline(void **s) {
+	launch_data_t reqs[MSG_BENCH_LABELS];
+	struct msg_tests_seen seen;
+	struct timespec start, end;
+	double serial_us, pipelined_us;
+	char label[64];
+	launch_t conn;
+	size_t i, run;
+	int sv[2], status;
+	pid_t p;
+
+	assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	assert_true((p = msg_tests_echo_server(sv[1], sv[0])) > 0);
+	close(sv[1]);
+	assert_true((conn = launchd_fdopen(sv[0], -1)) != NULL);
+
+	for (i = 0; i < MSG_BENCH_LABELS; i++) {
+		snprintf(label, sizeof(label), "com.example.monitored.%zu", i);
+		reqs[i] = msg_tests_getjob(label);
+	}
+
+	/* One request, one reply, like launch_msg() for each label. */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (run = 0; run < MSG_BENCH_RUNS; run++) {
+		msg_tests_reset(&seen, conn, false);
+		for (i = 0; i < MSG_BENCH_LABELS; i++) {
+			assert_int_equal(0, launchd_msg_send(conn, reqs[i]));
+			msg_tests_wait(conn, &seen, i + 1);
+		}
+		assert_false(seen.tagged[0]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	serial_us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / MSG_BENCH_RUNS;
+
+	/* All of them at once, like launch_msg_pipeline(). */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (run = 0; run < MSG_BENCH_RUNS; run++) {
+		msg_tests_reset(&seen, conn, false);
+		conn->holdsend = true;
+		for (i = 0; i < MSG_BENCH_LABELS; i++) {
+			assert_int_equal(0, launchd_msg_send_tagged(conn, reqs[i], i));
+		}
+		conn->holdsend = false;
+		if (launchd_msg_send(conn, NULL) == -1) {
+			assert_int_equal(EAGAIN, errno);
+			while (launchd_msg_send(conn, NULL) == -1) {
+				assert_int_equal(EAGAIN, errno);
+				msg_tests_wait(conn, &seen, seen.cnt + 1);
+			}
+		}
+		msg_tests_wait(conn, &seen, MSG_BENCH_LABELS);
+		for (i = 0; i < MSG_BENCH_LABELS; i++) {
+			assert_true(seen.tagged[i]);
+			assert_int_equal(i, seen.reqid[i]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pipelined_us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / MSG_BENCH_RUNS;
+
+	printf("%d GetJob requests: one at a time %9.1f us, pipelined %9.1f us\n",
+		MSG_BENCH_LABELS, serial_us, pipelined_us);
+
+	for (i = 0; i < MSG_BENCH_LABELS; i++) {
+		launch_data_free(reqs[i]);
+	}
+	launchd_close(conn, close);
+	assert_int_equal(p, waitpid(p, &status, 0));
+}
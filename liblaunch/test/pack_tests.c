@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "liblaunch_test.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
+
+static launch_data_t
+new_string(const char *s)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_STRING);
+	launch_data_set_string(d, s);
+	return d;
+}
+
+static launch_data_t
+new_integer(long long n)
+{
+	launch_data_t d = launch_data_alloc(LAUNCH_DATA_INTEGER);
+	launch_data_set_integer(d, n);
+	return d;
+}
+
+/* Roughly what launchctl submits for one job. */
+static launch_data_t
+build_job(size_t n, size_t keys)
+{
+	launch_data_t job = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	launch_data_t args = launch_data_alloc(LAUNCH_DATA_ARRAY);
+	launch_data_t fd = launch_data_alloc(LAUNCH_DATA_FD);
+	launch_data_t opaque = launch_data_alloc(LAUNCH_DATA_OPAQUE);
+	char buf[64];
+	size_t i;
+
+	snprintf(buf, sizeof(buf), "com.example.job%zu", n);
+	launch_data_dict_insert(job, new_string(buf), LAUNCH_JOBKEY_LABEL);
+	launch_data_array_set_index(args, new_string("/usr/sbin/exampled"), 0);
+	launch_data_array_set_index(args, new_string("-f"), 1);
+	launch_data_dict_insert(job, args, LAUNCH_JOBKEY_PROGRAMARGUMENTS);
+	launch_data_set_fd(fd, -1);
+	launch_data_dict_insert(job, fd, "Socket");
+	launch_data_set_opaque(opaque, buf, 13);
+	launch_data_dict_insert(job, opaque, "Opaque");
+
+	for (i = 4; i < keys; i++) {
+		snprintf(buf, sizeof(buf), "Key%zu", i);
+		launch_data_dict_insert(job, new_integer(i), buf);
+	}
+	return job;
+}
+
+static launch_data_t
+build_submitjob(size_t jobs)
+{
+	launch_data_t msg = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+	launch_data_t arr = launch_data_alloc(LAUNCH_DATA_ARRAY);
+	size_t i;
+
+	for (i = 0; i < jobs; i++) {
+		launch_data_array_set_index(arr, build_job(i, 20), i);
+	}
+	launch_data_dict_insert(msg, arr, LAUNCH_KEY_SUBMITJOB);
+	return msg;
+}
+
+struct emit_ctx {
+	char *buf;
+	size_t len;
+};
+
+static void
+emit_append(void *ctx, const void *bytes, size_t len)
+{
+	struct emit_ctx *ec = ctx;
+	memcpy(ec->buf + ec->len, bytes, len);
+	ec->len += len;
+}
+
+/*
+ * TEST: launch_data_packed_size, launch_data_pack_emit
+ *****************************************************/
+void test_launch_data_packed_size(void **s) {
+	launch_data_t d = build_submitjob(10);
+	size_t sz, fd_cnt = 0;
+	void *buf;
+
+	sz = launch_data_packed_size(d, &fd_cnt);
+	assert_int_equal(0, fd_cnt);
+
+	buf = malloc(sz);
+	assert_int_equal(sz, launch_data_pack(d, buf, sz, NULL, NULL));
+	/* One byte short must fail rather than overrun. */
+	assert_int_equal(0, launch_data_pack(d, buf, sz - 1, NULL, NULL));
+
+	free(buf);
+	launch_data_free(d);
+};
+
+void test_launch_data_pack_emit(void **s) {
+	launch_data_t d = build_submitjob(10), u;
+	size_t sz = launch_data_packed_size(d, NULL);
+	size_t data_offset = 0, fd_offset = 0;
+	struct emit_ctx ec = { calloc(1, sz), 0 };
+	void *buf = calloc(1, sz);
+
+	launch_data_pack(d, buf, sz, NULL, NULL);
+	assert_int_equal(sz, launch_data_pack_emit(d, emit_append, &ec, NULL));
+	assert_int_equal(sz, ec.len);
+	assert_true(0 == memcmp(buf, ec.buf, sz));
+
+	u = launch_data_unpack(ec.buf, ec.len, NULL, 0, &data_offset, &fd_offset);
+	assert_false(NULL == u);
+	assert_int_equal(10, launch_data_array_get_count(launch_data_dict_lookup(u, LAUNCH_KEY_SUBMITJOB)));
+
+	free(buf);
+	free(ec.buf);
+	launch_data_free(d);
+};
+/*****************************************************/
+
+/*
+ * BENCHMARK: exact-size message encoding
+ *****************************************************/
+static void
+bench_pack(const char *name, launch_data_t d)
+{
+	/* What launchd_msg_send() used to allocate for every message. */
+	const size_t legacy = 10 * 1024 * 1024 + 4 * 1024;
+	struct timespec start, end;
+	size_t i, sz = 0, alloc, iterations = 100;
+	void *buf;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		sz = launch_data_packed_size(d, NULL);
+		buf = malloc(sz);
+		assert_int_equal(sz, launch_data_pack(d, buf, sz, NULL, NULL));
+		free(buf);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	/* Past LAUNCH_MSG_STREAM_THRESHOLD only the stream chunk is allocated. */
+	alloc = sz > 256 * 1024 ? 64 * 1024 : sz;
+
+	printf("%-24s %9zu bytes/msg, alloc %9zu -> %9zu bytes/msg, %10.1f us/msg\n",
+		name, sz, legacy, alloc,
+		((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / iterations / 1000);
+}
+
+void bench_launch_data_pack(void **s) {
+	launch_data_t checkin = new_string(LAUNCH_KEY_CHECKIN);
+	launch_data_t job = build_job(0, 60);
+	launch_data_t submit = build_submitjob(1000);
+
+	bench_pack("CheckIn", checkin);
+	bench_pack("60-key job", job);
+	bench_pack("SubmitJob x 1000", submit);
+
+	launch_data_free(checkin);
+	launch_data_free(job);
+	launch_data_free(submit);
+};
+/*****************************************************/
@@ -0,0 +1,605 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "liblaunch_test.h"
+#include "launch_priv.h"
+#include "launch_internal.h"
+
+#if __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+
+/* Seed inputs for the mutation test below and for an external fuzzer. The
+ * test binary is run both from the top of the tree and from here.
+ */
+static const char *plist_corpus_dirs[] = {
+	"plist_corpus",
+	"liblaunch/test/plist_corpus",
+};
+
+struct plist_corpus_file {
+	char name[256];
+	char *buf;
+	size_t len;
+};
+
+static size_t
+plist_corpus_load(struct plist_corpus_file *files, size_t max)
+{
+	char path[1024];
+	struct dirent *de;
+	size_t i, n = 0;
+	FILE *f;
+	DIR *d = NULL;
+
+	for (i = 0; i < sizeof(plist_corpus_dirs) / sizeof(plist_corpus_dirs[0]) && !d; i++) {
+		d = opendir(plist_corpus_dirs[i]);
+	}
+	assert_false(NULL == d);
+	i--;
+
+	while ((de = readdir(d)) && n < max) {
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", plist_corpus_dirs[i], de->d_name);
+		assert_false(NULL == (f = fopen(path, "r")));
+		fseek(f, 0, SEEK_END);
+		files[n].len = (size_t)ftell(f);
+		fseek(f, 0, SEEK_SET);
+		files[n].buf = malloc(files[n].len + 1);
+		assert_int_equal(files[n].len, fread(files[n].buf, 1, files[n].len, f));
+		fclose(f);
+		snprintf(files[n].name, sizeof(files[n].name), "%s", de->d_name);
+		n++;
+	}
+	closedir(d);
+
+	return n;
+}
+
+static void
+plist_corpus_free(struct plist_corpus_file *files, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		free(files[i].buf);
+	}
+}
+
+/* Dictionaries compare by key, since XML and binary writers need not agree on
+ * an order.
+ */
+static bool
+plist_equal(launch_data_t a, launch_data_t b)
+{
+	size_t i;
+
+	if (launch_data_get_type(a) != launch_data_get_type(b)) {
+		return false;
+	}
+
+	switch (launch_data_get_type(a)) {
+	case LAUNCH_DATA_DICTIONARY:
+		if (launch_data_dict_get_count(a) != launch_data_dict_get_count(b)) {
+			return false;
+		}
+		for (i = 0; i < a->_array_cnt; i += 2) {
+			launch_data_t o = launch_data_dict_lookup(b, a->_array[i]->string);
+			if (!o || !plist_equal(a->_array[i + 1], o)) {
+				return false;
+			}
+		}
+		return true;
+	case LAUNCH_DATA_ARRAY:
+		if (a->_array_cnt != b->_array_cnt) {
+			return false;
+		}
+		for (i = 0; i < a->_array_cnt; i++) {
+			if (!plist_equal(a->_array[i], b->_array[i])) {
+				return false;
+			}
+		}
+		return true;
+	case LAUNCH_DATA_STRING:
+		return strcmp(a->string, b->string) == 0;
+	case LAUNCH_DATA_INTEGER:
+		return a->number == b->number;
+	case LAUNCH_DATA_REAL:
+		return a->float_num == b->float_num || (a->float_num != a->float_num && b->float_num != b->float_num);
+	case LAUNCH_DATA_BOOL:
+		return a->boolean == b->boolean;
+	case LAUNCH_DATA_OPAQUE:
+		return a->opaque_size == b->opaque_size && memcmp(a->opaque, b->opaque, a->opaque_size) == 0;
+	default:
+		return false;
+	}
+}
+
+static launch_data_t
+parse_string(const char *s)
+{
+	return launch_data_plist_parse(s, strlen(s));
+}
+
+/*
+ * TESTING: XML
+ *****************************************************/
+void test_plist_parse_xml(void **s) {
+	const char *xml =
+		"\xef\xbb\xbf<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+		"<plist version=\"1.0\">\n"
+		"<!-- comment -->\n"
+		"<dict>\n"
+		"\t<key>Label</key>\n"
+		"\t<string>com.example.<![CDATA[<xml>]]></string>\n"
+		"\t<key>ProgramArguments</key>\n"
+		"\t<array>\n"
+		"\t\t<string>/bin/echo</string>\n"
+		"\t\t<string>&lt;&amp;&gt;&#x263A;&#65;</string>\n"
+		"\t\t<date>2014-05-28T12:00:00Z</date>\n"
+		"\t</array>\n"
+		"\t<key>Nice</key>\n"
+		"\t<integer> -5 </integer>\n"
+		"\t<key>Mask</key>\n"
+		"\t<integer>0x1F</integer>\n"
+		"\t<key>Ratio</key>\n"
+		"\t<real>0.25</real>\n"
+		"\t<key>RunAtLoad</key>\n"
+		"\t<true/>\n"
+		"\t<key>Disabled</key>\n"
+		"\t<false></false>\n"
+		"\t<key>Blob</key>\n"
+		"\t<data>\n\tbGF1bmNo\n\tZA==\n\t</data>\n"
+		"\t<key>Dropped</key>\n"
+		"\t<date>2014-05-28T12:00:00Z</date>\n"
+		"\t<key>Empty</key>\n"
+		"\t<dict/>\n"
+		"</dict>\n"
+		"</plist>\n";
+	launch_data_t d = parse_string(xml), o;
+
+	assert_false(NULL == d);
+	assert_int_equal(LAUNCH_DATA_DICTIONARY, launch_data_get_type(d));
+	assert_int_equal(9, launch_data_dict_get_count(d));
+	assert_string_equal("com.example.<xml>", launch_data_get_string(launch_data_dict_lookup(d, LAUNCH_JOBKEY_LABEL)));
+
+	o = launch_data_dict_lookup(d, LAUNCH_JOBKEY_PROGRAMARGUMENTS);
+	assert_int_equal(2, launch_data_array_get_count(o));
+	assert_string_equal("<&>\xe2\x98\xba" "A", launch_data_get_string(launch_data_array_get_index(o, 1)));
+
+	assert_int_equal(-5, launch_data_get_integer(launch_data_dict_lookup(d, LAUNCH_JOBKEY_NICE)));
+	assert_int_equal(31, launch_data_get_integer(launch_data_dict_lookup(d, "Mask")));
+	assert_true(0.25 == launch_data_get_real(launch_data_dict_lookup(d, "Ratio")));
+	assert_true(launch_data_get_bool(launch_data_dict_lookup(d, LAUNCH_JOBKEY_RUNATLOAD)));
+	assert_false(launch_data_get_bool(launch_data_dict_lookup(d, LAUNCH_JOBKEY_DISABLED)));
+	o = launch_data_dict_lookup(d, "Blob");
+	assert_int_equal(7, launch_data_get_opaque_size(o));
+	assert_memory_equal("launchd", launch_data_get_opaque(o), 7);
+	assert_true(NULL == launch_data_dict_lookup(d, "Dropped"));
+	assert_int_equal(0, launch_data_dict_get_count(launch_data_dict_lookup(d, "Empty")));
+
+	launch_data_free(d);
+};
+
+/* Later duplicates win, and keys match case-insensitively as they do in any
+ * other launch_data dictionary.
+ */
+void test_plist_parse_xml_duplicates(void **s) {
+	launch_data_t d = parse_string("<plist><dict><key>A</key><integer>1</integer><key>a</key><integer>2</integer></dict></plist>");
+
+	assert_false(NULL == d);
+	assert_int_equal(1, launch_data_dict_get_count(d));
+	assert_int_equal(2, launch_data_get_integer(launch_data_dict_lookup(d, "A")));
+	launch_data_free(d);
+};
+
+void test_plist_parse_malformed(void **s) {
+	const char *bad[] = {
+		"",
+		"   ",
+		"<plist></plist>",
+		"<plist><dict></plist>",
+		"<plist><dict><key>A</key></dict></plist>",
+		"<plist><dict><string>A</string></dict></plist>",
+		"<plist><dict><key>A</key><key>B</key></dict></plist>",
+		"<plist><array><key>A</key></array></plist>",
+		"<plist><string>a</string><string>b</string></plist>",
+		"<plist><string>a<b/></string></plist>",
+		"<plist><integer>12x</integer></plist>",
+		"<plist><integer>--1</integer></plist>",
+		"<plist><integer>99999999999999999999</integer></plist>",
+		"<plist><real>one</real></plist>",
+		"<plist><true>yes</true></plist>",
+		"<plist><data>!!!!</data></plist>",
+		"<plist><string>&bogus;</string></plist>",
+		"<plist><string>&#0;</string></plist>",
+		"<plist><string>&#xD800;</string></plist>",
+		"<plist><dict>junk</dict></plist>",
+		"<plist><widget/></plist>",
+		"<plist><array></dict></plist>",
+		"<plist><string>unterminated",
+		"<plist><!-- unterminated",
+		"<plist><string>a</string></plist>trailing",
+		"</plist>",
+		"<>",
+	};
+	launch_data_t d;
+	size_t i;
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		errno = 0;
+		d = parse_string(bad[i]);
+		if (d) {
+			fprintf(stderr, "accepted: %s\n", bad[i]);
+		}
+		assert_true(NULL == d);
+		assert_int_equal(EINVAL, errno);
+	}
+};
+
+/* Nesting past the parser's limit fails instead of exhausting the stack. */
+void test_plist_parse_deep(void **s) {
+	size_t i, n = 100000;
+	char *xml = malloc(n * 15 + 1), *p = xml;
+
+	for (i = 0; i < n; i++) {
+		memcpy(p, "<array>", 7);
+		p += 7;
+	}
+	for (i = 0; i < n; i++) {
+		memcpy(p, "</array>", 8);
+		p += 8;
+	}
+	*p = '\0';
+
+	errno = 0;
+	assert_true(NULL == launch_data_plist_parse(xml, (size_t)(p - xml)));
+	assert_int_equal(EINVAL, errno);
+	free(xml);
+};
+
+/*
+ * TESTING: binary
+ *****************************************************/
+/* {Label: "com.example.bin", Args: ["a", "été"], Port: 8080, Ratio: 0.25,
+ *  On: true, Blob: <0102>}, as written by Python's plistlib.
+ */
+static const uint8_t plist_test_bplist[] = {
+	0x62, 0x70, 0x6c, 0x69, 0x73, 0x74, 0x30, 0x30, 0xd6, 0x01, 0x02, 0x03,
+	0x04, 0x05, 0x06, 0x07, 0x08, 0x0b, 0x0c, 0x0d, 0x0e, 0x55, 0x4c, 0x61,
+	0x62, 0x65, 0x6c, 0x54, 0x41, 0x72, 0x67, 0x73, 0x54, 0x50, 0x6f, 0x72,
+	0x74, 0x55, 0x52, 0x61, 0x74, 0x69, 0x6f, 0x52, 0x4f, 0x6e, 0x54, 0x42,
+	0x6c, 0x6f, 0x62, 0x5f, 0x10, 0x0f, 0x63, 0x6f, 0x6d, 0x2e, 0x65, 0x78,
+	0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x62, 0x69, 0x6e, 0xa2, 0x09, 0x0a,
+	0x51, 0x61, 0x63, 0x00, 0xe9, 0x00, 0x74, 0x00, 0xe9, 0x11, 0x1f, 0x90,
+	0x23, 0x3f, 0xd0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09, 0x42, 0x01,
+	0x02, 0x08, 0x15, 0x1b, 0x20, 0x25, 0x2b, 0x2e, 0x33, 0x45, 0x48, 0x4a,
+	0x51, 0x54, 0x5d, 0x5e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x61,
+};
+
+void test_plist_parse_binary(void **s) {
+	launch_data_t d = launch_data_plist_parse(plist_test_bplist, sizeof(plist_test_bplist)), o;
+
+	assert_false(NULL == d);
+	assert_int_equal(6, launch_data_dict_get_count(d));
+	assert_string_equal("com.example.bin", launch_data_get_string(launch_data_dict_lookup(d, LAUNCH_JOBKEY_LABEL)));
+	o = launch_data_dict_lookup(d, "Args");
+	assert_int_equal(2, launch_data_array_get_count(o));
+	assert_string_equal("\xc3\xa9t\xc3\xa9", launch_data_get_string(launch_data_array_get_index(o, 1)));
+	assert_int_equal(8080, launch_data_get_integer(launch_data_dict_lookup(d, "Port")));
+	assert_true(0.25 == launch_data_get_real(launch_data_dict_lookup(d, "Ratio")));
+	assert_true(launch_data_get_bool(launch_data_dict_lookup(d, "On")));
+	assert_int_equal(2, launch_data_get_opaque_size(launch_data_dict_lookup(d, "Blob")));
+
+	launch_data_free(d);
+};
+
+void test_plist_parse_binary_malformed(void **s) {
+	uint8_t buf[sizeof(plist_test_bplist)];
+	uint8_t dag[8 + 60 * 3 + 1 + 61 + 32];
+	size_t i, off, table;
+
+	/* Every truncation loses the trailer. */
+	for (i = 0; i < sizeof(plist_test_bplist); i++) {
+		errno = 0;
+		assert_true(NULL == launch_data_plist_parse(plist_test_bplist, i));
+		assert_int_equal(EINVAL, errno);
+	}
+
+	/* An array that contains itself. */
+	memcpy(buf, plist_test_bplist, sizeof(buf));
+	buf[0x45] = 0xa1;
+	buf[0x46] = 0x08;
+	errno = 0;
+	assert_true(NULL == launch_data_plist_parse(buf, sizeof(buf)));
+	assert_int_equal(EINVAL, errno);
+
+	/* An offset table that runs into the trailer. */
+	memcpy(buf, plist_test_bplist, sizeof(buf));
+	buf[sizeof(buf) - 17] = 0x20;
+	errno = 0;
+	assert_true(NULL == launch_data_plist_parse(buf, sizeof(buf)));
+	assert_int_equal(EINVAL, errno);
+
+	/* A dictionary key that is not a string. */
+	memcpy(buf, plist_test_bplist, sizeof(buf));
+	buf[0x09] = 0x0b;
+	errno = 0;
+	assert_true(NULL == launch_data_plist_parse(buf, sizeof(buf)));
+	assert_int_equal(EINVAL, errno);
+
+	/* Arrays that each hold the next one twice: 2^60 objects from a file of
+	 * a few hundred bytes.
+	 */
+	memset(dag, 0, sizeof(dag));
+	memcpy(dag, "bplist00", 8);
+	for (i = 0, off = 8; i < 60; i++) {
+		dag[off++] = 0xa2;
+		dag[off++] = (uint8_t)(i + 1);
+		dag[off++] = (uint8_t)(i + 1);
+	}
+	dag[off++] = 0x09;
+	table = off;
+	for (i = 0; i <= 60; i++) {
+		dag[off++] = (uint8_t)(8 + i * 3);
+	}
+	dag[off + 6] = 1;	/* offset size */
+	dag[off + 7] = 1;	/* reference size */
+	dag[off + 15] = 61;	/* objects */
+	dag[off + 31] = (uint8_t)table;
+	errno = 0;
+	assert_true(NULL == launch_data_plist_parse(dag, sizeof(dag)));
+	assert_int_equal(EINVAL, errno);
+};
+
+/*
+ * TESTING: corpus
+ *****************************************************/
+/* Each binary seed parses to the same tree as its XML twin, and every seed
+ * survives being written back out as XML and parsed again.
+ */
+void test_plist_corpus_roundtrip(void **s) {
+	struct plist_corpus_file files[64];
+	size_t i, j, n = plist_corpus_load(files, 64), len, pairs = 0;
+	launch_data_t d, d2;
+	char *xml;
+
+	assert_true(n > 0);
+	for (i = 0; i < n; i++) {
+		d = launch_data_plist_parse(files[i].buf, files[i].len);
+		if (!d) {
+			fprintf(stderr, "failed to parse: %s\n", files[i].name);
+		}
+		assert_false(NULL == d);
+
+		assert_false(NULL == (xml = launch_data_plist_xml(d, &len)));
+		assert_int_equal(len, strlen(xml));
+		assert_false(NULL == (d2 = launch_data_plist_parse(xml, len)));
+		assert_true(plist_equal(d, d2));
+		launch_data_free(d2);
+		free(xml);
+
+		for (j = 0; j < n; j++) {
+			size_t stem = strlen(files[i].name) - strlen(".plist");
+			if (strcmp(files[i].name + stem, ".plist") == 0 && strncmp(files[i].name, files[j].name, stem) == 0 && strcmp(files[j].name + stem, ".bplist") == 0) {
+				assert_false(NULL == (d2 = launch_data_plist_parse(files[j].buf, files[j].len)));
+				assert_true(plist_equal(d, d2));
+				launch_data_free(d2);
+				pairs++;
+			}
+		}
+		launch_data_free(d);
+	}
+	assert_true(pairs > 0);
+
+	plist_corpus_free(files, n);
+};
+
+static uint32_t
+plist_fuzz_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* A small deterministic mutation pass over the corpus: truncations, byte
+ * flips and spliced-in markup. The parser may reject any of it, but it must
+ * never read out of bounds or leak, which the sanitizers check when enabled.
+ */
+void test_plist_fuzz_corpus(void **s) {
+	static const char *splices[] = { "<", "</dict>", "<array>", "&", "]]>", "\xff", "\x0f", "\xdf" };
+	struct plist_corpus_file files[64];
+	size_t i, j, n = plist_corpus_load(files, 64);
+	uint32_t seed = 0x6c61756e;
+	launch_data_t d;
+	char *buf;
+
+	for (i = 0; i < n; i++) {
+		buf = malloc(files[i].len + 16);
+
+		for (j = 0; j < files[i].len; j += 7) {
+			memcpy(buf, files[i].buf, j);
+			if ((d = launch_data_plist_parse(buf, j))) {
+				launch_data_free(d);
+			}
+		}
+
+		for (j = 0; j < 2000; j++) {
+			size_t k, at, flips = 1 + plist_fuzz_rand(&seed) % 4, len = files[i].len;
+
+			memcpy(buf, files[i].buf, len);
+			for (k = 0; k < flips; k++) {
+				at = plist_fuzz_rand(&seed) % len;
+				if (plist_fuzz_rand(&seed) & 1) {
+					buf[at] = (char)plist_fuzz_rand(&seed);
+				} else {
+					const char *sp = splices[plist_fuzz_rand(&seed) % (sizeof(splices) / sizeof(splices[0]))];
+					memcpy(buf + at, sp, strlen(sp) > len - at ? len - at : strlen(sp));
+				}
+			}
+			if ((d = launch_data_plist_parse(buf, len))) {
+				launch_data_free(d);
+			}
+		}
+
+		free(buf);
+	}
+
+	plist_corpus_free(files, n);
+};
+
+void test_plist_write_file(void **s) {
+	char path[] = "/tmp/liblaunch_plist_test.XXXXXX";
+	launch_data_t d = launch_data_plist_parse(plist_test_bplist, sizeof(plist_test_bplist)), d2;
+	int fd = mkstemp(path);
+
+	assert_true(fd != -1);
+	close(fd);
+	assert_int_equal(0, launch_data_plist_write_file(d, path));
+	assert_false(NULL == (d2 = launch_data_plist_read_file(path)));
+	assert_true(plist_equal(d, d2));
+	unlink(path);
+
+	errno = 0;
+	assert_true(NULL == launch_data_plist_read_file(path));
+	assert_int_equal(ENOENT, errno);
+
+	launch_data_free(d);
+	launch_data_free(d2);
+};
+
+/*
+ * BENCHMARK: parse throughput
+ *****************************************************/
+#if __APPLE__
+/* What launchctl does today: a CF tree first, then a launch_data copy. */
+static launch_data_t
+bench_cf2launch_data(CFTypeRef cfr)
+{
+	launch_data_t r = NULL;
+	CFTypeID cft = CFGetTypeID(cfr);
+
+	if (cft == CFStringGetTypeID()) {
+		char buf[4096];
+		CFStringGetCString(cfr, buf, sizeof(buf), kCFStringEncodingUTF8);
+		r = launch_data_new_string(buf);
+	} else if (cft == CFBooleanGetTypeID()) {
+		r = launch_data_new_bool(CFBooleanGetValue(cfr));
+	} else if (cft == CFNumberGetTypeID()) {
+		long long n;
+		CFNumberGetValue(cfr, kCFNumberLongLongType, &n);
+		r = launch_data_new_integer(n);
+	} else if (cft == CFArrayGetTypeID()) {
+		CFIndex i, c = CFArrayGetCount(cfr);
+		r = launch_data_alloc(LAUNCH_DATA_ARRAY);
+		for (i = 0; i < c; i++) {
+			launch_data_array_set_index(r, bench_cf2launch_data(CFArrayGetValueAtIndex(cfr, i)), i);
+		}
+	} else if (cft == CFDictionaryGetTypeID()) {
+		CFIndex i, c = CFDictionaryGetCount(cfr);
+		const void **keys = malloc(c * sizeof(void *)), **vals = malloc(c * sizeof(void *));
+		char key[1024];
+
+		r = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+		CFDictionaryGetKeysAndValues(cfr, keys, vals);
+		for (i = 0; i < c; i++) {
+			CFStringGetCString(keys[i], key, sizeof(key), kCFStringEncodingUTF8);
+			launch_data_dict_insert(r, bench_cf2launch_data(vals[i]), key);
+		}
+		free(keys);
+		free(vals);
+	} else {
+		r = launch_data_new_bool(false);
+	}
+
+	return r;
+}
+
+static launch_data_t
+bench_parse_cf(const void *buf, size_t len)
+{
+	CFDataRef data = CFDataCreateWithBytesNoCopy(NULL, buf, len, kCFAllocatorNull);
+	CFPropertyListRef plist = CFPropertyListCreateWithData(NULL, data, kCFPropertyListMutableContainersAndLeaves, NULL, NULL);
+	launch_data_t r = bench_cf2launch_data(plist);
+
+	CFRelease(plist);
+	CFRelease(data);
+	return r;
+}
+#endif
+
+static void
+bench_parse(const char *name, launch_data_t (*parse)(const void *, size_t), struct plist_corpus_file *files, size_t n)
+{
+	struct timespec start, end;
+	size_t i, j, bytes = 0, iterations = 200;
+	double secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < n; i++) {
+			launch_data_t d = parse(files[i].buf, files[i].len);
+			assert_false(NULL == d);
+			launch_data_free(d);
+			bytes += files[i].len;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%-24s %9zu bytes, %8.1f MB/s, %8.1f us/file\n",
+		name, bytes / iterations, bytes / secs / 1e6, secs * 1e6 / (iterations * n));
+}
+
+void bench_plist_parse(void **s) {
+	struct plist_corpus_file files[64], xml[64], bin[64];
+	size_t i, n = plist_corpus_load(files, 64), nxml = 0, nbin = 0;
+
+	for (i = 0; i < n; i++) {
+		if (memcmp(files[i].buf, "bplist00", files[i].len < 8 ? files[i].len : 8) == 0) {
+			bin[nbin++] = files[i];
+		} else {
+			xml[nxml++] = files[i];
+		}
+	}
+
+	bench_parse("native XML", launch_data_plist_parse, xml, nxml);
+	bench_parse("native binary", launch_data_plist_parse, bin, nbin);
+#if __APPLE__
+	bench_parse("CoreFoundation XML", bench_parse_cf, xml, nxml);
+	bench_parse("CoreFoundation binary", bench_parse_cf, bin, nbin);
+#endif
+
+	plist_corpus_free(files, n);
+}
@@ -0,0 +1 @@
+../../launchd/spawn.c
\ No newline at end of file
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "liblaunch_test.h"
+#include "spawn.h"
+
+#define SPAWN_BENCH_RUNS 200
+
+extern char **environ;
+
+static int
+spawn_tests_wait(pid_t p)
+{
+	int status;
+
+	assert_true(p > 0);
+	assert_int_equal(p, waitpid(p, &status, 0));
+	return status;
+}
+
+/* Runs 'script' with /bin/sh and returns what it wrote to stdout. */
+static char *
+spawn_tests_run(struct spawn_plan *sp, const char *script, struct spawn_result *sr, int *status)
+{
+	char out[] = "/tmp/spawn_tests.XXXXXX";
+	char *const argv[] = { "sh", "-c", (char *)script, NULL };
+	static char buf[4096];
+	ssize_t n;
+	int fd;
+
+	assert_true((fd = mkstemp(out)) != -1);
+	// Writable by whoever the child ends up running as.
+	assert_int_equal(0, fchmod(fd, 0666));
+
+	sp->sp_path = "/bin/sh";
+	sp->sp_argv = argv;
+	sp->sp_stdio_path[STDOUT_FILENO] = out;
+	sp->sp_stdio_flags[STDOUT_FILENO] = O_WRONLY|O_CREAT|O_APPEND;
+
+	*status = spawn_tests_wait(spawn_plan_exec(sp, sr));
+
+	n = read(fd, buf, sizeof(buf) - 1);
+	assert_true(n >= 0);
+	buf[n] = '\0';
+	close(fd);
+	unlink(out);
+
+	return buf;
+}
+
+void test_spawn_env(void **s) {
+	char *envp[] = { "A=1", "B=2", NULL };
+	char *empty[] = { NULL };
+	struct spawn_env se;
+
+	spawn_env_init(&se);
+	assert_int_equal(0, spawn_env_copy(&se, envp));
+	assert_int_equal(2, se.se_envc);
+
+	assert_int_equal(0, spawn_env_set(&se, "A", "one", false));
+	assert_string_equal("1", spawn_env_get(&se, "A"));
+	assert_int_equal(0, spawn_env_set(&se, "A", "one", true));
+	assert_string_equal("one", spawn_env_get(&se, "A"));
+	assert_int_equal(0, spawn_env_set(&se, "AB", "3", false));
+	assert_string_equal("3", spawn_env_get(&se, "AB"));
+	assert_string_equal("one", spawn_env_get(&se, "A"));
+	assert_true(spawn_env_get(&se, "C") == NULL);
+
+	assert_int_equal(-1, spawn_env_set(&se, "X=Y", "z", true));
+	assert_int_equal(EINVAL, errno);
+	assert_int_equal(-1, spawn_env_set(&se, "", "z", true));
+
+	assert_int_equal(3, se.se_envc);
+	assert_true(se.se_envp[3] == NULL);
+
+	spawn_env_destroy(&se);
+	assert_true(se.se_envp == NULL);
+
+	/* An empty environment is still one a program can be started with. */
+	assert_int_equal(0, spawn_env_copy(&se, empty));
+	assert_true(se.se_envp != NULL);
+	assert_true(se.se_envp[0] == NULL);
+	spawn_env_destroy(&se);
+}
+
+void test_spawn_plan_exec(void **s) {
+	struct spawn_rlimit rl = { RLIMIT_NOFILE, false, true, { 64, 0 } };
+	struct spawn_result sr;
+	struct spawn_plan sp;
+	struct spawn_env se;
+	const char *out;
+	int status;
+
+	spawn_plan_init(&sp);
+	spawn_env_init(&se);
+	assert_int_equal(0, spawn_env_set(&se, "SPAWN_TEST", "hello", true));
+	sp.sp_envp = se.se_envp;
+	sp.sp_workingdir = "/";
+	sp.sp_setmask = true;
+	sp.sp_mask = 027;
+	sp.sp_limits = &rl;
+	sp.sp_nlimits = 1;
+
+	out = spawn_tests_run(&sp, "echo $SPAWN_TEST; pwd; umask; ulimit -n; "
+		"test $(ps -o pgid= -p $$) -eq $$ && echo leader; exit 3",
+		&sr, &status);
+	assert_true(sr.sr_execed);
+	assert_int_equal(0, sr.sr_nreports);
+	assert_true(WIFEXITED(status));
+	assert_int_equal(3, WEXITSTATUS(status));
+	assert_string_equal("hello\n/\n0027\n64\nleader\n", out);
+
+	/* The same environment serves any number of starts. */
+	out = spawn_tests_run(&sp, "echo $SPAWN_TEST", &sr, &status);
+	assert_true(sr.sr_execed);
+	assert_string_equal("hello\n", out);
+
+	spawn_env_destroy(&se);
+}
+
+void test_spawn_plan_search(void **s) {
+	char *const argv[] = { "sh", "-c", "exit 5", NULL };
+	struct spawn_result sr;
+	struct spawn_plan sp;
+	struct spawn_env se;
+	int status;
+
+	spawn_plan_init(&sp);
+	sp.sp_path = "sh";
+	sp.sp_argv = argv;
+	sp.sp_search = true;
+
+	spawn_env_init(&se);
+	assert_int_equal(0, spawn_env_set(&se, "PATH", "/nonexistent::/bin", true));
+	sp.sp_envp = se.se_envp;
+	status = spawn_tests_wait(spawn_plan_exec(&sp, &sr));
+	assert_true(sr.sr_execed);
+	assert_int_equal(5, WEXITSTATUS(status));
+
+	/* Without a '/' and without searching, "sh" is only the current directory. */
+	sp.sp_search = false;
+	status = spawn_tests_wait(spawn_plan_exec(&sp, &sr));
+	assert_false(sr.sr_execed);
+	assert_int_equal(ENOENT, WEXITSTATUS(status));
+
+	spawn_env_destroy(&se);
+}
+
+void test_spawn_plan_failures(void **s) {
+	char *const argv[] = { "nothing", NULL };
+	struct spawn_result sr;
+	struct spawn_plan sp;
+	const char *out;
+	pid_t child;
+	int status;
+
+	spawn_plan_init(&sp);
+	sp.sp_path = "/nonexistent/nothing";
+	sp.sp_argv = argv;
+	sp.sp_envp = environ;
+	sp.sp_workingdir = "/nonexistent";
+	sp.sp_stdio_path[STDERR_FILENO] = "/nonexistent/log";
+	sp.sp_stdio_flags[STDERR_FILENO] = O_WRONLY|O_CREAT|O_APPEND;
+
+	status = spawn_tests_wait(spawn_plan_exec(&sp, &sr));
+	assert_false(sr.sr_execed);
+	assert_int_equal(ENOENT, WEXITSTATUS(status));
+	assert_int_equal(3, sr.sr_nreports);
+	assert_int_equal(SPAWN_STEP_CHDIR, sr.sr_reports[0].sr_step);
+	assert_int_equal(ENOENT, sr.sr_reports[0].sr_errno);
+	assert_int_equal(SPAWN_STEP_OPEN, sr.sr_reports[1].sr_step);
+	assert_int_equal(STDERR_FILENO, sr.sr_reports[1].sr_arg);
+	assert_int_equal(SPAWN_STEP_EXEC, sr.sr_reports[2].sr_step);
+
+	/* The same non-fatal failures still end in an exec. */
+	out = spawn_tests_run(&sp, "echo ran", &sr, &status);
+	assert_true(sr.sr_execed);
+	assert_int_equal(2, sr.sr_nreports);
+	assert_string_equal("ran\n", out);
+
+	/* With launchd's own stdio closed, the report pipe must not land on a
+	 * descriptor that the child replaces.
+	 */
+	sp.sp_path = "/nonexistent/nothing";
+	sp.sp_argv = argv;
+	sp.sp_workingdir = NULL;
+	sp.sp_stdio_path[STDERR_FILENO] = NULL;
+	sp.sp_stdio_path[STDOUT_FILENO] = "/dev/null";
+	sp.sp_stdio_flags[STDOUT_FILENO] = O_WRONLY;
+	fflush(stdout);
+	if ((child = fork()) == 0) {
+		(void)close(STDIN_FILENO);
+		(void)close(STDOUT_FILENO);
+		(void)close(STDERR_FILENO);
+		(void)waitpid(spawn_plan_exec(&sp, &sr), NULL, 0);
+		_exit(!sr.sr_execed && sr.sr_nreports == 1 && sr.sr_reports[0].sr_step == SPAWN_STEP_EXEC ? 0 : 1);
+	}
+	status = spawn_tests_wait(child);
+	assert_true(WIFEXITED(status));
+	assert_int_equal(0, WEXITSTATUS(status));
+	sp.sp_stdio_path[STDOUT_FILENO] = NULL;
+
+	sp.sp_setuser = true;
+	if (getuid() == 0) {
+		static const gid_t groups[] = { 65533 };
+
+		sp.sp_uid = 65534;
+		sp.sp_gid = 65534;
+		sp.sp_groups = groups;
+		sp.sp_ngroups = 1;
+		out = spawn_tests_run(&sp, "id -u; id -g; id -G", &sr, &status);
+		assert_true(sr.sr_execed);
+		assert_int_equal(0, sr.sr_nreports);
+		assert_string_equal("65534\n65534\n65534 65533\n", out);
+		assert_int_equal(0, getuid());
+	} else {
+		/* Only root may change credentials; the child must not exec. */
+		sp.sp_uid = 0;
+		sp.sp_gid = 0;
+		out = spawn_tests_run(&sp, "echo ran", &sr, &status);
+		assert_false(sr.sr_execed);
+		assert_int_equal(1, sr.sr_nreports);
+		assert_int_equal(SPAWN_STEP_SETGID, sr.sr_reports[0].sr_step);
+		assert_string_equal("", out);
+	}
+}
+
+/* How launchd started jobs before spawn plans: fork(), then exec. */
+static pid_t
+spawn_bench_fork(char *const *argv, char **envp)
+{
+	pid_t p;
+
+	if ((p = fork()) == 0) {
+		execve(argv[0], argv, envp);
+		_exit(errno);
+	}
+	return p;
+}
+
+void bench_spawn_rss(void **s) {
+	static const size_t sizes[] = { 0, 100, 1024 };
+	char *const argv[] = { "/usr/bin/true", NULL };
+	char *envp[] = { NULL };
+	struct spawn_result sr;
+	struct spawn_plan sp;
+	struct timespec start, end;
+	size_t i, j, len;
+	double fork_us, spawn_us;
+	char *rss;
+
+	spawn_plan_init(&sp);
+	sp.sp_path = argv[0];
+	sp.sp_argv = argv;
+	sp.sp_envp = envp;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		/* Stand-in for a launchd that has grown: resident, dirty pages. */
+		len = sizes[i] << 20;
+		rss = NULL;
+		if (len) {
+			rss = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+			if (rss == MAP_FAILED) {
+				printf("%5zu MB resident: not enough memory, skipped\n", sizes[i]);
+				continue;
+			}
+			memset(rss, 0xa5, len);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < SPAWN_BENCH_RUNS; j++) {
+			spawn_tests_wait(spawn_bench_fork(argv, envp));
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		fork_us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / SPAWN_BENCH_RUNS;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < SPAWN_BENCH_RUNS; j++) {
+			spawn_tests_wait(spawn_plan_exec(&sp, &sr));
+			assert_true(sr.sr_execed);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		spawn_us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / SPAWN_BENCH_RUNS;
+
+		printf("%5zu MB resident: fork+exec %9.1f us/spawn, spawn plan %9.1f us/spawn\n",
+			sizes[i], fork_us, spawn_us);
+
+		if (rss) {
+			munmap(rss, len);
+		}
+	}
+}
@@ -0,0 +1 @@
+../../launchd/timerq.c
\ No newline at end of file
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2013 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdint.h>
+
+#include "liblaunch_test.h"
+#include "timerq.h"
+
+#define TIMERQ_TEST_CNT 1000
+
+/* Expired entries come out in deadline order regardless of insertion order. */
+void test_timerq_ordering(void **s) {
+	struct timerq tq;
+	struct timerq_entry *te, *entries = calloc(TIMERQ_TEST_CNT, sizeof(*entries));
+	uint64_t last = 0, n;
+	size_t i, fired = 0;
+
+	timerq_init(&tq);
+	for (i = 0; i < TIMERQ_TEST_CNT; i++) {
+		timerq_entry_init(&entries[i]);
+		/* A fixed permutation of 1..TIMERQ_TEST_CNT. */
+		assert_int_equal(0, timerq_arm(&tq, &entries[i], TIMERQ_CLOCK_MONOTONIC, (i * 7919) % TIMERQ_TEST_CNT + 1, 0));
+	}
+	assert_int_equal(TIMERQ_TEST_CNT, timerq_count(&tq));
+	assert_true(timerq_next(&tq, 0, 0) == 1);
+
+	assert_true(timerq_pop_expired(&tq, 0, 0, &n) == NULL);
+	while ((te = timerq_pop_expired(&tq, TIMERQ_TEST_CNT, 0, &n))) {
+		assert_true(te->te_deadline > last);
+		assert_false(timerq_entry_armed(te));
+		assert_int_equal(1, n);
+		last = te->te_deadline;
+		fired++;
+	}
+	assert_int_equal(TIMERQ_TEST_CNT, fired);
+	assert_true(timerq_next(&tq, 0, 0) == UINT64_MAX);
+
+	timerq_destroy(&tq);
+	free(entries);
+}
+
+/* Cancelled and re-armed entries never fire at their old deadline. */
+void test_timerq_cancel(void **s) {
+	struct timerq tq;
+	struct timerq_entry a, b, c;
+	uint64_t n;
+
+	timerq_init(&tq);
+	timerq_entry_init(&a);
+	timerq_entry_init(&b);
+	timerq_entry_init(&c);
+
+	assert_int_equal(0, timerq_arm(&tq, &a, TIMERQ_CLOCK_MONOTONIC, 10, 0));
+	assert_int_equal(0, timerq_arm(&tq, &b, TIMERQ_CLOCK_MONOTONIC, 20, 0));
+	assert_int_equal(0, timerq_arm(&tq, &c, TIMERQ_CLOCK_MONOTONIC, 30, 0));
+
+	timerq_cancel(&tq, &a);
+	assert_false(timerq_entry_armed(&a));
+	/* Cancelling twice is harmless. */
+	timerq_cancel(&tq, &a);
+	assert_int_equal(2, timerq_count(&tq));
+
+	/* Moving c ahead of b. */
+	assert_int_equal(0, timerq_arm(&tq, &c, TIMERQ_CLOCK_MONOTONIC, 15, 0));
+	assert_int_equal(2, timerq_count(&tq));
+	assert_true(timerq_next(&tq, 0, 0) == 15);
+
+	assert_true(timerq_pop_expired(&tq, 25, 0, &n) == &c);
+	assert_true(timerq_pop_expired(&tq, 25, 0, &n) == &b);
+	assert_true(timerq_pop_expired(&tq, 25, 0, &n) == NULL);
+
+	timerq_destroy(&tq);
+}
+
+/* Periodic entries stay queued and report the periods they missed. */
+void test_timerq_periodic(void **s) {
+	struct timerq tq;
+	struct timerq_entry a;
+	uint64_t n;
+
+	timerq_init(&tq);
+	timerq_entry_init(&a);
+
+	assert_int_equal(0, timerq_arm(&tq, &a, TIMERQ_CLOCK_MONOTONIC, 100, 100));
+	assert_true(timerq_pop_expired(&tq, 100, 0, &n) == &a);
+	assert_int_equal(1, n);
+	assert_true(timerq_entry_armed(&a));
+	assert_true(a.te_deadline == 200);
+
+	assert_true(timerq_pop_expired(&tq, 550, 0, &n) == &a);
+	assert_int_equal(4, n);
+	assert_true(a.te_deadline == 600);
+	assert_true(timerq_pop_expired(&tq, 550, 0, &n) == NULL);
+
+	timerq_destroy(&tq);
+}
+
+/* Wall deadlines follow the wall clock; monotonic ones ignore it. */
+void test_timerq_wall_clock_jump(void **s) {
+	struct timerq tq;
+	struct timerq_entry cal, throttle;
+	uint64_t n, mono = 1000, wall = 5000;
+
+	timerq_init(&tq);
+	timerq_entry_init(&cal);
+	timerq_entry_init(&throttle);
+
+	assert_int_equal(0, timerq_arm(&tq, &cal, TIMERQ_CLOCK_WALL, wall + 3600, 0));
+	assert_int_equal(0, timerq_arm(&tq, &throttle, TIMERQ_CLOCK_MONOTONIC, mono + 10, 0));
+	assert_true(timerq_next(&tq, mono, wall) == 10);
+	assert_true(timerq_deadline(&tq, TIMERQ_CLOCK_WALL) == 8600);
+	assert_true(timerq_deadline(&tq, TIMERQ_CLOCK_MONOTONIC) == 1010);
+
+	/* The clock is set an hour forward: the calendar entry is due now, the
+	 * throttle is not.
+	 */
+	wall += 3600;
+	assert_true(timerq_next(&tq, mono, wall) == 0);
+	assert_true(timerq_pop_expired(&tq, mono, wall, &n) == &cal);
+	assert_true(timerq_pop_expired(&tq, mono, wall, &n) == NULL);
+	assert_true(timerq_deadline(&tq, TIMERQ_CLOCK_WALL) == UINT64_MAX);
+
+	/* The clock is set two hours back: a new calendar entry waits the extra
+	 * time, while the throttle still fires on schedule.
+	 */
+	assert_int_equal(0, timerq_arm(&tq, &cal, TIMERQ_CLOCK_WALL, wall + 60, 0));
+	wall -= 7200;
+	assert_true(timerq_next(&tq, mono, wall) == 10);
+	mono += 10;
+	assert_true(timerq_pop_expired(&tq, mono, wall, &n) == &throttle);
+	assert_true(timerq_pop_expired(&tq, mono, wall, &n) == NULL);
+	assert_true(timerq_next(&tq, mono, wall) == 7260);
+
+	timerq_destroy(&tq);
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "liblaunch_test.h"
+#include "vproc_transaction.h"
+
+#define VT_TEST_PAIRS 20000
+#define VT_BENCH_PAIRS (1 << 21)
+#define VT_MAX_THREADS 64
+
+/*
+ * Stands in for libvproc's transaction globals. The mutex plays the serial
+ * transaction queue and 'dirty' plays proc_set_dirty(), so the slow path
+ * here does what _vproc_transaction_begin_internal() and
+ * _vproc_transaction_end_internal() do, and can tell when a transition was
+ * seen twice or out of order.
+ */
+struct vt_state {
+	pthread_mutex_t vt_queue;
+	int64_t vt_cnt;
+	bool vt_fast;
+	bool vt_dirty;
+	bool vt_broken;
+	uint64_t vt_flips;
+	size_t vt_pairs;
+};
+
+static void
+vt_begin(struct vt_state *vt)
+{
+	if (vt->vt_fast && _vproc_transaction_fast_begin(&vt->vt_cnt)) {
+		return;
+	}
+
+	pthread_mutex_lock(&vt->vt_queue);
+	if (__sync_add_and_fetch(&vt->vt_cnt, 1) == 1) {
+		vt->vt_broken |= vt->vt_dirty;
+		vt->vt_dirty = true;
+		vt->vt_flips++;
+	}
+	pthread_mutex_unlock(&vt->vt_queue);
+}
+
+static void
+vt_end(struct vt_state *vt)
+{
+	int64_t new;
+
+	if (vt->vt_fast && _vproc_transaction_fast_end(&vt->vt_cnt)) {
+		return;
+	}
+
+	pthread_mutex_lock(&vt->vt_queue);
+	new = __sync_sub_and_fetch(&vt->vt_cnt, 1);
+	if (new == 0) {
+		vt->vt_broken |= !vt->vt_dirty;
+		vt->vt_dirty = false;
+		vt->vt_flips++;
+	}
+	vt->vt_broken |= new < 0;
+	pthread_mutex_unlock(&vt->vt_queue);
+}
+
+static void *
+vt_thread(void *arg)
+{
+	struct vt_state *vt = arg;
+	bool dirty;
+	size_t i;
+
+	for (i = 0; i < vt->vt_pairs; i++) {
+		vt_begin(vt);
+		if (i % 64 == 0) {
+			/* Whoever holds a transaction must find the process dirty. */
+			pthread_mutex_lock(&vt->vt_queue);
+			dirty = vt->vt_dirty;
+			pthread_mutex_unlock(&vt->vt_queue);
+			if (!dirty) {
+				vt->vt_broken = true;
+			}
+		}
+		vt_end(vt);
+	}
+	return NULL;
+}
+
+static void
+vt_init(struct vt_state *vt, bool fast, size_t pairs)
+{
+	pthread_mutex_init(&vt->vt_queue, NULL);
+	vt->vt_cnt = 0;
+	vt->vt_fast = fast;
+	vt->vt_dirty = false;
+	vt->vt_broken = false;
+	vt->vt_flips = 0;
+	vt->vt_pairs = pairs;
+}
+
+/* Returns the seconds 'nthreads' threads took to run their pairs. */
+static double
+vt_run(struct vt_state *vt, size_t nthreads)
+{
+	pthread_t threads[VT_MAX_THREADS];
+	struct timespec start, end;
+	size_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nthreads; i++) {
+		assert_int_equal(0, pthread_create(&threads[i], NULL, vt_thread, vt));
+	}
+	for (i = 0; i < nthreads; i++) {
+		assert_int_equal(0, pthread_join(threads[i], NULL));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void test_vproc_transaction_fast_path(void **s) {
+	int64_t cnt = 0;
+
+	/* Leaving or reaching zero is always the queue's business. */
+	assert_false(_vproc_transaction_fast_begin(&cnt));
+	assert_false(_vproc_transaction_fast_end(&cnt));
+	assert_int_equal(0, cnt);
+
+	cnt = 1;
+	assert_false(_vproc_transaction_fast_end(&cnt));
+	assert_int_equal(1, cnt);
+	assert_true(_vproc_transaction_fast_begin(&cnt));
+	assert_int_equal(2, cnt);
+	assert_true(_vproc_transaction_fast_end(&cnt));
+	assert_int_equal(1, cnt);
+
+	/* An underflow is left for the slow path to catch. */
+	cnt = -1;
+	assert_false(_vproc_transaction_fast_begin(&cnt));
+	assert_false(_vproc_transaction_fast_end(&cnt));
+	assert_int_equal(-1, cnt);
+}
+
+void test_vproc_transaction_threads(void **s) {
+	struct vt_state vt;
+
+	/* With nothing else holding a transaction, the threads keep taking the
+	 * count through zero while others are on the fast path.
+	 */
+	vt_init(&vt, true, VT_TEST_PAIRS);
+	vt_run(&vt, 16);
+	assert_false(vt.vt_broken);
+	assert_int_equal(0, vt.vt_cnt);
+	assert_false(vt.vt_dirty);
+	assert_true(vt.vt_flips % 2 == 0);
+	assert_true(vt.vt_flips > 0);
+
+	/* While one is held, nothing reaches the slow path at all. */
+	vt_init(&vt, true, VT_TEST_PAIRS);
+	vt_begin(&vt);
+	vt_run(&vt, 16);
+	assert_false(vt.vt_broken);
+	assert_int_equal(1, vt.vt_flips);
+	vt_end(&vt);
+	assert_int_equal(2, vt.vt_flips);
+	assert_false(vt.vt_dirty);
+}
+
+void bench_vproc_transactions(void **s) {
+	struct vt_state serial, fast;
+	size_t nthreads;
+	double serial_s, fast_s;
+
+	/* A daemon that is busy: one transaction stays open underneath. */
+	for (nthreads = 1; nthreads <= VT_MAX_THREADS; nthreads *= 2) {
+		vt_init(&serial, false, VT_BENCH_PAIRS / nthreads);
+		vt_begin(&serial);
+		serial_s = vt_run(&serial, nthreads);
+		vt_end(&serial);
+
+		vt_init(&fast, true, VT_BENCH_PAIRS / nthreads);
+		vt_begin(&fast);
+		fast_s = vt_run(&fast, nthreads);
+		vt_end(&fast);
+
+		assert_false(serial.vt_broken);
+		assert_false(fast.vt_broken);
+		printf("%2zu threads: serial queue %12.0f pairs/s, fast path %12.0f pairs/s\n",
+			nthreads, VT_BENCH_PAIRS / serial_s, VT_BENCH_PAIRS / fast_s);
+	}
+}
@@ -84,6 +84,7 @@ kern_return_t _vprocmgr_getsocket(name_t);
 struct logmsg_s {
 	union {
 		STAILQ_ENTRY(logmsg_s) sqe;
+		uint64_t flags;		/* launchd-private; zero on the wire */
 		uint64_t __pad;
 	};
 	int64_t when;
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2014 R. Tyler Croy, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __VPROC_TRANSACTION_H__
+#define __VPROC_TRANSACTION_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Only the transaction count's 0->1 and 1->0 transitions do any work: they
+ * mark the process dirty or clean, or hand the count to the gone-to-zero
+ * callout. Those stay on the serial transaction queue. Every other begin and
+ * end just moves the count with a compare-and-swap that never takes it to or
+ * from zero, so the queue sees every transition across zero in order.
+ *
+ * Both return false, having changed nothing, when the caller has to take the
+ * slow path.
+ */
+static inline bool
+_vproc_transaction_fast_begin(int64_t *cnt)
+{
+	int64_t old = *(volatile int64_t *)cnt;
+
+	while (old >= 1) {
+		int64_t seen = __sync_val_compare_and_swap(cnt, old, old + 1);
+		if (seen == old) {
+			return true;
+		}
+		old = seen;
+	}
+	return false;
+}
+
+static inline bool
+_vproc_transaction_fast_end(int64_t *cnt)
+{
+	int64_t old = *(volatile int64_t *)cnt;
+
+	while (old > 1) {
+		int64_t seen = __sync_val_compare_and_swap(cnt, old, old - 1);
+		if (seen == old) {
+			return true;
+		}
+		old = seen;
+	}
+	return false;
+}
+
+#endif /* __VPROC_TRANSACTION_H__ */
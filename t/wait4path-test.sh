@@ -2,8 +2,20 @@
 
 describe "wait4path"
 
+before() {
+    dir=$(mktemp -d /tmp/wait4path-test.XXXXXX)
+}
+
+after() {
+    rm -rf "$dir" "$dir.trace"
+}
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
 it_shows_usage_by_default() {
-    test "$(runit)" = "usage: ${COMMAND} <object on mount point>"
+    test "$(runit)" = "usage: ${COMMAND} [-o] [-t timeout] <object on mount point> ..."
 }
 
 it_exits_for_existing_paths() {
@@ -17,6 +29,71 @@ it_exits_for_existing_mounts() {
     assert_empty $output
 }
 
+it_times_out() {
+    start=$(now_ms)
+    status=0
+    runit -t 0.2 "$dir/a/b" || status=$?
+    test $status = 2
+    test $(( $(now_ms) - start )) -lt 1000
+}
+
+it_waits_for_all_paths() {
+    status=0
+    runit -t 0.2 / "$dir/a" || status=$?
+    test $status = 2
+}
+
+it_waits_for_any_path_with_o() {
+    output=$(runit -o -t 0.2 "$dir/a" /)
+    assert_success $?
+    assert_empty $output
+}
+
+it_wakes_up_when_the_path_appears() {
+    ${COMMAND} -t 5 "$dir/a/b/c" &
+    pid=$!
+    sleep 0.2
+    start=$(now_ms)
+    mkdir -p "$dir/a/b/c"
+    wait $pid
+    assert_success $?
+    latency=$(( $(now_ms) - start ))
+    echo "wake-up latency: ${latency} ms" >&2
+    test $latency -lt 500
+}
+
+it_follows_a_parent_moved_into_place() {
+    mkdir -p "$dir/x/b"
+    ${COMMAND} -t 5 "$dir/a/b/c" &
+    pid=$!
+    sleep 0.2
+    touch "$dir/x/b/c"
+    mv "$dir/x" "$dir/a"
+    wait $pid
+    assert_success $?
+}
+
+# inotify reports every entry created in $dir, so the poll does return; what
+# is ignored is the event, and the path is only ever looked up the once.
+it_ignores_unrelated_changes() {
+    if ! command -v strace >/dev/null; then
+        echo "strace not found, only checking that it keeps waiting" >&2
+        set -- ${COMMAND}
+    else
+        set -- strace -f -qq -s 256 -e trace=%stat -o "$dir.trace" ${COMMAND}
+    fi
+    "$@" -t 0.5 "$dir/a" &
+    pid=$!
+    sleep 0.1
+    touch "$dir/b" "$dir/ab"
+    status=0
+    wait $pid || status=$?
+    test $status = 2
+    if test -f "$dir.trace"; then
+        test $(grep -c "\"$dir/a\"" "$dir.trace") = 1
+    fi
+}
+
 it_should_wait_for_mount() {
     # mkdir /tmp/foo && mdmfs -s 32m md /tmp/foo
     true
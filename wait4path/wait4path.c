@@ -2,40 +2,293 @@
  * Copyright (c) 2005 Apple Computer, Inc. All rights reserved.
  *
  * @APPLE_APACHE_LICENSE_HEADER_START@
- * 
+ *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
  * You may obtain a copy of the License at
- * 
+ *
  *     http://www.apache.org/licenses/LICENSE-2.0
- * 
+ *
  * Unless required by applicable law or agreed to in writing, software
  * distributed under the License is distributed on an "AS IS" BASIS,
  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
  * See the License for the specific language governing permissions and
  * limitations under the License.
- * 
+ *
  * @APPLE_APACHE_LICENSE_HEADER_END@
  */
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <fcntl.h>
+#else
 #include <sys/event.h>
+#endif
 #include <sys/time.h>
 #include <sys/param.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 
-int main(int argc, char *argv[])
+#define EXIT_TIMEDOUT 2
+
+struct w4p_path {
+	const char *path;
+	bool found;
+#ifdef __linux__
+	/* One inotify watch per existing directory along the path, each looking
+	 * out for the component that comes next in it.
+	 */
+	size_t nwatches;
+	int *wds;
+	const char **names;
+	char **comps;
+	size_t ncomps;
+#endif
+};
+
+static struct w4p_path *paths;
+static size_t npaths;
+static size_t nfound;
+static bool any;
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-o] [-t timeout] <object on mount point> ...\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+static bool
+done(void)
+{
+	return any ? nfound > 0 : nfound == npaths;
+}
+
+static void
+check(struct w4p_path *p)
 {
-	int kq = kqueue();
-	struct kevent kev;
 	struct stat sb;
 
-	if (argc != 2) {
-		fprintf(stderr, "usage: %s <object on mount point>\n", argv[0]);
+	if (!p->found && stat(p->path, &sb) == 0) {
+		p->found = true;
+		nfound++;
+	}
+}
+
+/* Milliseconds left until 'deadline', for poll(2), or -1 for no deadline. */
+static int
+remaining(const struct timespec *deadline)
+{
+	struct timespec now;
+	long long ms;
+
+	if (deadline == NULL) {
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (deadline->tv_sec - now.tv_sec) * 1000LL + (deadline->tv_nsec - now.tv_nsec + 999999) / 1000000;
+	return ms > 0 ? (ms > INT_MAX ? INT_MAX : (int)ms) : 0;
+}
+
+#ifdef __linux__
+#define W4P_DIR_EVENTS (IN_CREATE|IN_MOVED_TO|IN_MOVED_FROM|IN_DELETE|IN_ATTRIB|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR)
+
+static int ifd;
+
+static bool
+wd_in_use(int wd)
+{
+	size_t i, j;
+
+	for (i = 0; i < npaths; i++) {
+		for (j = 0; j < paths[i].nwatches; j++) {
+			if (paths[i].wds[j] == wd) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static void
+split(struct w4p_path *p)
+{
+	char *copy, *c, *last;
+
+	if ((copy = strdup(p->path)) == NULL
+			|| (p->comps = calloc(strlen(p->path) / 2 + 1, sizeof(p->comps[0]))) == NULL
+			|| (p->wds = calloc(strlen(p->path) / 2 + 2, sizeof(p->wds[0]))) == NULL
+			|| (p->names = calloc(strlen(p->path) / 2 + 2, sizeof(p->names[0]))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (c = strtok_r(copy, "/", &last); c; c = strtok_r(NULL, "/", &last)) {
+		if (strcmp(c, ".") != 0) {
+			p->comps[p->ncomps++] = c;
+		}
+	}
+}
+
+/* Looks for the path again and moves its watches to the directories that
+ * exist along it now. Returns false if a directory could not be watched.
+ */
+static bool
+rewatch(struct w4p_path *p)
+{
+	int old[p->nwatches + 1];
+	size_t nold = p->nwatches, len, i;
+	char dir[PATH_MAX];
+	struct stat sb;
+	bool ok = true;
+	int n, wd;
+
+	memcpy(old, p->wds, nold * sizeof(old[0]));
+	p->nwatches = 0;
+
+	check(p);
+	if (!p->found) {
+		len = (size_t)snprintf(dir, sizeof(dir), "%s", p->path[0] == '/' ? "/" : ".");
+		for (i = 0; i < p->ncomps; i++) {
+			if ((wd = inotify_add_watch(ifd, dir, W4P_DIR_EVENTS)) == -1) {
+				ok = false;
+				break;
+			}
+			p->wds[p->nwatches] = wd;
+			p->names[p->nwatches++] = p->comps[i];
+
+			if (i + 1 == p->ncomps) {
+				break;
+			}
+			n = snprintf(dir + len, sizeof(dir) - len, "%s%s", dir[len - 1] == '/' ? "" : "/", p->comps[i]);
+			if (n < 0 || (size_t)n >= sizeof(dir) - len) {
+				break;
+			}
+			len += (size_t)n;
+			if (stat(dir, &sb) == -1 || !S_ISDIR(sb.st_mode)) {
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < nold; i++) {
+		if (!wd_in_use(old[i])) {
+			(void)inotify_rm_watch(ifd, old[i]);
+		}
+	}
+
+	return ok;
+}
+
+static bool
+relevant(const struct w4p_path *p, const struct inotify_event *ev)
+{
+	size_t i;
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		return true;
+	}
+	for (i = 0; i < p->nwatches; i++) {
+		if (p->wds[i] == ev->wd && (ev->len == 0 || strcmp(ev->name, p->names[i]) == 0)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Each path's parent directories are watched with inotify, and only an event
+ * about the component that comes next in one of them makes us look again.
+ * Mounts do not show up in the directory they cover, so a change to the mount
+ * table, signalled by POLLPRI on /proc/self/mountinfo, looks at everything
+ * again. Where a directory cannot be watched, we fall back to looking once a
+ * second.
+ */
+static void
+wait4paths(const struct timespec *deadline)
+{
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd[2];
+	bool polling = false, recheck[npaths];
+	const struct inotify_event *ev;
+	ssize_t n;
+	size_t i;
+	int timeout;
+	char *c;
+
+	if ((ifd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) == -1) {
+		fprintf(stderr, "inotify_init1() failed: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	pfd[0].fd = ifd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+	pfd[1].events = POLLPRI;
+
+	for (i = 0; i < npaths; i++) {
+		split(&paths[i]);
+		polling |= !rewatch(&paths[i]);
+	}
+
+	while (!done()) {
+		timeout = remaining(deadline);
+		if (polling && (timeout == -1 || timeout > 1000)) {
+			timeout = 1000;
+		} else if (timeout == 0) {
+			return;
+		}
+
+		pfd[0].revents = pfd[1].revents = 0;
+		if (poll(pfd, 2, timeout) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "poll() failed: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+		memset(recheck, 0, sizeof(recheck));
+		if (polling || (pfd[1].revents & (POLLPRI | POLLERR))) {
+			memset(recheck, 1, sizeof(recheck));
+		}
+		if (pfd[0].revents & POLLIN) {
+			while ((n = read(ifd, buf, sizeof(buf))) > 0) {
+				for (c = buf; c < buf + n; c += sizeof(*ev) + ev->len) {
+					ev = (const struct inotify_event *)c;
+					for (i = 0; i < npaths; i++) {
+						recheck[i] |= relevant(&paths[i], ev);
+					}
+				}
+			}
+		}
+
+		polling = false;
+		for (i = 0; i < npaths; i++) {
+			if (recheck[i] && !paths[i].found) {
+				polling |= !rewatch(&paths[i]);
+			}
+		}
+	}
+}
+#else
+static void
+wait4paths(const struct timespec *deadline)
+{
+	struct timespec ts, *tsp = NULL;
+	struct kevent kev;
+	size_t i;
+	int kq, timeout;
+
+	if ((kq = kqueue()) == -1) {
+		fprintf(stderr, "kqueue() failed: %s\n", strerror(errno));
 		exit(EXIT_FAILURE);
 	}
 
@@ -46,16 +299,72 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	if (stat(argv[1], &sb) == 0) {
-		exit(EXIT_SUCCESS);
+	for (i = 0; i < npaths; i++) {
+		check(&paths[i]);
+	}
+
+	while (!done()) {
+		if ((timeout = remaining(deadline)) == 0) {
+			return;
+		} else if (timeout != -1) {
+			ts.tv_sec = timeout / 1000;
+			ts.tv_nsec = (timeout % 1000) * 1000000L;
+			tsp = &ts;
+		}
+		if (kevent(kq, NULL, 0, &kev, 1, tsp) > 0) {
+			for (i = 0; i < npaths; i++) {
+				check(&paths[i]);
+			}
+		}
 	}
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	struct timespec deadline, *dp = NULL;
+	double timeout;
+	char *endptr;
+	int ch, i;
 
-	for (;;) {
-		kevent(kq, NULL, 0, &kev, 1, NULL);
-		if (stat(argv[1], &sb) == 0) {
+	while ((ch = getopt(argc, argv, "ot:")) != -1) {
+		switch (ch) {
+		case 'o':
+			any = true;
+			break;
+		case 't':
+			timeout = strtod(optarg, &endptr);
+			if (*endptr != '\0' || endptr == optarg || !(timeout >= 0)) {
+				usage(argv[0]);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			deadline.tv_sec += (time_t)timeout;
+			deadline.tv_nsec += (long)((timeout - (time_t)timeout) * 1e9);
+			if (deadline.tv_nsec >= 1000000000L) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			dp = &deadline;
 			break;
+		default:
+			usage(argv[0]);
 		}
 	}
 
-	exit(EXIT_SUCCESS);
+	if (optind == argc) {
+		usage(argv[0]);
+	}
+
+	npaths = (size_t)(argc - optind);
+	if ((paths = calloc(npaths, sizeof(paths[0]))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = optind; i < argc; i++) {
+		paths[i - optind].path = argv[i];
+	}
+
+	wait4paths(dp);
+
+	exit(done() ? EXIT_SUCCESS : EXIT_TIMEDOUT);
 }